@@ -13,8 +13,17 @@
 #include "mathlib/mathlib.h"
 #include "mathlib/vector.h"
 #include "tier1/utlmemory.h"
+#include "tier1/utlvector.h"
 #include "tier1/strtools.h"
 #include "mathlib/compressed_vector.h"
+#include "mathlib/ssemath.h"
+#include "tier0/threadtools.h"
+#include "vstdlib/jobthread.h"
+
+#if !defined( _X360 ) && !defined( _PS3 )
+#include <emmintrin.h>
+#define RESAMPLE_LQ_SSE2 1
+#endif
 
 // Should be last include
 #include "tier0/memdbgon.h"
@@ -86,16 +95,9 @@ void GammaCorrectRGBA8888( unsigned char *src, unsigned char* dst, int width, in
 		return;
 	}
 
-	static unsigned char gamma[256];
-	static float lastSrcGamma = -1;
-	static float lastDstGamma = -1;
-
-	if (lastSrcGamma != srcGamma || lastDstGamma != dstGamma)
-	{
-		ConstructGammaTable( gamma, srcGamma, dstGamma );
-		lastSrcGamma = srcGamma;
-		lastDstGamma = dstGamma;
-	}
+	// Built per call so concurrent callers with different gammas don't share it
+	unsigned char gamma[256];
+	ConstructGammaTable( gamma, srcGamma, dstGamma );
 
 	GammaCorrectRGBA8888( src, dst, width, height, depth, gamma );
 }
@@ -530,6 +532,232 @@ static ApplyKernelFunc_t g_KernelFuncNice[] =
 	ApplyKernelAlphatestNice_t::ApplyKernel,
 };
 
+
+//-----------------------------------------------------------------------------
+// Tiled 2D filter for the default and normal map kernels.
+//
+// Destination tiles run on the job pool. Each tile streams the source rows its
+// kernels cover through a single linearized row of fltx4s and scatters every
+// row into per pixel accumulators, so memory is bounded by the tile size no
+// matter how wide the kernel is. Each pixel sums its samples in the same order
+// as CKernelWrapper::ComputeAveragedColor; gamma encoding is a search of the
+// 8 bit thresholds instead of a pow per channel, so results match the
+// RESAMPLE_REFERENCE path to within RESAMPLE_REFERENCE_TOLERANCE.
+//-----------------------------------------------------------------------------
+#define RESAMPLE_TILE_ROWS				8
+#define RESAMPLE_MIN_TILES				32
+
+// Below this many multiply-adds, the tiles run on the calling thread
+#define RESAMPLE_MIN_PARALLEL_WORK		( 256 * 1024 )
+
+struct ResampleContext_t
+{
+	const ResampleInfo_t *m_pInfo;
+	const KernelInfo_t *m_pKernel;
+	KernelType_t m_Type;
+	bool m_bNiceFilter;
+	int m_nWRatio;
+	int m_nHRatio;
+	int m_nInitialX;
+	int m_nInitialY;
+	const float *m_pGammaToLinear;
+
+	// m_pEncodeThreshold[k] is the smallest linear value that gamma encodes to k
+	float m_pEncodeThreshold[256];
+};
+
+struct ResampleTile_t
+{
+	const ResampleContext_t *m_pContext;
+	int m_nFirstRow;
+	int m_nRowCount;
+	int m_nFirstCol;
+	int m_nColCount;
+};
+
+static inline int WrapOrClampCoord( int x, int nSize, bool bClamp )
+{
+	// Wrapping works since sizes are powers of two, even for negative #s
+	return bClamp ? clamp( x, 0, nSize - 1 ) : ( x & ( nSize - 1 ) );
+}
+
+static inline unsigned char GammaEncode( const float *pEncodeThreshold, float flLinear )
+{
+	// Branchless binary search; the comparisons are unpredictable
+	int k = 0;
+	for ( int nStep = 128; nStep != 0; nStep >>= 1 )
+	{
+		k += ( flLinear >= pEncodeThreshold[k + nStep] ) ? nStep : 0;
+	}
+	return (unsigned char)k;
+}
+
+static void ResampleTile( ResampleTile_t &tile )
+{
+	const ResampleContext_t &ctx = *tile.m_pContext;
+	const ResampleInfo_t &info = *ctx.m_pInfo;
+	const KernelInfo_t &kernel = *ctx.m_pKernel;
+	bool bClampS = ( info.m_nFlags & RESAMPLE_CLAMPS ) != 0;
+	bool bClampT = ( info.m_nFlags & RESAMPLE_CLAMPT ) != 0;
+
+	int nFirstStartX = ctx.m_nWRatio * tile.m_nFirstCol + ctx.m_nInitialX;
+	int nRowLength = ( tile.m_nColCount - 1 ) * ctx.m_nWRatio + kernel.m_nWidth;
+	int nFirstStartY = ctx.m_nHRatio * tile.m_nFirstRow + ctx.m_nInitialY;
+	int nEndSrcY = ctx.m_nHRatio * ( tile.m_nFirstRow + tile.m_nRowCount - 1 ) + ctx.m_nInitialY + kernel.m_nHeight;
+
+	CUtlMemoryAligned<fltx4, 16> row( 0, nRowLength );
+	CUtlMemoryAligned<fltx4, 16> accum( 0, tile.m_nRowCount * tile.m_nColCount );
+	for ( int i = 0; i < tile.m_nRowCount * tile.m_nColCount; ++i )
+	{
+		accum[i] = LoadZeroSIMD();
+	}
+
+	for ( int srcY = nFirstStartY; srcY < nEndSrcY; ++srcY )
+	{
+		// Linearize the part of the source row the tile's kernels cover
+		const unsigned char *pSrcRow = info.m_pSrc + WrapOrClampCoord( srcY, info.m_nSrcHeight, bClampT ) * info.m_nSrcWidth * 4;
+		for ( int x = 0; x < nRowLength; ++x )
+		{
+			int sx = nFirstStartX + x;
+			if ( sx < 0 || sx >= info.m_nSrcWidth )
+			{
+				sx = WrapOrClampCoord( sx, info.m_nSrcWidth, bClampS );
+			}
+			const unsigned char *pSrcPixel = pSrcRow + sx * 4;
+			float *pLinear = (float *)&row[x];
+			if ( ctx.m_Type == KERNEL_NORMALMAP )
+			{
+				pLinear[0] = pSrcPixel[0];
+				pLinear[1] = pSrcPixel[1];
+				pLinear[2] = pSrcPixel[2];
+			}
+			else
+			{
+				pLinear[0] = ctx.m_pGammaToLinear[ pSrcPixel[0] ];
+				pLinear[1] = ctx.m_pGammaToLinear[ pSrcPixel[1] ];
+				pLinear[2] = ctx.m_pGammaToLinear[ pSrcPixel[2] ];
+			}
+			pLinear[3] = pSrcPixel[3];
+		}
+
+		// Add it to every destination row whose kernel covers it
+		for ( int r = 0; r < tile.m_nRowCount; ++r )
+		{
+			int k = srcY - ( ctx.m_nHRatio * ( tile.m_nFirstRow + r ) + ctx.m_nInitialY );
+			if ( k < 0 || k >= kernel.m_nHeight )
+				continue;
+
+			fltx4 *pAccum = &accum[r * tile.m_nColCount];
+			if ( ctx.m_bNiceFilter )
+			{
+				const float *pKernelRow = kernel.m_pKernel + k * kernel.m_nWidth;
+				for ( int c = 0; c < tile.m_nColCount; ++c )
+				{
+					const fltx4 *pSamples = &row[c * ctx.m_nWRatio];
+					fltx4 total = pAccum[c];
+					for ( int l = 0; l < kernel.m_nWidth; ++l )
+					{
+						if ( pKernelRow[l] == 0.0f )
+							continue;
+						total = MaddSIMD( ReplicateX4( pKernelRow[l] ), pSamples[l], total );
+					}
+					pAccum[c] = total;
+				}
+			}
+			else
+			{
+				fltx4 factor = ReplicateX4( kernel.m_pKernel[0] );
+				for ( int c = 0; c < tile.m_nColCount; ++c )
+				{
+					const fltx4 *pSamples = &row[c * ctx.m_nWRatio];
+					fltx4 total = pAccum[c];
+					for ( int l = 0; l < kernel.m_nWidth; ++l )
+					{
+						total = MaddSIMD( factor, pSamples[l], total );
+					}
+					pAccum[c] = total;
+				}
+			}
+		}
+	}
+
+	for ( int r = 0; r < tile.m_nRowCount; ++r )
+	{
+		unsigned char *pDest = info.m_pDest + ( ( tile.m_nFirstRow + r ) * info.m_nDestWidth + tile.m_nFirstCol ) * 4;
+		for ( int c = 0; c < tile.m_nColCount; ++c, pDest += 4 )
+		{
+			const float *total = (const float *)&accum[r * tile.m_nColCount + c];
+			if ( ctx.m_Type == KERNEL_NORMALMAP )
+			{
+				for ( int ch = 0; ch < 4; ++ ch )
+					pDest[ch] = Clamp( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( total[ch] - info.m_flColorGoal[ch] ) ) );
+			}
+			else
+			{
+				for ( int ch = 0; ch < 3; ++ ch )
+					pDest[ch] = GammaEncode( ctx.m_pEncodeThreshold, info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( ( total[ch] > 0 ? total[ch] : 0 ) - info.m_flColorGoal[ch] ) ) );
+				pDest[3] = Clamp( info.m_flColorGoal[3] + ( info.m_flColorScale[3] * ( total[3] - info.m_flColorGoal[3] ) ) );
+			}
+		}
+	}
+}
+
+static void ResampleTiled( const KernelInfo_t &kernel, const ResampleInfo_t &info, KernelType_t type, int wratio, int hratio, const float *gammaToLinear )
+{
+	ResampleContext_t ctx;
+	ctx.m_pInfo = &info;
+	ctx.m_pKernel = &kernel;
+	ctx.m_Type = type;
+	ctx.m_bNiceFilter = ( info.m_nFlags & RESAMPLE_NICE_FILTER ) != 0;
+	ctx.m_nWRatio = wratio;
+	ctx.m_nHRatio = hratio;
+	ctx.m_nInitialX = (wratio >> 1) - ((wratio * kernel.m_nDiameter) >> 1);
+	ctx.m_nInitialY = (hratio >> 1) - ((hratio * kernel.m_nDiameter) >> 1);
+	ctx.m_pGammaToLinear = gammaToLinear;
+
+	// Encoding to k means 255 * pow( x / 255, 1 / dstGamma ) rounds to k
+	ctx.m_pEncodeThreshold[0] = -FLT_MAX;
+	for ( int k = 1; k < 256; ++k )
+	{
+		ctx.m_pEncodeThreshold[k] = 255.0 * pow( ( k - 0.5 ) / 255.0, (double)info.m_flDestGamma );
+	}
+
+	// Split rows first; when there are few of them, split columns too so the
+	// small mips still spread across the pool
+	int nRowTiles = ( info.m_nDestHeight + RESAMPLE_TILE_ROWS - 1 ) / RESAMPLE_TILE_ROWS;
+	int nColTiles = clamp( RESAMPLE_MIN_TILES / nRowTiles, 1, info.m_nDestWidth );
+	int nTileCols = ( info.m_nDestWidth + nColTiles - 1 ) / nColTiles;
+	nColTiles = ( info.m_nDestWidth + nTileCols - 1 ) / nTileCols;
+
+	CUtlVector<ResampleTile_t> tiles;
+	tiles.EnsureCapacity( nRowTiles * nColTiles );
+	for ( int y = 0; y < info.m_nDestHeight; y += RESAMPLE_TILE_ROWS )
+	{
+		for ( int x = 0; x < info.m_nDestWidth; x += nTileCols )
+		{
+			ResampleTile_t &tile = tiles[ tiles.AddToTail() ];
+			tile.m_pContext = &ctx;
+			tile.m_nFirstRow = y;
+			tile.m_nRowCount = MIN( RESAMPLE_TILE_ROWS, info.m_nDestHeight - y );
+			tile.m_nFirstCol = x;
+			tile.m_nColCount = MIN( nTileCols, info.m_nDestWidth - x );
+		}
+	}
+
+	int64 nWork = (int64)info.m_nDestWidth * info.m_nDestHeight * kernel.m_nWidth * kernel.m_nHeight;
+	if ( tiles.Count() > 1 && nWork >= RESAMPLE_MIN_PARALLEL_WORK )
+	{
+		ParallelProcess( "ResampleRGBA8888", tiles.Base(), tiles.Count(), &ResampleTile );
+	}
+	else
+	{
+		for ( int i = 0; i < tiles.Count(); ++i )
+		{
+			ResampleTile( tiles[i] );
+		}
+	}
+}
+
 bool ResampleRGBA8888( const ResampleInfo_t& info )
 {
 	// No resampling needed, just gamma correction
@@ -554,14 +782,8 @@ bool ResampleRGBA8888( const ResampleInfo_t& info )
 	}
 
 	// Compute gamma tables...
-	static float gammaToLinear[256];
-	static float lastSrcGamma = -1;
-
-	if (lastSrcGamma != info.m_flSrcGamma)
-	{
-		ConstructFloatGammaTable( gammaToLinear, info.m_flSrcGamma, 1.0f );
-		lastSrcGamma =  info.m_flSrcGamma;
-	}
+	float gammaToLinear[256];
+	ConstructFloatGammaTable( gammaToLinear, info.m_flSrcGamma, 1.0f );
 
 	int wratio = info.m_nSrcWidth / info.m_nDestWidth;
 	int hratio = info.m_nSrcHeight / info.m_nDestHeight;
@@ -611,6 +833,8 @@ bool ResampleRGBA8888( const ResampleInfo_t& info )
 
 		if (power >= 0)
 		{
+			static CThreadFastMutex s_KernelCacheMutex;
+			AUTO_LOCK( s_KernelCacheMutex );
 			if (!kernelCache[power])
 			{
 				kernelCache[power] = new float[kernel.m_nWidth * kernel.m_nHeight];
@@ -665,7 +889,15 @@ bool ResampleRGBA8888( const ResampleInfo_t& info )
 		type = KERNEL_DEFAULT;
 	}
 
-	if ( info.m_nFlags & RESAMPLE_NICE_FILTER )
+	if ( type != KERNEL_ALPHATEST && dratio == 0 && info.m_nSrcDepth == 1 && !( info.m_nFlags & RESAMPLE_REFERENCE ) )
+	{
+		ResampleTiled( kernel, info, type, wratio, hratio, gammaToLinear );
+		if (pTempMemory)
+		{
+			delete[] pTempMemory;
+		}
+	}
+	else if ( info.m_nFlags & RESAMPLE_NICE_FILTER )
 	{	
 		g_KernelFuncNice[type]( kernel, info, wratio, hratio, dratio, gammaToLinear, pAlphaResult );
 		if (pTempMemory)
@@ -889,7 +1121,37 @@ void GenerateMipmapLevelsLQ( unsigned char* pSrc, unsigned char* pDst, int width
 
 		for ( int j = 0; j < dstHeight; ++j )
 		{
-			for ( int i = 0; i < dstWidth; ++i ) 
+			int i = 0;
+#ifdef RESAMPLE_LQ_SSE2
+			// Four destination pixels at a time, same truncating average as below
+			if ( cSrcStride && cSrcPitch )
+			{
+				const __m128i zero = _mm_setzero_si128();
+				for ( ; i + 4 <= dstWidth; i += 4 )
+				{
+					__m128i top0 = _mm_loadu_si128( (const __m128i *)pSrcPixel );
+					__m128i top1 = _mm_loadu_si128( (const __m128i *)( pSrcPixel + 16 ) );
+					__m128i bot0 = _mm_loadu_si128( (const __m128i *)( pSrcPixel + cSrcPitch ) );
+					__m128i bot1 = _mm_loadu_si128( (const __m128i *)( pSrcPixel + cSrcPitch + 16 ) );
+
+					// Vertical sums of source pixels 0,1 / 2,3 / 4,5 / 6,7 as 16 bit channels
+					__m128i p01 = _mm_add_epi16( _mm_unpacklo_epi8( top0, zero ), _mm_unpacklo_epi8( bot0, zero ) );
+					__m128i p23 = _mm_add_epi16( _mm_unpackhi_epi8( top0, zero ), _mm_unpackhi_epi8( bot0, zero ) );
+					__m128i p45 = _mm_add_epi16( _mm_unpacklo_epi8( top1, zero ), _mm_unpacklo_epi8( bot1, zero ) );
+					__m128i p67 = _mm_add_epi16( _mm_unpackhi_epi8( top1, zero ), _mm_unpackhi_epi8( bot1, zero ) );
+
+					// Horizontal pairs
+					__m128i d01 = _mm_add_epi16( _mm_unpacklo_epi64( p01, p23 ), _mm_unpackhi_epi64( p01, p23 ) );
+					__m128i d23 = _mm_add_epi16( _mm_unpacklo_epi64( p45, p67 ), _mm_unpackhi_epi64( p45, p67 ) );
+
+					_mm_storeu_si128( (__m128i *)pDstPixel, _mm_packus_epi16( _mm_srli_epi16( d01, 2 ), _mm_srli_epi16( d23, 2 ) ) );
+
+					pDstPixel += cStride * 4;
+					pSrcPixel += cStride * 8;
+				}
+			}
+#endif
+			for ( ; i < dstWidth; ++i ) 
 			{
 				// This doesn't round. It's crappy. It's a simple bilerp. 
 				pDstPixel[ 0 ] = ( ( unsigned int ) pSrcPixel[ 0 ] + ( unsigned int ) pSrcPixel[ 0 + cSrcStride ] + ( unsigned int ) pSrcPixel[ 0 + cSrcPitch ] + ( unsigned int ) pSrcPixel[ 0 + cSrcPitch + cSrcStride ] ) >> 2;
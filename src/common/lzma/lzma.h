@@ -32,6 +32,18 @@ unsigned char	*pInput,
 unsigned int	inputSize,
 unsigned int	*pOutputSize );
 
+//-----------------------------------------------------------------------------
+// Encodes chunkSize sized pieces of the input independently, on nThreads
+// threads (<= 0 for one per logical processor), into a lzma_chunked_header_t
+// buffer. Returns non-null Compressed buffer if successful. Caller must free.
+//-----------------------------------------------------------------------------
+unsigned char *LZMA_CompressChunked(
+unsigned char	*pInput,
+unsigned int	inputSize,
+unsigned int	chunkSize,
+int				nThreads,
+unsigned int	*pOutputSize );
+
 //-----------------------------------------------------------------------------
 // Above, but returns null if compression would not yield a size improvement
 //-----------------------------------------------------------------------------
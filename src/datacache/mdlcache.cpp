@@ -503,8 +503,8 @@ private:
 	FSAsyncStatus_t LoadData( const char *pszFilename, const char *pszPathID, bool bAsync, FSAsyncControl_t *pControl ) { return LoadData( pszFilename, pszPathID, NULL, 0, 0, bAsync, pControl ); }
 	FSAsyncStatus_t LoadData( const char *pszFilename, const char *pszPathID, void *pDest, int nBytes, int nOffset, bool bAsync, FSAsyncControl_t *pControl );
 	vertexFileHeader_t *LoadVertexData( studiohdr_t *pStudioHdr );
-	vertexFileHeader_t *BuildAndCacheVertexData( studiohdr_t *pStudioHdr, vertexFileHeader_t *pRawVvdHdr  );
-	bool BuildHardwareData( MDLHandle_t handle, studiodata_t *pStudioData, studiohdr_t *pStudioHdr, OptimizedModel::FileHeader_t *pVtxHdr );
+	vertexFileHeader_t *BuildAndCacheVertexData( studiohdr_t *pStudioHdr, vertexFileHeader_t *pRawVvdHdr, int nDataSize );
+	bool BuildHardwareData( MDLHandle_t handle, studiodata_t *pStudioData, studiohdr_t *pStudioHdr, OptimizedModel::FileHeader_t *pVtxHdr, int nDataSize );
 	void ConvertFlexData( studiohdr_t *pStudioHdr );
 
 	int ProcessPendingAsync( int iAsync );
@@ -1630,7 +1630,7 @@ void CMDLCache::ConvertFlexData( studiohdr_t *pStudioHdr )
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
-bool CMDLCache::BuildHardwareData( MDLHandle_t handle, studiodata_t *pStudioData, studiohdr_t *pStudioHdr, OptimizedModel::FileHeader_t *pVtxHdr )
+bool CMDLCache::BuildHardwareData( MDLHandle_t handle, studiodata_t *pStudioData, studiohdr_t *pStudioHdr, OptimizedModel::FileHeader_t *pVtxHdr, int nDataSize )
 {
 	if ( pVtxHdr )
 	{
@@ -1661,6 +1661,12 @@ bool CMDLCache::BuildHardwareData( MDLHandle_t handle, studiodata_t *pStudioData
 		unsigned char *pInputData = (unsigned char *)pVtxHdr + sizeof( OptimizedModel::FileHeader_t );
 		if ( CLZMA::IsCompressed( pInputData ) )
 		{
+			if ( nDataSize < (int)sizeof( OptimizedModel::FileHeader_t ) ||
+				!CLZMA::IsInputValid( pInputData, nDataSize - sizeof( OptimizedModel::FileHeader_t ) ) )
+			{
+				return false;
+			}
+
 			// vtx arrives compressed, decode and cache the results
 			unsigned int nOriginalSize = CLZMA::GetActualSize( pInputData );
 			pOriginalData.Alloc( sizeof( OptimizedModel::FileHeader_t ) + nOriginalSize );
@@ -1945,6 +1951,11 @@ studiohdr_t *CMDLCache::UnserializeMDL( MDLHandle_t handle, void *pData, int nDa
 	{
 		if ( CLZMA::IsCompressed( (unsigned char *)pData ) )
 		{
+			if ( !CLZMA::IsInputValid( (unsigned char *)pData, nDataSize ) )
+			{
+				return NULL;
+			}
+
 			// mdl arrives compressed, decode and cache the results
 			unsigned int nOriginalSize = CLZMA::GetActualSize( (unsigned char *)pData );
 			pOriginalData.Alloc( nOriginalSize );
@@ -2041,6 +2052,12 @@ bool CMDLCache::ReadMDLFile( MDLHandle_t handle, const char *pMDLFileName, CUtlB
 	{
 		if ( CLZMA::IsCompressed( (unsigned char *)buf.PeekGet() ) )
 		{
+			if ( !CLZMA::IsInputValid( (unsigned char *)buf.PeekGet(), buf.GetBytesRemaining() ) )
+			{
+				DevWarning( "Failed to load %s!\n", pMDLFileName );
+				return false;
+			}
+
 			// mdl arrives compressed, decode and cache the results
 			unsigned int nOriginalSize = CLZMA::GetActualSize( (unsigned char *)buf.PeekGet() );
 			void *pOriginalData = malloc( nOriginalSize );
@@ -2855,7 +2872,7 @@ bool CMDLCache::ProcessDataIntoCache( MDLHandle_t handle, MDLCacheDataType_t typ
 		{
 			if ( bDataValid )
 			{
-				BuildAndCacheVertexData( pStudioHdrCurrent, (vertexFileHeader_t *)pData );
+				BuildAndCacheVertexData( pStudioHdrCurrent, (vertexFileHeader_t *)pData, nDataSize );
 			}
 			else
 			{
@@ -2874,7 +2891,7 @@ bool CMDLCache::ProcessDataIntoCache( MDLHandle_t handle, MDLCacheDataType_t typ
 		{
 			if ( bDataValid )
 			{
-				BuildHardwareData( handle, pStudioDataCurrent, pStudioHdrCurrent, (OptimizedModel::FileHeader_t *)pData );
+				BuildHardwareData( handle, pStudioDataCurrent, pStudioHdrCurrent, (OptimizedModel::FileHeader_t *)pData, nDataSize );
 			}
 			else
 			{
@@ -2934,6 +2951,11 @@ bool CMDLCache::ProcessDataIntoCache( MDLHandle_t handle, MDLCacheDataType_t typ
 				{
 					if ( CLZMA::IsCompressed( (unsigned char *)pData ) )
 					{
+						if ( !CLZMA::IsInputValid( (unsigned char *)pData, nDataSize ) )
+						{
+							return false;
+						}
+
 						// anim block arrives compressed, decode and cache the results
 						unsigned int nOriginalSize = CLZMA::GetActualSize( (unsigned char *)pData );
 
@@ -2984,6 +3006,11 @@ bool CMDLCache::ProcessDataIntoCache( MDLHandle_t handle, MDLCacheDataType_t typ
 				{
 					if ( CLZMA::IsCompressed( (unsigned char *)pData ) )
 					{
+						if ( !CLZMA::IsInputValid( (unsigned char *)pData, nDataSize ) )
+						{
+							return NULL;
+						}
+
 						// phy arrives compressed, decode and cache the results
 						unsigned int nOriginalSize = CLZMA::GetActualSize( (unsigned char *)pData );
 						pOriginalData.Alloc( nOriginalSize );
@@ -3240,7 +3267,7 @@ bool CMDLCache::SetAsyncLoad( MDLCacheDataType_t type, bool bAsync )
 //-----------------------------------------------------------------------------
 // Cache model's specified dynamic data
 //-----------------------------------------------------------------------------
-vertexFileHeader_t *CMDLCache::BuildAndCacheVertexData( studiohdr_t *pStudioHdr, vertexFileHeader_t *pRawVvdHdr  )
+vertexFileHeader_t *CMDLCache::BuildAndCacheVertexData( studiohdr_t *pStudioHdr, vertexFileHeader_t *pRawVvdHdr, int nDataSize )
 {
 	MDLHandle_t	handle = (MDLHandle_t)(int)pStudioHdr->virtualModel&0xffff;
 	vertexFileHeader_t *pVvdHdr;
@@ -3278,6 +3305,12 @@ vertexFileHeader_t *CMDLCache::BuildAndCacheVertexData( studiohdr_t *pStudioHdr,
 		unsigned char *pInput = (unsigned char *)pRawVvdHdr + sizeof( vertexFileHeader_t );
 		if ( CLZMA::IsCompressed( pInput ) )
 		{
+			if ( nDataSize < (int)sizeof( vertexFileHeader_t ) ||
+				!CLZMA::IsInputValid( pInput, nDataSize - sizeof( vertexFileHeader_t ) ) )
+			{
+				return NULL;
+			}
+
 			// vvd arrives compressed, decode and cache the results
 			unsigned int nOriginalSize = CLZMA::GetActualSize( pInput );
 			pOriginalData.Alloc( sizeof( vertexFileHeader_t ) + nOriginalSize );
@@ -35,9 +35,12 @@ CDmxElement* CreateDmxElement( const char *pType )
 CDmxElement::CDmxElement( const char *pType )
 {
 	m_Type = s_TypeSymbols.AddString( pType );
+	m_pLazyFile = NULL;
+	m_nLazyIndex = -1;
 	m_nLockCount = 0;
 	m_bResortNeeded = false;
 	m_bIsMarkedForDeletion = false;
+	m_bLazyAttributes = false;
 	CreateUniqueId( &m_Id );
 }
 
@@ -178,6 +181,9 @@ void CDmxElement::RemoveAllAttributes()
 	}
 	m_Attributes.RemoveAll();
 	m_bResortNeeded = false;
+
+	// Attributes still in a lazily loaded file are removed too
+	m_bLazyAttributes = false;
 }
 
 
@@ -217,6 +223,7 @@ int CDmxElement::FindAttribute( const char *pAttributeName ) const
 	// where log N is the binary search for the symbol match
 	// and log M is the binary search for the attribute name->symbol
 	// We can eliminate log M by using a hash table in the symbol lookup
+	LoadLazyAttributes();
 	Resort();
 	CDmxAttribute search( pAttributeName );
 	return m_Attributes.Find( &search );
@@ -228,6 +235,7 @@ int CDmxElement::FindAttribute( const char *pAttributeName ) const
 //-----------------------------------------------------------------------------
 int CDmxElement::FindAttribute( CUtlSymbolLarge attributeName ) const
 {
+	LoadLazyAttributes();
 	Resort();
 	CDmxAttribute search( attributeName );
 	return m_Attributes.Find( &search );
@@ -265,16 +273,19 @@ const CDmxAttribute *CDmxElement::GetAttribute( const char *pAttributeName ) con
 //-----------------------------------------------------------------------------
 int CDmxElement::AttributeCount() const
 {
+	LoadLazyAttributes();
 	return m_Attributes.Count();
 }
 
 CDmxAttribute *CDmxElement::GetAttribute( int nIndex )
 {
+	LoadLazyAttributes();
 	return m_Attributes[ nIndex ];
 }
 
 const CDmxAttribute *CDmxElement::GetAttribute( int nIndex ) const
 {
+	LoadLazyAttributes();
 	return m_Attributes[ nIndex ];
 }
 
@@ -290,6 +301,11 @@ void CDmxElement::AddElementsToDelete( CUtlVector< CDmxElement * >& elementsToDe
 	m_bIsMarkedForDeletion = true;
 	elementsToDelete.AddToTail( this );
 
+	// Attributes that were never read own no memory. Elements they reference
+	// that were read are reachable through read attributes as well.
+	if ( m_bLazyAttributes )
+		return;
+
 	int nCount = AttributeCount();
 	for ( int i = 0; i < nCount; ++i )
 	{
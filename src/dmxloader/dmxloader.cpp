@@ -14,12 +14,35 @@
 #include "tier1/memstack.h"
 
 
+//-----------------------------------------------------------------------------
+// A binary file loaded lazily. The file image is kept until the DMX context
+// ends; each element remembers where its attributes start in it and reads
+// them the first time they are accessed.
+//-----------------------------------------------------------------------------
+class CDmxLazyFile
+{
+public:
+	CUtlBuffer m_Image;
+	CUtlVector< int > m_StringOffsets;
+	int m_nStringTableOffset;	// -1 for files without a string table
+	CUtlVector< CDmxElement* > m_Elements;
+	CUtlVector< int > m_NameOffsets;
+	CUtlVector< int > m_AttributeOffsets;
+};
+
+
 //-----------------------------------------------------------------------------
 // DMX elements/attributes can only be accessed inside a dmx context
 //-----------------------------------------------------------------------------
 static int s_bInDMXContext;
 CMemoryStack s_DMXAllocator;
 static bool s_bAllocatorInitialized;
+static CUtlVector< CDmxLazyFile* > s_LazyFiles;
+
+static void FreeLazyFiles()
+{
+	s_LazyFiles.PurgeAndDeleteElements();
+}
 
 void BeginDMXContext( )
 {
@@ -39,11 +62,23 @@ void EndDMXContext( bool bDecommitMemory )
 	Assert( s_bInDMXContext );
 	s_bInDMXContext = false;
 	s_DMXAllocator.FreeAll( bDecommitMemory );
+	FreeLazyFiles();
 }
 
 void DecommitDMXMemory()
 {
 	s_DMXAllocator.FreeAll( true );
+	FreeLazyFiles();
+}
+
+int DMXMemoryUsed()
+{
+	int nUsed = s_bAllocatorInitialized ? s_DMXAllocator.GetUsed() : 0;
+	for ( int i = 0; i < s_LazyFiles.Count(); ++i )
+	{
+		nUsed += s_LazyFiles[i]->m_Image.Size();
+	}
+	return nUsed;
 }
 
 
@@ -83,6 +118,8 @@ class CDmxSerializer
 {
 public:
 	bool Unserialize( CUtlBuffer &buf, int nEncodingVersion, CDmxElement **ppRoot );
+	bool UnserializeLazy( CDmxLazyFile *pFile, int nEncodingVersion, CDmxElement **ppRoot );
+	bool UnserializeLazyAttributes( CDmxLazyFile *pFile, CDmxElement *pElement );
 	bool Serialize( CUtlBuffer &buf, CDmxElement *pRoot, const char *pFileName );
 
 private:
@@ -100,6 +137,7 @@ private:
 	void UnserializeElementArrayAttribute( CUtlBuffer &buf, CDmxAttribute *pAttribute, CUtlVector<CDmxElement*> &elementList );
 	bool UnserializeAttributes( CUtlBuffer &buf, CDmxElement *pElement, CUtlVector<CDmxElement*> &elementList, int nStrings, int *offsetTable, char *stringTable );
 	int GetStringOffsetTable( CUtlBuffer &buf, int *offsetTable, int nStrings );
+	bool SkipAttributes( CUtlBuffer &buf, bool bHasStringTable );
 };
 
 
@@ -503,6 +541,261 @@ bool CDmxSerializer::Unserialize( CUtlBuffer &buf, int nEncodingVersion, CDmxEle
 }
 
 
+//-----------------------------------------------------------------------------
+// Skips over attribute values without reading them
+//-----------------------------------------------------------------------------
+static bool SkipBytes( CUtlBuffer &buf, int nBytes )
+{
+	if ( nBytes < 0 || nBytes > buf.GetBytesRemaining() )
+		return false;
+
+	buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nBytes );
+	return true;
+}
+
+static bool SkipString( CUtlBuffer &buf )
+{
+	int nLen = buf.PeekStringLength();
+	return ( nLen > 0 ) && SkipBytes( buf, nLen );
+}
+
+// Size of a value in a binary file, or 0 if it isn't fixed
+static int BinaryValueSize( DmAttributeType_t type )
+{
+	switch( type )
+	{
+	case AT_BOOL:
+		return 1;
+
+	case AT_ELEMENT:
+	case AT_INT:
+	case AT_FLOAT:
+	case AT_COLOR:
+		return 4;
+
+	case AT_VECTOR2:
+		return 8;
+
+	case AT_VECTOR3:
+	case AT_QANGLE:
+		return 12;
+
+	case AT_OBJECTID:
+	case AT_VECTOR4:
+	case AT_QUATERNION:
+		return 16;
+
+	case AT_VMATRIX:
+		return 64;
+	}
+
+	return 0;
+}
+
+static bool SkipValue( CUtlBuffer &buf, DmAttributeType_t type )
+{
+	if ( type == AT_STRING )
+		return SkipString( buf );
+
+	if ( type == AT_VOID )
+		return SkipBytes( buf, buf.GetInt() );
+
+	int nSize = BinaryValueSize( type );
+	return ( nSize > 0 ) && SkipBytes( buf, nSize );
+}
+
+static bool SkipAttributeValue( CUtlBuffer &buf, DmAttributeType_t type )
+{
+	if ( !IsArrayType( type ) )
+		return SkipValue( buf, type );
+
+	int nCount = buf.GetInt();
+	if ( nCount < 0 || !buf.IsValid() )
+		return false;
+
+	DmAttributeType_t valueType = ArrayTypeToValueType( type );
+	int nSize = BinaryValueSize( valueType );
+	if ( nSize > 0 )
+	{
+		if ( nCount > buf.GetBytesRemaining() / nSize )
+			return false;
+		return SkipBytes( buf, nCount * nSize );
+	}
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		if ( !SkipValue( buf, valueType ) )
+			return false;
+	}
+	return true;
+}
+
+bool CDmxSerializer::SkipAttributes( CUtlBuffer &buf, bool bHasStringTable )
+{
+	int nAttributeCount = buf.GetInt();
+	if ( nAttributeCount < 0 )
+		return false;
+
+	for ( int i = 0; i < nAttributeCount; ++i )
+	{
+		if ( bHasStringTable )
+		{
+			buf.GetShort();
+		}
+		else if ( !SkipString( buf ) )
+		{
+			return false;
+		}
+
+		DmAttributeType_t nAttributeType = (DmAttributeType_t)buf.GetChar();
+		if ( !buf.IsValid() || !SkipAttributeValue( buf, nAttributeType ) )
+			return false;
+	}
+
+	return buf.IsValid();
+}
+
+
+//-----------------------------------------------------------------------------
+// Lazy unserialization: creates every element, but only finds where the
+// attributes of each one start
+//-----------------------------------------------------------------------------
+bool CDmxSerializer::UnserializeLazy( CDmxLazyFile *pFile, int nEncodingVersion, CDmxElement **ppRoot )
+{
+	if ( nEncodingVersion < 0 || nEncodingVersion > 2 )
+		return false;
+
+	bool bReadStringTable = nEncodingVersion >= 2;
+	CUtlBuffer &buf = pFile->m_Image;
+
+	// Keep reading until we read a NULL terminator
+	while( buf.GetChar() != 0 )
+	{
+		if ( !buf.IsValid() )
+			return false;
+	}
+
+	// Index the string table; the strings stay in the image
+	int nStrings = 0;
+	pFile->m_nStringTableOffset = -1;
+	if ( bReadStringTable )
+	{
+		nStrings = buf.GetShort();
+		if ( nStrings > 0 )
+		{
+			pFile->m_StringOffsets.SetCount( nStrings );
+			int nStringMemoryUsage = GetStringOffsetTable( buf, pFile->m_StringOffsets.Base(), nStrings );
+			pFile->m_nStringTableOffset = buf.TellGet();
+			if ( nStringMemoryUsage <= 0 || !SkipBytes( buf, nStringMemoryUsage ) )
+				return false;
+		}
+	}
+
+	// Read in the element count.
+	const int nElementCount = buf.GetInt();
+	if ( !nElementCount )
+	{
+		// Empty (but valid) file
+		return true;
+	}
+
+	if ( nElementCount < 0 || ( bReadStringTable && pFile->m_nStringTableOffset < 0 ) )
+	{
+		// Invalid file. Non-empty files with a string table need at least one to associate with elements.
+		return false;
+	}
+
+	const char *pStringTable = bReadStringTable ? (const char*)buf.Base() + pFile->m_nStringTableOffset : NULL;
+	char pTypeBuf[256];
+	DmObjectId_t id;
+
+	// Create all elements; their names are read along with their attributes
+	pFile->m_Elements.EnsureCapacity( nElementCount );
+	pFile->m_NameOffsets.EnsureCapacity( nElementCount );
+	for ( int i = 0; i < nElementCount; ++i )
+	{
+		const char *pType = NULL;
+		if ( pStringTable )
+		{
+			int si = buf.GetShort();
+			if ( si >= nStrings )
+				return false;
+			pType = pStringTable + pFile->m_StringOffsets[ si ];
+		}
+		else
+		{
+			buf.GetString<256>( pTypeBuf );
+			pType = pTypeBuf;
+		}
+
+		pFile->m_NameOffsets.AddToTail( buf.TellGet() );
+		if ( !SkipString( buf ) )
+			return false;
+		buf.Get( &id, sizeof(DmObjectId_t) );
+		if ( !buf.IsValid() )
+			return false;
+
+		CDmxElement *pElement = new CDmxElement( pType );
+		pElement->SetId( id );
+		pElement->m_pLazyFile = pFile;
+		pElement->m_nLazyIndex = i;
+		pElement->m_bLazyAttributes = true;
+		pFile->m_Elements.AddToTail( pElement );
+	}
+
+	// Find the start of each element's attributes
+	pFile->m_AttributeOffsets.EnsureCapacity( nElementCount );
+	for ( int i = 0; i < nElementCount; ++i )
+	{
+		pFile->m_AttributeOffsets.AddToTail( buf.TellGet() );
+		if ( !SkipAttributes( buf, bReadStringTable ) )
+			return false;
+	}
+
+	// The root is the 0th element
+	*ppRoot = pFile->m_Elements[ 0 ];
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reads the attributes of a lazily loaded element
+//-----------------------------------------------------------------------------
+bool CDmxSerializer::UnserializeLazyAttributes( CDmxLazyFile *pFile, CDmxElement *pElement )
+{
+	CUtlBuffer &image = pFile->m_Image;
+	int nIndex = pElement->m_nLazyIndex;
+
+	{
+		CDmxElementModifyScope modify( pElement );
+		CDmxAttribute *pAttribute = pElement->AddAttribute( "name" );
+		pAttribute->SetValue( (const char *)image.Base() + pFile->m_NameOffsets[ nIndex ] );
+	}
+
+	char *pStringTable = NULL;
+	if ( pFile->m_nStringTableOffset >= 0 )
+	{
+		pStringTable = (char*)image.Base() + pFile->m_nStringTableOffset;
+	}
+
+	CUtlBuffer buf( image.Base(), image.TellMaxPut(), CUtlBuffer::READ_ONLY );
+	buf.SeekGet( CUtlBuffer::SEEK_HEAD, pFile->m_AttributeOffsets[ nIndex ] );
+	return UnserializeAttributes( buf, pElement, pFile->m_Elements, pFile->m_StringOffsets.Count(), pFile->m_StringOffsets.Base(), pStringTable );
+}
+
+void CDmxElement::LoadLazyAttributes_Internal()
+{
+	// Clear this first; reading the attributes goes through the accessors
+	m_bLazyAttributes = false;
+
+	CDmxSerializer dmxUnserializer;
+	if ( !dmxUnserializer.UnserializeLazyAttributes( m_pLazyFile, this ) )
+	{
+		Warning( "Error reading attributes of lazily loaded DMX element \"%s\"\n", GetName() );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Serialization main entry point
 //-----------------------------------------------------------------------------
@@ -539,13 +832,12 @@ bool SerializeDMX( const char *pFileName, const char *pPathID, bool bTextMode, C
 		}
 	}
 
-	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER |  CUtlBuffer::READ_ONLY );
-	g_pFullFileSystem->ReadFile( pFullPath, pPathID, buf );
-
+	// Stream straight to the file rather than building the whole file in memory
+	CUtlStreamBuffer buf( pFullPath, pPathID, bTextMode ? CUtlBuffer::TEXT_BUFFER : 0, true );
 	if ( !buf.IsValid() )
 	{
 		Warning( "SerializeDMX: Unable to open file \"%s\"\n", pFullPath );
-		return DMFILEID_INVALID;
+		return false;
 	}
 
 	return SerializeDMX( buf, pRoot, pFullPath );
@@ -620,7 +912,14 @@ bool ReadDMXHeader( CUtlBuffer &buf, char *pEncodingName, int nEncodingNameLen,
 //-----------------------------------------------------------------------------
 // Unserialization main entry point
 //-----------------------------------------------------------------------------
-bool UnserializeDMX( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileName )
+enum DmxLoadMode_t
+{
+	DMX_LOAD_EAGER,
+	DMX_LOAD_LAZY_COPY,		// Lazy; the file image is copied out of the buffer
+	DMX_LOAD_LAZY_SWAP,		// Lazy; the file image is taken from the buffer
+};
+
+static bool UnserializeDMX( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileName, DmxLoadMode_t mode )
 {
 	// NOTE: Checking the format name string for a version check here is how you'd do it
 	*ppRoot = NULL;
@@ -642,15 +941,47 @@ bool UnserializeDMX( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileNam
 
 	// Only allow binary protocol files
 	bool bIsBinary = ( buf.GetFlags() & CUtlBuffer::TEXT_BUFFER ) == 0;
-	if ( bIsBinary )
-	{
-		CDmxSerializer dmxUnserializer;
+	if ( !bIsBinary )
+		return UnserializeTextDMX( pFileName ? pFileName : "<no file>", buf, ppRoot );
+
+	CDmxSerializer dmxUnserializer;
+	if ( mode == DMX_LOAD_EAGER )
 		return dmxUnserializer.Unserialize( buf, nEncodingVersion, ppRoot );
+
+	CDmxLazyFile *pFile = new CDmxLazyFile;
+	s_LazyFiles.AddToTail( pFile );
+	if ( mode == DMX_LOAD_LAZY_SWAP )
+	{
+		pFile->m_Image.Swap( buf );
 	}
-	return UnserializeTextDMX( pFileName ? pFileName : "<no file>", buf, ppRoot );
+	else
+	{
+		int nBytes = buf.GetBytesRemaining();
+		const void *pBytes = buf.PeekGet( nBytes, 0 );
+		if ( !pBytes )
+			return false;
+		pFile->m_Image.Put( pBytes, nBytes );
+	}
+
+	if ( !dmxUnserializer.UnserializeLazy( pFile, nEncodingVersion, ppRoot ) )
+	{
+		*ppRoot = NULL;
+		return false;
+	}
+	return true;
 }
 
-bool UnserializeDMX( const char *pFileName, const char *pPathID, bool bTextMode, CDmxElement **ppRoot )
+bool UnserializeDMX( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileName )
+{
+	return UnserializeDMX( buf, ppRoot, pFileName, DMX_LOAD_EAGER );
+}
+
+bool UnserializeDMXLazy( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileName )
+{
+	return UnserializeDMX( buf, ppRoot, pFileName, DMX_LOAD_LAZY_COPY );
+}
+
+static bool UnserializeDMX( const char *pFileName, const char *pPathID, bool bTextMode, CDmxElement **ppRoot, DmxLoadMode_t mode )
 {
 	// NOTE: This guarantees full path names for pathids
 	char pBuf[MAX_PATH];
@@ -681,7 +1012,17 @@ bool UnserializeDMX( const char *pFileName, const char *pPathID, bool bTextMode,
 		return false;
 	}
 
-	return UnserializeDMX( buf, ppRoot, pFullPath );
+	return UnserializeDMX( buf, ppRoot, pFullPath, mode );
+}
+
+bool UnserializeDMX( const char *pFileName, const char *pPathID, bool bTextMode, CDmxElement **ppRoot )
+{
+	return UnserializeDMX( pFileName, pPathID, bTextMode, ppRoot, DMX_LOAD_EAGER );
+}
+
+bool UnserializeDMXLazy( const char *pFileName, const char *pPathID, bool bTextMode, CDmxElement **ppRoot )
+{
+	return UnserializeDMX( pFileName, pPathID, bTextMode, ppRoot, DMX_LOAD_LAZY_SWAP );
 }
 
 
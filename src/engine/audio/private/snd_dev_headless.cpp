@@ -0,0 +1,204 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Headless audio device. Mixes exactly like a 16-bit stereo device into
+// a buffer nothing plays, with the output position advancing in real time.
+// Selected with -snd_headless, so the mixer can be run and measured (see
+// snd_render_wav) on machines with no audio device.
+//
+//=====================================================================================//
+
+#include "audio_pch.h"
+#include "snd_dev_headless.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+extern bool snd_firsttime;
+
+// same size as the wave out buffers, about 1/3 second at 16-bit, stereo, 44100 Hz
+#define HEADLESS_BUFFER_SIZE	0x10000
+
+//-----------------------------------------------------------------------------
+//
+// NOTE: This only allows 16-bit, stereo output
+//
+//-----------------------------------------------------------------------------
+class CAudioDeviceHeadless : public CAudioDeviceBase
+{
+public:
+	CAudioDeviceHeadless();
+	virtual ~CAudioDeviceHeadless();
+
+	bool		IsActive( void );
+	bool		Init( void );
+	void		Shutdown( void );
+	int			GetOutputPosition( void );
+	void		Pause( void );
+	void		UnPause( void );
+	bool		Should3DMix( void )		{ return false; }
+
+	int			PaintBegin( float mixAheadTime, int soundtime, int paintedtime );
+	void		ClearBuffer( void );
+	void		TransferSamples( int end );
+
+	const char *DeviceName( void )			{ return "Headless"; }
+	int			DeviceChannels( void )		{ return 2; }
+	int			DeviceSampleBits( void )	{ return 16; }
+	int			DeviceSampleBytes( void )	{ return 2; }
+	int			DeviceDmaSpeed( void )		{ return SOUND_DMA_SPEED; }
+	int			DeviceSampleCount( void )	{ return HEADLESS_BUFFER_SIZE / DeviceSampleBytes(); }
+
+private:
+	int			m_pauseCount;
+
+	// seconds of output "played" so far, and when that was last advanced
+	double		m_flPlayedTime;
+	double		m_flLastTime;
+
+	short		*m_pBuffer;
+};
+
+static CAudioDeviceHeadless *g_pHeadlessDevice = NULL;
+
+CAudioDeviceHeadless::CAudioDeviceHeadless()
+{
+	m_pBuffer = NULL;
+}
+
+CAudioDeviceHeadless::~CAudioDeviceHeadless()
+{
+	Shutdown();
+	g_pHeadlessDevice = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Class factory
+//-----------------------------------------------------------------------------
+IAudioDevice *Audio_CreateHeadlessDevice( void )
+{
+	if ( !g_pHeadlessDevice )
+	{
+		g_pHeadlessDevice = new CAudioDeviceHeadless;
+		Assert( g_pHeadlessDevice );
+	}
+
+	if ( g_pHeadlessDevice && !g_pHeadlessDevice->Init() )
+	{
+		delete g_pHeadlessDevice;
+		g_pHeadlessDevice = NULL;
+	}
+
+	return g_pHeadlessDevice;
+}
+
+//-----------------------------------------------------------------------------
+// Init, shutdown
+//-----------------------------------------------------------------------------
+bool CAudioDeviceHeadless::Init( void )
+{
+	if ( m_pBuffer )
+		return true;
+
+	m_bSurround = false;
+	m_bSurroundCenter = false;
+	m_bHeadphone = false;
+	m_pauseCount = 0;
+	m_flPlayedTime = 0.0;
+	m_flLastTime = Plat_FloatTime();
+
+	m_pBuffer = new short[ DeviceSampleCount() ];
+	ClearBuffer();
+
+	if ( snd_firsttime )
+	{
+		DevMsg( "Headless sound initialized\n" );
+	}
+
+	return true;
+}
+
+void CAudioDeviceHeadless::Shutdown( void )
+{
+	delete[] m_pBuffer;
+	m_pBuffer = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Output position, in sample pairs, of the real time clock within the buffer
+//-----------------------------------------------------------------------------
+int CAudioDeviceHeadless::GetOutputPosition( void )
+{
+	double flTime = Plat_FloatTime();
+	if ( m_pauseCount == 0 )
+	{
+		m_flPlayedTime += flTime - m_flLastTime;
+	}
+	m_flLastTime = flTime;
+
+	int64 nPlayed = (int64)( m_flPlayedTime * DeviceDmaSpeed() );
+	return (int)( nPlayed % ( DeviceSampleCount() / DeviceChannels() ) );
+}
+
+//-----------------------------------------------------------------------------
+// Pausing stops the clock
+//-----------------------------------------------------------------------------
+void CAudioDeviceHeadless::Pause( void )
+{
+	GetOutputPosition();
+	m_pauseCount++;
+}
+
+void CAudioDeviceHeadless::UnPause( void )
+{
+	if ( m_pauseCount > 0 )
+	{
+		GetOutputPosition();
+		m_pauseCount--;
+	}
+}
+
+bool CAudioDeviceHeadless::IsActive( void )
+{
+	return ( m_pauseCount == 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Mixing setup
+//-----------------------------------------------------------------------------
+int CAudioDeviceHeadless::PaintBegin( float mixAheadTime, int soundtime, int paintedtime )
+{
+	//  soundtime - total samples that have been played out to hardware at dmaspeed
+	//  paintedtime - total samples that have been mixed at speed
+	//  endtime - target for samples in mixahead buffer at speed
+	unsigned int endtime = soundtime + mixAheadTime * DeviceDmaSpeed();
+
+	int samps = DeviceSampleCount() >> (DeviceChannels()-1);
+
+	if ((int)(endtime - soundtime) > samps)
+		endtime = soundtime + samps;
+
+	if ((endtime - paintedtime) & 0x3)
+	{
+		// The difference between endtime and painted time should align on 
+		// boundaries of 4 samples.  This is important when upsampling from 11khz -> 44khz.
+		endtime -= (endtime - paintedtime) & 0x3;
+	}
+
+	return endtime;
+}
+
+void CAudioDeviceHeadless::ClearBuffer( void )
+{
+	if ( !m_pBuffer )
+		return;
+
+	Q_memset( m_pBuffer, 0, DeviceSampleCount() * DeviceSampleBytes() );
+}
+
+void CAudioDeviceHeadless::TransferSamples( int end )
+{
+	if ( m_pBuffer )
+	{
+		S_TransferStereo16( m_pBuffer, PAINTBUFFER, g_paintedtime, end );
+	}
+}
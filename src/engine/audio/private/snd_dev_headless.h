@@ -0,0 +1,14 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Audio device with no output, for mixing on machines without sound hardware
+//
+//=====================================================================================//
+
+#ifndef SND_DEV_HEADLESS_H
+#define SND_DEV_HEADLESS_H
+#pragma once
+
+class IAudioDevice;
+IAudioDevice *Audio_CreateHeadlessDevice( void );
+
+#endif // SND_DEV_HEADLESS_H
@@ -162,7 +162,52 @@ bool IsSoundSourceLocalPlayer( int soundsource )
 
 CThreadMutex g_SndMutex;
 
-#define THREAD_LOCK_SOUND() AUTO_LOCK( g_SndMutex )
+//-----------------------------------------------------------------------------
+// With snd_mix_async the mix thread holds g_SndMutex for a whole mix, so every
+// game thread entry point below may wait for one. snd_mix_async_stats reports
+// how long that costs the game thread.
+//-----------------------------------------------------------------------------
+struct SoundLockStats_t
+{
+	int		m_nLocks;
+	int		m_nWaits;
+	double	m_flWaitTime;
+	double	m_flMaxWait;
+	int		m_nMixes;
+	double	m_flMixTime;
+	double	m_flMaxMix;
+	double	m_flStartTime;
+};
+static SoundLockStats_t s_SndLockStats;
+
+static void S_LockSound()
+{
+	if ( !ThreadInMainThread() )
+	{
+		g_SndMutex.Lock();
+		return;
+	}
+
+	s_SndLockStats.m_nLocks++;
+	if ( g_SndMutex.TryLock() )
+		return;
+
+	double flStart = Plat_FloatTime();
+	g_SndMutex.Lock();
+	double flWait = Plat_FloatTime() - flStart;
+	s_SndLockStats.m_nWaits++;
+	s_SndLockStats.m_flWaitTime += flWait;
+	s_SndLockStats.m_flMaxWait = MAX( s_SndLockStats.m_flMaxWait, flWait );
+}
+
+class CSoundLock
+{
+public:
+	CSoundLock()	{ S_LockSound(); }
+	~CSoundLock()	{ g_SndMutex.Unlock(); }
+};
+
+#define THREAD_LOCK_SOUND() CSoundLock soundLock
 
 const int MASK_BLOCK_AUDIO = CONTENTS_SOLID|CONTENTS_MOVEABLE|CONTENTS_WINDOW;
 
@@ -462,7 +507,7 @@ static ConVar volume( "volume", "1.0", FCVAR_ARCHIVE | FCVAR_ARCHIVE_XBOX, "Soun
 ConVar snd_musicvolume( "snd_musicvolume", "1.0", FCVAR_ARCHIVE | FCVAR_ARCHIVE_XBOX, "Music volume", true, 0.0f, true, 1.0f );	
 
 ConVar snd_mixahead( "snd_mixahead", "0.1", FCVAR_ARCHIVE );
-ConVar snd_mix_async( "snd_mix_async", "0" );
+ConVar snd_mix_async( "snd_mix_async", "0", 0, "Mix sound on its own thread instead of in the client frame" );
 #ifdef _DEBUG
 static ConCommand snd_mixvol("snd_mixvol", MXR_DebugSetMixGroupVolume, "Set named Mixgroup to mix volume.");
 #endif
@@ -6125,7 +6170,7 @@ void S_Update( const AudioState_t *pAudioState )
 	if ( !g_AudioDevice->IsActive() )
 		return;
 
-	g_SndMutex.Lock();
+	S_LockSound();
 
 	// Update any client side sound fade
 	S_UpdateSoundFade();
@@ -6568,7 +6613,12 @@ void S_Update_Thread()
 		// the 360 decoder has finite latency and cannot fulfill spike requests
 		float t0 = Plat_FloatTime();
 		S_Update_Guts( frameTime + snd_mixahead.GetFloat() );
-		int updateTime = ( Plat_FloatTime() - t0 ) * 1000.0f;
+		float flMixTime = Plat_FloatTime() - t0;
+		int updateTime = flMixTime * 1000.0f;
+
+		s_SndLockStats.m_nMixes++;
+		s_SndLockStats.m_flMixTime += flMixTime;
+		s_SndLockStats.m_flMaxMix = MAX( s_SndLockStats.m_flMaxMix, flMixTime );
 
 		// try to maintain a steadier rate by compensating for fluctuating mix times
 		int sleepTime = THREADED_MIX_TIME - updateTime;
@@ -6600,9 +6650,21 @@ void S_ShutdownMixThread()
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Movies and replays advance sound time by the host frame, so they always mix
+// in the client frame.
+//-----------------------------------------------------------------------------
+static bool S_ShouldMixAsync()
+{
+	if ( !snd_mix_async.GetBool() )
+		return false;
+
+	return !cl_movieinfo.IsRecording() && !IsReplayRendering();
+}
+
 void S_Update_( float mixAheadTime )
 {
-	if ( !IsConsole() || !snd_mix_async.GetBool() )
+	if ( !S_ShouldMixAsync() )
 	{
 		S_ShutdownMixThread();
 		S_Update_Guts( mixAheadTime );
@@ -6621,6 +6683,25 @@ void S_Update_( float mixAheadTime )
 	}
 }
 
+CON_COMMAND( snd_mix_async_stats, "Report how long the game thread waited on the sound lock and how long mixes took on the mix thread. Pass 'reset' to clear." )
+{
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		V_memset( &s_SndLockStats, 0, sizeof( s_SndLockStats ) );
+		s_SndLockStats.m_flStartTime = Plat_FloatTime();
+		return;
+	}
+
+	const SoundLockStats_t &stats = s_SndLockStats;
+	double flElapsed = Plat_FloatTime() - stats.m_flStartTime;
+	ConMsg( "snd_mix_async %d, %s\n", snd_mix_async.GetInt(), g_hMixThread ? "mix thread running" : "mixing in the client frame" );
+	ConMsg( "game thread locks: %d, %d waited (%.1f%%), %.3f ms total, %.3f ms max, %.3f ms per second\n",
+		stats.m_nLocks, stats.m_nWaits, stats.m_nLocks ? 100.0 * stats.m_nWaits / stats.m_nLocks : 0.0,
+		stats.m_flWaitTime * 1000.0, stats.m_flMaxWait * 1000.0, flElapsed > 0.0 ? stats.m_flWaitTime * 1000.0 / flElapsed : 0.0 );
+	ConMsg( "mix thread mixes: %d, %.3f ms average, %.3f ms max\n",
+		stats.m_nMixes, stats.m_nMixes ? stats.m_flMixTime * 1000.0 / stats.m_nMixes : 0.0, stats.m_flMaxMix * 1000.0 );
+}
+
 //-----------------------------------------------------------------------------
 // Threaded mixing enable. Purposely hiding enable/disable details.
 //-----------------------------------------------------------------------------
@@ -6797,6 +6878,53 @@ static void S_PlayDelay( const CCommand &args )
 }
 static ConCommand sndplaydelay( "sndplaydelay", S_PlayDelay, "Usage:  sndplaydelay delay_in_sec (negative to skip ahead) soundname", FCVAR_SERVER_CAN_EXECUTE );
 
+//-----------------------------------------------------------------------------
+// Mixes the sounds currently playing into a wave file as fast as possible and
+// reports the mixer throughput. Works with -snd_headless on machines with no
+// audio device.
+//-----------------------------------------------------------------------------
+CON_COMMAND( snd_render_wav, "Usage: snd_render_wav filename seconds. Mixes the playing sounds to a wave file and reports the mix time." )
+{
+	if ( args.ArgC() != 3 )
+	{
+		Msg( "Usage: snd_render_wav filename seconds\n" );
+		return;
+	}
+
+	if ( !g_AudioDevice || !g_AudioDevice->IsActive() )
+	{
+		Msg( "snd_render_wav: no active sound device, try -snd_headless\n" );
+		return;
+	}
+
+	float flSeconds = Q_atof( args[2] );
+	int sampleCount = (int)( flSeconds * SOUND_DMA_SPEED );
+	if ( sampleCount <= 0 )
+	{
+		Msg( "snd_render_wav: nothing to render\n" );
+		return;
+	}
+
+	// the render drives the mixer itself, S_Update_ restarts the thread on the next frame
+	S_ShutdownMixThread();
+
+	float flMixTime, flOutputTime;
+	bool bRendered;
+	{
+		THREAD_LOCK_SOUND();
+		bRendered = MIX_RenderToWave( args[1], sampleCount, s_bIsListenerUnderwater, &flMixTime, &flOutputTime );
+	}
+
+	if ( !bRendered )
+	{
+		Msg( "snd_render_wav: couldn't render to %s\n", args[1] );
+		return;
+	}
+
+	Msg( "Rendered %.2f seconds to %s: mix %.2f ms (%.1fx realtime), output %.2f ms\n",
+		flSeconds, args[1], flMixTime * 1000.0f, flMixTime > 0.0f ? flSeconds / flMixTime : 0.0f, flOutputTime * 1000.0f );
+}
+
 static bool SortByNameLessFunc( const int &lhs, const int &rhs )
 {
 	CSfxTable *pSfx1 = s_Sounds[lhs].pSfx;
@@ -23,6 +23,11 @@
 #undef id386
 #endif
 
+#if !defined( _X360 ) && !defined( _PS3 )
+#include <emmintrin.h>
+#define SND_MIX_SSE2 1
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -44,6 +49,82 @@ extern IReplayMovieManager *g_pReplayMovieManager;
 #define SND_SCALE_SHIFT16	(8-SND_SCALE_BITS16)
 #define SND_SCALE_LEVELS16	(1<<SND_SCALE_BITS16)
 
+//-----------------------------------------------------------------------------
+// Paintbuffer sample kernels. These work on the 32 bit samples of a
+// portable_samplepair_t array as a flat int array, and the SSE2 versions give
+// exactly the same results as the scalar loops, overflow included.
+//-----------------------------------------------------------------------------
+#ifdef SND_MIX_SSE2
+// low 32 bits of a 32x32 bit multiply in each lane, like the scalar int multiply
+static inline __m128i MIX_MulLo32( __m128i a, __m128i b )
+{
+	__m128i even = _mm_mul_epu32( a, b );
+	__m128i odd = _mm_mul_epu32( _mm_srli_epi64( a, 32 ), _mm_srli_epi64( b, 32 ) );
+	return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ), _mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+}
+#endif
+
+// pSamples[i] = (pSamples[i] * gain) >> 8
+static void MIX_ScaleSamples( int *pSamples, int nSamples, int gain )
+{
+	int i = 0;
+#ifdef SND_MIX_SSE2
+	__m128i vgain = _mm_set1_epi32( gain );
+	for ( ; i + 8 <= nSamples; i += 8 )
+	{
+		__m128i a = _mm_loadu_si128( (const __m128i *)( pSamples + i ) );
+		__m128i b = _mm_loadu_si128( (const __m128i *)( pSamples + i + 4 ) );
+		_mm_storeu_si128( (__m128i *)( pSamples + i ), _mm_srai_epi32( MIX_MulLo32( a, vgain ), 8 ) );
+		_mm_storeu_si128( (__m128i *)( pSamples + i + 4 ), _mm_srai_epi32( MIX_MulLo32( b, vgain ), 8 ) );
+	}
+#endif
+	for ( ; i < nSamples; i++ )
+	{
+		pSamples[i] = (pSamples[i] * gain) >> 8;
+	}
+}
+
+// pDest[i] = pSrc1[i] + pSrc2[i], pDest may be either source
+static void MIX_AddSamples( int *pDest, const int *pSrc1, const int *pSrc2, int nSamples )
+{
+	int i = 0;
+#ifdef SND_MIX_SSE2
+	for ( ; i + 8 <= nSamples; i += 8 )
+	{
+		__m128i a = _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( pSrc1 + i ) ), _mm_loadu_si128( (const __m128i *)( pSrc2 + i ) ) );
+		__m128i b = _mm_add_epi32( _mm_loadu_si128( (const __m128i *)( pSrc1 + i + 4 ) ), _mm_loadu_si128( (const __m128i *)( pSrc2 + i + 4 ) ) );
+		_mm_storeu_si128( (__m128i *)( pDest + i ), a );
+		_mm_storeu_si128( (__m128i *)( pDest + i + 4 ), b );
+	}
+#endif
+	for ( ; i < nSamples; i++ )
+	{
+		pDest[i] = pSrc1[i] + pSrc2[i];
+	}
+}
+
+// pSamples[i] = CLIP( pSamples[i] )
+static void MIX_ClipSamples( int *pSamples, int nSamples )
+{
+	int i = 0;
+#ifdef SND_MIX_SSE2
+	// saturate to 16 bits, raise -32768 to CLIP's -32767, then sign extend back out
+	__m128i vmin = _mm_set1_epi16( -32767 );
+	for ( ; i + 8 <= nSamples; i += 8 )
+	{
+		__m128i a = _mm_loadu_si128( (const __m128i *)( pSamples + i ) );
+		__m128i b = _mm_loadu_si128( (const __m128i *)( pSamples + i + 4 ) );
+		__m128i packed = _mm_max_epi16( _mm_packs_epi32( a, b ), vmin );
+		_mm_storeu_si128( (__m128i *)( pSamples + i ), _mm_srai_epi32( _mm_unpacklo_epi16( packed, packed ), 16 ) );
+		_mm_storeu_si128( (__m128i *)( pSamples + i + 4 ), _mm_srai_epi32( _mm_unpackhi_epi16( packed, packed ), 16 ) );
+	}
+#endif
+	for ( ; i < nSamples; i++ )
+	{
+		pSamples[i] = CLIP( pSamples[i] );
+	}
+}
+
 void Snd_WriteLinearBlastStereo16(void);
 void SND_PaintChannelFrom8( portable_samplepair_t *pOutput, int *volume, byte *pData8, int count );
 bool Con_IsVisible( void );
@@ -133,6 +214,7 @@ void DSP_SetDspAuto( int dsp_preset );
 bool DSP_CheckDspAutoEnabled( void );
 
 void MIX_ScalePaintBuffer( int bufferIndex, int count, float fgain );
+static void MIX_WriteRenderedSamples( int count );
 
 bool IsReplayRendering()
 {
@@ -428,9 +510,13 @@ void S_FreeChannel(channel_t *ch)
 		return;
 	ch->flags.m_bIsFreeingChannel = true;
 
-	SND_CloseMouth(ch);
+	// A wave render plays copies of the channels, the real sounds are still playing
+	if ( !MIX_IsRenderingToWave() )
+	{
+		SND_CloseMouth(ch);
 
-	g_pSoundServices->OnSoundStopped( ch->guid, ch->soundsource, ch->entchannel, ch->sfx->getname() );
+		g_pSoundServices->OnSoundStopped( ch->guid, ch->soundsource, ch->entchannel, ch->sfx->getname() );
+	}
 
 	ch->flags.isSentence = false;
 //	Msg("End sound %s\n", ch->sfx->getname() );
@@ -1231,11 +1317,7 @@ void MIX_MixPaintbuffers(int ibuf1, int ibuf2, int ibuf3, int count, float fgain
 		{
 			// mix front channels
 
-			for (i = 0; i < count; i++)
-			{
-				pbuf3[i].left  = pbuf1[i].left  + pbuf2[i].left;
-				pbuf3[i].right = pbuf1[i].right + pbuf2[i].right;
-			}
+			MIX_AddSamples( (int *)pbuf3, (int *)pbuf1, (int *)pbuf2, count * 2 );
 			goto gain2ch;
 		}
 
@@ -1570,36 +1652,26 @@ gain2ch:
     if ( gain_out == 256)		// KDB: perf
 		return;
 
-	for (i = 0; i < count; i++)
-	{
-		pbuf3[i].left  = (pbuf3[i].left * gain_out) >> 8;
-		pbuf3[i].right = (pbuf3[i].right * gain_out) >> 8;
-	}
+	MIX_ScaleSamples( (int *)pbuf3, count * 2, gain_out );
 	return;
 
 gain4ch:
 	if ( gain_out == 256)		// KDB: perf
 		return;
 
-	for (i = 0; i < count; i++)
-	{
-		pbuf3[i].left  = (pbuf3[i].left * gain_out) >> 8;
-		pbuf3[i].right = (pbuf3[i].right * gain_out) >> 8;
-		pbufrear3[i].left  = (pbufrear3[i].left * gain_out) >> 8;
-		pbufrear3[i].right = (pbufrear3[i].right * gain_out) >> 8;
-	}
+	MIX_ScaleSamples( (int *)pbuf3, count * 2, gain_out );
+	MIX_ScaleSamples( (int *)pbufrear3, count * 2, gain_out );
 	return;
 
 gain5ch:
 	if ( gain_out == 256)		// KDB: perf
 		return;
 
+	MIX_ScaleSamples( (int *)pbuf3, count * 2, gain_out );
+	MIX_ScaleSamples( (int *)pbufrear3, count * 2, gain_out );
+
 	for (i = 0; i < count; i++)
 	{
-		pbuf3[i].left  = (pbuf3[i].left * gain_out) >> 8;
-		pbuf3[i].right = (pbuf3[i].right * gain_out) >> 8;
-		pbufrear3[i].left  = (pbufrear3[i].left * gain_out) >> 8;
-		pbufrear3[i].right = (pbufrear3[i].right * gain_out) >> 8;
 		pbufcenter3[i].left  = (pbufcenter3[i].left * gain_out) >> 8;
 	}
 	return;
@@ -1619,23 +1691,11 @@ void MIX_ScalePaintBuffer( int bufferIndex, int count, float fgain )
 	if (gain == 256)
 		return;
 
-	if ( !g_paintBuffers[bufferIndex].fsurround )
-	{
-		for (i = 0; i < count; i++)
-		{
-			pbuf[i].left  = (pbuf[i].left * gain) >> 8;
-			pbuf[i].right = (pbuf[i].right * gain) >> 8;
-		}
-	}
-	else
+	MIX_ScaleSamples( (int *)pbuf, count * 2, gain );
+
+	if ( g_paintBuffers[bufferIndex].fsurround )
 	{
-		for (i = 0; i < count; i++)
-		{
-			pbuf[i].left  = (pbuf[i].left * gain) >> 8;
-			pbuf[i].right = (pbuf[i].right * gain) >> 8;
-			pbufrear[i].left  = (pbufrear[i].left * gain) >> 8;
-			pbufrear[i].right = (pbufrear[i].right * gain) >> 8;
-		}
+		MIX_ScaleSamples( (int *)pbufrear, count * 2, gain );
 
 		if (g_paintBuffers[bufferIndex].fsurround_center)
 		{
@@ -1730,23 +1790,13 @@ void MIX_CompressPaintbuffer(int ipaint, int count)
 	pbr = ppaint->pbufrear;
 	pbc = ppaint->pbufcenter;
 
-	for (i = 0; i < count; i++)
-	{
-		pbf->left = CLIP(pbf->left);
-		pbf->right = CLIP(pbf->right);
-		pbf++;
-	}
+	MIX_ClipSamples( (int *)pbf, count * 2 );
 	
 	if ( ppaint->fsurround )
 	{
 		Assert (pbr);
 
-		for (i = 0; i < count; i++)
-		{
-			pbr->left = CLIP(pbr->left);
-			pbr->right = CLIP(pbr->right);
-			pbr++;
-		}
+		MIX_ClipSamples( (int *)pbr, count * 2 );
 	}
 
 	if ( ppaint->fsurround_center )
@@ -2485,7 +2535,14 @@ void MIX_PaintChannels( int endtime, bool bIsUnderwater )
 		// transfer SOUND_BUFFER_PAINT paintbuffer out to DMA buffer
 		MIX_SetCurrentPaintbuffer( SOUND_BUFFER_PAINT );
 
-		g_AudioDevice->TransferSamples( end );
+		if ( MIX_IsRenderingToWave() )
+		{
+			MIX_WriteRenderedSamples( count );
+		}
+		else
+		{
+			g_AudioDevice->TransferSamples( end );
+		}
 
 		g_paintedtime = end;
 	}
@@ -2679,10 +2736,21 @@ bool MIX_ScaleChannelVolume( paintbuffer_t *ppaint, channel_t *pChannel, int vol
 void Snd_WriteLinearBlastStereo16( void )
 {
 #if	!id386
-	int		i;
+	int		i = 0;
 	int		val;
 
-	for ( i=0; i<snd_linear_count; i+=2 )
+#ifdef SND_MIX_SSE2
+	// scale, then let the saturating pack do the 16 bit clamp
+	__m128i vvol = _mm_set1_epi32( snd_vol );
+	for ( ; i + 8 <= snd_linear_count; i += 8 )
+	{
+		__m128i a = _mm_srai_epi32( MIX_MulLo32( _mm_loadu_si128( (const __m128i *)( snd_p + i ) ), vvol ), 8 );
+		__m128i b = _mm_srai_epi32( MIX_MulLo32( _mm_loadu_si128( (const __m128i *)( snd_p + i + 4 ) ), vvol ), 8 );
+		_mm_storeu_si128( (__m128i *)( snd_out + i ), _mm_packs_epi32( a, b ) );
+	}
+#endif
+
+	for ( ; i<snd_linear_count; i+=2 )
 	{
 		// scale and clamp left 16bit signed: [0x8000, 0x7FFF]
 		val = ( snd_p[i] * snd_vol )>>8;
@@ -3678,7 +3746,27 @@ void SW_Mix16Mono_NoShift( portable_samplepair_t *pOutput, int *volume, short *p
 	int vol0 = volume[0];
 	int vol1 = volume[1];
 #if !id386
-	for ( int i = 0; i < outCount; i++ )
+	int i = 0;
+#ifdef SND_MIX_SSE2
+	// pmaddwd of each sample against one volume and a zero word is an exact 32 bit product
+	if ( vol0 >= -32768 && vol0 <= 32767 && vol1 >= -32768 && vol1 <= 32767 )
+	{
+		__m128i vvol = _mm_set_epi32( vol1 & 0xFFFF, vol0 & 0xFFFF, vol1 & 0xFFFF, vol0 & 0xFFFF );
+		__m128i zero = _mm_setzero_si128();
+		for ( ; i + 4 <= outCount; i += 4 )
+		{
+			__m128i x = _mm_loadl_epi64( (const __m128i *)pData );
+			x = _mm_unpacklo_epi16( x, x );		// x0 x0 x1 x1 x2 x2 x3 x3
+			__m128i lo = _mm_srai_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( x, zero ), vvol ), 8 );
+			__m128i hi = _mm_srai_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( x, zero ), vvol ), 8 );
+			__m128i *pOut = (__m128i *)( pOutput + i );
+			_mm_storeu_si128( pOut, _mm_add_epi32( _mm_loadu_si128( pOut ), lo ) );
+			_mm_storeu_si128( pOut + 1, _mm_add_epi32( _mm_loadu_si128( pOut + 1 ), hi ) );
+			pData += 4;
+		}
+	}
+#endif
+	for ( ; i < outCount; i++ )
 	{
 		int x = *pData++;
 		pOutput[i].left += (x * vol0) >> 8;
@@ -3790,8 +3878,28 @@ void SW_Mix16Stereo( portable_samplepair_t *pOutput, int *volume, short *pData,
 {
 	int sampleIndex = 0;
 	fixedint sampleFrac = inputOffset;
+	int i = 0;
 
-	for ( int i = 0; i < outCount; i++ )
+#ifdef SND_MIX_SSE2
+	// unpitched samples are consecutive, so mix 4 pairs at a time like SW_Mix16Mono_NoShift
+	if ( rateScaleFix == FIX(1) && FIX_INTPART(inputOffset) == 0 && volume[0] >= -32768 && volume[0] <= 32767 && volume[1] >= -32768 && volume[1] <= 32767 )
+	{
+		__m128i vvol = _mm_set_epi32( volume[1] & 0xFFFF, volume[0] & 0xFFFF, volume[1] & 0xFFFF, volume[0] & 0xFFFF );
+		__m128i zero = _mm_setzero_si128();
+		for ( ; i + 4 <= outCount; i += 4 )
+		{
+			__m128i x = _mm_loadu_si128( (const __m128i *)( pData + sampleIndex ) );
+			__m128i lo = _mm_srai_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( x, zero ), vvol ), 8 );
+			__m128i hi = _mm_srai_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( x, zero ), vvol ), 8 );
+			__m128i *pOut = (__m128i *)( pOutput + i );
+			_mm_storeu_si128( pOut, _mm_add_epi32( _mm_loadu_si128( pOut ), lo ) );
+			_mm_storeu_si128( pOut + 1, _mm_add_epi32( _mm_loadu_si128( pOut + 1 ), hi ) );
+			sampleIndex += 8;
+		}
+	}
+#endif
+
+	for ( ; i < outCount; i++ )
 	{
 		pOutput[i].left  += (volume[0] * (int)(pData[sampleIndex]))>>8;
 		pOutput[i].right += (volume[1] * (int)(pData[sampleIndex+1]))>>8;
@@ -4291,3 +4399,131 @@ void SND_RecordBuffer( void )
 		}
 	}
 }
+
+//-----------------------------------------------------------------------------
+// Offline rendering. The mixer paints straight into a wave file instead of the
+// device, as fast as it can, so mixer throughput and output can be measured and
+// compared without depending on an audio device or real time.
+//-----------------------------------------------------------------------------
+static const char *s_pRenderWaveFile = NULL;
+static double s_flRenderOutputTime = 0.0;
+
+bool MIX_IsRenderingToWave( void )
+{
+	return s_pRenderWaveFile != NULL;
+}
+
+// converts 'count' samples of the front paintbuffer to 16 bit stereo at the master volume, as the device transfer would
+static void MIX_WriteRenderedSamples( int count )
+{
+	double flStart = Plat_FloatTime();
+
+	short *pOutput = (short *)_alloca( count * 2 * sizeof( short ) );
+	snd_vol = S_GetMasterVolume()*256;
+	snd_p = (int *)MIX_GetPFrontFromIPaint( SOUND_BUFFER_PAINT );
+	snd_out = pOutput;
+	snd_linear_count = count * 2;
+	Snd_WriteLinearBlastStereo16();
+
+	WaveAppendTmpFile( s_pRenderWaveFile, pOutput, 16, count * 2 );
+
+	s_flRenderOutputTime += Plat_FloatTime() - flStart;
+}
+
+// The render mixes copies of the channels: each playing channel gets a new mixer at
+// the same position, and the channels, active list and paintbuffer filter memory are
+// put back afterwards. Sentences and voice consume shared state as they mix, so they
+// are left out of the render.
+static channel_t s_RenderSavedChannels[MAX_CHANNELS];
+
+static void MIX_BeginRenderChannels( CActiveChannels &savedActive, CUtlVector< paintbuffer_t > &savedPaintBuffers )
+{
+	savedActive = g_ActiveChannels;
+	V_memcpy( s_RenderSavedChannels, channels, sizeof( channels ) );
+	savedPaintBuffers.CopyArray( g_paintBuffers.Base(), g_paintBuffers.Count() );
+
+	CChannelList list;
+	g_ActiveChannels.GetActiveChannels( list );
+	for ( int i = 0; i < list.Count(); i++ )
+	{
+		channel_t *ch = list.GetChannel( i );
+		CAudioMixer *pMixer = NULL;
+		if ( ch->pMixer && ch->sfx && ch->sfx->pSource && !ch->flags.isSentence && ch->sfx->pSource->GetType() != CAudioSource::AUDIO_SOURCE_VOICE )
+		{
+			pMixer = ch->sfx->pSource->CreateMixer( ch->initialStreamPosition );
+		}
+
+		if ( !pMixer )
+		{
+			// the saved channel keeps the real mixer
+			ch->pMixer = NULL;
+			g_ActiveChannels.Remove( ch );
+			continue;
+		}
+
+		pMixer->SetPositionFromSaved( ch->pMixer->GetPositionForSave() );
+		ch->pMixer = pMixer;
+	}
+}
+
+static void MIX_EndRenderChannels( const CActiveChannels &savedActive, const CUtlVector< paintbuffer_t > &savedPaintBuffers )
+{
+	// channels still playing at the end of the render own their copy of the mixer
+	for ( int i = 0; i < MAX_CHANNELS; i++ )
+	{
+		if ( channels[i].pMixer && channels[i].pMixer != s_RenderSavedChannels[i].pMixer )
+		{
+			delete channels[i].pMixer;
+		}
+	}
+
+	V_memcpy( channels, s_RenderSavedChannels, sizeof( channels ) );
+	g_ActiveChannels = savedActive;
+	for ( int i = 0; i < savedPaintBuffers.Count(); i++ )
+	{
+		g_paintBuffers[i] = savedPaintBuffers[i];
+	}
+}
+
+// Mixes the next 'sampleCount' samples of every playing channel into pFilename.
+// Mix time excludes the conversion and file writes, which are returned in pflOutputTime.
+// The painted time and channel state are restored afterwards so playback carries on
+// where it left off. Only stereo output can be rendered.
+bool MIX_RenderToWave( const char *pFilename, int sampleCount, bool bIsUnderwater, float *pflMixTime, float *pflOutputTime )
+{
+	if ( IsX360() || !g_AudioDevice || !g_AudioDevice->IsActive() || MIX_IsRenderingToWave() )
+		return false;
+
+	if ( g_AudioDevice->IsSurround() || g_AudioDevice->IsSurroundCenter() )
+	{
+		Warning( "Can't render %s, only stereo output can be rendered to a wave file\n", pFilename );
+		return false;
+	}
+
+	WaveCreateTmpFile( pFilename, SOUND_DMA_SPEED, 16, 2 );
+
+	CActiveChannels savedActive;
+	CUtlVector< paintbuffer_t > savedPaintBuffers;
+	MIX_BeginRenderChannels( savedActive, savedPaintBuffers );
+
+	s_pRenderWaveFile = pFilename;
+	s_flRenderOutputTime = 0.0;
+
+	int nSavedPaintedTime = g_paintedtime;
+	double flStart = Plat_FloatTime();
+
+	MIX_PaintChannels( g_paintedtime + sampleCount, bIsUnderwater );
+
+	double flTotal = Plat_FloatTime() - flStart;
+	g_paintedtime = nSavedPaintedTime;
+
+	s_pRenderWaveFile = NULL;
+
+	MIX_EndRenderChannels( savedActive, savedPaintBuffers );
+
+	WaveFixupTmpFile( pFilename );
+
+	*pflMixTime = flTotal - s_flRenderOutputTime;
+	*pflOutputTime = s_flRenderOutputTime;
+	return true;
+}
@@ -620,11 +620,19 @@ bool CAudioSourceWave::GetXboxAudioStartupData()
 				// vdat is precompiled into minimal binary format and possibly compressed
 				if ( CLZMA::IsCompressed( pData ) )
 				{
+					if ( !CLZMA::IsInputValid( pData, pHeader->vdatSize ) )
+					{
+						return false;
+					}
+
 					// uncompress binary vdat and restore
 					CUtlBuffer targetBuffer;
 					int originalSize = CLZMA::GetActualSize( pData );
 					targetBuffer.EnsureCapacity( originalSize );
-					CLZMA::Uncompress( pData, (unsigned char *)targetBuffer.Base() );
+					if ( CLZMA::Uncompress( pData, (unsigned char *)targetBuffer.Base() ) != (unsigned int)originalSize )
+					{
+						return false;
+					}
 					targetBuffer.SeekPut( CUtlBuffer::SEEK_HEAD, originalSize );
 					m_pTempSentence->CacheRestoreFromBuffer( targetBuffer );
 				}
@@ -5,6 +5,7 @@
 //=====================================================================================//
 
 #include "audio_pch.h"
+#include "snd_dev_headless.h"
 
 #if defined( USE_SDL )
 #include "snd_dev_sdl.h"
@@ -66,7 +67,12 @@ IAudioDevice *IAudioDevice::AutoDetectInit( bool waveOnly )
 {
 	IAudioDevice *pDevice = NULL;
 
-	if ( IsPC() )
+	if ( CommandLine()->CheckParm( "-snd_headless" ) )
+	{
+		DevMsg( "Using headless audio device\n" );
+		pDevice = Audio_CreateHeadlessDevice();
+	}
+	else if ( IsPC() )
 	{
 #if defined( WIN32 ) && !defined( USE_SDL )
 		if ( waveOnly )
@@ -89,6 +89,9 @@ extern bool SND_ShouldPause( channel_t *pChannel );
 extern bool SND_IsRecording();
 
 void MIX_PaintChannels( int endtime, bool bIsUnderwater );
+// Mix straight into a wave file instead of the device
+bool MIX_RenderToWave( const char *pFilename, int sampleCount, bool bIsUnderwater, float *pflMixTime, float *pflOutputTime );
+bool MIX_IsRenderingToWave( void );
 // Play a big of zeroed out sound
 void MIX_PaintNullChannels( int endtime );
 
@@ -20,11 +20,14 @@
 #include "netmessages.h"
 #include "ents_shared.h"
 #include "cl_ents_parse.h"
+#include "dt_instrumentation.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 static ConVar cl_flushentitypacket("cl_flushentitypacket", "0", FCVAR_CHEAT, "For debugging. Force the engine to flush an entity packet.");
+static ConVar cl_parallel_unpackentities( "cl_parallel_unpackentities", "0", 0, "Decode the props of the entities in a packet on the thread pool before handing them to the client in order. Only value dequantization runs on the pool." );
 
 // Prints important entity creation/deletion events to console
 #if defined( _DEBUG )
@@ -290,6 +293,189 @@ void CL_FlushEntityPacket( CClientFrame *packet, char const *errorString, ... )
 }
 
 
+// ----------------------------------------------------------------------------- //
+// Parallel unpacking.
+//
+// Before ReadPacketEntities runs, CL_UnpackPacketEntities scans the packet for
+// where each entity's props are and decodes them on the thread pool. The regular
+// handlers below then hand the decoded values to the client in packet order and
+// seek past the props instead of decoding them.
+// ----------------------------------------------------------------------------- //
+
+struct UnpackWork_t
+{
+	int					m_nEntity;
+	RecvTable			*m_pRecvTable;
+	const bf_read		*m_pPacket;
+	int					m_iStartBit;		// Where the entity's props start in m_pPacket.
+	int					m_iEndBit;
+	const void			*m_pBaselineData;	// Set if the entity enters the PVS.
+	int					m_nBaselineBits;
+	bool				m_bDecoded;
+	CRecvDecodedProps	m_Baseline;
+	CRecvDecodedProps	m_Props;
+
+	static void Process( UnpackWork_t &work )
+	{
+		work.m_bDecoded = true;
+
+		if ( work.m_pBaselineData )
+		{
+			bf_read fromBuf( "UnpackWork_t::Process->fromBuf", work.m_pBaselineData, Bits2Bytes( work.m_nBaselineBits ), work.m_nBaselineBits );
+			work.m_bDecoded &= RecvTable_ReadProps( work.m_pRecvTable, &fromBuf, &work.m_Baseline );
+		}
+
+		bf_read buf = *work.m_pPacket;
+		buf.Seek( work.m_iStartBit );
+		work.m_bDecoded &= RecvTable_ReadProps( work.m_pRecvTable, &buf, &work.m_Props );
+		work.m_bDecoded &= ( buf.GetNumBitsRead() == work.m_iEndBit );
+	}
+};
+
+static CUtlVector<UnpackWork_t> s_UnpackWork;
+static int s_nUnpackWork = 0;
+static int s_iNextUnpackWork = 0;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the props of every entity in the packet without decoding them
+//  and decodes them on the thread pool. Returns false if the packet has to be
+//  read the regular way.
+//-----------------------------------------------------------------------------
+static bool CL_UnpackPacketEntities( const CEntityReadInfo &u )
+{
+	VPROF( "CL_UnpackPacketEntities" );
+
+	s_nUnpackWork = 0;
+	s_iNextUnpackWork = 0;
+
+	// Merging into the baselines and the instrumentation both need the serial decode.
+	if ( !cl_parallel_unpackentities.GetBool() || u.m_bUpdateBaselines || g_bDTIEnabled )
+		return false;
+
+	// Same walk over the headers as CBaseClientState::ReadPacketEntities, on a copy of the packet.
+	bf_read buf = *u.m_pBuf;
+	int nHeaderBase = u.m_nHeaderBase;
+	for ( int iHeader = 0; iHeader < u.m_nHeaderCount; iHeader++ )
+	{
+		SyncTag_Read( &buf, "Hdr" );
+
+		int nEntity = nHeaderBase + 1 + buf.ReadUBitVar();
+		nHeaderBase = nEntity;
+
+		bool bEnterPVS = false;
+		if ( buf.ReadOneBit() == 0 )
+		{
+			bEnterPVS = buf.ReadOneBit() != 0;
+		}
+		else
+		{
+			// Leaving the PVS, nothing else to read.
+			buf.ReadOneBit();
+			continue;
+		}
+
+		if ( nEntity < 0 || nEntity >= MAX_EDICTS )
+			return false;
+
+		RecvTable *pRecvTable;
+		const void *pBaselineData = NULL;
+		int nBaselineBits = 0;
+		if ( bEnterPVS )
+		{
+			int iClass = buf.ReadUBitLong( cl.m_nServerClassBits );
+			buf.ReadUBitLong( NUM_NETWORKED_EHANDLE_SERIAL_NUMBER_BITS );
+
+			if ( iClass >= cl.m_nServerClasses )
+				return false;
+
+			// Same baseline as CL_CopyNewEntity.
+			ClientClass *pClass = cl.m_pServerClasses[iClass].m_pClientClass;
+			if ( !pClass )
+				return false;
+
+			pRecvTable = pClass->m_pRecvTable;
+
+			PackedEntity *baseline = u.m_bAsDelta ? cl.GetEntityBaseline( u.m_nBaseline, nEntity ) : NULL;
+			if ( baseline && baseline->m_pClientClass == pClass )
+			{
+				pBaselineData = baseline->GetData();
+				nBaselineBits = baseline->GetNumBits();
+			}
+			else
+			{
+				if ( !cl.GetClassBaseline( iClass, &pBaselineData, &nBaselineBits ) )
+					return false;
+
+				nBaselineBits *= 8; // convert to bits
+			}
+		}
+		else
+		{
+			pRecvTable = GetEntRecvTable( nEntity );
+		}
+
+		if ( !pRecvTable || !pRecvTable->m_pDecoder )
+			return false;
+
+		if ( s_nUnpackWork == s_UnpackWork.Count() )
+		{
+			s_UnpackWork.AddToTail();
+		}
+
+		UnpackWork_t &work = s_UnpackWork[s_nUnpackWork++];
+		work.m_nEntity = nEntity;
+		work.m_pRecvTable = pRecvTable;
+		work.m_pPacket = u.m_pBuf;
+		work.m_iStartBit = buf.GetNumBitsRead();
+		work.m_pBaselineData = pBaselineData;
+		work.m_nBaselineBits = nBaselineBits;
+		work.m_Baseline.RemoveAll();
+		work.m_Props.RemoveAll();
+
+		RecvTable_SkipProps( pRecvTable, &buf );
+		work.m_iEndBit = buf.GetNumBitsRead();
+
+		if ( buf.IsOverflowed() )
+			return false;
+	}
+
+	if ( s_nUnpackWork < 2 )
+		return false;
+
+	ParallelProcess( "UnpackWork_t::Process", s_UnpackWork.Base(), s_nUnpackWork, &UnpackWork_t::Process );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hands the entity's props decoded by CL_UnpackPacketEntities to it and
+//  seeks u.m_pBuf past them. Returns false if they have to be decoded now.
+//-----------------------------------------------------------------------------
+static bool CL_ApplyUnpackedEntity( CEntityReadInfo &u, RecvTable *pRecvTable, IClientNetworkable *pEnt, bool bEnterPVS )
+{
+	if ( s_iNextUnpackWork >= s_nUnpackWork )
+		return false;
+
+	const UnpackWork_t &work = s_UnpackWork[s_iNextUnpackWork];
+	if ( work.m_nEntity != u.m_nNewEntity || work.m_iStartBit != u.m_pBuf->GetNumBitsRead() )
+		return false;
+
+	s_iNextUnpackWork++;
+
+	if ( !work.m_bDecoded || work.m_pRecvTable != pRecvTable || ( work.m_pBaselineData != NULL ) != bEnterPVS )
+		return false;
+
+	if ( bEnterPVS )
+	{
+		// write data from baseline into entity
+		RecvTable_ApplyProps( pRecvTable, pEnt->GetDataTableBasePtr(), &work.m_Baseline, u.m_nNewEntity );
+	}
+
+	RecvTable_ApplyProps( pRecvTable, pEnt->GetDataTableBasePtr(), &work.m_Props, u.m_nNewEntity );
+	u.m_pBuf->Seek( work.m_iEndBit );
+	return true;
+}
+
+
 // ----------------------------------------------------------------------------- //
 // Regular handles for ReadPacketEntities.
 // ----------------------------------------------------------------------------- //
@@ -393,7 +579,7 @@ void CL_CopyNewEntity(
 		RecvTable_Decode( pRecvTable, ent->GetDataTableBasePtr(), &fromBuf, u.m_nNewEntity, false );
 
 	}
-	else
+	else if ( !CL_ApplyUnpackedEntity( u, pRecvTable, ent, true ) )
 	{
 		// write data from baseline into entity
 		RecvTable_Decode( pRecvTable, ent->GetDataTableBasePtr(), &fromBuf, u.m_nNewEntity, false );
@@ -478,7 +664,10 @@ void CL_CopyExistingEntity( CEntityReadInfo &u )
 		return;
 	}
 
-	RecvTable_Decode( pRecvTable, pEnt->GetDataTableBasePtr(), u.m_pBuf, u.m_nNewEntity );
+	if ( !CL_ApplyUnpackedEntity( u, pRecvTable, pEnt, false ) )
+	{
+		RecvTable_Decode( pRecvTable, pEnt->GetDataTableBasePtr(), u.m_pBuf, u.m_nNewEntity );
+	}
 
 	CL_AddPostDataUpdateCall( u, u.m_nNewEntity, DATA_UPDATE_DATATABLE_CHANGED );
 
@@ -657,10 +846,15 @@ bool CL_ProcessPacketEntities ( SVC_PacketEntities *entmsg )
 	u.m_nHeaderCount = entmsg->m_nUpdatedEntries;
 	u.m_nBaseline = entmsg->m_nBaseline;
 	u.m_bUpdateBaselines = entmsg->m_bUpdateBaseline;
+
+	// decode the entities' props ahead of time on the thread pool
+	CL_UnpackPacketEntities( u );
 	
 	// update the entities
 	cl.ReadPacketEntities( u );
 
+	s_nUnpackWork = 0;
+
 	ClientDLL_FrameStageNotify( FRAME_NET_UPDATE_POSTDATAUPDATE_START );
 
 	// call PostDataUpdate() for each entity
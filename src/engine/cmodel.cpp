@@ -537,6 +537,9 @@ struct leafnums_t
 	int		leafMaxCount;
 	int		*pLeafList;
 	CCollisionBSPData *pBSPData;
+	// if non-NULL, receives how far the box can move or grow before any
+	// node on the walk would classify it differently
+	float	*pLeafSlack;
 };
 
 
@@ -582,11 +585,21 @@ int CM_BoxLeafnums( leafnums_t &context, const Vector &center, const Vector &ext
 			float d1 = DotProductAbs( plane->normal, extents );
 			prev_topnode = nodenum;
 			if (d0 >= d1)
+			{
+				if ( context.pLeafSlack )
+					*context.pLeafSlack = MIN( *context.pLeafSlack, d0 - d1 );
 				nodenum = node->children[0];
+			}
 			else if (d0 < -d1)
+			{
+				if ( context.pLeafSlack )
+					*context.pLeafSlack = MIN( *context.pLeafSlack, -d1 - d0 );
 				nodenum = node->children[1];
+			}
 			else
 			{	// go down both
+				if ( context.pLeafSlack )
+					*context.pLeafSlack = MIN( *context.pLeafSlack, MIN( d1 - d0, d0 + d1 ) );
 				if (context.leafTopNode == -1)
 					context.leafTopNode = nodenum;
 				nodeList[nodeWriteIndex] = node->children[0];
@@ -599,12 +612,17 @@ int CM_BoxLeafnums( leafnums_t &context, const Vector &center, const Vector &ext
 	}
 }
 
-int	CM_BoxLeafnums ( const Vector& mins, const Vector& maxs, int *list, int listsize, int *topnode)
+int	CM_BoxLeafnums ( const Vector& mins, const Vector& maxs, int *list, int listsize, int *topnode, float *pSlack )
 {
 	leafnums_t context;
 	context.pLeafList = list;
 	context.leafTopNode = -1;
 	context.leafMaxCount = listsize;
+	context.pLeafSlack = pSlack;
+	if ( pSlack )
+	{
+		*pSlack = FLT_MAX;
+	}
 	// get the current collision bsp -- there is only one!
 	context.pBSPData = GetCollisionBSPData();
 	Vector center = (mins+maxs)*0.5f;
@@ -2073,6 +2091,7 @@ static inline void CM_UnsweptBoxTrace( TraceInfo_t *pTraceInfo, const Ray_t& ray
 	context.leafTopNode = -1;
 	context.leafMaxCount = ARRAYSIZE(leafs);
 	context.pBSPData = pTraceInfo->m_pBSPData;
+	context.pLeafSlack = NULL;
 
 	bool bFoundNonSolidLeaf = false;
 	numleafs = CM_BoxLeafnums ( context, ray.m_Start, ray.m_Extents+Vector(1,1,1), headnode);
@@ -2493,6 +2512,11 @@ void	FloodAreaConnections ( CCollisionBSPData *pBSPData )
 
 }
 
+// The server sets every areaportal's state once per client per frame, but
+// they rarely change, so only reflood when one actually opened or closed.
+static int s_nAreaFloods;
+static int s_nAreaFloodsSkipped;
+
 void CM_SetAreaPortalState( int portalnum, int isOpen )
 {
 	// get the current collision bsp -- there is only one!
@@ -2504,8 +2528,15 @@ void CM_SetAreaPortalState( int portalnum, int isOpen )
 		Sys_Error( "portalnum > numareaportals");
 	}
 
+	if ( pBSPData->portalopen[portalnum] == (isOpen != 0) )
+	{
+		++s_nAreaFloodsSkipped;
+		return;
+	}
+
 	pBSPData->portalopen[portalnum] = (isOpen != 0);
 	FloodAreaConnections (pBSPData);
+	++s_nAreaFloods;
 }
 
 void CM_SetAreaPortalStates( const int *portalnums, const int *isOpen, int nPortals )
@@ -2516,16 +2547,40 @@ void CM_SetAreaPortalStates( const int *portalnums, const int *isOpen, int nPort
 	CCollisionBSPData *pBSPData = GetCollisionBSPData();
 
 	// get the current collision bsp -- there is only one!
+	bool bChanged = false;
 	for ( int i=0; i < nPortals; i++ )
 	{
 		// Portalnums in the BSP file are 1-based instead of 0-based
 		if (portalnums[i] > pBSPData->numareaportals)
 			Sys_Error( "portalnum > numareaportals");
 
-		pBSPData->portalopen[portalnums[i]] = (isOpen[i] != 0);
+		bool bOpen = (isOpen[i] != 0);
+		if ( pBSPData->portalopen[portalnums[i]] != bOpen )
+		{
+			pBSPData->portalopen[portalnums[i]] = bOpen;
+			bChanged = true;
+		}
+	}
+
+	if ( !bChanged )
+	{
+		++s_nAreaFloodsSkipped;
+		return;
 	}
 
 	FloodAreaConnections( pBSPData );
+	++s_nAreaFloods;
+}
+
+void CM_GetAreaFloodStats( int *pFloods, int *pSkipped, bool bReset )
+{
+	*pFloods = s_nAreaFloods;
+	*pSkipped = s_nAreaFloodsSkipped;
+	if ( bReset )
+	{
+		s_nAreaFloods = 0;
+		s_nAreaFloodsSkipped = 0;
+	}
 }
 
 bool	CM_AreasConnected (int area1, int area2)
@@ -2762,6 +2817,13 @@ void CM_SetupAreaFloodNums( byte areaFloodNums[MAX_MAP_AREAS], int *pNumAreas )
 	if ( pBSPData->numareas > MAX_MAP_AREAS )
 		Error( "pBSPData->numareas > MAX_MAP_AREAS" );
 
+	if ( map_noareas.GetInt() )
+	{
+		// for debugging, everything is connected (see CM_AreasConnected)
+		memset( areaFloodNums, 0, pBSPData->numareas );
+		return;
+	}
+
 	for ( int i=0; i < pBSPData->numareas; i++ )
 	{
 		Assert( pBSPData->map_areas[i].floodnum < MAX_MAP_AREAS );
@@ -46,9 +46,11 @@ int			CM_PointLeafnum( const Vector& p );
 void		CM_SnapPointToReferenceLeaf(const Vector &referenceLeafPoint, float tolerance, Vector *pSnapPoint);
 
 // call with topnode set to the headnode, returns with topnode
-// set to the first node that splits the box
+// set to the first node that splits the box. If pSlack is given it receives
+// the distance the box center plus extents may change by without touching
+// a different set of leafs.
 int			CM_BoxLeafnums( const Vector& mins, const Vector& maxs, int *list,
-							int listsize, int *topnode );
+							int listsize, int *topnode, float *pSlack = NULL );
 //int			CM_TransformedBoxContents( const Vector& pos, const Vector& mins, const Vector& maxs, int headnode, const Vector& origin, const QAngle& angles );
 
 // Versions that accept rays...
@@ -65,6 +67,7 @@ int			CM_LeafFlags( int leafnum );
 
 void		CM_SetAreaPortalState( int portalnum, int isOpen );
 void		CM_SetAreaPortalStates( const int *portalnums, const int *isOpen, int nPortals );
+void		CM_GetAreaFloodStats( int *pFloods, int *pSkipped, bool bReset );
 bool	CM_AreasConnected( int area1, int area2 );
 
 int			CM_WriteAreaBits( byte *buffer, int buflen, int area );
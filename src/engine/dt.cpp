@@ -15,6 +15,7 @@
 #include "tier1/strtools.h"
 #include "tier0/dbg.h"
 #include "dt_stack.h"
+#include "coordsize.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -442,10 +443,120 @@ bool CSendTablePrecalc::SetupFlatPropertyArray()
 	SetRecursiveProxyIndices_R( pTable, GetRootNode(), nProxyIndices );
 
 	SendTable_GenerateProxyPaths( this, nProxyIndices );
+
+	SetupEncodePlan();
 	return true;
 }
 
 
+// Returns the number of bits a float component with these flags always encodes to,
+// or 0 if the encoding is variable length. Matches Float_SkipProp.
+static int GetFixedFloatBits( const SendProp *pProp )
+{
+	int flags = pProp->GetFlags();
+	if ( flags & ( SPROP_COORD | SPROP_COORD_MP | SPROP_COORD_MP_LOWPRECISION | SPROP_COORD_MP_INTEGRAL ) )
+		return 0;
+	else if ( flags & SPROP_NOSCALE )
+		return 32;
+	else if ( flags & SPROP_NORMAL )
+		return NORMAL_FRACTIONAL_BITS + 1;
+	else
+		return pProp->m_nBits;
+}
+
+
+static int GetFixedPropBits( const SendProp *pProp )
+{
+	switch ( pProp->GetType() )
+	{
+		case DPT_Int:
+			return ( pProp->GetFlags() & SPROP_VARINT ) ? 0 : pProp->m_nBits;
+
+		case DPT_Float:
+			return GetFixedFloatBits( pProp );
+
+		case DPT_Vector:
+		{
+			int nBits = GetFixedFloatBits( pProp );
+			if ( !nBits )
+				return 0;
+			// Normals send a sign bit instead of z.
+			return ( pProp->GetFlags() & SPROP_NORMAL ) ? nBits * 2 + 1 : nBits * 3;
+		}
+
+		case DPT_VectorXY:
+			return GetFixedFloatBits( pProp ) * 2;
+
+		default:
+			// Strings, arrays and int64s are variable length.
+			return 0;
+	}
+}
+
+
+static CSendTablePrecalc::EncodeOp_t GetPropEncodeOp( const SendProp *pProp )
+{
+	switch ( pProp->GetType() )
+	{
+		case DPT_Int:
+			if ( pProp->GetFlags() & SPROP_VARINT )
+				return CSendTablePrecalc::ENCODEOP_GENERIC;
+			return pProp->IsSigned() ? CSendTablePrecalc::ENCODEOP_SINT : CSendTablePrecalc::ENCODEOP_UINT;
+
+		case DPT_Float:
+			return CSendTablePrecalc::ENCODEOP_FLOAT;
+
+		case DPT_Vector:
+			return CSendTablePrecalc::ENCODEOP_VECTOR;
+
+		case DPT_VectorXY:
+			return CSendTablePrecalc::ENCODEOP_VECTORXY;
+
+		default:
+			return CSendTablePrecalc::ENCODEOP_GENERIC;
+	}
+}
+
+
+void CSendTablePrecalc::SetupEncodePlan()
+{
+	int nProps = GetNumProps();
+
+	MEM_ALLOC_CREDIT();
+	m_PropFixedBits.SetSize( nProps );
+	m_EncodeRuns.RemoveAll();
+
+	for ( int i=0; i < nProps; i++ )
+	{
+		const SendProp *pProp = GetProp( i );
+
+		int nFixedBits = GetFixedPropBits( pProp );
+		Assert( nFixedBits <= 0xFFFF );
+		m_PropFixedBits[i] = (unsigned short)nFixedBits;
+
+		// Only the op and the width of a single component matter when grouping.
+		unsigned char op = (unsigned char)GetPropEncodeOp( pProp );
+		unsigned char nBits = (unsigned char)( ( pProp->GetType() == DPT_Int || pProp->GetType() == DPT_Float ) ? nFixedBits : GetFixedFloatBits( pProp ) );
+
+		if ( m_EncodeRuns.Count() )
+		{
+			CEncodeRun &last = m_EncodeRuns.Tail();
+			if ( last.m_Op == op && last.m_nBits == nBits )
+			{
+				++last.m_nProps;
+				continue;
+			}
+		}
+
+		CEncodeRun &run = m_EncodeRuns[ m_EncodeRuns.AddToTail() ];
+		run.m_iFirstProp = (unsigned short)i;
+		run.m_nProps = 1;
+		run.m_Op = op;
+		run.m_nBits = nBits;
+	}
+}
+
+
 // ---------------------------------------------------------------------------------------- //
 // Helpers.
 // ---------------------------------------------------------------------------------------- //
@@ -361,9 +361,36 @@ public:
 	int			GetNumDataTableProxies() const;
 	void		SetNumDataTableProxies( int count );
 
+	// Builds m_EncodeRuns and m_PropFixedBits from the flat property array.
+	void		SetupEncodePlan();
+
+	// Returns the number of bits prop i always encodes to, or 0 if its encoding is variable length.
+	int			GetPropFixedBits( int i ) const;
+
 
 public:
 
+	// How SendTable_Encode writes the props in a run.
+	enum EncodeOp_t
+	{
+		ENCODEOP_GENERIC=0,		// Call through g_PropTypeFns.
+		ENCODEOP_UINT,			// Fixed-width unsigned int.
+		ENCODEOP_SINT,			// Fixed-width signed int.
+		ENCODEOP_FLOAT,			// EncodeFloat.
+		ENCODEOP_VECTOR,		// EncodeFloat for x and y, then z or the normal's sign bit.
+		ENCODEOP_VECTORXY,		// EncodeFloat for x and y.
+	};
+
+	// A run of consecutive flat props that share an encode op and bit width.
+	class CEncodeRun
+	{
+	public:
+		unsigned short	m_iFirstProp;
+		unsigned short	m_nProps;
+		unsigned char	m_Op;		// EncodeOp_t.
+		unsigned char	m_nBits;	// Fixed bit width shared by the run (0 if variable).
+	};
+
 	class CProxyPathEntry
 	{
 	public:
@@ -410,6 +437,12 @@ public:
 	
 	// Map prop offsets to indices for properties that can use it.
 	CUtlMap<unsigned short, unsigned short> m_PropOffsetToIndexMap;
+
+	// The precompiled encode plan. SendTable_Encode dispatches once per run instead of once per prop.
+	CUtlVector<CEncodeRun>		m_EncodeRuns;
+
+	// Indexed like m_Props. See GetPropFixedBits().
+	CUtlVector<unsigned short>	m_PropFixedBits;
 };
 
 
@@ -454,6 +487,11 @@ inline void CSendTablePrecalc::SetNumDataTableProxies( int count )
 	m_nDataTableProxies = count;
 }					   
 
+inline int CSendTablePrecalc::GetPropFixedBits( int i ) const
+{
+	return m_PropFixedBits[i];
+}
+
 
 // ------------------------------------------------------------------------ //
 // Helpers.
@@ -86,6 +86,11 @@ typedef struct
 extern PropTypeFns g_PropTypeFns[DPT_NUMSendPropTypes];
 
 
+// Encodes a single float component the way Float_Encode does. Exposed so SendTable_Encode's
+// precompiled plan can call it directly instead of going through g_PropTypeFns.
+void EncodeFloat( const SendProp *pProp, float fVal, bf_write *pOut, int objectID );
+
+
 // This is used for comparing packed buffers. Just extracts the raw bits for the 
 // data and returns the number of bits used to encode the data.
 int	DecodeBits( DecodeInfo *pInfo, unsigned char *pOut );
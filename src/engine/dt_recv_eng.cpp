@@ -561,6 +561,173 @@ void RecvTable_DecodeZeros( RecvTable *pTable, void *pStruct, int objectID )
 }
 
 
+void RecvTable_SkipProps( RecvTable *pTable, bf_read *pIn )
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	ErrorIfNot( pDecoder,
+		("RecvTable_SkipProps: table '%s' missing a decoder.", pTable->GetName())
+	);
+
+	unsigned int iProp;
+	CDeltaBitsReader deltaBitsReader( pIn );
+	while ( (iProp = deltaBitsReader.ReadNextPropIndex()) < MAX_DATATABLE_PROPS )
+	{
+		deltaBitsReader.SkipPropData( pDecoder->GetSendProp( iProp ) );
+	}
+}
+
+
+static void RecvTable_ReadPropValue( const SendProp *pSendProp, int iProp, bf_read *pIn, CRecvDecodedProps *pProps )
+{
+	int iValue = pProps->m_Props.AddToTail();
+	CRecvDecodedProps::Prop_t *pValue = &pProps->m_Props[iValue];
+	pValue->m_iProp = iProp;
+	pValue->m_iString = -1;
+
+	switch ( pSendProp->GetType() )
+	{
+	case DPT_String:
+		{
+			// Same as String_Decode, but the string is kept in pProps.
+			int len = pIn->ReadUBitLong( DT_MAX_STRING_BITS );
+			if ( len >= DT_MAX_STRING_BUFFERSIZE )
+			{
+				Warning( "RecvTable_ReadProps( %s ) invalid length (%d)\n", pSendProp->GetName(), len );
+				len = DT_MAX_STRING_BUFFERSIZE - 1;
+			}
+
+			int iString = pProps->m_Strings.AddMultipleToTail( len + 1 );
+			pIn->ReadBits( &pProps->m_Strings[iString], len*8 );
+			pProps->m_Strings[iString + len] = 0;
+
+			pValue->m_iString = iString;
+		}
+		break;
+
+	case DPT_Array:
+		{
+			// Same as Array_Decode. The elements are stored right after the array.
+			const SendProp *pArrayProp = pSendProp->GetArrayProp();
+			int nElements = pIn->ReadUBitLong( pSendProp->GetNumArrayLengthBits() );
+			pValue->m_Value.m_Int = nElements;
+
+			for ( int iElement=0; iElement < nElements; iElement++ )
+			{
+				RecvTable_ReadPropValue( pArrayProp, iProp, pIn, pProps );
+			}
+		}
+		break;
+
+	default:
+		{
+			// Without a RecvProp the decode functions only read the value.
+			DecodeInfo decodeInfo;
+			decodeInfo.m_pStruct = NULL;
+			decodeInfo.m_pData = NULL;
+			decodeInfo.m_pRecvProp = NULL;
+			decodeInfo.m_pProp = pSendProp;
+			decodeInfo.m_pIn = pIn;
+			decodeInfo.m_ObjectID = -1;
+
+			g_PropTypeFns[ pSendProp->GetType() ].Decode( &decodeInfo );
+			pValue->m_Value = decodeInfo.m_Value;
+		}
+		break;
+	}
+}
+
+
+bool RecvTable_ReadProps( RecvTable *pTable, bf_read *pIn, CRecvDecodedProps *pProps )
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	ErrorIfNot( pDecoder,
+		("RecvTable_ReadProps: table '%s' missing a decoder.", pTable->GetName())
+	);
+
+	unsigned int iProp;
+	CDeltaBitsReader deltaBitsReader( pIn );
+	while ( (iProp = deltaBitsReader.ReadNextPropIndex()) < MAX_DATATABLE_PROPS )
+	{
+		RecvTable_ReadPropValue( pDecoder->GetSendProp( iProp ), iProp, pIn, pProps );
+	}
+
+	return !pIn->IsOverflowed();
+}
+
+
+static inline void RecvTable_ApplyPropValue( CRecvProxyData *pProxyData, const CRecvDecodedProps *pProps, int iValue, void *pStruct, void *pData )
+{
+	const CRecvDecodedProps::Prop_t &value = pProps->m_Props[iValue];
+
+	pProxyData->m_Value = value.m_Value;
+	if ( value.m_iString >= 0 )
+	{
+		pProxyData->m_Value.m_pString = &pProps->m_Strings[value.m_iString];
+	}
+
+	pProxyData->m_pRecvProp->GetProxyFn()( pProxyData, pStruct, pData );
+}
+
+
+void RecvTable_ApplyProps( RecvTable *pTable, void *pStruct, const CRecvDecodedProps *pProps, int objectID )
+{
+	CRecvDecoder *pDecoder = pTable->m_pDecoder;
+	ErrorIfNot( pDecoder,
+		("RecvTable_ApplyProps: table '%s' missing a decoder.", pTable->GetName())
+	);
+
+	// Walk the stack the same way RecvTable_Decode does.
+	CClientDatatableStack theStack( pDecoder, (unsigned char*)pStruct, objectID );
+
+	theStack.Init();
+	for ( int iValue=0; iValue < pProps->m_Props.Count(); iValue++ )
+	{
+		int iProp = pProps->m_Props[iValue].m_iProp;
+		theStack.SeekToProp( iProp );
+		++g_nPropsDecoded;
+
+		const RecvProp *pProp = pDecoder->GetProp( iProp );
+		bool bArray = ( pDecoder->GetSendProp( iProp )->GetType() == DPT_Array );
+		int nElements = bArray ? pProps->m_Props[iValue].m_Value.m_Int : 0;
+
+		// Just skip the data if the prop is missing or the proxies are screwed.
+		if ( !pProp || !theStack.IsCurProxyValid() )
+		{
+			iValue += nElements;
+			continue;
+		}
+
+		CRecvProxyData proxyData;
+		proxyData.m_pRecvProp = pProp;
+		proxyData.m_iElement = 0;
+		proxyData.m_ObjectID = objectID;
+
+		void *pStructBase = theStack.GetCurStructBase();
+		unsigned char *pData = theStack.GetCurStructBase() + pProp->GetOffset();
+
+		if ( !bArray )
+		{
+			RecvTable_ApplyPropValue( &proxyData, pProps, iValue, pStructBase, pData );
+			continue;
+		}
+
+		// Same as Array_Decode.
+		const RecvProp *pArrayRecvProp = pProp->GetArrayProp();
+		ArrayLengthRecvProxyFn lengthProxy = pProp->GetArrayLengthProxy();
+		if ( lengthProxy )
+			lengthProxy( pStructBase, objectID, nElements );
+
+		proxyData.m_pRecvProp = pArrayRecvProp;
+		pData += pArrayRecvProp->GetOffset();
+		for ( proxyData.m_iElement=0; proxyData.m_iElement < nElements; proxyData.m_iElement++ )
+		{
+			RecvTable_ApplyPropValue( &proxyData, pProps, ++iValue, pStructBase, pData );
+			pData += pProp->GetElementStride();
+		}
+	}
+}
+
+
 
 int RecvTable_MergeDeltas(
 	RecvTable *pTable,
@@ -15,6 +15,7 @@
 #include "dt_recv.h"
 #include "bitbuf.h"
 #include "dt.h"
+#include "utlvector.h"
 
 class CStandardSendProxies;
 
@@ -86,6 +87,43 @@ void RecvTable_CopyEncoding(
 
 
 
+// Skips over a buffer RecvTable_Decode could read without decoding any of it.
+void RecvTable_SkipProps( RecvTable *pTable, bf_read *pIn );
+
+
+// ------------------------------------------------------------------------------------------ //
+// Split decoding.
+//
+// RecvTable_Decode reads each value and hands it to its recv proxy in one pass. These split
+// that in two, so the values of many objects can be read on worker threads while the proxies,
+// which write into the client's entities, still run on the main thread.
+// ------------------------------------------------------------------------------------------ //
+
+class CRecvDecodedProps
+{
+public:
+	void	RemoveAll()		{ m_Props.RemoveAll(); m_Strings.RemoveAll(); }
+
+public:
+	struct Prop_t
+	{
+		int			m_iProp;	// Index into the decoder's flat property list.
+		int			m_iString;	// Offset of a DPT_String value in m_Strings, -1 for other types.
+		DVariant	m_Value;	// For DPT_Array, m_Int is the element count and the elements follow.
+	};
+
+	CUtlVector<Prop_t>	m_Props;
+	CUtlVector<char>	m_Strings;
+};
+
+// Reads the values in pIn (anything RecvTable_Decode can read) into pProps without calling
+// any proxies, so it can be called from any thread. Returns false if pIn overflowed.
+bool RecvTable_ReadProps( RecvTable *pTable, bf_read *pIn, CRecvDecodedProps *pProps );
+
+// Hands the values from RecvTable_ReadProps to the recv proxies, the same way RecvTable_Decode would.
+void RecvTable_ApplyProps( RecvTable *pTable, void *pStruct, const CRecvDecodedProps *pProps, int objectID );
+
+
 // ------------------------------------------------------------------------------------------ //
 // Globals
 // ------------------------------------------------------------------------------------------ //
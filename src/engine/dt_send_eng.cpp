@@ -10,6 +10,7 @@
 #include <tier0/icommandline.h>
 #include <commonmacros.h>
 #include <checksum_crc.h>
+#include "convar.h"
 
 #include "dt_send_eng.h"
 #include "dt_encode.h"
@@ -17,6 +18,7 @@
 #include "dt_stack.h"
 #include "common.h"
 #include "packed_entity.h"
+#include "coordsize.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -233,6 +235,8 @@ public:
 CUtlVector< SendTable* > g_SendTables;
 CRC32_t	g_SendTableCRC = 0;
 
+static ConVar dt_encodeplan( "dt_encodeplan", "1", 0, "Encode and delta-compare props through each SendTable's precompiled encode plan instead of per-prop type callbacks." );
+
 
 
 // ------------------------------------------------------------------------ //
@@ -403,13 +407,134 @@ int SendTable_WriteAllDeltaProps(
 }
 
 
-bool SendTable_Encode(
+// Encodes all props one at a time through g_PropTypeFns.
+static void SendTable_EncodeProps_Generic( CEncodeInfo *pInfo, bool bNonZeroOnly )
+{
+	int iNumProps = pInfo->m_pPrecalc->GetNumProps();
+
+	for ( int iProp=0; iProp < iNumProps; iProp++ )
+	{
+		// skip if we don't have a valid prop proxy
+		if ( !pInfo->IsPropProxyValid( iProp ) )
+			continue;
+
+		pInfo->SeekToProp( iProp );
+        
+		// skip empty prop if we only encode non-zero values
+		if ( bNonZeroOnly && SendTable_IsPropZero( pInfo, iProp ) )
+			continue;
+
+		SendTable_EncodeProp( pInfo, iProp );
+	}
+}
+
+
+// Encodes one run of the precompiled plan. The op is a template parameter so the
+// switch below folds away and each run's inner loop calls its encoder directly.
+template< int nOp >
+static void SendTable_EncodeRun( CEncodeInfo *pInfo, const CSendTablePrecalc::CEncodeRun &run, bool bNonZeroOnly )
+{
+	CSendTablePrecalc *pPrecalc = pInfo->m_pPrecalc;
+	bf_write *pOut = pInfo->m_DeltaBitsWriter.GetBitBuf();
+	int objectID = pInfo->GetObjectID();
+
+	int iEndProp = run.m_iFirstProp + run.m_nProps;
+	for ( int iProp=run.m_iFirstProp; iProp < iEndProp; iProp++ )
+	{
+		if ( !pInfo->IsPropProxyValid( iProp ) )
+			continue;
+
+		pInfo->SeekToProp( iProp );
+
+		const SendProp *pProp = pPrecalc->GetProp( iProp );
+		unsigned char *pStructBase = pInfo->GetCurStructBase();
+
+		DVariant var;
+		pProp->GetProxyFn()( 
+			pProp,
+			pStructBase, 
+			pStructBase + pProp->GetOffset(), 
+			&var, 
+			0, // iElement
+			objectID
+			);
+
+		if ( bNonZeroOnly && g_PropTypeFns[pProp->m_Type].IsZero( pStructBase, &var, pProp ) )
+			continue;
+
+		pInfo->m_DeltaBitsWriter.WritePropIndex( iProp );
+
+		switch ( nOp )
+		{
+			case CSendTablePrecalc::ENCODEOP_UINT:
+				pOut->WriteUBitLong( (unsigned int)var.m_Int, run.m_nBits );
+				break;
+
+			case CSendTablePrecalc::ENCODEOP_SINT:
+				pOut->WriteSBitLong( var.m_Int, run.m_nBits );
+				break;
+
+			case CSendTablePrecalc::ENCODEOP_FLOAT:
+				EncodeFloat( pProp, var.m_Float, pOut, objectID );
+				break;
+
+			case CSendTablePrecalc::ENCODEOP_VECTOR:
+				EncodeFloat( pProp, var.m_Vector[0], pOut, objectID );
+				EncodeFloat( pProp, var.m_Vector[1], pOut, objectID );
+				if ( ( pProp->GetFlags() & SPROP_NORMAL ) == 0 )
+				{
+					EncodeFloat( pProp, var.m_Vector[2], pOut, objectID );
+				}
+				else
+				{
+					// Write a sign bit for z instead!
+					pOut->WriteOneBit( var.m_Vector[2] <= -NORMAL_RESOLUTION );
+				}
+				break;
+
+			case CSendTablePrecalc::ENCODEOP_VECTORXY:
+				EncodeFloat( pProp, var.m_Vector[0], pOut, objectID );
+				EncodeFloat( pProp, var.m_Vector[1], pOut, objectID );
+				break;
+
+			default:
+				g_PropTypeFns[pProp->m_Type].Encode( pStructBase, &var, pProp, pOut, objectID ); 
+				break;
+		}
+	}
+}
+
+
+// Encodes all props by walking the precompiled plan built in CSendTablePrecalc::SetupEncodePlan.
+// Produces exactly the same bits as SendTable_EncodeProps_Generic.
+static void SendTable_EncodeProps_Plan( CEncodeInfo *pInfo, bool bNonZeroOnly )
+{
+	const CUtlVector<CSendTablePrecalc::CEncodeRun> &runs = pInfo->m_pPrecalc->m_EncodeRuns;
+
+	for ( int iRun=0; iRun < runs.Count(); iRun++ )
+	{
+		const CSendTablePrecalc::CEncodeRun &run = runs[iRun];
+		switch ( run.m_Op )
+		{
+			case CSendTablePrecalc::ENCODEOP_UINT:		SendTable_EncodeRun<CSendTablePrecalc::ENCODEOP_UINT>( pInfo, run, bNonZeroOnly ); break;
+			case CSendTablePrecalc::ENCODEOP_SINT:		SendTable_EncodeRun<CSendTablePrecalc::ENCODEOP_SINT>( pInfo, run, bNonZeroOnly ); break;
+			case CSendTablePrecalc::ENCODEOP_FLOAT:		SendTable_EncodeRun<CSendTablePrecalc::ENCODEOP_FLOAT>( pInfo, run, bNonZeroOnly ); break;
+			case CSendTablePrecalc::ENCODEOP_VECTOR:	SendTable_EncodeRun<CSendTablePrecalc::ENCODEOP_VECTOR>( pInfo, run, bNonZeroOnly ); break;
+			case CSendTablePrecalc::ENCODEOP_VECTORXY:	SendTable_EncodeRun<CSendTablePrecalc::ENCODEOP_VECTORXY>( pInfo, run, bNonZeroOnly ); break;
+			default:									SendTable_EncodeRun<CSendTablePrecalc::ENCODEOP_GENERIC>( pInfo, run, bNonZeroOnly ); break;
+		}
+	}
+}
+
+
+static bool SendTable_EncodeInternal(
 	const SendTable *pTable,
 	const void *pStruct, 
 	bf_write *pOut, 
 	int objectID,
 	CUtlMemory<CSendProxyRecipients> *pRecipients,
-	bool bNonZeroOnly
+	bool bNonZeroOnly,
+	bool bUsePlan
 	)
 {
 	CSendTablePrecalc *pPrecalc = pTable->m_pPrecalc;
@@ -428,28 +553,33 @@ bool SendTable_Encode(
 	info.m_pRecipients = pRecipients;	// optional buffer to store the bits for which clients get what data.
 
 	info.Init();
-	
-	int iNumProps = pPrecalc->GetNumProps();
 
-	for ( int iProp=0; iProp < iNumProps; iProp++ )
+	if ( bUsePlan )
 	{
-		// skip if we don't have a valid prop proxy
-		if ( !info.IsPropProxyValid( iProp ) )
-			continue;
-
-		info.SeekToProp( iProp );
-        
-		// skip empty prop if we only encode non-zero values
-		if ( bNonZeroOnly && SendTable_IsPropZero(&info, iProp) )
-			continue;
-
-		SendTable_EncodeProp( &info, iProp );
+		SendTable_EncodeProps_Plan( &info, bNonZeroOnly );
+	}
+	else
+	{
+		SendTable_EncodeProps_Generic( &info, bNonZeroOnly );
 	}
 
 	return !pOut->IsOverflowed();
 }
 
 
+bool SendTable_Encode(
+	const SendTable *pTable,
+	const void *pStruct, 
+	bf_write *pOut, 
+	int objectID,
+	CUtlMemory<CSendProxyRecipients> *pRecipients,
+	bool bNonZeroOnly
+	)
+{
+	return SendTable_EncodeInternal( pTable, pStruct, pOut, objectID, pRecipients, bNonZeroOnly, dt_encodeplan.GetBool() );
+}
+
+
 void SendTable_WritePropList(
 	const SendTable *pTable,
 	const void *pState,
@@ -533,7 +663,29 @@ void SendTable_WritePropList(
 }
 
 
-int SendTable_CalcDelta(
+// Compares the next nBits of both buffers as raw bits and advances both past them.
+// Returns true if they differ.
+static FORCEINLINE bool SendTable_RawBitsDiffer( bf_read *p1, bf_read *p2, int nBits )
+{
+	while ( nBits > 32 )
+	{
+		if ( p1->ReadUBitLong( 32 ) != p2->ReadUBitLong( 32 ) )
+		{
+			p1->SeekRelative( nBits - 32 );
+			p2->SeekRelative( nBits - 32 );
+			return true;
+		}
+		nBits -= 32;
+	}
+
+	return p1->ReadUBitLong( nBits ) != p2->ReadUBitLong( nBits );
+}
+
+
+// With bUsePlan, fixed-width props (see CSendTablePrecalc::GetPropFixedBits) are skipped and
+// compared as raw bit ranges instead of through g_PropTypeFns.
+template< bool bUsePlan >
+static int SendTable_CalcDeltaInternal(
 	const SendTable *pTable,
 	
 	const void *pFromState,
@@ -580,7 +732,15 @@ int SendTable_CalcDelta(
 			// Skip any properties in the from state that aren't in the to state.
 			while ( iFromProp < iToProp )
 			{
-				fromBitsReader.SkipPropData( pPrecalc->GetProp( iFromProp ) );
+				int nFixedBits = bUsePlan ? pPrecalc->GetPropFixedBits( iFromProp ) : 0;
+				if ( nFixedBits )
+				{
+					fromBits.SeekRelative( nFixedBits );
+				}
+				else
+				{
+					fromBitsReader.SkipPropData( pPrecalc->GetProp( iFromProp ) );
+				}
 				iFromProp = fromBitsReader.ReadNextPropIndex();
 			}
 
@@ -588,7 +748,18 @@ int SendTable_CalcDelta(
 			{
 				// The property is in both states, so compare them and write the index 
 				// if the states are different.
-				if ( fromBitsReader.ComparePropData( &toBitsReader, pPrecalc->GetProp( iToProp ) ) )
+				int nFixedBits = bUsePlan ? pPrecalc->GetPropFixedBits( iToProp ) : 0;
+				bool bChanged;
+				if ( nFixedBits )
+				{
+					bChanged = SendTable_RawBitsDiffer( &fromBits, &toBits, nFixedBits );
+				}
+				else
+				{
+					bChanged = fromBitsReader.ComparePropData( &toBitsReader, pPrecalc->GetProp( iToProp ) ) != 0;
+				}
+
+				if ( bChanged )
 				{
 					*pDeltaProps++ = iToProp;
 					if ( pDeltaProps >= pDeltaPropsEnd )
@@ -603,7 +774,15 @@ int SendTable_CalcDelta(
 			else
 			{
 				// Only the 'to' state has this property, so just skip its data and register a change.
-				toBitsReader.SkipPropData( pPrecalc->GetProp( iToProp ) );
+				int nFixedBits = bUsePlan ? pPrecalc->GetPropFixedBits( iToProp ) : 0;
+				if ( nFixedBits )
+				{
+					toBits.SeekRelative( nFixedBits );
+				}
+				else
+				{
+					toBitsReader.SkipPropData( pPrecalc->GetProp( iToProp ) );
+				}
 				*pDeltaProps++ = iToProp;
 				if ( pDeltaProps >= pDeltaPropsEnd )
 				{
@@ -638,6 +817,75 @@ int SendTable_CalcDelta(
 	return pDeltaProps - pDeltaPropsBase;
 }
 
+
+int SendTable_CalcDelta(
+	const SendTable *pTable,
+	
+	const void *pFromState,
+	const int nFromBits,
+	
+	const void *pToState,
+	const int nToBits,
+	
+	int *pDeltaProps,
+	int nMaxDeltaProps,
+
+	const int objectID
+	)
+{
+	if ( dt_encodeplan.GetBool() )
+	{
+		return SendTable_CalcDeltaInternal<true>( pTable, pFromState, nFromBits, pToState, nToBits, pDeltaProps, nMaxDeltaProps, objectID );
+	}
+
+	return SendTable_CalcDeltaInternal<false>( pTable, pFromState, nFromBits, pToState, nToBits, pDeltaProps, nMaxDeltaProps, objectID );
+}
+
+
+bool SendTable_VerifyEncodePlan( 
+	const SendTable *pTable, 
+	const void *pStruct, 
+	int objectID, 
+	const void *pFromState, 
+	int nFromBits )
+{
+	ALIGN4 unsigned char planBits[MAX_PACKEDENTITY_DATA] ALIGN4_POST;
+	ALIGN4 unsigned char genericBits[MAX_PACKEDENTITY_DATA] ALIGN4_POST;
+
+	bf_write planBuf( "SendTable_VerifyEncodePlan->planBuf", planBits, sizeof( planBits ) );
+	bf_write genericBuf( "SendTable_VerifyEncodePlan->genericBuf", genericBits, sizeof( genericBits ) );
+
+	if ( !SendTable_EncodeInternal( pTable, pStruct, &planBuf, objectID, NULL, false, true ) ||
+		 !SendTable_EncodeInternal( pTable, pStruct, &genericBuf, objectID, NULL, false, false ) )
+	{
+		Warning( "SendTable_VerifyEncodePlan: overflow encoding '%s'.\n", pTable->GetName() );
+		return false;
+	}
+
+	if ( !CompareBitArrays( planBits, genericBits, planBuf.GetNumBitsWritten(), genericBuf.GetNumBitsWritten() ) )
+	{
+		Warning( "SendTable_VerifyEncodePlan: '%s' encodes to %d bits through the plan and %d bits generically, or the bits differ.\n", 
+			pTable->GetName(), planBuf.GetNumBitsWritten(), genericBuf.GetNumBitsWritten() );
+		return false;
+	}
+
+	// Delta against the supplied state (or against nothing, which exercises the zero checks).
+	int planProps[MAX_DATATABLE_PROPS];
+	int genericProps[MAX_DATATABLE_PROPS];
+
+	int nPlanProps = SendTable_CalcDeltaInternal<true>( pTable, pFromState, nFromBits, planBits, planBuf.GetNumBitsWritten(), planProps, ARRAYSIZE( planProps ), objectID );
+	int nGenericProps = SendTable_CalcDeltaInternal<false>( pTable, pFromState, nFromBits, planBits, planBuf.GetNumBitsWritten(), genericProps, ARRAYSIZE( genericProps ), objectID );
+
+	if ( nPlanProps != nGenericProps || V_memcmp( planProps, genericProps, nPlanProps * sizeof( planProps[0] ) ) )
+	{
+		Warning( "SendTable_VerifyEncodePlan: '%s' delta has %d changed props through the plan and %d generically, or the lists differ.\n", 
+			pTable->GetName(), nPlanProps, nGenericProps );
+		return false;
+	}
+
+	return true;
+}
+
 bool SendTable_WriteInfos( SendTable *pTable, bf_write *pBuf )
 {
 	pBuf->WriteString( pTable->GetName() );
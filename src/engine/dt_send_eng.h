@@ -117,6 +117,17 @@ bool SendTable_Encode(
 	);
 
 
+// Encodes pStruct through both the precompiled encode plan and the generic per-prop path and
+// returns true if they produce identical bits. Also checks that both SendTable_CalcDelta paths
+// find the same changed props between pFromState (which may be NULL) and the new encoding.
+bool SendTable_VerifyEncodePlan( 
+	const SendTable *pTable, 
+	const void *pStruct, 
+	int objectID, 
+	const void *pFromState, 
+	int nFromBits );
+
+
 // In order to receive a table, you must send it from the server and receive its info
 // on the client so the client knows how to unpack it.
 bool SendTable_WriteInfos( SendTable *pTable, bf_write *pBuf );
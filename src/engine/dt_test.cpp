@@ -888,15 +888,19 @@ void RunDataTableTest()
 	// Setup the data with all zeros.
 	DTTestServer dtServer;
 	DTTestClient dtClient;
+	DTTestClient dtSplitClient;	// Receives the same data through RecvTable_ReadProps/RecvTable_ApplyProps.
+	CRecvDecodedProps decodedProps;
 
 	ALIGN4 unsigned char prevEncoded[4096] ALIGN4_POST;
 	ALIGN4 unsigned char fullEncoded[4096] ALIGN4_POST;
 
 	memset(&dtServer, 0, sizeof(dtServer));
 	memset(&dtClient, 0, sizeof(dtClient));
+	memset(&dtSplitClient, 0, sizeof(dtSplitClient));
 	memset(prevEncoded, 0, sizeof(prevEncoded));
 
 	SetGuardBytes( &dtClient );
+	SetGuardBytes( &dtSplitClient );
 
 	// Now loop around, changing the data a little bit each time and send/recv deltas.
 	int nIterations = 25;
@@ -932,6 +936,12 @@ void RunDataTableTest()
 			Assert(false);
 		}
 
+		// The precompiled encode plan must produce the same bits and deltas as the generic path.
+		if ( !SendTable_VerifyEncodePlan( pSendTable, &dtServer, -1, iIteration ? prevEncoded : NULL, sizeof( prevEncoded ) * 8 ) )
+		{
+			Assert( !"RunDataTableTest: SendTable_VerifyEncodePlan failed." );
+		}
+
 
 		ALIGN4 unsigned char deltaEncoded[4096] ALIGN4_POST;
 		bf_write bfDeltaEncoded( "RunDataTableTest->bfDeltaEncoded", deltaEncoded, sizeof(deltaEncoded) );
@@ -1000,6 +1010,24 @@ void RunDataTableTest()
 
 		// Verify that only the changed properties were sent and that they were received correctly.
 		CompareDTTest( &dtClient, &dtServer );
+
+
+		// Skipping must end where decoding did, and decoding in two steps must give the same result.
+		bf_read bfSkip( "RunDataTableTest->bfSkip", copyEncoded, sizeof( copyEncoded ) );
+		RecvTable_SkipProps( pRecvTable, &bfSkip );
+		Verify( bfSkip.GetNumBitsRead() == bfDecode.GetNumBitsRead() );
+
+		bf_read bfSplitDecode( "RunDataTableTest->bfSplitDecode", copyEncoded, sizeof( copyEncoded ) );
+		decodedProps.RemoveAll();
+		if ( !RecvTable_ReadProps( pRecvTable, &bfSplitDecode, &decodedProps ) )
+		{
+			Assert( false );
+		}
+		Verify( bfSplitDecode.GetNumBitsRead() == bfDecode.GetNumBitsRead() );
+
+		RecvTable_ApplyProps( pRecvTable, &dtSplitClient, &decodedProps, 1111 );
+		CheckGuardBytes( &dtSplitClient );
+		CompareDTTest( &dtSplitClient, &dtServer );
 	}
 
 	SendTable_Term();
@@ -82,6 +82,9 @@ public:
 	// A version that simply accepts a ray (can work as a traceline or tracehull)
 	virtual void	TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace );
 
+	// Traces several rays at once, sharing the entity gathering between them
+	virtual void	TraceRays( int nRays, const Ray_t *pRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTraces );
+
 	// A version that sets up the leaf and entity lists and allows you to pass those in for collision.
 	virtual void	SetupLeafAndEntityListRay( const Ray_t &ray, CTraceListData &traceData );
 	virtual void    SetupLeafAndEntityListBox( const Vector &vecBoxMin, const Vector &vecBoxMax, CTraceListData &traceData );
@@ -158,6 +161,28 @@ private:
 
 	// Clips a trace to another trace
 	bool ClipTraceToTrace( trace_t &clipTrace, trace_t *pFinalTrace );
+
+	// A ray shortened to where it hit the world, plus what it takes to undo that
+	struct EntityRay_t
+	{
+		Ray_t	m_Ray;
+		float	m_flWorldFraction;
+		float	m_flWorldFractionLeftSolidScale;
+	};
+
+	// An entity that passed the filter for a whole TraceRays packet
+	struct PacketCandidate_t
+	{
+		ICollideable	*m_pCollideable;
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+	};
+
+	enum { MAX_TRACE_RAY_PACKET = 32 };
+
+	// The two halves of TraceRay around the entity pass, shared with TraceRays
+	bool TraceRayAgainstWorld( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace, EntityRay_t &entityRay );
+	void FinishTraceRay( const Ray_t &ray, const EntityRay_t &entityRay, trace_t *pTrace );
 private:
 	int m_traceStatCounters[NUM_TRACE_STAT_COUNTER];
 	const matrix3x4_t *m_pRootMoveParent;
@@ -197,11 +222,14 @@ public:
 //-----------------------------------------------------------------------------
 // Expose CVEngineServer to the game + client DLLs
 //-----------------------------------------------------------------------------
+// Version 3 is compatible with the latest since we're only adding things to the end, so expose that as well.
 static CEngineTraceServer	s_EngineTraceServer;
+EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CEngineTraceServer, IEngineTrace003, INTERFACEVERSION_ENGINETRACE_SERVER_VERSION_3, s_EngineTraceServer);
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CEngineTraceServer, IEngineTrace, INTERFACEVERSION_ENGINETRACE_SERVER, s_EngineTraceServer);
 
 #ifndef SWDS
 static CEngineTraceClient	s_EngineTraceClient;
+EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CEngineTraceClient, IEngineTrace003, INTERFACEVERSION_ENGINETRACE_CLIENT_VERSION_3, s_EngineTraceClient);
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CEngineTraceClient, IEngineTrace, INTERFACEVERSION_ENGINETRACE_CLIENT, s_EngineTraceClient);
 #endif
 
@@ -1665,36 +1693,11 @@ CON_COMMAND_EXTERN( ray_bench, RayBench, "Time the rays" )
 #endif
 
 //-----------------------------------------------------------------------------
-// A version that simply accepts a ray (can work as a traceline or tracehull)
+// World half of TraceRay. Returns false if the trace is already final,
+// otherwise fills in the ray clipped to the world for the entity pass
 //-----------------------------------------------------------------------------
-void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace )
-{	
-#if defined _DEBUG && !defined SWDS
-	if( debugrayenable.GetBool() )
-	{
-		s_FrameRays.AddToTail( ray );
-	}
-#endif
-
-#if BENCHMARK_RAY_TEST
-	if( s_BenchmarkRays.Count() < 15000 )
-	{
-		s_BenchmarkRays.EnsureCapacity(15000);
-		s_BenchmarkRays.AddToTail( ray );
-	}
-#endif
-
-	tmZone( TELEMETRY_LEVEL1, TMZF_NONE, "%s:%d", __FUNCTION__, __LINE__ );
-	VPROF_INCREMENT_COUNTER( "TraceRay", 1 );
-	m_traceStatCounters[TRACE_STAT_COUNTER_TRACERAY]++;
-//	VPROF_BUDGET( "CEngineTrace::TraceRay", "Ray/Hull Trace" );
-	
-	CTraceFilterHitAll traceFilter;
-	if ( !pTraceFilter )
-	{
-		pTraceFilter = &traceFilter;
-	}
-
+bool CEngineTrace::TraceRayAgainstWorld( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace, EntityRay_t &entityRay )
+{
 	CM_ClearTrace( pTrace );
 
 	// Collide with the world.
@@ -1715,11 +1718,11 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 
 		// inside world, no need to check being inside anything else
 		if ( pTrace->startsolid )
-			return;
+			return false;
 
 		// Early out if we only trace against the world
 		if ( pTraceFilter->GetTraceType() == TRACE_WORLD_ONLY )
-			return;
+			return false;
 	}
 	else
 	{
@@ -1730,17 +1733,17 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 	}
 
 	// Save the world collision fraction.
-	float flWorldFraction = pTrace->fraction;
-	float flWorldFractionLeftSolidScale = flWorldFraction;
+	entityRay.m_flWorldFraction = pTrace->fraction;
+	entityRay.m_flWorldFractionLeftSolidScale = entityRay.m_flWorldFraction;
 
 	// Create a ray that extends only until we hit the world
 	// and adjust the trace accordingly
-	Ray_t entityRay = ray;
+	entityRay.m_Ray = ray;
 
 	if ( pTrace->fraction == 0 )
 	{
-		entityRay.m_Delta.Init();
-		flWorldFractionLeftSolidScale = pTrace->fractionleftsolid;
+		entityRay.m_Ray.m_Delta.Init();
+		entityRay.m_flWorldFractionLeftSolidScale = pTrace->fractionleftsolid;
 		pTrace->fractionleftsolid = 1.0f;
 		pTrace->fraction = 1.0f;
 	}
@@ -1752,20 +1755,92 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 		// This is not the same as entityRay.m_Delta *= pTrace->fraction which happens 
 		// at a quantization that is more precise as m_Start moves away from the origin
 		Vector end;
-		VectorMA( entityRay.m_Start, pTrace->fraction, entityRay.m_Delta, end );
-		VectorSubtract(end, entityRay.m_Start, entityRay.m_Delta);
+		VectorMA( entityRay.m_Ray.m_Start, pTrace->fraction, entityRay.m_Ray.m_Delta, end );
+		VectorSubtract(end, entityRay.m_Ray.m_Start, entityRay.m_Ray.m_Delta);
 		// We know this is safe because pTrace->fraction != 0
 		pTrace->fractionleftsolid /= pTrace->fraction;
 		pTrace->fraction = 1.0;
 	}
 
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Converts a trace against the world-clipped ray back to the original ray
+//-----------------------------------------------------------------------------
+void CEngineTrace::FinishTraceRay( const Ray_t &ray, const EntityRay_t &entityRay, trace_t *pTrace )
+{
+	// Fix up the fractions so they are appropriate given the original
+	// unclipped-to-world ray
+	pTrace->fraction *= entityRay.m_flWorldFraction;
+	pTrace->fractionleftsolid *= entityRay.m_flWorldFractionLeftSolidScale;
+
+#ifdef _DEBUG
+	Vector vecOffset, vecEndTest;
+	VectorAdd( ray.m_Start, ray.m_StartOffset, vecOffset );
+	VectorMA( vecOffset, pTrace->fractionleftsolid, ray.m_Delta, vecEndTest );
+	Assert( VectorsAreEqual( vecEndTest, pTrace->startpos, 0.1f ) );
+	VectorMA( vecOffset, pTrace->fraction, ray.m_Delta, vecEndTest );
+	Assert( VectorsAreEqual( vecEndTest, pTrace->endpos, 0.1f ) );
+//	Assert( !ray.m_IsRay || pTrace->allsolid || pTrace->fraction >= pTrace->fractionleftsolid );
+#endif
+
+	if ( !ray.m_IsRay )
+	{
+		// Make sure no fractionleftsolid can be used with box sweeps
+		VectorAdd( ray.m_Start, ray.m_StartOffset, pTrace->startpos );
+		pTrace->fractionleftsolid = 0;
+
+#ifdef _DEBUG
+		pTrace->fractionleftsolid = VEC_T_NAN;
+#endif
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// A version that simply accepts a ray (can work as a traceline or tracehull)
+//-----------------------------------------------------------------------------
+void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTrace )
+{	
+#if defined _DEBUG && !defined SWDS
+	if( debugrayenable.GetBool() )
+	{
+		s_FrameRays.AddToTail( ray );
+	}
+#endif
+
+#if BENCHMARK_RAY_TEST
+	if( s_BenchmarkRays.Count() < 15000 )
+	{
+		s_BenchmarkRays.EnsureCapacity(15000);
+		s_BenchmarkRays.AddToTail( ray );
+	}
+#endif
+
+	tmZone( TELEMETRY_LEVEL1, TMZF_NONE, "%s:%d", __FUNCTION__, __LINE__ );
+	VPROF_INCREMENT_COUNTER( "TraceRay", 1 );
+	m_traceStatCounters[TRACE_STAT_COUNTER_TRACERAY]++;
+//	VPROF_BUDGET( "CEngineTrace::TraceRay", "Ray/Hull Trace" );
+	
+	CTraceFilterHitAll traceFilter;
+	if ( !pTraceFilter )
+	{
+		pTraceFilter = &traceFilter;
+	}
+
+	EntityRay_t entityRay;
+	if ( !TraceRayAgainstWorld( ray, fMask, pTraceFilter, pTrace, entityRay ) )
+		return;
+
 	// Collide with entities along the ray
 	// FIXME: Hitbox code causes this to be re-entrant for the IK stuff.
 	// If we could eliminate that, this could be static and therefore
 	// not have to reallocate memory all the time
 	CEntityListAlongRay enumerator;
 	enumerator.Reset();
-	SpatialPartition()->EnumerateElementsAlongRay( SpatialPartitionMask(), entityRay, false, &enumerator );
+	SpatialPartition()->EnumerateElementsAlongRay( SpatialPartitionMask(), entityRay.m_Ray, false, &enumerator );
 
 	bool bNoStaticProps = pTraceFilter->GetTraceType() == TRACE_ENTITIES_ONLY;
 	bool bFilterStaticProps = pTraceFilter->GetTraceType() == TRACE_EVERYTHING_FILTER_PROPS;
@@ -1808,7 +1883,7 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 			}
 		}
 
-		ClipRayToCollideable( entityRay, fMask, pCollideable, &tr );
+		ClipRayToCollideable( entityRay.m_Ray, fMask, pCollideable, &tr );
 
 		// Make sure the ray is always shorter than it currently is
 		ClipTraceToTrace( tr, pTrace );
@@ -1818,30 +1893,158 @@ void CEngineTrace::TraceRay( const Ray_t &ray, unsigned int fMask, ITraceFilter
 			break;
 	}
 
-	// Fix up the fractions so they are appropriate given the original
-	// unclipped-to-world ray
-	pTrace->fraction *= flWorldFraction;
-	pTrace->fractionleftsolid *= flWorldFractionLeftSolidScale;
+	FinishTraceRay( ray, entityRay, pTrace );
+}
 
-#ifdef _DEBUG
-	Vector vecOffset, vecEndTest;
-	VectorAdd( ray.m_Start, ray.m_StartOffset, vecOffset );
-	VectorMA( vecOffset, pTrace->fractionleftsolid, ray.m_Delta, vecEndTest );
-	Assert( VectorsAreEqual( vecEndTest, pTrace->startpos, 0.1f ) );
-	VectorMA( vecOffset, pTrace->fraction, ray.m_Delta, vecEndTest );
-	Assert( VectorsAreEqual( vecEndTest, pTrace->endpos, 0.1f ) );
-//	Assert( !ray.m_IsRay || pTrace->allsolid || pTrace->fraction >= pTrace->fractionleftsolid );
-#endif
 
-	if ( !ray.m_IsRay )
+//-----------------------------------------------------------------------------
+// Traces a packet of rays that were fired together, such as the pellets of
+// a shotgun blast. Each ray gets its own world trace, but the entities are
+// gathered with one spatial partition query over the whole packet, filtered
+// once, and then clipped only against the rays whose sweep reaches them.
+// Every trace comes out the same as TraceRay would produce for that ray.
+//-----------------------------------------------------------------------------
+void CEngineTrace::TraceRays( int nRays, const Ray_t *pRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTraces )
+{
+	// The clipped rays live on the stack, so run large packets in chunks
+	while ( nRays > MAX_TRACE_RAY_PACKET )
 	{
-		// Make sure no fractionleftsolid can be used with box sweeps
-		VectorAdd( ray.m_Start, ray.m_StartOffset, pTrace->startpos );
-		pTrace->fractionleftsolid = 0;
+		TraceRays( MAX_TRACE_RAY_PACKET, pRays, fMask, pTraceFilter, pTraces );
+		nRays -= MAX_TRACE_RAY_PACKET;
+		pRays += MAX_TRACE_RAY_PACKET;
+		pTraces += MAX_TRACE_RAY_PACKET;
+	}
 
-#ifdef _DEBUG
-		pTrace->fractionleftsolid = VEC_T_NAN;
-#endif
+	tmZone( TELEMETRY_LEVEL1, TMZF_NONE, "%s:%d", __FUNCTION__, __LINE__ );
+	VPROF_INCREMENT_COUNTER( "TraceRays", 1 );
+
+	CTraceFilterHitAll traceFilter;
+	if ( !pTraceFilter )
+	{
+		pTraceFilter = &traceFilter;
+	}
+
+	// Nothing to share
+	if ( nRays <= 1 || pTraceFilter->GetTraceType() == TRACE_WORLD_ONLY )
+	{
+		for ( int i = 0; i < nRays; ++i )
+		{
+			TraceRay( pRays[i], fMask, pTraceFilter, &pTraces[i] );
+		}
+		return;
+	}
+
+	// Collide each ray with the world, and bound what is left of them
+	EntityRay_t entityRays[MAX_TRACE_RAY_PACKET];
+	bool bActive[MAX_TRACE_RAY_PACKET];
+	Vector vecPacketMins( FLT_MAX, FLT_MAX, FLT_MAX );
+	Vector vecPacketMaxs( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+	int nActive = 0;
+	for ( int i = 0; i < nRays; ++i )
+	{
+		m_traceStatCounters[TRACE_STAT_COUNTER_TRACERAY]++;
+
+		bActive[i] = TraceRayAgainstWorld( pRays[i], fMask, pTraceFilter, &pTraces[i], entityRays[i] );
+		if ( !bActive[i] )
+			continue;
+
+		const Ray_t &entityRay = entityRays[i].m_Ray;
+		Vector vecEnd;
+		VectorAdd( entityRay.m_Start, entityRay.m_Delta, vecEnd );
+
+		Vector vecRayMins, vecRayMaxs;
+		VectorMin( entityRay.m_Start, vecEnd, vecRayMins );
+		VectorMax( entityRay.m_Start, vecEnd, vecRayMaxs );
+		VectorSubtract( vecRayMins, entityRay.m_Extents, vecRayMins );
+		VectorAdd( vecRayMaxs, entityRay.m_Extents, vecRayMaxs );
+
+		VectorMin( vecPacketMins, vecRayMins, vecPacketMins );
+		VectorMax( vecPacketMaxs, vecRayMaxs, vecPacketMaxs );
+		++nActive;
+	}
+
+	if ( nActive == 0 )
+		return;
+
+	// One partition query for the whole packet. The box can catch more than
+	// any single ray would, so don't cap the list like CEntityListAlongRay does.
+	CEntitiesAlongRay enumerator;
+	SpatialPartition()->EnumerateElementsInBox( SpatialPartitionMask(), vecPacketMins, vecPacketMaxs, false, &enumerator );
+
+	bool bNoStaticProps = pTraceFilter->GetTraceType() == TRACE_ENTITIES_ONLY;
+	bool bFilterStaticProps = pTraceFilter->GetTraceType() == TRACE_EVERYTHING_FILTER_PROPS;
+
+	// Run the filter once per entity rather than once per ray, and remember the
+	// bounds the partition knows the entity by so each ray can reject it cheaply
+	CUtlVectorFixedGrowable< PacketCandidate_t, 64 > candidates;
+	ICollideable *pCollideable;
+	const char *pDebugName;
+	int nCount = enumerator.m_EntityHandles.Count();
+	for ( int j = 0; j < nCount; ++j )
+	{
+		IHandleEntity *pHandleEntity = enumerator.m_EntityHandles[j];
+		HandleEntityToCollideable( pHandleEntity, &pCollideable, &pDebugName );
+
+		// Check for error condition
+		if ( IsPC() && IsDebug() && !IsSolid( pCollideable->GetSolid(), pCollideable->GetSolidFlags() ) )
+		{
+			Assert( 0 );
+			Msg( "%s in solid list (not solid)\n", pDebugName );
+			continue;
+		}
+
+		if ( !StaticPropMgr()->IsStaticProp( pHandleEntity ) )
+		{
+			if ( !pTraceFilter->ShouldHitEntity( pHandleEntity, fMask ) )
+				continue;
+		}
+		else
+		{
+			if ( bNoStaticProps )
+				continue;
+
+			if ( bFilterStaticProps )
+			{
+				if ( !pTraceFilter->ShouldHitEntity( pHandleEntity, fMask ) )
+					continue;
+			}
+		}
+
+		// Same bloat the partition is built with, so this never rejects
+		// anything EnumerateElementsAlongRay would have returned
+		PacketCandidate_t &candidate = candidates[ candidates.AddToTail() ];
+		candidate.m_pCollideable = pCollideable;
+		pCollideable->WorldSpaceSurroundingBounds( &candidate.m_vecMins, &candidate.m_vecMaxs );
+		candidate.m_vecMins -= Vector( 1, 1, 1 );
+		candidate.m_vecMaxs += Vector( 1, 1, 1 );
+	}
+
+	// Clip each ray against the candidates its sweep actually touches
+	trace_t tr;
+	for ( int i = 0; i < nRays; ++i )
+	{
+		if ( !bActive[i] )
+			continue;
+
+		const Ray_t &entityRay = entityRays[i].m_Ray;
+		trace_t *pTrace = &pTraces[i];
+		for ( int j = 0; j < candidates.Count(); ++j )
+		{
+			const PacketCandidate_t &candidate = candidates[j];
+			if ( !IsBoxIntersectingRay( candidate.m_vecMins, candidate.m_vecMaxs, entityRay ) )
+				continue;
+
+			ClipRayToCollideable( entityRay, fMask, candidate.m_pCollideable, &tr );
+
+			// Make sure the ray is always shorter than it currently is
+			ClipTraceToTrace( tr, pTrace );
+
+			// Stop if we're in allsolid
+			if ( pTrace->allsolid )
+				break;
+		}
+
+		FinishTraceRay( pRays[i], entityRays[i], pTrace );
 	}
 }
 
@@ -3714,6 +3714,12 @@ void CModelRender::StaticPropColorMeshCallback( void *pContext, const void *pDat
 		byte *pCompressedData = (byte *)pData + sizeof( HardwareVerts::FileHeader_t );
 		if ( CLZMA::IsCompressed( pCompressedData ) )
 		{
+			if ( numReadBytes < (int)sizeof( HardwareVerts::FileHeader_t ) ||
+				!CLZMA::IsInputValid( pCompressedData, numReadBytes - sizeof( HardwareVerts::FileHeader_t ) ) )
+			{
+				goto cleanUp;
+			}
+
 			// create a buffer that matches the original
 			int actualSize = CLZMA::GetActualSize( pCompressedData );
 			pOriginalData = (byte *)malloc( sizeof( HardwareVerts::FileHeader_t ) + actualSize );
@@ -56,7 +56,16 @@
 #include "optimize.h"
 #include "networkstringtable.h"
 #include "tier1/callqueue.h"
+#include "vstdlib/jobthread.h"
 #include <vgui_controls/Controls.h>
+#ifdef _WIN32
+#include "winlite.h"
+#elif defined( POSIX )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -401,6 +410,452 @@ struct lumpfiles_t
 };
 static lumpfiles_t s_MapLumpFiles[ HEADER_LUMPS ];
 
+//-----------------------------------------------------------------------------
+// When the .bsp is a loose file it is mapped into memory (copy on write), so
+// uncompressed lumps are used in place instead of being read into a buffer.
+// LZMA compressed lumps are all handed to the job pool as soon as the map is
+// opened, so they are decompressed in parallel ahead of the Mod_Load* that needs
+// them. The mapping lives until the world model is unloaded so game lumps
+// (static props, detail props) can use it too.
+//-----------------------------------------------------------------------------
+static ConVar map_load_mapped( "map_load_mapped", "1", 0, "Map the .bsp into memory and decompress compressed lumps on the job pool while loading." );
+
+struct MapLumpProfile_t
+{
+	int		m_nFileSize;			// bytes in the .bsp
+	int		m_nSize;				// bytes handed to the loader
+	int		m_nLoads;
+	float	m_flReadTime;
+	float	m_flDecompressTime;		// on whichever thread did it
+	float	m_flWaitTime;			// main thread stalled on a prefetch
+	bool	m_bMapped;
+	bool	m_bPrefetched;
+};
+
+struct MapLumpPrefetch_t
+{
+	CJob				*m_pJob;
+	byte				*m_pCompressed;
+	unsigned int		m_nCompressedSize;
+	unsigned int		m_nSize;
+	byte				*m_pData;		// uncompressed, NULL if decompression failed or a helper has it
+	MapLumpProfile_t	*m_pProfile;
+	bool				m_bQueued;		// until the prefetch is freed
+};
+
+class CMappedMapFile
+{
+public:
+	CMappedMapFile();
+	~CMappedMapFile();
+
+	bool Open( const char *pName, const char *pFullPath, unsigned int nExpectedSize );
+	void Close();
+
+	bool IsMapping( const char *pName ) const	{ return m_pBase && !V_stricmp( pName, m_szName ); }
+	byte *Base() const							{ return m_pBase; }
+	bool Contains( unsigned int nOffset, unsigned int nSize ) const { return nOffset <= m_nSize && nSize <= m_nSize - nOffset; }
+
+private:
+	byte			*m_pBase;
+	unsigned int	m_nSize;
+	char			m_szName[128];
+#ifdef _WIN32
+	HANDLE			m_hFile;
+	HANDLE			m_hMapping;
+#endif
+};
+
+static CMappedMapFile					s_MappedMap;
+static MapLumpPrefetch_t				s_LumpPrefetch[ HEADER_LUMPS ];
+static MapLumpProfile_t					s_LumpProfile[ HEADER_LUMPS ];
+static CUtlVector< MapLumpPrefetch_t >	s_GameLumpPrefetch;	// parallel to g_GameLumpDict
+static CUtlVector< MapLumpProfile_t >	s_GameLumpProfile;	// parallel to g_GameLumpDict
+static char								s_szProfileMapName[128];
+static float							s_flProfileLoadTime;
+
+CMappedMapFile::CMappedMapFile()
+{
+	m_pBase = NULL;
+	m_nSize = 0;
+	m_szName[0] = 0;
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#endif
+}
+
+CMappedMapFile::~CMappedMapFile()
+{
+	Close();
+}
+
+bool CMappedMapFile::Open( const char *pName, const char *pFullPath, unsigned int nExpectedSize )
+{
+	Close();
+
+	if ( !nExpectedSize )
+		return false;
+
+#ifdef _WIN32
+	m_hFile = CreateFile( pFullPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( m_hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	// Make sure the filesystem and the path we resolved agree on which file this is
+	if ( GetFileSize( m_hFile, NULL ) != nExpectedSize )
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMapping( m_hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	if ( !m_hMapping )
+	{
+		Close();
+		return false;
+	}
+
+	m_pBase = (byte *)MapViewOfFile( m_hMapping, FILE_MAP_COPY, 0, 0, 0 );
+	if ( !m_pBase )
+	{
+		Close();
+		return false;
+	}
+#elif defined( POSIX )
+	int fd = open( pFullPath, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_size != (off_t)nExpectedSize )
+	{
+		close( fd );
+		return false;
+	}
+
+	void *pBase = mmap( NULL, nExpectedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( pBase == MAP_FAILED )
+		return false;
+
+	// Nearly all of it is about to be touched, start reading ahead now
+	madvise( pBase, nExpectedSize, MADV_WILLNEED );
+	m_pBase = (byte *)pBase;
+#else
+	return false;
+#endif
+
+	m_nSize = nExpectedSize;
+	V_strcpy_safe( m_szName, pName );
+	return true;
+}
+
+void CMappedMapFile::Close()
+{
+#ifdef _WIN32
+	if ( m_pBase )
+	{
+		UnmapViewOfFile( m_pBase );
+	}
+	if ( m_hMapping )
+	{
+		CloseHandle( m_hMapping );
+		m_hMapping = NULL;
+	}
+	if ( m_hFile != INVALID_HANDLE_VALUE )
+	{
+		CloseHandle( m_hFile );
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+#elif defined( POSIX )
+	if ( m_pBase )
+	{
+		munmap( m_pBase, m_nSize );
+	}
+#endif
+	m_pBase = NULL;
+	m_nSize = 0;
+	m_szName[0] = 0;
+}
+
+static void DecompressMapLumpChunk( byte *pCompressed, int iChunk, byte *pOutput, bool *pbSucceeded )
+{
+	*pbSucceeded = CLZMA::UncompressChunk( pCompressed, iChunk, pOutput ) == CLZMA::GetChunkActualSize( pCompressed, iChunk );
+}
+
+// Chunked lumps are split into one job per chunk, which idle pool threads steal while this one works through the rest.
+// The chunk table must already have been checked with CLZMA::IsInputValid().
+static bool DecompressMapLumpChunked( byte *pCompressed, byte *pData )
+{
+	int nChunks = CLZMA::GetNumChunks( pCompressed );
+	unsigned int nActualSize = CLZMA::GetActualSize( pCompressed );
+
+	CUtlVectorFixedGrowable<CJob *, 64> jobs;
+	CUtlVectorFixedGrowable<bool, 64> succeeded;
+	jobs.SetCount( nChunks );
+	succeeded.SetCount( nChunks );
+
+	// Every job writes straight into pData, so no chunk may reach past the lump's actual size
+	unsigned int nOffset = 0;
+	for ( int i = 0; i < nChunks; i++ )
+	{
+		unsigned int nChunkSize = CLZMA::GetChunkActualSize( pCompressed, i );
+		if ( nChunkSize > nActualSize - nOffset )
+		{
+			return false;
+		}
+		nOffset += nChunkSize;
+	}
+	if ( nOffset != nActualSize )
+	{
+		return false;
+	}
+
+	nOffset = 0;
+	for ( int i = 0; i < nChunks; i++ )
+	{
+		succeeded[i] = false;
+		jobs[i] = g_pThreadPool->QueueCall( &DecompressMapLumpChunk, pCompressed, i, pData + nOffset, &succeeded[i] );
+		nOffset += CLZMA::GetChunkActualSize( pCompressed, i );
+	}
+
+	// One job at a time, POSIX ThreadWaitForEvents only waits on the first event
+	bool bSucceeded = true;
+	for ( int i = 0; i < nChunks; i++ )
+	{
+		g_pThreadPool->YieldWait( &jobs[i], 1 );
+		jobs[i]->Release();
+		bSucceeded = bSucceeded && succeeded[i];
+	}
+	return bSucceeded;
+}
+
+static void DecompressMapLump( MapLumpPrefetch_t *pPrefetch )
+{
+	double flStart = Plat_FloatTime();
+
+	// The lump comes straight from the file, don't trust its headers or chunk table
+	if ( CLZMA::IsInputValid( pPrefetch->m_pCompressed, pPrefetch->m_nCompressedSize ) &&
+		CLZMA::GetActualSize( pPrefetch->m_pCompressed ) == pPrefetch->m_nSize )
+	{
+		byte *pData = (byte *)malloc( pPrefetch->m_nSize );
+		bool bSucceeded;
+		if ( CLZMA::IsChunked( pPrefetch->m_pCompressed ) && CLZMA::GetNumChunks( pPrefetch->m_pCompressed ) > 1 )
+		{
+			bSucceeded = DecompressMapLumpChunked( pPrefetch->m_pCompressed, pData );
+		}
+		else
+		{
+			bSucceeded = CLZMA::Uncompress( pPrefetch->m_pCompressed, pData ) == pPrefetch->m_nSize;
+		}
+
+		if ( bSucceeded )
+		{
+			pPrefetch->m_pData = pData;
+		}
+		else
+		{
+			free( pData );
+		}
+	}
+
+	pPrefetch->m_pProfile->m_flDecompressTime += Plat_FloatTime() - flStart;
+}
+
+static void QueueMapLumpPrefetch( MapLumpPrefetch_t &prefetch, byte *pCompressed, unsigned int nCompressedSize, unsigned int nSize, MapLumpProfile_t *pProfile )
+{
+	prefetch.m_pCompressed = pCompressed;
+	prefetch.m_nCompressedSize = nCompressedSize;
+	prefetch.m_nSize = nSize;
+	prefetch.m_pData = NULL;
+	prefetch.m_pProfile = pProfile;
+	prefetch.m_bQueued = true;
+	pProfile->m_bPrefetched = true;
+	prefetch.m_pJob = g_pThreadPool->QueueCall( &DecompressMapLump, &prefetch );
+}
+
+// Returns the decompressed lump, or NULL if it wasn't prefetched or failed. Still owned by the prefetch.
+static byte *WaitForMapLumpPrefetch( MapLumpPrefetch_t &prefetch )
+{
+	if ( prefetch.m_pJob )
+	{
+		double flStart = Plat_FloatTime();
+		prefetch.m_pJob->WaitForFinishAndRelease();
+		prefetch.m_pJob = NULL;
+		prefetch.m_pProfile->m_flWaitTime += Plat_FloatTime() - flStart;
+	}
+	return prefetch.m_pData;
+}
+
+// Hands the decompressed lump to the caller. Loads of the same lump while it's
+// taken decompress on demand.
+static byte *TakeMapLumpPrefetch( MapLumpPrefetch_t &prefetch )
+{
+	byte *pData = WaitForMapLumpPrefetch( prefetch );
+	prefetch.m_pData = NULL;
+	return pData;
+}
+
+// Gives a taken lump back so later loads, like the model loader's after
+// CM_LoadMap, can use it too. Freed if the prefetch already went away.
+static void ReturnMapLumpPrefetch( MapLumpPrefetch_t &prefetch, byte *pData )
+{
+	if ( prefetch.m_bQueued && !prefetch.m_pData )
+	{
+		prefetch.m_pData = pData;
+	}
+	else
+	{
+		free( pData );
+	}
+}
+
+static void FreeMapLumpPrefetch( MapLumpPrefetch_t &prefetch )
+{
+	WaitForMapLumpPrefetch( prefetch );
+	free( prefetch.m_pData );
+	V_memset( &prefetch, 0, sizeof( prefetch ) );
+}
+
+static void FreeGameLumpPrefetch()
+{
+	for ( int i = 0; i < s_GameLumpPrefetch.Count(); i++ )
+	{
+		FreeMapLumpPrefetch( s_GameLumpPrefetch[i] );
+	}
+	s_GameLumpPrefetch.Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Maps the current .bsp and starts decompressing its compressed lumps
+//-----------------------------------------------------------------------------
+static void ResetMapLoadProfile()
+{
+	V_memset( s_LumpProfile, 0, sizeof( s_LumpProfile ) );
+	V_strcpy_safe( s_szProfileMapName, s_szMapName );
+	s_flProfileLoadTime = 0.0f;
+}
+
+static void MapLoad_BeginPrefetch()
+{
+	// Already started by an earlier Init for this map
+	if ( map_load_mapped.GetBool() && s_MappedMap.IsMapping( s_szMapName ) )
+		return;
+
+	CMapLoadHelper::ReleaseMappedMap();
+
+	if ( V_stricmp( s_szProfileMapName, s_szMapName ) )
+	{
+		ResetMapLoadProfile();
+	}
+
+	if ( !map_load_mapped.GetBool() )
+		return;
+
+	// Only loose files can be mapped, anything in a pack file goes through the filesystem as before
+	char szFullPath[MAX_PATH];
+	if ( !g_pFileSystem->RelativePathToFullPath_safe( s_szMapName, NULL, szFullPath, FILTER_CULLPACK ) )
+		return;
+
+	if ( !s_MappedMap.Open( s_szMapName, szFullPath, g_pFileSystem->Size( s_MapFileHandle ) ) )
+		return;
+
+	ResetMapLoadProfile();
+
+	if ( !g_pThreadPool || !g_pThreadPool->NumThreads() )
+		return;
+
+	// Only one of the lighting lumps is ever loaded
+	bool bHDRLighting = g_pMaterialSystemHardwareConfig->GetHDRType() != HDR_TYPE_NONE &&
+		CMapLoadHelper::LumpSize( LUMP_LIGHTING_HDR ) > 0;
+	int nUnusedLightingLump = bHDRLighting ? LUMP_LIGHTING : LUMP_LIGHTING_HDR;
+
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		const lump_t &lump = s_MapHeader.lumps[i];
+		if ( !lump.uncompressedSize || lump.filelen <= 0 || lump.fileofs < 0 || i == nUnusedLightingLump )
+			continue;
+
+		if ( !s_MappedMap.Contains( lump.fileofs, lump.filelen ) )
+			continue;
+
+		s_LumpProfile[i].m_nFileSize = lump.filelen;
+		QueueMapLumpPrefetch( s_LumpPrefetch[i], s_MappedMap.Base() + lump.fileofs, lump.filelen, lump.uncompressedSize, &s_LumpProfile[i] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Frees lumps decompressed ahead of time, once the world has been loaded.
+// Anything loaded after this decompresses on demand.
+//-----------------------------------------------------------------------------
+void CMapLoadHelper::DiscardPrefetchedLumps()
+{
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		FreeMapLumpPrefetch( s_LumpPrefetch[i] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Unmaps the .bsp when the world model goes away
+//-----------------------------------------------------------------------------
+void CMapLoadHelper::ReleaseMappedMap()
+{
+	DiscardPrefetchedLumps();
+	FreeGameLumpPrefetch();
+	s_MappedMap.Close();
+}
+
+CON_COMMAND( map_load_profile, "Prints how long each lump of the last map took to load" )
+{
+	if ( !s_szProfileMapName[0] )
+	{
+		ConMsg( "No map has been loaded yet.\n" );
+		return;
+	}
+
+	ConMsg( "%s: Map_LoadModel took %.1f ms\n", s_szProfileMapName, s_flProfileLoadTime * 1000.0f );
+	ConMsg( "lump      file KB   size KB  loads   read ms  decomp ms   wait ms\n" );
+
+	MapLumpProfile_t total;
+	V_memset( &total, 0, sizeof( total ) );
+
+	for ( int i = 0; i < HEADER_LUMPS + s_GameLumpProfile.Count(); i++ )
+	{
+		const MapLumpProfile_t &profile = ( i < HEADER_LUMPS ) ? s_LumpProfile[i] : s_GameLumpProfile[i - HEADER_LUMPS];
+		if ( !profile.m_nLoads && !profile.m_bPrefetched )
+			continue;
+
+		char szName[16];
+		if ( i < HEADER_LUMPS )
+		{
+			V_snprintf( szName, sizeof( szName ), "%d", i );
+		}
+		else
+		{
+			GameLumpId_t id = g_GameLumpDict[i - HEADER_LUMPS].id;
+			V_snprintf( szName, sizeof( szName ), "%c%c%c%c", ( id >> 24 ) & 0xFF, ( id >> 16 ) & 0xFF, ( id >> 8 ) & 0xFF, id & 0xFF );
+		}
+
+		ConMsg( "%-6s %10.1f %9.1f %6d %9.2f %10.2f %9.2f %s%s\n", szName,
+			profile.m_nFileSize / 1024.0f, profile.m_nSize / 1024.0f, profile.m_nLoads,
+			profile.m_flReadTime * 1000.0f, profile.m_flDecompressTime * 1000.0f, profile.m_flWaitTime * 1000.0f,
+			profile.m_bMapped ? "mapped " : "", profile.m_bPrefetched ? "prefetched" : "" );
+
+		total.m_nFileSize += profile.m_nFileSize;
+		total.m_nSize += profile.m_nSize;
+		total.m_nLoads += profile.m_nLoads;
+		total.m_flReadTime += profile.m_flReadTime;
+		total.m_flDecompressTime += profile.m_flDecompressTime;
+		total.m_flWaitTime += profile.m_flWaitTime;
+	}
+
+	ConMsg( "%-6s %10.1f %9.1f %6d %9.2f %10.2f %9.2f\n", "total",
+		total.m_nFileSize / 1024.0f, total.m_nSize / 1024.0f, total.m_nLoads,
+		total.m_flReadTime * 1000.0f, total.m_flDecompressTime * 1000.0f, total.m_flWaitTime * 1000.0f );
+}
+
 CON_COMMAND( mem_vcollide, "Dumps the memory used by vcollides" )
 {
 	g_ModelLoader.DumpVCollideStats();
@@ -479,6 +934,11 @@ void CMapLoadHelper::Init( model_t *pMapModel, const char *loadname )
 
 	s_pMap = &g_ModelLoader.m_worldBrushData;
 
+	if ( IsPC() )
+	{
+		MapLoad_BeginPrefetch();
+	}
+
 #if 0
 	// XXX(johns): There are security issues with this system currently. sv_pure doesn't handle unexpected/mismatched
 	//             lumps, so players can create lumps for maps not using them to wallhack/etc.. Currently unused,
@@ -759,6 +1219,7 @@ CMapLoadHelper::CMapLoadHelper( int lumpToLoad )
 	m_pData = NULL;
 	m_pRawData = NULL;
 	m_pUncompressedData = NULL;
+	m_bPrefetched = false;
 	
 	// Load raw lump from disk
 	lump_t *lump = &s_MapHeader.lumps[ lumpToLoad ];
@@ -788,11 +1249,21 @@ CMapLoadHelper::CMapLoadHelper( int lumpToLoad )
 		return;
 	}
 
+	MapLumpProfile_t &profile = s_LumpProfile[lumpToLoad];
+	double flStart = Plat_FloatTime();
+	bool bFromMapFile = ( fileToUse == s_MapFileHandle );
+
 	if ( s_MapBuffer.Base() )
 	{
 		// bsp is in memory
 		m_pData = (unsigned char*)s_MapBuffer.Base() + m_nLumpOffset;
 	}
+	else if ( bFromMapFile && s_MappedMap.IsMapping( s_szMapName ) && s_MappedMap.Contains( m_nLumpOffset, m_nLumpSize ) )
+	{
+		// bsp is mapped, use the lump in place
+		m_pData = s_MappedMap.Base() + m_nLumpOffset;
+		profile.m_bMapped = true;
+	}
 	else
 	{
 		if ( s_MapFileHandle == FILESYSTEM_INVALID_HANDLE )
@@ -827,21 +1298,49 @@ CMapLoadHelper::CMapLoadHelper( int lumpToLoad )
 		}
 	}
 
-	if ( lump->uncompressedSize != 0 )
+	profile.m_flReadTime += Plat_FloatTime() - flStart;
+	profile.m_nFileSize = m_nLumpSize;
+	profile.m_nLoads++;
+
+	byte *pPrefetched = bFromMapFile ? TakeMapLumpPrefetch( s_LumpPrefetch[lumpToLoad] ) : NULL;
+	if ( pPrefetched )
+	{
+		// Already decompressed on the job pool, borrow it until this helper goes away
+		m_nLumpSize = lump->uncompressedSize;
+		m_pUncompressedData = pPrefetched;
+		m_bPrefetched = true;
+
+		m_pData = m_pUncompressedData;
+	}
+	else if ( lump->uncompressedSize != 0 )
 	{
 		// Handle compressed lump -- users of the class see the uncompressed data
 		AssertMsg( CLZMA::IsCompressed( m_pData ),
 		           "Lump claims to be compressed but is not recognized as LZMA" );
 
+		// m_nLumpSize is still the size in the file here. The prefetch may have
+		// refused this lump already, so don't decode it unchecked.
+		if ( !CLZMA::IsInputValid( m_pData, m_nLumpSize ) )
+		{
+			Host_Error( "CMapLoadHelper::CMapLoadHelper, lump %i in map %s is corrupt\n", lumpToLoad, s_szMapName );
+		}
+
 		m_nLumpSize = CLZMA::GetActualSize( m_pData );
 		AssertMsg( lump->uncompressedSize == m_nLumpSize,
 		           "Lump header disagrees with lzma header for compressed lump" );
 
+		flStart = Plat_FloatTime();
 		m_pUncompressedData = (unsigned char *)malloc( m_nLumpSize );
-		CLZMA::Uncompress( m_pData, m_pUncompressedData );
+		if ( CLZMA::Uncompress( m_pData, m_pUncompressedData ) != m_nLumpSize )
+		{
+			Host_Error( "CMapLoadHelper::CMapLoadHelper, lump %i in map %s failed to decompress\n", lumpToLoad, s_szMapName );
+		}
+		profile.m_flDecompressTime += Plat_FloatTime() - flStart;
 
 		m_pData = m_pUncompressedData;
 	}
+
+	profile.m_nSize = m_nLumpSize;
 }
 
 //-----------------------------------------------------------------------------
@@ -849,7 +1348,11 @@ CMapLoadHelper::CMapLoadHelper( int lumpToLoad )
 //-----------------------------------------------------------------------------
 CMapLoadHelper::~CMapLoadHelper( void )
 {
-	if ( m_pUncompressedData )
+	if ( m_bPrefetched )
+	{
+		ReturnMapLumpPrefetch( s_LumpPrefetch[m_nLumpID], m_pUncompressedData );
+	}
+	else if ( m_pUncompressedData )
 	{
 		free( m_pUncompressedData );
 	}
@@ -2708,6 +3211,7 @@ bool Mod_LoadGameLump( int lumpId, void *pOutBuffer, int size )
 		return false;
 	}
 
+	bool bTempBuffer = false;
 	if ( s_MapBuffer.Base() )
 	{
 		// data is in memory
@@ -2727,6 +3231,27 @@ bool Mod_LoadGameLump( int lumpId, void *pOutBuffer, int size )
 			return true;
 		}
 	}
+	else if ( s_MappedMap.IsMapping( g_GameLumpFilename ) && s_MappedMap.Contains( g_GameLumpDict[i].offset, dataLength ) )
+	{
+		// bsp is mapped
+		MapLumpProfile_t &profile = s_GameLumpProfile[i];
+		double flStart = Plat_FloatTime();
+		profile.m_bMapped = true;
+		profile.m_nLoads++;
+
+		pData = s_MappedMap.Base() + g_GameLumpDict[i].offset;
+		byte *pPrefetched = pData;
+		if ( bIsCompressed )
+		{
+			pPrefetched = s_GameLumpPrefetch.IsValidIndex( i ) ? WaitForMapLumpPrefetch( s_GameLumpPrefetch[i] ) : NULL;
+		}
+		if ( pPrefetched )
+		{
+			V_memcpy( pOutBuffer, pPrefetched, outSize );
+			profile.m_flReadTime += Plat_FloatTime() - flStart;
+			return true;
+		}
+	}
 	else
 	{
 		// Load file into buffer
@@ -2749,6 +3274,7 @@ bool Mod_LoadGameLump( int lumpId, void *pOutBuffer, int size )
 		{
 			// data is compressed, read into temporary
 			pData = (byte *)malloc( dataLength );
+			bTempBuffer = true;
 			bool bOK = ( g_pFileSystem->Read( pData, dataLength, fileHandle ) > 0 );
 			g_pFileSystem->Close( fileHandle );
 			if ( !bOK )
@@ -2761,7 +3287,7 @@ bool Mod_LoadGameLump( int lumpId, void *pOutBuffer, int size )
 
 	// We'll fall though to here through here if we're compressed
 	bool bResult = false;
-	if ( !CLZMA::IsCompressed( pData ) || CLZMA::GetActualSize( (unsigned char *)pData ) != g_GameLumpDict[i].uncompressedSize )
+	if ( !CLZMA::IsInputValid( pData, dataLength ) || CLZMA::GetActualSize( (unsigned char *)pData ) != g_GameLumpDict[i].uncompressedSize )
 	{
 		Warning( "Failed loading game lump %i: lump claims to be compressed but metadata does not match\n", lumpId );
 	}
@@ -2772,7 +3298,7 @@ bool Mod_LoadGameLump( int lumpId, void *pOutBuffer, int size )
 		bResult = ( outputLength > 0 && (unsigned int)outputLength == g_GameLumpDict[i].uncompressedSize );
 	}
 
-	if ( !s_MapBuffer.Base() )
+	if ( bTempBuffer )
 	{
 		// done with temporary buffer
 		free( pData );
@@ -2791,6 +3317,7 @@ void Mod_LoadGameLumpDict( void )
 	// FIXME: This is brittle. If we ever try to load two game lumps
 	// (say, in multiple BSP files), the dictionary info I store here will get whacked
 
+	FreeGameLumpPrefetch();
 	g_GameLumpDict.RemoveAll();
 	V_strcpy_safe( g_GameLumpFilename, lh.GetMapName() );
 
@@ -2835,6 +3362,31 @@ void Mod_LoadGameLumpDict( void )
 			}
 		}
 	}
+
+	s_GameLumpProfile.SetCount( g_GameLumpDict.Count() );
+	V_memset( s_GameLumpProfile.Base(), 0, s_GameLumpProfile.Count() * sizeof( MapLumpProfile_t ) );
+	for ( int i = 0; i < g_GameLumpDict.Count(); i++ )
+	{
+		bool bIsCompressed = ( g_GameLumpDict[i].flags & GAMELUMPFLAG_COMPRESSED ) != 0;
+		s_GameLumpProfile[i].m_nFileSize = bIsCompressed ? g_GameLumpDict[i].compressedSize : g_GameLumpDict[i].uncompressedSize;
+		s_GameLumpProfile[i].m_nSize = g_GameLumpDict[i].uncompressedSize;
+	}
+
+	// Start decompressing compressed game lumps now, static props and detail props load them much later
+	if ( s_MappedMap.IsMapping( g_GameLumpFilename ) && g_pThreadPool && g_pThreadPool->NumThreads() )
+	{
+		s_GameLumpPrefetch.SetCount( g_GameLumpDict.Count() );
+		V_memset( s_GameLumpPrefetch.Base(), 0, s_GameLumpPrefetch.Count() * sizeof( MapLumpPrefetch_t ) );
+
+		for ( int i = 0; i < g_GameLumpDict.Count(); i++ )
+		{
+			const dgamelump_internal_t &gameLump = g_GameLumpDict[i];
+			if ( !( gameLump.flags & GAMELUMPFLAG_COMPRESSED ) || !s_MappedMap.Contains( gameLump.offset, gameLump.compressedSize ) )
+				continue;
+
+			QueueMapLumpPrefetch( s_GameLumpPrefetch[i], s_MappedMap.Base() + gameLump.offset, gameLump.compressedSize, gameLump.uncompressedSize, &s_GameLumpProfile[i] );
+		}
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -4594,10 +5146,13 @@ void CModelLoader::Map_LoadModel( model_t *mod )
 	COM_TimestampedLog( "  Map_SetRenderInfoAllocated" );
 	Map_SetRenderInfoAllocated( false );
 
-	// Close map file, etc.
+	// Close map file, etc. CM_LoadMap ran at the top of this function, so
+	// nothing reads the prefetched lumps after this point.
 	CMapLoadHelper::Shutdown();
+	CMapLoadHelper::DiscardPrefetchedLumps();
 
 	double elapsed = Plat_FloatTime() - startTime;
+	s_flProfileLoadTime = elapsed;
 	COM_TimestampedLog( "Map_LoadModel: Finish - loading took %.4f seconds", elapsed );
 }
 
@@ -4685,6 +5240,8 @@ void CModelLoader::Map_UnloadModel( model_t *mod )
 {
 	Assert( !( mod->nLoadFlags & FMODELLOADER_REFERENCEMASK ) );
 	mod->nLoadFlags &= ~FMODELLOADER_LOADED;
+
+	CMapLoadHelper::ReleaseMappedMap();
 	
 #ifndef SWDS
 	OverlayMgr()->UnloadOverlays();
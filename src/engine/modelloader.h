@@ -187,6 +187,12 @@ public:
 	// Free the lighting lump (increases free memory during loading on 360)
 	static void			FreeLightingLump();
 
+	// Free lumps that were decompressed ahead of time, once the world is loaded
+	static void			DiscardPrefetchedLumps();
+
+	// Unmap the .bsp, when the world model is unloaded
+	static void			ReleaseMappedMap();
+
 	// Returns the size of a particular lump without loading it
 	static int			LumpSize( int lumpId );
 	static int			LumpOffset( int lumpId );
@@ -202,6 +208,7 @@ private:
 	byte				*m_pRawData;
 	byte				*m_pData;
 	byte				*m_pUncompressedData;
+	bool				m_bPrefetched;		// m_pUncompressedData belongs to the lump's prefetch
 
 	// Handling for lump files
 	int					m_nLumpID;
@@ -776,6 +776,12 @@ void CNetChan::FlowReset( void )
 {
 	Q_memset( m_DataFlow, 0, sizeof( m_DataFlow ) );
 	Q_memset( m_MsgStats, 0, sizeof( m_MsgStats ) );
+
+	m_nVoiceMsgsIn = 0;
+	m_nVoiceBytesIn = 0;
+	m_nVoiceListeners = 0;
+	m_nVoiceMsgsOut = 0;
+	m_nVoiceBytesOut = 0;
 }
 
 void CNetChan::FlowNewPacket(int flow, int seqnr, int acknr, int nChoked, int nDropped, int nSize )
@@ -2616,6 +2622,37 @@ bool CNetChan::SendData( bf_write &msg, bool bReliable )
 	return buf->WriteBits( msg.GetData(), msg.GetNumBitsWritten() );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Appends a voice message the server serialized once for all listeners,
+//			exactly as SendNetMsg would have written it to the unreliable stream.
+//			A message that doesn't fit is dropped rather than overflowing the stream.
+//-----------------------------------------------------------------------------
+bool CNetChan::SendVoiceData( bf_write &msg )
+{
+	if ( !SendData( msg, false ) )
+		return false;
+
+	m_nVoiceMsgsOut++;
+	m_nVoiceBytesOut += msg.GetNumBytesWritten();
+	return true;
+}
+
+void CNetChan::AddVoiceRelayed( int nBytes, int nListeners )
+{
+	m_nVoiceMsgsIn++;
+	m_nVoiceBytesIn += nBytes;
+	m_nVoiceListeners += nListeners;
+}
+
+void CNetChan::GetVoiceStats( int &nMsgsIn, int &nBytesIn, int &nListeners, int &nMsgsOut, int &nBytesOut ) const
+{
+	nMsgsIn = m_nVoiceMsgsIn;
+	nBytesIn = m_nVoiceBytesIn;
+	nListeners = m_nVoiceListeners;
+	nMsgsOut = m_nVoiceMsgsOut;
+	nBytesOut = m_nVoiceBytesOut;
+}
+
 bool CNetChan::SendReliableViaStream( dataFragments_t *data)
 {
 	// Always queue any pending reliable data ahead of the fragmentation buffer
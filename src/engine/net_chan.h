@@ -202,6 +202,11 @@ public:	// INetChannel interface
 
 	int			IncrementSplitPacketSequence();
 
+	// Voice relay, see SV_BroadcastVoiceData
+	bool		SendVoiceData( bf_write &msg ); // append a voice message serialized once for every listener
+	void		AddVoiceRelayed( int nBytes, int nListeners ); // count a voice packet this channel's client sent out
+	void		GetVoiceStats( int &nMsgsIn, int &nBytesIn, int &nListeners, int &nMsgsOut, int &nBytesOut ) const;
+
 public:
 
 	static bool	IsValidFileForTransfer( const char *pFilename );
@@ -325,6 +330,13 @@ public:
 	netflow_t		m_DataFlow[ MAX_FLOWS ];  
 	int				m_MsgStats[INetChannelInfo::TOTAL];	// total bytes for each message group
 
+	// voice relay totals
+	int				m_nVoiceMsgsIn;		// voice packets from this client relayed by the server
+	int				m_nVoiceBytesIn;
+	int				m_nVoiceListeners;	// total listeners those packets were sent to
+	int				m_nVoiceMsgsOut;	// voice messages sent to this client
+	int				m_nVoiceBytesOut;
+
 
 	int				m_PacketDrop;	// packets lost before getting last update (was global net_drop)
 
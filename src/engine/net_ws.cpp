@@ -3363,6 +3363,11 @@ void NET_PrintChannelStatus( INetChannel * chan )
 	Msg( "- packets: in %.1f/s, out %.1f/s\n", chan->GetAvgPackets(FLOW_INCOMING), chan->GetAvgPackets(FLOW_OUTGOING) );
 	Msg( "- choke: in %.2f, out %.2f\n", chan->GetAvgChoke(FLOW_INCOMING), chan->GetAvgChoke(FLOW_OUTGOING) );
 	Msg( "- flow: in %.1f, out %.1f kB/s\n", chan->GetAvgData(FLOW_INCOMING)/1024.0f, chan->GetAvgData(FLOW_OUTGOING)/1024.0f );
+
+	int nVoiceMsgsIn, nVoiceBytesIn, nVoiceListeners, nVoiceMsgsOut, nVoiceBytesOut;
+	static_cast<CNetChan*>( chan )->GetVoiceStats( nVoiceMsgsIn, nVoiceBytesIn, nVoiceListeners, nVoiceMsgsOut, nVoiceBytesOut );
+	Msg( "- voice: in %i msgs %.1f kB (fan-out %.1f), out %i msgs %.1f kB\n", nVoiceMsgsIn, nVoiceBytesIn/1024.0f,
+		nVoiceMsgsIn ? (float)nVoiceListeners/nVoiceMsgsIn : 0.0f, nVoiceMsgsOut, nVoiceBytesOut/1024.0f );
 	Msg( "- total: in %.1f, out %.1f MB\n\n", (float)chan->GetTotalData(FLOW_INCOMING)/(1024*1024), (float)chan->GetTotalData(FLOW_OUTGOING)/(1024*1024) );
 }
 
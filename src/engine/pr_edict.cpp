@@ -60,6 +60,8 @@ static void ED_ClearEdict( edict_t *e )
 
 	e->m_NetworkSerialNumber = -1;  // must be filled by game.dll
 	Assert( (int) e->m_EdictIndex == (e - sv.edicts) );
+
+	InvalidateEntityClusterCache( e->m_EdictIndex );
 }
 
 void ED_ClearFreeFlag( edict_t *e )
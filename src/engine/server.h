@@ -183,6 +183,7 @@ extern IServerGameEnts *serverGameEnts;
 
 extern IServerGameClients *serverGameClients;
 extern int g_iServerGameClientsVersion;	// This matches the number at the end of the interface name (so for "ServerGameClients004", this would be 4).
+extern int g_iServerGameEntsVersion;	// This matches the number at the end of the interface name (so for "ServerGameEnts002", this would be 2).
 
 extern IHLTVDirector *serverGameDirector;
 
@@ -513,6 +513,7 @@ void CGameClient::UpdateUserSettings()
 {
 	// set voice loopback
 	m_bVoiceLoopback = m_ConVars->GetInt( "voice_loopback", 0 ) != 0;
+	SV_InvalidateVoiceHearing( GetPlayerSlot() );
 
 	CBaseClient::UpdateUserSettings();
 
@@ -615,6 +616,7 @@ void CGameClient::Inactivate( void )
 	m_Sounds.Purge();
 	m_VoiceStreams.ClearAll();
 	m_VoiceProximity.ClearAll();
+	SV_InvalidateVoiceHearing( GetPlayerSlot() );
 
 
 	DeleteClientFrames( -1 ); // delete all
@@ -666,6 +668,7 @@ void CGameClient::Clear()
 	m_Sounds.Purge();
 	m_VoiceStreams.ClearAll();
 	m_VoiceProximity.ClearAll();
+	SV_InvalidateVoiceHearing( GetPlayerSlot() );
 	edict = NULL;
 	m_pViewEntity = NULL;
 	m_bVoiceLoopback = false;
@@ -72,6 +72,7 @@
 #include "cl_rcon.h"
 #include "host_state.h"
 #include "voice.h"
+#include "net_chan.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1969,6 +1970,123 @@ void SV_WriteVoiceCodec(bf_write &pBuf)
 	voiceinit.WriteToBuffer( pBuf );
 }
 
+//-----------------------------------------------------------------------------
+// Voice routing cache. Who hears a talker only changes when the game calls
+// IVoiceServer, a client changes voice_loopback or clients come and go, so
+// each talker's row of the talker x listener matrix is asked of the game the
+// first time they talk and reused until one of those happens.
+//-----------------------------------------------------------------------------
+struct VoiceHearingRow_t
+{
+	int									m_nGeneration;	// s_nVoiceHearingGeneration the row was built for
+	int									m_nSpawnCount;
+	CBitVec< ABSOLUTE_PLAYER_LIMIT >	m_Active;		// listeners that were active when the row was built
+	CBitVec< ABSOLUTE_PLAYER_LIMIT >	m_Hearers;		// IsHearingClient of each active listener
+	CBitVec< ABSOLUTE_PLAYER_LIMIT >	m_Proximity;	// IsProximityHearingClient of each active listener
+};
+
+static VoiceHearingRow_t s_VoiceHearing[ ABSOLUTE_PLAYER_LIMIT ];
+static int s_nVoiceHearingGeneration = 1;
+
+// A client is a listener in every other talker's row as well as the talker of
+// its own, so any change throws away all rows
+void SV_InvalidateVoiceHearing( int iTalker )
+{
+	if ( iTalker >= 0 && iTalker < ABSOLUTE_PLAYER_LIMIT )
+	{
+		++s_nVoiceHearingGeneration;
+	}
+}
+
+static const VoiceHearingRow_t &SV_GetVoiceHearing( int iTalker )
+{
+	Assert( sv.GetClientCount() <= ABSOLUTE_PLAYER_LIMIT );
+
+	CBitVec< ABSOLUTE_PLAYER_LIMIT > active;
+	for ( int i = 0; i < sv.GetClientCount(); i++ )
+	{
+		if ( sv.GetClient(i)->IsActive() )
+		{
+			active.Set( i );
+		}
+	}
+
+	VoiceHearingRow_t &row = s_VoiceHearing[iTalker];
+	if ( row.m_nGeneration == s_nVoiceHearingGeneration && row.m_nSpawnCount == sv.GetSpawnCount() && row.m_Active.Compare( active ) )
+		return row;
+
+	row.m_nGeneration = s_nVoiceHearingGeneration;
+	row.m_nSpawnCount = sv.GetSpawnCount();
+	row.m_Active.Copy( active );
+	row.m_Hearers.ClearAll();
+	row.m_Proximity.ClearAll();
+
+	for ( int i = 0; i < sv.GetClientCount(); i++ )
+	{
+		if ( !active.IsBitSet( i ) )
+			continue;
+
+		IClient *pDestClient = sv.GetClient(i);
+		if ( pDestClient->IsHearingClient( iTalker ) )
+		{
+			row.m_Hearers.Set( i );
+		}
+
+		if ( pDestClient->IsProximityHearingClient( iTalker ) )
+		{
+			row.m_Proximity.Set( i );
+		}
+	}
+
+	return row;
+}
+
+//-----------------------------------------------------------------------------
+// A voice packet serialized at most once per variant, proximity or not and
+// full or zero length, then copied into each listener's channel as raw bits.
+//-----------------------------------------------------------------------------
+class CSerializedVoiceData
+{
+public:
+	CSerializedVoiceData( SVC_VoiceData &voiceData, int nBits ) : m_VoiceData( voiceData ), m_nBits( nBits )
+	{
+		Q_memset( m_bWritten, 0, sizeof( m_bWritten ) );
+	}
+
+	bf_write &Get( bool bProximity, bool bZeroLength )
+	{
+		bf_write &msg = m_Msg[bZeroLength][bProximity];
+		if ( !m_bWritten[bZeroLength][bProximity] )
+		{
+			m_bWritten[bZeroLength][bProximity] = true;
+
+			if ( bZeroLength )
+			{
+				msg.StartWriting( m_EmptyData[bProximity], sizeof( m_EmptyData[bProximity] ) );
+			}
+			else
+			{
+				msg.StartWriting( m_FullData[bProximity], sizeof( m_FullData[bProximity] ) );
+			}
+
+			m_VoiceData.m_bProximity = bProximity;
+			m_VoiceData.m_nLength = bZeroLength ? 0 : m_nBits;
+			m_VoiceData.WriteToBuffer( msg );
+		}
+		return msg;
+	}
+
+private:
+	SVC_VoiceData	&m_VoiceData;
+	int				m_nBits;
+	bf_write		m_Msg[2][2];		// [bZeroLength][bProximity]
+	bool			m_bWritten[2][2];
+
+	// the most voice data a client can send, plus the message header
+	ALIGN4 char		m_FullData[2][4096 + 16] ALIGN4_POST;
+	ALIGN4 char		m_EmptyData[2][16] ALIGN4_POST;
+};
+
 // Gets voice data from a client and forwards it to anyone who can hear this client.
 ConVar voice_debugfeedbackfrom( "voice_debugfeedbackfrom", "0" );
 
@@ -1978,6 +2096,8 @@ void SV_BroadcastVoiceData(IClient * pClient, int nBytes, char * data, int64 xui
 	if( !sv_voiceenable.GetInt() )
 		return;
 
+	VPROF( "SV_BroadcastVoiceData" );
+
 	// Build voice message once
 	SVC_VoiceData voiceData;
 	voiceData.m_nFromClient = pClient->GetPlayerSlot();
@@ -1990,9 +2110,13 @@ void SV_BroadcastVoiceData(IClient * pClient, int nBytes, char * data, int64 xui
 		Msg( "Sending voice from: %s - playerslot: %d\n", pClient->GetClientName(), pClient->GetPlayerSlot() + 1 );
 	}
 
+	const VoiceHearingRow_t &hearing = SV_GetVoiceHearing( voiceData.m_nFromClient );
+	CSerializedVoiceData serialized( voiceData, nBytes * 8 );
+	int nListeners = 0;
+
 	for(int i=0; i < sv.GetClientCount(); i++)
 	{
-		IClient *pDestClient = sv.GetClient(i);
+		CGameClient *pDestClient = sv.Client(i);
 
 		bool bSelf = (pDestClient == pClient);
 
@@ -2002,8 +2126,8 @@ void SV_BroadcastVoiceData(IClient * pClient, int nBytes, char * data, int64 xui
 
 		// Does the game code want cl sending to this client?
 
-		bool bHearsPlayer = pDestClient->IsHearingClient( voiceData.m_nFromClient );
-		voiceData.m_bProximity = pDestClient->IsProximityHearingClient( voiceData.m_nFromClient );
+		bool bHearsPlayer = hearing.m_Hearers.IsBitSet( i );
+		bool bProximity = hearing.m_Proximity.IsBitSet( i );
 
 		if ( IsX360() && bSelf == true )			
 			continue;
@@ -2011,17 +2135,34 @@ void SV_BroadcastVoiceData(IClient * pClient, int nBytes, char * data, int64 xui
 		if ( !bHearsPlayer && !bSelf )
 			continue;	
 
-		voiceData.m_nLength = nBytes * 8;
-
 		// Is loopback enabled?
-		if( !bHearsPlayer )
+		// If not, still send something, just zero length (this is so the client 
+		// can display something that shows knows the server knows it's talking).
+		bool bZeroLength = !bHearsPlayer;
+
+		INetChannel *pNetChannel = pDestClient->GetNetChannel();
+		if ( pNetChannel && !pDestClient->IsHLTV() && !pDestClient->IsReplay() && !pDestClient->IsTracing() )
 		{
-			// Still send something, just zero length (this is so the client 
-			// can display something that shows knows the server knows it's talking).
-			voiceData.m_nLength = 0;	
+			static_cast<CNetChan*>( pNetChannel )->SendVoiceData( serialized.Get( bProximity, bZeroLength ) );
 		}
+		else
+		{
+			// HLTV and replay record the message itself
+			voiceData.m_bProximity = bProximity;
+			voiceData.m_nLength = bZeroLength ? 0 : nBytes * 8;
+			pDestClient->SendNetMsg( voiceData );
+		}
+
+		if ( !bZeroLength )
+		{
+			nListeners++;
+		}
+	}
 
-		pDestClient->SendNetMsg( voiceData );
+	INetChannel *pTalkerChannel = pClient->GetNetChannel();
+	if ( pTalkerChannel )
+	{
+		static_cast<CNetChan*>( pTalkerChannel )->AddVoiceRelayed( nBytes, nListeners );
 	}
 }
 
@@ -96,6 +96,8 @@ void SV_TermSendTables( ServerClass *pClasses );
 
 // send voice data from cl to other clients
 void SV_BroadcastVoiceData(IClient * cl, int nBytes, char * data, int64 xuid);
+// the game changed who hears iTalker, see IVoiceServer
+void SV_InvalidateVoiceHearing( int iTalker );
 void SV_SendRestoreMsg( bf_write &dest );
 
 // A client has uploaded its logo to us;
@@ -471,6 +471,75 @@ void PackEntities_Normal(
 // Writes the compressed packet of entities to all clients
 //-----------------------------------------------------------------------------
 
+static ConVar sv_parallel_checktransmit( "sv_parallel_checktransmit", "1", 0, "Run CheckTransmit for each client on the job pool." );
+
+struct CheckTransmitWork_t
+{
+	CGameClient		*pClient;
+	CFrameSnapshot	*pSnapshot;
+
+	// PrepareParallelCheckTransmit has frozen the shared entity state CheckTransmit reads.
+	static void Process( CheckTransmitWork_t &item )
+	{
+		serverGameEnts->CheckTransmit( &item.pClient->m_PackInfo, item.pSnapshot->m_pValidEntities, item.pSnapshot->m_nValidEntities );
+		item.pClient->SetupPrevPackInfo();
+	}
+};
+
+// Time spent in the CheckTransmit stage of SV_ComputeClientPacks, kept separately for the
+// serial and parallel paths so the two can be compared on the same server.
+struct CheckTransmitStats_t
+{
+	int		m_nTicks;
+	int		m_nClients;
+	double	m_flTotal;
+	double	m_flMax;
+
+	void Reset()
+	{
+		m_nTicks = m_nClients = 0;
+		m_flTotal = m_flMax = 0.0;
+	}
+
+	void AddSample( double flTime, int nClients )
+	{
+		++m_nTicks;
+		m_nClients += nClients;
+		m_flTotal += flTime;
+		m_flMax = MAX( m_flMax, flTime );
+	}
+};
+
+static CheckTransmitStats_t g_CheckTransmitStats[2];
+
+CON_COMMAND( sv_checktransmit_stats, "Report time spent in CheckTransmit per tick for the serial and parallel paths. Pass 'reset' to clear." )
+{
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_CheckTransmitStats[0].Reset();
+		g_CheckTransmitStats[1].Reset();
+		return;
+	}
+
+	static const char *s_pModeNames[2] = { "serial", "parallel" };
+	for ( int i = 0; i < 2; ++i )
+	{
+		const CheckTransmitStats_t &stats = g_CheckTransmitStats[i];
+		if ( !stats.m_nTicks )
+		{
+			ConMsg( "%-8s: no samples\n", s_pModeNames[i] );
+			continue;
+		}
+
+		ConMsg( "%-8s: %d ticks, %.1f clients/tick, avg %.3f ms, max %.3f ms\n", 
+			s_pModeNames[i], 
+			stats.m_nTicks, 
+			(float)stats.m_nClients / stats.m_nTicks,
+			stats.m_flTotal * 1000.0 / stats.m_nTicks,
+			stats.m_flMax * 1000.0 );
+	}
+}
+
 void SV_ComputeClientPacks( 
 	int clientCount, 
 	CGameClient **clients,
@@ -483,13 +552,42 @@ void SV_ComputeClientPacks(
 	{
 		VPROF_BUDGET_FLAGS( "SV_ComputeClientPacks", "CheckTransmit", BUDGETFLAG_SERVER );
 
+		double flStart = Plat_FloatTime();
+
+		// SetupPackInfo calls back into the game to build the client's PVS, so it stays serial.
 		for (int iClient = 0; iClient < clientCount; ++iClient)
 		{
-			CCheckTransmitInfo *pInfo = &clients[iClient]->m_PackInfo;
 			clients[iClient]->SetupPackInfo( snapshot );
-			serverGameEnts->CheckTransmit( pInfo, snapshot->m_pValidEntities, snapshot->m_nValidEntities );
-			clients[iClient]->SetupPrevPackInfo();
 		}
+
+		bool bParallel = sv_parallel_checktransmit.GetBool() && 
+			clientCount > 1 && 
+			g_iServerGameEntsVersion >= 2 &&
+			serverGameEnts->PrepareParallelCheckTransmit( snapshot->m_pValidEntities, snapshot->m_nValidEntities );
+
+		CUtlVectorFixed< CheckTransmitWork_t, ABSOLUTE_PLAYER_LIMIT > workItems;
+		for (int iClient = 0; iClient < clientCount; ++iClient)
+		{
+			CheckTransmitWork_t w;
+			w.pClient = clients[iClient];
+			w.pSnapshot = snapshot;
+			workItems.AddToTail( w );
+		}
+
+		if ( bParallel )
+		{
+			ParallelProcess( "CheckTransmitWork_t::Process", workItems.Base(), workItems.Count(), &CheckTransmitWork_t::Process );
+			serverGameEnts->FinishParallelCheckTransmit();
+		}
+		else
+		{
+			for ( int i = 0; i < workItems.Count(); ++i )
+			{
+				CheckTransmitWork_t::Process( workItems[i] );
+			}
+		}
+
+		g_CheckTransmitStats[ bParallel ? 1 : 0 ].AddSample( Plat_FloatTime() - flStart, clientCount );
 	}
 
 	VPROF_BUDGET_FLAGS( "SV_ComputeClientPacks", "ComputeClientPacks", BUDGETFLAG_SERVER );
@@ -691,3 +789,85 @@ const char* GetObjectClassName( int objectID )
 
 
 
+
+//-----------------------------------------------------------------------------
+// Purpose: Encodes every networked entity through both its SendTable's encode
+//			plan and the generic per-prop path, and checks that the bits and the
+//			delta against the previous instance of the same class match.
+//-----------------------------------------------------------------------------
+CON_COMMAND( dt_verify_encode_plan, "Verify that every server class encodes identically through the SendTable encode plan. Pass 'missing' to list the classes with no entity to check." )
+{
+	if ( !sv.IsActive() )
+	{
+		ConMsg( "dt_verify_encode_plan: no active server.\n" );
+		return;
+	}
+
+	// The last encoding of each class is the 'from' state when checking the next instance.
+	CUtlVector< CUtlVector< unsigned char > > prevStates;
+	CUtlVector< int > prevBits;
+	CUtlVector< bool > classSeen;
+	prevStates.SetSize( sv.serverclasses );
+	prevBits.SetSize( sv.serverclasses );
+	classSeen.SetSize( sv.serverclasses );
+	for ( int i=0; i < sv.serverclasses; i++ )
+	{
+		prevBits[i] = 0;
+		classSeen[i] = false;
+	}
+
+	int nEntities = 0;
+	int nFailed = 0;
+	int nClassesSeen = 0;
+
+	for ( int iEdict=0; iEdict < sv.num_edicts; iEdict++ )
+	{
+		edict_t *edict = &sv.edicts[iEdict];
+		if ( edict->IsFree() || !edict->GetNetworkable() || !edict->GetUnknown() )
+			continue;
+
+		ServerClass *pServerClass = edict->GetNetworkable()->GetServerClass();
+		if ( !pServerClass )
+			continue;
+
+		SendTable *pSendTable = pServerClass->m_pTable;
+		int iClass = pServerClass->m_ClassID;
+
+		const void *pFromState = prevBits[iClass] ? prevStates[iClass].Base() : NULL;
+		if ( !SendTable_VerifyEncodePlan( pSendTable, edict->GetUnknown(), iEdict, pFromState, prevBits[iClass] ) )
+		{
+			ConMsg( "dt_verify_encode_plan: mismatch on entity %d (%s).\n", iEdict, pServerClass->GetName() );
+			++nFailed;
+		}
+
+		if ( !classSeen[iClass] )
+		{
+			classSeen[iClass] = true;
+			++nClassesSeen;
+		}
+
+		ALIGN4 unsigned char packedData[MAX_PACKEDENTITY_DATA] ALIGN4_POST;
+		bf_write writeBuf( "dt_verify_encode_plan->writeBuf", packedData, sizeof( packedData ) );
+		if ( SendTable_Encode( pSendTable, edict->GetUnknown(), &writeBuf, iEdict, NULL, false ) && writeBuf.GetNumBitsWritten() )
+		{
+			prevStates[iClass].CopyArray( packedData, writeBuf.GetNumBytesWritten() );
+			prevBits[iClass] = writeBuf.GetNumBitsWritten();
+		}
+
+		++nEntities;
+	}
+
+	ConMsg( "dt_verify_encode_plan: %d entities of %d/%d server classes checked, %d mismatches.\n", 
+		nEntities, nClassesSeen, sv.serverclasses, nFailed );
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "missing" ) )
+	{
+		for ( ServerClass *pClass = serverGameDLL->GetAllServerClasses(); pClass; pClass = pClass->m_pNext )
+		{
+			if ( !classSeen[pClass->m_ClassID] )
+			{
+				ConMsg( "dt_verify_encode_plan: no entity of %s.\n", pClass->GetName() );
+			}
+		}
+	}
+}
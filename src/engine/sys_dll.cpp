@@ -127,6 +127,7 @@ IServerGameEnts *serverGameEnts = NULL;
 
 IServerGameClients *serverGameClients = NULL;
 int g_iServerGameClientsVersion = 0;	// This matches the number at the end of the interface name (so for "ServerGameClients004", this would be 4).
+int g_iServerGameEntsVersion = 0;		// This matches the number at the end of the interface name (so for "ServerGameEnts002", this would be 2).
 
 IHLTVDirector	*serverGameDirector = NULL;
 
@@ -1168,10 +1169,23 @@ static bool LoadThisDll( char *szDllFilename, bool bIsServerOnly )
 		}
 
 		serverGameEnts = (IServerGameEnts*)g_ServerFactory(INTERFACEVERSION_SERVERGAMEENTS, NULL);
-		if ( !serverGameEnts )
+		if ( serverGameEnts )
 		{
-			ConMsg( "Could not get IServerGameEnts interface from library %s", szDllFilename );
-			goto IgnoreThisDLL;
+			g_iServerGameEntsVersion = 2;
+		}
+		else
+		{
+			// Try the previous version.
+			serverGameEnts = (IServerGameEnts*)g_ServerFactory(INTERFACEVERSION_SERVERGAMEENTS_VERSION_1, NULL);
+			if ( serverGameEnts )
+			{
+				g_iServerGameEntsVersion = 1;
+			}
+			else
+			{
+				ConMsg( "Could not get IServerGameEnts interface from library %s", szDllFilename );
+				goto IgnoreThisDLL;
+			}
 		}
 		
 		serverGameClients = (IServerGameClients*)g_ServerFactory(INTERFACEVERSION_SERVERGAMECLIENTS, NULL);
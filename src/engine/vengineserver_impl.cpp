@@ -1747,6 +1747,7 @@ private:
 	virtual const char* GetMapEntitiesString();
 	virtual void BuildEntityClusterList( edict_t *pEdict, PVSInfo_t *pPVSInfo );
 	virtual void CleanUpEntityClusterList( PVSInfo_t *pPVSInfo );
+	void ComputeEntityClusterList( PVSInfo_t *pPVSInfo, const Vector &vecWorldMins, const Vector &vecWorldMaxs, float *pSlack );
 	virtual void SolidMoved( edict_t *pSolidEnt, ICollideable *pSolidCollide, const Vector* pPrevAbsOrigin, bool accurateBboxTriggerChecks );
 	virtual void TriggerMoved( edict_t *pTriggerEnt, bool accurateBboxTriggerChecks );
 
@@ -1930,7 +1931,104 @@ inline bool SortClusterLessFunc( const int &left, const int &right )
 	return left < right;
 }
 
+//-----------------------------------------------------------------------------
+// An entity's cluster list only depends on which side of each BSP plane its
+// bounds fall, so remember how far the bounds were from flipping any of those
+// decisions and skip the leaf walk until they have moved further than that.
+//-----------------------------------------------------------------------------
+static ConVar sv_pvs_incremental( "sv_pvs_incremental", "1", 0, "Reuse an entity's cluster list until its bounds move far enough to touch a different set of leafs." );
+
+// Covers float error in the plane distances the slack was computed from
+#define PVS_SLACK_EPSILON	0.03125f
+
+struct EntityClusterCache_t
+{
+	PVSInfo_t		*m_pPVSInfo;	// NULL if nothing is cached for this edict
+	Vector			m_vecCenter;
+	Vector			m_vecExtents;
+	float			m_flSlack;
+
+	// What was left in m_pPVSInfo, so we notice if anyone else has touched it
+	unsigned short	*m_pClusters;
+	short			m_nClusterCount;
+	short			m_nHeadNode;
+	short			m_nAreaNum;
+	short			m_nAreaNum2;
+
+	bool IsCurrent( const PVSInfo_t *pPVSInfo ) const
+	{
+		return m_pPVSInfo == pPVSInfo &&
+			pPVSInfo->m_pClusters == m_pClusters &&
+			pPVSInfo->m_nClusterCount == m_nClusterCount &&
+			pPVSInfo->m_nHeadNode == m_nHeadNode &&
+			pPVSInfo->m_nAreaNum == m_nAreaNum &&
+			pPVSInfo->m_nAreaNum2 == m_nAreaNum2;
+	}
+};
+
+static EntityClusterCache_t s_EntityClusterCache[MAX_EDICTS];
+static int s_nClusterListBuilds;
+static int s_nClusterListReuses;
+
+void InvalidateEntityClusterCache( int iEdict )
+{
+	s_EntityClusterCache[iEdict].m_pPVSInfo = NULL;
+}
+
 void CVEngineServer::BuildEntityClusterList( edict_t *pEdict, PVSInfo_t *pPVSInfo )
+{
+	ICollideable *pCollideable = pEdict ? pEdict->GetCollideable() : NULL;
+	Assert( !pEdict || pCollideable );
+	if ( !pCollideable )
+	{
+		if ( pEdict )
+		{
+			InvalidateEntityClusterCache( pEdict->m_EdictIndex );
+		}
+
+		CleanUpEntityClusterList( pPVSInfo );
+		pPVSInfo->m_pClusters = 0;
+		pPVSInfo->m_nClusterCount = 0;
+		pPVSInfo->m_nAreaNum = 0;
+		pPVSInfo->m_nAreaNum2 = 0;
+		return;
+	}
+
+	Vector vecWorldMins, vecWorldMaxs;
+	pCollideable->WorldSpaceSurroundingBounds( &vecWorldMins, &vecWorldMaxs );
+	Vector vecCenter = (vecWorldMins + vecWorldMaxs) * 0.5f;
+	Vector vecExtents = vecWorldMaxs - vecCenter;
+
+	EntityClusterCache_t &cache = s_EntityClusterCache[pEdict->m_EdictIndex];
+	if ( sv_pvs_incremental.GetBool() && cache.IsCurrent( pPVSInfo ) )
+	{
+		// The center and extents feed into each plane test through unit normals,
+		// so neither can shift a test by more than the distance it moved.
+		float flMove = vecCenter.DistTo( cache.m_vecCenter ) + vecExtents.DistTo( cache.m_vecExtents );
+		if ( flMove + PVS_SLACK_EPSILON < cache.m_flSlack )
+		{
+			pPVSInfo->m_vCenter[0] = vecCenter[0];
+			pPVSInfo->m_vCenter[1] = vecCenter[1];
+			pPVSInfo->m_vCenter[2] = vecCenter[2];
+			++s_nClusterListReuses;
+			return;
+		}
+	}
+
+	ComputeEntityClusterList( pPVSInfo, vecWorldMins, vecWorldMaxs, &cache.m_flSlack );
+	++s_nClusterListBuilds;
+
+	cache.m_pPVSInfo = pPVSInfo;
+	cache.m_vecCenter = vecCenter;
+	cache.m_vecExtents = vecExtents;
+	cache.m_pClusters = pPVSInfo->m_pClusters;
+	cache.m_nClusterCount = pPVSInfo->m_nClusterCount;
+	cache.m_nHeadNode = pPVSInfo->m_nHeadNode;
+	cache.m_nAreaNum = pPVSInfo->m_nAreaNum;
+	cache.m_nAreaNum2 = pPVSInfo->m_nAreaNum2;
+}
+
+void CVEngineServer::ComputeEntityClusterList( PVSInfo_t *pPVSInfo, const Vector &vecWorldMins, const Vector &vecWorldMaxs, float *pSlack )
 {
 	int		i, j;
 	int		topnode;
@@ -1943,20 +2041,11 @@ void CVEngineServer::BuildEntityClusterList( edict_t *pEdict, PVSInfo_t *pPVSInf
 	pPVSInfo->m_nClusterCount = 0;
 	pPVSInfo->m_nAreaNum = 0;
 	pPVSInfo->m_nAreaNum2 = 0;
-	if ( !pEdict )
-		return;
-
-	ICollideable *pCollideable = pEdict->GetCollideable();
-	Assert( pCollideable );
-	if ( !pCollideable )
-		return;
 
 	topnode = -1;
 
 	//get all leafs, including solids
-	Vector vecWorldMins, vecWorldMaxs;
-	pCollideable->WorldSpaceSurroundingBounds( &vecWorldMins, &vecWorldMaxs );
-	leafCount = CM_BoxLeafnums( vecWorldMins, vecWorldMaxs, leafs, MAX_TOTAL_ENT_LEAFS, &topnode );
+	leafCount = CM_BoxLeafnums( vecWorldMins, vecWorldMaxs, leafs, MAX_TOTAL_ENT_LEAFS, &topnode, pSlack );
 
 	// set areas
 	for ( i = 0; i < leafCount; i++ )
@@ -2066,6 +2155,32 @@ void CVEngineServer::BuildEntityClusterList( edict_t *pEdict, PVSInfo_t *pPVSInf
 }
 
 
+CON_COMMAND( sv_pvs_stats, "Report how many entity cluster lists and areaportal floods were recomputed or skipped. Pass 'reset' to clear." )
+{
+	bool bReset = args.ArgC() > 1 && !Q_stricmp( args[1], "reset" );
+
+	int nFloods, nFloodsSkipped;
+	CM_GetAreaFloodStats( &nFloods, &nFloodsSkipped, bReset );
+
+	if ( bReset )
+	{
+		s_nClusterListBuilds = 0;
+		s_nClusterListReuses = 0;
+		return;
+	}
+
+	int nClusterLists = s_nClusterListBuilds + s_nClusterListReuses;
+	ConMsg( "cluster lists: %d requested, %d rebuilt, %d reused (%.1f%%)\n",
+		nClusterLists, s_nClusterListBuilds, s_nClusterListReuses,
+		nClusterLists ? 100.0f * s_nClusterListReuses / nClusterLists : 0.0f );
+
+	int nPortalUpdates = nFloods + nFloodsSkipped;
+	ConMsg( "areaportal updates: %d, %d flooded, %d unchanged (%.1f%%)\n",
+		nPortalUpdates, nFloods, nFloodsSkipped,
+		nPortalUpdates ? 100.0f * nFloodsSkipped / nPortalUpdates : 0.0f );
+}
+
+
 //-----------------------------------------------------------------------------
 // Cleans up the cluster list
 //-----------------------------------------------------------------------------
@@ -2074,9 +2189,12 @@ void CVEngineServer::CleanUpEntityClusterList( PVSInfo_t *pPVSInfo )
 	if ( pPVSInfo->m_nClusterCount > MAX_FAST_ENT_CLUSTERS )
 	{
 		s_PVSInfoAllocator.Free( pPVSInfo->m_pClusters );
-		pPVSInfo->m_pClusters = 0;
-		pPVSInfo->m_nClusterCount = 0;
 	}
+
+	// Always clear these, so a networkable later constructed at the same address
+	// can't be mistaken for this one by the cluster list cache
+	pPVSInfo->m_pClusters = 0;
+	pPVSInfo->m_nClusterCount = 0;
 }
 
 
@@ -19,6 +19,9 @@ void SeedRandomNumberGenerator( bool random_invariant );
 
 void InvalidateSharedEdictChangeInfos();
 
+// Forgets the cluster list BuildEntityClusterList last computed for this edict
+void InvalidateEntityClusterCache( int iEdict );
+
 
 #endif // VENGINESERVER_IMPL_H
 
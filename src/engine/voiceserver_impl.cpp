@@ -8,6 +8,7 @@
 #include "quakedef.h"
 #include "server.h"
 #include "ivoiceserver.h"
+#include "sv_main.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -39,7 +40,11 @@ public:
 
 		CGameClient *cl = sv.Client(iSender);
 			
-		cl->m_VoiceStreams.Set( iReceiver, bListen?1:0 );
+		if ( cl->m_VoiceStreams.IsBitSet( iReceiver ) != bListen )
+		{
+			cl->m_VoiceStreams.Set( iReceiver, bListen?1:0 );
+			SV_InvalidateVoiceHearing( iSender );
+		}
 
 		return true;
 	}	
@@ -54,7 +59,11 @@ public:
 
 		CGameClient *cl = sv.Client(iSender);
 
-		cl->m_VoiceProximity.Set( iReceiver, bUseProximity );
+		if ( cl->m_VoiceProximity.IsBitSet( iReceiver ) != bUseProximity )
+		{
+			cl->m_VoiceProximity.Set( iReceiver, bUseProximity );
+			SV_InvalidateVoiceHearing( iSender );
+		}
 
 		return true;
 	}	
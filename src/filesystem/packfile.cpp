@@ -213,6 +213,12 @@ int CZipPackFile::ReadFromPack( int nEntryIndex, void* pBuffer, int nDestBytes,
 
 			if ( CLZMA::IsCompressed( pPreloadData ) )
 			{
+				if ( !CLZMA::IsInputValid( pPreloadData, pPreloadEntry->Length ) )
+				{
+					Warning( "Pack file: preload entry %d is corrupt\n", nEntryIndex );
+					return 0;
+				}
+
 				unsigned int actualSize = CLZMA::GetActualSize( pPreloadData );
 				if ( nLocalOffset + nBytes <= (int)actualSize )
 				{
@@ -227,14 +233,16 @@ int CZipPackFile::ReadFromPack( int nEntryIndex, void* pBuffer, int nDestBytes,
 					if ( nLocalOffset == 0 && nDestBytes >= (int)actualSize && nBytes == (int)actualSize )
 					{
 						// uncompress directly into caller's buffer
-						CLZMA::Uncompress( (unsigned char *)pPreloadData, (unsigned char *)pBuffer );
-						return nBytes;
+						return ( CLZMA::Uncompress( (unsigned char *)pPreloadData, (unsigned char *)pBuffer ) == actualSize ) ? nBytes : 0;
 					}
 
 					// uncompress into temporary memory
 					CUtlMemory< byte > tempMemory;
 					tempMemory.EnsureCapacity( actualSize );
-					CLZMA::Uncompress( pPreloadData, tempMemory.Base() );
+					if ( CLZMA::Uncompress( pPreloadData, tempMemory.Base() ) != actualSize )
+					{
+						return 0;
+					}
 					// copy only what caller expects
 					V_memcpy( pBuffer, (byte*)tempMemory.Base() + nLocalOffset, nBytes );
 					return nBytes;
@@ -130,7 +130,8 @@ public:
 
 	CNewParticleEffect *SpawnHalloweenSpellFootsteps( ParticleAttachment_t eParticleAttachment, int iHalloweenFootstepType );
 
-	void FireBullet( CTFWeaponBase *pWpn, const FireBulletsInfo_t &info, bool bDoEffects, int nDamageType, int nCustomDamageType = TF_DMG_CUSTOM_NONE );
+	void FireBullet( CTFWeaponBase *pWpn, const FireBulletsInfo_t &info, bool bDoEffects, int nDamageType, int nCustomDamageType = TF_DMG_CUSTOM_NONE, const trace_t *pPelletTrace = NULL );
+	void TraceBulletPellets( const FireBulletsInfo_t &info, int nPellets, const Vector *pDirs, trace_t *pTraces );
 
 	void ImpactWaterTrace( trace_t &trace, const Vector &vecStart );
 
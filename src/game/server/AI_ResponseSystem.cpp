@@ -29,6 +29,10 @@
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring). If set to 3, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_ruleindex( "rr_ruleindex", "1", FCVAR_NONE, "Only score the rules whose required concept matches the query's concept." );
+ConVar rr_recordqueries( "rr_recordqueries", "0", FCVAR_NONE, "Record the criteria of every response query so rr_verify_rule_index can replay them." );
+
+#define RR_MAX_RECORDED_QUERIES	8192
 
 static CUtlSymbolTable g_RS;
 
@@ -59,6 +63,7 @@ public:
 		maxequals = false;
 		maxval = 0.0f;
 		minval = 0.0f;
+		tokenval = 0.0f;
 
 		token = UTL_INVAL_SYMBOL;
 		rawtoken = UTL_INVAL_SYMBOL;
@@ -110,6 +115,7 @@ public:
 
 	float	maxval;
 	float	minval;
+	float	tokenval;		// atof( GetToken() ), so numeric compares don't reparse the token
 
 	bool	valid : 1;      //1
 	bool	isnumeric : 1;  //2
@@ -122,6 +128,7 @@ public:
 	void	SetToken( char const *s )
 	{
 		token = g_RS.AddString( s );
+		tokenval = (float)atof( s );
 	}
 
 	char const *GetToken()
@@ -683,6 +690,16 @@ public:
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
+	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, IUniformRandomStream *pRandom );
+
+	int			GetRuleConceptCriterion( const Rule *rule );
+	void		BuildRuleIndex();
+	const CUtlVector< unsigned short > &GetCandidateRules( const AI_CriteriaSet& set );
+
+	void		RecordQuery( const AI_CriteriaSet& set );
+	void		AppendMatchingCriteria( AI_CriteriaSet& set, int icriterion );
+	int			CompareRuleSelection( const AI_CriteriaSet& set, int nQuery, const char *pszName, const char *pszQuery );
+	int			VerifyRuleIndex( const char *pszName );
 
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
@@ -710,6 +727,18 @@ public:
 	CUtlDict< Rule, short >	m_Rules;
 	CUtlDict< Enumeration, short > m_Enumerations;
 
+	// Rule index. Rules with a required "concept" == value criterion can only score when the
+	// query's concept matches, so they are bucketed by that value. Every bucket also holds the
+	// rules that aren't bucketed, and all lists are in ascending rule order so the tied rules
+	// passed to the random tie-break are the same ones a full scan would find.
+	CUtlDict< int, short >			m_ConceptRuleBuckets;	// Concept -> index into m_RuleBuckets.
+	CUtlVector< CUtlVector< unsigned short > > m_RuleBuckets;
+	CUtlVector< unsigned short >	m_UnbucketedRules;
+	int								m_nIndexedRules;
+
+	// Queries captured while rr_recordqueries is set.
+	CUtlVector< AI_CriteriaSet >	m_RecordedQueries;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -762,6 +791,7 @@ CResponseSystem::CResponseSystem()
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_nIndexedRules = -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +847,11 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+
+	m_ConceptRuleBuckets.RemoveAll();
+	m_RuleBuckets.Purge();
+	m_UnbucketedRules.Purge();
+	m_nIndexedRules = -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -996,11 +1031,19 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	if ( !m.valid )
 		return false;
 
-	float v = (float)atof( setValue );
-	if ( setValue[0] == '[' )
+	// String equality matchers never look at the numeric value, so only parse it when needed.
+	float v = 0.0f;
+	if ( m.isnumeric || m.usemin || m.usemax )
 	{
-		bool found = false;
-		v = LookupEnumeration( setValue, found );
+		if ( setValue[0] == '[' )
+		{
+			bool found = false;
+			v = LookupEnumeration( setValue, found );
+		}
+		else
+		{
+			v = (float)atof( setValue );
+		}
 	}
 	
 	int minmaxcount = 0;
@@ -1047,7 +1090,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	{
 		if ( m.isnumeric )
 		{
-			if ( v == (float)atof( m.GetToken() ) )
+			if ( v == m.tokenval )
 				return false;
 		}
 		else
@@ -1066,7 +1109,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 		if ( !setValue || !setValue[0] )
 			return false;
 
-		return v == (float)atof( m.GetToken() );
+		return v == m.tokenval;
 	}
 
 	return !Q_stricmp( setValue, m.GetToken() ) ? true : false;
@@ -1683,14 +1726,134 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule
 // Output : int
 //-----------------------------------------------------------------------------
 int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose )
+{
+	if ( rr_recordqueries.GetBool() )
+	{
+		RecordQuery( set );
+	}
+
+	// Rules being debugged print their score whether or not they match, so scan them all.
+	const char *pszDebugRule = rr_debugrule.GetString();
+	bool bUseIndex = rr_ruleindex.GetBool() && !verbose && !( pszDebugRule && pszDebugRule[0] );
+
+	return FindBestMatchingRule( set, verbose, bUseIndex, random );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the index of the rule's required concept == value criterion,
+//			or -1 if the rule could match queries with any concept.
+//-----------------------------------------------------------------------------
+int CResponseSystem::GetRuleConceptCriterion( const Rule *rule )
+{
+	int count = rule->m_Criteria.Count();
+	for ( int i = 0; i < count; i++ )
+	{
+		int icriterion = rule->m_Criteria[ i ];
+		Criteria *c = &m_Criteria[ icriterion ];
+
+		// Only a failed required criterion forces the rule's score to zero.
+		if ( c->IsSubCriteriaType() || !c->required || !c->name || Q_stricmp( c->name, "concept" ) )
+			continue;
+
+		const Matcher &m = c->matcher;
+		if ( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax )
+			continue;
+
+		if ( !c->matcher.GetToken()[0] )
+			continue;
+
+		return icriterion;
+	}
+
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the rules by their required concept. See m_ConceptRuleBuckets.
+//-----------------------------------------------------------------------------
+void CResponseSystem::BuildRuleIndex()
+{
+	m_ConceptRuleBuckets.RemoveAll();
+	m_RuleBuckets.Purge();
+	m_UnbucketedRules.Purge();
+
+	int c = m_Rules.Count();
+	CUtlVector< int > ruleBucket;
+	ruleBucket.SetCount( c );
+
+	for ( int i = 0; i < c; i++ )
+	{
+		ruleBucket[ i ] = -1;
+
+		int icriterion = GetRuleConceptCriterion( &m_Rules[ i ] );
+		if ( icriterion == -1 )
+			continue;
+
+		const char *pszConcept = m_Criteria[ icriterion ].matcher.GetToken();
+		int idx = m_ConceptRuleBuckets.Find( pszConcept );
+		if ( idx == m_ConceptRuleBuckets.InvalidIndex() )
+		{
+			idx = m_ConceptRuleBuckets.Insert( pszConcept, m_RuleBuckets.AddToTail() );
+		}
+		ruleBucket[ i ] = m_ConceptRuleBuckets[ idx ];
+	}
+
+	// Walk the rules in order so each bucket stays sorted, adding unbucketed rules to all of them.
+	for ( int i = 0; i < c; i++ )
+	{
+		if ( ruleBucket[ i ] != -1 )
+		{
+			m_RuleBuckets[ ruleBucket[ i ] ].AddToTail( i );
+			continue;
+		}
+
+		m_UnbucketedRules.AddToTail( i );
+		for ( int b = 0; b < m_RuleBuckets.Count(); b++ )
+		{
+			m_RuleBuckets[ b ].AddToTail( i );
+		}
+	}
+
+	m_nIndexedRules = c;
+
+	DevMsg( 2, "Response rule index: %d rules, %d concepts, %d rules match any concept\n",
+		c, m_RuleBuckets.Count(), m_UnbucketedRules.Count() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the rules that can score against this query, in ascending order.
+//-----------------------------------------------------------------------------
+const CUtlVector< unsigned short > &CResponseSystem::GetCandidateRules( const AI_CriteriaSet& set )
+{
+	if ( m_nIndexedRules != m_Rules.Count() )
+	{
+		BuildRuleIndex();
+	}
+
+	int found = set.FindCriterionIndex( "concept" );
+	if ( found != -1 )
+	{
+		const char *pszConcept = set.GetValue( found );
+		int idx = m_ConceptRuleBuckets.Find( pszConcept ? pszConcept : "" );
+		if ( idx != m_ConceptRuleBuckets.InvalidIndex() )
+			return m_RuleBuckets[ m_ConceptRuleBuckets[ idx ] ];
+	}
+
+	return m_UnbucketedRules;
+}
+
+int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, IUniformRandomStream *pRandom )
 {
 	CUtlVector< int >	bestrules;
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
-	int i;
-	for ( i = 0; i < c; i++ )
+	const CUtlVector< unsigned short > *pCandidates = bUseIndex ? &GetCandidateRules( set ) : NULL;
+
+	int c = pCandidates ? pCandidates->Count() : m_Rules.Count();
+	int n;
+	for ( n = 0; n < c; n++ )
 	{
+		int i = pCandidates ? (int)pCandidates->Element( n ) : n;
 		float score = ScoreCriteriaAgainstRule( set, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -1715,7 +1878,7 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 		return bestrules[ 0 ];
 
 	// Randomly pick one of the tied matching rules
-	int idx = random->RandomInt( 0, bestCount - 1 );
+	int idx = pRandom->RandomInt( 0, bestCount - 1 );
 	if ( verbose )
 	{
 		DevMsg( "Found %i matching rules, selecting slot %i\n", bestCount, idx );
@@ -1723,6 +1886,135 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	return bestrules[ idx ];
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Keeps a copy of a query for rr_verify_rule_index.
+//-----------------------------------------------------------------------------
+void CResponseSystem::RecordQuery( const AI_CriteriaSet& set )
+{
+	if ( m_RecordedQueries.Count() >= RR_MAX_RECORDED_QUERIES )
+		return;
+
+	MEM_ALLOC_CREDIT();
+	m_RecordedQueries.AddToTail( set );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Appends a value that satisfies the criterion's matcher, so the rule
+//			the query is built from is at least a candidate for it.
+//-----------------------------------------------------------------------------
+void CResponseSystem::AppendMatchingCriteria( AI_CriteriaSet& set, int icriterion )
+{
+	Criteria *c = &m_Criteria[ icriterion ];
+	if ( c->IsSubCriteriaType() )
+	{
+		for ( int i = 0; i < c->subcriteria.Count(); i++ )
+		{
+			AppendMatchingCriteria( set, c->subcriteria[ i ] );
+		}
+		return;
+	}
+
+	Matcher &m = c->matcher;
+	if ( !c->name || !m.valid )
+		return;
+
+	char value[ 64 ];
+	if ( m.usemin || m.usemax )
+	{
+		float v;
+		if ( m.usemin && m.usemax )
+		{
+			v = 0.5f * ( m.minval + m.maxval );
+		}
+		else
+		{
+			v = m.usemin ? m.minval + 1.0f : m.maxval - 1.0f;
+		}
+		Q_snprintf( value, sizeof( value ), "%f", v );
+	}
+	else if ( m.notequal )
+	{
+		Q_strncpy( value, "rr_verify_rule_index", sizeof( value ) );
+	}
+	else
+	{
+		Q_strncpy( value, m.GetToken(), sizeof( value ) );
+	}
+
+	set.AppendCriteria( c->name, value );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Selects a rule for the query through the rule index and through a full
+//			scan with identically seeded random streams. Returns the number of
+//			seeds where the selected rule differs.
+//-----------------------------------------------------------------------------
+int CResponseSystem::CompareRuleSelection( const AI_CriteriaSet& set, int nQuery, const char *pszName, const char *pszQuery )
+{
+	int nMismatches = 0;
+
+	// Several seeds so queries with tied rules exercise different tie-break slots.
+	for ( int nSeed = 1; nSeed <= 4; nSeed++ )
+	{
+		CUniformRandomStream indexedRandom, scanRandom;
+		indexedRandom.SetSeed( nSeed * ( nQuery + 1 ) );
+		scanRandom.SetSeed( nSeed * ( nQuery + 1 ) );
+
+		int iIndexed = FindBestMatchingRule( set, false, true, &indexedRandom );
+		int iScan = FindBestMatchingRule( set, false, false, &scanRandom );
+		if ( iIndexed != iScan )
+		{
+			Warning( "%s: %s (seed %d) selected rule '%s' through the index and '%s' by full scan\n", pszName, pszQuery, nSeed,
+				iIndexed != -1 ? m_Rules.GetElementName( iIndexed ) : "<none>",
+				iScan != -1 ? m_Rules.GetElementName( iScan ) : "<none>" );
+			++nMismatches;
+		}
+	}
+
+	return nMismatches;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Checks that the rule index selects the same rules as a full scan for
+//			the recorded queries, for a query built from each rule's criteria and
+//			for a query with no concept. Returns the number of mismatches.
+//-----------------------------------------------------------------------------
+int CResponseSystem::VerifyRuleIndex( const char *pszName )
+{
+	int nMismatches = 0;
+	char szQuery[ 256 ];
+
+	int nQueries = m_RecordedQueries.Count();
+	for ( int q = 0; q < nQueries; q++ )
+	{
+		Q_snprintf( szQuery, sizeof( szQuery ), "recorded query %d", q );
+		nMismatches += CompareRuleSelection( m_RecordedQueries[ q ], q, pszName, szQuery );
+	}
+
+	// Recording needs gameplay, so also build a query from every rule's own criteria.
+	int c = m_Rules.Count();
+	for ( int i = 0; i < c; i++ )
+	{
+		AI_CriteriaSet set;
+		Rule *rule = &m_Rules[ i ];
+		for ( int j = 0; j < rule->m_Criteria.Count(); j++ )
+		{
+			AppendMatchingCriteria( set, rule->m_Criteria[ j ] );
+		}
+
+		Q_snprintf( szQuery, sizeof( szQuery ), "query for rule '%s'", m_Rules.GetElementName( i ) );
+		nMismatches += CompareRuleSelection( set, nQueries + i, pszName, szQuery );
+	}
+
+	AI_CriteriaSet noConcept;
+	nMismatches += CompareRuleSelection( noConcept, nQueries + c, pszName, "query with no concept" );
+
+	Msg( "%s: %d recorded queries, %d rules in %d concept buckets (%d unbucketed), %d mismatches\n",
+		pszName, nQueries, c, m_RuleBuckets.Count(), m_UnbucketedRules.Count(), nMismatches );
+
+	return nMismatches;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : set - 
@@ -2942,6 +3234,17 @@ public:
 		ResetResponseGroups();
 	}
 
+	void VerifyAllRuleIndices()
+	{
+		int nMismatches = VerifyRuleIndex( GetScriptFile() );
+		for ( int i = 0; i < m_InstancedSystems.Count(); i++ )
+		{
+			nMismatches += m_InstancedSystems[ i ]->VerifyRuleIndex( m_InstancedSystems.GetElementName( i ) );
+		}
+
+		Msg( "rr_verify_rule_index: %s\n", nMismatches ? "FAILED" : "passed" );
+	}
+
 	void ReloadAllResponseSystems()
 	{
 		Clear();
@@ -3051,6 +3354,14 @@ CON_COMMAND( rr_reloadresponsesystems, "Reload all response system scripts." )
 #endif
 }
 
+CON_COMMAND( rr_verify_rule_index, "Run queries recorded with rr_recordqueries, plus a query built from each rule, through the rule index and a full rule scan, and report any difference in the selected rules." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	defaultresponsesytem.VerifyAllRuleIndices();
+}
+
 static short RESPONSESYSTEM_SAVE_RESTORE_VERSION = 1;
 
 // note:  this won't save/restore settings from instanced response systems.  Could add that with a CDefSaveRestoreOps implementation if needed
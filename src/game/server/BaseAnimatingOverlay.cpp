@@ -492,6 +492,42 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: adds the layers GetSkeleton would accumulate to the pose cache key
+//-----------------------------------------------------------------------------
+bool CBaseAnimatingOverlay::GetPoseCacheKey( CStudioHdr *pStudioHdr, int boneMask, posecachekey_t &key )
+{
+	if ( !BaseClass::GetPoseCacheKey( pStudioHdr, boneMask, key ) )
+		return false;
+
+	// sort the layers, same as GetSkeleton
+	int layer[MAX_OVERLAYS] = {};
+	int i;
+	for (i = 0; i < m_AnimOverlay.Count(); i++)
+	{
+		layer[i] = MAX_OVERLAYS;
+	}
+	for (i = 0; i < m_AnimOverlay.Count(); i++)
+	{
+		CAnimationLayer &pLayer = m_AnimOverlay[i];
+		if( (pLayer.m_flWeight > 0) && pLayer.IsActive() && pLayer.m_nOrder >= 0 && pLayer.m_nOrder < m_AnimOverlay.Count())
+		{
+			layer[pLayer.m_nOrder] = i;
+		}
+	}
+	for (i = 0; i < m_AnimOverlay.Count(); i++)
+	{
+		if (layer[i] >= 0 && layer[i] < m_AnimOverlay.Count())
+		{
+			CAnimationLayer &pLayer = m_AnimOverlay[layer[i]];
+			if ( !key.AddLayer( pLayer.m_nSequence, pLayer.m_flCycle, pLayer.m_flWeight ) )
+				return false;
+		}
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: zero's out all non-restore safe fields
 // Output :
@@ -215,6 +215,18 @@ bool CServerNetworkProperty::IsInPVS( const edict_t *pRecipient, const void *pvs
 }
 
 
+//-----------------------------------------------------------------------------
+// Areas are connected when they share a flood number in the client's snapshot.
+// CheckAreasConnected reads the engine's current flood state, which belongs to
+// whichever client set up visibility last once clients run CheckTransmit after
+// all of their setups.
+//-----------------------------------------------------------------------------
+static inline bool AreSnapshotAreasConnected( const CCheckTransmitInfo *pInfo, int nArea1, int nArea2 )
+{
+	Assert( nArea1 < pInfo->m_nMapAreas && nArea2 < pInfo->m_nMapAreas );
+	return pInfo->m_AreaFloodNums[nArea1] == pInfo->m_AreaFloodNums[nArea2];
+}
+
 //-----------------------------------------------------------------------------
 // PVS: this function is called a lot, so it avoids function calls
 //-----------------------------------------------------------------------------
@@ -231,7 +243,7 @@ bool CServerNetworkProperty::IsInPVS( const CCheckTransmitInfo *pInfo )
 		for ( i=0; i< pInfo->m_AreasNetworked; i++ )
 		{
 			int clientArea = pInfo->m_Areas[i];
-			if ( clientArea == m_PVSInfo.m_nAreaNum || engine->CheckAreasConnected( clientArea, m_PVSInfo.m_nAreaNum ) )
+			if ( clientArea == m_PVSInfo.m_nAreaNum || AreSnapshotAreasConnected( pInfo, clientArea, m_PVSInfo.m_nAreaNum ) )
 				break;
 		}
 	}
@@ -245,10 +257,10 @@ bool CServerNetworkProperty::IsInPVS( const CCheckTransmitInfo *pInfo )
 			if ( clientArea == m_PVSInfo.m_nAreaNum || clientArea == m_PVSInfo.m_nAreaNum2 )
 				break;
 
-			if ( engine->CheckAreasConnected( clientArea, m_PVSInfo.m_nAreaNum ) )
+			if ( AreSnapshotAreasConnected( pInfo, clientArea, m_PVSInfo.m_nAreaNum ) )
 				break;
 
-			if ( engine->CheckAreasConnected( clientArea, m_PVSInfo.m_nAreaNum2 ) )
+			if ( AreSnapshotAreasConnected( pInfo, clientArea, m_PVSInfo.m_nAreaNum2 ) )
 				break;
 		}
 	}
@@ -259,6 +271,41 @@ bool CServerNetworkProperty::IsInPVS( const CCheckTransmitInfo *pInfo )
 		return false;
 	}
 
+	return IsInClusterPVS( pInfo );
+}
+
+
+//-----------------------------------------------------------------------------
+// PVS: same as above, but the area test is a lookup in a bitmask of every area
+// connected to one of the client's networked areas
+//-----------------------------------------------------------------------------
+bool CServerNetworkProperty::IsInPVS( const CCheckTransmitInfo *pInfo, const byte *pConnectedAreas )
+{
+	// PVS data must be up to date
+	Assert( !m_pPev || ( ( m_pPev->m_fStateFlags & FL_EDICT_DIRTY_PVS_INFORMATION ) == 0 ) );
+
+	int nArea = m_PVSInfo.m_nAreaNum;
+	if ( !( pConnectedAreas[nArea >> 3] & BitVec_BitInByte( nArea ) ) )
+	{
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		nArea = m_PVSInfo.m_nAreaNum2;
+		if ( !nArea || !( pConnectedAreas[nArea >> 3] & BitVec_BitInByte( nArea ) ) )
+		{
+			// areas not connected
+			return false;
+		}
+	}
+
+	return IsInClusterPVS( pInfo );
+}
+
+
+//-----------------------------------------------------------------------------
+// PVS: tests the entity's clusters against the client's PVS, ignoring areas
+//-----------------------------------------------------------------------------
+bool CServerNetworkProperty::IsInClusterPVS( const CCheckTransmitInfo *pInfo )
+{
 	// ignore if not touching a PV leaf
 	// negative leaf count is a node number
 	// If no pvs, add any entity
@@ -272,7 +319,7 @@ bool CServerNetworkProperty::IsInPVS( const CCheckTransmitInfo *pInfo )
 		return (engine->CheckHeadnodeVisible( m_PVSInfo.m_nHeadNode, pPVS, pInfo->m_nPVSSize ) != 0);
 	}
 	
-	for ( i = m_PVSInfo.m_nClusterCount; --i >= 0; )
+	for ( int i = m_PVSInfo.m_nClusterCount; --i >= 0; )
 	{
 		int nCluster = m_PVSInfo.m_pClusters[i];
 		if ( ((int)(pPVS[nCluster >> 3])) & BitVec_BitInByte( nCluster ) )
@@ -89,9 +89,12 @@ public:
 	// You can use this to override any entity's ShouldTransmit behavior.
 	// void SetTransmitProxy( CBaseTransmitProxy *pProxy );
 
-	// This version does a PVS check which also checks for connected areas
+	// This version does a PVS check which also checks for connected areas, as of the client's snapshot
 	bool IsInPVS( const CCheckTransmitInfo *pInfo );
 
+	// This version checks areas against a bitmask of the areas connected to the client's networked areas
+	bool IsInPVS( const CCheckTransmitInfo *pInfo, const byte *pConnectedAreas );
+
 	// This version doesn't do the area check
 	bool IsInPVS( const edict_t *pRecipient, const void *pvs, int pvssize );
 
@@ -104,6 +107,9 @@ public:
 private:
 	// Detaches the edict.. should only be called by CBaseNetworkable's destructor.
 	void DetachEdict();
+
+	// The cluster half of the PVS checks
+	bool IsInClusterPVS( const CCheckTransmitInfo *pInfo );
 	CBaseEntity *GetOuter();
 
 	// Marks the networkable that it will should transmit
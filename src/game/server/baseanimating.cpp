@@ -1753,6 +1753,54 @@ void CBaseAnimating::BuildMatricesWithBoneMerge(
 ConVar sv_pvsskipanimation( "sv_pvsskipanimation", "1", FCVAR_ARCHIVE, "Skips SetupBones when npc's are outside the PVS" );
 ConVar ai_setupbones_debug( "ai_setupbones_debug", "0", 0, "Shows that bones that are setup every think" );
 
+static void PoseCacheSizeChangedCallback( IConVar *var, const char *pOldValue, float flOldValue );
+ConVar sv_posecache_size( "sv_posecache_size", "0", 0, "Size in KB of the cache that lets entities in identical poses share bone setup. 0 disables it.", true, 0, true, 65536, PoseCacheSizeChangedCallback );
+
+static void PoseCacheSizeChangedCallback( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	Studio_SetPoseCacheSize( sv_posecache_size.GetInt() * 1024 );
+}
+
+CON_COMMAND( sv_posecache_stats, "Shows hit rate and memory use of the bone setup pose cache. Pass 'reset' to clear the counters." )
+{
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		Studio_ResetPoseCacheStats();
+		return;
+	}
+
+	posecachestats_t stats;
+	Studio_GetPoseCacheStats( stats );
+
+	int nLookups = stats.hits + stats.misses;
+	Msg( "Pose cache: %d hits, %d misses (%.1f%% hit rate), %d stores\n", 
+		stats.hits, stats.misses, nLookups ? 100.0f * stats.hits / nLookups : 0.0f, stats.stores );
+	Msg( "  %d indexed entries, %u / %u KB used, generation %d\n", 
+		stats.entries, stats.usedBytes / 1024, stats.targetBytes / 1024, stats.generation );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sizes the pose cache on startup and empties it when models may go away
+//-----------------------------------------------------------------------------
+class CPoseCacheSystem : public CAutoGameSystem
+{
+public:
+	CPoseCacheSystem() : CAutoGameSystem( "CPoseCacheSystem" ) {}
+
+	virtual bool Init()
+	{
+		Studio_SetPoseCacheSize( sv_posecache_size.GetInt() * 1024 );
+		return true;
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		Studio_InvalidatePoseCache();
+	}
+};
+
+static CPoseCacheSystem g_PoseCacheSystem;
+
 
 
 
@@ -1803,6 +1851,16 @@ void CBaseAnimating::SetupBones( matrix3x4_t *pBoneToWorld, int boneMask )
 	// adjust hit boxes based on IK driven offset
 	Vector adjOrigin = GetAbsOrigin() + Vector( 0, 0, m_flEstIkOffset );
 
+	if ( SetupBonesFromPoseCache( pStudioHdr, pBoneToWorld, boneMask, adjOrigin ) )
+	{
+		if (ai_setupbones_debug.GetBool())
+		{
+			DrawRawSkeleton( pBoneToWorld, boneMask, true, 0.11 );
+		}
+		RemoveEFlags( EFL_SETTING_UP_BONES );
+		return;
+	}
+
 	if ( CanSkipAnimation() )
 	{
 		IBoneSetup boneSetup( pStudioHdr, boneMask, GetPoseParameterArray() );
@@ -1830,7 +1888,7 @@ void CBaseAnimating::SetupBones( matrix3x4_t *pBoneToWorld, int boneMask )
 		}
 	}
 	
-	CBaseAnimating *pParent = dynamic_cast< CBaseAnimating* >( GetMoveParent() );
+	CBaseAnimating *pParent = GetMoveParent() ? GetMoveParent()->GetBaseAnimating() : NULL;
 	if ( pParent )
 	{
 		// We're doing bone merging, so do special stuff here.
@@ -1875,6 +1933,38 @@ void CBaseAnimating::SetupBones( matrix3x4_t *pBoneToWorld, int boneMask )
 	RemoveEFlags( EFL_SETTING_UP_BONES );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Builds the bones from the shared pose cache when nothing but the pose
+//			cache key affects them. Returns false if the caller has to do a full setup.
+//-----------------------------------------------------------------------------
+bool CBaseAnimating::SetupBonesFromPoseCache( CStudioHdr *pStudioHdr, matrix3x4_t *pBoneToWorld, int boneMask, const Vector &adjOrigin )
+{
+	if ( !sv_posecache_size.GetBool() )
+		return false;
+
+	// IK, bone merging and skipped animation all depend on more than the pose
+	if ( m_pIk || CanSkipAnimation() || ( GetMoveParent() && GetMoveParent()->GetBaseAnimating() ) )
+		return false;
+
+	posecachekey_t key;
+	if ( !GetPoseCacheKey( pStudioHdr, boneMask, key ) )
+		return false;
+
+	if ( Studio_BuildMatricesFromPoseCache( pStudioHdr, key, GetAbsAngles(), adjOrigin, GetModelScale(), pBoneToWorld ) )
+		return true;
+
+	Vector pos[MAXSTUDIOBONES];
+	QuaternionAligned q[MAXSTUDIOBONES];
+	GetSkeleton( pStudioHdr, pos, q, boneMask );
+
+	matrix3x4_t boneToModel[MAXSTUDIOBONES];
+	Studio_BuildMatrices( pStudioHdr, vec3_angle, vec3_origin, pos, q, -1, 1.0f, boneToModel, boneMask );
+	Studio_AddToPoseCache( pStudioHdr, key, boneToModel );
+
+	Studio_TransformBoneToModel( pStudioHdr, boneMask, GetAbsAngles(), adjOrigin, GetModelScale(), boneToModel, pBoneToWorld );
+	return true;
+}
+
 //=========================================================
 //=========================================================
 int CBaseAnimating::GetNumBones ( void )
@@ -2496,6 +2586,8 @@ void CBaseAnimating::SetModel( const char *szModelName )
 {
 	MDLCACHE_CRITICAL_SECTION();
 
+	const studiohdr_t *pOldStudioHdr = m_pStudioHdr ? m_pStudioHdr->GetRenderHdr() : NULL;
+
 	// delete exiting studio model container
 	UnlockStudioHdr();
 	delete m_pStudioHdr;
@@ -2519,6 +2611,13 @@ void CBaseAnimating::SetModel( const char *szModelName )
 
 	UTIL_SetModel( this, szModelName );
 
+	// Poses are keyed on the studio header, so drop them if this entity's model was swapped out
+	CStudioHdr *pNewStudioHdr = GetModelPtr();
+	if ( pOldStudioHdr && ( !pNewStudioHdr || pNewStudioHdr->GetRenderHdr() != pOldStudioHdr ) )
+	{
+		Studio_InvalidatePoseCache();
+	}
+
 	InitBoneControllers( );
 	SetSequence( 0 );
 	
@@ -2830,6 +2929,19 @@ void CBaseAnimating::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaterni
 	boneSetup.CalcBoneAdj( pos, q, GetEncodedControllerArray() );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Everything the GetSkeleton above reads, apart from time
+//-----------------------------------------------------------------------------
+bool CBaseAnimating::GetPoseCacheKey( CStudioHdr *pStudioHdr, int boneMask, posecachekey_t &key )
+{
+	// Autoplay sequences are driven by time
+	if ( !pStudioHdr->SequencesAvailable() || pStudioHdr->CountAutoplaySequences() )
+		return false;
+
+	key.Init( pStudioHdr, GetSequence(), GetCycle(), boneMask, GetPoseParameterArray(), GetEncodedControllerArray() );
+	return true;
+}
+
 int CBaseAnimating::DrawDebugTextOverlays(void) 
 {
 	int text_offset = BaseClass::DrawDebugTextOverlays();
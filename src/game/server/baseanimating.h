@@ -19,6 +19,7 @@
 
 struct animevent_t;
 struct matrix3x4_t;
+struct posecachekey_t;
 class CIKContext;
 class KeyValues;
 FORWARD_DECLARE_HANDLE( memhandle_t );
@@ -132,6 +133,8 @@ public:
 	virtual bool CanBecomeRagdoll( void ); //Check if this entity will ragdoll when dead.
 
 	virtual	void GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaternion q[], int boneMask );
+	// Describes everything GetSkeleton depends on. Returns false if the pose can't be shared through the pose cache.
+	virtual bool GetPoseCacheKey( CStudioHdr *pStudioHdr, int boneMask, posecachekey_t &key );
 
 	virtual void GetBoneTransform( int iBone, matrix3x4_t &pBoneToWorld );
 	virtual void SetupBones( matrix3x4_t *pBoneToWorld, int boneMask );
@@ -342,6 +345,7 @@ private:
 	void InputSetModelScale( inputdata_t &inputdata );
 
 	bool CanSkipAnimation( void );
+	bool SetupBonesFromPoseCache( CStudioHdr *pStudioHdr, matrix3x4_t *pBoneToWorld, int boneMask, const Vector &adjOrigin );
 
 public:
 	CNetworkVar( int, m_nForceBone );
@@ -62,6 +62,7 @@
 #include "env_debughistory.h"
 #include "tier1/utlstring.h"
 #include "utlhashtable.h"
+#include "tier1/utlflathashmap.h"
 
 #if defined( TF_DLL )
 #include "tf_gamerules.h"
@@ -92,6 +93,10 @@ CBasePlayer *CBaseEntity::m_pPredictionPlayer = NULL;
 // Used to make sure nobody calls UpdateTransmitState directly.
 int g_nInsideDispatchUpdateTransmitState = 0;
 
+// Set while the engine runs CheckTransmit for several clients at once. Transmit states
+// were brought up to date beforehand, so DispatchUpdateTransmitState only reads them.
+bool g_bTransmitStateFrozen = false;
+
 // When this is false, throw an assert in debug when GetAbsAnything is called. Used when hierachy is incomplete/invalid.
 bool CBaseEntity::s_bAbsQueriesValid = true;
 
@@ -3186,6 +3191,11 @@ int CBaseEntity::Restore( IRestore &restore )
 	// loops through the data description list, restoring each data desc block in order
 	int status = RestoreDataDescBlock( restore, GetDataDescMap() );
 
+	if ( m_iName != NULL_STRING )
+	{
+		gEntList.NotifyEntityNameChanged();
+	}
+
 	// ---------------------------------------------------------------
 	// HACKHACK: We don't know the space of these vectors until now
 	// if they are worldspace, fix them up.
@@ -3555,7 +3565,7 @@ int CBaseEntity::UpdateTransmitState()
 int CBaseEntity::DispatchUpdateTransmitState()
 {
 	edict_t *ed = edict();
-	if ( m_nTransmitStateOwnedCounter != 0 )
+	if ( m_nTransmitStateOwnedCounter != 0 || g_bTransmitStateFrozen )
 		return ed ? ed->m_fStateFlags : 0;
 	
 	g_nInsideDispatchUpdateTransmitState++;
@@ -3709,6 +3719,18 @@ void CBaseEntity::ComputeWorldSpaceSurroundingBox( Vector *pMins, Vector *pMaxs
 }
 
 
+void CBaseEntity::SetName( string_t newName )
+{
+	// UTIL_Remove clears the name of every entity it removes, unnamed ones
+	// shouldn't invalidate the name cache
+	if ( IDENT_STRINGS( m_iName, newName ) )
+		return;
+
+	m_iName = newName;
+	gEntList.NotifyEntityNameChanged();
+}
+
+
 //------------------------------------------------------------------------------
 // Purpose : If name exists returns name, otherwise returns classname
 // Input   :
@@ -3864,6 +3886,69 @@ void CBaseEntity::OnEntityEvent( EntityEvent_t event, void *pEventData )
 ConVar ent_messages_draw( "ent_messages_draw", "0", FCVAR_CHEAT, "Visualizes all entity input/output activity." );
 
 
+//-----------------------------------------------------------------------------
+// Input lookups are cached per most derived datamap. Datamaps are static, so
+// entries never go stale; only inputs that exist are cached since the name
+// passed in may not outlive the call.
+//-----------------------------------------------------------------------------
+struct InputDescKey_t
+{
+	datamap_t	*m_pMap;
+	const char	*m_pszName;
+};
+
+struct InputDescKeyHashFunctor
+{
+	unsigned int operator()( const InputDescKey_t &key ) const
+	{
+		return CaselessStringHashFunctor()( key.m_pszName ) ^ Mix64HashFunctor()( (uint64)(uintp)key.m_pMap );
+	}
+};
+
+struct InputDescKeyEqualFunctor
+{
+	bool operator()( const InputDescKey_t &a, const InputDescKey_t &b ) const
+	{
+		return a.m_pMap == b.m_pMap && !Q_stricmp( a.m_pszName, b.m_pszName );
+	}
+};
+
+static CUtlFlatHashMap< InputDescKey_t, typedescription_t *, InputDescKeyHashFunctor, InputDescKeyEqualFunctor > s_InputDescCache;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the data description of the named input, NULL if we don't have one.
+//-----------------------------------------------------------------------------
+typedescription_t *CBaseEntity::FindInput( const char *szInputName )
+{
+	InputDescKey_t key;
+	key.m_pMap = GetDataDescMap();
+	key.m_pszName = szInputName;
+
+	UtlFlatHashHandle_t h = s_InputDescCache.Find( key );
+	if ( h != s_InputDescCache.InvalidHandle() )
+		return s_InputDescCache[h];
+
+	for ( datamap_t *dmap = key.m_pMap; dmap != NULL; dmap = dmap->baseMap )
+	{
+		// search through all the actions in the data description, looking for a match
+		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		{
+			if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
+			{
+				if ( !Q_stricmp(dmap->dataDesc[i].externalName, szInputName) )
+				{
+					key.m_pszName = dmap->dataDesc[i].externalName;
+					s_InputDescCache.Insert( key, &dmap->dataDesc[i] );
+					return &dmap->dataDesc[i];
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: calls the appropriate message mapped function in the entity according
 //			to the fired action.
@@ -3886,86 +3971,77 @@ bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator,
 		NDebugOverlay::Box( GetAbsOrigin(), Vector(-4, -4, -4), Vector(4, 4, 4), 0, 255, 0, 0, 3 );
 	}
 
-	// loop through the data description list, restoring each data desc block
-	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+	typedescription_t *pInput = FindInput( szInputName );
+	if ( pInput )
 	{
-		// search through all the actions in the data description, looking for a match
-		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		// mapper debug message
+		if ( SHOULD_LOG_ENTITY_IO() )
 		{
-			if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
+			char szBuffer[256];
+			if (pCaller != NULL)
 			{
-				if ( !Q_stricmp(dmap->dataDesc[i].externalName, szInputName) )
-				{
-					// found a match
-
-					char szBuffer[256];
-					// mapper debug message
-					if (pCaller != NULL)
-					{
-						Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, STRING(pCaller->m_iName), GetDebugName(), szInputName, Value.String() );
-					}
-					else
-					{
-						Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input <NULL>: %s.%s(%s)\n", gpGlobals->curtime, GetDebugName(), szInputName, Value.String() );
-					}
-					DevMsg( 2, "%s", szBuffer );
-					ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
-
-					if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
-					{
-						DrawInputOverlay(szInputName,pCaller,Value);
-					}
+				Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, STRING(pCaller->m_iName), GetDebugName(), szInputName, Value.String() );
+			}
+			else
+			{
+				Q_snprintf( szBuffer, sizeof(szBuffer), "(%0.2f) input <NULL>: %s.%s(%s)\n", gpGlobals->curtime, GetDebugName(), szInputName, Value.String() );
+			}
+			DevMsg( 2, "%s", szBuffer );
+			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+		}
 
-					// convert the value if necessary
-					if ( Value.FieldType() != dmap->dataDesc[i].fieldType )
-					{
-						if ( !(Value.FieldType() == FIELD_VOID && dmap->dataDesc[i].fieldType == FIELD_STRING) ) // allow empty strings
-						{
-							if ( !Value.Convert( (fieldtype_t)dmap->dataDesc[i].fieldType ) )
-							{
-								// bad conversion
-								Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
-									STRING(m_iClassname), GetDebugName(), szInputName, 
-									( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
-									( pCaller != NULL ) ? STRING(pCaller->m_iName) : "<null>" );
-								return false;
-							}
-						}
-					}
+		if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
+		{
+			DrawInputOverlay(szInputName,pCaller,Value);
+		}
 
-					// call the input handler, or if there is none just set the value
-					inputfunc_t pfnInput = dmap->dataDesc[i].inputFunc;
+		// convert the value if necessary
+		if ( Value.FieldType() != pInput->fieldType )
+		{
+			if ( !(Value.FieldType() == FIELD_VOID && pInput->fieldType == FIELD_STRING) ) // allow empty strings
+			{
+				if ( !Value.Convert( (fieldtype_t)pInput->fieldType ) )
+				{
+					// bad conversion
+					Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
+						STRING(m_iClassname), GetDebugName(), szInputName, 
+						( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+						( pCaller != NULL ) ? STRING(pCaller->m_iName) : "<null>" );
+					return false;
+				}
+			}
+		}
 
-					if ( pfnInput )
-					{ 
-						// Package the data into a struct for passing to the input handler.
-						inputdata_t data;
-						data.pActivator = pActivator;
-						data.pCaller = pCaller;
-						data.value = Value;
-						data.nOutputID = outputID;
+		// call the input handler, or if there is none just set the value
+		inputfunc_t pfnInput = pInput->inputFunc;
 
-						(this->*pfnInput)( data );
-					}
-					else if ( dmap->dataDesc[i].flags & FTYPEDESC_KEY )
-					{
-						// set the value directly
-						Value.SetOther( ((char*)this) + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ]);
-					
-						// TODO: if this becomes evil and causes too many full entity updates, then we should make
-						// a macro like this:
-						//
-						// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
-						//
-						// Then the datadesc points at that function and we call it here. The only pain is to add
-						// that function for all the DEFINE_INPUT calls.
-						NetworkStateChanged();
-					}
+		if ( pfnInput )
+		{ 
+			// Package the data into a struct for passing to the input handler.
+			inputdata_t data;
+			data.pActivator = pActivator;
+			data.pCaller = pCaller;
+			data.value = Value;
+			data.nOutputID = outputID;
 
-					return true;
-				}
-			}
+			(this->*pfnInput)( data );
+		}
+		else if ( pInput->flags & FTYPEDESC_KEY )
+		{
+			// set the value directly
+			Value.SetOther( ((char*)this) + pInput->fieldOffset[ TD_OFFSET_NORMAL ]);
+		
+			// TODO: if this becomes evil and causes too many full entity updates, then we should make
+			// a macro like this:
+			//
+			// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
+			//
+			// Then the datadesc points at that function and we call it here. The only pain is to add
+			// that function for all the DEFINE_INPUT calls.
+			NetworkStateChanged();
 		}
+
+		return true;
 	}
 
 	DevMsg( 2, "unhandled input: (%s) -> (%s,%s)\n", szInputName, STRING(m_iClassname), GetDebugName()/*,", from (%s,%s)" STRING(pCaller->m_iClassname), STRING(pCaller->m_iName)*/ );
@@ -636,6 +636,7 @@ public:
 	// handles an input (usually caused by outputs)
 	// returns true if the the value in the pass in should be set, false if the input is to be ignored
 	virtual bool AcceptInput( const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID );
+	typedescription_t *FindInput( const char *szInputName );
 
 	//
 	// Input handlers.
@@ -1940,11 +1941,6 @@ inline string_t CBaseEntity::GetEntityName()
 	return m_iName; 
 }
 
-inline void CBaseEntity::SetName( string_t newName )
-{
-	m_iName = newName;
-}
-
 
 inline bool CBaseEntity::NameMatches( const char *pszNameOrWildcard )
 {
@@ -84,6 +84,8 @@ OUTPUTS:
 #include "tier1/strtools.h"
 #include "datacache/imdlcache.h"
 #include "env_debughistory.h"
+#include "tier1/utlflathashmap.h"
+#include "tier1/generichash.h"
 
 #include "tier0/vprof.h"
 
@@ -275,45 +277,49 @@ void CBaseEntityOutput::FireOutput(variant_t Value, CBaseEntity *pActivator, CBa
 			g_EventQueue.AddEvent( STRING(ev->m_iTarget), STRING(ev->m_iTargetInput), ValueOverride, ev->m_flDelay, pActivator, pCaller, ev->m_iIDStamp );
 		}
 
-		if ( ev->m_flDelay )
+		// Don't format trace lines nobody will see
+		if ( SHOULD_LOG_ENTITY_IO() )
 		{
-			char szBuffer[256];
-			Q_snprintf( szBuffer,
-						sizeof(szBuffer),
-						"(%0.2f) output: (%s,%s) -> (%s,%s,%.1f)(%s)\n",
+			if ( ev->m_flDelay )
+			{
+				char szBuffer[256];
+				Q_snprintf( szBuffer,
+							sizeof(szBuffer),
+							"(%0.2f) output: (%s,%s) -> (%s,%s,%.1f)(%s)\n",
 #ifdef TF_DLL
-						engine->GetServerTime(),
+							engine->GetServerTime(),
 #else
-						gpGlobals->curtime,
+							gpGlobals->curtime,
 #endif
-						pCaller ? STRING(pCaller->m_iClassname) : "NULL",
-						pCaller ? STRING(pCaller->GetEntityName()) : "NULL",
-						STRING(ev->m_iTarget),
-						STRING(ev->m_iTargetInput),
-						ev->m_flDelay,
-						STRING(ev->m_iParameter) );
+							pCaller ? STRING(pCaller->m_iClassname) : "NULL",
+							pCaller ? STRING(pCaller->GetEntityName()) : "NULL",
+							STRING(ev->m_iTarget),
+							STRING(ev->m_iTargetInput),
+							ev->m_flDelay,
+							STRING(ev->m_iParameter) );
 
-			DevMsg( 2, "%s", szBuffer );
-			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
-		}
-		else
-		{
-			char szBuffer[256];
-			Q_snprintf( szBuffer,
-						sizeof(szBuffer),
-						"(%0.2f) output: (%s,%s) -> (%s,%s)(%s)\n",
+				DevMsg( 2, "%s", szBuffer );
+				ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+			}
+			else
+			{
+				char szBuffer[256];
+				Q_snprintf( szBuffer,
+							sizeof(szBuffer),
+							"(%0.2f) output: (%s,%s) -> (%s,%s)(%s)\n",
 #ifdef TF_DLL
-						engine->GetServerTime(),
+							engine->GetServerTime(),
 #else
-						gpGlobals->curtime,
+							gpGlobals->curtime,
 #endif
-						pCaller ? STRING(pCaller->m_iClassname) : "NULL",
-						pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget),
-						STRING(ev->m_iTargetInput),
-						STRING(ev->m_iParameter) );
+							pCaller ? STRING(pCaller->m_iClassname) : "NULL",
+							pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget),
+							STRING(ev->m_iTargetInput),
+							STRING(ev->m_iParameter) );
 
-			DevMsg( 2, "%s", szBuffer );
-			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+				DevMsg( 2, "%s", szBuffer );
+				ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+			}
 		}
 
 		if ( pCaller && pCaller->m_debugOverlays & OVERLAY_MESSAGE_BIT)
@@ -331,10 +337,13 @@ void CBaseEntityOutput::FireOutput(variant_t Value, CBaseEntity *pActivator, CBa
 			ev->m_nTimesToFire--;
 			if (ev->m_nTimesToFire == 0)
 			{
-				char szBuffer[256];
-				Q_snprintf( szBuffer, sizeof(szBuffer), "Removing from action list: (%s,%s) -> (%s,%s)\n", pCaller ? STRING(pCaller->m_iClassname) : "NULL", pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget), STRING(ev->m_iTargetInput));
-				DevMsg( 2, "%s", szBuffer );
-				ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+				if ( SHOULD_LOG_ENTITY_IO() )
+				{
+					char szBuffer[256];
+					Q_snprintf( szBuffer, sizeof(szBuffer), "Removing from action list: (%s,%s) -> (%s,%s)\n", pCaller ? STRING(pCaller->m_iClassname) : "NULL", pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget), STRING(ev->m_iTargetInput));
+					DevMsg( 2, "%s", szBuffer );
+					ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+				}
 				bRemove = true;
 			}
 		}
@@ -642,10 +651,202 @@ DEFINE_FIXEDSIZE_ALLOCATOR( EventQueuePrioritizedEvent_t, 128, CUtlMemoryPool::G
 
 CEventQueue g_EventQueue;
 
+ConVar ent_io_cache( "ent_io_cache", "1", FCVAR_NONE, "Cache which entities an entity I/O target name resolves to, rather than searching the entity list every time an event fires." );
+ConVar ent_io_profile( "ent_io_profile", "0", FCVAR_NONE, "Time every entity I/O event the queue fires, see ent_io_profile_report." );
+
+//-----------------------------------------------------------------------------
+// Entities an event target name resolved to, in entity list order, as of a
+// name generation. Renaming or naming any entity bumps the generation and the
+// list is rebuilt on next use; entities that have gone away drop out of the
+// handles on their own.
+//-----------------------------------------------------------------------------
+struct EventTargetList_t
+{
+	CUtlString m_Name;
+	int m_nGeneration;
+	CUtlVector<EHANDLE> m_Targets;
+};
+
+// Keyed by the list's own copy of the name
+static CUtlFlatHashMap< const char *, EventTargetList_t *, CaselessStringHashFunctor, CaselessStringEqualFunctor > s_EventTargetCache;
+
+static int s_nEventTargetCacheHits;
+static int s_nEventTargetCacheRebuilds;
+static int s_nEventQueueFastInserts;
+
+// Procedural names depend on who is asking, so they are searched for every time
+static inline bool IsCacheableTargetName( const char *pszName )
+{
+	return pszName[0] && pszName[0] != '!';
+}
+
+static EventTargetList_t *GetEventTargets( const char *pszName )
+{
+	EventTargetList_t *pList;
+	UtlFlatHashHandle_t h = s_EventTargetCache.Find( pszName );
+	if ( h != s_EventTargetCache.InvalidHandle() )
+	{
+		pList = s_EventTargetCache[h];
+	}
+	else
+	{
+		pList = new EventTargetList_t;
+		pList->m_Name = pszName;
+		pList->m_nGeneration = gEntList.GetNameGeneration() - 1;
+		s_EventTargetCache.Insert( pList->m_Name.Get(), pList );
+	}
+
+	if ( pList->m_nGeneration == gEntList.GetNameGeneration() )
+	{
+		++s_nEventTargetCacheHits;
+		return pList;
+	}
+
+	++s_nEventTargetCacheRebuilds;
+	pList->m_Targets.RemoveAll();
+	for ( CBaseEntity *pTarget = gEntList.FindEntityByName( NULL, pszName ); pTarget; pTarget = gEntList.FindEntityByName( pTarget, pszName ) )
+	{
+		pList->m_Targets.AddToTail( pTarget );
+	}
+	pList->m_nGeneration = gEntList.GetNameGeneration();
+
+	return pList;
+}
+
+//-----------------------------------------------------------------------------
+// Per connection timings for ent_io_profile. Connections are told apart by
+// caller, target and input rather than the output ID, which is 0 for every
+// event fired from code or ent_fire.
+//-----------------------------------------------------------------------------
+struct MapIOProfileKey_t
+{
+	uint32		m_hCaller;
+	uint32		m_hTarget;		// Set when the event targets an entity directly
+	const char	*m_pszTarget;	// Pooled target name otherwise
+	const char	*m_pszInput;	// Pooled input name
+};
+
+struct MapIOProfileKeyHashFunctor
+{
+	unsigned int operator()( const MapIOProfileKey_t &key ) const
+	{
+		return HashBlock( &key, sizeof( key ) );
+	}
+};
+
+struct MapIOProfileKeyEqualFunctor
+{
+	bool operator()( const MapIOProfileKey_t &a, const MapIOProfileKey_t &b ) const
+	{
+		return a.m_hCaller == b.m_hCaller && a.m_hTarget == b.m_hTarget && a.m_pszTarget == b.m_pszTarget && a.m_pszInput == b.m_pszInput;
+	}
+};
+
+struct MapIOProfile_t
+{
+	char m_szCaller[64];
+	char m_szTarget[64];
+	char m_szInput[64];
+	int m_nFires;
+	int m_nTargets;
+	double m_flTime;
+	double m_flMaxTime;
+};
+
+static CUtlFlatHashMap< MapIOProfileKey_t, MapIOProfile_t, MapIOProfileKeyHashFunctor, MapIOProfileKeyEqualFunctor > s_MapIOProfile;
+
+static void RecordMapIOProfile( EventQueuePrioritizedEvent_t *pe, int nTargets, double flTime )
+{
+	MapIOProfileKey_t key;
+	V_memset( &key, 0, sizeof( key ) );
+	key.m_hCaller = pe->m_pCaller.ToInt();
+	if ( pe->m_pEntTarget.IsValid() )
+	{
+		key.m_hTarget = pe->m_pEntTarget.ToInt();
+	}
+	else
+	{
+		key.m_pszTarget = STRING( pe->m_iTarget );
+	}
+	key.m_pszInput = STRING( pe->m_iTargetInput );
+
+	bool bInserted;
+	UtlFlatHashHandle_t h = s_MapIOProfile.Insert( key, MapIOProfile_t(), &bInserted );
+	MapIOProfile_t &profile = s_MapIOProfile[h];
+	if ( bInserted )
+	{
+		V_memset( &profile, 0, sizeof( profile ) );
+		V_strncpy( profile.m_szCaller, pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "<null>", sizeof( profile.m_szCaller ) );
+		V_strncpy( profile.m_szTarget, pe->m_pEntTarget ? pe->m_pEntTarget->GetDebugName() : STRING( pe->m_iTarget ), sizeof( profile.m_szTarget ) );
+		V_strncpy( profile.m_szInput, STRING( pe->m_iTargetInput ), sizeof( profile.m_szInput ) );
+	}
+
+	profile.m_nFires++;
+	profile.m_nTargets += nTargets;
+	profile.m_flTime += flTime;
+	profile.m_flMaxTime = MAX( profile.m_flMaxTime, flTime );
+}
+
+static int MapIOProfileSortFunc( MapIOProfile_t * const *ppLeft, MapIOProfile_t * const *ppRight )
+{
+	if ( (*ppLeft)->m_flTime == (*ppRight)->m_flTime )
+		return 0;
+	return ( (*ppLeft)->m_flTime > (*ppRight)->m_flTime ) ? -1 : 1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the entity I/O connections that took the most time to fire.
+//-----------------------------------------------------------------------------
+void CC_EntIOProfileReport( const CCommand &args )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !V_stricmp( args[1], "reset" ) )
+	{
+		s_MapIOProfile.RemoveAll();
+		s_nEventTargetCacheHits = s_nEventTargetCacheRebuilds = s_nEventQueueFastInserts = 0;
+		Msg( "Entity I/O profile reset.\n" );
+		return;
+	}
+
+	int nCount = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 20;
+
+	CUtlVector< MapIOProfile_t * > sorted;
+	int nFires = 0;
+	double flTotal = 0.0;
+	FOR_EACH_FLATHASHMAP( s_MapIOProfile, h )
+	{
+		sorted.AddToTail( &s_MapIOProfile[h] );
+		nFires += s_MapIOProfile[h].m_nFires;
+		flTotal += s_MapIOProfile[h].m_flTime;
+	}
+	sorted.Sort( MapIOProfileSortFunc );
+
+	if ( !ent_io_profile.GetBool() )
+	{
+		Msg( "ent_io_profile is off, set it to 1 to gather timings.\n" );
+	}
+
+	Msg( "%d events on %d connections, %.2f ms. Target cache: %d hits, %d rebuilds. %d queue inserts skipped the search.\n",
+		 nFires, sorted.Count(), flTotal * 1000.0, s_nEventTargetCacheHits, s_nEventTargetCacheRebuilds, s_nEventQueueFastInserts );
+	Msg( "%10s %8s %10s %10s %8s  %s\n", "total ms", "fires", "avg us", "max us", "targets", "connection" );
+	for ( int i = 0; i < sorted.Count() && i < nCount; i++ )
+	{
+		const MapIOProfile_t *pProfile = sorted[i];
+		Msg( "%10.3f %8d %10.2f %10.2f %8.2f  %s -> %s.%s\n",
+			 pProfile->m_flTime * 1000.0, pProfile->m_nFires, pProfile->m_flTime * 1000000.0 / pProfile->m_nFires,
+			 pProfile->m_flMaxTime * 1000000.0, (float)pProfile->m_nTargets / pProfile->m_nFires,
+			 pProfile->m_szCaller, pProfile->m_szTarget, pProfile->m_szInput );
+	}
+}
+static ConCommand ent_io_profile_report( "ent_io_profile_report", CC_EntIOProfileReport, "Lists the entity I/O connections that took the most time to fire while ent_io_profile was on.\n\tArguments: [number of connections to list] or reset" );
+
 CEventQueue::CEventQueue()
 {
 	m_Events.m_flFireTime = -FLT_MAX;
 	m_Events.m_pNext = NULL;
+	m_pLastAdded = NULL;
 
 	Init();
 }
@@ -754,6 +955,10 @@ ISaveRestoreBlockHandler *GetEventQueueSaveRestoreBlockHandler()
 void CEventQueue::Init( void )
 {
 	Clear();
+
+	// New level, the names in the target cache and profile go away with the old one's string pool
+	s_EventTargetCache.PurgeAndDeleteElements();
+	s_MapIOProfile.Purge();
 }
 
 void CEventQueue::Clear( void )
@@ -769,6 +974,7 @@ void CEventQueue::Clear( void )
 	}
 
 	m_Events.m_pNext = NULL;
+	m_pLastAdded = NULL;
 }
 
 void CEventQueue::Dump( void )
@@ -862,9 +1068,18 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 {
+	// Everything before the last event added fires no later than it, so if the new event doesn't fire
+	// earlier either the search can start there. Events added in the same tick, zero delay outputs
+	// in particular, all share a fire time and so go in without walking the events pending after them.
+	EventQueuePrioritizedEvent_t *pe = &m_Events;
+	if ( m_pLastAdded && m_pLastAdded->m_flFireTime <= newEvent->m_flFireTime )
+	{
+		pe = m_pLastAdded;
+		++s_nEventQueueFastInserts;
+	}
+
 	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	for ( ; pe->m_pNext != NULL; pe = pe->m_pNext )
 	{
 		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
 		{
@@ -882,11 +1097,18 @@ void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 	{
 		newEvent->m_pNext->m_pPrev = newEvent;
 	}
+
+	m_pLastAdded = newEvent;
 }
 
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 {
 	Assert( pe->m_pPrev );
+	if ( pe == m_pLastAdded )
+	{
+		// the one before fires no later, so it's still a valid place to start
+		m_pLastAdded = pe->m_pPrev;
+	}
 	pe->m_pPrev->m_pNext = pe->m_pNext;
 	if ( pe->m_pNext )
 	{
@@ -915,23 +1137,59 @@ void CEventQueue::ServiceEvents( void )
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		bool bProfile = ent_io_profile.GetBool();
+		double flStart = bProfile ? Plat_FloatTime() : 0.0;
+
 		bool targetFound = false;
+		int nTargets = 0;
 
 		// find the targets
 		if ( pe->m_iTarget != NULL_STRING )
 		{
-			// In the context the event, the searching entity is also the caller
-			CBaseEntity *pSearchingEntity = pe->m_pCaller;
+			const char *pszTarget = STRING(pe->m_iTarget);
 			CBaseEntity *target = NULL;
-			while ( 1 )
+			bool bSearch = true;
+
+			if ( ent_io_cache.GetBool() && IsCacheableTargetName( pszTarget ) )
 			{
-				target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
-				if ( !target )
-					break;
+				EventTargetList_t *pTargets = GetEventTargets( pszTarget );
+				int nGeneration = gEntList.GetNameGeneration();
+				for ( int i = 0; i < pTargets->m_Targets.Count(); i++ )
+				{
+					CBaseEntity *pCached = pTargets->m_Targets[i];
+					if ( !pCached )
+						continue;
+
+					// pump the action into the target
+					target = pCached;
+					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					targetFound = true;
+					nTargets++;
 
-				// pump the action into the target
-				target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
-				targetFound = true;
+					if ( gEntList.GetNameGeneration() != nGeneration )
+						break;
+				}
+
+				// If an input named or renamed something, carry on from the last target with a
+				// live search, which is what the uncached search would have seen
+				bSearch = gEntList.GetNameGeneration() != nGeneration;
+			}
+
+			if ( bSearch )
+			{
+				// In the context the event, the searching entity is also the caller
+				CBaseEntity *pSearchingEntity = pe->m_pCaller;
+				while ( 1 )
+				{
+					target = gEntList.FindEntityByName( target, pe->m_iTarget, pSearchingEntity, pe->m_pActivator, pe->m_pCaller );
+					if ( !target )
+						break;
+
+					// pump the action into the target
+					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					targetFound = true;
+					nTargets++;
+				}
 			}
 		}
 
@@ -940,6 +1198,7 @@ void CEventQueue::ServiceEvents( void )
 		{
 			pe->m_pEntTarget->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
 			targetFound = true;
+			nTargets++;
 		}
 
 		if ( !targetFound )
@@ -957,6 +1216,7 @@ void CEventQueue::ServiceEvents( void )
 					// pump the action into the target
 					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
 					targetFound = true;
+					nTargets++;
 				}
 			}
 		}
@@ -978,6 +1238,11 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
+		if ( bProfile )
+		{
+			RecordMapIOProfile( pe, nTargets, Plat_FloatTime() - flStart );
+		}
+
 		// remove the event from the list (remembering that the queue may have been added to)
 		RemoveEvent( pe );
 		delete pe;
@@ -998,6 +1263,52 @@ void CEventQueue::ServiceEvents( void )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Resolves the target entities and inputs of every output connection
+//			in the map, so the first time each one fires costs no more than
+//			the rest.
+//-----------------------------------------------------------------------------
+void CEventQueue::PrecompileConnections( void )
+{
+	if ( !ent_io_cache.GetBool() )
+		return;
+
+	VPROF( "CEventQueue::PrecompileConnections" );
+
+	int nConnections = 0;
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity != NULL; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		for ( datamap_t *dmap = pEntity->GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+		{
+			for ( int i = 0; i < dmap->dataNumFields; i++ )
+			{
+				if ( !( dmap->dataDesc[i].flags & FTYPEDESC_OUTPUT ) )
+					continue;
+
+				CBaseEntityOutput *pOutput = (CBaseEntityOutput *)( (char *)pEntity + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ] );
+				for ( CEventAction *ev = pOutput->GetFirstAction(); ev != NULL; ev = ev->m_pNext )
+				{
+					nConnections++;
+
+					if ( ev->m_iTarget == NULL_STRING || !IsCacheableTargetName( STRING(ev->m_iTarget) ) )
+						continue;
+
+					EventTargetList_t *pTargets = GetEventTargets( STRING(ev->m_iTarget) );
+					for ( int j = 0; j < pTargets->m_Targets.Count(); j++ )
+					{
+						if ( pTargets->m_Targets[j] )
+						{
+							pTargets->m_Targets[j]->FindInput( STRING(ev->m_iTargetInput) );
+						}
+					}
+				}
+			}
+		}
+	}
+
+	DevMsg( "Resolved %d entity I/O connections to %d target names\n", nConnections, s_EventTargetCache.Count() );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Dumps the contents of the Entity I/O event queue to the console.
 //-----------------------------------------------------------------------------
@@ -294,6 +294,7 @@ CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
 	m_bClearingEntities = false;
+	m_nNameGeneration = 0;
 }
 
 
@@ -81,6 +81,8 @@ private:
 	bool m_bClearingEntities;
 	CUtlVector<IEntityListener *>	m_entityListeners;
 
+	int m_nNameGeneration;
+
 public:
 	IServerNetworkable* GetServerNetworkable( CBaseHandle hEnt ) const;
 	CBaseNetworkable* GetBaseNetworkable( CBaseHandle hEnt ) const;
@@ -101,6 +103,11 @@ public:
 
 	// Returns true while in the Clear() call.
 	bool	IsClearingEntities()	{return m_bClearingEntities;}
+
+	// Bumped whenever an entity's targetname is set, so cached name lookups know to redo themselves.
+	// Entities going away don't bump it, cached lookups hold handles for that.
+	void	NotifyEntityNameChanged()	{ ++m_nNameGeneration; }
+	int		GetNameGeneration() const	{ return m_nNameGeneration; }
 	
 	// add a class that gets notified of entity events
 	void AddListenerEntity( IEntityListener *pListener );
@@ -73,6 +73,8 @@ public:
 
 	fieldtype_t ValueFieldType() { return m_Value.FieldType(); }
 
+	CEventAction *GetFirstAction() { return m_ActionList; }
+
 	void FireOutput( variant_t Value, CBaseEntity *pActivator, CBaseEntity *pCaller, float fDelay = 0 );
 
 	/// Delete every single action in the action list. 
@@ -27,8 +27,11 @@ enum debughistorycategories_t
 
 #if defined(DISABLE_DEBUG_HISTORY)
 #define ADD_DEBUG_HISTORY( category, line )		((void)0)
+// Entity I/O trace lines then only go to DevMsg( 2, ... ), don't format them unless it prints
+#define SHOULD_LOG_ENTITY_IO()					( developer.GetInt() >= 2 )
 #else
 #define ADD_DEBUG_HISTORY( category, line )		AddDebugHistoryLine( category, line )
+#define SHOULD_LOG_ENTITY_IO()					true
 void AddDebugHistoryLine( int iCategory, const char *pszLine );
 #endif
 
@@ -51,6 +51,9 @@ public:
 	// services the queue, firing off any events who's time hath come
 	void ServiceEvents( void );
 
+	// resolves the targets and inputs of every entity's output connections up front, call once the map has spawned
+	void PrecompileConnections( void );
+
 	// debugging
 	void ValidateQueue( void );
 
@@ -74,6 +77,9 @@ private:
 	DECLARE_SIMPLE_DATADESC();
 	EventQueuePrioritizedEvent_t m_Events;
 	int m_iListCount;
+
+	// the most recently added event still in the queue, where the insertion search starts when it can
+	EventQueuePrioritizedEvent_t *m_pLastAdded;
 };
 
 extern CEventQueue g_EventQueue;
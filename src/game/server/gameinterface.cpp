@@ -72,6 +72,7 @@
 #include "ienginevgui.h"
 #endif
 #include "ragdoll_shared.h"
+#include "bone_setup.h"
 #include "toolframework/iserverenginetools.h"
 #include "sceneentity.h"
 #include "appframework/IAppSystemGroup.h"
@@ -1864,6 +1865,9 @@ bool CServerGameDLL::ShouldHideServer( void )
 //-----------------------------------------------------------------------------
 void CServerGameDLL::InvalidateMdlCache()
 {
+	// Studio headers are about to be reloaded, so no cached pose is valid any more
+	Studio_InvalidatePoseCache();
+
 	CBaseAnimating *pAnimating;
 	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity != NULL; pEntity = gEntList.NextEnt(pEntity) )
 	{
@@ -2400,8 +2404,14 @@ public:
 	virtual edict_t*		BaseEntityToEdict( CBaseEntity *pEnt );
 	virtual CBaseEntity*	EdictToBaseEntity( edict_t *pEdict );
 	virtual void			CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts );
+	virtual bool			PrepareParallelCheckTransmit( const unsigned short *pEdictIndices, int nEdicts );
+	virtual void			FinishParallelCheckTransmit();
 };
-EXPOSE_SINGLE_INTERFACE(CServerGameEnts, IServerGameEnts, INTERFACEVERSION_SERVERGAMEENTS);
+
+CServerGameEnts g_ServerGameEnts;
+// INTERFACEVERSION_SERVERGAMEENTS_VERSION_1 is compatible with the latest since we're only adding things to the end, so expose that as well.
+EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CServerGameEnts, IServerGameEnts001, INTERFACEVERSION_SERVERGAMEENTS_VERSION_1, g_ServerGameEnts );
+EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CServerGameEnts, IServerGameEnts, INTERFACEVERSION_SERVERGAMEENTS, g_ServerGameEnts );
 
 void CServerGameEnts::SetDebugEdictBase(edict_t *base)
 {
@@ -2465,6 +2475,94 @@ inline void CServerNetworkProperty::CheckTransmit( CCheckTransmitInfo *pInfo )
 	}
 } */
 
+//-----------------------------------------------------------------------------
+// Purpose: An entity passes the area half of the PVS test if its area shares a
+//			flood number with one of the client's networked areas. The engine
+//			snapshots each client's flood numbers in its pack info, so turn
+//			them into a bitmask of connected areas once and keep it until the
+//			client moves into different areas or an areaportal opens or closes.
+//-----------------------------------------------------------------------------
+struct ClientAreaMask_t
+{
+	int		m_nAreasNetworked;
+	int		m_Areas[MAX_WORLD_AREAS];
+	int		m_nMapAreas;
+	byte	m_AreaFloodNums[MAX_MAP_AREAS];
+	byte	m_ConnectedAreas[MAX_MAP_AREAS / 8];
+
+	// Only ever touched by the CheckTransmit for this client
+	int		m_nBuilds;
+	int		m_nReuses;
+};
+
+static ClientAreaMask_t s_ClientAreaMasks[ABSOLUTE_PLAYER_LIMIT + 1];
+
+static const byte *GetClientConnectedAreas( int iClient, const CCheckTransmitInfo *pInfo )
+{
+	ClientAreaMask_t &mask = s_ClientAreaMasks[iClient];
+	if ( mask.m_nAreasNetworked == pInfo->m_AreasNetworked &&
+		mask.m_nMapAreas == pInfo->m_nMapAreas &&
+		!V_memcmp( mask.m_Areas, pInfo->m_Areas, pInfo->m_AreasNetworked * sizeof( pInfo->m_Areas[0] ) ) &&
+		!V_memcmp( mask.m_AreaFloodNums, pInfo->m_AreaFloodNums, pInfo->m_nMapAreas ) )
+	{
+		++mask.m_nReuses;
+		return mask.m_ConnectedAreas;
+	}
+
+	mask.m_nAreasNetworked = pInfo->m_AreasNetworked;
+	V_memcpy( mask.m_Areas, pInfo->m_Areas, pInfo->m_AreasNetworked * sizeof( pInfo->m_Areas[0] ) );
+	mask.m_nMapAreas = pInfo->m_nMapAreas;
+	V_memcpy( mask.m_AreaFloodNums, pInfo->m_AreaFloodNums, pInfo->m_nMapAreas );
+
+	V_memset( mask.m_ConnectedAreas, 0, sizeof( mask.m_ConnectedAreas ) );
+	for ( int i = 0; i < pInfo->m_AreasNetworked; i++ )
+	{
+		int nClientArea = pInfo->m_Areas[i];
+		Assert( nClientArea < pInfo->m_nMapAreas );
+		mask.m_ConnectedAreas[nClientArea >> 3] |= BitVec_BitInByte( nClientArea );
+
+		byte nFloodNum = pInfo->m_AreaFloodNums[nClientArea];
+		for ( int nArea = 0; nArea < pInfo->m_nMapAreas; nArea++ )
+		{
+			if ( pInfo->m_AreaFloodNums[nArea] == nFloodNum )
+			{
+				mask.m_ConnectedAreas[nArea >> 3] |= BitVec_BitInByte( nArea );
+			}
+		}
+	}
+
+	++mask.m_nBuilds;
+	return mask.m_ConnectedAreas;
+}
+
+void CC_PVSAreaMaskStats( const CCommand &args )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		for ( int i = 0; i < ARRAYSIZE( s_ClientAreaMasks ); i++ )
+		{
+			s_ClientAreaMasks[i].m_nBuilds = 0;
+			s_ClientAreaMasks[i].m_nReuses = 0;
+		}
+		return;
+	}
+
+	int nBuilds = 0, nReuses = 0;
+	for ( int i = 0; i < ARRAYSIZE( s_ClientAreaMasks ); i++ )
+	{
+		nBuilds += s_ClientAreaMasks[i].m_nBuilds;
+		nReuses += s_ClientAreaMasks[i].m_nReuses;
+	}
+
+	int nTotal = nBuilds + nReuses;
+	Msg( "client area masks: %d used, %d rebuilt, %d reused (%.1f%%)\n",
+		nTotal, nBuilds, nReuses, nTotal ? 100.0f * nReuses / nTotal : 0.0f );
+}
+static ConCommand sv_pvs_areamask_stats( "sv_pvs_areamask_stats", CC_PVSAreaMaskStats, "Report how often CheckTransmit rebuilt or reused each client's connected area mask. Pass 'reset' to clear." );
+
 void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts )
 {
 	// NOTE: for speed's sake, this assumes that all networkables are CBaseEntities and that the edict list
@@ -2480,10 +2578,21 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 	if ( !pRecipientEntity )
 		return;
 	
-	MDLCACHE_CRITICAL_SECTION();
+	// When the engine runs clients on job threads it already holds the cache lock on the main
+	// thread, and PrepareParallelCheckTransmit has done everything that might need it.
+	bool bLockCache = ThreadInMainThread();
+	if ( bLockCache )
+	{
+		mdlcache->BeginLock();
+	}
+
 	CBasePlayer *pRecipientPlayer = static_cast<CBasePlayer*>( pRecipientEntity );
 	const int skyBoxArea = pRecipientPlayer->m_Local.m_skybox3d.area;
 
+	// Use the area connectivity the engine snapshotted for this client rather than asking it
+	// for the current state, which by now reflects whichever client set up visibility last.
+	const byte *pConnectedAreas = GetClientConnectedAreas( pInfo->m_pClientEnt - pBaseEdict, pInfo );
+
 #ifndef _X360
 	const bool bIsHLTV = pRecipientPlayer->IsHLTV();
 	const bool bIsReplay = pRecipientPlayer->IsReplay();
@@ -2587,7 +2696,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			continue;
 		}
 
-		bool bInPVS = netProp->IsInPVS( pInfo );
+		bool bInPVS = netProp->IsInPVS( pInfo, pConnectedAreas );
 		if ( bInPVS || sv_force_transmit_ents.GetBool() )
 		{
 			// only send if entity is in PVS
@@ -2642,7 +2751,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			{
 				// Check pvs
 				check->RecomputePVSInformation();
-				bool bMoveParentInPVS = check->IsInPVS( pInfo );
+				bool bMoveParentInPVS = check->IsInPVS( pInfo, pConnectedAreas );
 				if ( bMoveParentInPVS )
 				{
 					orig->SetTransmit( pInfo, true );
@@ -2655,9 +2764,63 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 		}
 	}
 
+	if ( bLockCache )
+	{
+		mdlcache->EndLock();
+	}
+
 //	Msg("A:%i, N:%i, F: %i, P: %i\n", always, dontSend, fullCheck, PVS );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: CheckTransmit lazily recomputes PVS info and absolute positions as it
+//			touches entities, and ShouldTransmit re-evaluates transmit states, which
+//			rewrites the shared edict flags. Do all of that up front on the main
+//			thread, then freeze transmit states until FinishParallelCheckTransmit so
+//			that the per client passes only read shared entity state.
+//-----------------------------------------------------------------------------
+extern bool g_bTransmitStateFrozen;
+
+bool CServerGameEnts::PrepareParallelCheckTransmit( const unsigned short *pEdictIndices, int nEdicts )
+{
+	MDLCACHE_CRITICAL_SECTION();
+
+	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
+	for ( int i=0; i < nEdicts; i++ )
+	{
+		edict_t *pEdict = &pBaseEdict[pEdictIndices[i]];
+		if ( pEdict->m_fStateFlags & FL_EDICT_DONTSEND )
+			continue;
+
+		CServerNetworkProperty *pNetProp = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
+		while ( pNetProp )
+		{
+			CBaseEntity *pEnt = pNetProp->GetBaseEntity();
+			if ( pEnt && ( pNetProp->edict()->m_fStateFlags & FL_EDICT_FULLCHECK ) )
+			{
+				pEnt->DispatchUpdateTransmitState();
+			}
+
+			pNetProp->RecomputePVSInformation();
+
+			if ( pEnt && pEnt->IsEFlagSet( EFL_DIRTY_ABSTRANSFORM ) )
+			{
+				pEnt->CalcAbsolutePosition();
+			}
+
+			pNetProp = pNetProp->GetNetworkParent();
+		}
+	}
+
+	g_bTransmitStateFrozen = true;
+	return true;
+}
+
+void CServerGameEnts::FinishParallelCheckTransmit()
+{
+	g_bTransmitStateFrozen = false;
+}
+
 
 CServerGameClients g_ServerGameClients;
 // INTERFACEVERSION_SERVERGAMECLIENTS_VERSION_3 is compatible with the latest since we're only adding things to the end, so expose that as well.
@@ -3132,6 +3295,8 @@ float CServerGameClients::ProcessUsercmds( edict_t *player, bf_read *buf, int nu
 		return 0.0f;
 	}
 
+	g_pServerBenchmark->RecordUsercmds( pPlayer, cmds, numcmds, totalcmds, dropped_packets );
+
 	MDLCACHE_CRITICAL_SECTION();
 	pPlayer->ProcessUsercmds( cmds, numcmds, totalcmds, dropped_packets, paused );
 
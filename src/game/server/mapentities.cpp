@@ -17,6 +17,7 @@
 #include "stringregistry.h"
 #include "datacache/imdlcache.h"
 #include "world.h"
+#include "eventqueue.h"
 #include "toolframework/iserverenginetools.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -483,6 +484,8 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 
 	SpawnHierarchicalList( nEntities, pSpawnList, bActivateEntities );
 
+	g_EventQueue.PrecompileConnections();
+
 	delete [] pSpawnMapData;
 	delete [] pSpawnList;
 }
@@ -1402,9 +1402,18 @@ NavErrorType CNavMesh::GetNavDataFromFile( CUtlBuffer &outBuffer, bool *pNavData
 		// 360 has compressed NAVs
 		if ( CLZMA::IsCompressed( (unsigned char *)outBuffer.Base() ) )
 		{
+			if ( !CLZMA::IsInputValid( (unsigned char *)outBuffer.Base(), outBuffer.TellPut() ) )
+			{
+				return NAV_CORRUPT_DATA;
+			}
+
 			int originalSize = CLZMA::GetActualSize( (unsigned char *)outBuffer.Base() );
 			unsigned char *pOriginalData = new unsigned char[originalSize];
-			CLZMA::Uncompress( (unsigned char *)outBuffer.Base(), pOriginalData );
+			if ( CLZMA::Uncompress( (unsigned char *)outBuffer.Base(), pOriginalData ) != (unsigned int)originalSize )
+			{
+				delete [] pOriginalData;
+				return NAV_CORRUPT_DATA;
+			}
 			outBuffer.AssumeMemory( pOriginalData, originalSize, originalSize, CUtlBuffer::READ_ONLY );
 		}
 	}
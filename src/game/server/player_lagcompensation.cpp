@@ -10,9 +10,10 @@
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
 #include "inetchannelinfo.h"
-#include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
+#include "mathlib/ssemath.h"
 #include "tier0/vprof.h"
+#include "serverbenchmark_base.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -37,6 +38,9 @@ ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
 
+ConVar sv_unlag_rayfilter( "sv_unlag_rayfilter", "0", FCVAR_DEVELOPMENTONLY, "Only backtrack players whose rewound bounds are near the ray along the shooter's aim. Off by default: the ray ignores weapon spread, hull traces and cones, so shots that leave the aim line could miss players it skipped" );
+ConVar sv_unlag_rayfilter_tolerance( "sv_unlag_rayfilter_tolerance", "32", FCVAR_DEVELOPMENTONLY, "Extra radius added to a player's bounding sphere for sv_unlag_rayfilter, to cover hitboxes outside the bbox and melee/flame hulls" );
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -114,6 +118,317 @@ public:
 	float					m_masterCycle;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: History of one player, newest record first. Storage is allocated
+//			when the player is first recorded and sized from sv_maxunlag and the
+//			tick interval. When full the oldest record is overwritten.
+//-----------------------------------------------------------------------------
+class CLagRecordTrack
+{
+public:
+	CLagRecordTrack()
+	{
+		m_nMask = -1;
+		m_flLinkDistanceSqr = -1.0f;
+		RemoveAll();
+	}
+
+	void RemoveAll()
+	{
+		m_nHead = 0;
+		m_nCount = 0;
+		m_nContiguous = 0;
+	}
+
+	// Frees the storage, e.g. when the player leaves
+	void Purge()
+	{
+		RemoveAll();
+		m_flSimulationTimes.Purge();
+		m_flStepDistanceSqr.Purge();
+		m_Records.Purge();
+		m_nMask = -1;
+	}
+
+	// Makes room for at least nRecords records. Throws away the history if the size changes.
+	void EnsureCapacity( int nRecords )
+	{
+		int nCapacity = SmallestPowerOfTwoGreaterOrEqual( nRecords );
+		if ( nCapacity == m_nMask + 1 )
+			return;
+
+		RemoveAll();
+		m_flSimulationTimes.SetCount( nCapacity );
+		m_flStepDistanceSqr.SetCount( nCapacity );
+		m_Records.SetCount( nCapacity );
+		m_nMask = nCapacity - 1;
+	}
+
+	int Count() const
+	{
+		return m_nCount;
+	}
+
+	// Index 0 is the newest record
+	LagRecord &Element( int i )
+	{
+		Assert( i >= 0 && i < m_nCount );
+		return m_Records[ ( m_nHead + i ) & m_nMask ];
+	}
+
+	float SimulationTime( int i ) const
+	{
+		Assert( i >= 0 && i < m_nCount );
+		return m_flSimulationTimes[ ( m_nHead + i ) & m_nMask ];
+	}
+
+	LagRecord &AddToHead( float flSimulationTime )
+	{
+		Assert( m_nMask >= 0 );
+		Assert( !m_nCount || flSimulationTime > SimulationTime( 0 ) );
+
+		m_nHead = ( m_nHead - 1 ) & m_nMask;
+		m_nCount = MIN( m_nCount + 1, m_nMask + 1 );
+		m_nContiguous = MIN( m_nContiguous, m_nCount - 1 );
+		m_flSimulationTimes[ m_nHead ] = flSimulationTime;
+
+		LagRecord &record = m_Records[ m_nHead ];
+		record.m_flSimulationTime = flSimulationTime;
+		return record;
+	}
+
+	void RemoveTail()
+	{
+		Assert( m_nCount > 0 );
+		--m_nCount;
+		m_nContiguous = MIN( m_nContiguous, m_nCount );
+	}
+
+	// Call after filling in a new head record. Keeps track of how many records, starting at
+	// the head, can be backtracked to without crossing a death or a teleport. The distance
+	// each record moved is kept so a new teleport distance applies to the whole history.
+	void LinkHead( float flTeleportDistanceSqr )
+	{
+		LagRecord &head = Element( 0 );
+		float &flStepSqr = m_flStepDistanceSqr[ m_nHead ];
+		flStepSqr = ( m_nCount > 1 ) ? ( head.m_vecOrigin - Element( 1 ).m_vecOrigin ).Length2DSqr() : FLT_MAX;
+
+		if ( flTeleportDistanceSqr != m_flLinkDistanceSqr )
+		{
+			m_flLinkDistanceSqr = flTeleportDistanceSqr;
+			m_nContiguous = 0;
+			while ( m_nContiguous < m_nCount && ( Element( m_nContiguous ).m_fFlags & LC_ALIVE ) )
+			{
+				++m_nContiguous;
+				if ( m_nContiguous == m_nCount || StepDistanceSqr( m_nContiguous - 1 ) > flTeleportDistanceSqr )
+					break;
+			}
+		}
+		else if ( !( head.m_fFlags & LC_ALIVE ) )
+		{
+			m_nContiguous = 0;
+		}
+		else if ( m_nContiguous > 0 && flStepSqr <= flTeleportDistanceSqr )
+		{
+			m_nContiguous = MIN( m_nContiguous + 1, m_nCount );
+		}
+		else
+		{
+			m_nContiguous = 1;
+		}
+	}
+
+	int ContiguousCount() const
+	{
+		return m_nContiguous;
+	}
+
+	// Returns the newest record at or before flTargetTime, or the oldest record if they are all newer.
+	int Find( float flTargetTime ) const
+	{
+		Assert( m_nCount > 0 );
+
+		// Simulation times strictly decrease from the head
+		int lo = 0;
+		int hi = m_nCount - 1;
+		while ( lo < hi )
+		{
+			int mid = ( lo + hi ) >> 1;
+			if ( SimulationTime( mid ) <= flTargetTime )
+			{
+				hi = mid;
+			}
+			else
+			{
+				lo = mid + 1;
+			}
+		}
+		return lo;
+	}
+
+private:
+	// Squared 2D distance record i moved since the record after it
+	float StepDistanceSqr( int i ) const
+	{
+		return m_flStepDistanceSqr[ ( m_nHead + i ) & m_nMask ];
+	}
+
+	// Kept apart from the records so the search only touches a few cache lines
+	CUtlVector< float >		m_flSimulationTimes;
+	CUtlVector< float >		m_flStepDistanceSqr;
+	CUtlVector< LagRecord >	m_Records;
+	int						m_nMask;
+	int						m_nHead;
+	int						m_nCount;
+	int						m_nContiguous;
+	float					m_flLinkDistanceSqr;	// Teleport distance m_nContiguous was computed with
+};
+
+// Origin, mins and maxs are interpolated four players at a time
+enum
+{
+	LERP_ORIGIN_X = 0,
+	LERP_ORIGIN_Y,
+	LERP_ORIGIN_Z,
+	LERP_MINS_X,
+	LERP_MINS_Y,
+	LERP_MINS_Z,
+	LERP_MAXS_X,
+	LERP_MAXS_Y,
+	LERP_MAXS_Z,
+
+	LERP_COMPONENT_COUNT
+};
+
+#define BACKTRACK_BATCH_SIZE	ALIGN_VALUE( MAX_PLAYERS, 4 )
+
+//-----------------------------------------------------------------------------
+// Purpose: Players to be backtracked by one StartLagCompensation, with their
+//			interpolation inputs and results laid out for SIMD.
+//-----------------------------------------------------------------------------
+struct BacktrackBatch_t
+{
+	int				m_nCount;
+	CBasePlayer		*m_pPlayers[ BACKTRACK_BATCH_SIZE ];
+	LagRecord		*m_pRecords[ BACKTRACK_BATCH_SIZE ];
+	LagRecord		*m_pPrevRecords[ BACKTRACK_BATCH_SIZE ];	// NULL if not interpolating
+
+	ALIGN16 float	m_flFrac[ BACKTRACK_BATCH_SIZE ] ALIGN16_POST;
+	ALIGN16 float	m_flScale[ BACKTRACK_BATCH_SIZE ] ALIGN16_POST;
+	ALIGN16 float	m_flFrom[ LERP_COMPONENT_COUNT ][ BACKTRACK_BATCH_SIZE ] ALIGN16_POST;
+	ALIGN16 float	m_flTo[ LERP_COMPONENT_COUNT ][ BACKTRACK_BATCH_SIZE ] ALIGN16_POST;
+	ALIGN16 float	m_flResult[ LERP_COMPONENT_COUNT ][ BACKTRACK_BATCH_SIZE ] ALIGN16_POST;
+
+	void Interpolate();
+	int RayFilter( const Vector &vecStart, const Vector &vecDir, float flTolerance );
+};
+
+static void StoreLerpComponents( float (*pDest)[ BACKTRACK_BATCH_SIZE ], int i, const LagRecord &record )
+{
+	pDest[LERP_ORIGIN_X][i] = record.m_vecOrigin.x;
+	pDest[LERP_ORIGIN_Y][i] = record.m_vecOrigin.y;
+	pDest[LERP_ORIGIN_Z][i] = record.m_vecOrigin.z;
+	pDest[LERP_MINS_X][i] = record.m_vecMinsPreScaled.x;
+	pDest[LERP_MINS_Y][i] = record.m_vecMinsPreScaled.y;
+	pDest[LERP_MINS_Z][i] = record.m_vecMinsPreScaled.z;
+	pDest[LERP_MAXS_X][i] = record.m_vecMaxsPreScaled.x;
+	pDest[LERP_MAXS_Y][i] = record.m_vecMaxsPreScaled.y;
+	pDest[LERP_MAXS_Z][i] = record.m_vecMaxsPreScaled.z;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: m_flResult = Lerp( m_flFrac, m_flFrom, m_flTo ) for every player
+//-----------------------------------------------------------------------------
+void BacktrackBatch_t::Interpolate()
+{
+	for ( int i = 0; i < m_nCount; i += 4 )
+	{
+		fltx4 frac = LoadAlignedSIMD( &m_flFrac[i] );
+		for ( int c = 0; c < LERP_COMPONENT_COUNT; ++c )
+		{
+			fltx4 from = LoadAlignedSIMD( &m_flFrom[c][i] );
+			fltx4 to = LoadAlignedSIMD( &m_flTo[c][i] );
+			StoreAlignedSIMD( &m_flResult[c][i], AddSIMD( from, MulSIMD( SubSIMD( to, from ), frac ) ) );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops players whose interpolated bounding sphere doesn't touch the ray.
+//			Must be called after Interpolate. Returns the number of players left.
+//-----------------------------------------------------------------------------
+int BacktrackBatch_t::RayFilter( const Vector &vecStart, const Vector &vecDir, float flTolerance )
+{
+	fltx4 startX = ReplicateX4( vecStart.x );
+	fltx4 startY = ReplicateX4( vecStart.y );
+	fltx4 startZ = ReplicateX4( vecStart.z );
+	fltx4 dirX = ReplicateX4( vecDir.x );
+	fltx4 dirY = ReplicateX4( vecDir.y );
+	fltx4 dirZ = ReplicateX4( vecDir.z );
+	fltx4 tolerance = ReplicateX4( flTolerance );
+
+	int nKept = 0;
+	for ( int i = 0; i < m_nCount; i += 4 )
+	{
+		fltx4 scale = LoadAlignedSIMD( &m_flScale[i] );
+		fltx4 minsX = LoadAlignedSIMD( &m_flResult[LERP_MINS_X][i] );
+		fltx4 minsY = LoadAlignedSIMD( &m_flResult[LERP_MINS_Y][i] );
+		fltx4 minsZ = LoadAlignedSIMD( &m_flResult[LERP_MINS_Z][i] );
+		fltx4 maxsX = LoadAlignedSIMD( &m_flResult[LERP_MAXS_X][i] );
+		fltx4 maxsY = LoadAlignedSIMD( &m_flResult[LERP_MAXS_Y][i] );
+		fltx4 maxsZ = LoadAlignedSIMD( &m_flResult[LERP_MAXS_Z][i] );
+
+		// Sphere around the scaled bbox
+		fltx4 halfScale = MulSIMD( scale, Four_PointFives );
+		fltx4 centerX = MaddSIMD( AddSIMD( minsX, maxsX ), halfScale, LoadAlignedSIMD( &m_flResult[LERP_ORIGIN_X][i] ) );
+		fltx4 centerY = MaddSIMD( AddSIMD( minsY, maxsY ), halfScale, LoadAlignedSIMD( &m_flResult[LERP_ORIGIN_Y][i] ) );
+		fltx4 centerZ = MaddSIMD( AddSIMD( minsZ, maxsZ ), halfScale, LoadAlignedSIMD( &m_flResult[LERP_ORIGIN_Z][i] ) );
+
+		fltx4 extX = SubSIMD( maxsX, minsX );
+		fltx4 extY = SubSIMD( maxsY, minsY );
+		fltx4 extZ = SubSIMD( maxsZ, minsZ );
+		fltx4 extSqr = MaddSIMD( extX, extX, MaddSIMD( extY, extY, MulSIMD( extZ, extZ ) ) );
+		fltx4 radius = MaddSIMD( SqrtSIMD( extSqr ), halfScale, tolerance );
+
+		// Distance from the sphere center to the ray
+		fltx4 deltaX = SubSIMD( centerX, startX );
+		fltx4 deltaY = SubSIMD( centerY, startY );
+		fltx4 deltaZ = SubSIMD( centerZ, startZ );
+		fltx4 along = MaddSIMD( deltaX, dirX, MaddSIMD( deltaY, dirY, MulSIMD( deltaZ, dirZ ) ) );
+		fltx4 deltaSqr = MaddSIMD( deltaX, deltaX, MaddSIMD( deltaY, deltaY, MulSIMD( deltaZ, deltaZ ) ) );
+		fltx4 distSqr = SubSIMD( deltaSqr, MulSIMD( along, along ) );
+
+		fltx4 hit = AndSIMD( CmpLeSIMD( distSqr, MulSIMD( radius, radius ) ), 
+							 CmpGeSIMD( along, NegSIMD( radius ) ) );
+		int nHitMask = TestSignSIMD( hit );
+
+		// Compact in place. Only the fields used after filtering need to move.
+		int nLanes = MIN( 4, m_nCount - i );
+		for ( int j = 0; j < nLanes; ++j )
+		{
+			if ( !( nHitMask & ( 1 << j ) ) )
+				continue;
+
+			int iSrc = i + j;
+			if ( iSrc != nKept )
+			{
+				m_pPlayers[nKept] = m_pPlayers[iSrc];
+				m_pRecords[nKept] = m_pRecords[iSrc];
+				m_pPrevRecords[nKept] = m_pPrevRecords[iSrc];
+				m_flFrac[nKept] = m_flFrac[iSrc];
+				for ( int c = 0; c < LERP_COMPONENT_COUNT; ++c )
+				{
+					m_flResult[c][nKept] = m_flResult[c][iSrc];
+				}
+			}
+			++nKept;
+		}
+	}
+
+	m_nCount = nKept;
+	return nKept;
+}
+
 
 //
 // Try to take the player from his current origin to vWantedPos.
@@ -199,6 +514,8 @@ public:
 
 private:
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
+	bool			AddToBatch( BacktrackBatch_t &batch, CBasePlayer *pPlayer, float flTargetTime );
+	void			ApplyBacktrack( const BacktrackBatch_t &batch, int iPlayer, float flTargetTime );
 
 	void ClearHistory()
 	{
@@ -206,8 +523,13 @@ private:
 			m_PlayerTrack[i].Purge();
 	}
 
-	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	// keep a history of lag records for each player
+	CLagRecordTrack			m_PlayerTrack[ MAX_PLAYERS ];
+
+	// Players being backtracked by StartLagCompensation, and a separate batch for
+	// BacktrackPlayer since sv_unlag_fixstuck can call it while the first is in use
+	BacktrackBatch_t		m_Batch;
+	BacktrackBatch_t		m_SingleBatch;
 
 	// Scratchpad for determining what needs to be restored
 	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
@@ -245,52 +567,44 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	// remove all records before that time:
 	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
 
+	// Enough records to cover sv_maxunlag, plus the two on either side of it
+	int nRecordsNeeded = (int)ceil( sv_maxunlag.GetFloat() / TICK_INTERVAL ) + 2;
+
 	// Iterate all active players
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 
-		CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[i-1];
+		CLagRecordTrack *track = &m_PlayerTrack[i-1];
 
 		if ( !pPlayer )
 		{
-			if ( track->Count() > 0 )
-			{
-				track->RemoveAll();
-			}
-
+			track->Purge();
 			continue;
 		}
 
-		Assert( track->Count() < 1000 ); // insanity check
+		track->EnsureCapacity( nRecordsNeeded );
 
 		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while ( track->IsValidIndex( tailIndex ) )
+		while ( track->Count() > 0 )
 		{
-			LagRecord &tail = track->Element( tailIndex );
-
 			// if tail is within limits, stop
-			if ( tail.m_flSimulationTime >= flDeadtime )
+			if ( track->SimulationTime( track->Count() - 1 ) >= flDeadtime )
 				break;
 			
-			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
+			track->RemoveTail();
 		}
 
 		// check if head has same simulation time
 		if ( track->Count() > 0 )
 		{
-			LagRecord &head = track->Element( track->Head() );
-
 			// check if player changed simulation time since last time updated
-			if ( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
+			if ( track->SimulationTime( 0 ) >= pPlayer->GetSimulationTime() )
 				continue; // don't add new entry for same or older time
 		}
 
-		// add new record to player track
-		LagRecord &record = track->Element( track->AddToHead() );
+		// add new record to player track, dropping the oldest one if it's full
+		LagRecord &record = track->AddToHead( pPlayer->GetSimulationTime() );
 
 		record.m_fFlags = 0;
 		if ( pPlayer->IsAlive() )
@@ -298,7 +612,6 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 			record.m_fFlags |= LC_ALIVE;
 		}
 
-		record.m_flSimulationTime	= pPlayer->GetSimulationTime();
 		record.m_vecAngles			= pPlayer->GetLocalAngles();
 		record.m_vecOrigin			= pPlayer->GetLocalOrigin();
 		record.m_vecMinsPreScaled	= pPlayer->CollisionProp()->OBBMinsPreScaled();
@@ -318,6 +631,8 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 		}
 		record.m_masterSequence = pPlayer->GetSequence();
 		record.m_masterCycle = pPlayer->GetCycle();
+
+		track->LinkHead( m_flTeleportDistanceSqr );
 	}
 
 	//Clear the current player.
@@ -347,7 +662,7 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 	if ( !player->m_bLagCompensation		// Player not wanting lag compensation
 		 || (gpGlobals->maxClients <= 1)	// no lag compensation in single player
 		 || !sv_unlag.GetBool()				// disabled by server admin
-		 || player->IsBot() 				// not for bots
+		 || ( player->IsBot() && !g_pServerBenchmark->IsReplayPlayer( player ) )	// not for bots, unless they replay a real player
 		 || player->IsObserver()			// not for spectators
 		)
 		return;
@@ -394,6 +709,9 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		targettick = gpGlobals->tickcount - TIME_TO_TICKS( correct );
 	}
 	
+	float flTargetTime = TICKS_TO_TIME( targettick );
+	m_Batch.m_nCount = 0;
+
 	// Iterate all active players
 	const CBitVec<MAX_EDICTS> *pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
@@ -415,79 +733,74 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		if ( !player->WantsLagCompensationOnEntity( pPlayer, cmd, pEntityTransmitBits ) )
 			continue;
 
-		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		// Find where to move other player back in time to
+		AddToBatch( m_Batch, pPlayer, flTargetTime );
+	}
+
+	m_Batch.Interpolate();
+
+	if ( sv_unlag_rayfilter.GetBool() )
+	{
+		// Nobody off the line of fire needs to be moved
+		Vector vecForward;
+		AngleVectors( cmd->viewangles, &vecForward );
+		m_Batch.RayFilter( player->Weapon_ShootPosition(), vecForward, sv_unlag_rayfilter_tolerance.GetFloat() );
+	}
+
+	for ( int i = 0; i < m_Batch.m_nCount; ++i )
+	{
+		ApplyBacktrack( m_Batch, i, flTargetTime );
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Moves a single player back in time
+//-----------------------------------------------------------------------------
 void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
 {
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
+	m_SingleBatch.m_nCount = 0;
+	if ( !AddToBatch( m_SingleBatch, pPlayer, flTargetTime ) )
+		return;
 
+	m_SingleBatch.Interpolate();
+	ApplyBacktrack( m_SingleBatch, 0, flTargetTime );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the history records to backtrack this player to and queues
+//			them for interpolation. Returns false if the player can't be backtracked.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::AddToBatch( BacktrackBatch_t &batch, CBasePlayer *pPlayer, float flTargetTime )
+{
 	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
 	int pl_index = pPlayer->entindex() - 1;
 
 	// get track history of this player
-	CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[ pl_index ];
+	CLagRecordTrack *track = &m_PlayerTrack[ pl_index ];
 
 	// check if we have at leat one entry
 	if ( track->Count() <= 0 )
-		return;
+		return false;
 
-	int curr = track->Head();
-
-	LagRecord *prevRecord = NULL;
-	LagRecord *record = NULL;
-
-	Vector prevOrg = pPlayer->GetLocalOrigin();
-	
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex(curr) )
+	// The newest record has to be reachable from where the player is now...
+	Vector delta = track->Element( 0 ).m_vecOrigin - pPlayer->GetLocalOrigin();
+	if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
 	{
-		// remember last record
-		prevRecord = record;
-
-		// get next record
-		record = &track->Element( curr );
-
-		if ( !(record->m_fFlags & LC_ALIVE) )
-		{
-			// player most be alive, lost track
-			return;
-		}
-
-		Vector delta = record->m_vecOrigin - prevOrg;
-		if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
-		{
-			// lost track, too much difference
-			return; 
-		}
-
-		// did we find a context smaller than target time ?
-		if ( record->m_flSimulationTime <= flTargetTime )
-			break; // hurra, stop
-
-		prevOrg = record->m_vecOrigin;
-
-		// go one step back
-		curr = track->Next( curr );
+		// lost track, too much difference
+		return false;
 	}
 
-	Assert( record );
-
-	if ( !record )
+	// ...and every record from there back to the one we want must be alive and free of teleports
+	int iRecord = track->Find( flTargetTime );
+	if ( iRecord >= track->ContiguousCount() )
 	{
-		if ( sv_unlag_debug.GetBool() )
-		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
-		}
-
-		return; // that should never happen
+		// player must be alive, lost track
+		return false;
 	}
 
+	LagRecord *record = &track->Element( iRecord );
+	LagRecord *prevRecord = ( iRecord > 0 ) ? &track->Element( iRecord - 1 ) : NULL;
+
 	float frac = 0.0f;
 	if ( prevRecord && 
 		 (record->m_flSimulationTime < flTargetTime) &&
@@ -504,22 +817,44 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			( prevRecord->m_flSimulationTime - record->m_flSimulationTime );
 
 		Assert( frac > 0 && frac < 1 ); // should never extrapolate
-
-		ang				= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
-		org				= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
-		minsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
-		maxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
-	}
-	else
-	{
-		// we found the exact record or no other record to interpolate with
-		// just copy these values since they are the best we have
-		org				= record->m_vecOrigin;
-		ang				= record->m_vecAngles;
-		minsPreScaled	= record->m_vecMinsPreScaled;
-		maxsPreScaled	= record->m_vecMaxsPreScaled;
 	}
 
+	int i = batch.m_nCount++;
+	Assert( i < BACKTRACK_BATCH_SIZE );
+
+	batch.m_pPlayers[i] = pPlayer;
+	batch.m_pRecords[i] = record;
+	batch.m_pPrevRecords[i] = prevRecord;
+	batch.m_flFrac[i] = frac;
+	batch.m_flScale[i] = pPlayer->GetModelScale();
+
+	// we found the exact record or no other record to interpolate with,
+	// interpolating with a fraction of 0 just gives us the record
+	StoreLerpComponents( batch.m_flFrom, i, *record );
+	StoreLerpComponents( batch.m_flTo, i, prevRecord ? *prevRecord : *record );
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves a player to its interpolated position from the batch and
+//			remembers what needs to be restored.
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::ApplyBacktrack( const BacktrackBatch_t &batch, int iPlayer, float flTargetTime )
+{
+	// Read everything out of the batch up front, sv_unlag_fixstuck can refill it
+	CBasePlayer *pPlayer = batch.m_pPlayers[iPlayer];
+	LagRecord *record = batch.m_pRecords[iPlayer];
+	LagRecord *prevRecord = batch.m_pPrevRecords[iPlayer];
+	float frac = batch.m_flFrac[iPlayer];
+
+	Vector org( batch.m_flResult[LERP_ORIGIN_X][iPlayer], batch.m_flResult[LERP_ORIGIN_Y][iPlayer], batch.m_flResult[LERP_ORIGIN_Z][iPlayer] );
+	Vector minsPreScaled( batch.m_flResult[LERP_MINS_X][iPlayer], batch.m_flResult[LERP_MINS_Y][iPlayer], batch.m_flResult[LERP_MINS_Z][iPlayer] );
+	Vector maxsPreScaled( batch.m_flResult[LERP_MAXS_X][iPlayer], batch.m_flResult[LERP_MAXS_Y][iPlayer], batch.m_flResult[LERP_MAXS_Z][iPlayer] );
+	QAngle ang = ( frac > 0.0f ) ? Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles ) : record->m_vecAngles;
+
+	int pl_index = pPlayer->entindex() - 1;
+
 	// See if this is still a valid position for us to teleport to
 	if ( sv_unlag_fixstuck.GetBool() )
 	{
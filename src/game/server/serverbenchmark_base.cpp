@@ -9,6 +9,10 @@
 #include "props.h"
 #include "filesystem.h"
 #include "tier0/icommandline.h"
+#include "tier0/vprof.h"
+#include "usercmd.h"
+#include "utlbuffer.h"
+#include "datacache/imdlcache.h"
 
 
 // Server benchmark. Only works on specified maps.
@@ -20,6 +24,8 @@
 
 static ConVar sv_benchmark_numticks( "sv_benchmark_numticks", "3300", 0, "If > 0, then it only runs the benchmark for this # of ticks." );
 static ConVar sv_benchmark_autovprofrecord( "sv_benchmark_autovprofrecord", "0", 0, "If running a benchmark and this is set, it will record a vprof file over the duration of the benchmark with filename benchmark.vprof." );
+static ConVar sv_benchmark_replay( "sv_benchmark_replay", "", 0, "If set, the benchmark replays the usercmds recorded with sv_benchmark_record into this file instead of running scripted bots." );
+static ConVar sv_benchmark_replay_stressbots( "sv_benchmark_replay_stressbots", "1", 0, "Turn on sv_stressbots while replaying so snapshots are built and encoded for the replay bots like for real clients." );
 
 static float s_flBenchmarkStartWaitSeconds = 3;	// Wait this many seconds after level load before starting the benchmark.
 
@@ -40,6 +46,554 @@ static double Benchmark_ValidTime()
 }
 
 
+// ---------------------------------------------------------------------------------------------- //
+// Usercmd recording.
+//
+// sv_benchmark_record captures the usercmds every human player sends on a live server, along with
+// their team and class changes. When sv_benchmark_replay names a recording, the benchmark creates a
+// bot per recorded player and feeds it those usercmds on the same ticks, so prediction, lag
+// compensation and snapshot encoding cost what they did in the real match, every run.
+// ---------------------------------------------------------------------------------------------- //
+
+#define USERCMD_RECORDING_ID		(('D'<<24)+('M'<<16)+('C'<<8)+'U')	// little-endian "UCMD"
+#define USERCMD_RECORDING_VERSION	1
+#define USERCMD_RECORDING_MAXCMDS	64
+
+enum UsercmdRecordType_t
+{
+	USERCMD_RECORD_CMDS,
+	USERCMD_RECORD_PLAYERSTATE,
+	USERCMD_RECORD_END,
+};
+
+struct UsercmdRecord_t
+{
+	int			m_nType;
+	int			m_nTick;	// relative to the start of the recording
+	int			m_iSlot;
+
+	// USERCMD_RECORD_PLAYERSTATE
+	int			m_iTeam;
+	int			m_iClass;
+	float		m_flLerpTime;
+
+	// USERCMD_RECORD_CMDS, newest first like CServerGameClients::ProcessUsercmds
+	int			m_nNumCmds;
+	int			m_nTotalCmds;
+	int			m_nDroppedPackets;
+	CUserCmd	m_Cmds[USERCMD_RECORDING_MAXCMDS];
+};
+
+struct UsercmdRecordingSlot_t
+{
+	CHandle< CBasePlayer >	m_hPlayer;
+	int						m_iTeam;
+	int						m_iClass;
+	float					m_flLerpTime;
+};
+
+static void WriteUsercmdRecordHeader( CUtlBuffer &buf, int nType, int nTick, int iSlot )
+{
+	buf.PutUnsignedChar( nType );
+	buf.PutInt( nTick );
+	buf.PutUnsignedChar( iSlot );
+}
+
+static bool ReadUsercmdRecord( CUtlBuffer &buf, UsercmdRecord_t &record )
+{
+	record.m_nType = buf.GetUnsignedChar();
+	if ( !buf.IsValid() || record.m_nType == USERCMD_RECORD_END )
+		return false;
+
+	record.m_nTick = buf.GetInt();
+	record.m_iSlot = buf.GetUnsignedChar();
+
+	if ( record.m_nType == USERCMD_RECORD_PLAYERSTATE )
+	{
+		record.m_iTeam = buf.GetInt();
+		record.m_iClass = buf.GetInt();
+		record.m_flLerpTime = buf.GetFloat();
+		return buf.IsValid();
+	}
+
+	if ( record.m_nType != USERCMD_RECORD_CMDS )
+		return false;
+
+	record.m_nNumCmds = buf.GetUnsignedChar();
+	record.m_nTotalCmds = buf.GetUnsignedChar();
+	record.m_nDroppedPackets = buf.GetUnsignedChar();
+	int nBytes = buf.GetUnsignedShort();
+	if ( !buf.IsValid() || record.m_nTotalCmds > USERCMD_RECORDING_MAXCMDS || record.m_nNumCmds > record.m_nTotalCmds ||
+		nBytes > buf.GetBytesRemaining() )
+		return false;
+
+	bf_read bits( buf.PeekGet(), nBytes );
+	CUserCmd cmdNull;
+	CUserCmd *from = &cmdNull;
+	for ( int i = record.m_nTotalCmds - 1; i >= 0; i-- )
+	{
+		ReadUsercmd( &bits, &record.m_Cmds[i], from );
+		from = &record.m_Cmds[i];
+	}
+	buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nBytes );
+
+	return !bits.IsOverflowed();
+}
+
+class CUsercmdRecorder
+{
+public:
+	CUsercmdRecorder()
+	{
+		m_szFilename[0] = 0;
+		m_nStartTick = 0;
+	}
+
+	bool IsRecording() const
+	{
+		return m_szFilename[0] != 0;
+	}
+
+	void Start( const char *pFilename )
+	{
+		Stop();
+
+		Q_strncpy( m_szFilename, pFilename, sizeof( m_szFilename ) );
+		Q_DefaultExtension( m_szFilename, ".ucmd", sizeof( m_szFilename ) );
+		m_nStartTick = gpGlobals->tickcount;
+
+		m_Buffer.Purge();
+		m_Buffer.PutInt( USERCMD_RECORDING_ID );
+		m_Buffer.PutInt( USERCMD_RECORDING_VERSION );
+		m_Buffer.PutString( STRING( gpGlobals->mapname ) );
+		m_Buffer.PutFloat( gpGlobals->interval_per_tick );
+
+		Msg( "Recording usercmds to %s\n", m_szFilename );
+	}
+
+	void Stop()
+	{
+		if ( !IsRecording() )
+			return;
+
+		m_Buffer.PutUnsignedChar( USERCMD_RECORD_END );
+		if ( filesystem->WriteFile( m_szFilename, "DEFAULT_WRITE_PATH", m_Buffer ) )
+		{
+			Msg( "Recorded %d ticks of usercmds from %d players to %s\n", gpGlobals->tickcount - m_nStartTick, m_Slots.Count(), m_szFilename );
+		}
+		else
+		{
+			Warning( "Couldn't write usercmd recording %s\n", m_szFilename );
+		}
+
+		m_Buffer.Purge();
+		m_Slots.Purge();
+		m_szFilename[0] = 0;
+	}
+
+	void Record( CBasePlayer *pPlayer, CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets )
+	{
+		if ( !IsRecording() || pPlayer->IsFakeClient() || totalcmds > USERCMD_RECORDING_MAXCMDS )
+			return;
+
+		int iSlot = FindOrAddSlot( pPlayer );
+		if ( iSlot < 0 )
+			return;
+
+		int nTick = gpGlobals->tickcount - m_nStartTick;
+
+		UsercmdRecordingSlot_t &slot = m_Slots[iSlot];
+		int iTeam = pPlayer->GetTeamNumber();
+		int iClass = CServerBenchmarkHook::s_pBenchmarkHook ? CServerBenchmarkHook::s_pBenchmarkHook->GetPlayerClass( pPlayer ) : 0;
+		if ( iTeam != slot.m_iTeam || iClass != slot.m_iClass || pPlayer->m_fLerpTime != slot.m_flLerpTime )
+		{
+			slot.m_iTeam = iTeam;
+			slot.m_iClass = iClass;
+			slot.m_flLerpTime = pPlayer->m_fLerpTime;
+
+			WriteUsercmdRecordHeader( m_Buffer, USERCMD_RECORD_PLAYERSTATE, nTick, iSlot );
+			m_Buffer.PutInt( iTeam );
+			m_Buffer.PutInt( iClass );
+			m_Buffer.PutFloat( slot.m_flLerpTime );
+		}
+
+		// Same delta encoding the client uses, with tick_count made relative to the recording
+		byte data[ USERCMD_RECORDING_MAXCMDS * 64 ];
+		bf_write bits( data, sizeof( data ) );
+		CUserCmd cmdNull;
+		CUserCmd to;
+		CUserCmd from = cmdNull;
+		for ( int i = totalcmds - 1; i >= 0; i-- )
+		{
+			to = cmds[i];
+			to.tick_count -= m_nStartTick;
+			WriteUsercmd( &bits, &to, &from );
+			from = to;
+		}
+
+		if ( bits.IsOverflowed() )
+			return;
+
+		WriteUsercmdRecordHeader( m_Buffer, USERCMD_RECORD_CMDS, nTick, iSlot );
+		m_Buffer.PutUnsignedChar( numcmds );
+		m_Buffer.PutUnsignedChar( totalcmds );
+		m_Buffer.PutUnsignedChar( MIN( dropped_packets, 255 ) );
+		m_Buffer.PutUnsignedShort( bits.GetNumBytesWritten() );
+		m_Buffer.Put( data, bits.GetNumBytesWritten() );
+	}
+
+private:
+	int FindOrAddSlot( CBasePlayer *pPlayer )
+	{
+		for ( int i = 0; i < m_Slots.Count(); i++ )
+		{
+			if ( m_Slots[i].m_hPlayer == pPlayer )
+				return i;
+		}
+
+		// Slots are a byte in the file
+		if ( m_Slots.Count() >= 255 )
+			return -1;
+
+		int iSlot = m_Slots.AddToTail();
+		m_Slots[iSlot].m_hPlayer = pPlayer;
+		m_Slots[iSlot].m_iTeam = -1;
+		m_Slots[iSlot].m_iClass = -1;
+		m_Slots[iSlot].m_flLerpTime = -1.0f;
+		return iSlot;
+	}
+
+	CUtlBuffer m_Buffer;
+	CUtlVector< UsercmdRecordingSlot_t > m_Slots;
+	int m_nStartTick;
+	char m_szFilename[MAX_PATH];
+};
+
+static CUsercmdRecorder g_UsercmdRecorder;
+
+CON_COMMAND( sv_benchmark_record, "Record the usercmds of all human players into a file that sv_benchmark_replay can play back." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: sv_benchmark_record <filename>\n" );
+		return;
+	}
+
+	g_UsercmdRecorder.Start( args[1] );
+}
+
+CON_COMMAND( sv_benchmark_record_stop, "Stop recording usercmds and write the file." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_UsercmdRecorder.Stop();
+}
+
+
+class CUsercmdReplay
+{
+public:
+	CUsercmdReplay()
+	{
+		m_nNumTicks = 0;
+	}
+
+	bool IsLoaded() const
+	{
+		return m_Buffer.TellPut() != 0;
+	}
+
+	int GetNumTicks() const
+	{
+		return m_nNumTicks;
+	}
+
+	bool Load( const char *pFilename )
+	{
+		Clear();
+
+		char szFilename[MAX_PATH];
+		Q_strncpy( szFilename, pFilename, sizeof( szFilename ) );
+		Q_DefaultExtension( szFilename, ".ucmd", sizeof( szFilename ) );
+
+		if ( !filesystem->ReadFile( szFilename, "MOD", m_Buffer ) )
+		{
+			Warning( "Server benchmark: can't read usercmd recording %s\n", szFilename );
+			return false;
+		}
+
+		char szMapName[MAX_PATH];
+		if ( m_Buffer.GetInt() != USERCMD_RECORDING_ID || m_Buffer.GetInt() != USERCMD_RECORDING_VERSION )
+		{
+			Warning( "Server benchmark: %s isn't a usercmd recording\n", szFilename );
+			Clear();
+			return false;
+		}
+
+		m_Buffer.GetString( szMapName );
+		float flInterval = m_Buffer.GetFloat();
+		if ( Q_stricmp( szMapName, STRING( gpGlobals->mapname ) ) || flInterval != gpGlobals->interval_per_tick )
+		{
+			Warning( "Server benchmark: %s was recorded on %s at %.1f tick, replay results won't match\n", szFilename, szMapName, 1.0f / flInterval );
+		}
+
+		// Validate the whole thing once up front and find how long it runs
+		int nDataStart = m_Buffer.TellGet();
+		int nRecords = 0;
+		while ( ReadUsercmdRecord( m_Buffer, m_Record ) )
+		{
+			m_nNumTicks = MAX( m_nNumTicks, m_Record.m_nTick + 1 );
+			++nRecords;
+		}
+
+		m_Buffer.SeekGet( CUtlBuffer::SEEK_HEAD, nDataStart );
+		Msg( "Server benchmark: replaying %d ticks (%d usercmd packets) from %s\n", m_nNumTicks, nRecords, szFilename );
+		return true;
+	}
+
+	void Clear()
+	{
+		m_Buffer.Purge();
+		m_Slots.Purge();
+		m_nNumTicks = 0;
+	}
+
+	// Run everything recorded up to and including nTick
+	void Update( int nTick, int nStartTick )
+	{
+		MDLCACHE_CRITICAL_SECTION();
+
+		while ( m_Buffer.GetBytesRemaining() > 0 )
+		{
+			int nRecordStart = m_Buffer.TellGet();
+			if ( !ReadUsercmdRecord( m_Buffer, m_Record ) )
+			{
+				m_Buffer.SeekGet( CUtlBuffer::SEEK_TAIL, 0 );
+				break;
+			}
+
+			if ( m_Record.m_nTick > nTick )
+			{
+				m_Buffer.SeekGet( CUtlBuffer::SEEK_HEAD, nRecordStart );
+				break;
+			}
+
+			if ( m_Record.m_nType == USERCMD_RECORD_PLAYERSTATE )
+			{
+				ApplyPlayerState( m_Record );
+			}
+			else
+			{
+				RunUsercmds( m_Record, nStartTick );
+			}
+		}
+	}
+
+	bool IsReplayPlayer( CBasePlayer *pPlayer )
+	{
+		for ( int i = 0; i < m_Slots.Count(); i++ )
+		{
+			if ( m_Slots[i].m_hPlayer == pPlayer )
+				return true;
+		}
+		return false;
+	}
+
+private:
+	void ApplyPlayerState( const UsercmdRecord_t &record )
+	{
+		m_Slots.EnsureCount( record.m_iSlot + 1 );
+
+		UsercmdRecordingSlot_t &slot = m_Slots[record.m_iSlot];
+		slot.m_iTeam = record.m_iTeam;
+		slot.m_iClass = record.m_iClass;
+		slot.m_flLerpTime = record.m_flLerpTime;
+
+		if ( !slot.m_hPlayer )
+		{
+			slot.m_hPlayer = CServerBenchmarkHook::s_pBenchmarkHook->CreateReplayBot( record.m_iTeam, record.m_iClass );
+		}
+		else
+		{
+			CServerBenchmarkHook::s_pBenchmarkHook->SetReplayPlayerState( slot.m_hPlayer, record.m_iTeam, record.m_iClass );
+		}
+	}
+
+	void RunUsercmds( UsercmdRecord_t &record, int nStartTick )
+	{
+		if ( !m_Slots.IsValidIndex( record.m_iSlot ) )
+			return;
+
+		UsercmdRecordingSlot_t &slot = m_Slots[record.m_iSlot];
+		CBasePlayer *pPlayer = slot.m_hPlayer;
+		if ( !pPlayer )
+			return;
+
+		// Bots don't send client settings, give them the ones the real player had
+		pPlayer->m_fLerpTime = slot.m_flLerpTime;
+		pPlayer->m_bLagCompensation = true;
+		pPlayer->m_bPredictWeapons = true;
+
+		for ( int i = 0; i < record.m_nTotalCmds; i++ )
+		{
+			record.m_Cmds[i].tick_count += nStartTick;
+		}
+
+		pPlayer->ProcessUsercmds( record.m_Cmds, record.m_nNumCmds, record.m_nTotalCmds, record.m_nDroppedPackets, false );
+	}
+
+	CUtlBuffer m_Buffer;
+	CUtlVector< UsercmdRecordingSlot_t > m_Slots;
+	UsercmdRecord_t m_Record;
+	int m_nNumTicks;
+};
+
+
+// ---------------------------------------------------------------------------------------------- //
+// Per tick timing, in total and by VPROF budget group.
+// ---------------------------------------------------------------------------------------------- //
+class CBenchmarkTickProfile
+{
+public:
+	void Start()
+	{
+		m_TickTimes.Purge();
+		m_GroupTimes.Purge();
+		m_flLastTickTime = 0.0;
+
+#ifdef VPROF_ENABLED
+		// Budget groups created after this all land in the last column
+		m_nGroups = g_VProfCurrentProfile.GetNumBudgetGroups() + 1;
+		engine->ServerCommand( "vprof_on\n" );
+		engine->ServerExecute();
+#else
+		m_nGroups = 0;
+#endif
+	}
+
+	void Stop()
+	{
+#ifdef VPROF_ENABLED
+		engine->ServerCommand( "vprof_off\n" );
+		engine->ServerExecute();
+#endif
+	}
+
+	void Sample( double flNow )
+	{
+		if ( m_flLastTickTime != 0.0 )
+		{
+			m_TickTimes.AddToTail( ( flNow - m_flLastTickTime ) * 1000.0f );
+
+#ifdef VPROF_ENABLED
+			// The tree holds last frame's times, which is the last tick in benchmark mode
+			int iFirst = m_GroupTimes.AddMultipleToTail( m_nGroups );
+			V_memset( &m_GroupTimes[iFirst], 0, m_nGroups * sizeof( float ) );
+			if ( g_VProfCurrentProfile.IsEnabled() && g_VProfCurrentProfile.GetRoot()->GetChild() )
+			{
+				AddNodeTimes_R( g_VProfCurrentProfile.GetRoot()->GetChild(), &m_GroupTimes[iFirst] );
+			}
+#endif
+		}
+		m_flLastTickTime = flNow;
+	}
+
+	// Prints to the console, or writes "key := value" lines when given a file
+	void Report( FileHandle_t fh )
+	{
+		int nTicks = m_TickTimes.Count();
+		if ( !nTicks )
+			return;
+
+		CUtlVector< float > sorted;
+		sorted.SetCount( nTicks );
+
+		if ( !fh )
+		{
+			Warning( "Tick time (ms)                        p50      p90      p99      max\n" );
+		}
+
+		V_memcpy( sorted.Base(), m_TickTimes.Base(), nTicks * sizeof( float ) );
+		ReportPercentiles( fh, "total", sorted );
+
+#ifdef VPROF_ENABLED
+		for ( int iGroup = 0; iGroup < m_nGroups; iGroup++ )
+		{
+			for ( int i = 0; i < nTicks; i++ )
+			{
+				sorted[i] = m_GroupTimes[i * m_nGroups + iGroup];
+			}
+
+			const char *pName = ( iGroup < m_nGroups - 1 ) ? g_VProfCurrentProfile.GetBudgetGroupName( iGroup ) : "(new groups)";
+			ReportPercentiles( fh, pName, sorted );
+		}
+#endif
+	}
+
+private:
+#ifdef VPROF_ENABLED
+	void AddNodeTimes_R( CVProfNode *pNode, float *pGroupTimes )
+	{
+		for ( ; pNode; pNode = pNode->GetSibling() )
+		{
+			int iGroup = MIN( pNode->GetBudgetGroupID(), m_nGroups - 1 );
+			pGroupTimes[iGroup] += pNode->GetPrevTimeLessChildren();
+
+			AddNodeTimes_R( pNode->GetChild(), pGroupTimes );
+		}
+	}
+#endif
+
+	static int SortFloats( const float *a, const float *b )
+	{
+		return ( *a < *b ) ? -1 : ( *a > *b );
+	}
+
+	void ReportPercentiles( FileHandle_t fh, const char *pName, CUtlVector< float > &samples )
+	{
+		samples.Sort( SortFloats );
+
+		int nLast = samples.Count() - 1;
+		float flMax = samples[nLast];
+		if ( flMax <= 0.0f )
+			return;
+
+		float p50 = samples[ nLast * 50 / 100 ];
+		float p90 = samples[ nLast * 90 / 100 ];
+		float p99 = samples[ nLast * 99 / 100 ];
+		if ( !fh )
+		{
+			Warning( "  %-32s %8.3f %8.3f %8.3f %8.3f\n", pName, p50, p90, p99, flMax );
+		}
+		else
+		{
+			// One key per line, like sv_benchmark itself, so build scripts can track each one
+			char szKey[64];
+			Q_strncpy( szKey, pName, sizeof( szKey ) );
+			for ( char *pChar = szKey; *pChar; ++pChar )
+			{
+				if ( !V_isalnum( *pChar ) )
+					*pChar = '_';
+			}
+
+			filesystem->FPrintf( fh, "sv_benchmark_%s_p50 := %.3f\n", szKey, p50 );
+			filesystem->FPrintf( fh, "sv_benchmark_%s_p90 := %.3f\n", szKey, p90 );
+			filesystem->FPrintf( fh, "sv_benchmark_%s_p99 := %.3f\n", szKey, p99 );
+			filesystem->FPrintf( fh, "sv_benchmark_%s_max := %.3f\n", szKey, flMax );
+		}
+	}
+
+	CUtlVector< float > m_TickTimes;
+	CUtlVector< float > m_GroupTimes;	// m_nGroups per tick
+	int m_nGroups;
+	double m_flLastTickTime;
+};
+
+
 // ---------------------------------------------------------------------------------------------- //
 // CServerBenchmark implementation.
 // ---------------------------------------------------------------------------------------------- //
@@ -49,6 +603,8 @@ public:
 	CServerBenchmark()
 	{
 		m_BenchmarkState = BENCHMARKSTATE_NOT_RUNNING;
+		m_bReplaying = false;
+		m_bOldStressBots = false;
 		
 		// The benchmark should always have the same seed and do exactly the same thing on the same ticks.
 		m_RandomStream.SetSeed( 1111 ); 
@@ -81,6 +637,14 @@ public:
 		if ( !CServerBenchmarkHook::s_pBenchmarkHook )
 			Error( "This game doesn't support server benchmarks (no CServerBenchmarkHook found)." );
 
+		m_bReplaying = ( sv_benchmark_replay.GetString()[0] && m_Replay.Load( sv_benchmark_replay.GetString() ) );
+		if ( m_bReplaying && sv_benchmark_replay_stressbots.GetBool() )
+		{
+			ConVarRef sv_stressbots( "sv_stressbots" );
+			m_bOldStressBots = sv_stressbots.GetBool();
+			sv_stressbots.SetValue( true );
+		}
+
 		m_BenchmarkState = BENCHMARKSTATE_START_WAIT;
 		m_flBenchmarkStartTime = Plat_FloatTime();
 		m_flBenchmarkStartWaitTime = flCountdown;
@@ -123,6 +687,10 @@ public:
 				m_BenchmarkState = BENCHMARKSTATE_RUNNING;
 
 				StartVProfRecord();
+				if ( m_bReplaying )
+				{
+					m_TickProfile.Start();
+				}
 
 				RandomSeed( 0 );
 				m_RandomStream.SetSeed( 0 );
@@ -133,7 +701,7 @@ public:
 		UpdateBenchmarkCounter();
 	
 		// Are we finished with the benchmark?
-		if ( nTicksRunSoFar >= sv_benchmark_numticks.GetInt() )
+		if ( nTicksRunSoFar >= GetNumTicksToRun() )
 		{
 			EndVProfRecord();
 			OutputResults();
@@ -142,11 +710,27 @@ public:
 		}
 
 		// Ok, update whatever we're doing in the benchmark.
-		UpdatePlayerCreation();
-		UpdateVPhysicsObjects();
+		if ( m_bReplaying )
+		{
+			m_TickProfile.Sample( Benchmark_ValidTime() );
+			m_Replay.Update( nTicksRunSoFar, m_nBenchmarkStartTick );
+		}
+		else
+		{
+			UpdatePlayerCreation();
+			UpdateVPhysicsObjects();
+		}
 		CServerBenchmarkHook::s_pBenchmarkHook->UpdateBenchmark();
 	}
 
+	int GetNumTicksToRun()
+	{
+		if ( m_bReplaying && ( sv_benchmark_numticks.GetInt() <= 0 || m_Replay.GetNumTicks() < sv_benchmark_numticks.GetInt() ) )
+			return m_Replay.GetNumTicks();
+
+		return sv_benchmark_numticks.GetInt();
+	}
+
 	void StartVProfRecord()
 	{
 		if ( sv_benchmark_autovprofrecord.GetInt() )
@@ -177,6 +761,10 @@ public:
 			if ( fh )
 			{
 				filesystem->FPrintf( fh, "sv_benchmark := %.2f\n", flRunTime );
+				if ( m_bReplaying )
+				{
+					m_TickProfile.Report( fh );
+				}
 			}
 			filesystem->Close( fh );
 
@@ -184,6 +772,22 @@ public:
 			engine->ServerCommand( "quit\n" );
 		}
 		
+		if ( m_bReplaying )
+		{
+			m_TickProfile.Stop();
+			m_Replay.Clear();
+			m_bReplaying = false;
+
+			if ( sv_benchmark_replay_stressbots.GetBool() )
+			{
+				ConVarRef sv_stressbots( "sv_stressbots" );
+				sv_stressbots.SetValue( m_bOldStressBots );
+			}
+		}
+
+		// A recording can't span a level change
+		g_UsercmdRecorder.Stop();
+
 		m_BenchmarkState = BENCHMARKSTATE_NOT_RUNNING;
 		engine->SetDedicatedServerBenchmarkMode( false );
 	}
@@ -288,7 +892,7 @@ public:
 		if ( (flCurTime - m_flLastBenchmarkCounterUpdate) > 3.0f )
 		{
 			m_flLastBenchmarkCounterUpdate = flCurTime;
-			Msg( "Benchmark: %d%% complete.\n", ((gpGlobals->tickcount - m_nBenchmarkStartTick) * 100) / sv_benchmark_numticks.GetInt() );
+			Msg( "Benchmark: %d%% complete.\n", ((gpGlobals->tickcount - m_nBenchmarkStartTick) * 100) / MAX( GetNumTicksToRun(), 1 ) );
 		}
 	}
 
@@ -332,9 +936,13 @@ public:
 
 		Warning( "------------------ SERVER BENCHMARK RESULTS ------------------\n" );
 		Warning( "Total time          : %.2f seconds\n", flRunTime );
-		Warning( "Num ticks simulated : %d\n", sv_benchmark_numticks.GetInt() );
-		Warning( "Ticks per second    : %.2f\n", sv_benchmark_numticks.GetInt() / flRunTime );
+		Warning( "Num ticks simulated : %d\n", GetNumTicksToRun() );
+		Warning( "Ticks per second    : %.2f\n", GetNumTicksToRun() / flRunTime );
 		Warning( "Benchmark CRC       : %d\n", CalculateBenchmarkCRC() );
+		if ( m_bReplaying )
+		{
+			m_TickProfile.Report( NULL );
+		}
 		Warning( "--------------------------------------------------------------\n" );
 	}
 
@@ -366,6 +974,21 @@ public:
 		return m_RandomStream.RandomInt( nMin, nMax );
 	}
 
+	virtual void RecordUsercmds( CBasePlayer *pPlayer, CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets )
+	{
+		g_UsercmdRecorder.Record( pPlayer, cmds, numcmds, totalcmds, dropped_packets );
+	}
+
+	virtual bool IsReplaying()
+	{
+		return m_bReplaying;
+	}
+
+	virtual bool IsReplayPlayer( CBasePlayer *pPlayer )
+	{
+		return m_bReplaying && m_Replay.IsReplayPlayer( pPlayer );
+	}
+
 
 private:
 	
@@ -395,6 +1018,11 @@ private:
 	int m_nBenchmarkMode;
 
 	CUniformRandomStream m_RandomStream;
+
+	bool m_bReplaying;
+	bool m_bOldStressBots;
+	CUsercmdReplay m_Replay;
+	CBenchmarkTickProfile m_TickProfile;
 };
 
 static CServerBenchmark g_ServerBenchmark;
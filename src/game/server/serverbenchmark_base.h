@@ -11,6 +11,8 @@
 #endif
 
 
+class CUserCmd;
+
 // The base server code calls into this.
 class IServerBenchmark
 {
@@ -26,6 +28,11 @@ public:
 	virtual int RandomInt( int nMin, int nMax ) = 0;
 	virtual float RandomFloat( float flMin, float flMax ) = 0;
 	virtual int GetTickOffset() = 0;
+
+	// Usercmd recording (sv_benchmark_record) and replay (sv_benchmark_replay).
+	virtual void RecordUsercmds( CBasePlayer *pPlayer, CUserCmd *cmds, int numcmds, int totalcmds, int dropped_packets ) = 0;
+	virtual bool IsReplaying() = 0;
+	virtual bool IsReplayPlayer( CBasePlayer *pPlayer ) = 0;
 };
 
 extern IServerBenchmark *g_pServerBenchmark;
@@ -56,8 +63,16 @@ public:
 	// If you want to manage the bots yourself, you can return NULL here.
 	virtual CBasePlayer* CreateBot() = 0;
 
+	// Usercmd replay. The recording stores each player's team and class as returned by GetPlayerClass.
+	// CreateReplayBot must return a bot that is driven only by the replayed usercmds (no bot AI).
+	virtual int GetPlayerClass( CBasePlayer *pPlayer ) { return 0; }
+	virtual CBasePlayer* CreateReplayBot( int iTeam, int iClass ) { return CreateBot(); }
+	virtual void SetReplayPlayerState( CBasePlayer *pPlayer, int iTeam, int iClass ) {}
+
 private:
 	friend class CServerBenchmark;
+	friend class CUsercmdRecorder;
+	friend class CUsercmdReplay;
 	static CServerBenchmarkHook *s_pBenchmarkHook; // There can be only one!!
 };
 
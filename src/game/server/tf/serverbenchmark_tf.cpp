@@ -13,6 +13,7 @@
 
 
 static ConVar sv_benchmark_freeroam( "sv_benchmark_freeroam", "0", 0, "Allow the local player to move freely in the benchmark. Only used for debugging. Don't use for real benchmarks because it will make the timing inconsistent." );
+static ConVar sv_benchmark_botclass( "sv_benchmark_botclass", "0", 0, "If set, every benchmark bot after the first engineers plays this class. Use 1 (scout) or 6 (heavy) with tf_fx_batch_pellets 0/1 to compare pellet tracing." );
 
 
 class CTFServerBenchmark : public CServerBenchmarkHook
@@ -20,6 +21,13 @@ class CTFServerBenchmark : public CServerBenchmarkHook
 public:
 	virtual void StartBenchmark()
 	{
+		m_nBotsCreated = 0;
+		m_bSetupLocalPlayer = false;
+
+		// A replay is driven entirely by the recorded usercmds
+		if ( g_pServerBenchmark->IsReplaying() )
+			return;
+
 		ConVarRef cvBotFlipout( "bot_flipout" );
 		cvBotFlipout.SetValue( 3 );
 
@@ -28,9 +36,6 @@ public:
 
 		extern ConVar mp_teams_unbalance_limit;
 		mp_teams_unbalance_limit.SetValue( (int)0 );
-
-		m_nBotsCreated = 0;
-		m_bSetupLocalPlayer = false;
 	}
 
 	virtual void GetPhysicsModelNames( CUtlVector<char*> &modelNames )
@@ -89,7 +94,7 @@ public:
 
 	virtual void UpdateBenchmark()
 	{
-		if ( m_nBotsCreated == 0 )
+		if ( m_nBotsCreated == 0 || g_pServerBenchmark->IsReplaying() )
 		{
 			return;
 		}
@@ -215,6 +220,8 @@ public:
 		int iClass = g_pServerBenchmark->RandomInt( TF_FIRST_NORMAL_CLASS, ( TF_LAST_NORMAL_CLASS - 1 ) ); //( TF_LAST_NORMAL_CLASS - 1 ) to exclude the new civilian class
 		if ( m_nBotsCreated < 4 )
 			iClass = TF_CLASS_ENGINEER; // Make engineers first so they'll build sentries.
+		else if ( IsValidTFPlayerClass( sv_benchmark_botclass.GetInt() ) )
+			iClass = sv_benchmark_botclass.GetInt();
 
 		CBasePlayer *pPlayer = BotPutInServer( false, false, iTeam, iClass, NULL );
 		if ( !pPlayer )
@@ -224,6 +231,40 @@ public:
 		return pPlayer;
 	}
 
+	virtual int GetPlayerClass( CBasePlayer *pPlayer )
+	{
+		CTFPlayer *pTFPlayer = ToTFPlayer( pPlayer );
+		return pTFPlayer ? pTFPlayer->GetPlayerClass()->GetClassIndex() : TF_CLASS_UNDEFINED;
+	}
+
+	virtual CBasePlayer* CreateReplayBot( int iTeam, int iClass )
+	{
+		CBasePlayer *pPlayer = BotPutInServer( false, false, iTeam, iClass, NULL );
+		if ( !pPlayer )
+			Error( "Server benchmark: Can't create replay bot." );
+
+		++m_nBotsCreated;
+		return pPlayer;
+	}
+
+	virtual void SetReplayPlayerState( CBasePlayer *pPlayer, int iTeam, int iClass )
+	{
+		CTFPlayer *pTFPlayer = ToTFPlayer( pPlayer );
+		if ( !pTFPlayer )
+			return;
+
+		if ( pTFPlayer->GetTeamNumber() != iTeam )
+		{
+			pTFPlayer->ChangeTeam( iTeam );
+		}
+
+		if ( iClass != TF_CLASS_UNDEFINED && pTFPlayer->GetPlayerClass()->GetClassIndex() != iClass )
+		{
+			pTFPlayer->SetDesiredPlayerClassIndex( iClass );
+			pTFPlayer->ForceRespawn();
+		}
+	}
+
 private:
 	int m_nBotsCreated;
 	bool m_bSetupLocalPlayer;
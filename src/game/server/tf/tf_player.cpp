@@ -12959,6 +12959,8 @@ void CTFPlayer::RemoveOwnedProjectiles( void )
 			UTIL_Remove( pFlameEnt );
 		}
 	}
+
+	g_TFFlameManager.RemoveFlamesFromAttacker( this );
 }
 
 //-----------------------------------------------------------------------------
@@ -20,6 +20,7 @@
 #endif
 
 ConVar tf_use_fixed_weaponspreads( "tf_use_fixed_weaponspreads", "1", FCVAR_REPLICATED | FCVAR_NOTIFY, "If set to 1, weapons that fire multiple pellets per shot will use a non-random pellet distribution." );
+ConVar tf_fx_batch_pellets( "tf_fx_batch_pellets", "1", FCVAR_REPLICATED, "If set to 1, all the pellets of a multi-pellet shot are traced together in one packet." );
 
 // Client specific.
 #ifdef CLIENT_DLL
@@ -121,6 +122,59 @@ Vector g_vecFixedWpnSpreadPellets[] =
 	Vector( -0.85,0.85,0 ),	
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Seeds the random stream for one pellet and works out its direction.
+//-----------------------------------------------------------------------------
+static Vector FX_GetPelletDirection( CTFWeaponBase *pWpn, int iBullet, int nBulletsPerShot, int iSeed, bool bFixedSpread,
+									float flSpread, const Vector &vecShootForward, const Vector &vecShootRight, const Vector &vecShootUp )
+{
+	// Initialize random system with this seed.
+	RandomSeed( iSeed );	
+
+	// Get circular gaussian spread. Under some cases we fire a bullet right down the crosshair:
+	//	- The first bullet of a spread weapon (except for rapid fire spread weapons like the minigun)
+	//	- The first bullet of a non-spread weapon if it's been >1.25 second since firing
+	bool bFirePerfect = false;
+	if ( iBullet == 0 && pWpn )
+	{
+		float flTimeSinceLastShot = (gpGlobals->curtime - pWpn->m_flLastFireTime );
+		if ( nBulletsPerShot > 1 && flTimeSinceLastShot > 0.25 )
+		{
+			bFirePerfect = true;
+		}
+		else if ( nBulletsPerShot == 1 && flTimeSinceLastShot > 1.25 )
+		{
+			bFirePerfect = true;
+		}
+	}
+
+	float x,y;
+	if ( bFixedSpread )
+	{
+		int iSpread = iBullet;
+		while ( iSpread >= ARRAYSIZE(g_vecFixedWpnSpreadPellets) )
+		{
+			iSpread -= ARRAYSIZE(g_vecFixedWpnSpreadPellets);
+		}
+		float flScalar = 0.5;
+		x = g_vecFixedWpnSpreadPellets[iSpread].x * flScalar;
+		y = g_vecFixedWpnSpreadPellets[iSpread].y * flScalar;
+	}
+	else if ( bFirePerfect )
+	{
+		x = y = 0;
+	}
+	else
+	{
+		x = RandomFloat( -0.5, 0.5 ) + RandomFloat( -0.5, 0.5 );
+		y = RandomFloat( -0.5, 0.5 ) + RandomFloat( -0.5, 0.5 );
+	}
+
+	Vector vecDir = vecShootForward + ( x *  flSpread * vecShootRight ) + ( y * flSpread * vecShootUp );
+	vecDir.NormalizeInPlace();
+	return vecDir;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: This runs on both the client and the server.  On the server, it 
 // only does the damage calculations.  On the client, it does all the effects.
@@ -274,57 +328,32 @@ void FX_FireBullets( CTFWeaponBase *pWpn, int iPlayer, const Vector &vecOrigin,
 	{
 		CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pWeapon, nBulletsPerShot, mult_bullets_per_shot );
 	}
-	for ( int iBullet = 0; iBullet < nBulletsPerShot; ++iBullet )
+
+	// Trace all the pellets of the shot together, so they share one entity query
+	// instead of each doing their own. The directions depend only on the seeds,
+	// and the loop below reseeds before each pellet exactly as before, so the
+	// random stream FireBullet sees is unchanged.
+	CUtlVectorFixedGrowable< trace_t, 16 > pelletTraces;
+	if ( nBulletsPerShot > 1 && tf_fx_batch_pellets.GetBool() )
 	{
-		// Initialize random system with this seed.
-		RandomSeed( iSeed );	
-
-		// Get circular gaussian spread. Under some cases we fire a bullet right down the crosshair:
-		//	- The first bullet of a spread weapon (except for rapid fire spread weapons like the minigun)
-		//	- The first bullet of a non-spread weapon if it's been >1.25 second since firing
-		bool bFirePerfect = false;
-		if ( iBullet == 0 && pWpn )
+		CUtlVectorFixedGrowable< Vector, 16 > vecPelletDirs;
+		for ( int iBullet = 0; iBullet < nBulletsPerShot; ++iBullet )
 		{
-			float flTimeSinceLastShot = (gpGlobals->curtime - pWpn->m_flLastFireTime );
-			if ( nBulletsPerShot > 1 && flTimeSinceLastShot > 0.25 )
-			{
-				bFirePerfect = true;
-			}
-			else if ( nBulletsPerShot == 1 && flTimeSinceLastShot > 1.25 )
-			{
-				bFirePerfect = true;
-			}
+			vecPelletDirs.AddToTail( FX_GetPelletDirection( pWpn, iBullet, nBulletsPerShot, iSeed + iBullet, bFixedSpread, flSpread, vecShootForward, vecShootRight, vecShootUp ) );
 		}
 
-		float x,y;
-		if ( bFixedSpread )
-		{
-			int iSpread = iBullet;
-			while ( iSpread >= ARRAYSIZE(g_vecFixedWpnSpreadPellets) )
-			{
-				iSpread -= ARRAYSIZE(g_vecFixedWpnSpreadPellets);
-			}
-			float flScalar = 0.5;
-			x = g_vecFixedWpnSpreadPellets[iSpread].x * flScalar;
-			y = g_vecFixedWpnSpreadPellets[iSpread].y * flScalar;
-		}
-		else if ( bFirePerfect )
-		{
-			x = y = 0;
-		}
-		else
-		{
-			x = RandomFloat( -0.5, 0.5 ) + RandomFloat( -0.5, 0.5 );
-			y = RandomFloat( -0.5, 0.5 ) + RandomFloat( -0.5, 0.5 );
-		}
+		pelletTraces.SetCount( nBulletsPerShot );
+		pPlayer->TraceBulletPellets( fireInfo, nBulletsPerShot, vecPelletDirs.Base(), pelletTraces.Base() );
+	}
 
+	for ( int iBullet = 0; iBullet < nBulletsPerShot; ++iBullet )
+	{
 		// Initialize the varialbe firing information.
-		fireInfo.m_vecDirShooting = vecShootForward + ( x *  flSpread * vecShootRight ) + ( y * flSpread * vecShootUp );
-		fireInfo.m_vecDirShooting.NormalizeInPlace();
+		fireInfo.m_vecDirShooting = FX_GetPelletDirection( pWpn, iBullet, nBulletsPerShot, iSeed, bFixedSpread, flSpread, vecShootForward, vecShootRight, vecShootUp );
 		fireInfo.m_bUseServerRandomSeed = pWpn && pWpn->UseServerRandomSeed();
 
 		// Fire a bullet.
-		pPlayer->FireBullet( pWpn, fireInfo, bDoEffects, nDamageType, nCustomDamageType );
+		pPlayer->FireBullet( pWpn, fireInfo, bDoEffects, nDamageType, nCustomDamageType, pelletTraces.Count() ? &pelletTraces[iBullet] : NULL );
 
 		// Use new seed for next bullet.
 		++iSeed; 
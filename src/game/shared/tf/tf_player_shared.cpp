@@ -9793,10 +9793,36 @@ void CTFPlayer::ModifyDamageInfo( CTakeDamageInfo *pInfo, const CBaseEntity *pTa
 }
 #endif
 
+//-----------------------------------------------------------------------------
+// Purpose: Traces every pellet of a shot in one packet, using the same mask and
+//          filter as FireBullet. The results can be handed back to FireBullet.
+//-----------------------------------------------------------------------------
+void CTFPlayer::TraceBulletPellets( const FireBulletsInfo_t &info, int nPellets, const Vector *pDirs, trace_t *pTraces )
+{
+	CUtlVector< Ray_t, CUtlMemoryAligned< Ray_t, 16 > > rays;
+	rays.SetCount( nPellets );
+	for ( int i = 0; i < nPellets; ++i )
+	{
+		rays[i].Init( info.m_vecSrc, info.m_vecSrc + pDirs[i] * info.m_flDistance );
+	}
+
+	// Ignore teammates and their (physical) upgrade items when shooting in MvM
+	if ( TFGameRules() && TFGameRules()->GameModeUsesUpgrades() )
+	{
+		CTraceFilterIgnoreFriendlyCombatItems traceFilter( this, COLLISION_GROUP_NONE, GetTeamNumber() );
+		enginetrace->TraceRays( nPellets, rays.Base(), MASK_SOLID | CONTENTS_HITBOX, &traceFilter, pTraces );
+	}
+	else
+	{
+		CTraceFilterSimple traceFilter( this, COLLISION_GROUP_NONE );
+		enginetrace->TraceRays( nPellets, rays.Base(), MASK_SOLID | CONTENTS_HITBOX, &traceFilter, pTraces );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CTFPlayer::FireBullet( CTFWeaponBase *pWpn, const FireBulletsInfo_t &info, bool bDoEffects, int nDamageType, int nCustomDamageType /*= TF_DMG_CUSTOM_NONE*/ )
+void CTFPlayer::FireBullet( CTFWeaponBase *pWpn, const FireBulletsInfo_t &info, bool bDoEffects, int nDamageType, int nCustomDamageType /*= TF_DMG_CUSTOM_NONE*/, const trace_t *pPelletTrace /*= NULL*/ )
 {
 	// Fire a bullet (ignoring the shooter).
 	Vector vecStart = info.m_vecSrc;
@@ -9812,8 +9838,13 @@ void CTFPlayer::FireBullet( CTFWeaponBase *pWpn, const FireBulletsInfo_t &info,
 	Ray_t ray;
 	ray.Init( vecStart, vecEnd );
 
+	// Use the packet trace from TraceBulletPellets, unless what it hit stopped being solid since
+	if ( pPelletTrace && ( !pPelletTrace->m_pEnt || pPelletTrace->m_pEnt->IsSolid() ) )
+	{
+		trace = *pPelletTrace;
+	}
 	// Ignore teammates and their (physical) upgrade items when shooting in MvM
-	if ( TFGameRules() && TFGameRules()->GameModeUsesUpgrades() )
+	else if ( TFGameRules() && TFGameRules()->GameModeUsesUpgrades() )
 	{
 		CTraceFilterIgnoreFriendlyCombatItems traceFilter( this, COLLISION_GROUP_NONE, GetTeamNumber() );
 		UTIL_TraceLine( vecStart, vecEnd, MASK_SOLID | CONTENTS_HITBOX, &traceFilter, &trace );
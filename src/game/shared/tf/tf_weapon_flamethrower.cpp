@@ -32,6 +32,7 @@
 	#include "particle_parse.h"
 	#include "tf_weaponbase_grenadeproj.h"
 	#include "tf_weapon_compound_bow.h"
+	#include "filters.h"
 	#include "tf_projectile_arrow.h"
 	#include "tf_gamestats.h"
 	#include "NextBot/NextBotManager.h"
@@ -53,6 +54,7 @@
 	ConVar  tf_flamethrower_velocityfadestart("tf_flamethrower_velocityfadestart", ".3", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Time at which attacker's velocity contribution starts to fade." );
 	ConVar  tf_flamethrower_velocityfadeend("tf_flamethrower_velocityfadeend", ".5", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Time at which attacker's velocity contribution finishes fading." );
 	ConVar	tf_flamethrower_burst_zvelocity( "tf_flamethrower_burst_zvelocity", "350", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY );
+	ConVar	tf_flamethrower_batched( "tf_flamethrower_batched", "1", FCVAR_NONE, "Simulate flames in the batched flame manager instead of as tf_flame entities." );
 
 	static const char *s_pszFlameThrowerHitTargetThink = "FlameThrowerHitTargetThink";
 
@@ -678,7 +680,7 @@ void CTFFlameThrower::PrimaryAttack()
 		else
 #endif // STAGING_ONLY
 		{
-			CTFFlameEntity::Create( GetFlameOriginPos(), pOwner->EyeAngles(), this, tf_flamethrower_velocity.GetFloat(), iDmgType, flDamage, iCritFromBehind == 1 );
+			CTFFlameManager::CreateFlame( GetFlameOriginPos(), pOwner->EyeAngles(), this, tf_flamethrower_velocity.GetFloat(), iDmgType, flDamage, iCritFromBehind == 1 );
 		}
 
 		// Pyros can become invis in some game modes.  Hitting fire normally handles this,
@@ -2237,6 +2239,27 @@ END_NETWORK_TABLE()
 LINK_ENTITY_TO_CLASS( tf_flame, CTFFlameEntity );
 IMPLEMENT_AUTO_LIST( ITFFlameEntityAutoList );
 
+// Set by tf_flamethrower_damage_test while it fires a flame, so both simulations
+// draw the same numbers without reseeding the shared streams
+static IUniformRandomStream *s_pFlameRandom = NULL;
+
+static float RandomFlameLifeScale()
+{
+	return ( s_pFlameRandom ? s_pFlameRandom : random )->RandomFloat( 0.9f, 1.1f );
+}
+
+static Vector RandomFlameVector( float flMinVal, float flMaxVal )
+{
+	if ( !s_pFlameRandom )
+		return RandomVector( flMinVal, flMaxVal );
+
+	Vector vecRandom;
+	vecRandom.x = s_pFlameRandom->RandomFloat( flMinVal, flMaxVal );
+	vecRandom.y = s_pFlameRandom->RandomFloat( flMinVal, flMaxVal );
+	vecRandom.z = s_pFlameRandom->RandomFloat( flMinVal, flMaxVal );
+	return vecRandom;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -2276,7 +2299,7 @@ void CTFFlameEntity::Spawn( void )
 
 		float flFlameLife = tf_flamethrower_flametime.GetFloat();
 		CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( GetOwnerEntity(), flFlameLife, mult_flame_life );
-		m_flTimeRemove = gpGlobals->curtime + ( flFlameLife * random->RandomFloat( 0.9f, 1.1f ) );
+		m_flTimeRemove = gpGlobals->curtime + ( flFlameLife * RandomFlameLifeScale() );
 	}
 	else
 	{
@@ -2326,7 +2349,7 @@ CTFFlameEntity *CTFFlameEntity::Create( const Vector &vecOrigin, const QAngle &v
 	CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pFlame->m_hAttacker, iFlameSizeMult, mult_flame_size );
 	if ( bRandomize )
 	{
-		pFlame->m_vecBaseVelocity += RandomVector( -velocity * iFlameSizeMult * tf_flamethrower_vecrand.GetFloat(), velocity * iFlameSizeMult * tf_flamethrower_vecrand.GetFloat() );
+		pFlame->m_vecBaseVelocity += RandomFlameVector( -velocity * iFlameSizeMult * tf_flamethrower_vecrand.GetFloat(), velocity * iFlameSizeMult * tf_flamethrower_vecrand.GetFloat() );
 	}
 	if ( pOwner->GetOwnerEntity() )
 	{
@@ -2517,18 +2540,6 @@ void CTFFlameEntity::FlameThink( void )
 }
 
 
-//-----------------------------------------------------------------------------
-// Purpose: 
-//-----------------------------------------------------------------------------
-void CTFFlameEntity::SetHitTarget( void )
-{
-	if ( !m_hFlameThrower )
-		return;
-
-	m_hFlameThrower->SetHitTarget();
-}
-
-
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -2545,8 +2556,21 @@ void CTFFlameEntity::RemoveFlame()
 //-----------------------------------------------------------------------------
 void CTFFlameEntity::OnCollide( CBaseEntity *pOther )
 {
-	int nContents = UTIL_PointContents( GetAbsOrigin() );
-	if ( (nContents & MASK_WATER) )
+	TFFlameHit_t flame;
+	flame.m_vecOrigin = GetAbsOrigin();
+	flame.m_vecInitialPos = m_vecInitialPos;
+	flame.m_vecBaseVelocity = m_vecBaseVelocity;
+	flame.m_vecVelocity = GetAbsVelocity();
+	flame.m_pOwner = GetOwnerEntity();
+	flame.m_pAttacker = m_hAttacker;
+	flame.m_pFlameThrower = m_hFlameThrower;
+	flame.m_pIgnore = this;
+	flame.m_iDmgType = m_iDmgType;
+	flame.m_flDmgAmount = m_flDmgAmount;
+	flame.m_bCritFromBehind = m_bCritFromBehind;
+
+	TFFlameCollideResult_t eResult = CTFFlameManager::OnCollide( flame, pOther );
+	if ( eResult == TF_FLAME_COLLIDE_EXTINGUISHED )
 	{
 		RemoveFlame();
 		return;
@@ -2554,173 +2578,1047 @@ void CTFFlameEntity::OnCollide( CBaseEntity *pOther )
 
 	// remember that we've burnt this player
 	m_hEntitiesBurnt.AddToTail( pOther );
-	
-	float flDistance = GetAbsOrigin().DistTo( m_vecInitialPos );
-	float flDamage = m_flDmgAmount * RemapValClamped( flDistance, tf_flamethrower_maxdamagedist.GetFloat()/2, tf_flamethrower_maxdamagedist.GetFloat(), 1.0f, 0.70f );
 
-	flDamage = MAX( flDamage, 1.0 );
-	if ( tf_debug_flamethrower.GetInt() )
+	if ( eResult == TF_FLAME_COLLIDE_DAMAGED && m_hFlameThrower )
 	{
-		Msg( "Flame touch dmg: %.1f\n", flDamage );
+		m_bBurnedEnemy = true;
 	}
+}
 
-	CBaseEntity *pAttacker = m_hAttacker;
-	if ( !pAttacker )
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameEntity::OnCollideWithTeammate( CTFPlayer *pPlayer )
+{
+	// Only care about Snipers
+	if ( !pPlayer->IsPlayerClass(TF_CLASS_SNIPER) )
+		return;
+
+	int iIndex = m_hEntitiesBurnt.Find( pPlayer );
+	if ( iIndex != m_hEntitiesBurnt.InvalidIndex() )
 		return;
 
-	SetHitTarget();
+	m_hEntitiesBurnt.AddToTail( pPlayer );
 
-	int iDamageType = m_iDmgType;
+	CTFFlameManager::OnCollideWithTeammate( pPlayer );
+}
 
-	if ( pOther && pOther->IsPlayer() )
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameEntity::UpdateFlameThrowerHitRatio( void )
+{
+	if ( !m_hFlameThrower )
+		return;
+	
+	if ( m_bBurnedEnemy )
 	{
-		CTFPlayer *pVictim = ToTFPlayer( pOther );
-		if ( IsBehindTarget( pOther ) )
-		{
-			if ( m_bCritFromBehind == true )
-			{
-				iDamageType |= DMG_CRITICAL;
-			}
+		m_hFlameThrower->DecrementFlameDamageCount();
+	}
 
-			if ( pVictim )
-			{
-				pVictim->HandleAchievement_Pyro_BurnFromBehind( ToTFPlayer( pAttacker ) );
-			}
-		}
+	m_hFlameThrower->DecrementActiveFlameCount();
+}
 
-		// Pyro-specific
-		if ( pAttacker->IsPlayer() && pVictim )
-		{
-			CTFPlayer *pPlayerAttacker = ToTFPlayer( pAttacker );
-			if ( pPlayerAttacker && pPlayerAttacker->IsPlayerClass( TF_CLASS_PYRO ) )
-			{
-				// burn the victim while taunting?
-				if ( pVictim->m_Shared.InCond( TF_COND_TAUNTING ) )
-				{
-					static CSchemaItemDefHandle flipTaunt( "Flippin' Awesome Taunt" );
-					// if I'm the one being flipped, and getting lit on fire
-					if ( !pVictim->IsTauntInitiator() && pVictim->GetTauntEconItemView() && pVictim->GetTauntEconItemView()->GetItemDefinition() == flipTaunt )
-					{
-						pPlayerAttacker->AwardAchievement( ACHIEVEMENT_TF_PYRO_IGNITE_PLAYER_BEING_FLIPPED );
-					}
-				}
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+float CTFFlameEntity::GetFlameFloat( void )
+{
+	return tf_flamethrower_float.GetFloat();
+}
 
-				pVictim->m_Shared.AddCond( TF_COND_HEALING_DEBUFF, 2.f, pAttacker );
-			}
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+float CTFFlameEntity::GetFlameDrag( void )
+{
+	return tf_flamethrower_drag.GetFloat();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Is the flame travelling the same way the target is facing?
+//-----------------------------------------------------------------------------
+static bool FlameIsBehindTarget( const Vector &vecBaseVelocity, CBaseEntity *pTarget )
+{
+	Assert( pTarget );
+
+	// Get the forward view vector of the target, ignore Z
+	Vector vecVictimForward;
+	AngleVectors( pTarget->EyeAngles(), &vecVictimForward, NULL, NULL );
+	vecVictimForward.z = 0.0f;
+	vecVictimForward.NormalizeInPlace();
+
+	Vector vecTraveling = vecBaseVelocity;
+	vecTraveling.z = 0.0f;
+	vecTraveling.NormalizeInPlace();
+
+	return ( DotProduct( vecVictimForward, vecTraveling ) > 0.8 );
+}
+
+#define TF_FLAME_DAMAGE_TEST_SEED	0x3f1a
+
+//-----------------------------------------------------------------------------
+// Purpose: Scripted damage regression test for the flame simulations. Pins an
+//			attacker and a victim in place, fires the same seeded stream of
+//			flames at the victim once with tf_flame entities and once with the
+//			batched simulation, and compares what each one dealt. Hits are
+//			counted by a damage filter put on the victim for the test.
+//-----------------------------------------------------------------------------
+class CTFFlameDamageTest
+{
+public:
+	CTFFlameDamageTest() : m_nPass( -1 ) {}
+
+	bool IsRunning( void ) const { return m_nPass >= 0; }
+	void Start( CTFPlayer *pAttacker, CTFFlameThrower *pFlameThrower, CTFPlayer *pVictim, int nFlames );
+	void Stop( void );
+	void Update( void );
+	void OnFlameDamage( const CTakeDamageInfo &info );
+
+private:
+	enum
+	{
+		PASS_ENTITIES = 0,
+		PASS_BATCHED,
+
+		PASS_COUNT
+	};
+
+	void PinPlayers( CTFPlayer *pAttacker, CTFPlayer *pVictim );
+	bool HasFlamesInFlight( CTFPlayer *pAttacker ) const;
+	void Report( void );
+
+	CHandle< CTFPlayer >		m_hAttacker;
+	CHandle< CTFFlameThrower >	m_hFlameThrower;
+	CHandle< CTFPlayer >		m_hVictim;
+	EHANDLE						m_hFilter;
+	CUniformRandomStream		m_Random;
+	Vector						m_vecAttackerOrigin;
+	QAngle						m_angAttacker;
+	Vector						m_vecVictimOrigin;
+	QAngle						m_angVictim;
+
+	Vector						m_vecFlameOrigin;
+	QAngle						m_angFlame;
+	int							m_iDmgType;
+	float						m_flDmgAmount;
+	bool						m_bCritFromBehind;
+
+	int							m_nPass;
+	int							m_nFlames;
+	int							m_nFlamesFired;
+	int							m_nHits[PASS_COUNT];
+	int							m_nCrits[PASS_COUNT];
+	float						m_flDamage[PASS_COUNT];
+};
+
+static CTFFlameDamageTest s_FlameDamageTest;
+
+#define TF_FLAME_DAMAGE_TEST_FILTER	"__tf_flame_damage_test_filter"
+
+//-----------------------------------------------------------------------------
+// Purpose: Damage filter the test puts on its victim. Lets everything through
+//			and reports the flame hits, which ignite, but not the afterburn.
+//-----------------------------------------------------------------------------
+class CTFFlameDamageTestFilter : public CBaseFilter
+{
+	DECLARE_CLASS( CTFFlameDamageTestFilter, CBaseFilter );
+
+protected:
+	virtual bool PassesDamageFilterImpl( const CTakeDamageInfo &info )
+	{
+		if ( ( info.GetDamageType() & DMG_IGNITE ) && info.GetDamageCustom() == TF_DMG_CUSTOM_BURNING )
+		{
+			s_FlameDamageTest.OnFlameDamage( info );
 		}
+		return true;
 	}
+};
 
-	CTakeDamageInfo info( GetOwnerEntity(), pAttacker, GetOwnerEntity(), flDamage, iDamageType, TF_DMG_CUSTOM_BURNING );
-	info.SetReportedPosition( pAttacker->GetAbsOrigin() );
+LINK_ENTITY_TO_CLASS( filter_tf_flame_damage_test, CTFFlameDamageTestFilter );
 
-	if ( info.GetDamageType() & DMG_CRITICAL )
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameDamageTest::Start( CTFPlayer *pAttacker, CTFFlameThrower *pFlameThrower, CTFPlayer *pVictim, int nFlames )
+{
+	m_hAttacker = pAttacker;
+	m_hFlameThrower = pFlameThrower;
+	m_hVictim = pVictim;
+	m_vecAttackerOrigin = pAttacker->GetAbsOrigin();
+	m_angAttacker = pAttacker->EyeAngles();
+	m_vecVictimOrigin = pVictim->GetAbsOrigin();
+	m_angVictim = pVictim->EyeAngles();
+
+	// Same damage setup as CTFFlameThrower::PrimaryAttack, minus random crits
+	m_vecFlameOrigin = pFlameThrower->GetFlameOriginPos();
+	m_angFlame = pAttacker->EyeAngles();
+	m_iDmgType = g_aWeaponDamageTypes[ pFlameThrower->GetWeaponID() ];
+
+	const WeaponData_t &weaponData = pFlameThrower->GetTFWpnData().GetWeaponData( TF_WEAPON_PRIMARY_MODE );
+	m_flDmgAmount = (float)weaponData.m_nDamage * weaponData.m_flTimeFireDelay;
+	CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pFlameThrower, m_flDmgAmount, mult_dmg );
+
+	int iCritFromBehind = 0;
+	CALL_ATTRIB_HOOK_INT_ON_OTHER( pFlameThrower, iCritFromBehind, set_flamethrower_back_crit );
+	m_bCritFromBehind = ( iCritFromBehind == 1 );
+
+	// Count the hits with a damage filter on the victim. Players don't normally
+	// have one, and Stop clears it again.
+	CBaseEntity *pFilter = CreateEntityByName( "filter_tf_flame_damage_test" );
+	if ( !pFilter )
+		return;
+
+	pFilter->SetName( AllocPooledString( TF_FLAME_DAMAGE_TEST_FILTER ) );
+	DispatchSpawn( pFilter );
+	m_hFilter = pFilter;
+
+	variant_t filterName;
+	filterName.SetString( pFilter->GetEntityName() );
+	pVictim->AcceptInput( "SetDamageFilter", pAttacker, pAttacker, filterName, 0 );
+
+	m_nPass = PASS_ENTITIES;
+	m_nFlames = nFlames;
+	m_nFlamesFired = 0;
+	for ( int i = 0; i < PASS_COUNT; ++i )
 	{
-		info.SetCritType( CTakeDamageInfo::CRIT_FULL );
+		m_nHits[i] = 0;
+		m_nCrits[i] = 0;
+		m_flDamage[i] = 0.0f;
 	}
 
-	// terrible hack for flames hitting the Merasmus props to get the particle effect in the correct position
-	if ( TFGameRules() && TFGameRules()->GetActiveBoss() && ( TFGameRules()->GetActiveBoss()->GetBossType() == HALLOWEEN_BOSS_MERASMUS ) )
+	Msg( "tf_flamethrower_damage_test: firing %d flames at %s\n", m_nFlames, pVictim->GetPlayerName() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameDamageTest::Stop( void )
+{
+	m_nPass = -1;
+
+	CTFPlayer *pVictim = m_hVictim;
+	if ( pVictim && m_hFilter )
 	{
-		info.SetDamagePosition( GetAbsOrigin() );
+		variant_t emptyName;
+		emptyName.SetString( NULL_STRING );
+		pVictim->AcceptInput( "SetDamageFilter", NULL, NULL, emptyName, 0 );
 	}
 
-	// Track hits for the Flamethrower, which is used to change the weapon sound based on hit ratio
-	if ( m_hFlameThrower )
+	if ( m_hFilter )
 	{
-		m_bBurnedEnemy = true;
-		m_hFlameThrower->IncrementFlameDamageCount();
+		UTIL_Remove( m_hFilter );
+		m_hFilter = NULL;
 	}
-
-	// We collided with pOther, so try to find a place on their surface to show blood
-	trace_t pTrace;
-	UTIL_TraceLine( WorldSpaceCenter(), pOther->WorldSpaceCenter(), MASK_SOLID|CONTENTS_HITBOX, this, COLLISION_GROUP_NONE, &pTrace );
-
-	pOther->DispatchTraceAttack( info, GetAbsVelocity(), &pTrace );
-	ApplyMultiDamage();
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: 
+// Purpose: Runs once per tick, ahead of the batched flame update
 //-----------------------------------------------------------------------------
-void CTFFlameEntity::OnCollideWithTeammate( CTFPlayer *pPlayer )
+void CTFFlameDamageTest::Update( void )
 {
-	// Only care about Snipers
-	if ( !pPlayer->IsPlayerClass(TF_CLASS_SNIPER) )
+	if ( !IsRunning() )
 		return;
 
-	int iIndex = m_hEntitiesBurnt.Find( pPlayer );
-	if ( iIndex != m_hEntitiesBurnt.InvalidIndex() )
+	CTFPlayer *pAttacker = m_hAttacker;
+	CTFPlayer *pVictim = m_hVictim;
+	CTFFlameThrower *pFlameThrower = m_hFlameThrower;
+	if ( !pAttacker || !pVictim || !pFlameThrower || !pAttacker->IsAlive() || !pVictim->IsAlive() )
+	{
+		Msg( "tf_flamethrower_damage_test: aborted, the attacker or the target went away\n" );
+		Stop();
 		return;
+	}
 
-	m_hEntitiesBurnt.AddToTail( pPlayer );
+	PinPlayers( pAttacker, pVictim );
 
-	// Does he have the bow?
-	CTFWeaponBase *pWpn = pPlayer->GetActiveTFWeapon();
-	if ( pWpn && pWpn->GetWeaponID() == TF_WEAPON_COMPOUND_BOW )
+	if ( m_nFlamesFired < m_nFlames )
 	{
-		CTFCompoundBow *pBow = static_cast<CTFCompoundBow*>( pWpn );
-		pBow->SetArrowAlight( true );
+		// Both passes draw the same random numbers for the same flame
+		m_Random.SetSeed( TF_FLAME_DAMAGE_TEST_SEED + m_nFlamesFired );
+		s_pFlameRandom = &m_Random;
+
+		if ( m_nPass == PASS_ENTITIES )
+		{
+			CTFFlameEntity::Create( m_vecFlameOrigin, m_angFlame, pFlameThrower, tf_flamethrower_velocity.GetFloat(), m_iDmgType, m_flDmgAmount, m_bCritFromBehind );
+		}
+		else
+		{
+			g_TFFlameManager.AddFlame( m_vecFlameOrigin, m_angFlame, pFlameThrower, tf_flamethrower_velocity.GetFloat(), m_iDmgType, m_flDmgAmount, m_bCritFromBehind );
+		}
+
+		s_pFlameRandom = NULL;
+
+		++m_nFlamesFired;
+		return;
+	}
+
+	// Let every flame of this pass burn out before starting the next one
+	if ( HasFlamesInFlight( pAttacker ) )
+		return;
+
+	if ( ++m_nPass < PASS_COUNT )
+	{
+		m_nFlamesFired = 0;
+		return;
 	}
+
+	Report();
+	Stop();
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: 
+// Purpose: Hold both players still and keep the victim alive
 //-----------------------------------------------------------------------------
-bool CTFFlameEntity::IsBehindTarget( CBaseEntity *pTarget )
+void CTFFlameDamageTest::PinPlayers( CTFPlayer *pAttacker, CTFPlayer *pVictim )
 {
-	return ( DotProductToTarget( pTarget ) > 0.8 );
+	pAttacker->Teleport( &m_vecAttackerOrigin, NULL, &vec3_origin );
+	pAttacker->SnapEyeAngles( m_angAttacker );
+
+	pVictim->Teleport( &m_vecVictimOrigin, NULL, &vec3_origin );
+	pVictim->SnapEyeAngles( m_angVictim );
+	pVictim->SetHealth( pVictim->GetMaxHealth() );
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Utility to calculate dot product between facing angles of flame and target
+// Purpose: 
 //-----------------------------------------------------------------------------
-float CTFFlameEntity::DotProductToTarget( CBaseEntity *pTarget )
+bool CTFFlameDamageTest::HasFlamesInFlight( CTFPlayer *pAttacker ) const
 {
-	Assert( pTarget );
+	if ( g_TFFlameManager.GetFlameCount( pAttacker ) > 0 )
+		return true;
 
-	// Get the forward view vector of the target, ignore Z
-	Vector vecVictimForward;
-	AngleVectors( pTarget->EyeAngles(), &vecVictimForward, NULL, NULL );
-	vecVictimForward.z = 0.0f;
-	vecVictimForward.NormalizeInPlace();
+	FOR_EACH_VEC( ITFFlameEntityAutoList::AutoList(), i )
+	{
+		CTFFlameEntity *pFlameEnt = static_cast< CTFFlameEntity* >( ITFFlameEntityAutoList::AutoList()[i] );
+		if ( pFlameEnt->IsEntityAttacker( pAttacker ) )
+			return true;
+	}
 
-	Vector vecTraveling = m_vecBaseVelocity;
-	vecTraveling.z = 0.0f;
-	vecTraveling.NormalizeInPlace();
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called by the victim's damage filter for every flame hit
+//-----------------------------------------------------------------------------
+void CTFFlameDamageTest::OnFlameDamage( const CTakeDamageInfo &info )
+{
+	if ( !IsRunning() || info.GetAttacker() != m_hAttacker.Get() )
+		return;
 
-	return DotProduct( vecVictimForward, vecTraveling );
+	++m_nHits[m_nPass];
+	if ( info.GetDamageType() & DMG_CRITICAL )
+	{
+		++m_nCrits[m_nPass];
+	}
+	m_flDamage[m_nPass] += info.GetDamage();
 }
 
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-void CTFFlameEntity::UpdateFlameThrowerHitRatio( void )
+void CTFFlameDamageTest::Report( void )
 {
-	if ( !m_hFlameThrower )
+	Msg( "tf_flamethrower_damage_test: %d flames per pass\n", m_nFlames );
+	Msg( "  tf_flame entities: %4d hits %4d crits %9.2f damage\n", m_nHits[PASS_ENTITIES], m_nCrits[PASS_ENTITIES], m_flDamage[PASS_ENTITIES] );
+	Msg( "  batched flames:    %4d hits %4d crits %9.2f damage\n", m_nHits[PASS_BATCHED], m_nCrits[PASS_BATCHED], m_flDamage[PASS_BATCHED] );
+
+	bool bMatch = ( m_nHits[PASS_ENTITIES] == m_nHits[PASS_BATCHED] ) &&
+				  ( m_nCrits[PASS_ENTITIES] == m_nCrits[PASS_BATCHED] ) &&
+				  ( fabs( m_flDamage[PASS_ENTITIES] - m_flDamage[PASS_BATCHED] ) < 0.01f );
+	Msg( "  %s\n", bMatch ? "PASS" : "FAIL" );
+}
+
+CON_COMMAND_F( tf_flamethrower_damage_test, "Fires the same seeded flames at the enemy you are aiming at with tf_flame entities and with the batched flame simulation, and compares the damage dealt. The target should be standing still. Usage: tf_flamethrower_damage_test [flames]", FCVAR_CHEAT )
+{
+	CTFPlayer *pAttacker = ToTFPlayer( UTIL_GetCommandClient() );
+	if ( !pAttacker )
 		return;
-	
-	if ( m_bBurnedEnemy )
+
+	if ( s_FlameDamageTest.IsRunning() )
 	{
-		m_hFlameThrower->DecrementFlameDamageCount();
+		Msg( "tf_flamethrower_damage_test: a test is already running\n" );
+		return;
 	}
 
-	m_hFlameThrower->DecrementActiveFlameCount();
+	CTFFlameThrower *pFlameThrower = dynamic_cast< CTFFlameThrower* >( pAttacker->GetActiveTFWeapon() );
+	if ( !pFlameThrower )
+	{
+		Msg( "tf_flamethrower_damage_test: switch to a flamethrower first\n" );
+		return;
+	}
+
+	Vector vecForward;
+	AngleVectors( pAttacker->EyeAngles(), &vecForward );
+
+	trace_t tr;
+	UTIL_TraceLine( pAttacker->EyePosition(), pAttacker->EyePosition() + vecForward * tf_flamethrower_maxdamagedist.GetFloat(), MASK_SHOT, pAttacker, COLLISION_GROUP_NONE, &tr );
+
+	CTFPlayer *pVictim = ToTFPlayer( tr.m_pEnt );
+	if ( !pVictim || !pVictim->IsAlive() || pVictim->InSameTeam( pAttacker ) )
+	{
+		Msg( "tf_flamethrower_damage_test: aim at an enemy player within %.0f units\n", tf_flamethrower_maxdamagedist.GetFloat() );
+		return;
+	}
+
+	int nFlames = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 66;
+	s_FlameDamageTest.Start( pAttacker, pFlameThrower, pVictim, clamp( nFlames, 1, 1000 ) );
 }
 
+CTFFlameManager g_TFFlameManager;
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-float CTFFlameEntity::GetFlameFloat( void )
+CTFFlameManager::CTFFlameManager() : CAutoGameSystemPerFrame( "CTFFlameManager" )
 {
-	return tf_flamethrower_float.GetFloat();
 }
 
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-float CTFFlameEntity::GetFlameDrag( void )
+void CTFFlameManager::LevelShutdownPostEntity()
 {
-	return tf_flamethrower_drag.GetFloat();
+	s_FlameDamageTest.Stop();
+	RemoveAllFlames();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameManager::CreateFlame( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, float flSpeed, int iDmgType, float flDmgAmount, bool bAlwaysCritFromBehind )
+{
+	if ( tf_flamethrower_batched.GetBool() )
+	{
+		g_TFFlameManager.AddFlame( vecOrigin, vecAngles, pOwner, flSpeed, iDmgType, flDmgAmount, bAlwaysCritFromBehind );
+	}
+	else
+	{
+		CTFFlameEntity::Create( vecOrigin, vecAngles, pOwner, flSpeed, iDmgType, flDmgAmount, bAlwaysCritFromBehind );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Queues a flame. It is set up exactly like CTFFlameEntity::Spawn and
+//			Create, drawing the same random numbers in the same order, and
+//			starts moving on the next tick like a newly spawned entity would.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::AddFlame( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, float flSpeed, int iDmgType, float flDmgAmount, bool bAlwaysCritFromBehind, bool bRandomize )
+{
+	if ( !pOwner )
+		return;
+
+	FlameSpawn_t &spawn = m_PendingFlames[ m_PendingFlames.AddToTail() ];
+	spawn.m_vecOrigin = vecOrigin;
+	spawn.m_hOwner = pOwner;
+	spawn.m_hAttacker = pOwner->GetOwnerEntity() ? pOwner->GetOwnerEntity() : pOwner;
+	spawn.m_hFlameThrower = dynamic_cast< CTFFlameThrower* >( pOwner );
+	spawn.m_iDmgType = iDmgType;
+	spawn.m_flDmgAmount = flDmgAmount;
+	spawn.m_bCritFromBehind = bAlwaysCritFromBehind;
+
+	float flBoxSize = tf_flamethrower_boxsize.GetFloat();
+	CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pOwner, flBoxSize, mult_flame_size );
+	spawn.m_flBoxSize = flBoxSize;
+
+	// Track total active flames
+	if ( spawn.m_hFlameThrower )
+	{
+		spawn.m_hFlameThrower->IncrementActiveFlameCount();
+
+		float flFlameLife = tf_flamethrower_flametime.GetFloat();
+		CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pOwner, flFlameLife, mult_flame_life );
+		spawn.m_flTimeRemove = gpGlobals->curtime + ( flFlameLife * RandomFlameLifeScale() );
+	}
+	else
+	{
+		spawn.m_flTimeRemove = gpGlobals->curtime + 3.f;
+	}
+
+	// Setup the initial velocity.
+	Vector vecForward;
+	AngleVectors( vecAngles, &vecForward );
+
+	CBaseEntity *pAttacker = spawn.m_hAttacker;
+	float flFlameLifeMult = 1.0f;
+	CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pAttacker, flFlameLifeMult, mult_flame_life );
+	float flVelocity = flFlameLifeMult * flSpeed;
+	spawn.m_vecBaseVelocity = vecForward * flVelocity;
+	float flFlameSizeMult = 1.0f;
+	CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pAttacker, flFlameSizeMult, mult_flame_size );
+	if ( bRandomize )
+	{
+		spawn.m_vecBaseVelocity += RandomFlameVector( -flVelocity * flFlameSizeMult * tf_flamethrower_vecrand.GetFloat(), flVelocity * flFlameSizeMult * tf_flamethrower_vecrand.GetFloat() );
+	}
+
+	spawn.m_vecAttackerVelocity = pOwner->GetOwnerEntity() ? pOwner->GetOwnerEntity()->GetAbsVelocity() : vec3_origin;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Moves the flames fired this tick into the simulation
+//-----------------------------------------------------------------------------
+void CTFFlameManager::CommitPendingFlames()
+{
+	FOR_EACH_VEC( m_PendingFlames, i )
+	{
+		const FlameSpawn_t &spawn = m_PendingFlames[i];
+
+		int iFlame = m_Flames.AddToTail();
+		if ( ( iFlame & 3 ) == 0 )
+		{
+			// Start a new block of four, zeroed so the unused lanes stay well behaved
+			m_vecPos[ m_vecPos.AddToTail() ].DuplicateVector( vec3_origin );
+			m_vecPrevPos[ m_vecPrevPos.AddToTail() ].DuplicateVector( vec3_origin );
+			m_vecBaseVelocity[ m_vecBaseVelocity.AddToTail() ].DuplicateVector( vec3_origin );
+			m_vecAttackerVelocity[ m_vecAttackerVelocity.AddToTail() ].DuplicateVector( vec3_origin );
+			m_vecVelocity[ m_vecVelocity.AddToTail() ].DuplicateVector( vec3_origin );
+		}
+
+		FlameInfo_t &info = m_Flames[iFlame];
+		info.m_vecInitialPos = spawn.m_vecOrigin;
+		info.m_hOwner = spawn.m_hOwner;
+		info.m_hAttacker = spawn.m_hAttacker;
+		info.m_hFlameThrower = spawn.m_hFlameThrower;
+		info.m_flTimeRemove = spawn.m_flTimeRemove;
+		info.m_flBoxSize = spawn.m_flBoxSize;
+		info.m_flDmgAmount = spawn.m_flDmgAmount;
+		info.m_iDmgType = spawn.m_iDmgType;
+		info.m_bCritFromBehind = spawn.m_bCritFromBehind;
+		info.m_bBurnedEnemy = false;
+		info.m_bRemove = false;
+
+		int iBlock = iFlame >> 2;
+		SetFlameVector( m_vecPos[iBlock], iFlame, spawn.m_vecOrigin );
+		SetFlameVector( m_vecPrevPos[iBlock], iFlame, spawn.m_vecOrigin );
+		SetFlameVector( m_vecBaseVelocity[iBlock], iFlame, spawn.m_vecBaseVelocity );
+		SetFlameVector( m_vecAttackerVelocity[iBlock], iFlame, spawn.m_vecAttackerVelocity );
+		SetFlameVector( m_vecVelocity[iBlock], iFlame, spawn.m_vecBaseVelocity );
+	}
+
+	m_PendingFlames.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Advances every flame by one tick
+//-----------------------------------------------------------------------------
+void CTFFlameManager::FrameUpdatePostEntityThink()
+{
+	s_FlameDamageTest.Update();
+
+	if ( !m_Flames.Count() && !m_PendingFlames.Count() )
+		return;
+
+	VPROF_BUDGET( "CTFFlameManager::FrameUpdatePostEntityThink", VPROF_BUDGETGROUP_GAME );
+
+	// Retire expired flames and sort the rest into one batch per attacker
+	int nGroups = 0;
+	FOR_EACH_VEC( m_Flames, i )
+	{
+		FlameInfo_t &info = m_Flames[i];
+		if ( info.m_bRemove )
+			continue;
+
+		// if we've expired, remove ourselves
+		if ( gpGlobals->curtime >= info.m_flTimeRemove )
+		{
+			info.m_bRemove = true;
+			continue;
+		}
+
+		// Did we move? should we check collision?
+		Vector vecPos = GetFlameVector( m_vecPos[ i >> 2 ], i );
+		Vector vecPrevPos = GetFlameVector( m_vecPrevPos[ i >> 2 ], i );
+		if ( vecPos == vecPrevPos )
+			continue;
+
+		// A flame whose attacker is gone can never burn anything again
+		CTFPlayer *pAttacker = dynamic_cast< CTFPlayer* >( info.m_hAttacker.Get() );
+		if ( !pAttacker )
+		{
+			info.m_bRemove = true;
+			continue;
+		}
+
+		Vector vecExtents( info.m_flBoxSize, info.m_flBoxSize, info.m_flBoxSize );
+		Vector vecMins, vecMaxs;
+		VectorMin( vecPrevPos, vecPos, vecMins );
+		VectorMax( vecPrevPos, vecPos, vecMaxs );
+		vecMins -= vecExtents;
+		vecMaxs += vecExtents;
+
+		int iGroup = 0;
+		while ( iGroup < nGroups && m_Groups[iGroup].m_pAttacker != pAttacker )
+		{
+			++iGroup;
+		}
+
+		if ( iGroup == nGroups )
+		{
+			if ( nGroups == m_Groups.Count() )
+			{
+				m_Groups.AddToTail();
+			}
+
+			FlameGroup_t &group = m_Groups[ nGroups++ ];
+			group.m_pAttacker = pAttacker;
+			group.m_vecMins = vecMins;
+			group.m_vecMaxs = vecMaxs;
+			group.m_Flames.RemoveAll();
+		}
+		else
+		{
+			FlameGroup_t &group = m_Groups[iGroup];
+			VectorMin( group.m_vecMins, vecMins, group.m_vecMins );
+			VectorMax( group.m_vecMaxs, vecMaxs, group.m_vecMaxs );
+		}
+
+		m_Groups[iGroup].m_Flames.AddToTail( i );
+	}
+
+	for ( int iGroup = 0; iGroup < nGroups; ++iGroup )
+	{
+		CollideGroup( m_Groups[iGroup] );
+	}
+
+	// Render debug visualization if convar on
+	if ( tf_debug_flamethrower.GetInt() )
+	{
+		FOR_EACH_VEC( m_Flames, i )
+		{
+			const FlameInfo_t &info = m_Flames[i];
+			if ( info.m_bRemove )
+				continue;
+
+			Vector vecExtents( info.m_flBoxSize, info.m_flBoxSize, info.m_flBoxSize );
+			if ( info.m_hEntitiesBurnt.Count() > 0 )
+			{
+				int val = ( (int) ( gpGlobals->curtime * 10 ) ) % 255;
+				NDebugOverlay::Box( GetFlameVector( m_vecPos[ i >> 2 ], i ), -vecExtents, vecExtents, val, 255, val, 0, 0 );
+			}
+			else
+			{
+				NDebugOverlay::Box( GetFlameVector( m_vecPos[ i >> 2 ], i ), -vecExtents, vecExtents, 0, 100, 255, 0, 0 );
+			}
+		}
+	}
+
+	Integrate();
+
+	// Compact out everything that was removed, back to front so each flame
+	// swapped into a hole has already been checked
+	for ( int i = m_Flames.Count() - 1; i >= 0; --i )
+	{
+		if ( m_Flames[i].m_bRemove )
+		{
+			RemoveFlame( i );
+		}
+	}
+
+	CommitPendingFlames();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collides all of one attacker's flames against one shared set of
+//			candidate targets.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::CollideGroup( FlameGroup_t &group )
+{
+	// A single partition query covers the sweep of every flame in the group
+	CFlameEntityEnum eFlameEnum( group.m_pAttacker );
+	enginetrace->EnumerateEntities( group.m_vecMins, group.m_vecMaxs, &eFlameEnum );
+
+	// Bounds the partition keeps for each target, see CCollisionProperty::UpdatePartition
+	const CUtlVector< CBaseEntity* > &targets = eFlameEnum.GetTargets();
+	CUtlVectorFixedGrowable< Vector, 64 > targetBounds;
+	targetBounds.SetCount( targets.Count() * 2 );
+	FOR_EACH_VEC( targets, i )
+	{
+		targets[i]->CollisionProp()->WorldSpaceSurroundingBounds( &targetBounds[ 2 * i ], &targetBounds[ 2 * i + 1 ] );
+		targetBounds[ 2 * i ] -= Vector( 1, 1, 1 );
+		targetBounds[ 2 * i + 1 ] += Vector( 1, 1, 1 );
+	}
+
+	FOR_EACH_VEC( group.m_Flames, i )
+	{
+		CollideFlame( group.m_Flames[i], group.m_pAttacker, targets, targetBounds.Base() );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same collision rules as CTFFlameEntity::FlameThink
+//-----------------------------------------------------------------------------
+void CTFFlameManager::CollideFlame( int iFlame, CTFPlayer *pAttacker, const CUtlVector< CBaseEntity* > &targets, const Vector *pTargetBounds )
+{
+	FlameInfo_t &info = m_Flames[iFlame];
+	Vector vecPos = GetFlameVector( m_vecPos[ iFlame >> 2 ], iFlame );
+	Vector vecPrevPos = GetFlameVector( m_vecPrevPos[ iFlame >> 2 ], iFlame );
+	Vector vecMaxs( info.m_flBoxSize, info.m_flBoxSize, info.m_flBoxSize );
+	Vector vecMins = -vecMaxs;
+
+	// Create a ray for flame entity to trace
+	Ray_t rayWorld;
+	rayWorld.Init( info.m_vecInitialPos, vecPos, vecMins, vecMaxs );
+
+	// check against world first
+	// if we collide with world, just destroy the flame
+	trace_t trWorld;
+	UTIL_TraceRay( rayWorld, MASK_SOLID, NULL, COLLISION_GROUP_DEBRIS, &trWorld );
+
+	bool bHitWorld = trWorld.startsolid || trWorld.fraction < 1.f;
+
+	// update the ray
+	Ray_t rayEnt;
+	rayEnt.Init( vecPrevPos, vecPos, vecMins, vecMaxs );
+
+	TFFlameHit_t flame;
+	flame.m_vecOrigin = vecPos;
+	flame.m_vecInitialPos = info.m_vecInitialPos;
+	flame.m_vecBaseVelocity = GetFlameVector( m_vecBaseVelocity[ iFlame >> 2 ], iFlame );
+	flame.m_vecVelocity = GetFlameVector( m_vecVelocity[ iFlame >> 2 ], iFlame );
+	flame.m_pOwner = info.m_hOwner;
+	flame.m_pAttacker = pAttacker;
+	flame.m_pFlameThrower = info.m_hFlameThrower;
+	flame.m_pIgnore = NULL;
+	flame.m_iDmgType = info.m_iDmgType;
+	flame.m_flDmgAmount = info.m_flDmgAmount;
+	flame.m_bCritFromBehind = info.m_bCritFromBehind;
+
+	// burn all entities that we should collide with
+	bool bHitSomething = false;
+	FOR_EACH_VEC( targets, i )
+	{
+		CBaseEntity *pEnt = targets[i];
+
+		// the query was for the whole group, narrow it down to this flame's sweep
+		if ( !IsBoxIntersectingRay( pTargetBounds[ 2 * i ], pTargetBounds[ 2 * i + 1 ], rayEnt ) )
+			continue;
+
+		// an earlier flame may have killed it this tick
+		if ( ( pEnt->IsPlayer() || pEnt->MyNextBotPointer() ) && !pEnt->IsAlive() )
+			continue;
+
+		// skip ent that's already burnt by this flame
+		int iIndex = info.m_hEntitiesBurnt.Find( pEnt );
+		if ( iIndex != info.m_hEntitiesBurnt.InvalidIndex() )
+			continue;
+
+		// if we're removing the flame this frame from hitting world, check if we hit this ent before hitting the world
+		if ( bHitWorld )
+		{
+			trace_t trEnt;
+			enginetrace->ClipRayToEntity( rayWorld, MASK_SOLID | CONTENTS_HITBOX, pEnt, &trEnt );
+			// hit world before this ent, skip it
+			if ( trEnt.fraction >= trWorld.fraction )
+				continue;
+		}
+
+		// burn them all!
+		if ( pEnt->IsPlayer() && pEnt->InSameTeam( pAttacker ) )
+		{
+			// Only care about Snipers
+			CTFPlayer *pPlayer = ToTFPlayer( pEnt );
+			if ( pPlayer->IsPlayerClass( TF_CLASS_SNIPER ) )
+			{
+				info.m_hEntitiesBurnt.AddToTail( pPlayer );
+				OnCollideWithTeammate( pPlayer );
+			}
+		}
+		else
+		{
+			TFFlameCollideResult_t eResult = OnCollide( flame, pEnt );
+			if ( eResult == TF_FLAME_COLLIDE_EXTINGUISHED )
+			{
+				info.m_bRemove = true;
+			}
+			else
+			{
+				// remember that we've burnt this player
+				info.m_hEntitiesBurnt.AddToTail( pEnt );
+
+				if ( eResult == TF_FLAME_COLLIDE_DAMAGED && info.m_hFlameThrower )
+				{
+					info.m_bBurnedEnemy = true;
+				}
+			}
+		}
+
+		bHitSomething = true;
+	}
+
+	if ( bHitSomething && tf_debug_flamethrower.GetBool() )
+	{
+		NDebugOverlay::SweptBox( vecPrevPos, vecPos, vecMins, vecMaxs, vec3_angle, 255, 255, 0, 100, 5.0 );
+		NDebugOverlay::Box( vecPos, vecMins, vecMaxs, 255, 255, 0, 100, 5.0 );
+	}
+
+	// remove the flame if it hits the world
+	if ( bHitWorld )
+	{
+		if ( tf_debug_flamethrower.GetInt() )
+		{
+			NDebugOverlay::SweptBox( info.m_vecInitialPos, vecPos, vecMins, vecMaxs, vec3_angle, 255, 0, 0, 100, 3.0 );
+		}
+
+		info.m_bRemove = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The velocity update from CTFFlameEntity::FlameThink followed by the
+//			MOVETYPE_NOCLIP step, four flames at a time
+//-----------------------------------------------------------------------------
+void CTFFlameManager::Integrate()
+{
+	fltx4 fl4Drag = ReplicateX4( tf_flamethrower_drag.GetFloat() );
+	fltx4 fl4FrameTime = ReplicateX4( gpGlobals->frametime );
+	FourVectors vecFloat;
+	vecFloat.DuplicateVector( Vector( 0, 0, tf_flamethrower_float.GetFloat() ) );
+
+	for ( int i = 0; i < m_vecPos.Count(); ++i )
+	{
+		// Reduce our base velocity by the air drag constant
+		m_vecBaseVelocity[i] *= fl4Drag;
+
+		// Add our float upward velocity
+		FourVectors vecVelocity = m_vecBaseVelocity[i];
+		vecVelocity += vecFloat;
+		vecVelocity += m_vecAttackerVelocity[i];
+		m_vecVelocity[i] = vecVelocity;
+
+		m_vecPrevPos[i] = m_vecPos[i];
+
+		vecVelocity *= fl4FrameTime;
+		m_vecPos[i] += vecVelocity;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Swaps the last flame into the slot being removed
+//-----------------------------------------------------------------------------
+void CTFFlameManager::RemoveFlame( int iFlame )
+{
+	UpdateFlameThrowerHitRatio( m_Flames[iFlame] );
+
+	int iLast = m_Flames.Count() - 1;
+	if ( iFlame != iLast )
+	{
+		int iBlock = iFlame >> 2;
+		int iLastBlock = iLast >> 2;
+		SetFlameVector( m_vecPos[iBlock], iFlame, GetFlameVector( m_vecPos[iLastBlock], iLast ) );
+		SetFlameVector( m_vecPrevPos[iBlock], iFlame, GetFlameVector( m_vecPrevPos[iLastBlock], iLast ) );
+		SetFlameVector( m_vecBaseVelocity[iBlock], iFlame, GetFlameVector( m_vecBaseVelocity[iLastBlock], iLast ) );
+		SetFlameVector( m_vecAttackerVelocity[iBlock], iFlame, GetFlameVector( m_vecAttackerVelocity[iLastBlock], iLast ) );
+		SetFlameVector( m_vecVelocity[iBlock], iFlame, GetFlameVector( m_vecVelocity[iLastBlock], iLast ) );
+	}
+
+	m_Flames.FastRemove( iFlame );
+
+	// Drop the last block once it's empty
+	if ( ( iLast & 3 ) == 0 )
+	{
+		m_vecPos.RemoveMultipleFromTail( 1 );
+		m_vecPrevPos.RemoveMultipleFromTail( 1 );
+		m_vecBaseVelocity.RemoveMultipleFromTail( 1 );
+		m_vecAttackerVelocity.RemoveMultipleFromTail( 1 );
+		m_vecVelocity.RemoveMultipleFromTail( 1 );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameManager::RemoveAllFlames()
+{
+	m_Flames.Purge();
+	m_PendingFlames.Purge();
+	m_Groups.Purge();
+	m_vecPos.Purge();
+	m_vecPrevPos.Purge();
+	m_vecBaseVelocity.Purge();
+	m_vecAttackerVelocity.Purge();
+	m_vecVelocity.Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Flames are only flagged here, since this can be reached from the
+//			damage we deal while simulating. They are dropped at the end of the
+//			next update.
+//-----------------------------------------------------------------------------
+void CTFFlameManager::RemoveFlamesFromAttacker( CBaseEntity *pAttacker )
+{
+	FOR_EACH_VEC( m_Flames, i )
+	{
+		if ( m_Flames[i].m_hAttacker.Get() == pAttacker )
+		{
+			m_Flames[i].m_bRemove = true;
+		}
+	}
+
+	FOR_EACH_VEC_BACK( m_PendingFlames, i )
+	{
+		if ( m_PendingFlames[i].m_hAttacker.Get() == pAttacker )
+		{
+			if ( m_PendingFlames[i].m_hFlameThrower )
+			{
+				m_PendingFlames[i].m_hFlameThrower->DecrementActiveFlameCount();
+			}
+
+			m_PendingFlames.Remove( i );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int CTFFlameManager::GetFlameCount( CBaseEntity *pAttacker ) const
+{
+	int nCount = 0;
+	FOR_EACH_VEC( m_Flames, i )
+	{
+		if ( !m_Flames[i].m_bRemove && ( !pAttacker || m_Flames[i].m_hAttacker.Get() == pAttacker ) )
+		{
+			++nCount;
+		}
+	}
+
+	FOR_EACH_VEC( m_PendingFlames, i )
+	{
+		if ( !pAttacker || m_PendingFlames[i].m_hAttacker.Get() == pAttacker )
+		{
+			++nCount;
+		}
+	}
+
+	return nCount;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CTFFlameManager::UpdateFlameThrowerHitRatio( const FlameInfo_t &info )
+{
+	CTFFlameThrower *pFlameThrower = info.m_hFlameThrower;
+	if ( !pFlameThrower )
+		return;
+
+	if ( info.m_bBurnedEnemy )
+	{
+		pFlameThrower->DecrementFlameDamageCount();
+	}
+
+	pFlameThrower->DecrementActiveFlameCount();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when a flame has collided with another entity
+//-----------------------------------------------------------------------------
+TFFlameCollideResult_t CTFFlameManager::OnCollide( const TFFlameHit_t &flame, CBaseEntity *pOther )
+{
+	int nContents = UTIL_PointContents( flame.m_vecOrigin );
+	if ( (nContents & MASK_WATER) )
+		return TF_FLAME_COLLIDE_EXTINGUISHED;
+
+	float flDistance = flame.m_vecOrigin.DistTo( flame.m_vecInitialPos );
+	float flDamage = flame.m_flDmgAmount * RemapValClamped( flDistance, tf_flamethrower_maxdamagedist.GetFloat()/2, tf_flamethrower_maxdamagedist.GetFloat(), 1.0f, 0.70f );
+
+	flDamage = MAX( flDamage, 1.0 );
+	if ( tf_debug_flamethrower.GetInt() )
+	{
+		Msg( "Flame touch dmg: %.1f\n", flDamage );
+	}
+
+	CBaseEntity *pAttacker = flame.m_pAttacker;
+	if ( !pAttacker )
+		return TF_FLAME_COLLIDE_NO_ATTACKER;
+
+	if ( flame.m_pFlameThrower )
+	{
+		flame.m_pFlameThrower->SetHitTarget();
+	}
+
+	int iDamageType = flame.m_iDmgType;
+
+	if ( pOther && pOther->IsPlayer() )
+	{
+		CTFPlayer *pVictim = ToTFPlayer( pOther );
+		if ( FlameIsBehindTarget( flame.m_vecBaseVelocity, pOther ) )
+		{
+			if ( flame.m_bCritFromBehind == true )
+			{
+				iDamageType |= DMG_CRITICAL;
+			}
+
+			if ( pVictim )
+			{
+				pVictim->HandleAchievement_Pyro_BurnFromBehind( ToTFPlayer( pAttacker ) );
+			}
+		}
+
+		// Pyro-specific
+		if ( pAttacker->IsPlayer() && pVictim )
+		{
+			CTFPlayer *pPlayerAttacker = ToTFPlayer( pAttacker );
+			if ( pPlayerAttacker && pPlayerAttacker->IsPlayerClass( TF_CLASS_PYRO ) )
+			{
+				// burn the victim while taunting?
+				if ( pVictim->m_Shared.InCond( TF_COND_TAUNTING ) )
+				{
+					static CSchemaItemDefHandle flipTaunt( "Flippin' Awesome Taunt" );
+					// if I'm the one being flipped, and getting lit on fire
+					if ( !pVictim->IsTauntInitiator() && pVictim->GetTauntEconItemView() && pVictim->GetTauntEconItemView()->GetItemDefinition() == flipTaunt )
+					{
+						pPlayerAttacker->AwardAchievement( ACHIEVEMENT_TF_PYRO_IGNITE_PLAYER_BEING_FLIPPED );
+					}
+				}
+
+				pVictim->m_Shared.AddCond( TF_COND_HEALING_DEBUFF, 2.f, pAttacker );
+			}
+		}
+	}
+
+	CTakeDamageInfo info( flame.m_pOwner, pAttacker, flame.m_pOwner, flDamage, iDamageType, TF_DMG_CUSTOM_BURNING );
+	info.SetReportedPosition( pAttacker->GetAbsOrigin() );
+
+	if ( info.GetDamageType() & DMG_CRITICAL )
+	{
+		info.SetCritType( CTakeDamageInfo::CRIT_FULL );
+	}
+
+	// terrible hack for flames hitting the Merasmus props to get the particle effect in the correct position
+	if ( TFGameRules() && TFGameRules()->GetActiveBoss() && ( TFGameRules()->GetActiveBoss()->GetBossType() == HALLOWEEN_BOSS_MERASMUS ) )
+	{
+		info.SetDamagePosition( flame.m_vecOrigin );
+	}
+
+	// Track hits for the Flamethrower, which is used to change the weapon sound based on hit ratio
+	if ( flame.m_pFlameThrower )
+	{
+		flame.m_pFlameThrower->IncrementFlameDamageCount();
+	}
+
+	// We collided with pOther, so try to find a place on their surface to show blood
+	trace_t pTrace;
+	UTIL_TraceLine( flame.m_vecOrigin, pOther->WorldSpaceCenter(), MASK_SOLID|CONTENTS_HITBOX, flame.m_pIgnore, COLLISION_GROUP_NONE, &pTrace );
+
+	pOther->DispatchTraceAttack( info, flame.m_vecVelocity, &pTrace );
+	ApplyMultiDamage();
+
+	return TF_FLAME_COLLIDE_DAMAGED;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Flames light the arrows of friendly Snipers
+//-----------------------------------------------------------------------------
+void CTFFlameManager::OnCollideWithTeammate( CTFPlayer *pPlayer )
+{
+	// Does he have the bow?
+	CTFWeaponBase *pWpn = pPlayer->GetActiveTFWeapon();
+	if ( pWpn && pWpn->GetWeaponID() == TF_WEAPON_COMPOUND_BOW )
+	{
+		CTFCompoundBow *pBow = static_cast<CTFCompoundBow*>( pWpn );
+		pBow->SetArrowAlight( true );
+	}
 }
 
 #endif // GAME_DLL
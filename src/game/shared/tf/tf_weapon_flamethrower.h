@@ -30,6 +30,7 @@
 	#include "tf_projectile_rocket.h"
 	#include "baseentity.h"
 	#include "iscorer.h"
+	#include "mathlib/ssemath.h"
 #endif
 
 enum FlameThrowerState_t
@@ -231,6 +232,32 @@ public:
 };
 
 #ifdef GAME_DLL
+//-----------------------------------------------------------------------------
+// Purpose: State of a flame at the moment it touches something, shared by the
+//			damage rules of both flame simulations.
+//-----------------------------------------------------------------------------
+struct TFFlameHit_t
+{
+	Vector					m_vecOrigin;			// current position of the flame
+	Vector					m_vecInitialPos;		// position the flame was fired from
+	Vector					m_vecBaseVelocity;		// base velocity, used to tell if we hit from behind
+	Vector					m_vecVelocity;			// current velocity, used as the damage direction
+	CBaseEntity				*m_pOwner;				// entity that emitted the flame, used as the inflictor
+	CBaseEntity				*m_pAttacker;			// attacking player
+	CTFFlameThrower			*m_pFlameThrower;		// weapon tracking the hit ratio, may be NULL
+	const IHandleEntity		*m_pIgnore;				// entity the impact trace should skip
+	int						m_iDmgType;				// damage type
+	float					m_flDmgAmount;			// amount of base damage
+	bool					m_bCritFromBehind;		// always crits from behind
+};
+
+enum TFFlameCollideResult_t
+{
+	TF_FLAME_COLLIDE_EXTINGUISHED = 0,		// flame is in water and should be removed, the target was not burnt
+	TF_FLAME_COLLIDE_NO_ATTACKER,			// target counts as burnt, but there was nobody to deal the damage
+	TF_FLAME_COLLIDE_DAMAGED,				// target was burnt and damaged
+};
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -250,13 +277,11 @@ public:
 	void SetCritFromBehind( bool bState ) { m_bCritFromBehind = bState; }
 	bool IsEntityAttacker( CBaseEntity *pEnt ) { return m_hAttacker.Get() == pEnt; }
 
-private:
 	void RemoveFlame();
+
+private:
 	void OnCollide( CBaseEntity *pOther );
 	void OnCollideWithTeammate( CTFPlayer *pPlayer );
-	void SetHitTarget( void );
-	bool IsBehindTarget( CBaseEntity *pTarget );
-	float DotProductToTarget( CBaseEntity *pTarget );
 	void UpdateFlameThrowerHitRatio( void );
 	float GetFlameFloat( void );
 	float GetFlameDrag( void );
@@ -276,6 +301,98 @@ private:
 
 	CHandle< CTFFlameThrower > m_hFlameThrower;
 };
+
+//-----------------------------------------------------------------------------
+// Purpose: Entity-free flame simulation. Flames are kept in structure-of-arrays
+//			form, advanced together once per tick, and collided in per-attacker
+//			batches that share a single spatial partition query.
+//-----------------------------------------------------------------------------
+class CTFFlameManager : public CAutoGameSystemPerFrame
+{
+public:
+	CTFFlameManager();
+
+	// IGameSystem
+	virtual void LevelShutdownPostEntity();
+	virtual void FrameUpdatePostEntityThink();
+
+	// Creates a flame with whichever simulation tf_flamethrower_batched selects
+	static void CreateFlame( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, float flSpeed, int iDmgType, float flDmgAmount, bool bAlwaysCritFromBehind );
+
+	void AddFlame( const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner, float flSpeed, int iDmgType, float flDmgAmount, bool bAlwaysCritFromBehind, bool bRandomize = true );
+	void RemoveFlamesFromAttacker( CBaseEntity *pAttacker );
+	int GetFlameCount( CBaseEntity *pAttacker = NULL ) const;
+
+	// Damage rules, shared with CTFFlameEntity
+	static TFFlameCollideResult_t OnCollide( const TFFlameHit_t &flame, CBaseEntity *pOther );
+	static void OnCollideWithTeammate( CTFPlayer *pPlayer );
+
+private:
+	struct FlameSpawn_t
+	{
+		Vector				m_vecOrigin;
+		Vector				m_vecBaseVelocity;
+		Vector				m_vecAttackerVelocity;
+		EHANDLE				m_hOwner;
+		EHANDLE				m_hAttacker;
+		CHandle< CTFFlameThrower > m_hFlameThrower;
+		float				m_flTimeRemove;
+		float				m_flBoxSize;
+		float				m_flDmgAmount;
+		int					m_iDmgType;
+		bool				m_bCritFromBehind;
+	};
+
+	// Per-flame data that is only touched by collision and removal
+	struct FlameInfo_t
+	{
+		Vector				m_vecInitialPos;		// position the flame was fired from
+		EHANDLE				m_hOwner;				// entity that emitted the flame
+		EHANDLE				m_hAttacker;			// attacking player
+		CHandle< CTFFlameThrower > m_hFlameThrower;
+		CUtlVector< EHANDLE > m_hEntitiesBurnt;		// list of entities this flame has burnt
+		float				m_flTimeRemove;			// time at which the flame should be removed
+		float				m_flBoxSize;			// half-extent of the collision box
+		float				m_flDmgAmount;			// amount of base damage
+		int					m_iDmgType;				// damage type
+		bool				m_bCritFromBehind;		// always crits from behind
+		bool				m_bBurnedEnemy;			// we track hitting to calculate hit/miss ratio in the Flamethrower
+		bool				m_bRemove;				// flame is done and will be compacted out at the end of the tick
+	};
+
+	struct FlameGroup_t
+	{
+		CTFPlayer			*m_pAttacker;
+		Vector				m_vecMins;
+		Vector				m_vecMaxs;
+		CUtlVector< int >	m_Flames;
+	};
+
+	void CommitPendingFlames();
+	void CollideGroup( FlameGroup_t &group );
+	void CollideFlame( int iFlame, CTFPlayer *pAttacker, const CUtlVector< CBaseEntity* > &targets, const Vector *pTargetBounds );
+	void Integrate();
+	void RemoveFlame( int iFlame );
+	void RemoveAllFlames();
+	void UpdateFlameThrowerHitRatio( const FlameInfo_t &info );
+
+	Vector GetFlameVector( const FourVectors &vecs, int iFlame ) const	{ return vecs.Vec( iFlame & 3 ); }
+	void SetFlameVector( FourVectors &vecs, int iFlame, const Vector &vec ) { vecs.X( iFlame & 3 ) = vec.x; vecs.Y( iFlame & 3 ) = vec.y; vecs.Z( iFlame & 3 ) = vec.z; }
+
+	// Kinematic state, four flames to a FourVectors so one tick of motion runs four flames at a time
+	typedef CUtlVector< FourVectors, CUtlMemoryAligned< FourVectors, 16 > > FlameVectors_t;
+	FlameVectors_t				m_vecPos;
+	FlameVectors_t				m_vecPrevPos;
+	FlameVectors_t				m_vecBaseVelocity;
+	FlameVectors_t				m_vecAttackerVelocity;
+	FlameVectors_t				m_vecVelocity;
+
+	CUtlVector< FlameInfo_t >	m_Flames;
+	CUtlVector< FlameSpawn_t >	m_PendingFlames;		// flames fired this tick, simulated from the next one
+	CUtlVector< FlameGroup_t >	m_Groups;
+};
+
+extern CTFFlameManager g_TFFlameManager;
 #endif // GAME_DLL
 
 
@@ -0,0 +1,96 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: A Sound Script Image file holds every sound entry listed in the
+// game_sounds_manifest with its wave names already gender expanded, plus a
+// perfect hash over the entry names, so the sound emitter system can skip
+// parsing the scripts at mod init.
+//
+//=====================================================================================//
+#ifndef SOUND_SCRIPT_IMAGE_FILE_H
+#define SOUND_SCRIPT_IMAGE_FILE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "commonmacros.h"
+
+#define SOUNDSCRIPT_IMAGE_ID			MAKEID( 'V','S','S','I' )
+#define SOUNDSCRIPT_IMAGE_VERSION		1
+
+// Seed of the hash that picks a name's bucket in the perfect hash. The
+// bucket's own seed then picks the name's slot.
+#define SOUNDSCRIPT_IMAGE_BUCKET_SEED	0x50554F53
+
+// SoundScriptImageEntry_t::nFlags
+enum
+{
+	SOUNDSCRIPT_IMAGE_PLAY_TO_OWNER_ONLY	= 0x1,
+	SOUNDSCRIPT_IMAGE_USES_GENDER_TOKEN		= 0x2,
+	SOUNDSCRIPT_IMAGE_PRELOAD				= 0x4,
+};
+
+// one wave of an entry, sound names first followed by converted names
+struct SoundScriptImageWave_t
+{
+	int		nString;				// wave name
+	byte	gender;					// gender_t
+	byte	pad[3];
+};
+
+// stored in the order the entries were registered
+struct SoundScriptImageEntry_t
+{
+	int		nName;					// string index of the sound name
+	int		nFirstWave;				// index into the wave array
+	uint16	nScript;				// index into the script table
+	uint16	nSoundNames;
+	uint16	nConvertedNames;
+	uint16	nChannel;
+	float	flVolumeStart;
+	float	flVolumeRange;
+	uint16	nSoundLevelStart;
+	uint16	nSoundLevelRange;
+	byte	nPitchStart;
+	byte	nPitchRange;
+	uint16	nDelayMsec;
+	int		nFlags;
+};
+
+struct SoundScriptImageHeader_t
+{
+	int				nId;
+	int				nVersion;
+	unsigned int	uManifestChecksum;	// CRC of the manifest and script names and timestamps the image was built from
+	int				nNumStrings;		// number of unique strings in table
+	int				nNumScripts;
+	int				nNumSounds;
+	int				nNumWaves;
+	int				nNumBuckets;
+	int				nNumSlots;
+	int				nScriptOffset;		// int string index per script
+	int				nSoundOffset;		// SoundScriptImageEntry_t per sound
+	int				nWaveOffset;		// SoundScriptImageWave_t per wave
+	int				nBucketOffset;		// unsigned int seed per bucket
+	int				nSlotOffset;		// int sound index per slot, -1 if unused
+
+	inline const char *String( int iString ) const
+	{
+		if ( iString < 0 || iString >= nNumStrings )
+		{
+			Assert( 0 );
+			return NULL;
+		}
+
+		// access string table (after header) to access pool
+		const unsigned int *pTable = (const unsigned int *)((const byte *)this + sizeof( SoundScriptImageHeader_t ));
+		return (const char *)this + pTable[iString];
+	}
+
+	template < class T >
+	inline const T *Data( int nOffset ) const
+	{
+		return (const T *)( (const byte *)this + nOffset );
+	}
+};
+
+#endif // SOUND_SCRIPT_IMAGE_FILE_H
@@ -418,8 +418,16 @@ namespace ImageLoader
 		RESAMPLE_CLAMPS = 0x8,
 		RESAMPLE_CLAMPT = 0x10,
 		RESAMPLE_CLAMPU = 0x20,
+
+		// Use the original single threaded, per pixel filter. 2D default and
+		// normal map resamples otherwise go through a tiled, threaded filter
+		// whose output differs from it by at most RESAMPLE_REFERENCE_TOLERANCE
+		// per channel.
+		RESAMPLE_REFERENCE = 0x40,
 	};
 
+	#define RESAMPLE_REFERENCE_TOLERANCE	1
+
 	struct ResampleInfo_t
 	{
 
@@ -18,6 +18,8 @@
 #include "mathlib/ssequaternion.h"
 #include "bitvec.h"
 #include "datamanager.h"
+#include "utlhashtable.h"
+#include "generichash.h"
 #include "convar.h"
 #include "tier0/tslist.h"
 #include "vphysics_interface.h"
@@ -243,6 +245,246 @@ void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 	}
 }
 
+// -----------------------------------------------------------------
+void posecachekey_t::Init( const CStudioHdr *pStudioHdr, int nSequence, float flCycle, int nBoneMask, const float flPoseParameter[], const float flController[] )
+{
+	memset( this, 0, sizeof( *this ) );
+
+	const studiohdr_t *pRenderHdr = pStudioHdr->GetRenderHdr();
+	this->pStudioHdr = pRenderHdr;
+	checksum = pRenderHdr->checksum;
+	sequence = nSequence;
+	cycle = flCycle;
+	boneMask = nBoneMask;
+
+	memcpy( poseParameter, flPoseParameter, pStudioHdr->GetNumPoseParameters() * sizeof( float ) );
+	if ( flController )
+	{
+		memcpy( controller, flController, pStudioHdr->numbonecontrollers() * sizeof( float ) );
+	}
+}
+
+bool posecachekey_t::AddLayer( int nSequence, float flCycle, float flWeight )
+{
+	if ( numLayers >= MAXPOSECACHELAYERS )
+		return false;
+
+	posecachelayer_t &layer = layers[numLayers++];
+	layer.sequence = nSequence;
+	layer.cycle = flCycle;
+	layer.weight = flWeight;
+	return true;
+}
+
+struct posecacheparams_t
+{
+	const posecachekey_t	*pKey;
+	const matrix3x4_t		*pBoneToModel;
+	int						numbones;
+	int						generation;
+};
+
+class CPoseCacheEntry
+{
+public:
+	// you must implement these static functions for the ResourceManager
+	// -----------------------------------------------------------
+	static CPoseCacheEntry *CreateResource( const posecacheparams_t &params )
+	{
+		unsigned int size = EstimatedSize( params );
+		CPoseCacheEntry *pMem = (CPoseCacheEntry *)malloc( size );
+		pMem->m_key = *params.pKey;
+		pMem->m_generation = params.generation;
+		pMem->m_numbones = params.numbones;
+		pMem->m_size = size;
+		memcpy( pMem->BoneArray(), params.pBoneToModel, params.numbones * sizeof(matrix3x4_t) );
+		return pMem;
+	}
+
+	static unsigned int EstimatedSize( const posecacheparams_t &params )
+	{
+		return sizeof(CPoseCacheEntry) + params.numbones * sizeof(matrix3x4_t);
+	}
+	// -----------------------------------------------------------
+	// member functions that must be present for the ResourceManager
+	void				DestroyResource() { free( this ); }
+	CPoseCacheEntry		*GetData() { return this; }
+	unsigned int		Size() { return m_size; }
+	// -----------------------------------------------------------
+
+	matrix3x4_t			*BoneArray() { return (matrix3x4_t *)( this + 1 ); }
+
+	posecachekey_t		m_key;
+	int					m_generation;
+	int					m_numbones;
+	unsigned int		m_size;
+};
+
+class CPoseCache
+{
+public:
+	CPoseCache() : m_Data( 0 )
+	{
+		m_nGeneration = 0;
+		m_nHits = 0;
+		m_nMisses = 0;
+		m_nStores = 0;
+	}
+
+	// Caller must hold the data manager's mutex
+	CPoseCacheEntry *Find( const posecachekey_t &key, unsigned int nHash )
+	{
+		UtlHashHandle_t h = m_Index.Find( nHash );
+		if ( h == m_Index.InvalidHandle() )
+			return NULL;
+
+		CPoseCacheEntry *pEntry = m_Data.GetResource_NoLock( m_Index[h] );
+		if ( !pEntry )
+		{
+			// Evicted
+			m_Index.RemoveByHandle( h );
+			return NULL;
+		}
+
+		if ( pEntry->m_generation != m_nGeneration || memcmp( &pEntry->m_key, &key, sizeof( key ) ) )
+			return NULL;
+
+		return pEntry;
+	}
+
+	void PruneIndex()
+	{
+		for ( UtlHashHandle_t h = m_Index.FirstHandle(); h != m_Index.InvalidHandle(); )
+		{
+			if ( !m_Data.GetResource_NoLockNoLRUTouch( m_Index[h] ) )
+			{
+				h = m_Index.RemoveAndAdvance( h );
+			}
+			else
+			{
+				h = m_Index.NextHandle( h );
+			}
+		}
+	}
+
+	CDataManager<CPoseCacheEntry, posecacheparams_t, CPoseCacheEntry *, CThreadFastMutex> m_Data;
+	CUtlHashtable<unsigned int, memhandle_t> m_Index;	// key hash -> entry, a colliding key replaces the old one
+	int				m_nGeneration;
+	int				m_nHits;
+	int				m_nMisses;
+	int				m_nStores;
+};
+
+static CPoseCache g_PoseCache;
+
+// Past this many index entries, drop the ones whose poses have been evicted
+#define POSECACHE_INDEX_PRUNE_COUNT	4096
+
+void Studio_TransformBoneToModel( const CStudioHdr *pStudioHdr, int boneMask, const QAngle& angles, const Vector& origin, float flScale, const matrix3x4_t *pBoneToModel, matrix3x4_t bonetoworld[MAXSTUDIOBONES] )
+{
+	matrix3x4_t rotationmatrix; // model to world transformation
+	AngleMatrix( angles, origin, rotationmatrix );
+
+	// Account for a change in scale, same as Studio_BuildMatrices
+	if ( flScale < 1.0f-FLT_EPSILON || flScale > 1.0f+FLT_EPSILON )
+	{
+		VectorScale( rotationmatrix[0], flScale, rotationmatrix[0] );
+		VectorScale( rotationmatrix[1], flScale, rotationmatrix[1] );
+		VectorScale( rotationmatrix[2], flScale, rotationmatrix[2] );
+	}
+
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		if ( pStudioHdr->boneFlags(i) & boneMask )
+		{
+			ConcatTransforms( rotationmatrix, pBoneToModel[i], bonetoworld[i] );
+		}
+	}
+}
+
+bool Studio_BuildMatricesFromPoseCache( const CStudioHdr *pStudioHdr, const posecachekey_t &key, const QAngle& angles, const Vector& origin, float flScale, matrix3x4_t bonetoworld[MAXSTUDIOBONES] )
+{
+	unsigned int nHash = HashBlock( &key, sizeof( key ) );
+
+	AUTO_LOCK( g_PoseCache.m_Data.AccessMutex() );
+	CPoseCacheEntry *pEntry = g_PoseCache.Find( key, nHash );
+	if ( !pEntry )
+	{
+		++g_PoseCache.m_nMisses;
+		return false;
+	}
+
+	Assert( pEntry->m_numbones == pStudioHdr->numbones() );
+	++g_PoseCache.m_nHits;
+	Studio_TransformBoneToModel( pStudioHdr, key.boneMask, angles, origin, flScale, pEntry->BoneArray(), bonetoworld );
+	return true;
+}
+
+void Studio_AddToPoseCache( const CStudioHdr *pStudioHdr, const posecachekey_t &key, const matrix3x4_t *pBoneToModel )
+{
+	if ( !g_PoseCache.m_Data.TargetSize() )
+		return;
+
+	unsigned int nHash = HashBlock( &key, sizeof( key ) );
+
+	AUTO_LOCK( g_PoseCache.m_Data.AccessMutex() );
+	if ( g_PoseCache.Find( key, nHash ) )
+		return;
+
+	posecacheparams_t params;
+	params.pKey = &key;
+	params.pBoneToModel = pBoneToModel;
+	params.numbones = pStudioHdr->numbones();
+	params.generation = g_PoseCache.m_nGeneration;
+
+	// Replaces whatever else was indexed under this hash. The old entry ages out of the LRU.
+	memhandle_t hEntry = g_PoseCache.m_Data.CreateResource( params );
+	UtlHashHandle_t h = g_PoseCache.m_Index.Insert( nHash );
+	g_PoseCache.m_Index[h] = hEntry;
+	++g_PoseCache.m_nStores;
+
+	if ( g_PoseCache.m_Index.Count() > POSECACHE_INDEX_PRUNE_COUNT )
+	{
+		g_PoseCache.PruneIndex();
+	}
+}
+
+void Studio_InvalidatePoseCache()
+{
+	AUTO_LOCK( g_PoseCache.m_Data.AccessMutex() );
+
+	// Entries from older generations never match again and age out of the LRU
+	++g_PoseCache.m_nGeneration;
+}
+
+void Studio_SetPoseCacheSize( unsigned int nBytes )
+{
+	AUTO_LOCK( g_PoseCache.m_Data.AccessMutex() );
+	g_PoseCache.m_Data.SetTargetSize( nBytes );
+	g_PoseCache.m_Data.FlushToTargetSize();
+	g_PoseCache.PruneIndex();
+}
+
+void Studio_GetPoseCacheStats( posecachestats_t &stats )
+{
+	AUTO_LOCK( g_PoseCache.m_Data.AccessMutex() );
+	stats.hits = g_PoseCache.m_nHits;
+	stats.misses = g_PoseCache.m_nMisses;
+	stats.stores = g_PoseCache.m_nStores;
+	stats.entries = g_PoseCache.m_Index.Count();
+	stats.usedBytes = g_PoseCache.m_Data.UsedSize();
+	stats.targetBytes = g_PoseCache.m_Data.TargetSize();
+	stats.generation = g_PoseCache.m_nGeneration;
+}
+
+void Studio_ResetPoseCacheStats()
+{
+	AUTO_LOCK( g_PoseCache.m_Data.AccessMutex() );
+	g_PoseCache.m_nHits = 0;
+	g_PoseCache.m_nMisses = 0;
+	g_PoseCache.m_nStores = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
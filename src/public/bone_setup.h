@@ -436,6 +436,61 @@ memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params );
 void Studio_DestroyBoneCache( memhandle_t cacheHandle );
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle );
 
+//-----------------------------------------------------------------------------
+// Shared cache of bone-to-model matrices, keyed by everything that goes into
+// a pose. Entities in identical poses reuse each other's bone setup, and an
+// entity whose pose didn't change reuses its own from an earlier tick.
+//-----------------------------------------------------------------------------
+#define MAXPOSECACHELAYERS	16
+
+struct posecachelayer_t
+{
+	int				sequence;
+	float			cycle;
+	float			weight;
+};
+
+struct posecachekey_t
+{
+	const studiohdr_t *pStudioHdr;
+	int				checksum;
+	int				sequence;
+	float			cycle;
+	int				boneMask;
+	float			poseParameter[MAXSTUDIOPOSEPARAM];
+	float			controller[MAXSTUDIOBONECTRLS];
+	int				numLayers;
+	posecachelayer_t layers[MAXPOSECACHELAYERS];
+
+	// Unused slots are zeroed so keys can be hashed and compared as raw memory
+	void			Init( const CStudioHdr *pStudioHdr, int sequence, float cycle, int boneMask, const float poseParameter[], const float controller[] );
+	// Layers must be added in the order they're accumulated. Returns false if there are too many.
+	bool			AddLayer( int sequence, float cycle, float weight );
+};
+
+struct posecachestats_t
+{
+	int				hits;
+	int				misses;
+	int				stores;
+	int				entries;
+	unsigned int	usedBytes;
+	unsigned int	targetBytes;
+	int				generation;
+};
+
+// Builds bonetoworld from a cached pose. Returns false if the pose isn't cached.
+bool Studio_BuildMatricesFromPoseCache( const CStudioHdr *pStudioHdr, const posecachekey_t &key, const QAngle& angles, const Vector& origin, float flScale, matrix3x4_t bonetoworld[MAXSTUDIOBONES] );
+// pBoneToModel must come from Studio_BuildMatrices with no rotation, translation or scale
+void Studio_AddToPoseCache( const CStudioHdr *pStudioHdr, const posecachekey_t &key, const matrix3x4_t *pBoneToModel );
+// Same result as Studio_BuildMatrices, from matrices built with no rotation, translation or scale
+void Studio_TransformBoneToModel( const CStudioHdr *pStudioHdr, int boneMask, const QAngle& angles, const Vector& origin, float flScale, const matrix3x4_t *pBoneToModel, matrix3x4_t bonetoworld[MAXSTUDIOBONES] );
+// Drops every cached pose. Call whenever studio headers may have been unloaded.
+void Studio_InvalidatePoseCache();
+void Studio_SetPoseCacheSize( unsigned int nBytes );
+void Studio_GetPoseCacheStats( posecachestats_t &stats );
+void Studio_ResetPoseCacheStats();
+
 // Given a ray, trace for an intersection with this studiomodel.  Get the array of bones from StudioSetupHitboxBones
 bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace );
 
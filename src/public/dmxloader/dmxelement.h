@@ -21,6 +21,12 @@
 #include "dmxloader/dmxattribute.h"
 
 
+//-----------------------------------------------------------------------------
+// Forward declarations
+//-----------------------------------------------------------------------------
+class CDmxLazyFile;
+
+
 //-----------------------------------------------------------------------------
 // Sort functor class for attributes 
 //-----------------------------------------------------------------------------
@@ -170,12 +176,19 @@ private:
 	// Are we locked?
 	bool IsLocked() const;
 
+	// Reads the attributes of an element from a lazily loaded file on first access
+	void LoadLazyAttributes() const;
+	void LoadLazyAttributes_Internal();
+
 	AttributeList_t m_Attributes;
 	DmObjectId_t m_Id;	// We need this strictly because we support serialization
 	CUtlSymbolLarge m_Type;
+	CDmxLazyFile *m_pLazyFile;	// File the attributes come from, if loaded lazily
+	int m_nLazyIndex;			// Index of the element in that file
 	char m_nLockCount;
 	mutable bool m_bResortNeeded : 1;
 	bool m_bIsMarkedForDeletion : 1;
+	bool m_bLazyAttributes : 1;	// Attributes haven't been read from m_pLazyFile yet
 
 	static CUtlSymbolTableLargeMT s_TypeSymbols;
 
@@ -196,6 +209,14 @@ inline bool CDmxElement::IsLocked() const
 	return m_nLockCount > 0;
 }
 
+inline void CDmxElement::LoadLazyAttributes() const
+{
+	if ( m_bLazyAttributes )
+	{
+		const_cast< CDmxElement* >( this )->LoadLazyAttributes_Internal();
+	}
+}
+
 inline const char *CDmxElement::GetValueString( const char *pAttributeName ) const
 {
 	const CDmxAttribute* pAttribute = GetAttribute( pAttributeName );
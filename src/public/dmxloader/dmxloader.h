@@ -27,6 +27,12 @@ bool SerializeDMX( const char *pFileName, const char *pPathID, bool bTextMode, C
 bool UnserializeDMX( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileName = NULL );
 bool UnserializeDMX( const char *pFileName, const char *pPathID,  bool bTextMode, CDmxElement **ppRoot );
 
+// Binary files loaded lazily only create their elements up front; the attributes
+// of an element are read the first time it is accessed. The file image is kept
+// until the DMX context ends. Text files are always loaded in full.
+bool UnserializeDMXLazy( CUtlBuffer &buf, CDmxElement **ppRoot, const char *pFileName = NULL );
+bool UnserializeDMXLazy( const char *pFileName, const char *pPathID, bool bTextMode, CDmxElement **ppRoot );
+
 //-----------------------------------------------------------------------------
 // DMX elements/attributes can only be accessed inside a dmx context
 //-----------------------------------------------------------------------------
@@ -34,6 +40,9 @@ void BeginDMXContext( );
 void EndDMXContext( bool bDecommitMemory );
 void DecommitDMXMemory();
 
+// Bytes held by the DMX context, including the images of lazily loaded files
+int DMXMemoryUsed();
+
 
 //-----------------------------------------------------------------------------
 // Helper macro
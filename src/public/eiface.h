@@ -642,7 +642,8 @@ typedef IServerGameDLL IServerGameDLL008;
 //-----------------------------------------------------------------------------
 #define VENGINE_SERVER_RANDOM_INTERFACE_VERSION	"VEngineRandom001"
 
-#define INTERFACEVERSION_SERVERGAMEENTS			"ServerGameEnts001"
+#define INTERFACEVERSION_SERVERGAMEENTS_VERSION_1	"ServerGameEnts001"
+#define INTERFACEVERSION_SERVERGAMEENTS			"ServerGameEnts002"
 //-----------------------------------------------------------------------------
 // Purpose: Interface to get at server entities
 //-----------------------------------------------------------------------------
@@ -670,8 +671,20 @@ public:
 	// This is also where an entity can force other entities to be transmitted if it refers to them
 	// with ehandles.
 	virtual void			CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts ) = 0;
+
+	// Added with version 2.
+
+	// Called on the main thread before CheckTransmit is run for a frame's clients. Brings any lazily
+	// updated state that CheckTransmit reads (transmit states, PVS info, absolute positions) up to
+	// date for these edicts and stops transmit states from changing. If this returns true, CheckTransmit
+	// may then be called for different clients at the same time from job threads, and the engine calls
+	// FinishParallelCheckTransmit on the main thread once all of them are done.
+	virtual bool			PrepareParallelCheckTransmit( const unsigned short *pEdictIndices, int nEdicts ) = 0;
+	virtual void			FinishParallelCheckTransmit() = 0;
 };
 
+typedef IServerGameEnts IServerGameEnts001;
+
 #define INTERFACEVERSION_SERVERGAMECLIENTS_VERSION_3	"ServerGameClients003"
 #define INTERFACEVERSION_SERVERGAMECLIENTS				"ServerGameClients004"
 
@@ -123,8 +123,10 @@ public:
 //-----------------------------------------------------------------------------
 // Interface the engine exposes to the game DLL
 //-----------------------------------------------------------------------------
-#define INTERFACEVERSION_ENGINETRACE_SERVER	"EngineTraceServer003"
-#define INTERFACEVERSION_ENGINETRACE_CLIENT	"EngineTraceClient003"
+#define INTERFACEVERSION_ENGINETRACE_SERVER_VERSION_3	"EngineTraceServer003"
+#define INTERFACEVERSION_ENGINETRACE_SERVER				"EngineTraceServer004"
+#define INTERFACEVERSION_ENGINETRACE_CLIENT_VERSION_3	"EngineTraceClient003"
+#define INTERFACEVERSION_ENGINETRACE_CLIENT				"EngineTraceClient004"
 abstract_class IEngineTrace
 {
 public:
@@ -188,8 +190,16 @@ public:
 
 	// Walks bsp to find the leaf containing the specified point
 	virtual int GetLeafContainingPoint( const Vector &ptTest ) = 0;
+
+	// Added with version 4.
+
+	// Traces a packet of rays fired together (e.g. shotgun pellets). Gives the same
+	// results as calling TraceRay on each one, but gathers the entities only once.
+	virtual void TraceRays( int nRays, const Ray_t *pRays, unsigned int fMask, ITraceFilter *pTraceFilter, trace_t *pTraces ) = 0;
 };
 
+typedef IEngineTrace IEngineTrace003;
+
 
 
 #endif // ENGINE_IENGINETRACE_H
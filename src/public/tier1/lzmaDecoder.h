@@ -19,8 +19,10 @@
 
 #if !defined( _X360 )
 #define LZMA_ID				(('A'<<24)|('M'<<16)|('Z'<<8)|('L'))
+#define LZMA_CHUNKED_ID		(('C'<<24)|('M'<<16)|('Z'<<8)|('L'))
 #else
 #define LZMA_ID				(('L'<<24)|('Z'<<16)|('M'<<8)|('A'))
+#define LZMA_CHUNKED_ID		(('L'<<24)|('Z'<<16)|('M'<<8)|('C'))
 #endif
 
 // bind the buffer for correct identification
@@ -32,6 +34,19 @@ struct lzma_header_t
 	unsigned int	lzmaSize;		// always little endian
 	unsigned char	properties[5];
 };
+
+// A chunked buffer is a table of independent lzma_header_t streams, each covering
+// chunkSize bytes of output (the last may be short). Chunks can be decoded in any
+// order or in parallel, and a streaming decoder only needs a dictionary the size of
+// one chunk rather than of the whole buffer.
+struct lzma_chunked_header_t
+{
+	unsigned int	id;
+	unsigned int	actualSize;		// always little endian
+	unsigned int	chunkSize;		// always little endian
+	unsigned int	numChunks;		// always little endian
+	// followed by numChunks little endian offsets, from the start of this header, of each chunk's lzma_header_t
+};
 #pragma pack()
 
 class CLZMAStream;
@@ -39,9 +54,31 @@ class CLZMAStream;
 class CLZMA
 {
 public:
+	// These accept both plain and chunked buffers
 	static unsigned int	Uncompress( unsigned char *pInput, unsigned char *pOutput );
 	static bool			IsCompressed( unsigned char *pInput );
 	static unsigned int	GetActualSize( unsigned char *pInput );
+
+	// Chunked buffers only. UncompressChunk writes chunk iChunk's output to pOutput, which must
+	// hold GetChunkActualSize() bytes, and returns the number of bytes written (0 on failure).
+	static bool			IsChunked( unsigned char *pInput );
+	static int			GetNumChunks( unsigned char *pInput );
+	static unsigned int	GetChunkActualSize( unsigned char *pInput, int iChunk );
+	static unsigned int	GetChunkOffset( unsigned char *pInput, int iChunk );
+	static unsigned int	UncompressChunk( unsigned char *pInput, int iChunk, unsigned char *pOutput );
+
+	// True if the headers, the chunk table and every stream lie within the nInputSize bytes at
+	// pInput, the chunks follow the table in order and they add up to the buffer's actual size.
+	// Check untrusted input with its real size before decoding it.
+	static bool			IsInputValid( unsigned char *pInput, unsigned int nInputSize );
+
+	// The number of input bytes the headers say the buffer uses, or 0 if its chunks aren't
+	// stored in order right after the chunk table
+	static unsigned int	GetInputSize( unsigned char *pInput );
+
+	// Memory the decoder needs besides the input and output: the probability model, plus the
+	// dictionary when decoding a stream into windows rather than into one whole output buffer.
+	static unsigned int	GetDecoderMemory( unsigned char *pInput, bool bStreaming );
 };
 
 // For files besides the implementation, we forward declare a dummy struct. We can't unconditionally forward declare
@@ -99,4 +136,43 @@ private:
 	bool m_bZIPStyleHeader : 1;
 };
 
+//-----------------------------------------------------------------------------
+// Decodes a fully resident (e.g. memory mapped) plain or chunked LZMA buffer into
+// caller provided windows, so the whole output never has to exist at once:
+//
+//	CLZMAWindowDecoder decoder;
+//	if ( decoder.Init( pCompressed ) )
+//		while ( decoder.Read( window, sizeof( window ), nWritten ) && nWritten )
+//			Consume( window, nWritten );
+//-----------------------------------------------------------------------------
+class CLZMAWindowDecoder
+{
+public:
+	CLZMAWindowDecoder();
+	~CLZMAWindowDecoder();
+
+	// Returns false if pInput is not LZMA data
+	bool Init( unsigned char *pInput );
+
+	unsigned int GetActualSize() const { return m_nActualSize; }
+	unsigned int GetBytesRemaining() const { return m_nActualSize - m_nBytesWritten; }
+
+	// Decode up to nWindowSize bytes into pWindow. Returns false on error; at the end of the
+	// data returns true with nBytesWritten == 0.
+	bool Read( unsigned char *pWindow, unsigned int nWindowSize, /* out */ unsigned int &nBytesWritten );
+
+private:
+	bool BeginStream();
+
+	unsigned char	*m_pInput;
+	CLZMAStream		*m_pStream;
+	unsigned char	*m_pStreamInput;
+	unsigned int	m_nStreamInputSize;
+	unsigned int	m_nStreamInputRead;
+	int				m_iChunk;
+	int				m_nChunks;
+	unsigned int	m_nActualSize;
+	unsigned int	m_nBytesWritten;
+};
+
 #endif
@@ -0,0 +1,903 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: a flat, open-addressing hash map that probes 16 slots at a time.
+//
+// Usage notes:
+// - keys and values live inline in one array, so there is no per-node
+//   allocation and a successful lookup usually touches two cache lines
+//   (the control bytes and the slot itself)
+// - handles are slot indices. They stay valid across Remove(), but NOT
+//   across insertion, which may rehash the table. If you need indices
+//   that survive insertion, use CUtlFlatHashDict / CUtlFlatStringMap
+// - Insert() first searches for an existing match and returns it if found
+// - a value type of "empty_t" turns the map into a set, exactly like
+//   CUtlHashtable
+// - iteration order is unspecified
+//
+// Implementation notes:
+// - every slot has a signed control byte: EMPTY and DELETED are negative,
+//   a full slot holds the low 7 bits of its key's hash ("H2")
+// - the rest of the hash ("H1") picks the slot a probe starts at. A probe
+//   loads the 16 control bytes from there, compares them all against H2
+//   with one SSE2 compare, and only calls the equality functor for the
+//   slots whose byte matched. It stops at the first group that contains
+//   an EMPTY byte, so a miss is usually decided by that single compare
+// - the first 16 control bytes are mirrored after the last slot, so a
+//   group load never has to wrap around the end of the table
+// - load (live + deleted slots) is kept at or below 7/8. When a table
+//   fills up with tombstones it is rehashed in place rather than grown
+//
+// CUtlFlatHashMap< uint32 >                 setOfIntegers;
+// CUtlFlatHashMap< const char *, int >      mapFromStringsToInts;
+// CUtlFlatHashMap< int, CUtlVector<blah_t> > mapFromIntsToArrays;
+//
+//=============================================================================//
+
+#ifndef UTLFLATHASHMAP_H
+#define UTLFLATHASHMAP_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/dbg.h"
+#include "tier1/strtools.h"
+#include "tier1/utlcommon.h"
+#include "tier1/utlvector.h"
+#include "tier1/utllinkedlist.h"
+#include "tier1/utlsymbol.h"
+#include "tier1/utldict.h"
+
+#if !defined( _X360 ) && !defined( _PS3 )
+#include <emmintrin.h>
+#define UTLFLATHASHMAP_SSE2 1
+#endif
+
+#if defined( _WIN32 ) && !defined( _X360 )
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward)
+#endif
+
+#include "tier0/memdbgon.h"
+
+typedef unsigned int UtlFlatHashHandle_t;
+
+#define FOR_EACH_FLATHASHMAP( map, iter ) \
+	for ( UtlFlatHashHandle_t iter = (map).FirstHandle(); iter != (map).InvalidHandle(); iter = (map).NextHandle( iter ) )
+
+
+//-----------------------------------------------------------------------------
+// One group of 16 control bytes, and the bitmask queries the probe needs.
+// Bit i of a result refers to the i'th byte of the group.
+//-----------------------------------------------------------------------------
+class CUtlFlatHashGroup
+{
+public:
+	enum
+	{
+		WIDTH = 16,
+
+		CTRL_EMPTY = -128,
+		CTRL_DELETED = -2,
+	};
+
+	explicit FORCEINLINE CUtlFlatHashGroup( const int8 *pCtrl )
+	{
+#ifdef UTLFLATHASHMAP_SSE2
+		m_Ctrl = _mm_loadu_si128( (const __m128i *)pCtrl );
+#else
+		m_pCtrl = pCtrl;
+#endif
+	}
+
+	// Slots holding this H2 byte
+	FORCEINLINE uint32 Match( int8 h2 ) const
+	{
+#ifdef UTLFLATHASHMAP_SSE2
+		return (uint32)_mm_movemask_epi8( _mm_cmpeq_epi8( m_Ctrl, _mm_set1_epi8( h2 ) ) );
+#else
+		uint32 nMask = 0;
+		for ( int i = 0; i < WIDTH; ++i )
+		{
+			nMask |= ( m_pCtrl[i] == h2 ) << i;
+		}
+		return nMask;
+#endif
+	}
+
+	FORCEINLINE uint32 MatchEmpty() const
+	{
+		return Match( (int8)CTRL_EMPTY );
+	}
+
+	// Empty and deleted are the only control bytes below -1
+	FORCEINLINE uint32 MatchEmptyOrDeleted() const
+	{
+#ifdef UTLFLATHASHMAP_SSE2
+		return (uint32)_mm_movemask_epi8( _mm_cmpgt_epi8( _mm_set1_epi8( -1 ), m_Ctrl ) );
+#else
+		uint32 nMask = 0;
+		for ( int i = 0; i < WIDTH; ++i )
+		{
+			nMask |= ( m_pCtrl[i] < -1 ) << i;
+		}
+		return nMask;
+#endif
+	}
+
+	// Index of the lowest set bit. nMask must not be 0
+	static FORCEINLINE int LowestBit( uint32 nMask )
+	{
+		Assert( nMask );
+#if defined( _WIN32 ) && !defined( _X360 )
+		unsigned long nBit;
+		_BitScanForward( &nBit, nMask );
+		return (int)nBit;
+#elif defined( GNUC ) || defined( __GNUC__ )
+		return __builtin_ctz( nMask );
+#else
+		int nBit = 0;
+		while ( !( nMask & 1 ) )
+		{
+			nMask >>= 1;
+			++nBit;
+		}
+		return nBit;
+#endif
+	}
+
+private:
+#ifdef UTLFLATHASHMAP_SSE2
+	__m128i m_Ctrl;
+#else
+	const int8 *m_pCtrl;
+#endif
+};
+
+
+//-----------------------------------------------------------------------------
+// The map itself
+//-----------------------------------------------------------------------------
+template < typename KeyT, typename ValueT = empty_t, typename KeyHashT = DefaultHashFunctor<KeyT>, typename KeyIsEqualT = DefaultEqualFunctor<KeyT> >
+class CUtlFlatHashMap
+{
+public:
+	typedef UtlFlatHashHandle_t handle_t;
+	typedef CUtlKeyValuePair< KeyT, ValueT > KVPair;
+	typedef typename ArgumentTypeInfo< KeyT >::Arg_t KeyArg_t;
+	typedef typename ArgumentTypeInfo< ValueT >::Arg_t ValueArg_t;
+	typedef typename KVPair::ValueReturn_t Element_t;
+
+	explicit CUtlFlatHashMap( int nMinSize = 0, const KeyHashT &hash = KeyHashT(), const KeyIsEqualT &equal = KeyIsEqualT() )
+		: m_pCtrl( NULL ), m_pSlots( NULL ), m_nCapacity( 0 ), m_nCount( 0 ), m_nGrowthLeft( 0 ), m_hash( hash ), m_eq( equal )
+	{
+		if ( nMinSize > 0 )
+		{
+			Reserve( nMinSize );
+		}
+	}
+
+	CUtlFlatHashMap( const CUtlFlatHashMap &src )
+		: m_pCtrl( NULL ), m_pSlots( NULL ), m_nCapacity( 0 ), m_nCount( 0 ), m_nGrowthLeft( 0 ), m_hash( src.m_hash ), m_eq( src.m_eq )
+	{
+		CopyFrom( src );
+	}
+
+	CUtlFlatHashMap &operator=( const CUtlFlatHashMap &src )
+	{
+		if ( this != &src )
+		{
+			Purge();
+			m_hash = src.m_hash;
+			m_eq = src.m_eq;
+			CopyFrom( src );
+		}
+		return *this;
+	}
+
+	~CUtlFlatHashMap()
+	{
+		Purge();
+	}
+
+	int Count() const { return m_nCount; }
+	bool IsEmpty() const { return m_nCount == 0; }
+
+	// Number of slots; handles are in [0, Capacity())
+	int Capacity() const { return (int)m_nCapacity; }
+
+	// Makes room for nCount elements without rehashing
+	void Reserve( int nCount );
+
+	// Returns the handle of the key, or InvalidHandle()
+	handle_t Find( KeyArg_t k ) const
+	{
+		return m_nCapacity ? DoFind( k, m_hash( k ) ) : InvalidHandle();
+	}
+
+	// Same, with a hash the caller already computed with this map's functor
+	handle_t FindWithHash( KeyArg_t k, unsigned int h ) const
+	{
+		return m_nCapacity ? DoFind( k, h ) : InvalidHandle();
+	}
+
+	bool HasElement( KeyArg_t k ) const { return Find( k ) != InvalidHandle(); }
+
+	// Inserts a key with a default-constructed value, or returns the existing one
+	handle_t Insert( KeyArg_t k );
+
+	// Inserts a key-value pair. If the key is already present, the value is NOT overwritten
+	handle_t Insert( KeyArg_t k, ValueArg_t v, bool *pDidInsert = NULL );
+
+	// Inserts or overwrites
+	handle_t InsertOrReplace( KeyArg_t k, ValueArg_t v );
+
+	// Returns true if the key was found and removed
+	bool Remove( KeyArg_t k );
+	void RemoveByHandle( handle_t h );
+
+	// Destructs all the elements but keeps the table
+	void RemoveAll();
+
+	// Destructs all the elements and frees the table
+	void Purge();
+
+	// Call delete on each value, then Purge()
+	void PurgeAndDeleteElements();
+
+	const KeyT &Key( handle_t h ) const { Assert( IsValidHandle( h ) ); return m_pSlots[h].m_key; }
+
+	Element_t &Element( handle_t h ) { Assert( IsValidHandle( h ) ); return m_pSlots[h].GetValue(); }
+	const Element_t &Element( handle_t h ) const { Assert( IsValidHandle( h ) ); return m_pSlots[h].GetValue(); }
+	Element_t &operator[]( handle_t h ) { return Element( h ); }
+	const Element_t &operator[]( handle_t h ) const { return Element( h ); }
+
+	bool IsValidHandle( handle_t h ) const { return h < m_nCapacity && m_pCtrl[h] >= 0; }
+	static handle_t InvalidHandle() { return (handle_t)-1; }
+
+	// Iteration over the full slots, in no particular order
+	handle_t FirstHandle() const { return NextFullSlot( 0 ); }
+	handle_t NextHandle( handle_t h ) const { return NextFullSlot( h + 1 ); }
+
+	KeyHashT &GetHashRef() { return m_hash; }
+	KeyIsEqualT &GetEqualRef() { return m_eq; }
+
+private:
+	enum { GROUP_WIDTH = CUtlFlatHashGroup::WIDTH };
+
+	static FORCEINLINE uint32 H1( unsigned int h ) { return h >> 7; }
+	static FORCEINLINE int8 H2( unsigned int h ) { return (int8)( h & 0x7F ); }
+
+	// Triangular probing over the groups; visits every group once when the
+	// capacity is a power of two
+	struct ProbeSeq_t
+	{
+		ProbeSeq_t( uint32 nStart, uint32 nMask ) : m_nMask( nMask ), m_nOffset( nStart & nMask ), m_nIndex( 0 ) {}
+		uint32 Offset( int i ) const { return ( m_nOffset + i ) & m_nMask; }
+		void Next() { m_nIndex += GROUP_WIDTH; m_nOffset = ( m_nOffset + m_nIndex ) & m_nMask; }
+
+		uint32 m_nMask;
+		uint32 m_nOffset;
+		uint32 m_nIndex;
+	};
+
+	// Keeps the mirrored bytes past the end in sync
+	FORCEINLINE void SetCtrl( uint32 i, int8 c )
+	{
+		m_pCtrl[i] = c;
+		if ( i < GROUP_WIDTH )
+		{
+			m_pCtrl[m_nCapacity + i] = c;
+		}
+	}
+
+	static uint32 GrowthForCapacity( uint32 nCapacity ) { return nCapacity - nCapacity / 8; }
+
+	handle_t DoFind( KeyArg_t k, unsigned int h ) const;
+	uint32 FindInsertSlot( unsigned int h ) const;
+	uint32 PrepareInsert( unsigned int h );
+	void Rehash( uint32 nNewCapacity );
+	void CopyFrom( const CUtlFlatHashMap &src );
+	handle_t NextFullSlot( uint32 i ) const;
+
+	int8 *m_pCtrl;
+	KVPair *m_pSlots;
+	uint32 m_nCapacity;
+	int m_nCount;
+	uint32 m_nGrowthLeft;
+	KeyHashT m_hash;
+	KeyIsEqualT m_eq;
+};
+
+
+template < typename K, typename V, typename H, typename E >
+inline UtlFlatHashHandle_t CUtlFlatHashMap<K,V,H,E>::DoFind( KeyArg_t k, unsigned int h ) const
+{
+	const int8 h2 = H2( h );
+	ProbeSeq_t seq( H1( h ), m_nCapacity - 1 );
+	for ( ;; )
+	{
+		CUtlFlatHashGroup group( m_pCtrl + seq.m_nOffset );
+		for ( uint32 nMatch = group.Match( h2 ); nMatch; nMatch &= nMatch - 1 )
+		{
+			uint32 i = seq.Offset( CUtlFlatHashGroup::LowestBit( nMatch ) );
+			if ( m_eq( m_pSlots[i].m_key, k ) )
+				return i;
+		}
+
+		if ( group.MatchEmpty() )
+			return InvalidHandle();
+
+		seq.Next();
+		Assert( seq.m_nIndex < m_nCapacity );
+	}
+}
+
+// First empty or deleted slot along the key's probe sequence
+template < typename K, typename V, typename H, typename E >
+inline uint32 CUtlFlatHashMap<K,V,H,E>::FindInsertSlot( unsigned int h ) const
+{
+	ProbeSeq_t seq( H1( h ), m_nCapacity - 1 );
+	for ( ;; )
+	{
+		uint32 nMask = CUtlFlatHashGroup( m_pCtrl + seq.m_nOffset ).MatchEmptyOrDeleted();
+		if ( nMask )
+			return seq.Offset( CUtlFlatHashGroup::LowestBit( nMask ) );
+
+		seq.Next();
+		Assert( seq.m_nIndex < m_nCapacity );
+	}
+}
+
+// Finds a slot for a key known not to be in the map, growing if needed, and marks it full
+template < typename K, typename V, typename H, typename E >
+uint32 CUtlFlatHashMap<K,V,H,E>::PrepareInsert( unsigned int h )
+{
+	uint32 i = m_nCapacity ? FindInsertSlot( h ) : 0;
+	if ( !m_nCapacity || ( m_nGrowthLeft == 0 && m_pCtrl[i] != CUtlFlatHashGroup::CTRL_DELETED ) )
+	{
+		// Mostly tombstones? Clean up at the same size, otherwise double
+		if ( m_nCapacity && (uint32)m_nCount <= m_nCapacity / 64 * 25 )
+		{
+			Rehash( m_nCapacity );
+		}
+		else
+		{
+			Rehash( m_nCapacity ? m_nCapacity * 2 : GROUP_WIDTH );
+		}
+		i = FindInsertSlot( h );
+	}
+
+	// Reusing a tombstone doesn't use up any growth
+	if ( m_pCtrl[i] == CUtlFlatHashGroup::CTRL_EMPTY )
+	{
+		--m_nGrowthLeft;
+	}
+
+	++m_nCount;
+	SetCtrl( i, H2( h ) );
+	return i;
+}
+
+template < typename K, typename V, typename H, typename E >
+UtlFlatHashHandle_t CUtlFlatHashMap<K,V,H,E>::Insert( KeyArg_t k )
+{
+	unsigned int h = m_hash( k );
+	handle_t i = m_nCapacity ? DoFind( k, h ) : InvalidHandle();
+	if ( i != InvalidHandle() )
+		return i;
+
+	i = PrepareInsert( h );
+	Construct( &m_pSlots[i] );
+	m_pSlots[i].m_key = k;
+	return i;
+}
+
+template < typename K, typename V, typename H, typename E >
+UtlFlatHashHandle_t CUtlFlatHashMap<K,V,H,E>::Insert( KeyArg_t k, ValueArg_t v, bool *pDidInsert )
+{
+	unsigned int h = m_hash( k );
+	handle_t i = m_nCapacity ? DoFind( k, h ) : InvalidHandle();
+	if ( pDidInsert )
+	{
+		*pDidInsert = ( i == InvalidHandle() );
+	}
+
+	if ( i != InvalidHandle() )
+		return i;
+
+	i = PrepareInsert( h );
+	new ( &m_pSlots[i] ) KVPair( k, v );
+	return i;
+}
+
+template < typename K, typename V, typename H, typename E >
+UtlFlatHashHandle_t CUtlFlatHashMap<K,V,H,E>::InsertOrReplace( KeyArg_t k, ValueArg_t v )
+{
+	bool bDidInsert;
+	handle_t i = Insert( k, v, &bDidInsert );
+	if ( !bDidInsert )
+	{
+		m_pSlots[i].GetValue() = v;
+	}
+	return i;
+}
+
+template < typename K, typename V, typename H, typename E >
+bool CUtlFlatHashMap<K,V,H,E>::Remove( KeyArg_t k )
+{
+	handle_t i = Find( k );
+	if ( i == InvalidHandle() )
+		return false;
+
+	RemoveByHandle( i );
+	return true;
+}
+
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::RemoveByHandle( handle_t h )
+{
+	Assert( IsValidHandle( h ) );
+	Destruct( &m_pSlots[h] );
+	--m_nCount;
+
+	// If there is an empty byte within one group of this slot on both sides,
+	// no probe can ever have walked past it, so it can go straight back to
+	// empty instead of leaving a tombstone.
+	uint32 nEmptyBefore = CUtlFlatHashGroup( m_pCtrl + ( ( h - GROUP_WIDTH ) & ( m_nCapacity - 1 ) ) ).MatchEmpty();
+	uint32 nEmptyAfter = CUtlFlatHashGroup( m_pCtrl + h ).MatchEmpty();
+	bool bWasNeverFull = false;
+	if ( nEmptyBefore && nEmptyAfter )
+	{
+		int nFullBefore = 0;
+		for ( uint32 nBit = 1u << ( GROUP_WIDTH - 1 ); !( nEmptyBefore & nBit ); nBit >>= 1 )
+		{
+			++nFullBefore;
+		}
+		int nFullAfter = CUtlFlatHashGroup::LowestBit( nEmptyAfter );
+		bWasNeverFull = ( nFullBefore + nFullAfter ) < GROUP_WIDTH;
+	}
+
+	if ( bWasNeverFull )
+	{
+		SetCtrl( h, (int8)CUtlFlatHashGroup::CTRL_EMPTY );
+		++m_nGrowthLeft;
+	}
+	else
+	{
+		SetCtrl( h, (int8)CUtlFlatHashGroup::CTRL_DELETED );
+	}
+}
+
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::RemoveAll()
+{
+	if ( !m_nCapacity )
+		return;
+
+	for ( uint32 i = 0; i < m_nCapacity; ++i )
+	{
+		if ( m_pCtrl[i] >= 0 )
+		{
+			Destruct( &m_pSlots[i] );
+		}
+	}
+
+	memset( m_pCtrl, CUtlFlatHashGroup::CTRL_EMPTY, m_nCapacity + GROUP_WIDTH );
+	m_nCount = 0;
+	m_nGrowthLeft = GrowthForCapacity( m_nCapacity );
+}
+
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::Purge()
+{
+	RemoveAll();
+	free( m_pCtrl );
+	free( m_pSlots );
+	m_pCtrl = NULL;
+	m_pSlots = NULL;
+	m_nCapacity = 0;
+	m_nGrowthLeft = 0;
+}
+
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::PurgeAndDeleteElements()
+{
+	for ( uint32 i = 0; i < m_nCapacity; ++i )
+	{
+		if ( m_pCtrl[i] >= 0 )
+		{
+			delete m_pSlots[i].GetValue();
+		}
+	}
+	Purge();
+}
+
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::Reserve( int nCount )
+{
+	if ( nCount <= 0 || (uint32)nCount <= (uint32)m_nCount + m_nGrowthLeft )
+		return;
+
+	uint32 nCapacity = GROUP_WIDTH;
+	while ( GrowthForCapacity( nCapacity ) < (uint32)nCount )
+	{
+		nCapacity *= 2;
+	}
+	Rehash( nCapacity );
+}
+
+// Moves every element into a fresh table of nNewCapacity slots
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::Rehash( uint32 nNewCapacity )
+{
+	Assert( ( nNewCapacity & ( nNewCapacity - 1 ) ) == 0 && nNewCapacity >= GROUP_WIDTH );
+	Assert( (uint32)m_nCount < GrowthForCapacity( nNewCapacity ) || !m_nCount );
+
+	int8 *pOldCtrl = m_pCtrl;
+	KVPair *pOldSlots = m_pSlots;
+	uint32 nOldCapacity = m_nCapacity;
+
+	MEM_ALLOC_CREDIT_CLASS();
+	m_pCtrl = (int8 *)malloc( nNewCapacity + GROUP_WIDTH );
+	m_pSlots = (KVPair *)malloc( nNewCapacity * sizeof( KVPair ) );
+	memset( m_pCtrl, CUtlFlatHashGroup::CTRL_EMPTY, nNewCapacity + GROUP_WIDTH );
+	m_nCapacity = nNewCapacity;
+	m_nGrowthLeft = GrowthForCapacity( nNewCapacity ) - m_nCount;
+
+	for ( uint32 i = 0; i < nOldCapacity; ++i )
+	{
+		if ( pOldCtrl[i] < 0 )
+			continue;
+
+		unsigned int h = m_hash( pOldSlots[i].m_key );
+		uint32 j = FindInsertSlot( h );
+		SetCtrl( j, H2( h ) );
+
+		// Same relocation CUtlHashtable does: move the bits, skip the constructors
+		memcpy( (void *)&m_pSlots[j], (const void *)&pOldSlots[i], sizeof( KVPair ) );
+	}
+
+	free( pOldCtrl );
+	free( pOldSlots );
+}
+
+template < typename K, typename V, typename H, typename E >
+void CUtlFlatHashMap<K,V,H,E>::CopyFrom( const CUtlFlatHashMap &src )
+{
+	Reserve( src.m_nCount );
+	for ( handle_t i = src.FirstHandle(); i != src.InvalidHandle(); i = src.NextHandle( i ) )
+	{
+		unsigned int h = m_hash( src.m_pSlots[i].m_key );
+		uint32 j = PrepareInsert( h );
+		new ( &m_pSlots[j] ) KVPair( src.m_pSlots[i] );
+	}
+}
+
+template < typename K, typename V, typename H, typename E >
+inline UtlFlatHashHandle_t CUtlFlatHashMap<K,V,H,E>::NextFullSlot( uint32 i ) const
+{
+	for ( ; i < m_nCapacity; ++i )
+	{
+		if ( m_pCtrl[i] >= 0 )
+			return i;
+	}
+	return InvalidHandle();
+}
+
+
+//-----------------------------------------------------------------------------
+// Hash and compare functors for the string adapters. The compare type is
+// the same EDictCompareType CUtlDict takes.
+//-----------------------------------------------------------------------------
+struct FlatHashDictHashFunctor
+{
+	FlatHashDictHashFunctor( int nCompareType = k_eDictCompareTypeCaseInsensitive ) : m_nCompareType( nCompareType ) {}
+
+	unsigned int operator()( const char *s ) const
+	{
+		if ( m_nCompareType == k_eDictCompareTypeCaseSensitive )
+			return StringHashFunctor()( s );
+		if ( m_nCompareType != k_eDictCompareTypeFilenames )
+			return CaselessStringHashFunctor()( s );
+
+		// Caseless, and treats / and \ as the same character
+		uint32 h = 2166136261u;
+		for ( ; *s; ++s )
+		{
+			uint32 c = (unsigned char) *s;
+			c += (((('A'-1) - c) & (c - ('Z'+1))) >> 26) & 32;
+			if ( c == '\\' )
+			{
+				c = '/';
+			}
+			h = (h ^ c) * 16777619;
+		}
+		return (h ^ (h << 17)) + (h >> 21);
+	}
+
+	int m_nCompareType;
+};
+
+struct FlatHashDictEqualFunctor
+{
+	FlatHashDictEqualFunctor( int nCompareType = k_eDictCompareTypeCaseInsensitive ) : m_nCompareType( nCompareType ) {}
+
+	bool operator()( const char *a, const char *b ) const
+	{
+		if ( m_nCompareType == k_eDictCompareTypeCaseSensitive )
+			return V_strcmp( a, b ) == 0;
+		if ( m_nCompareType != k_eDictCompareTypeFilenames )
+			return V_stricmp( a, b ) == 0;
+		return !CaselessStringLessThanIgnoreSlashes( a, b ) && !CaselessStringLessThanIgnoreSlashes( b, a );
+	}
+
+	int m_nCompareType;
+};
+
+
+//-----------------------------------------------------------------------------
+// CUtlDict-compatible dictionary on top of CUtlFlatHashMap. Elements live in
+// a linked list so indices stay valid across insertion and removal, just
+// like CUtlDict; the flat map only holds name -> index. Unlike CUtlDict,
+// First()/Next() do not visit the names in sorted order.
+//-----------------------------------------------------------------------------
+#define FOR_EACH_FLATHASHDICT( dictName, iteratorName ) \
+	for( int iteratorName=dictName.First(); iteratorName != dictName.InvalidIndex(); iteratorName = dictName.Next( iteratorName ) )
+
+template <class T, class I = int>
+class CUtlFlatHashDict
+{
+public:
+	CUtlFlatHashDict( int compareType = k_eDictCompareTypeCaseInsensitive, int growSize = 0, int initSize = 0 )
+		: m_Elements( growSize, initSize ), m_Lookup( initSize, FlatHashDictHashFunctor( compareType ), FlatHashDictEqualFunctor( compareType ) )
+	{
+	}
+
+	~CUtlFlatHashDict()
+	{
+		Purge();
+	}
+
+	void EnsureCapacity( int num )
+	{
+		m_Elements.EnsureCapacity( num );
+		m_Lookup.Reserve( num );
+	}
+
+	T &Element( I i ) { return m_Elements[i].m_Value; }
+	const T &Element( I i ) const { return m_Elements[i].m_Value; }
+	T &operator[]( I i ) { return Element( i ); }
+	const T &operator[]( I i ) const { return Element( i ); }
+
+	char *GetElementName( I i ) { return m_Elements[i].m_pName; }
+	char const *GetElementName( I i ) const { return m_Elements[i].m_pName; }
+
+	void SetElementName( I i, char const *pName )
+	{
+		MEM_ALLOC_CREDIT_CLASS();
+		m_Lookup.Remove( m_Elements[i].m_pName );
+		free( m_Elements[i].m_pName );
+		m_Elements[i].m_pName = strdup( pName );
+		m_Lookup.Insert( m_Elements[i].m_pName, i );
+	}
+
+	unsigned int Count() const { return m_Elements.Count(); }
+	I MaxElement() const { return m_Elements.MaxElement(); }
+	bool IsValidIndex( I i ) const { return m_Elements.IsValidIndex( i ); }
+	static I InvalidIndex() { return ElementList_t::InvalidIndex(); }
+
+	// CUtlDict would add a second entry for a name that is already present;
+	// this returns the existing one and leaves its element alone
+	I Insert( const char *pName, const T &element )
+	{
+		I i = Find( pName );
+		if ( i != InvalidIndex() )
+			return i;
+
+		MEM_ALLOC_CREDIT_CLASS();
+		i = m_Elements.AddToTail();
+		m_Elements[i].m_pName = strdup( pName );
+		m_Elements[i].m_Value = element;
+		m_Lookup.Insert( m_Elements[i].m_pName, i );
+		return i;
+	}
+
+	I Insert( const char *pName )
+	{
+		I i = Find( pName );
+		if ( i != InvalidIndex() )
+			return i;
+
+		MEM_ALLOC_CREDIT_CLASS();
+		i = m_Elements.AddToTail();
+		m_Elements[i].m_pName = strdup( pName );
+		m_Lookup.Insert( m_Elements[i].m_pName, i );
+		return i;
+	}
+
+	I Find( const char *pName ) const
+	{
+		if ( !pName )
+			return InvalidIndex();
+
+		UtlFlatHashHandle_t h = m_Lookup.Find( pName );
+		return ( h != m_Lookup.InvalidHandle() ) ? m_Lookup[h] : InvalidIndex();
+	}
+
+	bool HasElement( const char *pName ) const { return Find( pName ) != InvalidIndex(); }
+
+	void RemoveAt( I i )
+	{
+		m_Lookup.Remove( m_Elements[i].m_pName );
+		free( m_Elements[i].m_pName );
+		m_Elements.Remove( i );
+	}
+
+	void Remove( const char *pName )
+	{
+		I i = Find( pName );
+		if ( i != InvalidIndex() )
+		{
+			RemoveAt( i );
+		}
+	}
+
+	void RemoveAll()
+	{
+		for ( I i = m_Elements.Head(); i != m_Elements.InvalidIndex(); i = m_Elements.Next( i ) )
+		{
+			free( m_Elements[i].m_pName );
+		}
+		m_Elements.RemoveAll();
+		m_Lookup.RemoveAll();
+	}
+
+	void Purge()
+	{
+		RemoveAll();
+		m_Elements.Purge();
+		m_Lookup.Purge();
+	}
+
+	void PurgeAndDeleteElements()
+	{
+		for ( I i = m_Elements.Head(); i != m_Elements.InvalidIndex(); i = m_Elements.Next( i ) )
+		{
+			delete m_Elements[i].m_Value;
+		}
+		Purge();
+	}
+
+	I First() const { return m_Elements.Head(); }
+	I Next( I i ) const { return m_Elements.Next( i ); }
+
+	typedef I IndexType_t;
+
+private:
+	struct DictEntry_t
+	{
+		char *m_pName;
+		T m_Value;
+	};
+
+	typedef CUtlLinkedList< DictEntry_t, I > ElementList_t;
+	ElementList_t m_Elements;
+
+	// Keys point at the names owned by m_Elements
+	CUtlFlatHashMap< const char *, I, FlatHashDictHashFunctor, FlatHashDictEqualFunctor > m_Lookup;
+};
+
+
+//-----------------------------------------------------------------------------
+// CUtlStringMap-compatible map on top of CUtlFlatHashMap. Strings get
+// sequential ids in insertion order, just like CUtlSymbolTable symbols.
+//-----------------------------------------------------------------------------
+template <class T>
+class CUtlFlatStringMap
+{
+public:
+	CUtlFlatStringMap( bool caseInsensitive = true )
+		: m_Lookup( 0, FlatHashDictHashFunctor( caseInsensitive ? k_eDictCompareTypeCaseInsensitive : k_eDictCompareTypeCaseSensitive ),
+			FlatHashDictEqualFunctor( caseInsensitive ? k_eDictCompareTypeCaseInsensitive : k_eDictCompareTypeCaseSensitive ) )
+	{
+	}
+
+	~CUtlFlatStringMap()
+	{
+		FreeStrings();
+	}
+
+	// Get data by the string itself:
+	T& operator[]( const char *pString )
+	{
+		UtlSymId_t n = Find( pString );
+		if ( n == UTL_INVAL_SYMBOL )
+		{
+			MEM_ALLOC_CREDIT_CLASS();
+			n = m_Strings.AddToTail( strdup( pString ) );
+			m_Lookup.Insert( m_Strings[n], n );
+			m_Vector.EnsureCount( m_Strings.Count() );
+		}
+		return m_Vector[n];
+	}
+
+	// Get data by the string's id - only used to retrieve a pre-existing string, not create a new one!
+	T& operator[]( UtlSymId_t n )
+	{
+		Assert( n >=0 && n <= m_Vector.Count() );
+		return m_Vector[n];
+	}
+
+	const T& operator[]( UtlSymId_t n ) const
+	{
+		Assert( n >=0 && n <= m_Vector.Count() );
+		return m_Vector[n];
+	}
+
+	bool Defined( const char *pString ) const
+	{
+		return Find( pString ) != UTL_INVAL_SYMBOL;
+	}
+
+	UtlSymId_t Find( const char *pString ) const
+	{
+		if ( !pString )
+			return UTL_INVAL_SYMBOL;
+
+		UtlFlatHashHandle_t h = m_Lookup.Find( pString );
+		return ( h != m_Lookup.InvalidHandle() ) ? m_Lookup[h] : UTL_INVAL_SYMBOL;
+	}
+
+	static UtlSymId_t InvalidIndex()
+	{
+		return UTL_INVAL_SYMBOL;
+	}
+
+	int GetNumStrings( void ) const
+	{
+		return m_Strings.Count();
+	}
+
+	const char *String( int n ) const
+	{
+		return m_Strings[n];
+	}
+
+	// Clear all of the data from the map
+	void Clear()
+	{
+		m_Vector.RemoveAll();
+		FreeStrings();
+	}
+
+	void Purge()
+	{
+		m_Vector.Purge();
+		FreeStrings();
+	}
+
+	void PurgeAndDeleteElements()
+	{
+		m_Vector.PurgeAndDeleteElements();
+		FreeStrings();
+	}
+
+private:
+	void FreeStrings()
+	{
+		m_Lookup.RemoveAll();
+		for ( int i = 0; i < m_Strings.Count(); ++i )
+		{
+			free( m_Strings[i] );
+		}
+		m_Strings.RemoveAll();
+	}
+
+	CUtlVector<T> m_Vector;
+	CUtlVector<char *> m_Strings;
+	CUtlFlatHashMap< const char *, UtlSymId_t, FlatHashDictHashFunctor, FlatHashDictEqualFunctor > m_Lookup;
+};
+
+#include "tier0/memdbgoff.h"
+
+#endif // UTLFLATHASHMAP_H
@@ -430,6 +430,14 @@ JOB_INTERFACE void RunThreadPoolTests();
 
 JOB_INTERFACE IThreadPool *g_pThreadPool;
 
+//-----------------------------------------------------------------------------
+// Is the calling thread one of pPool's workers (or any pool's, if NULL)?
+// Parallel helpers use this to run nested work inline rather than queue it
+// behind the thread that is waiting on it.
+//-----------------------------------------------------------------------------
+
+JOB_INTERFACE bool ThreadInThreadPool( IThreadPool *pPool = NULL );
+
 //-----------------------------------------------------------------------------
 // Class to combine the metadata for an operation and the ability to perform
 // the operation. Meant for inheritance. All functions inline, defers to executor
@@ -884,6 +892,12 @@ public:
 			return;
 		}
 
+		if ( ThreadInThreadPool( pThreadPool ) )			// nested, run inline on this worker
+		{
+			DoExecute();
+			return;
+		}
+
 		int nThreads = pThreadPool->NumThreads();
 		if ( nJobs > nThreads )
 		{
@@ -993,7 +1007,7 @@ public:
 		{
 			m_lIndex = lBegin;
 			m_lLimit = lBegin + nItems;
-			int i = g_pThreadPool->NumIdleThreads();
+			int i = ThreadInThreadPool( g_pThreadPool ) ? 0 : g_pThreadPool->NumIdleThreads();	// nested runs inline
 
 			if ( nMaxParallel < i)
 			{
@@ -1090,6 +1104,12 @@ protected:
 	{
 		int i = g_pThreadPool->NumIdleThreads();
 
+		if ( ThreadInThreadPool( g_pThreadPool ) )		// nested, run inline on this worker
+		{
+			i = 0;
+			threadOverride = -1;
+		}
+
 		if ( nMaxParallel < i)
 		{
 			i = nMaxParallel;
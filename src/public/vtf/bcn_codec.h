@@ -0,0 +1,57 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Native BC1/BC3/BC4/BC5 (DXT1/DXT5/ATI1N/ATI2N) block compression,
+//			so texture conversion doesn't depend on the platform compressors.
+//
+//=============================================================================//
+
+#ifndef BCN_CODEC_H
+#define BCN_CODEC_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+#include "bitmap/imageformat.h"
+
+
+//-----------------------------------------------------------------------------
+// Which channels of an RGBA8888 image a format keeps, for BCn_ComputePSNR
+//-----------------------------------------------------------------------------
+enum
+{
+	BCN_CHANNEL_R = 0x1,
+	BCN_CHANNEL_G = 0x2,
+	BCN_CHANNEL_B = 0x4,
+	BCN_CHANNEL_A = 0x8,
+
+	BCN_CHANNEL_RGB = BCN_CHANNEL_R | BCN_CHANNEL_G | BCN_CHANNEL_B,
+	BCN_CHANNEL_RGBA = BCN_CHANNEL_RGB | BCN_CHANNEL_A,
+};
+
+// Number of endpoint refinement passes the BC1 color encoder makes.
+// Each pass refits the endpoints to the chosen indices by least squares
+// and is kept only if it lowers the block error.
+#define BCN_DEFAULT_REFINE_PASSES	1
+
+// Returns true for DXT1, DXT5, ATI1N, ATI2N and the DXT runtime formats
+bool BCn_IsSupportedFormat( ImageFormat fmt );
+
+// Returns the channels of the source that survive compression to fmt
+int BCn_GetChannelMask( ImageFormat fmt );
+
+// Compresses a tightly packed RGBA8888 image. Images whose dimensions are
+// not a multiple of 4 are padded by repeating the last row and column.
+// Any band of rows starting on a multiple of 4 can be compressed on its own.
+// ATI1N keeps red, ATI2N keeps red in its first block and green in its second.
+void BCn_CompressImage( const uint8 *pRGBA8888, int nWidth, int nHeight, uint8 *pDst, ImageFormat fmt, int nRefinePasses = BCN_DEFAULT_REFINE_PASSES );
+
+// Decompresses to a tightly packed RGBA8888 image. Channels the format doesn't
+// store decode as 0, and alpha as 255.
+void BCn_DecompressImage( const uint8 *pSrc, int nWidth, int nHeight, uint8 *pRGBA8888, ImageFormat fmt );
+
+// Peak signal to noise ratio in dB between two RGBA8888 images over the given
+// channels. Returns a large value for identical images.
+double BCn_ComputePSNR( const uint8 *pRGBA8888A, const uint8 *pRGBA8888B, int nPixels, int nChannelMask );
+
+#endif // BCN_CODEC_H
@@ -285,8 +285,10 @@ public:
 	virtual unsigned char *LowResImageData() = 0;
 
 	// Converts the textures image format. Use IMAGE_FORMAT_DEFAULT
-	// if you want to be able to use various tool functions below
-	virtual	void ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV ) = 0;
+	// if you want to be able to use various tool functions below.
+	// BC formats are compressed by the native encoder across the thread pool,
+	// bImageLoader forces the original single threaded ImageLoader compressors.
+	virtual	void ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV, bool bImageLoader = false ) = 0;
 
 	// NOTE: The following methods only work on textures using the
 	// IMAGE_FORMAT_DEFAULT!
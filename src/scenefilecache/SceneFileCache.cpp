@@ -293,6 +293,16 @@ bool CSceneFileCache::GetSceneDataFromImage( const char *pFileName, int iScene,
 	unsigned char *pData = (unsigned char *)pHeader + pEntries[iScene].nDataOffset;
 	bool bIsCompressed;
 	bIsCompressed = CLZMA::IsCompressed( pData );
+	if ( bIsCompressed && !CLZMA::IsInputValid( pData, pEntries[iScene].nDataLength ) )
+	{
+		Warning( "Scene image entry %d for '%s' is corrupt\n", iScene, pFileName );
+		if ( pSceneLength )
+		{
+			*pSceneLength = 0;
+		}
+		return false;
+	}
+
 	if ( bIsCompressed )
 	{
 		int originalSize = CLZMA::GetActualSize( pData );
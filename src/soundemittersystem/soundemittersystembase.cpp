@@ -17,12 +17,16 @@
 #include "checksum_crc.h"
 #include "SoundEmitterSystem/isoundemittersystembase.h"
 #include "ifilelist.h"
+#include "tier0/icommandline.h"
+#include "tier1/generichash.h"
+#include "SoundEmitterSystem/SoundScriptImageFile.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 #define MANIFEST_FILE				"scripts/game_sounds_manifest.txt"
 #define GAME_SOUNDS_HEADER_BLOCK	"scripts/game_sounds_header.txt"
+#define SOUNDSCRIPT_IMAGE_FILE		"scripts/game_sounds.image"
 
 static IFileSystem* filesystem = 0;
 
@@ -31,7 +35,8 @@ static IFileSystem* filesystem = 0;
 //-----------------------------------------------------------------------------
 CSoundEmitterSystemBase::CSoundEmitterSystemBase() : 
 	m_nInitCount( 0 ),
-	m_uManifestPlusScriptChecksum( 0 )
+	m_uManifestPlusScriptChecksum( 0 ),
+	m_bSoundIndexComplete( false )
 {
 }
 
@@ -173,6 +178,555 @@ static void AccumulateFileNameAndTimestampIntoChecksum( CRC32_t *crc, char const
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Lower cases a sound name for the perfect hash. Returns the length,
+//  or -1 if the name doesn't fit.
+//-----------------------------------------------------------------------------
+static int LowerSoundName( const char *pName, char *pOut, int nOutSize )
+{
+	int nLen = 0;
+	for ( ; pName[ nLen ]; ++nLen )
+	{
+		if ( nLen >= nOutSize - 1 )
+			return -1;
+
+		char c = pName[ nLen ];
+		pOut[ nLen ] = ( c >= 'A' && c <= 'Z' ) ? c + ( 'a' - 'A' ) : c;
+	}
+	pOut[ nLen ] = 0;
+	return nLen;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds a hash and displace perfect hash over the sound names. Each
+//  name hashes to a bucket, and each bucket gets the first seed that sends all
+//  of its names to distinct free slots. The largest buckets are placed first.
+//-----------------------------------------------------------------------------
+static bool BuildSoundNamePerfectHash( const CUtlVector< const char * > &names, CUtlVector< unsigned int > &seeds, CUtlVector< int > &slots )
+{
+	int nNames = names.Count();
+	int nBuckets = nNames / 2 + 1;
+	int nSlots = nNames + nNames / 4 + 1;
+
+	CUtlVector< char > lowered;
+	CUtlVector< int > nameStart, nameLen, nameBucket;
+	nameStart.SetCount( nNames );
+	nameLen.SetCount( nNames );
+	nameBucket.SetCount( nNames );
+
+	CUtlVector< int > bucketCount, bucketStart;
+	bucketCount.SetCount( nBuckets );
+	bucketStart.SetCount( nBuckets + 1 );
+	memset( bucketCount.Base(), 0, nBuckets * sizeof( int ) );
+
+	for ( int i = 0; i < nNames; i++ )
+	{
+		char szLower[ 256 ];
+		int nLen = LowerSoundName( names[ i ], szLower, sizeof( szLower ) );
+		if ( nLen < 0 )
+		{
+			DevWarning( "CSoundEmitterSystem:  sound name %s is too long for the sound index\n", names[ i ] );
+			return false;
+		}
+
+		nameStart[ i ] = lowered.AddMultipleToTail( nLen, szLower );
+		nameLen[ i ] = nLen;
+		nameBucket[ i ] = MurmurHash2( szLower, nLen, SOUNDSCRIPT_IMAGE_BUCKET_SEED ) % nBuckets;
+		++bucketCount[ nameBucket[ i ] ];
+	}
+
+	// Group the names by bucket
+	int nMaxBucketSize = 0;
+	bucketStart[ 0 ] = 0;
+	for ( int b = 0; b < nBuckets; b++ )
+	{
+		bucketStart[ b + 1 ] = bucketStart[ b ] + bucketCount[ b ];
+		nMaxBucketSize = MAX( nMaxBucketSize, bucketCount[ b ] );
+	}
+
+	CUtlVector< int > members, fill;
+	members.SetCount( nNames );
+	fill.CopyArray( bucketStart.Base(), nBuckets );
+	for ( int i = 0; i < nNames; i++ )
+	{
+		members[ fill[ nameBucket[ i ] ]++ ] = i;
+	}
+
+	seeds.SetCount( nBuckets );
+	memset( seeds.Base(), 0, nBuckets * sizeof( unsigned int ) );
+	slots.SetCount( nSlots );
+	for ( int i = 0; i < nSlots; i++ )
+	{
+		slots[ i ] = -1;
+	}
+
+	CUtlVector< int > candidates;
+	candidates.SetCount( nMaxBucketSize );
+
+	for ( int nSize = nMaxBucketSize; nSize > 0; nSize-- )
+	{
+		for ( int b = 0; b < nBuckets; b++ )
+		{
+			if ( bucketCount[ b ] != nSize )
+				continue;
+
+			const int *pMembers = &members[ bucketStart[ b ] ];
+
+			unsigned int nSeed;
+			for ( nSeed = 1; nSeed < ( 1 << 24 ); nSeed++ )
+			{
+				bool bFits = true;
+				for ( int m = 0; m < nSize && bFits; m++ )
+				{
+					int iName = pMembers[ m ];
+					int nSlot = MurmurHash2( &lowered[ nameStart[ iName ] ], nameLen[ iName ], nSeed ) % nSlots;
+					if ( slots[ nSlot ] != -1 )
+					{
+						bFits = false;
+						break;
+					}
+
+					for ( int k = 0; k < m; k++ )
+					{
+						if ( candidates[ k ] == nSlot )
+						{
+							bFits = false;
+							break;
+						}
+					}
+					candidates[ m ] = nSlot;
+				}
+
+				if ( bFits )
+					break;
+			}
+
+			if ( nSeed >= ( 1 << 24 ) )
+			{
+				DevWarning( "CSoundEmitterSystem:  couldn't place %i sound names in the sound index\n", nSize );
+				return false;
+			}
+
+			seeds[ b ] = nSeed;
+			for ( int m = 0; m < nSize; m++ )
+			{
+				slots[ candidates[ m ] ] = pMembers[ m ];
+			}
+		}
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Checks that every count and offset in an image lies within its nSize bytes
+//-----------------------------------------------------------------------------
+static bool IsSoundScriptImageValid( const SoundScriptImageHeader_t *pHeader, int nSize )
+{
+	if ( nSize < (int)sizeof( SoundScriptImageHeader_t ) ||
+		 pHeader->nId != SOUNDSCRIPT_IMAGE_ID ||
+		 pHeader->nVersion != SOUNDSCRIPT_IMAGE_VERSION )
+		return false;
+
+	if ( pHeader->nNumStrings < 0 || pHeader->nNumScripts < 0 || pHeader->nNumScripts > 65535 || 
+		 pHeader->nNumSounds < 0 || pHeader->nNumSounds > 65534 || pHeader->nNumWaves < 0 ||
+		 pHeader->nNumBuckets < 0 || pHeader->nNumSlots < 0 ||
+		 ( pHeader->nNumBuckets > 0 ) != ( pHeader->nNumSlots > 0 ) )
+		return false;
+
+	struct ImageRange_t
+	{
+		int nOffset;
+		int nCount;
+		int nElementSize;
+	};
+	ImageRange_t ranges[] =
+	{
+		{ sizeof( SoundScriptImageHeader_t ), pHeader->nNumStrings, sizeof( unsigned int ) },
+		{ pHeader->nScriptOffset, pHeader->nNumScripts, sizeof( int ) },
+		{ pHeader->nSoundOffset, pHeader->nNumSounds, sizeof( SoundScriptImageEntry_t ) },
+		{ pHeader->nWaveOffset, pHeader->nNumWaves, sizeof( SoundScriptImageWave_t ) },
+		{ pHeader->nBucketOffset, pHeader->nNumBuckets, sizeof( unsigned int ) },
+		{ pHeader->nSlotOffset, pHeader->nNumSlots, sizeof( int ) },
+	};
+	for ( int i = 0; i < ARRAYSIZE( ranges ); i++ )
+	{
+		if ( ranges[ i ].nOffset < (int)sizeof( SoundScriptImageHeader_t ) ||
+			 (int64)ranges[ i ].nOffset + (int64)ranges[ i ].nCount * ranges[ i ].nElementSize > nSize )
+			return false;
+	}
+
+	// The string pool sits between the string table and the scripts, zero padded
+	const byte *pBase = (const byte *)pHeader;
+	unsigned int nPoolStart = sizeof( SoundScriptImageHeader_t ) + pHeader->nNumStrings * sizeof( unsigned int );
+	if ( (unsigned int)pHeader->nScriptOffset <= nPoolStart || pBase[ pHeader->nScriptOffset - 1 ] != 0 )
+		return false;
+
+	const unsigned int *pStrings = pHeader->Data<unsigned int>( sizeof( SoundScriptImageHeader_t ) );
+	for ( int i = 0; i < pHeader->nNumStrings; i++ )
+	{
+		if ( pStrings[ i ] < nPoolStart || pStrings[ i ] >= (unsigned int)pHeader->nScriptOffset )
+			return false;
+	}
+
+	const int *pScripts = pHeader->Data<int>( pHeader->nScriptOffset );
+	for ( int i = 0; i < pHeader->nNumScripts; i++ )
+	{
+		if ( pScripts[ i ] < 0 || pScripts[ i ] >= pHeader->nNumStrings )
+			return false;
+	}
+
+	const SoundScriptImageEntry_t *pEntries = pHeader->Data<SoundScriptImageEntry_t>( pHeader->nSoundOffset );
+	for ( int i = 0; i < pHeader->nNumSounds; i++ )
+	{
+		const SoundScriptImageEntry_t &entry = pEntries[ i ];
+		if ( entry.nName < 0 || entry.nName >= pHeader->nNumStrings ||
+			 entry.nScript >= pHeader->nNumScripts ||
+			 entry.nFirstWave < 0 || entry.nFirstWave + entry.nSoundNames + entry.nConvertedNames > pHeader->nNumWaves )
+			return false;
+	}
+
+	const SoundScriptImageWave_t *pWaves = pHeader->Data<SoundScriptImageWave_t>( pHeader->nWaveOffset );
+	for ( int i = 0; i < pHeader->nNumWaves; i++ )
+	{
+		if ( pWaves[ i ].nString < 0 || pWaves[ i ].nString >= pHeader->nNumStrings || pWaves[ i ].gender > GENDER_FEMALE )
+			return false;
+	}
+
+	const int *pSlots = pHeader->Data<int>( pHeader->nSlotOffset );
+	for ( int i = 0; i < pHeader->nNumSlots; i++ )
+	{
+		if ( pSlots[ i ] < -1 || pSlots[ i ] >= pHeader->nNumSounds )
+			return false;
+	}
+
+	return true;
+}
+
+static bool UseSoundScriptImage()
+{
+	// 360 doesn't checksum the scripts, so it can't tell when an image is stale
+	return !IsX360() && !CommandLine()->FindParm( "-nosoundscriptcache" );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Registers the sounds from a previously written image, if it was
+//  built from the same manifest and scripts.
+// Output : Returns true if the scripts don't need parsing.
+//-----------------------------------------------------------------------------
+bool CSoundEmitterSystemBase::LoadSoundScriptImage( const char *pImageName )
+{
+	if ( !UseSoundScriptImage() )
+		return false;
+
+	double flStartTime = Plat_FloatTime();
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( pImageName, "MOD", buf ) )
+		return false;
+
+	const SoundScriptImageHeader_t *pHeader = (const SoundScriptImageHeader_t *)buf.Base();
+	if ( !IsSoundScriptImageValid( pHeader, buf.TellMaxPut() ) )
+	{
+		DevMsg( "CSoundEmitterSystem:  Ignoring bad sound script image %s\n", pImageName );
+		return false;
+	}
+
+	if ( pHeader->uManifestChecksum != m_uManifestPlusScriptChecksum )
+	{
+		DevMsg( "CSoundEmitterSystem:  Sound scripts changed since %s was written, rebuilding\n", pImageName );
+		return false;
+	}
+
+	const int *pScripts = pHeader->Data<int>( pHeader->nScriptOffset );
+	for ( int i = 0; i < pHeader->nNumScripts; i++ )
+	{
+		CSoundScriptFile sf;
+		sf.hFilename = filesystem->FindOrAddFileName( pHeader->String( pScripts[ i ] ) );
+		sf.dirty = false;
+		m_SoundKeyValues.AddToTail( sf );
+	}
+
+	// Wave names get added to the symbol table the first time an entry uses them
+	CUtlVector< CUtlSymbol > waveSymbols;
+	waveSymbols.SetCount( pHeader->nNumStrings );
+
+	CUtlVector< UtlHashHandle_t > handles;
+	handles.SetCount( pHeader->nNumSounds );
+
+	const SoundScriptImageEntry_t *pEntries = pHeader->Data<SoundScriptImageEntry_t>( pHeader->nSoundOffset );
+	const SoundScriptImageWave_t *pWaves = pHeader->Data<SoundScriptImageWave_t>( pHeader->nWaveOffset );
+	for ( int i = 0; i < pHeader->nNumSounds; i++ )
+	{
+		const SoundScriptImageEntry_t &entry = pEntries[ i ];
+
+		CSoundEntry *pEntry;
+
+		{
+			MEM_ALLOC_CREDIT();
+			pEntry = new CSoundEntry;
+		}
+
+		pEntry->m_Name = pHeader->String( entry.nName );
+		pEntry->m_bRemoved			= false;
+		pEntry->m_nScriptFileIndex	= entry.nScript;
+		pEntry->m_bIsOverride		= false;
+
+		CSoundParametersInternal &params = pEntry->m_SoundParams;
+		params.SetChannel( entry.nChannel );
+		params.SetVolume( entry.flVolumeStart, entry.flVolumeRange );
+		params.SetSoundLevel( entry.nSoundLevelStart, entry.nSoundLevelRange );
+		params.SetPitch( entry.nPitchStart, entry.nPitchRange );
+		params.SetDelayMsec( entry.nDelayMsec );
+		params.SetOnlyPlayToOwner( ( entry.nFlags & SOUNDSCRIPT_IMAGE_PLAY_TO_OWNER_ONLY ) != 0 );
+		params.SetUsesGenderToken( ( entry.nFlags & SOUNDSCRIPT_IMAGE_USES_GENDER_TOKEN ) != 0 );
+		params.SetShouldPreload( ( entry.nFlags & SOUNDSCRIPT_IMAGE_PRELOAD ) != 0 );
+
+		int nWaves = entry.nSoundNames + entry.nConvertedNames;
+		for ( int j = 0; j < nWaves; j++ )
+		{
+			const SoundScriptImageWave_t &wave = pWaves[ entry.nFirstWave + j ];
+
+			CUtlSymbol &sym = waveSymbols[ wave.nString ];
+			if ( !sym.IsValid() )
+			{
+				sym = m_Waves.AddString( pHeader->String( wave.nString ) );
+			}
+
+			SoundFile e;
+			e.symbol = sym;
+			e.gender = wave.gender;
+			if ( j < entry.nSoundNames )
+			{
+				params.AddSoundName( e );
+			}
+			else
+			{
+				params.AddConvertedName( e );
+			}
+		}
+
+		handles[ i ] = m_Sounds.Insert( pEntry );
+		if ( m_Sounds[ handles[ i ] ] != pEntry )
+		{
+			// Names were unique when the image was written
+			Assert( 0 );
+			delete pEntry;
+		}
+	}
+
+	SetSoundIndexFromImage( pHeader, handles );
+
+	DevMsg( "CSoundEmitterSystem:  Loaded %i sounds from %s in %.1f msec\n", 
+		pHeader->nNumSounds, pImageName, ( Plat_FloatTime() - flStartTime ) * 1000.0 );
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the sounds parsed from the manifest's scripts to an image
+//  that the next mod init can load instead.
+//-----------------------------------------------------------------------------
+void CSoundEmitterSystemBase::WriteSoundScriptImage( const char *pImageName )
+{
+	if ( !UseSoundScriptImage() || m_Sounds.Count() == 0 )
+		return;
+
+	CUtlVector< UtlHashHandle_t > handles;
+	CUtlVector< const char * > names;
+	handles.EnsureCapacity( m_Sounds.Count() );
+	names.EnsureCapacity( m_Sounds.Count() );
+	for ( UtlHashHandle_t i = m_Sounds.FirstHandle(); i != m_Sounds.InvalidHandle(); i = m_Sounds.NextHandle( i ) )
+	{
+		Assert( !m_Sounds[ i ]->IsOverride() );
+		handles.AddToTail( i );
+		names.AddToTail( m_Sounds[ i ]->m_Name.Get() );
+	}
+
+	CUtlVector< unsigned int > seeds;
+	CUtlVector< int > slots;
+	if ( !BuildSoundNamePerfectHash( names, seeds, slots ) )
+	{
+		// Still worth writing, lookups just go through m_Sounds
+		seeds.Purge();
+		slots.Purge();
+	}
+
+	// strings are sound names, then script names, then each distinct wave name
+	CUtlBuffer stringPool;
+	CUtlVector< int > stringOffsets;
+
+	for ( int i = 0; i < names.Count(); i++ )
+	{
+		stringOffsets.AddToTail( stringPool.TellPut() );
+		stringPool.PutString( names[ i ] );
+	}
+
+	CUtlVector< int > scripts;
+	for ( int i = 0; i < m_SoundKeyValues.Count(); i++ )
+	{
+		char fn[ 512 ];
+		if ( !filesystem->String( m_SoundKeyValues[ i ].hFilename, fn, sizeof( fn ) ) )
+		{
+			fn[ 0 ] = 0;
+		}
+
+		scripts.AddToTail( stringOffsets.AddToTail( stringPool.TellPut() ) );
+		stringPool.PutString( fn );
+	}
+
+	CUtlHashtable< UtlSymId_t, int > waveStrings;
+	CUtlVector< SoundScriptImageEntry_t > entries;
+	CUtlVector< SoundScriptImageWave_t > waves;
+	entries.SetCount( handles.Count() );
+
+	for ( int i = 0; i < handles.Count(); i++ )
+	{
+		const CSoundEntry *pEntry = m_Sounds[ handles[ i ] ];
+		const CSoundParametersInternal &params = pEntry->m_SoundParams;
+
+		SoundScriptImageEntry_t &entry = entries[ i ];
+		memset( &entry, 0, sizeof( entry ) );
+		entry.nName = i;
+		entry.nFirstWave = waves.Count();
+		entry.nScript = pEntry->m_nScriptFileIndex;
+		entry.nSoundNames = params.NumSoundNames();
+		entry.nConvertedNames = params.NumConvertedNames();
+		entry.nChannel = params.GetChannel();
+		entry.flVolumeStart = params.GetVolume().start.GetFloat();
+		entry.flVolumeRange = params.GetVolume().range.GetFloat();
+		entry.nSoundLevelStart = params.GetSoundLevel().start;
+		entry.nSoundLevelRange = params.GetSoundLevel().range;
+		entry.nPitchStart = params.GetPitch().start;
+		entry.nPitchRange = params.GetPitch().range;
+		entry.nDelayMsec = params.GetDelayMsec();
+		entry.nFlags = ( params.OnlyPlayToOwner() ? SOUNDSCRIPT_IMAGE_PLAY_TO_OWNER_ONLY : 0 ) |
+			( params.UsesGenderToken() ? SOUNDSCRIPT_IMAGE_USES_GENDER_TOKEN : 0 ) |
+			( params.ShouldPreload() ? SOUNDSCRIPT_IMAGE_PRELOAD : 0 );
+
+		for ( int j = 0; j < entry.nSoundNames + entry.nConvertedNames; j++ )
+		{
+			const SoundFile &soundFile = ( j < entry.nSoundNames ) ? params.GetSoundNames()[ j ] : params.GetConvertedNames()[ j - entry.nSoundNames ];
+
+			UtlHashHandle_t hWave = waveStrings.Find( soundFile.symbol );
+			if ( hWave == waveStrings.InvalidHandle() )
+			{
+				hWave = waveStrings.Insert( soundFile.symbol, stringOffsets.AddToTail( stringPool.TellPut() ) );
+				stringPool.PutString( m_Waves.String( soundFile.symbol ) );
+			}
+
+			SoundScriptImageWave_t wave;
+			memset( &wave, 0, sizeof( wave ) );
+			wave.nString = waveStrings[ hWave ];
+			wave.gender = soundFile.gender;
+			waves.AddToTail( wave );
+		}
+	}
+
+	// keep everything after the pool dword aligned
+	while ( stringPool.TellPut() & 3 )
+	{
+		stringPool.PutChar( 0 );
+	}
+
+	// first header, then lookup table, then string pool blob, then the fixed size tables
+	int stringPoolStart = sizeof( SoundScriptImageHeader_t ) + stringOffsets.Count() * sizeof( unsigned int );
+
+	SoundScriptImageHeader_t imageHeader;
+	memset( &imageHeader, 0, sizeof( imageHeader ) );
+	imageHeader.nId = SOUNDSCRIPT_IMAGE_ID;
+	imageHeader.nVersion = SOUNDSCRIPT_IMAGE_VERSION;
+	imageHeader.uManifestChecksum = m_uManifestPlusScriptChecksum;
+	imageHeader.nNumStrings = stringOffsets.Count();
+	imageHeader.nNumScripts = scripts.Count();
+	imageHeader.nNumSounds = entries.Count();
+	imageHeader.nNumWaves = waves.Count();
+	imageHeader.nNumBuckets = seeds.Count();
+	imageHeader.nNumSlots = slots.Count();
+	imageHeader.nScriptOffset = stringPoolStart + stringPool.TellPut();
+	imageHeader.nSoundOffset = imageHeader.nScriptOffset + scripts.Count() * sizeof( int );
+	imageHeader.nWaveOffset = imageHeader.nSoundOffset + entries.Count() * sizeof( SoundScriptImageEntry_t );
+	imageHeader.nBucketOffset = imageHeader.nWaveOffset + waves.Count() * sizeof( SoundScriptImageWave_t );
+	imageHeader.nSlotOffset = imageHeader.nBucketOffset + seeds.Count() * sizeof( unsigned int );
+
+	CUtlBuffer buf;
+	buf.Put( &imageHeader, sizeof( imageHeader ) );
+	for ( int i = 0; i < stringOffsets.Count(); i++ )
+	{
+		buf.PutUnsignedInt( stringPoolStart + stringOffsets[ i ] );
+	}
+	Assert( stringPoolStart == buf.TellPut() );
+	buf.Put( stringPool.Base(), stringPool.TellPut() );
+	buf.Put( scripts.Base(), scripts.Count() * sizeof( int ) );
+	buf.Put( entries.Base(), entries.Count() * sizeof( SoundScriptImageEntry_t ) );
+	buf.Put( waves.Base(), waves.Count() * sizeof( SoundScriptImageWave_t ) );
+	buf.Put( seeds.Base(), seeds.Count() * sizeof( unsigned int ) );
+	buf.Put( slots.Base(), slots.Count() * sizeof( int ) );
+	Assert( imageHeader.nSlotOffset + slots.Count() * (int)sizeof( int ) == buf.TellPut() );
+
+	char path[ MAX_PATH ];
+	Q_ExtractFilePath( pImageName, path, sizeof( path ) );
+	filesystem->CreateDirHierarchy( path, "MOD" );
+
+	if ( filesystem->FileExists( pImageName, "MOD" ) && 
+		 !filesystem->IsFileWritable( pImageName, "MOD" ) )
+	{
+		filesystem->SetFileWritable( pImageName, true, "MOD" );
+	}
+
+	if ( filesystem->WriteFile( pImageName, "MOD", buf ) )
+	{
+		DevMsg( "CSoundEmitterSystem:  Wrote %i sounds to %s (%i bytes)\n", entries.Count(), pImageName, buf.TellPut() );
+	}
+	else
+	{
+		DevMsg( "CSoundEmitterSystem:  Unable to write %s\n", pImageName );
+	}
+
+	SetSoundIndexFromImage( (const SoundScriptImageHeader_t *)buf.Base(), handles );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Points the image's perfect hash at the handles its sounds got in m_Sounds
+//-----------------------------------------------------------------------------
+void CSoundEmitterSystemBase::SetSoundIndexFromImage( const SoundScriptImageHeader_t *pHeader, const CUtlVector< UtlHashHandle_t > &handles )
+{
+	m_SoundIndexSeeds.CopyArray( pHeader->Data<unsigned int>( pHeader->nBucketOffset ), pHeader->nNumBuckets );
+
+	const int *pSlots = pHeader->Data<int>( pHeader->nSlotOffset );
+	m_SoundIndexSlots.SetCount( pHeader->nNumSlots );
+	for ( int i = 0; i < pHeader->nNumSlots; i++ )
+	{
+		m_SoundIndexSlots[ i ] = ( pSlots[ i ] >= 0 ) ? handles[ pSlots[ i ] ] : m_Sounds.InvalidHandle();
+	}
+
+	m_bSoundIndexComplete = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks a sound up in the perfect hash, falling back to m_Sounds for
+//  sounds added since it was built.
+//-----------------------------------------------------------------------------
+UtlHashHandle_t CSoundEmitterSystemBase::FindSoundInIndex( const char *pName ) const
+{
+	char szLower[ 256 ];
+	int nLen = LowerSoundName( pName, szLower, sizeof( szLower ) );
+	if ( nLen >= 0 )
+	{
+		unsigned int nBucket = MurmurHash2( szLower, nLen, SOUNDSCRIPT_IMAGE_BUCKET_SEED ) % (unsigned int)m_SoundIndexSeeds.Count();
+		unsigned int nSlot = MurmurHash2( szLower, nLen, m_SoundIndexSeeds[ nBucket ] ) % (unsigned int)m_SoundIndexSlots.Count();
+
+		UtlHashHandle_t idx = m_SoundIndexSlots[ nSlot ];
+		if ( m_Sounds.IsValidHandle( idx ) && !Q_stricmp( m_Sounds[ idx ]->m_Name.Get(), pName ) )
+			return idx;
+
+		if ( m_bSoundIndexComplete )
+			return m_Sounds.InvalidHandle();
+	}
+
+	return m_Sounds.Find( pName );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Output : Returns true on success, false on failure.
@@ -198,22 +752,13 @@ bool CSoundEmitterSystemBase::InternalModInit()
 	{
 		AccumulateFileNameAndTimestampIntoChecksum( &crc, MANIFEST_FILE );
 
+		// Checksum every listed script up front, it decides whether the scripts need parsing at all
 		for ( KeyValues *sub = manifest->GetFirstSubKey(); sub != NULL; sub = sub->GetNextKey() )
 		{
-			if ( !Q_stricmp( sub->GetName(), "precache_file" ) )
+			if ( !Q_stricmp( sub->GetName(), "precache_file" ) ||
+				 !Q_stricmp( sub->GetName(), "preload_file" ) )
 			{
 				AccumulateFileNameAndTimestampIntoChecksum( &crc, sub->GetString() );
-
-				// Add and always precache
-				AddSoundsFromFile( sub->GetString(), false );
-				continue;
-			}
-			else if ( !Q_stricmp( sub->GetName(), "preload_file" ) )
-			{
-				AccumulateFileNameAndTimestampIntoChecksum( &crc, sub->GetString() );
-
-				// Add and always precache
-				AddSoundsFromFile( sub->GetString(), true );
 				continue;
 			}
 			else if ( !Q_stricmp( sub->GetName(), "faceposer_file" ) )
@@ -225,6 +770,29 @@ bool CSoundEmitterSystemBase::InternalModInit()
 			Warning( "CSoundEmitterSystemBase::BaseInit:  Manifest '%s' with bogus file type '%s', expecting 'declare_file' or 'precache_file'\n", 
 				MANIFEST_FILE, sub->GetName() );
 		}
+
+		CRC32_Final( &crc );
+
+		m_uManifestPlusScriptChecksum =( unsigned int )crc;
+
+		if ( !LoadSoundScriptImage( SOUNDSCRIPT_IMAGE_FILE ) )
+		{
+			for ( KeyValues *sub = manifest->GetFirstSubKey(); sub != NULL; sub = sub->GetNextKey() )
+			{
+				if ( !Q_stricmp( sub->GetName(), "precache_file" ) )
+				{
+					// Add and always precache
+					AddSoundsFromFile( sub->GetString(), false );
+				}
+				else if ( !Q_stricmp( sub->GetName(), "preload_file" ) )
+				{
+					// Add and always precache
+					AddSoundsFromFile( sub->GetString(), true );
+				}
+			}
+
+			WriteSoundScriptImage( SOUNDSCRIPT_IMAGE_FILE );
+		}
 	}
 	else
 	{
@@ -232,10 +800,6 @@ bool CSoundEmitterSystemBase::InternalModInit()
 	}
 	manifest->deleteThis();
 
-	CRC32_Final( &crc );
-
-	m_uManifestPlusScriptChecksum =( unsigned int )crc;
-
 // Only print total once, on server
 #if !defined( CLIENT_DLL ) && !defined( FACEPOSER )
 	DevMsg( 1, "CSoundEmitterSystem:  Registered %i sounds\n", m_Sounds.Count() );
@@ -284,6 +848,10 @@ void CSoundEmitterSystemBase::InternalModShutdown()
 	m_SavedOverrides.Purge();
 	m_Waves.RemoveAll();
 	m_ActorGenders.Purge();
+
+	m_SoundIndexSeeds.Purge();
+	m_SoundIndexSlots.Purge();
+	m_bSoundIndexComplete = false;
 }
 
 
@@ -307,9 +875,7 @@ int	CSoundEmitterSystemBase::GetSoundIndex( const char *pName ) const
 	if ( !pName )
 		return -1;
 
-	CSoundEntry search;
-	search.m_Name = pName;
-	UtlHashHandle_t idx = m_Sounds.Find( pName );
+	UtlHashHandle_t idx = m_SoundIndexSeeds.Count() ? FindSoundInIndex( pName ) : m_Sounds.Find( pName );
 	if ( idx == m_Sounds.InvalidHandle() )
 		return -1;
 
@@ -914,6 +1480,8 @@ void CSoundEmitterSystemBase::AddSoundsFromFile( const char *filename, bool bPre
 
 					InitSoundInternalParameters( pKeys->GetName(), pKeys, pEntry->m_SoundParams );
 					pEntry->m_SoundParams.SetShouldPreload( bPreload ); // this gets handled by game code after initting.
+
+					m_bSoundIndexComplete = false;
 				}
 			}
 			pKeys = pKeys->GetNextKey();
@@ -1184,6 +1752,7 @@ bool CSoundEmitterSystemBase::AddSound( const char *soundname, const char *scrip
 	pEntry->m_SoundParams.CopyFrom( params );
 
 	m_Sounds.Insert( pEntry );
+	m_bSoundIndexComplete = false;
 
 	m_SoundKeyValues[ i ].dirty = true;
 
@@ -1469,6 +2038,7 @@ void CSoundEmitterSystemBase::RenameSound( const char *soundname, const char *ne
 	pEntry->m_Name = newname;
 	// Re-insert in new spot
 	m_Sounds.Insert( pEntry );
+	m_bSoundIndexComplete = false;
 
 	// Mark associated script as dirty
 	m_SoundKeyValues[ pEntry->m_nScriptFileIndex ].dirty = true;
@@ -1652,6 +2222,7 @@ void CSoundEmitterSystemBase::ClearSoundOverrides()
 	{
 		CSoundEntry *entry = m_SavedOverrides[ i ];
 		m_Sounds.Insert( entry );
+		m_bSoundIndexComplete = false;
 	}
 
 	m_SavedOverrides.Purge();
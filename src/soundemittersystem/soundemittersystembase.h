@@ -18,6 +18,8 @@
 #include <tier1/utlstring.h>
 #include <tier1/utlhashtable.h>
 
+struct SoundScriptImageHeader_t;
+
 soundlevel_t TextToSoundLevel( const char *key );
 
 struct CSoundEntry
@@ -153,6 +155,11 @@ private:
 
 	void LoadGlobalActors();
 
+	bool LoadSoundScriptImage( const char *pImageName );
+	void WriteSoundScriptImage( const char *pImageName );
+	void SetSoundIndexFromImage( const SoundScriptImageHeader_t *pHeader, const CUtlVector< UtlHashHandle_t > &handles );
+	UtlHashHandle_t FindSoundInIndex( const char *pName ) const;
+
 	float	TranslateAttenuation( const char *key );
 	soundlevel_t	TranslateSoundLevel( const char *key );
 	int TranslateChannel( const char *name );
@@ -178,6 +185,12 @@ private:
 	unsigned int		m_uManifestPlusScriptChecksum;
 
 	CUtlSymbolTable		m_Waves;
+
+	// Perfect hash over the sounds registered at mod init, taken from the sound script image.
+	// Once other sounds get inserted into m_Sounds, names missing from it fall back to m_Sounds.Find.
+	CUtlVector< unsigned int >		m_SoundIndexSeeds;
+	CUtlVector< UtlHashHandle_t >	m_SoundIndexSlots;
+	bool							m_bSoundIndexComplete;
 };
 
 #endif // SOUNDEMITTERSYSTEMBASE_H
@@ -21,6 +21,12 @@
 #endif
 
 #include <malloc.h>
+#ifdef POSIX
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
 
 #include "tier0/valve_minmax_off.h"	// GCC 4.2.2 headers screw up our min/max defs.
 #include <algorithm>
@@ -1069,6 +1075,434 @@ CSmallBlockPool *CSmallBlockHeap::FindPool( void *p )
 
 #endif
 
+#ifdef MEM_THREAD_HEAP_ENABLED
+//-----------------------------------------------------------------------------
+// Thread caching small block heap (POSIX)
+//-----------------------------------------------------------------------------
+
+// Size classes, all multiples of THREAD_HEAP_ALIGN
+static const unsigned s_ThreadHeapClassSizes[THREAD_HEAP_NUM_CLASSES] =
+{
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256,
+	320, 384, 448, 512,
+	640, 768, 896, 1024,
+	1280, 1536, 1792, 2048,
+};
+
+// Roughly how many bytes a thread moves to or from the shared class at a time
+#define THREAD_HEAP_BATCH_BYTES		(16*1024)
+
+struct ThreadHeapCache_t
+{
+	struct Bin_t
+	{
+		void *	m_pHead;
+		int		m_nCount;
+	};
+
+	Bin_t				m_Bins[THREAD_HEAP_NUM_CLASSES];
+
+	// Stats, only written by the owning thread
+	uint64				m_nAllocs[THREAD_HEAP_NUM_CLASSES];
+	uint64				m_nRequestedBytes[THREAD_HEAP_NUM_CLASSES];
+
+	ThreadHeapCache_t	*m_pNext;
+	ThreadHeapCache_t	*m_pPrev;
+};
+
+static CThreadCachingHeap *s_pThreadHeap;
+static __thread ThreadHeapCache_t *t_pThreadHeapCache;
+static pthread_key_t s_ThreadHeapKey;
+
+static void ThreadHeapCacheDestructor( void *pCache )
+{
+	s_pThreadHeap->ReleaseThreadCache( (ThreadHeapCache_t *)pCache );
+}
+
+// The heap has to be chosen before the first allocation, which is long before
+//  CommandLine() exists, so read the command line straight from the OS.
+static bool ThreadHeapRequested()
+{
+#ifdef LINUX
+	int fd = open( "/proc/self/cmdline", O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	char buf[4096];
+	int nRead = read( fd, buf, sizeof( buf ) - 1 );
+	close( fd );
+	if ( nRead <= 0 )
+		return false;
+
+	// Arguments are separated by NULs
+	buf[nRead] = 0;
+	for ( int i = 0; i < nRead; i += strlen( buf + i ) + 1 )
+	{
+		if ( !strcmp( buf + i, "-threadheap" ) )
+			return true;
+	}
+	return false;
+#else
+	return false;
+#endif
+}
+
+void CThreadHeapClass::Init( unsigned nBlockSize, byte *pBase )
+{
+	m_pFreeList = NULL;
+	m_nFree = 0;
+	m_nBlockSize = nBlockSize;
+	m_nBatchSize = THREAD_HEAP_BATCH_BYTES / nBlockSize;
+	if ( m_nBatchSize > 64 )
+	{
+		m_nBatchSize = 64;
+	}
+	else if ( m_nBatchSize < 4 )
+	{
+		m_nBatchSize = 4;
+	}
+	m_pBase = m_pNextAlloc = pBase;
+	m_pLimit = pBase + THREAD_HEAP_CLASS_REGION;
+}
+
+int CThreadHeapClass::FetchBatch( void **ppHead, int nWanted )
+{
+	AUTO_LOCK( m_Mutex );
+
+	void *pHead = NULL;
+	int nCount = 0;
+
+	// Recycled blocks first
+	while ( nCount < nWanted && m_pFreeList )
+	{
+		void *p = m_pFreeList;
+		m_pFreeList = *(void **)p;
+		*(void **)p = pHead;
+		pHead = p;
+		++nCount;
+	}
+	m_nFree -= nCount;
+
+	// Then fresh ones. The region is reserved with MAP_NORESERVE, so pages are only
+	//  committed when first touched.
+	while ( nCount < nWanted && m_pNextAlloc + m_nBlockSize <= m_pLimit )
+	{
+		void *p = m_pNextAlloc;
+		m_pNextAlloc += m_nBlockSize;
+		*(void **)p = pHead;
+		pHead = p;
+		++nCount;
+	}
+
+	*ppHead = pHead;
+	return nCount;
+}
+
+void CThreadHeapClass::ReturnBatch( void *pHead, void *pTail, int nCount )
+{
+	AUTO_LOCK( m_Mutex );
+	*(void **)pTail = m_pFreeList;
+	m_pFreeList = pHead;
+	m_nFree += nCount;
+}
+
+size_t CThreadHeapClass::GetCommittedSize()
+{
+	return m_pNextAlloc - m_pBase;
+}
+
+int CThreadHeapClass::CountCommittedBlocks()
+{
+	return GetCommittedSize() / m_nBlockSize;
+}
+
+int CThreadHeapClass::CountFreeBlocks()
+{
+	return m_nFree;
+}
+
+CThreadCachingHeap::CThreadCachingHeap()
+{
+	m_pBase = m_pLimit = NULL;
+	m_pCaches = NULL;
+	memset( m_RetiredAllocs, 0, sizeof( m_RetiredAllocs ) );
+	memset( m_RetiredRequestedBytes, 0, sizeof( m_RetiredRequestedBytes ) );
+}
+
+void CThreadCachingHeap::Init()
+{
+	if ( m_pBase || !ThreadHeapRequested() )
+		return;
+
+	size_t nReserve = (size_t)THREAD_HEAP_NUM_CLASSES * THREAD_HEAP_CLASS_REGION;
+	void *pBase = mmap( NULL, nReserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+	if ( pBase == MAP_FAILED )
+		return;
+
+	if ( pthread_key_create( &s_ThreadHeapKey, ThreadHeapCacheDestructor ) != 0 )
+	{
+		munmap( pBase, nReserve );
+		return;
+	}
+
+	s_pThreadHeap = this;
+
+	int iClass = 0;
+	for ( int i = 0; i < ARRAYSIZE( m_ClassLookup ); i++ )
+	{
+		unsigned nSize = ( i + 1 ) * THREAD_HEAP_ALIGN;
+		while ( s_ThreadHeapClassSizes[iClass] < nSize )
+		{
+			iClass++;
+		}
+		m_ClassLookup[i] = iClass;
+	}
+
+	for ( int i = 0; i < THREAD_HEAP_NUM_CLASSES; i++ )
+	{
+		m_Classes[i].Init( s_ThreadHeapClassSizes[i], (byte *)pBase + (size_t)i * THREAD_HEAP_CLASS_REGION );
+	}
+
+	// Set last, ShouldUse and IsOwner key off these
+	m_pLimit = (byte *)pBase + nReserve;
+	m_pBase = (byte *)pBase;
+}
+
+ThreadHeapCache_t *CThreadCachingHeap::GetThreadCache()
+{
+	ThreadHeapCache_t *pCache = t_pThreadHeapCache;
+	if ( pCache )
+		return pCache;
+
+	pCache = (ThreadHeapCache_t *)calloc( 1, sizeof( ThreadHeapCache_t ) );
+	if ( !pCache )
+		return NULL;
+
+	{
+		AUTO_LOCK( m_CachesMutex );
+		pCache->m_pNext = m_pCaches;
+		if ( m_pCaches )
+		{
+			m_pCaches->m_pPrev = pCache;
+		}
+		m_pCaches = pCache;
+	}
+
+	t_pThreadHeapCache = pCache;
+	pthread_setspecific( s_ThreadHeapKey, pCache );
+	return pCache;
+}
+
+void CThreadCachingHeap::ReleaseThreadCache( ThreadHeapCache_t *pCache )
+{
+	for ( int i = 0; i < THREAD_HEAP_NUM_CLASSES; i++ )
+	{
+		ThreadHeapCache_t::Bin_t &bin = pCache->m_Bins[i];
+		if ( !bin.m_pHead )
+			continue;
+
+		void *pTail = bin.m_pHead;
+		while ( *(void **)pTail )
+		{
+			pTail = *(void **)pTail;
+		}
+		m_Classes[i].ReturnBatch( bin.m_pHead, pTail, bin.m_nCount );
+	}
+
+	{
+		AUTO_LOCK( m_CachesMutex );
+		for ( int i = 0; i < THREAD_HEAP_NUM_CLASSES; i++ )
+		{
+			m_RetiredAllocs[i] += pCache->m_nAllocs[i];
+			m_RetiredRequestedBytes[i] += pCache->m_nRequestedBytes[i];
+		}
+
+		if ( pCache->m_pPrev )
+		{
+			pCache->m_pPrev->m_pNext = pCache->m_pNext;
+		}
+		else
+		{
+			m_pCaches = pCache->m_pNext;
+		}
+		if ( pCache->m_pNext )
+		{
+			pCache->m_pNext->m_pPrev = pCache->m_pPrev;
+		}
+	}
+
+	if ( t_pThreadHeapCache == pCache )
+	{
+		t_pThreadHeapCache = NULL;
+	}
+	free( pCache );
+}
+
+void *CThreadCachingHeap::Alloc( size_t nBytes )
+{
+	if ( !nBytes )
+	{
+		nBytes = 1;
+	}
+
+	ThreadHeapCache_t *pCache = GetThreadCache();
+	if ( !pCache )
+		return NULL;
+
+	int iClass = FindClass( nBytes );
+	ThreadHeapCache_t::Bin_t &bin = pCache->m_Bins[iClass];
+	if ( !bin.m_pHead )
+	{
+		CThreadHeapClass &heapClass = m_Classes[iClass];
+		bin.m_nCount = heapClass.FetchBatch( &bin.m_pHead, heapClass.GetBatchSize() );
+		if ( !bin.m_nCount )
+			return NULL;	// class region is full
+	}
+
+	void *p = bin.m_pHead;
+	bin.m_pHead = *(void **)p;
+	--bin.m_nCount;
+
+	++pCache->m_nAllocs[iClass];
+	pCache->m_nRequestedBytes[iClass] += nBytes;
+	return p;
+}
+
+void *CThreadCachingHeap::Realloc( void *p, size_t nBytes )
+{
+	if ( !nBytes )
+	{
+		Free( p );
+		return NULL;
+	}
+
+	size_t nOldSize = GetSize( p );
+	if ( nBytes <= nOldSize && FindClass( nBytes ) == FindClass( p ) )
+	{
+		// Still the right size class
+		return p;
+	}
+
+	void *pNew = ShouldUse( nBytes ) ? Alloc( nBytes ) : NULL;
+	if ( !pNew )
+	{
+		pNew = malloc( nBytes );
+		if ( !pNew )
+			return NULL;
+	}
+
+	memcpy( pNew, p, MIN( nOldSize, nBytes ) );
+	Free( p );
+	return pNew;
+}
+
+void CThreadCachingHeap::Free( void *p )
+{
+	ThreadHeapCache_t *pCache = GetThreadCache();
+	int iClass = FindClass( p );
+	CThreadHeapClass &heapClass = m_Classes[iClass];
+
+	if ( !pCache )
+	{
+		heapClass.ReturnBatch( p, p, 1 );
+		return;
+	}
+
+	ThreadHeapCache_t::Bin_t &bin = pCache->m_Bins[iClass];
+	*(void **)p = bin.m_pHead;
+	bin.m_pHead = p;
+	++bin.m_nCount;
+
+	// Keep at most two batches per class on this thread, give one back
+	int nBatch = heapClass.GetBatchSize();
+	if ( bin.m_nCount > 2 * nBatch )
+	{
+		void *pHead = bin.m_pHead;
+		void *pTail = pHead;
+		for ( int i = 1; i < nBatch; i++ )
+		{
+			pTail = *(void **)pTail;
+		}
+		bin.m_pHead = *(void **)pTail;
+		bin.m_nCount -= nBatch;
+		heapClass.ReturnBatch( pHead, pTail, nBatch );
+	}
+}
+
+size_t CThreadCachingHeap::GetSize( void *p )
+{
+	return m_Classes[FindClass( p )].GetBlockSize();
+}
+
+void CThreadCachingHeap::DumpStats( FILE *pFile )
+{
+	int nCached[THREAD_HEAP_NUM_CLASSES] = {};
+	uint64 nAllocs[THREAD_HEAP_NUM_CLASSES];
+	uint64 nRequestedBytes[THREAD_HEAP_NUM_CLASSES];
+	int nThreads = 0;
+
+	{
+		AUTO_LOCK( m_CachesMutex );
+		memcpy( nAllocs, m_RetiredAllocs, sizeof( nAllocs ) );
+		memcpy( nRequestedBytes, m_RetiredRequestedBytes, sizeof( nRequestedBytes ) );
+
+		// Other threads' counters are read without their cooperation, good enough for stats
+		for ( ThreadHeapCache_t *pCache = m_pCaches; pCache; pCache = pCache->m_pNext )
+		{
+			for ( int i = 0; i < THREAD_HEAP_NUM_CLASSES; i++ )
+			{
+				nCached[i] += pCache->m_Bins[i].m_nCount;
+				nAllocs[i] += pCache->m_nAllocs[i];
+				nRequestedBytes[i] += pCache->m_nRequestedBytes[i];
+			}
+			nThreads++;
+		}
+	}
+
+	size_t bytesCommitted = 0;
+	size_t bytesAllocated = 0;
+
+	for ( int i = 0; i < THREAD_HEAP_NUM_CLASSES; i++ )
+	{
+		CThreadHeapClass &heapClass = m_Classes[i];
+		size_t nCommitted = heapClass.GetCommittedSize();
+		int nFree = heapClass.CountFreeBlocks();
+		int nAllocated = heapClass.CountCommittedBlocks() - nFree - nCached[i];
+		size_t nAllocatedBytes = (size_t)nAllocated * heapClass.GetBlockSize();
+
+		// Fragmentation is committed memory not holding a live block; fill is how much
+		//  of each block the requests actually used
+		float flFragmentation = nCommitted ? 100.0f * ( nCommitted - nAllocatedBytes ) / nCommitted : 0.0f;
+		float flFill = nAllocs[i] ? 100.0f * nRequestedBytes[i] / ( nAllocs[i] * heapClass.GetBlockSize() ) : 0.0f;
+
+		if ( pFile )
+		{
+			// output for vxconsole parsing
+			fprintf( pFile, "Class %i: Size: %u Allocated: %i Free: %i ThreadCached: %i CommittedSize: %llu Allocs: %llu Fill: %.1f%% Fragmentation: %.1f%%\n",
+				i, heapClass.GetBlockSize(), nAllocated, nFree, nCached[i], (uint64)nCommitted, nAllocs[i], flFill, flFragmentation );
+		}
+		else
+		{
+			Msg( "Class %i: (size: %u) blocks: allocated:%i free:%i thread cached:%i (committed size:%llu kb) allocs:%llu fill:%.1f%% fragmentation:%.1f%%\n",
+				i, heapClass.GetBlockSize(), nAllocated, nFree, nCached[i], (uint64)nCommitted / 1024, nAllocs[i], flFill, flFragmentation );
+		}
+
+		bytesCommitted += nCommitted;
+		bytesAllocated += nAllocatedBytes;
+	}
+
+	if ( pFile )
+	{
+		fprintf( pFile, "Totals: Threads: %i Committed: %llu Allocated: %llu\n", nThreads, (uint64)bytesCommitted, (uint64)bytesAllocated );
+	}
+	else
+	{
+		Msg( "Totals: Threads:%i Committed:%llu kb Allocated:%llu kb\n", nThreads, (uint64)bytesCommitted / 1024, (uint64)bytesAllocated / 1024 );
+	}
+}
+#endif
+
 #if USE_PHYSICAL_SMALL_BLOCK_HEAP
 
 CX360SmallBlockPool *CX360SmallBlockPool::gm_AddressToPool[BYTES_X360_SBH/PAGESIZE_X360_SBH];
@@ -1482,6 +1916,18 @@ void *CStdMemAlloc::Alloc( size_t nSize )
 	return pMem;
 }
 
+#endif
+
+#ifdef MEM_THREAD_HEAP_ENABLED
+	if ( m_ThreadHeap.ShouldUse( nSize ) )
+	{
+		pMem = m_ThreadHeap.Alloc( nSize );
+		if ( pMem )
+		{
+			ApplyMemoryInitializations( pMem, nSize );
+			return pMem;
+		}
+	}
 #endif
 
 	pMem = malloc( nSize );
@@ -1516,6 +1962,18 @@ void *CStdMemAlloc::Realloc( void *pMem, size_t nSize )
 	}
 #endif
 
+#ifdef MEM_THREAD_HEAP_ENABLED
+	if ( m_ThreadHeap.IsOwner( pMem ) )
+	{
+		void *pRet = m_ThreadHeap.Realloc( pMem, nSize );
+		if ( !pRet && nSize )
+		{
+			SetCRTAllocFailed( nSize );
+		}
+		return pRet;
+	}
+#endif
+
 	void *pRet = realloc( pMem, nSize );
 		if ( !pRet )
 		{
@@ -1549,6 +2007,14 @@ void CStdMemAlloc::Free( void *pMem )
 	}
 #endif
 
+#ifdef MEM_THREAD_HEAP_ENABLED
+	if ( m_ThreadHeap.IsOwner( pMem ) )
+	{
+		m_ThreadHeap.Free( pMem );
+		return;
+	}
+#endif
+
 	free( pMem );
 }
 
@@ -1613,6 +2079,12 @@ size_t CStdMemAlloc::GetSize( void *pMem )
 		return _msize( pMem );
 	}
 #else
+#ifdef MEM_THREAD_HEAP_ENABLED
+	if ( m_ThreadHeap.IsOwner( pMem ) )
+	{
+		return m_ThreadHeap.GetSize( pMem );
+	}
+#endif
 	return malloc_usable_size( pMem );
 #endif
 }
@@ -1716,6 +2188,22 @@ void CStdMemAlloc::DumpStatsFileBase( char const *pchFileBase )
 #endif
 
 		fclose( pFile );
+#elif defined( MEM_THREAD_HEAP_ENABLED )
+	if ( !m_ThreadHeap.IsEnabled() )
+		return;
+
+	char filename[ 512 ];
+	snprintf( filename, sizeof( filename ), "%s.txt", pchFileBase );
+	FILE *pFile = fopen( filename, "wt" );
+	if ( !pFile )
+		return;
+
+	fprintf( pFile, "Thread heap:\n" );
+	m_ThreadHeap.DumpStats( pFile );
+	fclose( pFile );
+
+	// Also spew to the console, there's no vxconsole to read the file on a dedicated server
+	m_ThreadHeap.DumpStats();
 #endif
 }
 
@@ -69,6 +69,14 @@
 #define MEM_SBH_ENABLED 1
 #endif
 
+// The thread caching heap is the POSIX counterpart of the SBH. It can't take over malloc either,
+//  so it has the same caveat: memory from it must only be freed through g_pMemAlloc. It owns a
+//  reserved address range, so anything that came from libc before it was enabled (or from header
+//  code outside memdbgon.h) is still recognized and handed back to libc. Off unless -threadheap.
+#if defined( POSIX ) && !defined( _PS3 ) && !defined( NO_THREAD_HEAP )
+#define MEM_THREAD_HEAP_ENABLED 1
+#endif
+
 class ALIGN16 CSmallBlockPool
 {
 public:
@@ -128,6 +136,84 @@ private:
 	byte *m_pLimit;
 } ALIGN16_POST;
 
+#ifdef MEM_THREAD_HEAP_ENABLED
+#define THREAD_HEAP_NUM_CLASSES		24
+#define THREAD_HEAP_MAX_BLOCK		MAX_SBH_BLOCK
+#define THREAD_HEAP_ALIGN			16
+// Address space reserved per size class; a class that fills its region sends further
+//  allocations to libc. 32-bit processes can't spare much, so keep the whole
+//  reservation there at 48MB.
+#ifdef PLATFORM_64BITS
+#define THREAD_HEAP_CLASS_REGION	(256*1024*1024)
+#else
+#define THREAD_HEAP_CLASS_REGION	(2*1024*1024)
+#endif
+
+// Blocks of one size class shared by all threads. Threads move blocks in and
+//  out of here in batches, so the lock is only taken once per batch.
+class CThreadHeapClass
+{
+public:
+	void Init( unsigned nBlockSize, byte *pBase );
+	unsigned GetBlockSize() const { return m_nBlockSize; }
+	int GetBatchSize() const { return m_nBatchSize; }
+
+	// Returns up to nWanted blocks linked through their first word
+	int FetchBatch( void **ppHead, int nWanted );
+	void ReturnBatch( void *pHead, void *pTail, int nCount );
+
+	size_t GetCommittedSize();
+	int CountCommittedBlocks();
+	int CountFreeBlocks();
+
+private:
+	CThreadFastMutex m_Mutex;
+	void *			m_pFreeList;
+	int				m_nFree;
+	unsigned		m_nBlockSize;
+	int				m_nBatchSize;
+	byte *			m_pBase;
+	byte *			m_pNextAlloc;
+	byte *			m_pLimit;
+};
+
+struct ThreadHeapCache_t;
+
+class CThreadCachingHeap
+{
+public:
+	CThreadCachingHeap();
+	void Init();
+	bool IsEnabled() const { return m_pBase != NULL; }
+	bool ShouldUse( size_t nBytes ) { return m_pBase && nBytes <= THREAD_HEAP_MAX_BLOCK; }
+	bool IsOwner( void *p ) { return (byte *)p >= m_pBase && (byte *)p < m_pLimit; }
+	void *Alloc( size_t nBytes );
+	void *Realloc( void *p, size_t nBytes );
+	void Free( void *p );
+	size_t GetSize( void *p );
+	void DumpStats( FILE *pFile = NULL );
+
+	// Called when a thread exits
+	void ReleaseThreadCache( ThreadHeapCache_t *pCache );
+
+private:
+	int FindClass( size_t nBytes ) { return m_ClassLookup[ ( nBytes - 1 ) / THREAD_HEAP_ALIGN ]; }
+	int FindClass( void *p ) { return ( (byte *)p - m_pBase ) / THREAD_HEAP_CLASS_REGION; }
+	ThreadHeapCache_t *GetThreadCache();
+
+	byte			m_ClassLookup[THREAD_HEAP_MAX_BLOCK / THREAD_HEAP_ALIGN];
+	CThreadHeapClass m_Classes[THREAD_HEAP_NUM_CLASSES];
+	byte *			m_pBase;
+	byte *			m_pLimit;
+
+	// All live thread caches, for stats. Counters of exited threads are folded into m_Retired*.
+	CThreadFastMutex m_CachesMutex;
+	ThreadHeapCache_t *m_pCaches;
+	uint64			m_RetiredAllocs[THREAD_HEAP_NUM_CLASSES];
+	uint64			m_RetiredRequestedBytes[THREAD_HEAP_NUM_CLASSES];
+};
+#endif
+
 #ifdef USE_PHYSICAL_SMALL_BLOCK_HEAP
 #define BYTES_X360_SBH (32*1024*1024)
 #define PAGESIZE_X360_SBH (64*1024)
@@ -213,6 +299,9 @@ public:
 	{
 		// Make sure that we return 64-bit addresses in 64-bit builds.
 		ReserveBottomMemory();
+#ifdef MEM_THREAD_HEAP_ENABLED
+		m_ThreadHeap.Init();
+#endif
 	}
 	// Release versions
 	virtual void *Alloc( size_t nSize );
@@ -276,6 +365,9 @@ public:
 	CX360SmallBlockHeap m_LargePageSmallBlockHeap;
 #endif
 #endif
+#ifdef MEM_THREAD_HEAP_ENABLED
+	CThreadCachingHeap m_ThreadHeap;
+#endif
 
 #if defined( _MEMTEST )
 	virtual void SetStatsExtraInfo( const char *pMapName, const char *pComment );
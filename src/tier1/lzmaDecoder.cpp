@@ -94,7 +94,7 @@ static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 bool CLZMA::IsCompressed( unsigned char *pInput )
 {
 	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	if ( pHeader && ( pHeader->id == LZMA_ID || pHeader->id == LZMA_CHUNKED_ID ) )
 	{
 		return true;
 	}
@@ -111,8 +111,9 @@ bool CLZMA::IsCompressed( unsigned char *pInput )
 unsigned int CLZMA::GetActualSize( unsigned char *pInput )
 {
 	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	if ( pHeader && ( pHeader->id == LZMA_ID || pHeader->id == LZMA_CHUNKED_ID ) )
 	{
+		// actualSize sits at the same offset in both headers
 		return LittleLong( pHeader->actualSize );
 	}
 
@@ -127,6 +128,44 @@ unsigned int CLZMA::GetActualSize( unsigned char *pInput )
 /* static */
 unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 {
+	if ( IsChunked( pInput ) )
+	{
+		// Without the caller's input size the chunks are only bounded by their own headers, like a plain
+		// stream is, which holds as long as they follow the table back to back
+		if ( !IsInputValid( pInput, GetInputSize( pInput ) ) )
+		{
+			Warning( "LZMA Decompression failed (bad chunk table)\n" );
+			return 0;
+		}
+
+		unsigned int nActualSize = GetActualSize( pInput );
+		unsigned int nTotal = 0;
+		int nChunks = GetNumChunks( pInput );
+		for ( int i = 0; i < nChunks; i++ )
+		{
+			// The caller's buffer only holds nActualSize bytes
+			if ( GetChunkActualSize( pInput, i ) > nActualSize - nTotal )
+			{
+				Warning( "LZMA Decompression failed (chunk %d overflows output)\n", i );
+				return 0;
+			}
+
+			unsigned int nChunkSize = UncompressChunk( pInput, i, pOutput + nTotal );
+			if ( !nChunkSize )
+			{
+				return 0;
+			}
+			nTotal += nChunkSize;
+		}
+
+		if ( nTotal != nActualSize )
+		{
+			Warning( "LZMA Decompression failed (chunked size mismatch)\n" );
+			return 0;
+		}
+		return nTotal;
+	}
+
 	lzma_header_t *pHeader = (lzma_header_t *)pInput;
 	if ( pHeader->id != LZMA_ID )
 	{
@@ -134,15 +173,9 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 		return false;
 	}
 
-	CLzmaDec state;
-
-	LzmaDec_Construct(&state);
-
-	if ( LzmaDec_Allocate(&state, pHeader->properties, LZMA_PROPS_SIZE, &g_Alloc) != SZ_OK )
-	{
-		Assert( false );
-		return 0;
-	}
+	// LzmaDecode() uses pOutput as its dictionary and only allocates the probability model,
+	// so there is no decoder state to allocate here. Allocating one as well would cost a
+	// second, dictionary sized (up to 64MB), buffer per call.
 
 	// These are in/out variables
 	SizeT outProcessed = pHeader->actualSize;
@@ -151,9 +184,6 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 	SRes result = LzmaDecode( (Byte *)pOutput, &outProcessed, (Byte *)(pInput + sizeof( lzma_header_t ) ),
 	                          &inProcessed, (Byte *)pHeader->properties, LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &g_Alloc );
 
-
-	LzmaDec_Free(&state, &g_Alloc);
-
 	if ( result != SZ_OK || pHeader->actualSize != outProcessed )
 	{
 		Warning( "LZMA Decompression failed (%i)\n", result );
@@ -163,6 +193,193 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 	return outProcessed;
 }
 
+//-----------------------------------------------------------------------------
+// Chunked buffers
+//-----------------------------------------------------------------------------
+/* static */
+bool CLZMA::IsChunked( unsigned char *pInput )
+{
+	lzma_chunked_header_t *pHeader = (lzma_chunked_header_t *)pInput;
+	return ( pHeader && pHeader->id == LZMA_CHUNKED_ID );
+}
+
+/* static */
+int CLZMA::GetNumChunks( unsigned char *pInput )
+{
+	if ( !IsChunked( pInput ) )
+	{
+		return 0;
+	}
+	return LittleLong( ((lzma_chunked_header_t *)pInput)->numChunks );
+}
+
+/* static */
+unsigned int CLZMA::GetChunkOffset( unsigned char *pInput, int iChunk )
+{
+	Assert( iChunk >= 0 && iChunk < GetNumChunks( pInput ) );
+	unsigned int *pOffsets = (unsigned int *)( pInput + sizeof( lzma_chunked_header_t ) );
+	return LittleLong( pOffsets[iChunk] );
+}
+
+/* static */
+unsigned int CLZMA::GetChunkActualSize( unsigned char *pInput, int iChunk )
+{
+	if ( iChunk < 0 || iChunk >= GetNumChunks( pInput ) )
+	{
+		return 0;
+	}
+	return GetActualSize( pInput + GetChunkOffset( pInput, iChunk ) );
+}
+
+/* static */
+unsigned int CLZMA::UncompressChunk( unsigned char *pInput, int iChunk, unsigned char *pOutput )
+{
+	if ( iChunk < 0 || iChunk >= GetNumChunks( pInput ) )
+	{
+		return 0;
+	}
+
+	unsigned char *pChunk = pInput + GetChunkOffset( pInput, iChunk );
+	if ( ((lzma_header_t *)pChunk)->id != LZMA_ID )
+	{
+		Warning( "LZMA Decompression failed (bad chunk %d)\n", iChunk );
+		return 0;
+	}
+	return Uncompress( pChunk, pOutput );
+}
+
+/* static */
+unsigned int CLZMA::GetInputSize( unsigned char *pInput )
+{
+	if ( !IsCompressed( pInput ) )
+	{
+		return 0;
+	}
+
+	if ( !IsChunked( pInput ) )
+	{
+		return sizeof( lzma_header_t ) + LittleLong( ((lzma_header_t *)pInput)->lzmaSize );
+	}
+
+	unsigned int nChunks = GetNumChunks( pInput );
+	if ( nChunks == 0 || nChunks > ( UINT_MAX - sizeof( lzma_chunked_header_t ) ) / sizeof( unsigned int ) )
+	{
+		return 0;
+	}
+
+	unsigned int nSize = sizeof( lzma_chunked_header_t ) + nChunks * sizeof( unsigned int );
+	for ( unsigned int i = 0; i < nChunks; i++ )
+	{
+		if ( GetChunkOffset( pInput, i ) != nSize )
+		{
+			return 0;
+		}
+
+		lzma_header_t *pChunk = (lzma_header_t *)( pInput + nSize );
+		if ( pChunk->id != LZMA_ID || LittleLong( pChunk->lzmaSize ) > UINT_MAX - sizeof( lzma_header_t ) - nSize )
+		{
+			return 0;
+		}
+		nSize += sizeof( lzma_header_t ) + LittleLong( pChunk->lzmaSize );
+	}
+	return nSize;
+}
+
+/* static */
+bool CLZMA::IsInputValid( unsigned char *pInput, unsigned int nInputSize )
+{
+	if ( !IsCompressed( pInput ) )
+	{
+		return false;
+	}
+
+	if ( !IsChunked( pInput ) )
+	{
+		lzma_header_t *pHeader = (lzma_header_t *)pInput;
+		return ( nInputSize >= sizeof( lzma_header_t ) &&
+		         LittleLong( pHeader->lzmaSize ) <= nInputSize - sizeof( lzma_header_t ) );
+	}
+
+	if ( nInputSize < sizeof( lzma_chunked_header_t ) )
+	{
+		return false;
+	}
+
+	unsigned int nChunks = LittleLong( ((lzma_chunked_header_t *)pInput)->numChunks );
+	if ( nChunks == 0 || nChunks > ( nInputSize - sizeof( lzma_chunked_header_t ) ) / sizeof( unsigned int ) )
+	{
+		return false;
+	}
+
+	// The encoder stores the chunks in order, right after the table
+	unsigned int nNextOffset = sizeof( lzma_chunked_header_t ) + nChunks * sizeof( unsigned int );
+	unsigned int nActualSize = GetActualSize( pInput );
+	unsigned int nTotal = 0;
+	for ( unsigned int i = 0; i < nChunks; i++ )
+	{
+		unsigned int nOffset = GetChunkOffset( pInput, i );
+		if ( nOffset != nNextOffset || nInputSize < sizeof( lzma_header_t ) || nOffset > nInputSize - sizeof( lzma_header_t ) )
+		{
+			return false;
+		}
+
+		lzma_header_t *pChunk = (lzma_header_t *)( pInput + nOffset );
+		if ( pChunk->id != LZMA_ID || LittleLong( pChunk->lzmaSize ) > nInputSize - nOffset - sizeof( lzma_header_t ) )
+		{
+			return false;
+		}
+
+		unsigned int nChunkSize = LittleLong( pChunk->actualSize );
+		if ( nChunkSize > nActualSize - nTotal )
+		{
+			return false;
+		}
+		nTotal += nChunkSize;
+		nNextOffset = nOffset + sizeof( lzma_header_t ) + LittleLong( pChunk->lzmaSize );
+	}
+
+	return ( nTotal == nActualSize );
+}
+
+/* static */
+unsigned int CLZMA::GetDecoderMemory( unsigned char *pInput, bool bStreaming )
+{
+	if ( IsChunked( pInput ) )
+	{
+		// Chunks are decoded one at a time per thread, the worst one decides
+		unsigned int nMax = 0;
+		int nChunks = GetNumChunks( pInput );
+		for ( int i = 0; i < nChunks; i++ )
+		{
+			nMax = Max( nMax, GetDecoderMemory( pInput + GetChunkOffset( pInput, i ), bStreaming ) );
+		}
+		return nMax;
+	}
+
+	lzma_header_t *pHeader = (lzma_header_t *)pInput;
+	if ( !pHeader || pHeader->id != LZMA_ID )
+	{
+		return 0;
+	}
+
+	CLzmaProps props;
+	if ( LzmaProps_Decode( &props, pHeader->properties, LZMA_PROPS_SIZE ) != SZ_OK )
+	{
+		return 0;
+	}
+
+	// LzmaProps_GetNumProbs() from LzmaDec.c, which keeps it private
+	const unsigned int nBaseProbs = 1846;
+	const unsigned int nLiteralProbs = 768;
+	unsigned int nMemory = ( nBaseProbs + ( nLiteralProbs << ( props.lc + props.lp ) ) ) * sizeof( CLzmaProb );
+	if ( bStreaming )
+	{
+		// A one-shot decode uses the output buffer as its dictionary, a stream needs its own
+		nMemory += props.dicSize;
+	}
+	return nMemory;
+}
+
 CLZMAStream::CLZMAStream()
 	: m_pDecoderState( NULL ),
 	  m_nActualSize( 0 ),
@@ -403,3 +620,106 @@ CLZMAStream::eHeaderParse CLZMAStream::TryParseHeader( unsigned char *pInput, un
 	m_bParsedHeader = true;
 	return eHeaderParse_OK;
 }
+
+//-----------------------------------------------------------------------------
+// CLZMAWindowDecoder
+//-----------------------------------------------------------------------------
+CLZMAWindowDecoder::CLZMAWindowDecoder()
+	: m_pInput( NULL ),
+	  m_pStream( NULL ),
+	  m_pStreamInput( NULL ),
+	  m_nStreamInputSize( 0 ),
+	  m_nStreamInputRead( 0 ),
+	  m_iChunk( 0 ),
+	  m_nChunks( 0 ),
+	  m_nActualSize( 0 ),
+	  m_nBytesWritten( 0 )
+{}
+
+CLZMAWindowDecoder::~CLZMAWindowDecoder()
+{
+	delete m_pStream;
+}
+
+bool CLZMAWindowDecoder::Init( unsigned char *pInput )
+{
+	delete m_pStream;
+	m_pStream = NULL;
+
+	if ( !CLZMA::IsCompressed( pInput ) || !CLZMA::IsInputValid( pInput, CLZMA::GetInputSize( pInput ) ) )
+	{
+		return false;
+	}
+
+	m_pInput = pInput;
+	m_nActualSize = CLZMA::GetActualSize( pInput );
+	m_nBytesWritten = 0;
+	m_iChunk = 0;
+	m_nChunks = CLZMA::IsChunked( pInput ) ? CLZMA::GetNumChunks( pInput ) : 1;
+
+	return BeginStream();
+}
+
+bool CLZMAWindowDecoder::BeginStream()
+{
+	delete m_pStream;
+	m_pStream = NULL;
+
+	if ( m_iChunk >= m_nChunks )
+	{
+		return true;
+	}
+
+	m_pStreamInput = CLZMA::IsChunked( m_pInput ) ? m_pInput + CLZMA::GetChunkOffset( m_pInput, m_iChunk ) : m_pInput;
+	lzma_header_t *pHeader = (lzma_header_t *)m_pStreamInput;
+	if ( pHeader->id != LZMA_ID )
+	{
+		Warning( "LZMA window decode failed (bad chunk %d)\n", m_iChunk );
+		return false;
+	}
+
+	m_nStreamInputSize = sizeof( lzma_header_t ) + LittleLong( pHeader->lzmaSize );
+	m_nStreamInputRead = 0;
+	m_pStream = new CLZMAStream();
+	return true;
+}
+
+bool CLZMAWindowDecoder::Read( unsigned char *pWindow, unsigned int nWindowSize, /* out */ unsigned int &nBytesWritten )
+{
+	nBytesWritten = 0;
+
+	while ( nBytesWritten < nWindowSize && m_pStream )
+	{
+		unsigned int nRemaining;
+		if ( m_pStream->GetExpectedBytesRemaining( nRemaining ) && nRemaining == 0 )
+		{
+			// This stream is done, move on to the next chunk
+			m_iChunk++;
+			if ( !BeginStream() )
+			{
+				return false;
+			}
+			continue;
+		}
+
+		unsigned int nRead, nWritten;
+		if ( !m_pStream->Read( m_pStreamInput + m_nStreamInputRead, m_nStreamInputSize - m_nStreamInputRead,
+		                       pWindow + nBytesWritten, nWindowSize - nBytesWritten, nRead, nWritten ) )
+		{
+			return false;
+		}
+
+		if ( !nRead && !nWritten )
+		{
+			// No progress with all input available, the data is truncated or corrupt
+			Warning( "LZMA window decode stalled in chunk %d\n", m_iChunk );
+			return false;
+		}
+
+		m_nStreamInputRead += nRead;
+		nBytesWritten += nWritten;
+	}
+
+	m_nBytesWritten += nBytesWritten;
+	return true;
+}
@@ -0,0 +1,66 @@
+#! perl
+
+# Loads a few maps on a dedicated server and runs dt_verify_encode_plan on each,
+# which encodes every networked entity through the SendTable encode plan and
+# the generic per-prop path and compares the bits. Any mismatch goes to errors.txt.
+
+@maps = qw( ctf_2fort cp_dustbowl pl_badwater koth_harvest_final arena_well mvm_decoy );
+
+$gamedir = "../../../game";
+$cfgname = "encode_plan_test.cfg";
+$logname = "$gamedir/tf/console.log";
+
+open( CFG, ">$gamedir/tf/cfg/$cfgname" ) || die "can't write $cfgname";
+print CFG "wait 60\n";
+print CFG "dt_verify_encode_plan missing\n";
+print CFG "quit\n";
+close CFG;
+
+my $errors;
+
+foreach $map ( @maps )
+{
+	unlink $logname if ( -e $logname );
+
+	print STDOUT "running dt_verify_encode_plan on $map\n";
+	`$gamedir/srcds.exe -game tf -console -condebug -nomaster -insecure -nodttest +maxplayers 24 +servercfgfile $cfgname +map $map`;
+
+	if ( ! open( LOG, $logname ) )
+	{
+		$errors .= "ERROR: $map : no console log, the server didn't start\n";
+		next;
+	}
+
+	my $summary;
+	while( <LOG> )
+	{
+		s/[\n\r]//g;
+		next unless ( /^dt_verify_encode_plan: / );
+
+		print STDOUT "$_\n";
+		$errors .= "ERROR: $map : $_\n" if ( /mismatch on entity/ );
+		$summary = $_ if ( /server classes checked/ );
+	}
+	close LOG;
+
+	if ( ! length( $summary ) )
+	{
+		$errors .= "ERROR: $map : dt_verify_encode_plan didn't run\n";
+	}
+	elsif ( $summary !~ / 0 mismatches/ )
+	{
+		$errors .= "ERROR: $map : $summary\n";
+	}
+}
+
+unlink "$gamedir/tf/cfg/$cfgname";
+
+print $errors;
+
+if( length( $errors ) > 0 )
+{
+	print "writing errors.txt\n";
+	open FP, ">errors.txt";
+	print FP "$errors";
+	close FP;
+}
@@ -0,0 +1,69 @@
+#! perl
+
+# Loads a map on a dedicated server and runs rr_verify_rule_index, which sends a
+# query built from each response rule through the rule index and through a full
+# rule scan and compares the selected rules. Any mismatch goes to errors.txt.
+
+$map = "ctf_2fort";
+
+$gamedir = "../../../game";
+$cfgname = "rule_index_test.cfg";
+$logname = "$gamedir/tf/console.log";
+
+open( CFG, ">$gamedir/tf/cfg/$cfgname" ) || die "can't write $cfgname";
+print CFG "wait 60\n";
+print CFG "rr_verify_rule_index\n";
+print CFG "quit\n";
+close CFG;
+
+my $errors;
+
+unlink $logname if ( -e $logname );
+
+print STDOUT "running rr_verify_rule_index on $map\n";
+`$gamedir/srcds.exe -game tf -console -condebug -nomaster -insecure +maxplayers 24 +servercfgfile $cfgname +map $map`;
+
+if ( ! open( LOG, $logname ) )
+{
+	$errors .= "ERROR: no console log, the server didn't start\n";
+}
+else
+{
+	my $result;
+	my $rules = 0;
+	while( <LOG> )
+	{
+		s/[\n\r]//g;
+
+		$errors .= "ERROR: $_\n" if ( /selected rule .* through the index and/ );
+		$rules += $1 if ( /: \d+ recorded queries, (\d+) rules in / );
+		$result = $1 if ( /^rr_verify_rule_index: (\w+)/ );
+	}
+	close LOG;
+
+	if ( ! length( $result ) )
+	{
+		$errors .= "ERROR: rr_verify_rule_index didn't run\n";
+	}
+	elsif ( $result ne "passed" )
+	{
+		$errors .= "ERROR: rr_verify_rule_index $result\n";
+	}
+	elsif ( $rules == 0 )
+	{
+		$errors .= "ERROR: rr_verify_rule_index found no response rules\n";
+	}
+	print STDOUT "rr_verify_rule_index: $result, $rules rules\n";
+}
+
+unlink "$gamedir/tf/cfg/$cfgname";
+
+print $errors;
+
+if( length( $errors ) > 0 )
+{
+	print "writing errors.txt\n";
+	open FP, ">errors.txt";
+	print FP "$errors";
+	close FP;
+}
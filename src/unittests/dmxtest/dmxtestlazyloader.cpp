@@ -0,0 +1,181 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit test program for DMX testing (lazy binary loading)
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "unitlib/unitlib.h"
+#include "dmxloader/dmxloader.h"
+#include "dmxloader/dmxelement.h"
+#include "tier1/utlbuffer.h"
+#include "tier0/platform.h"
+#include "tier0/memalloc.h"
+
+#if defined( LINUX )
+#include <malloc.h>
+#elif defined( OSX )
+#include <malloc/malloc.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Benchmark settings
+//-----------------------------------------------------------------------------
+#define BENCHMARK_ELEMENT_COUNT		2048
+#define BENCHMARK_SPARSE_STRIDE		16
+
+
+void TestReadFile( CDmxElement *pRoot );
+
+
+//-----------------------------------------------------------------------------
+// Heap bytes currently in use by the process. DMXMemoryUsed leaves out
+// array and string storage, which lives on the heap.
+//-----------------------------------------------------------------------------
+static size_t HeapBytesInUse()
+{
+#if defined( LINUX )
+	struct mallinfo info = mallinfo();
+	return (size_t)(unsigned int)info.uordblks + (size_t)(unsigned int)info.hblkhd;
+#elif defined( OSX )
+	malloc_statistics_t stats;
+	malloc_zone_statistics( NULL, &stats );
+	return stats.size_in_use;
+#else
+	return g_pMemAlloc->GetSize( NULL );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Builds a flat tree of small elements, like a model's bones or vertices
+//-----------------------------------------------------------------------------
+static CDmxElement *BuildBenchmarkTree( int nElements )
+{
+	CDmxElement *pRoot = CreateDmxElement( "DmElement" );
+	pRoot->SetValue( "name", "root" );
+
+	CDmxElementModifyScope modifyRoot( pRoot );
+	CUtlVector< CDmxElement* > &children = pRoot->AddAttribute( "children" )->GetArrayForEdit< CDmxElement* >();
+	for ( int i = 0; i < nElements; ++i )
+	{
+		char pName[32];
+		Q_snprintf( pName, sizeof(pName), "item%d", i );
+
+		CDmxElement *pChild = CreateDmxElement( "DmeBenchmarkItem" );
+		pChild->SetValue( "name", pName );
+		pChild->SetValue( "index", i );
+		pChild->SetValue( "position", Vector( i, -i, 0.5f * i ) );
+		pChild->SetValue( "parent", pRoot );
+		{
+			CDmxElementModifyScope modify( pChild );
+			CUtlVector< float > &weights = pChild->AddAttribute( "weights" )->GetArrayForEdit< float >();
+			for ( int j = 0; j < 8; ++j )
+			{
+				weights.AddToTail( i + j );
+			}
+		}
+		children.AddToTail( pChild );
+	}
+
+	return pRoot;
+}
+
+static int SumIndices( CDmxElement *pRoot, int nStride )
+{
+	const CUtlVector< CDmxElement* > &children = pRoot->GetArray< CDmxElement* >( "children" );
+	int nSum = 0;
+	for ( int i = 0; i < children.Count(); i += nStride )
+	{
+		nSum += children[i]->GetValue< int >( "index" );
+	}
+	return nSum;
+}
+
+static int ExpectedSum( int nElements, int nStride )
+{
+	int nSum = 0;
+	for ( int i = 0; i < nElements; i += nStride )
+	{
+		nSum += i;
+	}
+	return nSum;
+}
+
+
+DEFINE_TESTCASE_NOSUITE( DmxLazyLoaderTest )
+{
+	Msg( "Running dmx lazy loader tests...\n" );
+
+	// The lazy reader has to read the same data as the eager one
+	{
+		DECLARE_DMX_CONTEXT();
+
+		CDmxElement *pRoot;
+		bool bOk = UnserializeDMXLazy( "dmxtestloader.dmx", NULL, false, &pRoot );
+		Shipping_Assert( bOk );
+		Shipping_Assert( pRoot );
+		if ( pRoot )
+		{
+			TestReadFile( pRoot );
+			CleanupDMX( pRoot );
+		}
+	}
+
+	// Compare load time and memory of both readers on a larger file.
+	// Memory is what the reader still holds after each step, not the peak
+	// during it: how much the heap grew since just before the load, plus the
+	// DMX stack. The lazy reader's copy of the file shows up in both.
+	CUtlBuffer buf;
+	{
+		DECLARE_DMX_CONTEXT();
+
+		CDmxElement *pRoot = BuildBenchmarkTree( BENCHMARK_ELEMENT_COUNT );
+		bool bOk = SerializeDMX( buf, pRoot );
+		Shipping_Assert( bOk );
+		CleanupDMX( pRoot );
+	}
+
+	Msg( "%d elements, %d KB file\n", BENCHMARK_ELEMENT_COUNT + 1, buf.TellPut() / 1024 );
+	for ( int nPass = 0; nPass < 2; ++nPass )
+	{
+		DECLARE_DMX_CONTEXT();
+
+		bool bLazy = ( nPass != 0 );
+		buf.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
+
+		CDmxElement *pRoot = NULL;
+		size_t nBaseMemory = HeapBytesInUse();
+		double flStart = Plat_FloatTime();
+		bool bOk = bLazy ? UnserializeDMXLazy( buf, &pRoot ) : UnserializeDMX( buf, &pRoot );
+		double flLoadTime = Plat_FloatTime() - flStart;
+		int nLoadMemory = (int)( HeapBytesInUse() - nBaseMemory );
+		int nLoadDmxMemory = DMXMemoryUsed();
+		Shipping_Assert( bOk );
+		Shipping_Assert( pRoot );
+		if ( !pRoot )
+			continue;
+
+		flStart = Plat_FloatTime();
+		int nSparseSum = SumIndices( pRoot, BENCHMARK_SPARSE_STRIDE );
+		double flSparseTime = Plat_FloatTime() - flStart;
+		int nSparseMemory = (int)( HeapBytesInUse() - nBaseMemory );
+		int nSparseDmxMemory = DMXMemoryUsed();
+		Shipping_Assert( nSparseSum == ExpectedSum( BENCHMARK_ELEMENT_COUNT, BENCHMARK_SPARSE_STRIDE ) );
+
+		flStart = Plat_FloatTime();
+		int nFullSum = SumIndices( pRoot, 1 );
+		double flFullTime = Plat_FloatTime() - flStart;
+		int nFullMemory = (int)( HeapBytesInUse() - nBaseMemory );
+		int nFullDmxMemory = DMXMemoryUsed();
+		Shipping_Assert( nFullSum == ExpectedSum( BENCHMARK_ELEMENT_COUNT, 1 ) );
+
+		Msg( "%s: load %.2f ms, %d + %d KB; every %dth element %.2f ms, %d + %d KB; all elements %.2f ms, %d + %d KB (heap + DMX)\n",
+			bLazy ? "lazy " : "eager", flLoadTime * 1000.0, nLoadMemory / 1024, nLoadDmxMemory / 1024,
+			BENCHMARK_SPARSE_STRIDE, ( flLoadTime + flSparseTime ) * 1000.0, nSparseMemory / 1024, nSparseDmxMemory / 1024,
+			( flLoadTime + flSparseTime + flFullTime ) * 1000.0, nFullMemory / 1024, nFullDmxMemory / 1024 );
+
+		CleanupDMX( pRoot );
+	}
+}
@@ -0,0 +1,381 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Unit tests and benchmarks for CUtlFlatHashMap and its adapters
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "tier0/dbg.h"
+#include "tier0/fasttimer.h"
+#include "unitlib/unitlib.h"
+#include "tier1/utlflathashmap.h"
+#include "tier1/utlhashtable.h"
+#include "tier1/utlmap.h"
+#include "tier1/utldict.h"
+#include "tier1/UtlStringMap.h"
+#include "tier1/utlstring.h"
+#include "vstdlib/random.h"
+
+DEFINE_TESTSUITE( UtlFlatHashMapTestSuite )
+
+// Cheap deterministic key stream so runs are comparable
+static uint32 NextKey( uint32 &nState )
+{
+	nState = nState * 1664525u + 1013904223u;
+	return nState;
+}
+
+DEFINE_TESTCASE( UtlFlatHashMapTestBasic, UtlFlatHashMapTestSuite )
+{
+	Msg( "Flat hash map basic test...\n" );
+
+	CUtlFlatHashMap< int, int > map;
+	Shipping_Assert( map.Count() == 0 );
+	Shipping_Assert( map.Find( 7 ) == map.InvalidHandle() );
+
+	// Enough elements to go through several rehashes
+	const int nCount = 5000;
+	for ( int i = 0; i < nCount; ++i )
+	{
+		bool bDidInsert;
+		map.Insert( i * 3, i, &bDidInsert );
+		Shipping_Assert( bDidInsert );
+	}
+	Shipping_Assert( map.Count() == nCount );
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		UtlFlatHashHandle_t h = map.Find( i * 3 );
+		Shipping_Assert( h != map.InvalidHandle() );
+		Shipping_Assert( map.Key( h ) == i * 3 );
+		Shipping_Assert( map[h] == i );
+		Shipping_Assert( map.Find( i * 3 + 1 ) == map.InvalidHandle() );
+	}
+
+	// Insert doesn't overwrite, InsertOrReplace does
+	bool bDidInsert;
+	UtlFlatHashHandle_t h = map.Insert( 3, 1000, &bDidInsert );
+	Shipping_Assert( !bDidInsert && map[h] == 1 );
+	h = map.InsertOrReplace( 3, 1000 );
+	Shipping_Assert( map[h] == 1000 );
+
+	// Remove every other key, then make sure probing still finds the rest
+	for ( int i = 0; i < nCount; i += 2 )
+	{
+		Shipping_Assert( map.Remove( i * 3 ) );
+	}
+	Shipping_Assert( !map.Remove( 0 ) );
+	Shipping_Assert( map.Count() == nCount / 2 );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		Shipping_Assert( map.HasElement( i * 3 ) == ( ( i & 1 ) != 0 ) );
+	}
+
+	// Iteration visits each element once
+	int nVisited = 0;
+	FOR_EACH_FLATHASHMAP( map, it )
+	{
+		Shipping_Assert( ( map.Key( it ) / 3 ) & 1 );
+		++nVisited;
+	}
+	Shipping_Assert( nVisited == map.Count() );
+
+	// Churn through the tombstones; the table must not grow without bound
+	int nCapacity = map.Capacity();
+	for ( int nRound = 0; nRound < 20; ++nRound )
+	{
+		for ( int i = 0; i < nCount; i += 2 )
+		{
+			map.Insert( i * 3, i );
+		}
+		for ( int i = 0; i < nCount; i += 2 )
+		{
+			map.Remove( i * 3 );
+		}
+	}
+	Shipping_Assert( map.Count() == nCount / 2 );
+	Shipping_Assert( map.Capacity() <= nCapacity * 2 );
+
+	CUtlFlatHashMap< int, int > copy( map );
+	Shipping_Assert( copy.Count() == map.Count() );
+	Shipping_Assert( copy.HasElement( 3 ) && !copy.HasElement( 0 ) );
+
+	map.RemoveAll();
+	Shipping_Assert( map.Count() == 0 && !map.HasElement( 3 ) );
+	map.Purge();
+	Shipping_Assert( map.Capacity() == 0 );
+}
+
+DEFINE_TESTCASE( UtlFlatHashMapTestSet, UtlFlatHashMapTestSuite )
+{
+	Msg( "Flat hash set test...\n" );
+
+	CUtlFlatHashMap< uint32 > set;
+	uint32 nState = 1;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		set.Insert( NextKey( nState ) );
+	}
+
+	nState = 1;
+	for ( int i = 0; i < 1000; ++i )
+	{
+		uint32 nKey = NextKey( nState );
+		UtlFlatHashHandle_t h = set.Find( nKey );
+		Shipping_Assert( h != set.InvalidHandle() && set[h] == nKey );
+	}
+}
+
+DEFINE_TESTCASE( UtlFlatHashMapTestDict, UtlFlatHashMapTestSuite )
+{
+	Msg( "Flat hash dict test...\n" );
+
+	CUtlFlatHashDict< int > dict;
+	int nFoo = dict.Insert( "Foo", 1 );
+	int nBar = dict.Insert( "bar", 2 );
+	Shipping_Assert( dict.Count() == 2 );
+	Shipping_Assert( dict.Find( "FOO" ) == nFoo );
+	Shipping_Assert( dict.Find( "BAR" ) == nBar );
+	Shipping_Assert( !V_strcmp( dict.GetElementName( nFoo ), "Foo" ) );
+	Shipping_Assert( dict[nBar] == 2 );
+	Shipping_Assert( dict.Find( NULL ) == dict.InvalidIndex() );
+
+	// Indices stay put as the dictionary grows, like CUtlDict
+	char szName[32];
+	for ( int i = 0; i < 1000; ++i )
+	{
+		V_snprintf( szName, sizeof( szName ), "element%d", i );
+		dict.Insert( szName, i );
+	}
+	Shipping_Assert( dict.Find( "foo" ) == nFoo && dict[nFoo] == 1 );
+
+	dict.SetElementName( nFoo, "baz" );
+	Shipping_Assert( !dict.HasElement( "foo" ) && dict.Find( "BAZ" ) == nFoo );
+
+	dict.Remove( "bar" );
+	Shipping_Assert( !dict.IsValidIndex( nBar ) && !dict.HasElement( "bar" ) );
+	Shipping_Assert( dict.Count() == 1001 );
+
+	int nVisited = 0;
+	FOR_EACH_FLATHASHDICT( dict, i )
+	{
+		Shipping_Assert( dict.Find( dict.GetElementName( i ) ) == i );
+		++nVisited;
+	}
+	Shipping_Assert( nVisited == 1001 );
+
+	CUtlFlatHashDict< int > filenames( k_eDictCompareTypeFilenames );
+	int nFile = filenames.Insert( "Models/Player/Scout.mdl", 0 );
+	Shipping_Assert( filenames.Find( "models\\player\\scout.MDL" ) == nFile );
+
+	CUtlFlatHashDict< int > caseSensitive( k_eDictCompareTypeCaseSensitive );
+	caseSensitive.Insert( "Foo", 0 );
+	Shipping_Assert( !caseSensitive.HasElement( "foo" ) && caseSensitive.HasElement( "Foo" ) );
+}
+
+DEFINE_TESTCASE( UtlFlatHashMapTestStringMap, UtlFlatHashMapTestSuite )
+{
+	Msg( "Flat string map test...\n" );
+
+	CUtlFlatStringMap< int > map;
+	map[ "first" ] = 1;
+	map[ "Second" ] = 2;
+	Shipping_Assert( map.GetNumStrings() == 2 );
+	Shipping_Assert( map.Defined( "FIRST" ) && !map.Defined( "third" ) );
+	Shipping_Assert( map.Find( "first" ) == 0 && map.Find( "second" ) == 1 );
+	Shipping_Assert( map[ map.Find( "second" ) ] == 2 );
+	Shipping_Assert( !V_strcmp( map.String( 1 ), "Second" ) );
+	Shipping_Assert( map.Find( "third" ) == map.InvalidIndex() );
+
+	map.Clear();
+	Shipping_Assert( map.GetNumStrings() == 0 && !map.Defined( "first" ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Benchmarks. Each container gets the same keys: an insert pass, a find pass
+// over present keys, a find pass over absent keys (ints only), and an erase
+// pass. The times are reported, not checked.
+//-----------------------------------------------------------------------------
+static const int s_nBenchmarkInts = 200000;
+static const int s_nBenchmarkStrings = 50000;
+
+static void ReportTiming( const char *pContainer, const char *pOperation, CFastTimer &timer, int nOps )
+{
+	Msg( "  %-20s %-10s %8.2f ms  %6.1f ns/op\n", pContainer, pOperation, timer.GetDuration().GetMillisecondsF(),
+		timer.GetDuration().GetMillisecondsF() * 1000000.0 / nOps );
+}
+
+// Scattered keys: even ones are inserted, the odd ones next to them are misses
+static uint32 BenchmarkKey( int i )
+{
+	return (uint32)i * 2u * 2654435761u;
+}
+
+template < class Map_t >
+static void BenchmarkIntMap( const char *pName, Map_t &map, int nCount )
+{
+	CFastTimer timer;
+	int nFound = 0;
+
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		map.Insert( BenchmarkKey( i ), i );
+	}
+	timer.End();
+	ReportTiming( pName, "insert", timer, nCount );
+
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		nFound += map.Find( BenchmarkKey( i ) ) != map.InvalidIndex();
+	}
+	timer.End();
+	ReportTiming( pName, "find hit", timer, nCount );
+	Shipping_Assert( nFound == nCount );
+
+	nFound = 0;
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		nFound += map.Find( BenchmarkKey( i ) + 1 ) != map.InvalidIndex();
+	}
+	timer.End();
+	ReportTiming( pName, "find miss", timer, nCount );
+	Shipping_Assert( nFound == 0 );
+
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		map.Remove( BenchmarkKey( i ) );
+	}
+	timer.End();
+	ReportTiming( pName, "erase", timer, nCount );
+	Shipping_Assert( map.Count() == 0 );
+}
+
+// Gives the int containers one shape for BenchmarkIntMap
+class CBenchFlatHashMap : public CUtlFlatHashMap< uint32, int >
+{
+public:
+	static UtlFlatHashHandle_t InvalidIndex() { return InvalidHandle(); }
+};
+
+class CBenchHashtable : public CUtlHashtable< uint32, int >
+{
+public:
+	static UtlHashHandle_t InvalidIndex() { return InvalidHandle(); }
+};
+
+class CBenchMap : public CUtlMap< uint32, int, int >
+{
+public:
+	CBenchMap() : CUtlMap< uint32, int, int >( DefLessFunc( uint32 ) ) {}
+};
+
+template < class Dict_t >
+static void BenchmarkStringDict( const char *pName, Dict_t &dict, const CUtlVector< CUtlString > &names )
+{
+	CFastTimer timer;
+	int nCount = names.Count();
+
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		dict.Insert( names[i].Get(), i );
+	}
+	timer.End();
+	ReportTiming( pName, "insert", timer, nCount );
+
+	int nFound = 0;
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		nFound += dict.Find( names[i].Get() ) != dict.InvalidIndex();
+	}
+	timer.End();
+	ReportTiming( pName, "find hit", timer, nCount );
+	Shipping_Assert( nFound == nCount );
+
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		dict.Remove( names[i].Get() );
+	}
+	timer.End();
+	ReportTiming( pName, "erase", timer, nCount );
+	Shipping_Assert( dict.Count() == 0 );
+}
+
+// The names outlive the table, so it can key on the pointers directly
+class CBenchStringHashtable : public CUtlHashtable< const char *, int, CaselessStringHashFunctor, CaselessStringEqualFunctor >
+{
+public:
+	static UtlHashHandle_t InvalidIndex() { return InvalidHandle(); }
+};
+
+template < class StringMap_t >
+static void BenchmarkStringMap( const char *pName, StringMap_t &map, const CUtlVector< CUtlString > &names )
+{
+	CFastTimer timer;
+	int nCount = names.Count();
+
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		map[ names[i].Get() ] = i;
+	}
+	timer.End();
+	ReportTiming( pName, "insert", timer, nCount );
+
+	int nFound = 0;
+	timer.Start();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		nFound += map.Defined( names[i].Get() );
+	}
+	timer.End();
+	ReportTiming( pName, "find hit", timer, nCount );
+	Shipping_Assert( nFound == nCount );
+}
+
+DEFINE_TESTCASE( UtlFlatHashMapTestBenchmark, UtlFlatHashMapTestSuite )
+{
+	Msg( "Flat hash map benchmark (%d int keys, %d string keys)...\n", s_nBenchmarkInts, s_nBenchmarkStrings );
+
+	{
+		CBenchFlatHashMap flat;
+		BenchmarkIntMap( "CUtlFlatHashMap", flat, s_nBenchmarkInts );
+		CBenchHashtable hashtable;
+		BenchmarkIntMap( "CUtlHashtable", hashtable, s_nBenchmarkInts );
+		CBenchMap map;
+		BenchmarkIntMap( "CUtlMap", map, s_nBenchmarkInts );
+	}
+
+	// Names shaped like the model and sound paths these containers usually hold
+	CUtlVector< CUtlString > names;
+	RandomSeed( 0 );
+	for ( int i = 0; i < s_nBenchmarkStrings; ++i )
+	{
+		char szName[MAX_PATH];
+		V_snprintf( szName, sizeof( szName ), "models/props_%d/prop_%08x_%d.mdl", i % 37, RandomInt( 0, INT_MAX ), i );
+		names.AddToTail( CUtlString( szName ) );
+	}
+
+	{
+		CUtlFlatHashDict< int > flatDict;
+		BenchmarkStringDict( "CUtlFlatHashDict", flatDict, names );
+		CBenchStringHashtable hashtable;
+		BenchmarkStringDict( "CUtlHashtable", hashtable, names );
+		CUtlDict< int > dict;
+		BenchmarkStringDict( "CUtlDict", dict, names );
+	}
+
+	{
+		CUtlFlatStringMap< int > flatStringMap;
+		BenchmarkStringMap( "CUtlFlatStringMap", flatStringMap, names );
+		CUtlStringMap< int > stringMap;
+		BenchmarkStringMap( "CUtlStringMap", stringMap, names );
+	}
+}
@@ -10,6 +10,8 @@
 #include "cmdlib.h"
 #include "tier0/icommandline.h"
 #include "utlbuffer.h"
+#include "lzma/lzma.h"
+#include "tier1/lzmaDecoder.h"
 
 int CopyVariableLump( int lump, void **dest, int size );
 
@@ -25,7 +27,7 @@ void StripPath( const char* pPath, char* pBuf, int nBufLen )
 	Q_strncpy( pBuf, pSrc, nBufLen );
 }
 
-bool RepackBSP( const char *pszMapFile, bool bCompress )
+bool RepackBSP( const char *pszMapFile, bool bCompress, bool bChunked )
 {
 	Msg( "Repacking %s\n", pszMapFile );
 
@@ -45,7 +47,7 @@ bool RepackBSP( const char *pszMapFile, bool bCompress )
 	CUtlBuffer outputBuffer;
 
 	if ( !RepackBSP( inputBuffer, outputBuffer,
-	                 bCompress ? RepackBSPCallback_LZMA : NULL,
+	                 bCompress ? ( bChunked ? RepackBSPCallback_LZMAChunked : RepackBSPCallback_LZMA ) : NULL,
 	                 bCompress ? IZip::eCompressionType_LZMA : IZip::eCompressionType_None ) )
 	{
 		Warning( "Internal error compressing BSP\n" );
@@ -60,6 +62,170 @@ bool RepackBSP( const char *pszMapFile, bool bCompress )
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Decode benchmark: every lump of the map stored uncompressed, as one LZMA
+// stream and as chunked LZMA, decoded whole and through a streaming window
+//-----------------------------------------------------------------------------
+#define BENCHMARK_WINDOW_SIZE	( 64 * 1024 )
+
+enum BenchmarkFormat_t
+{
+	BENCHMARK_UNCOMPRESSED = 0,
+	BENCHMARK_LZMA,
+	BENCHMARK_LZMA_CHUNKED,
+
+	BENCHMARK_FORMAT_COUNT
+};
+
+static const char *s_pBenchmarkFormatNames[BENCHMARK_FORMAT_COUNT] = { "uncompressed", "lzma", "lzma chunked" };
+
+struct BenchmarkResult_t
+{
+	uint64	m_nDiskSize;
+	double	m_flDecodeTime;
+	double	m_flStreamTime;
+	// Computed from the buffer sizes, not measured: the largest lump's input + output + decoder
+	// state, and for a windowed decode input + window + decoder state with its own dictionary
+	unsigned int	m_nWorkingSet;
+	unsigned int	m_nStreamWorkingSet;
+};
+
+static void BenchmarkDecodeLump( unsigned char *pData, unsigned int nSize, BenchmarkFormat_t format, BenchmarkResult_t &result, unsigned char *pOutput, unsigned char *pWindow )
+{
+	if ( format == BENCHMARK_UNCOMPRESSED )
+	{
+		// Loading is a copy out of the file buffer
+		double flStart = Plat_FloatTime();
+		memcpy( pOutput, pData, nSize );
+		result.m_flDecodeTime += Plat_FloatTime() - flStart;
+		result.m_nDiskSize += nSize;
+		result.m_nWorkingSet = MAX( result.m_nWorkingSet, nSize );
+		result.m_nStreamWorkingSet = MAX( result.m_nStreamWorkingSet, nSize );
+		return;
+	}
+
+	unsigned int nCompressedSize = 0;
+	unsigned char *pCompressed = format == BENCHMARK_LZMA_CHUNKED ?
+		LZMA_CompressChunked( pData, nSize, BSP_LZMA_CHUNK_SIZE, -1, &nCompressedSize ) :
+		LZMA_Compress( pData, nSize, &nCompressedSize );
+	if ( !pCompressed )
+	{
+		// Stored as is, same as RepackBSP does
+		BenchmarkDecodeLump( pData, nSize, BENCHMARK_UNCOMPRESSED, result, pOutput, pWindow );
+		return;
+	}
+
+	result.m_nDiskSize += nCompressedSize;
+
+	double flStart = Plat_FloatTime();
+	unsigned int nDecoded = CLZMA::Uncompress( pCompressed, pOutput );
+	result.m_flDecodeTime += Plat_FloatTime() - flStart;
+
+	if ( nDecoded != nSize || memcmp( pOutput, pData, nSize ) )
+	{
+		Warning( "%s lump failed to round trip\n", s_pBenchmarkFormatNames[format] );
+	}
+
+	flStart = Plat_FloatTime();
+	CLZMAWindowDecoder decoder;
+	unsigned int nStreamed = 0;
+	unsigned int nWritten = 0;
+	if ( decoder.Init( pCompressed ) )
+	{
+		while ( decoder.Read( pWindow, BENCHMARK_WINDOW_SIZE, nWritten ) && nWritten )
+		{
+			nStreamed += nWritten;
+		}
+	}
+	result.m_flStreamTime += Plat_FloatTime() - flStart;
+
+	if ( nStreamed != nSize )
+	{
+		Warning( "%s lump failed to stream (%u of %u bytes)\n", s_pBenchmarkFormatNames[format], nStreamed, nSize );
+	}
+
+	result.m_nWorkingSet = MAX( result.m_nWorkingSet, nCompressedSize + nSize + CLZMA::GetDecoderMemory( pCompressed, false ) );
+	result.m_nStreamWorkingSet = MAX( result.m_nStreamWorkingSet, nCompressedSize + BENCHMARK_WINDOW_SIZE + CLZMA::GetDecoderMemory( pCompressed, true ) );
+
+	free( pCompressed );
+}
+
+static bool BenchmarkBSP( const char *pszMapFile, BenchmarkResult_t *pTotals )
+{
+	CUtlBuffer inputBuffer;
+	if ( !g_pFullFileSystem->ReadFile( pszMapFile, NULL, inputBuffer ) )
+	{
+		Warning( "Couldn't read file %s - BSP benchmark failed\n", pszMapFile );
+		return false;
+	}
+
+	dheader_t *pHeader = (dheader_t *)inputBuffer.Base();
+	if ( inputBuffer.TellPut() < (int)sizeof( dheader_t ) || pHeader->ident != IDBSPHEADER )
+	{
+		Warning( "%s is not a PC BSP file\n", pszMapFile );
+		return false;
+	}
+
+	Msg( "Benchmarking %s\n", pszMapFile );
+
+	BenchmarkResult_t results[BENCHMARK_FORMAT_COUNT];
+	V_memset( results, 0, sizeof( results ) );
+
+	unsigned char *pWindow = (unsigned char *)malloc( BENCHMARK_WINDOW_SIZE );
+
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		const lump_t &lump = pHeader->lumps[i];
+		if ( lump.filelen <= 0 || lump.fileofs + lump.filelen > inputBuffer.TellPut() )
+			continue;
+
+		// Benchmark against the raw lump data, decompressing it first if the map is already compressed.
+		// The game lump is compressed per sub-lump and is measured as stored.
+		unsigned char *pData = (unsigned char *)inputBuffer.Base() + lump.fileofs;
+		unsigned int nSize = lump.filelen;
+		unsigned char *pRaw = NULL;
+		if ( lump.uncompressedSize && CLZMA::IsCompressed( pData ) )
+		{
+			nSize = CLZMA::GetActualSize( pData );
+			pRaw = (unsigned char *)malloc( nSize );
+			if ( CLZMA::Uncompress( pData, pRaw ) != nSize )
+			{
+				Warning( "Couldn't decompress lump %d\n", i );
+				free( pRaw );
+				continue;
+			}
+			pData = pRaw;
+		}
+
+		unsigned char *pOutput = (unsigned char *)malloc( nSize );
+		for ( int format = 0; format < BENCHMARK_FORMAT_COUNT; format++ )
+		{
+			BenchmarkDecodeLump( pData, nSize, (BenchmarkFormat_t)format, results[format], pOutput, pWindow );
+		}
+		free( pOutput );
+		free( pRaw );
+	}
+
+	free( pWindow );
+
+	Msg( "  %-14s %12s %12s %12s %14s %14s\n", "format", "disk bytes", "decode ms", "stream ms", "est. bytes", "est. stream" );
+	for ( int format = 0; format < BENCHMARK_FORMAT_COUNT; format++ )
+	{
+		const BenchmarkResult_t &result = results[format];
+		Msg( "  %-14s %12llu %12.2f %12.2f %14u %14u\n", s_pBenchmarkFormatNames[format], (unsigned long long)result.m_nDiskSize,
+			 result.m_flDecodeTime * 1000.0, result.m_flStreamTime * 1000.0, result.m_nWorkingSet, result.m_nStreamWorkingSet );
+
+		BenchmarkResult_t &total = pTotals[format];
+		total.m_nDiskSize += result.m_nDiskSize;
+		total.m_flDecodeTime += result.m_flDecodeTime;
+		total.m_flStreamTime += result.m_flStreamTime;
+		total.m_nWorkingSet = MAX( total.m_nWorkingSet, result.m_nWorkingSet );
+		total.m_nStreamWorkingSet = MAX( total.m_nStreamWorkingSet, result.m_nStreamWorkingSet );
+	}
+
+	return true;
+}
+
 void Usage( void )
 {
 	fprintf( stderr, "usage: \n" );
@@ -75,10 +241,15 @@ void Usage( void )
 	fprintf( stderr, "  Deletes the cubemaps from <bspFile>.\n");
 	fprintf( stderr, "bspzip -addfiles <bspfile> <relativePathPrefix> <listfile> <newbspfile>\n");
 	fprintf( stderr, "  Adds files to <newbspfile>.\n");
-	fprintf( stderr, "bspzip -repack [ -compress ] <bspfile>\n");
+	fprintf( stderr, "bspzip -repack [ -compress [ -chunked ] ] <bspfile>\n");
 	fprintf( stderr, "  Optimally repacks a BSP file, optionally using compressed BSP format.\n");
 	fprintf( stderr, "  Using on a compressed BSP without -compress will effectively decompress\n");
-	fprintf( stderr, "  a compressed BSP.\n");
+	fprintf( stderr, "  a compressed BSP. -chunked splits large lumps into independently\n");
+	fprintf( stderr, "  compressed chunks, compressed on all cores and decompressed in parallel.\n");
+	fprintf( stderr, "bspzip -benchmark <bspfile> [ <bspfile> ... ]\n");
+	fprintf( stderr, "  Compares lump size and decode time of uncompressed, LZMA and chunked\n");
+	fprintf( stderr, "  LZMA storage, decoding whole and through CLZMAWindowDecoder, with the\n");
+	fprintf( stderr, "  decode working set each would need estimated from the buffer sizes.\n");
 
 	exit( -1 );
 }
@@ -522,17 +693,21 @@ int main( int argc, char **argv )
 			fclose( fp );
 		}
 	}
-	else if( ( stricmp( pAction, "-repack" ) == 0 ) && ( nActionArgs == 1 || nActionArgs == 2 ) )
+	else if( ( stricmp( pAction, "-repack" ) == 0 ) && ( nActionArgs >= 1 && nActionArgs <= 3 ) )
 	{
-		// bspzip -repack [ -compress ] <bspfile>
+		// bspzip -repack [ -compress [ -chunked ] ] <bspfile>
 		bool bCompress = false;
-		const char *pFile = pActionArgs[0];
-		if ( nActionArgs == 2 && stricmp( pActionArgs[0], "-compress" ) == 0 )
+		bool bChunked = false;
+		const char *pFile = pActionArgs[nActionArgs - 1];
+		if ( nActionArgs >= 2 && stricmp( pActionArgs[0], "-compress" ) == 0 )
 		{
-			pFile = pActionArgs[1];
 			bCompress = true;
 		}
-		else if ( nActionArgs == 2 )
+		if ( nActionArgs == 3 && stricmp( pActionArgs[1], "-chunked" ) == 0 )
+		{
+			bChunked = true;
+		}
+		if ( nActionArgs != 1 + bCompress + bChunked )
 		{
 			Usage();
 			return 0;
@@ -542,7 +717,40 @@ int main( int argc, char **argv )
 		char szAbsBSPPath[MAX_PATH] = { 0 };
 		Q_MakeAbsolutePath( szAbsBSPPath, sizeof( szAbsBSPPath ), pFile );
 		Q_DefaultExtension( szAbsBSPPath, ".bsp", sizeof( szAbsBSPPath ) );
-		return RepackBSP( szAbsBSPPath, bCompress ) ? 0 : -1;
+		return RepackBSP( szAbsBSPPath, bCompress, bChunked ) ? 0 : -1;
+	}
+	else if( ( stricmp( pAction, "-benchmark" ) == 0 ) && nActionArgs >= 1 )
+	{
+		// bspzip -benchmark <bspfile> [ <bspfile> ... ]
+		CmdLib_InitFileSystem( pActionArgs[0] );
+
+		BenchmarkResult_t totals[BENCHMARK_FORMAT_COUNT];
+		V_memset( totals, 0, sizeof( totals ) );
+
+		int nMaps = 0;
+		for ( int i = 0; i < nActionArgs; i++ )
+		{
+			char szAbsBSPPath[MAX_PATH] = { 0 };
+			Q_MakeAbsolutePath( szAbsBSPPath, sizeof( szAbsBSPPath ), pActionArgs[i] );
+			Q_DefaultExtension( szAbsBSPPath, ".bsp", sizeof( szAbsBSPPath ) );
+			if ( BenchmarkBSP( szAbsBSPPath, totals ) )
+			{
+				nMaps++;
+			}
+		}
+
+		if ( nMaps > 1 )
+		{
+			Msg( "Total over %d maps\n", nMaps );
+			for ( int format = 0; format < BENCHMARK_FORMAT_COUNT; format++ )
+			{
+				Msg( "  %-14s %12llu %12.2f %12.2f %14u %14u\n", s_pBenchmarkFormatNames[format], (unsigned long long)totals[format].m_nDiskSize,
+					 totals[format].m_flDecodeTime * 1000.0, totals[format].m_flStreamTime * 1000.0,
+					 totals[format].m_nWorkingSet, totals[format].m_nStreamWorkingSet );
+			}
+		}
+
+		return nMaps == nActionArgs ? 0 : -1;
 	}
 	else
 	{
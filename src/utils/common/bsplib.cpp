@@ -4579,6 +4579,42 @@ bool RepackBSPCallback_LZMA( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer )
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Compress callback for RepackBSP, writing chunked lumps that the engine can
+// decompress in parallel and stream with a one chunk dictionary
+//-----------------------------------------------------------------------------
+bool RepackBSPCallback_LZMAChunked( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer )
+{
+	if ( !inputBuffer.TellPut() )
+	{
+		// nothing to do
+		return false;
+	}
+
+	unsigned int originalSize = inputBuffer.TellPut() - inputBuffer.TellGet();
+
+	// Small lumps gain nothing from being split
+	if ( originalSize <= BSP_LZMA_CHUNK_SIZE )
+	{
+		return RepackBSPCallback_LZMA( inputBuffer, outputBuffer );
+	}
+
+	unsigned int compressedSize = 0;
+	unsigned char *pCompressedOutput = LZMA_CompressChunked( (unsigned char *)inputBuffer.Base() + inputBuffer.TellGet(),
+															 originalSize, BSP_LZMA_CHUNK_SIZE, -1, &compressedSize );
+	if ( pCompressedOutput && compressedSize < originalSize )
+	{
+		outputBuffer.Put( pCompressedOutput, compressedSize );
+		DevMsg( "Compressed bsp lump %u -> %u bytes in %u chunks\n", originalSize, compressedSize,
+				( originalSize + BSP_LZMA_CHUNK_SIZE - 1 ) / BSP_LZMA_CHUNK_SIZE );
+		free( pCompressedOutput );
+		return true;
+	}
+
+	free( pCompressedOutput );
+	return false;
+}
+
 
 bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc, IZip::eCompressionType packfileCompression )
 {
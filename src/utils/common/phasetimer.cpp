@@ -0,0 +1,74 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "phasetimer.h"
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+
+
+struct PhaseTime_t
+{
+	const char *m_pName;
+	int m_nParent;
+	int m_nDepth;
+	double m_flTime;
+};
+
+static CUtlVector< PhaseTime_t > s_PhaseTimes;
+static int s_nCurrentPhase = -1;
+
+CPhaseTimer::CPhaseTimer( const char *pPhaseName )
+{
+	int i;
+	for ( i = 0; i < s_PhaseTimes.Count(); i++ )
+	{
+		if ( s_PhaseTimes[i].m_nParent == s_nCurrentPhase && !Q_stricmp( s_PhaseTimes[i].m_pName, pPhaseName ) )
+			break;
+	}
+
+	if ( i == s_PhaseTimes.Count() )
+	{
+		PhaseTime_t &phase = s_PhaseTimes[ s_PhaseTimes.AddToTail() ];
+		phase.m_pName = pPhaseName;
+		phase.m_nParent = s_nCurrentPhase;
+		phase.m_nDepth = ( s_nCurrentPhase >= 0 ) ? s_PhaseTimes[ s_nCurrentPhase ].m_nDepth + 1 : 0;
+		phase.m_flTime = 0.0;
+	}
+
+	m_nPhase = i;
+	s_nCurrentPhase = i;
+	m_flStartTime = Plat_FloatTime();
+}
+
+CPhaseTimer::~CPhaseTimer()
+{
+	s_PhaseTimes[ m_nPhase ].m_flTime += Plat_FloatTime() - m_flStartTime;
+	s_nCurrentPhase = s_PhaseTimes[ m_nPhase ].m_nParent;
+}
+
+void PrintPhaseTimes( const char *pTitle, int nThreads )
+{
+	double flTotal = 0.0;
+	for ( int i = 0; i < s_PhaseTimes.Count(); i++ )
+	{
+		if ( s_PhaseTimes[i].m_nDepth == 0 )
+		{
+			flTotal += s_PhaseTimes[i].m_flTime;
+		}
+	}
+
+	Msg( "\n%s (%d thread%s):\n", pTitle, nThreads, ( nThreads == 1 ) ? "" : "s" );
+	for ( int i = 0; i < s_PhaseTimes.Count(); i++ )
+	{
+		const PhaseTime_t &phase = s_PhaseTimes[i];
+		Msg( "  %*s%-*s %9.3fs %6.1f%%\n", phase.m_nDepth * 2, "", 32 - phase.m_nDepth * 2, phase.m_pName,
+			phase.m_flTime, ( flTotal > 0.0 ) ? 100.0 * phase.m_flTime / flTotal : 0.0 );
+	}
+	Msg( "  %-32s %9.3fs\n", "total", flTotal );
+}
@@ -0,0 +1,33 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Named, nested timing of a tool's phases for -timing style reports
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef PHASETIMER_H
+#define PHASETIMER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+// Adds the time until it goes out of scope to the named phase. Phases started
+// inside another phase are reported under it. Main thread only.
+class CPhaseTimer
+{
+public:
+	CPhaseTimer( const char *pPhaseName );
+	~CPhaseTimer();
+
+private:
+	int		m_nPhase;
+	double	m_flStartTime;
+};
+
+// Prints every phase, indented by nesting, with its share of the top level total:
+// <pTitle> (<nThreads> threads):
+void PrintPhaseTimes( const char *pTitle, int nThreads );
+
+
+#endif // PHASETIMER_H
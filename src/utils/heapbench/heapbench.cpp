@@ -0,0 +1,248 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Allocation heavy benchmark for the tier0 allocator. Runs the same
+//			small block churn through libc malloc and through g_pMemAlloc on
+//			1..n threads. Run it once with -threadheap to measure the thread
+//			caching heap and once without to measure tier0 on top of libc.
+//			The workload is synthetic, not a recorded game allocation trace,
+//			so treat the numbers as a comparison of the allocators only.
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tier0/dbg.h"
+#include "tier0/icommandline.h"
+#include "tier0/memalloc.h"
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+
+
+#define MAX_BENCH_THREADS		64
+
+SpewRetval_t HeapBenchOutputFunc( SpewType_t spewType, char const *pMsg )
+{
+	printf( "%s", pMsg );
+	fflush( stdout );
+
+	if (spewType == SPEW_ERROR)
+		return SPEW_ABORT;
+	return (spewType == SPEW_ASSERT) ? SPEW_DEBUGGER : SPEW_CONTINUE;
+}
+
+static void Usage( void )
+{
+	Error( "Usage: heapbench [-threadheap] [-threads <n>] [-ops <n>] [-live <n>] [-iterations <n>]\n" );
+	exit( -1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Allocators under test
+//-----------------------------------------------------------------------------
+enum BenchAllocator_t
+{
+	BENCH_LIBC,
+	BENCH_TIER0,
+
+	BENCH_ALLOCATOR_COUNT
+};
+
+static inline void *BenchAlloc( BenchAllocator_t allocator, size_t nSize )
+{
+	return ( allocator == BENCH_LIBC ) ? malloc( nSize ) : g_pMemAlloc->Alloc( nSize );
+}
+
+static inline void BenchFree( BenchAllocator_t allocator, void *p )
+{
+	if ( allocator == BENCH_LIBC )
+	{
+		free( p );
+	}
+	else
+	{
+		g_pMemAlloc->Free( p );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Each thread keeps a window of live blocks and replaces a random one per
+// operation. Sizes lean small, like the strings, vectors and keyvalues that
+// dominate allocation counts in the game, with a tail past the small block
+// limit so both paths of the allocator are exercised.
+//-----------------------------------------------------------------------------
+struct BenchThread_t
+{
+	BenchAllocator_t	m_Allocator;
+	int					m_nOps;
+	int					m_nLive;
+	void **				m_ppLive;
+	unsigned int		m_nSeed;
+	volatile bool *		m_pbGo;
+	CInterlockedInt *	m_pnReady;
+};
+
+static inline unsigned int NextRandom( unsigned int &nSeed )
+{
+	nSeed ^= nSeed << 13;
+	nSeed ^= nSeed >> 17;
+	nSeed ^= nSeed << 5;
+	return nSeed;
+}
+
+static inline size_t RandomBlockSize( unsigned int &nSeed )
+{
+	unsigned int n = NextRandom( nSeed );
+	unsigned int nBucket = n % 100;
+	n >>= 8;
+	if ( nBucket < 70 )
+		return 16 + n % 113;		// 16..128
+	if ( nBucket < 95 )
+		return 129 + n % 896;		// 129..1024
+	return 1025 + n % 3072;			// 1025..4096
+}
+
+static unsigned BenchThreadFunc( void *pParam )
+{
+	BenchThread_t *pThread = (BenchThread_t *)pParam;
+	BenchAllocator_t allocator = pThread->m_Allocator;
+	void **ppLive = pThread->m_ppLive;
+	unsigned int nSeed = pThread->m_nSeed;
+
+	++(*pThread->m_pnReady);
+	while ( !*pThread->m_pbGo )
+	{
+		ThreadPause();
+	}
+
+	for ( int i = 0; i < pThread->m_nOps; ++i )
+	{
+		int iSlot = NextRandom( nSeed ) % pThread->m_nLive;
+		if ( ppLive[iSlot] )
+		{
+			BenchFree( allocator, ppLive[iSlot] );
+		}
+
+		size_t nSize = RandomBlockSize( nSeed );
+		unsigned char *p = (unsigned char *)BenchAlloc( allocator, nSize );
+		if ( p )
+		{
+			// Touch both ends, the way a real caller fills the block
+			p[0] = (unsigned char)i;
+			p[nSize - 1] = (unsigned char)i;
+		}
+		ppLive[iSlot] = p;
+	}
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Runs nThreads threads of churn and returns the wall clock time. Blocks still
+// live at the end are freed by the main thread, which also measures frees of
+// memory allocated on other threads.
+//-----------------------------------------------------------------------------
+static double RunBench( BenchAllocator_t allocator, int nThreads, int nOps, int nLive )
+{
+	BenchThread_t threads[MAX_BENCH_THREADS];
+	ThreadHandle_t hThreads[MAX_BENCH_THREADS];
+	volatile bool bGo = false;
+	CInterlockedInt nReady;
+
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		BenchThread_t &thread = threads[i];
+		thread.m_Allocator = allocator;
+		thread.m_nOps = nOps;
+		thread.m_nLive = nLive;
+		thread.m_ppLive = (void **)calloc( nLive, sizeof( void * ) );
+		thread.m_nSeed = 2463534242u + i * 7919;
+		thread.m_pbGo = &bGo;
+		thread.m_pnReady = &nReady;
+		hThreads[i] = CreateSimpleThread( BenchThreadFunc, &thread );
+	}
+
+	while ( nReady < nThreads )
+	{
+		ThreadSleep( 0 );
+	}
+
+	double flStart = Plat_FloatTime();
+	bGo = true;
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+	}
+
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		for ( int j = 0; j < nLive; ++j )
+		{
+			if ( threads[i].m_ppLive[j] )
+			{
+				BenchFree( allocator, threads[i].m_ppLive[j] );
+			}
+		}
+	}
+	double flSeconds = Plat_FloatTime() - flStart;
+
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		free( threads[i].m_ppLive );
+	}
+	return flSeconds;
+}
+
+int main( int argc, char **argv )
+{
+	SpewOutputFunc( HeapBenchOutputFunc );
+	CommandLine()->CreateCmdLine( argc, argv );
+
+	if ( CommandLine()->CheckParm( "-?" ) || CommandLine()->CheckParm( "-help" ) )
+	{
+		Usage();
+	}
+
+	int nMaxThreads = CommandLine()->ParmValue( "-threads", (int)GetCPUInformation()->m_nLogicalProcessors );
+	nMaxThreads = MAX( 1, MIN( nMaxThreads, MAX_BENCH_THREADS ) );
+	int nOps = MAX( 1, CommandLine()->ParmValue( "-ops", 2000000 ) );
+	int nLive = MAX( 1, CommandLine()->ParmValue( "-live", 4096 ) );
+	int nIterations = MAX( 1, CommandLine()->ParmValue( "-iterations", 3 ) );
+
+	// tier0 picks its heap from the process command line before main runs
+	const char *pTier0Name = CommandLine()->CheckParm( "-threadheap" ) ? "thread heap" : "tier0 libc";
+
+	Msg( "Synthetic workload: %d ops per thread, %d live blocks per thread, best of %d\n", nOps, nLive, nIterations );
+	Msg( "%8s %16s %16s %8s\n", "threads", "libc Mops/s", pTier0Name, "speedup" );
+
+	// 1, 2, 4, ... and finally nMaxThreads
+	for ( int nThreads = 1; ; nThreads = MIN( nThreads * 2, nMaxThreads ) )
+	{
+		double pMops[BENCH_ALLOCATOR_COUNT];
+		for ( int a = 0; a < BENCH_ALLOCATOR_COUNT; ++a )
+		{
+			double flBest = 0.0;
+			for ( int i = 0; i < nIterations; ++i )
+			{
+				double flSeconds = RunBench( (BenchAllocator_t)a, nThreads, nOps, nLive );
+				if ( i == 0 || flSeconds < flBest )
+				{
+					flBest = flSeconds;
+				}
+			}
+
+			// Every op is one free and one alloc
+			pMops[a] = ( flBest > 0.0 ) ? 2.0 * nOps * nThreads / flBest / 1000000.0 : 0.0;
+		}
+
+		Msg( "%8d %16.1f %16.1f %7.2fx\n", nThreads, pMops[BENCH_LIBC], pMops[BENCH_TIER0],
+			( pMops[BENCH_LIBC] > 0.0 ) ? pMops[BENCH_TIER0] / pMops[BENCH_LIBC] : 0.0 );
+
+		if ( nThreads == nMaxThreads )
+			break;
+	}
+
+	return 0;
+}
@@ -17,6 +17,7 @@
 #include "C/LzmaEnc.h"
 #include "C/LzmaDec.h"
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 
 // Allocator to pass to LZMA functions
 static void *SzAlloc(void *p, size_t size) { return malloc(size); }
@@ -135,6 +136,8 @@ LzmaEncode( const Byte *inBuffer,
 	}
 
 	LzmaEncProps_Init( &props );
+	// Don't ask for a dictionary bigger than the input, a streaming decoder has to allocate all of it
+	props.reduceSize = inSize;
 	res = LzmaEnc_SetProps( enc, &props );
 
 	if ( res != SZ_OK )
@@ -234,6 +237,138 @@ unsigned char *LZMA_Compress( unsigned char *pInput,
 	return pOutputBuffer;
 }
 
+//-----------------------------------------------------------------------------
+// Chunked encoding. Each chunk is compressed independently, spread over nThreads
+// threads (all logical processors if <= 0).
+//-----------------------------------------------------------------------------
+struct LZMAChunk_t
+{
+	unsigned char	*m_pInput;
+	unsigned int	m_nInputSize;
+	unsigned char	*m_pOutput;
+	unsigned int	m_nOutputSize;
+};
+
+struct LZMAChunkWork_t
+{
+	LZMAChunk_t		*m_pChunks;
+	int				m_nChunks;
+	CInterlockedInt	m_iNextChunk;
+};
+
+static unsigned LZMA_CompressChunksThread( void *pParam )
+{
+	LZMAChunkWork_t *pWork = (LZMAChunkWork_t *)pParam;
+
+	int iChunk;
+	while ( ( iChunk = pWork->m_iNextChunk++ ) < pWork->m_nChunks )
+	{
+		LZMAChunk_t &chunk = pWork->m_pChunks[iChunk];
+		chunk.m_pOutput = LZMA_Compress( chunk.m_pInput, chunk.m_nInputSize, &chunk.m_nOutputSize );
+	}
+	return 0;
+}
+
+unsigned char *LZMA_CompressChunked( unsigned char *pInput,
+                                     unsigned int  inputSize,
+                                     unsigned int  chunkSize,
+                                     int           nThreads,
+                                     unsigned int  *pOutputSize )
+{
+	*pOutputSize = 0;
+
+	if ( !inputSize || !chunkSize )
+	{
+		return NULL;
+	}
+
+	int nChunks = ( inputSize + chunkSize - 1 ) / chunkSize;
+
+	LZMAChunk_t *pChunks = (LZMAChunk_t *)calloc( nChunks, sizeof( LZMAChunk_t ) );
+	if ( !pChunks )
+	{
+		return NULL;
+	}
+
+	for ( int i = 0; i < nChunks; i++ )
+	{
+		pChunks[i].m_pInput = pInput + i * chunkSize;
+		pChunks[i].m_nInputSize = ( i == nChunks - 1 ) ? inputSize - i * chunkSize : chunkSize;
+	}
+
+	LZMAChunkWork_t work;
+	work.m_pChunks = pChunks;
+	work.m_nChunks = nChunks;
+	work.m_iNextChunk = 0;
+
+	if ( nThreads <= 0 )
+	{
+		nThreads = GetCPUInformation()->m_nLogicalProcessors;
+	}
+	nThreads = MAX( 1, MIN( nThreads, nChunks ) );
+
+	// This thread is one of the workers
+	ThreadHandle_t *pThreads = (ThreadHandle_t *)stackalloc( nThreads * sizeof( ThreadHandle_t ) );
+	for ( int i = 1; i < nThreads; i++ )
+	{
+		pThreads[i] = CreateSimpleThread( LZMA_CompressChunksThread, &work );
+	}
+
+	LZMA_CompressChunksThread( &work );
+
+	for ( int i = 1; i < nThreads; i++ )
+	{
+		if ( pThreads[i] )
+		{
+			ThreadJoin( pThreads[i] );
+			ReleaseThreadHandle( pThreads[i] );
+		}
+	}
+
+	// A thread that failed to start leaves its chunks to the others, but check anyway
+	unsigned int nTableSize = sizeof( lzma_chunked_header_t ) + nChunks * sizeof( unsigned int );
+	unsigned int nOutputSize = nTableSize;
+	bool bOK = true;
+	for ( int i = 0; i < nChunks; i++ )
+	{
+		if ( !pChunks[i].m_pOutput )
+		{
+			bOK = false;
+			break;
+		}
+		nOutputSize += pChunks[i].m_nOutputSize;
+	}
+
+	unsigned char *pOutputBuffer = bOK ? (unsigned char *)malloc( nOutputSize ) : NULL;
+	if ( pOutputBuffer )
+	{
+		lzma_chunked_header_t *pHeader = (lzma_chunked_header_t *)pOutputBuffer;
+		pHeader->id = LZMA_CHUNKED_ID;
+		pHeader->actualSize = inputSize;
+		pHeader->chunkSize = chunkSize;
+		pHeader->numChunks = nChunks;
+
+		unsigned int *pOffsets = (unsigned int *)( pOutputBuffer + sizeof( lzma_chunked_header_t ) );
+		unsigned int nOffset = nTableSize;
+		for ( int i = 0; i < nChunks; i++ )
+		{
+			pOffsets[i] = nOffset;
+			memcpy( pOutputBuffer + nOffset, pChunks[i].m_pOutput, pChunks[i].m_nOutputSize );
+			nOffset += pChunks[i].m_nOutputSize;
+		}
+
+		*pOutputSize = nOutputSize;
+	}
+
+	for ( int i = 0; i < nChunks; i++ )
+	{
+		free( pChunks[i].m_pOutput );
+	}
+	free( pChunks );
+
+	return pOutputBuffer;
+}
+
 //-----------------------------------------------------------------------------
 // Above, but returns null if compression would not yield a size improvement
 //-----------------------------------------------------------------------------
@@ -262,26 +397,56 @@ bool LZMA_Uncompress( unsigned char *pInBuffer,
 	*ppOutBuffer = NULL;
 	*pOutSize = 0;
 
-	lzma_header_t *pHeader = (lzma_header_t *)pInBuffer;
-	if ( pHeader->id != LZMA_ID )
+	lzma_chunked_header_t *pChunkedHeader = (lzma_chunked_header_t *)pInBuffer;
+	if ( pChunkedHeader->id == LZMA_CHUNKED_ID )
 	{
-		// not ours
-		return false;
-	}
+		unsigned char *pOutBuffer = (unsigned char *)malloc( pChunkedHeader->actualSize );
+		if ( !pOutBuffer )
+		{
+			return false;
+		}
 
-	CLzmaDec state;
+		unsigned int *pOffsets = (unsigned int *)( pInBuffer + sizeof( lzma_chunked_header_t ) );
+		unsigned int nOutputSize = 0;
+		for ( unsigned int i = 0; i < pChunkedHeader->numChunks; i++ )
+		{
+			lzma_header_t *pChunk = (lzma_header_t *)( pInBuffer + pOffsets[i] );
+			unsigned char *pChunkOutput = NULL;
+			unsigned int nChunkSize = 0;
+			if ( pChunk->id != LZMA_ID || nOutputSize + pChunk->actualSize > pChunkedHeader->actualSize ||
+			     !LZMA_Uncompress( (unsigned char *)pChunk, &pChunkOutput, &nChunkSize ) )
+			{
+				free( pOutBuffer );
+				return false;
+			}
+			memcpy( pOutBuffer + nOutputSize, pChunkOutput, nChunkSize );
+			free( pChunkOutput );
+			nOutputSize += nChunkSize;
+		}
 
-	LzmaDec_Construct(&state);
+		if ( nOutputSize != pChunkedHeader->actualSize )
+		{
+			free( pOutBuffer );
+			return false;
+		}
 
-	if ( LzmaDec_Allocate(&state, pHeader->properties, LZMA_PROPS_SIZE, &g_Alloc) != SZ_OK )
+		*ppOutBuffer = pOutBuffer;
+		*pOutSize = nOutputSize;
+		return true;
+	}
+
+	lzma_header_t *pHeader = (lzma_header_t *)pInBuffer;
+	if ( pHeader->id != LZMA_ID )
 	{
+		// not ours
 		return false;
 	}
 
+	// LzmaDecode decodes straight into the output buffer, so it only allocates the
+	// probability model and never a dictionary.
 	unsigned char *pOutBuffer = (unsigned char *)malloc( pHeader->actualSize );
 	if ( !pOutBuffer )
 	{
-		LzmaDec_Free(&state, &g_Alloc);
 		return false;
 	}
 
@@ -292,9 +457,6 @@ bool LZMA_Uncompress( unsigned char *pInBuffer,
 	SRes result = LzmaDecode( (Byte *)pOutBuffer, &outProcessed, (Byte *)(pInBuffer + sizeof( lzma_header_t ) ),
 	                          &inProcessed, (Byte *)pHeader->properties, LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &g_Alloc );
 
-
-	LzmaDec_Free(&state, &g_Alloc);
-
 	if ( result != SZ_OK || pHeader->actualSize != outProcessed )
 	{
 		free( pOutBuffer );
@@ -310,7 +472,7 @@ bool LZMA_Uncompress( unsigned char *pInBuffer,
 bool LZMA_IsCompressed( unsigned char *pInput )
 {
 	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	if ( pHeader && ( pHeader->id == LZMA_ID || pHeader->id == LZMA_CHUNKED_ID ) )
 	{
 		return true;
 	}
@@ -322,8 +484,9 @@ bool LZMA_IsCompressed( unsigned char *pInput )
 unsigned int LZMA_GetActualSize( unsigned char *pInput )
 {
 	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	if ( pHeader && ( pHeader->id == LZMA_ID || pHeader->id == LZMA_CHUNKED_ID ) )
 	{
+		// actualSize is at the same offset in both headers
 		return pHeader->actualSize;
 	}
 
@@ -28,6 +28,7 @@
 #include "tier1/strtools.h"
 #include "mathlib/vmatrix.h"
 #include "mdlobjects/dmeboneflexdriver.h"
+#include "vstdlib/jobthread.h"
 
 
 class CBoneRenderBounds
@@ -115,193 +116,321 @@ void ClearModel (void)
 }
 
 
-void processAnimations()
-{ 
-	int i, j;
-
-	// find global root bone.
-	if ( strlen( rootname ) )
+//-----------------------------------------------------------------------------
+// Runs each item through pfnProcess, spread across the thread pool when
+// studiomdl was started with -threads
+//-----------------------------------------------------------------------------
+template< class T >
+static void ProcessItems( const char *pszDescription, T *pItems, int nItems, void (*pfnProcess)( T & ) )
+{
+	if ( g_nThreads > 1 && nItems > 1 )
 	{
-		g_rootIndex = findGlobalBone( rootname );
-		if (g_rootIndex == -1)
-			g_rootIndex = 0;
+		ParallelProcess( pszDescription, pItems, nItems, pfnProcess );
+	}
+	else
+	{
+		for ( int i = 0; i < nItems; i++ )
+		{
+			pfnProcess( pItems[i] );
+		}
 	}
+}
 
-	buildAnimationWeights( );
 
-	for (i = 0; i < g_numani; i++)
-	{
-		s_animation_t *panim = g_panimation[i];
+//-----------------------------------------------------------------------------
+// Applies an animation's commands and extracts its motion
+//-----------------------------------------------------------------------------
+static void ProcessAnimation( s_animation_t *&panim )
+{
+	extractUnusedMotion( panim ); // FIXME: this should be part of LinearMotion()
 
-		extractUnusedMotion( panim ); // FIXME: this should be part of LinearMotion()
+	setAnimationWeight( panim, 0 );
 
-		setAnimationWeight( panim, 0 );
+	int startframe = 0;
 
-		int startframe = 0;
+	if (panim->fudgeloop)
+	{
+		fixupMissingFrame( panim );
+	}
 
-		if (panim->fudgeloop)
-		{
-			fixupMissingFrame( panim );
-		}
+	for (int j = 0; j < panim->numcmds; j++)
+	{
+		s_animcmd_t *pcmd = &panim->cmds[j];
 
-		for (j = 0; j < panim->numcmds; j++)
+		switch( pcmd->cmd )
 		{
-			s_animcmd_t *pcmd = &panim->cmds[j];
-
-			switch( pcmd->cmd )
+		case CMD_WEIGHTS:
+			setAnimationWeight( panim, pcmd->u.weightlist.index );
+			break;
+		case CMD_SUBTRACT:
+			panim->flags |= STUDIO_DELTA;
+			subtractBaseAnimations( pcmd->u.subtract.ref, panim, pcmd->u.subtract.frame, pcmd->u.subtract.flags );
+			break;
+		case CMD_AO:
 			{
-			case CMD_WEIGHTS:
-				setAnimationWeight( panim, pcmd->u.weightlist.index );
-				break;
-			case CMD_SUBTRACT:
-				panim->flags |= STUDIO_DELTA;
-				subtractBaseAnimations( pcmd->u.subtract.ref, panim, pcmd->u.subtract.frame, pcmd->u.subtract.flags );
-				break;
-			case CMD_AO:
+				int bone = g_rootIndex;
+				if (pcmd->u.ao.pBonename != NULL)
 				{
-					int bone = g_rootIndex;
-					if (pcmd->u.ao.pBonename != NULL)
+					bone = findGlobalBone( pcmd->u.ao.pBonename );
+					if (bone == -1)
 					{
-						bone = findGlobalBone( pcmd->u.ao.pBonename );
-						if (bone == -1)
-						{
-							MdlError("unable to find bone %s to alignbone\n", pcmd->u.ao.pBonename );
-						}
+						MdlError("unable to find bone %s to alignbone\n", pcmd->u.ao.pBonename );
 					}
-					processAutoorigin( pcmd->u.ao.ref, panim, pcmd->u.ao.motiontype, pcmd->u.ao.srcframe, pcmd->u.ao.destframe, bone );
-				}
-				break;
-			case CMD_MATCH:
-				processMatch( pcmd->u.match.ref, panim, false );
-				break;
-			case CMD_FIXUP:
-				fixupLoopingDiscontinuities( panim, pcmd->u.fixuploop.start, pcmd->u.fixuploop.end );
-				break;
-			case CMD_ANGLE:
-				makeAngle( panim, pcmd->u.angle.angle );
-				break;
-			case CMD_IKFIXUP:
-				break;
-			case CMD_IKRULE:
-				// processed later
-				break;
-			case CMD_MOTION:
-				{
-					extractLinearMotion( 
-						panim, 
-						pcmd->u.motion.motiontype, 
-						startframe, 
-						pcmd->u.motion.iEndFrame, 
-						pcmd->u.motion.iEndFrame, 
-						panim, 
-						startframe );
-					startframe = pcmd->u.motion.iEndFrame;
-				}
-				break;
-			case CMD_REFMOTION:
-				{
-					extractLinearMotion(
-						panim, 
-						pcmd->u.motion.motiontype, 
-						startframe, 
-						pcmd->u.motion.iEndFrame, 
-						pcmd->u.motion.iSrcFrame, 
-						pcmd->u.motion.pRefAnim, 
-						pcmd->u.motion.iRefFrame );
-					startframe = pcmd->u.motion.iEndFrame;
-				}
-				break;
-			case CMD_DERIVATIVE:
-				{
-					createDerivative(
-						panim, 
-						pcmd->u.derivative.scale );
-				}
-				break;
-			case CMD_NOANIMATION:
-				{
-					clearAnimations( panim );
-				}
-				break;
-			case CMD_LINEARDELTA:
-				{
-					panim->flags |= STUDIO_DELTA;
-					linearDelta( panim, panim, panim->numframes - 1, pcmd->u.linear.flags );
-				}
-				break;
-			case CMD_COMPRESS:
-				{
-					reencodeAnimation( panim, pcmd->u.compress.frames );
-				}
-				break;
-			case CMD_NUMFRAMES:
-				{
-					forceNumframes( panim, pcmd->u.numframes.frames );
 				}
-				break;
-			case CMD_COUNTERROTATE:
+				processAutoorigin( pcmd->u.ao.ref, panim, pcmd->u.ao.motiontype, pcmd->u.ao.srcframe, pcmd->u.ao.destframe, bone );
+			}
+			break;
+		case CMD_MATCH:
+			processMatch( pcmd->u.match.ref, panim, false );
+			break;
+		case CMD_FIXUP:
+			fixupLoopingDiscontinuities( panim, pcmd->u.fixuploop.start, pcmd->u.fixuploop.end );
+			break;
+		case CMD_ANGLE:
+			makeAngle( panim, pcmd->u.angle.angle );
+			break;
+		case CMD_IKFIXUP:
+			break;
+		case CMD_IKRULE:
+			// processed later
+			break;
+		case CMD_MOTION:
+			{
+				extractLinearMotion( 
+					panim, 
+					pcmd->u.motion.motiontype, 
+					startframe, 
+					pcmd->u.motion.iEndFrame, 
+					pcmd->u.motion.iEndFrame, 
+					panim, 
+					startframe );
+				startframe = pcmd->u.motion.iEndFrame;
+			}
+			break;
+		case CMD_REFMOTION:
+			{
+				extractLinearMotion(
+					panim, 
+					pcmd->u.motion.motiontype, 
+					startframe, 
+					pcmd->u.motion.iEndFrame, 
+					pcmd->u.motion.iSrcFrame, 
+					pcmd->u.motion.pRefAnim, 
+					pcmd->u.motion.iRefFrame );
+				startframe = pcmd->u.motion.iEndFrame;
+			}
+			break;
+		case CMD_DERIVATIVE:
+			{
+				createDerivative(
+					panim, 
+					pcmd->u.derivative.scale );
+			}
+			break;
+		case CMD_NOANIMATION:
+			{
+				clearAnimations( panim );
+			}
+			break;
+		case CMD_LINEARDELTA:
+			{
+				panim->flags |= STUDIO_DELTA;
+				linearDelta( panim, panim, panim->numframes - 1, pcmd->u.linear.flags );
+			}
+			break;
+		case CMD_COMPRESS:
+			{
+				reencodeAnimation( panim, pcmd->u.compress.frames );
+			}
+			break;
+		case CMD_NUMFRAMES:
+			{
+				forceNumframes( panim, pcmd->u.numframes.frames );
+			}
+			break;
+		case CMD_COUNTERROTATE:
+			{
+				int bone = findGlobalBone( pcmd->u.counterrotate.pBonename );
+				if (bone != -1)
 				{
-					int bone = findGlobalBone( pcmd->u.counterrotate.pBonename );
-					if (bone != -1)
-					{
-						QAngle target;
-
-						if (!pcmd->u.counterrotate.bHasTarget)
-						{
-							matrix3x4_t rootxform;
-							matrix3x4_t defaultBoneToWorld;
-							AngleMatrix( panim->rotation, rootxform );
-							ConcatTransforms( rootxform, g_bonetable[bone].boneToPose, defaultBoneToWorld );
+					QAngle target;
 
-							MatrixAngles( defaultBoneToWorld, target );
-						}
-						else
-						{
-							target.Init( pcmd->u.counterrotate.targetAngle[0], pcmd->u.counterrotate.targetAngle[1], pcmd->u.counterrotate.targetAngle[2] );
-						}
+					if (!pcmd->u.counterrotate.bHasTarget)
+					{
+						matrix3x4_t rootxform;
+						matrix3x4_t defaultBoneToWorld;
+						AngleMatrix( panim->rotation, rootxform );
+						ConcatTransforms( rootxform, g_bonetable[bone].boneToPose, defaultBoneToWorld );
 
-						counterRotateBone( panim, bone, target );
+						MatrixAngles( defaultBoneToWorld, target );
 					}
 					else
 					{
-						MdlError("unable to find bone %s to counterrotate\n", pcmd->u.counterrotate.pBonename );
+						target.Init( pcmd->u.counterrotate.targetAngle[0], pcmd->u.counterrotate.targetAngle[1], pcmd->u.counterrotate.targetAngle[2] );
 					}
+
+					counterRotateBone( panim, bone, target );
 				}
-				break;
-			case CMD_WORLDSPACEBLEND:
-				worldspaceBlend( pcmd->u.world.ref, panim, pcmd->u.world.startframe, pcmd->u.world.loops );
-				break;
-			case CMD_MATCHBLEND:
-				matchBlend( panim, pcmd->u.match.ref, pcmd->u.match.srcframe, pcmd->u.match.destframe, pcmd->u.match.destpre, pcmd->u.match.destpost );
-				break;
-			case CMD_LOCALHIERARCHY:
-				localHierarchy( panim, pcmd->u.localhierarchy.pBonename, pcmd->u.localhierarchy.pParentname, pcmd->u.localhierarchy.start, pcmd->u.localhierarchy.peak, pcmd->u.localhierarchy.tail, pcmd->u.localhierarchy.end );
-				// localHierarchy( panim, char	*pBonename, char *pParentname, int start, int peak, int tail, int end );
-				break;
+				else
+				{
+					MdlError("unable to find bone %s to counterrotate\n", pcmd->u.counterrotate.pBonename );
+				}
+			}
+			break;
+		case CMD_WORLDSPACEBLEND:
+			worldspaceBlend( pcmd->u.world.ref, panim, pcmd->u.world.startframe, pcmd->u.world.loops );
+			break;
+		case CMD_MATCHBLEND:
+			matchBlend( panim, pcmd->u.match.ref, pcmd->u.match.srcframe, pcmd->u.match.destframe, pcmd->u.match.destpre, pcmd->u.match.destpost );
+			break;
+		case CMD_LOCALHIERARCHY:
+			localHierarchy( panim, pcmd->u.localhierarchy.pBonename, pcmd->u.localhierarchy.pParentname, pcmd->u.localhierarchy.start, pcmd->u.localhierarchy.peak, pcmd->u.localhierarchy.tail, pcmd->u.localhierarchy.end );
+			// localHierarchy( panim, char	*pBonename, char *pParentname, int start, int peak, int tail, int end );
+			break;
+		}
+	}
+
+	if (panim->motiontype)
+	{
+		int lastframe;
+		if (!(panim->flags & STUDIO_LOOPING) )
+		{
+			// roll back 0.2 seconds to try to prevent popping
+			int frames = panim->fps * panim->motionrollback;
+			lastframe = max( min( startframe + 1, panim->numframes - 1), panim->numframes - frames - 1 );
+			//printf("%s : %d %d (%d)\n", panim->name, startframe, lastframe, panim->numframes - 1 );
+		}
+		else
+		{
+			lastframe = panim->numframes - 1;
+		}
+		extractLinearMotion( panim, panim->motiontype, startframe, lastframe, panim->numframes - 1, panim, startframe );
+		startframe = panim->numframes - 1;
+	}
+
+	realignLooping( panim );
+
+	forceAnimationLoop( panim );
+}
+
+
+//-----------------------------------------------------------------------------
+// Returns the other animation a command reads from, if any
+//-----------------------------------------------------------------------------
+static s_animation_t *GetAnimCmdRef( const s_animcmd_t *pcmd )
+{
+	switch( pcmd->cmd )
+	{
+	case CMD_SUBTRACT:
+		return pcmd->u.subtract.ref;
+	case CMD_AO:
+		return pcmd->u.ao.ref;
+	case CMD_MATCH:
+	case CMD_MATCHBLEND:
+		return pcmd->u.match.ref;
+	case CMD_REFMOTION:
+		return pcmd->u.motion.pRefAnim;
+	case CMD_WORLDSPACEBLEND:
+		return pcmd->u.world.ref;
+	}
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Processes the animations on the thread pool. An animation that reads
+// another is put in a later wave than every lower numbered animation it
+// shares a reference with, so each one sees exactly the data it would have
+// seen processed serially in order and the output is unchanged.
+// Returns false if the references can't be resolved.
+//-----------------------------------------------------------------------------
+static bool ProcessAnimationWaves()
+{
+	int i, j;
+
+	for (i = 0; i < g_numani; i++)
+	{
+		if (g_panimation[i]->index != i)
+			return false;
+	}
+
+	CUtlVector< int > wave;
+	wave.SetCount( g_numani );
+	for (i = 0; i < g_numani; i++)
+	{
+		wave[i] = 0;
+	}
+
+	int nWaves = 0;
+	for (i = 0; i < g_numani; i++)
+	{
+		s_animation_t *panim = g_panimation[i];
+
+		// anything earlier this reads from or that reads from this has already been placed
+		for (j = 0; j < panim->numcmds; j++)
+		{
+			s_animation_t *pRef = GetAnimCmdRef( &panim->cmds[j] );
+			if (!pRef)
+				continue;
+			if (pRef->index < 0 || pRef->index >= g_numani || g_panimation[pRef->index] != pRef)
+				return false;
+			if (pRef->index < i)
+			{
+				wave[i] = max( wave[i], wave[pRef->index] + 1 );
 			}
 		}
 
-		if (panim->motiontype)
+		// later animations this reads from must wait until it's done
+		for (j = 0; j < panim->numcmds; j++)
 		{
-			int lastframe;
-			if (!(panim->flags & STUDIO_LOOPING) )
+			s_animation_t *pRef = GetAnimCmdRef( &panim->cmds[j] );
+			if (pRef && pRef->index > i)
 			{
-				// roll back 0.2 seconds to try to prevent popping
-				int frames = panim->fps * panim->motionrollback;
-				lastframe = max( min( startframe + 1, panim->numframes - 1), panim->numframes - frames - 1 );
-				//printf("%s : %d %d (%d)\n", panim->name, startframe, lastframe, panim->numframes - 1 );
+				wave[pRef->index] = max( wave[pRef->index], wave[i] + 1 );
 			}
-			else
+		}
+
+		nWaves = max( nWaves, wave[i] + 1 );
+	}
+
+	CUtlVector< s_animation_t * > anims;
+	for (int w = 0; w < nWaves; w++)
+	{
+		anims.RemoveAll();
+		for (i = 0; i < g_numani; i++)
+		{
+			if (wave[i] == w)
 			{
-				lastframe = panim->numframes - 1;
+				anims.AddToTail( g_panimation[i] );
 			}
-			extractLinearMotion( panim, panim->motiontype, startframe, lastframe, panim->numframes - 1, panim, startframe );
-			startframe = panim->numframes - 1;
 		}
+		ProcessItems( "ProcessAnimation", anims.Base(), anims.Count(), &ProcessAnimation );
+	}
+	return true;
+}
+
+
+void processAnimations()
+{ 
+	int i, j;
+
+	// find global root bone.
+	if ( strlen( rootname ) )
+	{
+		g_rootIndex = findGlobalBone( rootname );
+		if (g_rootIndex == -1)
+			g_rootIndex = 0;
+	}
 
-		realignLooping( panim );
+	buildAnimationWeights( );
 
-		forceAnimationLoop( panim );
+	// verbose output is only readable in order
+	if (g_nThreads <= 1 || g_verbose || !ProcessAnimationWaves())
+	{
+		for (i = 0; i < g_numani; i++)
+		{
+			ProcessAnimation( g_panimation[i] );
+		}
 	}
 
 	// merge weightlists
@@ -6518,336 +6647,375 @@ static void LockBoneLengths()
 
 
 //-----------------------------------------------------------------------------
-// Purpose: go through all the IK rules and calculate the animated path the IK'd 
-//			end point moves relative to its IK target.
+// Builds an animation's IK rules and their error streams
 //-----------------------------------------------------------------------------
-static void ProcessIKRules( )
+static void ProcessAnimationIKRules( s_animation_t *&panim )
 {
-	int i, j, k;
+	int j, k;
 
-	// copy source animations
-	for (i = 0; i < g_numani; i++)
+	const char *pAnimationName = panim->animationname;
+	s_sourceanim_t *pSourceAnim = FindSourceAnim( panim->source, pAnimationName );
+
+	for (j = 0; j < panim->numcmds; j++)
 	{
-		s_animation_t *panim = g_panimation[i];
-		const char *pAnimationName = g_panimation[i]->animationname;
-		s_sourceanim_t *pSourceAnim = FindSourceAnim( panim->source, pAnimationName );
+		if ( panim->cmds[j].cmd == CMD_IKFIXUP )
+		{
+			fixupIKErrors( panim, panim->cmds[j].u.ikfixup.pRule );
+		}
 
-		for (j = 0; j < panim->numcmds; j++)
+		if (panim->cmds[j].cmd != CMD_IKRULE)
+			continue;
+
+		if (panim->numikrules >= MAXSTUDIOIKRULES)
 		{
-			if ( panim->cmds[j].cmd == CMD_IKFIXUP )
-			{
-				fixupIKErrors( panim, panim->cmds[j].u.ikfixup.pRule );
-			}
+			MdlError("Too many IK rules in %s (%s)\n", panim->name, panim->filename );
+		}
+		s_ikrule_t *pRule = &panim->ikrule[panim->numikrules++];
 
-			if (panim->cmds[j].cmd != CMD_IKRULE)
-				continue;
+		// make a copy of the rule;
+		*pRule = *panim->cmds[j].u.ikrule.pRule;
+	}
 
-			if (panim->numikrules >= MAXSTUDIOIKRULES)
-			{
-				MdlError("Too many IK rules in %s (%s)\n", panim->name, panim->filename );
-			}
-			s_ikrule_t *pRule = &panim->ikrule[panim->numikrules++];
+	for (j = 0; j < panim->numikrules; j++)
+	{
+		s_ikrule_t *pRule = &panim->ikrule[j];
 
-			// make a copy of the rule;
-			*pRule = *panim->cmds[j].u.ikrule.pRule;
+		if (pRule->start == 0 && pRule->peak == 0 && pRule->tail == 0 && pRule->end == 0)
+		{
+			pRule->tail = panim->numframes - 1;
+			pRule->end = panim->numframes - 1;
 		}
 
-		for (j = 0; j < panim->numikrules; j++)
+		if (pRule->start != -1 && pRule->peak == -1 && pRule->tail == -1 && pRule->end != -1)
 		{
-			s_ikrule_t *pRule = &panim->ikrule[j];
+			pRule->peak = (pRule->start + pRule->end) / 2;
+			pRule->tail = (pRule->start + pRule->end) / 2;
+		}
 
-			if (pRule->start == 0 && pRule->peak == 0 && pRule->tail == 0 && pRule->end == 0)
-			{
-				pRule->tail = panim->numframes - 1;
-				pRule->end = panim->numframes - 1;
-			}
+		if (pRule->start != -1 && pRule->peak == -1 && pRule->tail != -1)
+		{
+			pRule->peak = (pRule->start + pRule->tail) / 2;
+		}
 
-			if (pRule->start != -1 && pRule->peak == -1 && pRule->tail == -1 && pRule->end != -1)
-			{
-				pRule->peak = (pRule->start + pRule->end) / 2;
-				pRule->tail = (pRule->start + pRule->end) / 2;
-			}
+		if (pRule->peak != -1 && pRule->tail == -1 && pRule->end != -1)
+		{
+			pRule->tail = (pRule->peak + pRule->end) / 2;
+		}
 
-			if (pRule->start != -1 && pRule->peak == -1 && pRule->tail != -1)
-			{
-				pRule->peak = (pRule->start + pRule->tail) / 2;
-			}
+		if (pRule->peak == -1)
+		{
+			pRule->start = 0;
+			pRule->peak = 0;
+		}
 
-			if (pRule->peak != -1 && pRule->tail == -1 && pRule->end != -1)
-			{
-				pRule->tail = (pRule->peak + pRule->end) / 2;
-			}
+		if (pRule->tail == -1)
+		{
+			pRule->tail = panim->numframes - 1;
+			pRule->end = panim->numframes - 1;
+		}
 
-			if (pRule->peak == -1)
-			{
-				pRule->start = 0;
-				pRule->peak = 0;
-			}
+		if (pRule->contact == -1)
+		{
+			pRule->contact = pRule->peak;
+		}
+
+		// huh, make up start and end numbers
+		if (pRule->start == -1)
+		{
+			s_ikrule_t *pPrev = FindPrevIKRule( panim, j );
 
-			if (pRule->tail == -1)
+			if (pPrev->slot == pRule->slot)
 			{
-				pRule->tail = panim->numframes - 1;
-				pRule->end = panim->numframes - 1;
+				if (pRule->peak < pPrev->tail)
+				{
+					pRule->start = pRule->peak + (pPrev->tail - pRule->peak) / 2;
+				}
+				else
+				{
+					pRule->start = pRule->peak + (pPrev->tail - pRule->peak + panim->numframes - 1) / 2;
+				}
+				pRule->start = (pRule->start + panim->numframes / 2) % (panim->numframes - 1);
+				pPrev->end = (pRule->start + panim->numframes - 1) % (panim->numframes - 1);
 			}
-
-			if (pRule->contact == -1)
+			else
 			{
-				pRule->contact = pRule->peak;
+				pRule->start = pPrev->tail;
+				pPrev->end = pRule->peak;
 			}
+			// printf("%s : %d (%d) : %d %d %d %d\n", panim->name, pRule->chain, panim->numframes - 1, pRule->start, pRule->peak, pRule->tail, pRule->end );
+		}
 
-			// huh, make up start and end numbers
-			if (pRule->start == -1)
-			{
-				s_ikrule_t *pPrev = FindPrevIKRule( panim, j );
+		// huh, make up start and end numbers
+		if (pRule->end == -1)
+		{
+			s_ikrule_t *pNext = FindNextIKRule( panim, j );
 
-				if (pPrev->slot == pRule->slot)
+			if (pNext->slot == pRule->slot)
+			{
+				if (pNext->peak < pRule->tail)
 				{
-					if (pRule->peak < pPrev->tail)
-					{
-						pRule->start = pRule->peak + (pPrev->tail - pRule->peak) / 2;
-					}
-					else
-					{
-						pRule->start = pRule->peak + (pPrev->tail - pRule->peak + panim->numframes - 1) / 2;
-					}
-					pRule->start = (pRule->start + panim->numframes / 2) % (panim->numframes - 1);
-					pPrev->end = (pRule->start + panim->numframes - 1) % (panim->numframes - 1);
+					pNext->start = pNext->peak + (pRule->tail - pNext->peak) / 2;
 				}
 				else
 				{
-					pRule->start = pPrev->tail;
-					pPrev->end = pRule->peak;
+					pNext->start = pNext->peak + (pRule->tail - pNext->peak + panim->numframes - 1) / 2;
 				}
-				// printf("%s : %d (%d) : %d %d %d %d\n", panim->name, pRule->chain, panim->numframes - 1, pRule->start, pRule->peak, pRule->tail, pRule->end );
+				pNext->start = (pNext->start + panim->numframes / 2) % (panim->numframes - 1);
+				pRule->end = (pNext->start + panim->numframes - 1) % (panim->numframes - 1);
 			}
-
-			// huh, make up start and end numbers
-			if (pRule->end == -1)
+			else
 			{
-				s_ikrule_t *pNext = FindNextIKRule( panim, j );
+				pNext->start = pRule->tail;
+				pRule->end = pNext->peak;
+			}
+			// printf("%s : %d (%d) : %d %d %d %d\n", panim->name, pRule->chain, panim->numframes - 1, pRule->start, pRule->peak, pRule->tail, pRule->end );
+		}
 
-				if (pNext->slot == pRule->slot)
-				{
-					if (pNext->peak < pRule->tail)
-					{
-						pNext->start = pNext->peak + (pRule->tail - pNext->peak) / 2;
-					}
-					else
-					{
-						pNext->start = pNext->peak + (pRule->tail - pNext->peak + panim->numframes - 1) / 2;
-					}
-					pNext->start = (pNext->start + panim->numframes / 2) % (panim->numframes - 1);
-					pRule->end = (pNext->start + panim->numframes - 1) % (panim->numframes - 1);
-				}
-				else
-				{
-					pNext->start = pRule->tail;
-					pRule->end = pNext->peak;
-				}
-				// printf("%s : %d (%d) : %d %d %d %d\n", panim->name, pRule->chain, panim->numframes - 1, pRule->start, pRule->peak, pRule->tail, pRule->end );
-			}
+		// check for wrapping
+		if (pRule->peak < pRule->start)
+		{
+			pRule->peak += panim->numframes - 1;
+		}
+		if (pRule->tail < pRule->peak)
+		{
+			pRule->tail += panim->numframes - 1;
+		}
+		if (pRule->end < pRule->tail)
+		{
+			pRule->end += panim->numframes - 1;
+		}
+		if (pRule->contact < pRule->start)
+		{
+			pRule->contact += panim->numframes - 1;
+		}
 
-			// check for wrapping
-			if (pRule->peak < pRule->start)
-			{
-				pRule->peak += panim->numframes - 1;
-			}
-			if (pRule->tail < pRule->peak)
-			{
-				pRule->tail += panim->numframes - 1;
-			}
-			if (pRule->end < pRule->tail)
-			{
-				pRule->end += panim->numframes - 1;
-			}
-			if (pRule->contact < pRule->start)
-			{
-				pRule->contact += panim->numframes - 1;
-			}
+		/*
+		printf("%s : %d (%d) : %d %d %d %d : %s\n", panim->name, pRule->chain, panim->numframes - 1, pRule->start, pRule->peak, pRule->tail, pRule->end,
+			pRule->usesequence ? "usesequence" : pRule->usesource ? "source" : "" );
+		*/
 
-			/*
-			printf("%s : %d (%d) : %d %d %d %d : %s\n", panim->name, pRule->chain, panim->numframes - 1, pRule->start, pRule->peak, pRule->tail, pRule->end,
-				pRule->usesequence ? "usesequence" : pRule->usesource ? "source" : "" );
-			*/
+		pRule->errorData.numerror = pRule->end - pRule->start + 1;
+		if (pRule->end >= panim->numframes)
+			pRule->errorData.numerror = pRule->errorData.numerror + 2;
 
-			pRule->errorData.numerror = pRule->end - pRule->start + 1;
-			if (pRule->end >= panim->numframes)
-				pRule->errorData.numerror = pRule->errorData.numerror + 2;
+		pRule->errorData.pError = (s_streamdata_t *)kalloc( pRule->errorData.numerror, sizeof( s_streamdata_t ));
 
-			pRule->errorData.pError = (s_streamdata_t *)kalloc( pRule->errorData.numerror, sizeof( s_streamdata_t ));
+		int n = 0;
 
-			int n = 0;
+		if (pRule->usesequence)
+		{
+			// FIXME: bah, this is horrendously hacky, add a damn back pointer
+			for (n = 0; n < g_sequence.Count(); n++)
+			{
+				if (g_sequence[n].panim[0][0] == panim)
+					break;
+			}
+		}
 
-			if (pRule->usesequence)
+		switch( pRule->type )
+		{
+		case IK_SELF:
 			{
-				// FIXME: bah, this is horrendously hacky, add a damn back pointer
-				for (n = 0; n < g_sequence.Count(); n++)
+				matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+				matrix3x4_t worldToBone;
+				matrix3x4_t local;
+
+				if (strlen(pRule->bonename) == 0)
 				{
-					if (g_sequence[n].panim[0][0] == panim)
-						break;
+					pRule->bone = -1;
 				}
-			}
+				else
+				{
 
-			switch( pRule->type )
-			{
-			case IK_SELF:
+					pRule->bone = findGlobalBone( pRule->bonename );
+					if (pRule->bone == -1)
+					{
+						MdlError("unknown bone '%s' in ikrule\n", pRule->bonename );
+					}
+				}
+
+				for (k = 0; k < pRule->errorData.numerror; k++)
 				{
-					matrix3x4_t boneToWorld[MAXSTUDIOBONES];
-					matrix3x4_t worldToBone;
-					matrix3x4_t local;
+					if (pRule->usesequence)
+					{
+						CalcSeqTransforms( n, k + pRule->start, boneToWorld );
+					}
+					else if (pRule->usesource)
+					{
+						matrix3x4_t srcBoneToWorld[MAXSTUDIOSRCBONES];
+						BuildRawTransforms( panim->source, pAnimationName, k + pRule->start + panim->startframe - pSourceAnim->startframe, panim->scale, panim->adjust, panim->rotation, panim->flags, srcBoneToWorld );
+						TranslateAnimations( panim->source, srcBoneToWorld, boneToWorld );
+					}
+					else 
+					{
+						CalcBoneTransforms( panim, k + pRule->start, boneToWorld );
+					}
+
 
-					if (strlen(pRule->bonename) == 0)
+					if (pRule->bone != -1)
 					{
-						pRule->bone = -1;
+						MatrixInvert( boneToWorld[pRule->bone], worldToBone );
+						ConcatTransforms( worldToBone, boneToWorld[g_ikchain[pRule->chain].link[2].bone], local );
 					}
 					else
 					{
-
-						pRule->bone = findGlobalBone( pRule->bonename );
-						if (pRule->bone == -1)
-						{
-							MdlError("unknown bone '%s' in ikrule\n", pRule->bonename );
-						}
+						MatrixCopy( boneToWorld[g_ikchain[pRule->chain].link[2].bone], local );
 					}
 
-					for (k = 0; k < pRule->errorData.numerror; k++)
-					{
-						if (pRule->usesequence)
-						{
-							CalcSeqTransforms( n, k + pRule->start, boneToWorld );
-						}
-						else if (pRule->usesource)
-						{
-							matrix3x4_t srcBoneToWorld[MAXSTUDIOSRCBONES];
-							BuildRawTransforms( panim->source, pAnimationName, k + pRule->start + panim->startframe - pSourceAnim->startframe, panim->scale, panim->adjust, panim->rotation, panim->flags, srcBoneToWorld );
-							TranslateAnimations( panim->source, srcBoneToWorld, boneToWorld );
-						}
-						else 
-						{
-							CalcBoneTransforms( panim, k + pRule->start, boneToWorld );
-						}
+					MatrixAngles( local, pRule->errorData.pError[k].q, pRule->errorData.pError[k].pos );
 
+					/*
+					QAngle ang;
+					QuaternionAngles( pRule->errorData.pError[k].q, ang );
+					printf("%d  %.1f %.1f %.1f : %.1f %.1f %.1f\n", 
+						k,
+						pRule->errorData.pError[k].pos.x, pRule->errorData.pError[k].pos.y, pRule->errorData.pError[k].pos.z, 
+						ang.x, ang.y, ang.z );
+					*/
+				}
+			}
+			break;
+		case IK_WORLD:
+			break;
+		case IK_ATTACHMENT:
+			{
+				matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+				matrix3x4_t worldToBone;
+				matrix3x4_t local;
 
-						if (pRule->bone != -1)
-						{
-							MatrixInvert( boneToWorld[pRule->bone], worldToBone );
-							ConcatTransforms( worldToBone, boneToWorld[g_ikchain[pRule->chain].link[2].bone], local );
-						}
-						else
-						{
-							MatrixCopy( boneToWorld[g_ikchain[pRule->chain].link[2].bone], local );
-						}
+				int bone = g_ikchain[pRule->chain].link[2].bone;
+				CalcBoneTransforms( panim, pRule->contact, boneToWorld );
+				// FIXME: add in motion
 
-						MatrixAngles( local, pRule->errorData.pError[k].q, pRule->errorData.pError[k].pos );
+				// pRule->pos = footfall;
+				// pRule->q = RadianEuler( 0, 0, 0 );
 
-						/*
-						QAngle ang;
-						QuaternionAngles( pRule->errorData.pError[k].q, ang );
-						printf("%d  %.1f %.1f %.1f : %.1f %.1f %.1f\n", 
-							k,
-							pRule->errorData.pError[k].pos.x, pRule->errorData.pError[k].pos.y, pRule->errorData.pError[k].pos.z, 
-							ang.x, ang.y, ang.z );
-						*/
+				if (strlen(pRule->bonename) == 0)
+				{
+					if (pRule->bone != -1)
+					{
+						pRule->bone = bone;
 					}
 				}
-				break;
-			case IK_WORLD:
-				break;
-			case IK_ATTACHMENT:
+				else
 				{
-					matrix3x4_t boneToWorld[MAXSTUDIOBONES];
-					matrix3x4_t worldToBone;
-					matrix3x4_t local;
+					pRule->bone = findGlobalBone( pRule->bonename );
+					if (pRule->bone == -1)
+					{
+						MdlError("unknown bone '%s' in ikrule\n", pRule->bonename );
+					}
+				}
 
-					int bone = g_ikchain[pRule->chain].link[2].bone;
+				if (pRule->bone != -1)
+				{
+					// FIXME: look for local bones...
 					CalcBoneTransforms( panim, pRule->contact, boneToWorld );
-					// FIXME: add in motion
+					MatrixAngles( boneToWorld[pRule->bone], pRule->q, pRule->pos );
+				}
 
-					// pRule->pos = footfall;
-					// pRule->q = RadianEuler( 0, 0, 0 );
+#if 0
+				printf("%d  %.1f %.1f %.1f\n", 
+					pRule->peak,
+					pRule->pos.x, pRule->pos.y, pRule->pos.z );
+#endif
 
-					if (strlen(pRule->bonename) == 0)
+				for (k = 0; k < pRule->errorData.numerror; k++)
+				{
+					int t = k + pRule->start;
+
+					if (pRule->usesequence)
 					{
-						if (pRule->bone != -1)
-						{
-							pRule->bone = bone;
-						}
+						CalcSeqTransforms( n, t, boneToWorld );
 					}
-					else
+					else if (pRule->usesource)
 					{
-						pRule->bone = findGlobalBone( pRule->bonename );
-						if (pRule->bone == -1)
-						{
-							MdlError("unknown bone '%s' in ikrule\n", pRule->bonename );
-						}
+						matrix3x4_t srcBoneToWorld[MAXSTUDIOSRCBONES];
+						BuildRawTransforms( panim->source, pAnimationName, t + panim->startframe - pSourceAnim->startframe, srcBoneToWorld );
+						TranslateAnimations( panim->source, srcBoneToWorld, boneToWorld );
 					}
-
-					if (pRule->bone != -1)
+					else 
 					{
-						// FIXME: look for local bones...
-						CalcBoneTransforms( panim, pRule->contact, boneToWorld );
-						MatrixAngles( boneToWorld[pRule->bone], pRule->q, pRule->pos );
+						CalcBoneTransforms( panim, t, boneToWorld );
 					}
 
-#if 0
-					printf("%d  %.1f %.1f %.1f\n", 
-						pRule->peak,
-						pRule->pos.x, pRule->pos.y, pRule->pos.z );
-#endif
+					Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
 
-					for (k = 0; k < pRule->errorData.numerror; k++)
-					{
-						int t = k + pRule->start;
+					// printf("%2d : %2d : %4.2f %6.1f %6.1f %6.1f\n", k, t, s, pos.x, pos.y, pos.z );
 
-						if (pRule->usesequence)
-						{
-							CalcSeqTransforms( n, t, boneToWorld );
-						}
-						else if (pRule->usesource)
-						{
-							matrix3x4_t srcBoneToWorld[MAXSTUDIOSRCBONES];
-							BuildRawTransforms( panim->source, pAnimationName, t + panim->startframe - pSourceAnim->startframe, srcBoneToWorld );
-							TranslateAnimations( panim->source, srcBoneToWorld, boneToWorld );
-						}
-						else 
-						{
-							CalcBoneTransforms( panim, t, boneToWorld );
-						}
 
-						Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
+					AngleMatrix( pRule->q, pos, local );
+					MatrixInvert( local, worldToBone );
 
-						// printf("%2d : %2d : %4.2f %6.1f %6.1f %6.1f\n", k, t, s, pos.x, pos.y, pos.z );
+					// calc position error
+					ConcatTransforms( worldToBone, boneToWorld[bone], local );
+					MatrixAngles( local, pRule->errorData.pError[k].q, pRule->errorData.pError[k].pos );
 
+#if 0
+					QAngle ang;
+					QuaternionAngles( pRule->errorData.pError[k].q, ang );
+					printf("%d  %.1f %.1f %.1f : %.1f %.1f %.1f\n", 
+						k + pRule->start,
+						pRule->errorData.pError[k].pos.x, pRule->errorData.pError[k].pos.y, pRule->errorData.pError[k].pos.z, 
+						ang.x, ang.y, ang.z );
+#endif
+				}
+			}
+			break;
+		case IK_GROUND:
+			{
+				matrix3x4_t boneToWorld[MAXSTUDIOBONES];
+				matrix3x4_t worldToBone;
+				matrix3x4_t local;
 
-						AngleMatrix( pRule->q, pos, local );
-						MatrixInvert( local, worldToBone );
+				int bone = g_ikchain[pRule->chain].link[2].bone;
 
-						// calc position error
-						ConcatTransforms( worldToBone, boneToWorld[bone], local );
-						MatrixAngles( local, pRule->errorData.pError[k].q, pRule->errorData.pError[k].pos );
+				if (pRule->usesequence)
+				{
+					CalcSeqTransforms( n, pRule->contact, boneToWorld );
+				}
+				else if (pRule->usesource)
+				{
+					matrix3x4_t srcBoneToWorld[MAXSTUDIOSRCBONES];
+					BuildRawTransforms( panim->source, pAnimationName, pRule->contact + panim->startframe - pSourceAnim->startframe, panim->scale, panim->adjust, panim->rotation, panim->flags, srcBoneToWorld );
+					TranslateAnimations( panim->source, srcBoneToWorld, boneToWorld );
+				}
+				else 
+				{
+					CalcBoneTransforms( panim, pRule->contact, boneToWorld );
+				}
 
+				// FIXME: add in motion
+
+				Vector footfall;
+				VectorTransform( g_ikchain[pRule->chain].center, boneToWorld[bone], footfall );
+				footfall.z = pRule->floor;
+
+				AngleMatrix( RadianEuler( 0, 0, 0 ), footfall, local );
+				MatrixInvert( local, worldToBone );
+
+				pRule->pos = footfall;
+				pRule->q = RadianEuler( 0, 0, 0 );
+				
 #if 0
-						QAngle ang;
-						QuaternionAngles( pRule->errorData.pError[k].q, ang );
-						printf("%d  %.1f %.1f %.1f : %.1f %.1f %.1f\n", 
-							k + pRule->start,
-							pRule->errorData.pError[k].pos.x, pRule->errorData.pError[k].pos.y, pRule->errorData.pError[k].pos.z, 
-							ang.x, ang.y, ang.z );
+				printf("%d  %.1f %.1f %.1f\n", 
+					pRule->peak,
+					pRule->pos.x, pRule->pos.y, pRule->pos.z );
 #endif
-					}
-				}
-				break;
-			case IK_GROUND:
-				{
-					matrix3x4_t boneToWorld[MAXSTUDIOBONES];
-					matrix3x4_t worldToBone;
-					matrix3x4_t local;
 
-					int bone = g_ikchain[pRule->chain].link[2].bone;
+				float s;
+				for (k = 0; k < pRule->errorData.numerror; k++)
+				{
+					int t = k + pRule->start;
+					/*
+					if (t > pRule->end)
+					{
+						t = t - (panim->numframes - 1);
+					}
+					*/
 
 					if (pRule->usesequence)
 					{
-						CalcSeqTransforms( n, pRule->contact, boneToWorld );
+						CalcSeqTransforms( n, t, boneToWorld );
 					}
 					else if (pRule->usesource)
 					{
@@ -6857,141 +7025,133 @@ static void ProcessIKRules( )
 					}
 					else 
 					{
-						CalcBoneTransforms( panim, pRule->contact, boneToWorld );
+						CalcBoneTransforms( panim, t, boneToWorld );
 					}
+					Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
+					s = 0.0;
 
-					// FIXME: add in motion
+					Vector cur;
+					VectorTransform( g_ikchain[pRule->chain].center, boneToWorld[bone], cur );
+					cur.z = pos.z;
 
-					Vector footfall;
-					VectorTransform( g_ikchain[pRule->chain].center, boneToWorld[bone], footfall );
-					footfall.z = pRule->floor;
-
-					AngleMatrix( RadianEuler( 0, 0, 0 ), footfall, local );
-					MatrixInvert( local, worldToBone );
-
-					pRule->pos = footfall;
-					pRule->q = RadianEuler( 0, 0, 0 );
-					
-#if 0
-					printf("%d  %.1f %.1f %.1f\n", 
-						pRule->peak,
-						pRule->pos.x, pRule->pos.y, pRule->pos.z );
-#endif
-
-					float s;
-					for (k = 0; k < pRule->errorData.numerror; k++)
+					if (t < pRule->start || t >= pRule->end)
 					{
-						int t = k + pRule->start;
-						/*
-						if (t > pRule->end)
-						{
-							t = t - (panim->numframes - 1);
-						}
-						*/
-
-						if (pRule->usesequence)
-						{
-							CalcSeqTransforms( n, t, boneToWorld );
-						}
-						else if (pRule->usesource)
-						{
-							matrix3x4_t srcBoneToWorld[MAXSTUDIOSRCBONES];
-							BuildRawTransforms( panim->source, pAnimationName, pRule->contact + panim->startframe - pSourceAnim->startframe, panim->scale, panim->adjust, panim->rotation, panim->flags, srcBoneToWorld );
-							TranslateAnimations( panim->source, srcBoneToWorld, boneToWorld );
-						}
-						else 
-						{
-							CalcBoneTransforms( panim, t, boneToWorld );
-						}
-						Vector pos = pRule->pos + calcMovement( panim, t, pRule->contact );
-						s = 0.0;
-
-						Vector cur;
-						VectorTransform( g_ikchain[pRule->chain].center, boneToWorld[bone], cur );
-						cur.z = pos.z;
-
-						if (t < pRule->start || t >= pRule->end)
-						{
-							// s = (float)(t - pRule->start) / (pRule->peak - pRule->start);
-							// pos = startPos * (1 - s) + pos * s;
-							pos = cur;
-						}
-						else if (t < pRule->peak)
-						{
-							s = (float)(pRule->peak - t) / (pRule->peak - pRule->start);
-							s = 3 * s * s - 2 * s * s * s;
-							pos = pos * (1 - s) + cur * s;
-						}
-						else if (t > pRule->tail)
-						{
-							s = (float)(t - pRule->tail) / (pRule->end - pRule->tail);
-							s = 3 * s * s - 2 * s * s * s;
-							pos = pos * (1 - s) + cur * s;
-							//pos = endPos - calcMovement( panim, t, pRule->tail );
-						}
+						// s = (float)(t - pRule->start) / (pRule->peak - pRule->start);
+						// pos = startPos * (1 - s) + pos * s;
+						pos = cur;
+					}
+					else if (t < pRule->peak)
+					{
+						s = (float)(pRule->peak - t) / (pRule->peak - pRule->start);
+						s = 3 * s * s - 2 * s * s * s;
+						pos = pos * (1 - s) + cur * s;
+					}
+					else if (t > pRule->tail)
+					{
+						s = (float)(t - pRule->tail) / (pRule->end - pRule->tail);
+						s = 3 * s * s - 2 * s * s * s;
+						pos = pos * (1 - s) + cur * s;
+						//pos = endPos - calcMovement( panim, t, pRule->tail );
+					}
 
-						//MatrixPosition( boneToWorld[bone], pos );
-						//pos.z = pRule->floor;
+					//MatrixPosition( boneToWorld[bone], pos );
+					//pos.z = pRule->floor;
 
-						// printf("%2d : %2d : %4.2f %6.1f %6.1f %6.1f\n", k, t, s, pos.x, pos.y, pos.z );
+					// printf("%2d : %2d : %4.2f %6.1f %6.1f %6.1f\n", k, t, s, pos.x, pos.y, pos.z );
 
 
-						AngleMatrix( pRule->q, pos, local );
-						MatrixInvert( local, worldToBone );
+					AngleMatrix( pRule->q, pos, local );
+					MatrixInvert( local, worldToBone );
 
-						// calc position error
-						ConcatTransforms( worldToBone, boneToWorld[bone], local );
-						MatrixAngles( local, pRule->errorData.pError[k].q, pRule->errorData.pError[k].pos );
+					// calc position error
+					ConcatTransforms( worldToBone, boneToWorld[bone], local );
+					MatrixAngles( local, pRule->errorData.pError[k].q, pRule->errorData.pError[k].pos );
 
 #if 0
-						QAngle ang;
-						QuaternionAngles( pRule->errorData.pError[k].q, ang );
-						printf("%d  %.1f %.1f %.1f : %.1f %.1f %.1f\n", 
-							k + pRule->start,
-							pRule->errorData.pError[k].pos.x, pRule->errorData.pError[k].pos.y, pRule->errorData.pError[k].pos.z, 
-							ang.x, ang.y, ang.z );
+					QAngle ang;
+					QuaternionAngles( pRule->errorData.pError[k].q, ang );
+					printf("%d  %.1f %.1f %.1f : %.1f %.1f %.1f\n", 
+						k + pRule->start,
+						pRule->errorData.pError[k].pos.x, pRule->errorData.pError[k].pos.y, pRule->errorData.pError[k].pos.z, 
+						ang.x, ang.y, ang.z );
 #endif
-					}
 				}
-				break;
-			case IK_RELEASE:
-			case IK_UNLATCH:
-				break;
 			}
+			break;
+		case IK_RELEASE:
+		case IK_UNLATCH:
+			break;
 		}
+	}
 
-		if ((panim->flags & STUDIO_DELTA) || panim->noAutoIK)
-			continue;
+	if ((panim->flags & STUDIO_DELTA) || panim->noAutoIK)
+		return;
 
-		// auto release ik chains that are moved but not referenced and have no explicit rules
-		int count[16];
+	// auto release ik chains that are moved but not referenced and have no explicit rules
+	int count[16];
 
-		for (j = 0; j < g_numikchains; j++)
-		{
-			count[j] = 0;
-		}
+	for (j = 0; j < g_numikchains; j++)
+	{
+		count[j] = 0;
+	}
+
+	for (j = 0; j < panim->numikrules; j++)
+	{
+		count[panim->ikrule[j].chain]++;
+	}
 
-		for (j = 0; j < panim->numikrules; j++)
+	for (j = 0; j < g_numikchains; j++)
+	{
+		if (count[j] == 0 && panim->weight[g_ikchain[j].link[2].bone] > 0.0)
 		{
-			count[panim->ikrule[j].chain]++;
+			// printf("%s - %s\n", panim->name, g_ikchain[j].name );
+			k = panim->numikrules++;
+			panim->ikrule[k].chain = j;
+			panim->ikrule[k].slot = j;
+			panim->ikrule[k].type = IK_RELEASE;
+			panim->ikrule[k].start = 0;
+			panim->ikrule[k].peak = 0;
+			panim->ikrule[k].tail = panim->numframes - 1;
+			panim->ikrule[k].end = panim->numframes - 1;
 		}
+	}
+}
 
-		for (j = 0; j < g_numikchains; j++)
+
+//-----------------------------------------------------------------------------
+// Purpose: go through all the IK rules and calculate the animated path the IK'd 
+//			end point moves relative to its IK target.
+//-----------------------------------------------------------------------------
+static void ProcessIKRules( )
+{
+	int i, j, k;
+
+	// ikfixup rewrites an animation that other animations' rules may sample through their sequence
+	bool bParallel = true;
+	for (i = 0; i < g_numani && bParallel; i++)
+	{
+		for (j = 0; j < g_panimation[i]->numcmds; j++)
 		{
-			if (count[j] == 0 && panim->weight[g_ikchain[j].link[2].bone] > 0.0)
+			if (g_panimation[i]->cmds[j].cmd == CMD_IKFIXUP)
 			{
-				// printf("%s - %s\n", panim->name, g_ikchain[j].name );
-				k = panim->numikrules++;
-				panim->ikrule[k].chain = j;
-				panim->ikrule[k].slot = j;
-				panim->ikrule[k].type = IK_RELEASE;
-				panim->ikrule[k].start = 0;
-				panim->ikrule[k].peak = 0;
-				panim->ikrule[k].tail = panim->numframes - 1;
-				panim->ikrule[k].end = panim->numframes - 1;
+				bParallel = false;
+				break;
 			}
 		}
 	}
+
+	// copy source animations
+	if (bParallel)
+	{
+		ProcessItems( "ProcessIKRules", g_panimation, g_numani, &ProcessAnimationIKRules );
+	}
+	else
+	{
+		for (i = 0; i < g_numani; i++)
+		{
+			ProcessAnimationIKRules( g_panimation[i] );
+		}
+	}
 	// exit(0);
 
 
@@ -7049,319 +7209,342 @@ static void ProcessIKRules( )
 
 
 //-----------------------------------------------------------------------------
-// CompressAnimations
+// Finds the quantization scales for one bone over all animations
 //-----------------------------------------------------------------------------
 
-static void CompressAnimations( )
+static void CalcBoneAnimationScales( s_bonetable_t &bone )
 {
-	int i, j, k, n, m;
+	int i, k, n;
+	int j = &bone - g_bonetable;
 
-	// find scales for all bones
-	for (j = 0; j < g_numbones; j++)
+	// printf("%s : ", g_bonetable[j].name );
+	for (k = 0; k < 6; k++)
 	{
-		// printf("%s : ", g_bonetable[j].name );
-		for (k = 0; k < 6; k++)
-		{
-			float minv, maxv, scale;
-			float total_minv, total_maxv;
+		float minv, maxv, scale;
+		float total_minv, total_maxv;
 
-			if (k < 3) 
-			{
-				minv = -128.0;
-				maxv = 128.0;
-				total_maxv = total_minv = g_bonetable[j].pos[k];
-			}
-			else
-			{
-				minv = -M_PI / 8.0;
-				maxv = M_PI / 8.0;
-				total_maxv = total_minv = g_bonetable[j].rot[k-3];
-			}
+		if (k < 3) 
+		{
+			minv = -128.0;
+			maxv = 128.0;
+			total_maxv = total_minv = g_bonetable[j].pos[k];
+		}
+		else
+		{
+			minv = -M_PI / 8.0;
+			maxv = M_PI / 8.0;
+			total_maxv = total_minv = g_bonetable[j].rot[k-3];
+		}
 
-			for (i = 0; i < g_numani; i++)
+		for (i = 0; i < g_numani; i++)
+		{
+			for (n = 0; n < g_panimation[i]->numframes; n++)
 			{
-				for (n = 0; n < g_panimation[i]->numframes; n++)
+				float v = 0.0f;
+				switch(k)
 				{
-					float v = 0.0f;
-					switch(k)
+				case 0: 
+				case 1: 
+				case 2: 
+					if (g_panimation[i]->flags & STUDIO_DELTA)
 					{
-					case 0: 
-					case 1: 
-					case 2: 
-						if (g_panimation[i]->flags & STUDIO_DELTA)
-						{
-							v = g_panimation[i]->sanim[n][j].pos[k]; 
-						}
-						else
-						{
-							v = ( g_panimation[i]->sanim[n][j].pos[k] - g_bonetable[j].pos[k] ); 
+						v = g_panimation[i]->sanim[n][j].pos[k]; 
+					}
+					else
+					{
+						v = ( g_panimation[i]->sanim[n][j].pos[k] - g_bonetable[j].pos[k] ); 
 
-							if (g_panimation[i]->sanim[n][j].pos[k] < total_minv)
-								total_minv = g_panimation[i]->sanim[n][j].pos[k];
-							if (g_panimation[i]->sanim[n][j].pos[k] > total_maxv)
-								total_maxv = g_panimation[i]->sanim[n][j].pos[k];
-						}
-						break;
-					case 3:
-					case 4:
-					case 5:
-						if (g_panimation[i]->flags & STUDIO_DELTA)
-						{
-							v = g_panimation[i]->sanim[n][j].rot[k-3]; 
-						}
-						else
-						{
-							v = ( g_panimation[i]->sanim[n][j].rot[k-3] - g_bonetable[j].rot[k-3] ); 
-						}
-						while (v >= M_PI)
-							v -= M_PI * 2;
-						while (v < -M_PI)
-							v += M_PI * 2;
-						break;
+						if (g_panimation[i]->sanim[n][j].pos[k] < total_minv)
+							total_minv = g_panimation[i]->sanim[n][j].pos[k];
+						if (g_panimation[i]->sanim[n][j].pos[k] > total_maxv)
+							total_maxv = g_panimation[i]->sanim[n][j].pos[k];
 					}
-					if (v < minv)
-						minv = v;
-					if (v > maxv)
-						maxv = v;
+					break;
+				case 3:
+				case 4:
+				case 5:
+					if (g_panimation[i]->flags & STUDIO_DELTA)
+					{
+						v = g_panimation[i]->sanim[n][j].rot[k-3]; 
+					}
+					else
+					{
+						v = ( g_panimation[i]->sanim[n][j].rot[k-3] - g_bonetable[j].rot[k-3] ); 
+					}
+					while (v >= M_PI)
+						v -= M_PI * 2;
+					while (v < -M_PI)
+						v += M_PI * 2;
+					break;
 				}
+				if (v < minv)
+					minv = v;
+				if (v > maxv)
+					maxv = v;
 			}
-			if (minv < maxv)
+		}
+		if (minv < maxv)
+		{
+			if (-minv> maxv)
 			{
-				if (-minv> maxv)
-				{
-					scale = minv / -32768.0;
-				}
-				else
-				{
-					scale = maxv / 32767;
-				}
+				scale = minv / -32768.0;
 			}
 			else
 			{
-				scale = 1.0 / 32.0;
-			}
-			switch(k)
-			{
-			case 0: 
-			case 1: 
-			case 2: 
-				g_bonetable[j].posscale[k] = scale;
-				g_bonetable[j].posrange[k] = total_maxv - total_minv;
-				break;
-			case 3:
-			case 4:
-			case 5:
-				// printf("(%.1f %.1f)", RAD2DEG(minv), RAD2DEG(maxv) );
-				// printf("(%.1f)", RAD2DEG(maxv-minv) );
-				g_bonetable[j].rotscale[k-3] = scale;
-				break;
+				scale = maxv / 32767;
 			}
-			// printf("%.0f ", 1.0 / scale );
 		}
-		// printf("\n" );
+		else
+		{
+			scale = 1.0 / 32.0;
+		}
+		switch(k)
+		{
+		case 0: 
+		case 1: 
+		case 2: 
+			g_bonetable[j].posscale[k] = scale;
+			g_bonetable[j].posrange[k] = total_maxv - total_minv;
+			break;
+		case 3:
+		case 4:
+		case 5:
+			// printf("(%.1f %.1f)", RAD2DEG(minv), RAD2DEG(maxv) );
+			// printf("(%.1f)", RAD2DEG(maxv-minv) );
+			g_bonetable[j].rotscale[k-3] = scale;
+			break;
+		}
+		// printf("%.0f ", 1.0 / scale );
 	}
+	// printf("\n" );
+}
 
+//-----------------------------------------------------------------------------
+// Run length encodes one animation against the bone scales
+//-----------------------------------------------------------------------------
 
-	// reduce animations
-	for (i = 0; i < g_numani; i++)
+static void CompressAnimation( s_animation_t *&panim )
+{
+	int j, k, n, m;
+
+	s_source_t *psource = panim->source;
+
+	if (g_bCheckLengths)
 	{
-		s_animation_t *panim = g_panimation[i];
-		s_source_t *psource = panim->source;
+		printf("%s\n", panim->name ); 
+	}
 
-		if (g_bCheckLengths)
-		{
-			printf("%s\n", panim->name ); 
-		}
+	// setup animation interior sections
+	int iSectionFrames = panim->numframes;
+	if ( panim->numframes >= g_minSectionFrameLimit )
+	{
+		iSectionFrames = g_sectionFrames;
+		panim->sectionframes = g_sectionFrames;
+		panim->numsections = (int)(panim->numframes / panim->sectionframes) + 2;
+	}
+	else
+	{
+		panim->sectionframes = 0;
+		panim->numsections = 1;
+	}
 
-		// setup animation interior sections
-		int iSectionFrames = panim->numframes;
-		if ( panim->numframes >= g_minSectionFrameLimit )
-		{
-			iSectionFrames = g_sectionFrames;
-			panim->sectionframes = g_sectionFrames;
-			panim->numsections = (int)(panim->numframes / panim->sectionframes) + 2;
-		}
-		else
-		{
-			panim->sectionframes = 0;
-			panim->numsections = 1;
-		}
+	for (int w = 0; w < panim->numsections; w++)
+	{
+		int iStartFrame = w * iSectionFrames;
+		int iEndFrame = (w + 1) * iSectionFrames;
 
-		for (int w = 0; w < panim->numsections; w++)
-		{
-			int iStartFrame = w * iSectionFrames;
-			int iEndFrame = (w + 1) * iSectionFrames;
+		iStartFrame = min( iStartFrame, panim->numframes - 1 );
+		iEndFrame = min( iEndFrame, panim->numframes - 1 );
 
-			iStartFrame = min( iStartFrame, panim->numframes - 1 );
-			iEndFrame = min( iEndFrame, panim->numframes - 1 );
+		// printf("%s : %d %d\n", panim->name, iStartFrame, iEndFrame );
 
-			// printf("%s : %d %d\n", panim->name, iStartFrame, iEndFrame );
+		for (j = 0; j < g_numbones; j++)
+		{
+			for (k = 0; k < 6; k++)
+			{
+				panim->anim[w][j].num[k] = 0;
+				panim->anim[w][j].data[k] = NULL;
+			}
 
-			for (j = 0; j < g_numbones; j++)
+			// skip bones that are always procedural
+			if (g_bonetable[j].flags & BONE_ALWAYS_PROCEDURAL)
 			{
-				for (k = 0; k < 6; k++)
-				{
-					panim->anim[w][j].num[k] = 0;
-					panim->anim[w][j].data[k] = NULL;
-				}
+				// panim->weight[j] = 0.0;
+				continue;
+			}
 
-				// skip bones that are always procedural
-				if (g_bonetable[j].flags & BONE_ALWAYS_PROCEDURAL)
-				{
-					// panim->weight[j] = 0.0;
-					continue;
-				}
+			// skip bones that have no influence
+			if (panim->weight[j] < 0.001)
+				continue;
 
-				// skip bones that have no influence
-				if (panim->weight[j] < 0.001)
-					continue;
+			float checkmin[6], checkmax[6];
+			for (k = 0; k < 6; k++)
+			{
+				checkmin[k] = 9999;
+				checkmax[k] = -9999;
+			}
 
-				float checkmin[6], checkmax[6];
-				for (k = 0; k < 6; k++)
-				{
-					checkmin[k] = 9999;
-					checkmax[k] = -9999;
-				}
+			for (k = 0; k < 6; k++)
+			{
+				mstudioanimvalue_t	*pcount, *pvalue;
+				float v;
+				short value[MAXSTUDIOANIMFRAMES];
+				mstudioanimvalue_t data[MAXSTUDIOANIMFRAMES];
 
-				for (k = 0; k < 6; k++)
+				// find deltas from default pose
+				for (n = 0; n <= iEndFrame - iStartFrame; n++)
 				{
-					mstudioanimvalue_t	*pcount, *pvalue;
-					float v;
-					short value[MAXSTUDIOANIMFRAMES];
-					mstudioanimvalue_t data[MAXSTUDIOANIMFRAMES];
-
-					// find deltas from default pose
-					for (n = 0; n <= iEndFrame - iStartFrame; n++)
+					s_bone_t *psrcdata = &panim->sanim[n+iStartFrame][j];
+					switch(k)
 					{
-						s_bone_t *psrcdata = &panim->sanim[n+iStartFrame][j];
-						switch(k)
+					case 0: /* X Position */
+					case 1: /* Y Position */
+					case 2: /* Z Position */
+						if (panim->flags & STUDIO_DELTA)
 						{
-						case 0: /* X Position */
-						case 1: /* Y Position */
-						case 2: /* Z Position */
-							if (panim->flags & STUDIO_DELTA)
-							{
-								value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
-								// pre-scale pos delta since format only has room for "overall" weight
-								float r = panim->posweight[j] / panim->weight[j];
-								value[n] *= r;
-							}
-							else
-							{
-								value[n] = ( psrcdata->pos[k] - g_bonetable[j].pos[k] ) / g_bonetable[j].posscale[k]; 
-							}
+							value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
+							// pre-scale pos delta since format only has room for "overall" weight
+							float r = panim->posweight[j] / panim->weight[j];
+							value[n] *= r;
+						}
+						else
+						{
+							value[n] = ( psrcdata->pos[k] - g_bonetable[j].pos[k] ) / g_bonetable[j].posscale[k]; 
+						}
 
-							checkmin[k] = min( value[n] * g_bonetable[j].posscale[k], checkmin[k] );
-							checkmax[k] = max( value[n] * g_bonetable[j].posscale[k], checkmax[k] );
-							break;
-						case 3: /* X Rotation */
-						case 4: /* Y Rotation */
-						case 5: /* Z Rotation */
-							if (panim->flags & STUDIO_DELTA)
-							{
-								v = psrcdata->rot[k-3]; 
-							}
-							else
-							{
-								v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
-							}
+						checkmin[k] = min( value[n] * g_bonetable[j].posscale[k], checkmin[k] );
+						checkmax[k] = max( value[n] * g_bonetable[j].posscale[k], checkmax[k] );
+						break;
+					case 3: /* X Rotation */
+					case 4: /* Y Rotation */
+					case 5: /* Z Rotation */
+						if (panim->flags & STUDIO_DELTA)
+						{
+							v = psrcdata->rot[k-3]; 
+						}
+						else
+						{
+							v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
+						}
 
-							while (v >= M_PI)
-								v -= M_PI * 2;
-							while (v < -M_PI)
-								v += M_PI * 2;
+						while (v >= M_PI)
+							v -= M_PI * 2;
+						while (v < -M_PI)
+							v += M_PI * 2;
 
-							checkmin[k] = min( v, checkmin[k] );
-							checkmax[k] = max( v, checkmax[k] );
-							value[n] = v / g_bonetable[j].rotscale[k-3]; 
-							break;
-						}
+						checkmin[k] = min( v, checkmin[k] );
+						checkmax[k] = max( v, checkmax[k] );
+						value[n] = v / g_bonetable[j].rotscale[k-3]; 
+						break;
 					}
-					if (n == 0)
-						MdlError("no animation frames: \"%s\"\n", psource->filename );
+				}
+				if (n == 0)
+					MdlError("no animation frames: \"%s\"\n", psource->filename );
 
-					// FIXME: this compression algorithm needs work
+				// FIXME: this compression algorithm needs work
 
-					// initialize animation RLE block
-					memset( data, 0, sizeof( data ) ); 
-					pcount = data; 
-					pvalue = pcount + 1;
+				// initialize animation RLE block
+				memset( data, 0, sizeof( data ) ); 
+				pcount = data; 
+				pvalue = pcount + 1;
 
-					pcount->num.valid = 1;
-					pcount->num.total = 1;
-					pvalue->value = value[0];
-					pvalue++;
+				pcount->num.valid = 1;
+				pcount->num.total = 1;
+				pvalue->value = value[0];
+				pvalue++;
 
-					// build a RLE of deltas from the default pose
-					for (m = 1; m < n; m++)
+				// build a RLE of deltas from the default pose
+				for (m = 1; m < n; m++)
+				{
+					if (pcount->num.total == 255)
+					{
+						// chain too long, force a new entry
+						pcount = pvalue;
+						pvalue = pcount + 1;
+						pcount->num.valid++;
+						pvalue->value = value[m];
+						pvalue++;
+					} 
+					// insert value if they're not equal, 
+					// or if we're not on a run and the run is less than 3 units
+					else if ((value[m] != value[m-1]) 
+						|| ((pcount->num.total == pcount->num.valid) && ((m < n - 1) && value[m] != value[m+1])))
 					{
-						if (pcount->num.total == 255)
+						if (pcount->num.total != pcount->num.valid)
 						{
-							// chain too long, force a new entry
+							//if (j == 0) printf("%d:%d   ", pcount->num.valid, pcount->num.total ); 
 							pcount = pvalue;
 							pvalue = pcount + 1;
-							pcount->num.valid++;
-							pvalue->value = value[m];
-							pvalue++;
-						} 
-						// insert value if they're not equal, 
-						// or if we're not on a run and the run is less than 3 units
-						else if ((value[m] != value[m-1]) 
-							|| ((pcount->num.total == pcount->num.valid) && ((m < n - 1) && value[m] != value[m+1])))
-						{
-							if (pcount->num.total != pcount->num.valid)
-							{
-								//if (j == 0) printf("%d:%d   ", pcount->num.valid, pcount->num.total ); 
-								pcount = pvalue;
-								pvalue = pcount + 1;
-							}
-							pcount->num.valid++;
-							pvalue->value = value[m];
-							pvalue++;
 						}
-						pcount->num.total++;
+						pcount->num.valid++;
+						pvalue->value = value[m];
+						pvalue++;
 					}
-					//if (j == 0) printf("%d:%d\n", pcount->num.valid, pcount->num.total ); 
+					pcount->num.total++;
+				}
+				//if (j == 0) printf("%d:%d\n", pcount->num.valid, pcount->num.total ); 
 
-					panim->anim[w][j].num[k] = pvalue - data;
-					if (panim->anim[w][j].num[k] == 2 && value[0] == 0)
-					{
-						panim->anim[w][j].num[k] = 0;
-					}
-					else
-					{
-						panim->anim[w][j].data[k] = (mstudioanimvalue_t *)kalloc( pvalue - data, sizeof( mstudioanimvalue_t ) );
-						memmove( panim->anim[w][j].data[k], data, (pvalue - data) * sizeof( mstudioanimvalue_t ) );
-					}
-					// printf("%d(%d) ", g_source[i]->panim[q]->numanim[j][k], n );
+				panim->anim[w][j].num[k] = pvalue - data;
+				if (panim->anim[w][j].num[k] == 2 && value[0] == 0)
+				{
+					panim->anim[w][j].num[k] = 0;
 				}
+				else
+				{
+					panim->anim[w][j].data[k] = (mstudioanimvalue_t *)kalloc( pvalue - data, sizeof( mstudioanimvalue_t ) );
+					memmove( panim->anim[w][j].data[k], data, (pvalue - data) * sizeof( mstudioanimvalue_t ) );
+				}
+				// printf("%d(%d) ", g_source[i]->panim[q]->numanim[j][k], n );
+			}
 
-				if (g_bCheckLengths)
+			if (g_bCheckLengths)
+			{
+				char *tmp[6] = { "X", "Y", "Z", "XR", "YR", "ZR" };
+				n = 0;
+				for (k = 0; k < 3; k++)
 				{
-					char *tmp[6] = { "X", "Y", "Z", "XR", "YR", "ZR" };
-					n = 0;
-					for (k = 0; k < 3; k++)
+					if (checkmin[k] != 0)
 					{
-						if (checkmin[k] != 0)
-						{
-							if (n == 0)
-								printf("%s :", g_bonetable[j].name );
-						
-							printf("%s(%.1f: %.1f %.1f) ", tmp[k], g_bonetable[j].pos[k], checkmin[k], checkmax[k] );
-							n = 1;
-						}
+						if (n == 0)
+							printf("%s :", g_bonetable[j].name );
+					
+						printf("%s(%.1f: %.1f %.1f) ", tmp[k], g_bonetable[j].pos[k], checkmin[k], checkmax[k] );
+						n = 1;
 					}
-					if (n)
-						printf("\n");
 				}
+				if (n)
+					printf("\n");
 			}
 		}
+	}
 
-		if (panim->numsections == 1)
+	if (panim->numsections == 1)
+	{
+		panim->sectionframes = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// CompressAnimations
+//-----------------------------------------------------------------------------
+
+static void CompressAnimations( )
+{
+	// find scales for all bones
+	ProcessItems( "CalcBoneAnimationScales", g_bonetable, g_numbones, &CalcBoneAnimationScales );
+
+	// reduce animations, -checklengths prints as it goes so keep it in order
+	if (g_bCheckLengths)
+	{
+		for (int i = 0; i < g_numani; i++)
 		{
-			panim->sectionframes = 0;
+			CompressAnimation( g_panimation[i] );
 		}
 	}
+	else
+	{
+		ProcessItems( "CompressAnimation", g_panimation, g_numani, &CompressAnimation );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -7522,48 +7705,48 @@ static void CompressSingle( s_animationstream_t *pStream )
 // Compress all the IK data
 //-----------------------------------------------------------------------------
 
-static void CompressIKErrors( )
+static void CompressAnimationIKErrors( s_animation_t *&panim )
 {
-	int i, j;
-
-	// find scales for all bones
-	for (i = 0; i < g_numani; i++)
+	for (int j = 0; j < panim->numikrules; j++)
 	{
-		for (j = 0; j < g_panimation[i]->numikrules; j++)
-		{
-			s_ikrule_t *pRule = &g_panimation[i]->ikrule[j];
+		s_ikrule_t *pRule = &panim->ikrule[j];
 
-			if (pRule->errorData.numerror == 0)
-				continue;
+		if (pRule->errorData.numerror == 0)
+			continue;
 
-			CompressSingle( &pRule->errorData );
-		}
+		CompressSingle( &pRule->errorData );
 	}
 }
 
+static void CompressIKErrors( )
+{
+	// find scales for all bones
+	ProcessItems( "CompressIKErrors", g_panimation, g_numani, &CompressAnimationIKErrors );
+}
+
 //-----------------------------------------------------------------------------
 // Compress all the Local Hierarchy data
 //-----------------------------------------------------------------------------
 
-static void CompressLocalHierarchy( )
+static void CompressAnimationLocalHierarchy( s_animation_t *&panim )
 {
-	int i, j;
-
-	// find scales for all bones
-	for (i = 0; i < g_numani; i++)
+	for (int j = 0; j < panim->numlocalhierarchy; j++)
 	{
-		for (j = 0; j < g_panimation[i]->numlocalhierarchy; j++)
-		{
-			s_localhierarchy_t *pRule = &g_panimation[i]->localhierarchy[j];
+		s_localhierarchy_t *pRule = &panim->localhierarchy[j];
 
-			if (pRule->localData.numerror == 0)
-				continue;
+		if (pRule->localData.numerror == 0)
+			continue;
 
-			CompressSingle( &pRule->localData );
-		}
+		CompressSingle( &pRule->localData );
 	}
 }
 
+static void CompressLocalHierarchy( )
+{
+	// find scales for all bones
+	ProcessItems( "CompressLocalHierarchy", g_panimation, g_numani, &CompressAnimationLocalHierarchy );
+}
+
 
 //-----------------------------------------------------------------------------
 // 
@@ -8118,7 +8301,10 @@ void SimplifyModel()
 
 	// have to load the lod sources before remapping bones so that the remap
 	// happens for all LODs.
-	LoadLODSources();
+	{
+		CPhaseTimer timer( "load lods" );
+		LoadLODSources();
+	}
 
 	RemapBones();
 
@@ -8156,7 +8342,10 @@ void SimplifyModel()
 	
 	// remap lods to root, building aggregate final pools
 	// mark bones used by an lod
-	UnifyLODs();
+	{
+		CPhaseTimer timer( "unify lods" );
+		UnifyLODs();
+	}
 	
 	if ( g_bPrintBones )
 	{
@@ -8172,9 +8361,13 @@ void SimplifyModel()
 	}
 	SpewBoneUsageStats();
 
-	RemapAnimations();
+	{
+		CPhaseTimer timer( "animations" );
+
+		RemapAnimations();
 
-	processAnimations();
+		processAnimations();
+	}
 
 	limitBoneRotations();
 
@@ -8206,11 +8399,18 @@ void SimplifyModel()
 
 	LockBoneLengths();
 
-	ProcessIKRules();
+	{
+		CPhaseTimer timer( "ik rules" );
+		ProcessIKRules();
+	}
 
-	CompressIKErrors( );
+	{
+		CPhaseTimer timer( "compress ik" );
 
-	CompressLocalHierarchy( );
+		CompressIKErrors( );
+
+		CompressLocalHierarchy( );
+	}
 
 	CalcPoseParameters();
 
@@ -8220,7 +8420,10 @@ void SimplifyModel()
 
 	SetupHitBoxes();
 
-	CompressAnimations( );
+	{
+		CPhaseTimer timer( "compress animations" );
+		CompressAnimations( );
+	}
 
 	CalcSequenceBoundingBoxes();
 
@@ -66,6 +66,7 @@
 #include "mdllib/mdllib.h"
 #include "perfstats.h"
 #include "worldsize.h"
+#include "vstdlib/jobthread.h"
 
 bool g_collapse_bones = false;
 bool g_collapse_bones_aggressive = false;
@@ -99,6 +100,8 @@ float g_flDefaultMotionRollback = 0.3f;
 int g_minSectionFrameLimit = 120;
 int g_sectionFrames = 30;
 bool g_bNoAnimblockStall = false;
+int g_nThreads = 1;
+bool g_bTimingReport = false;
 
 char g_path[MAX_PATH];
 Vector g_vecMinWorldspace = Vector( MIN_COORD_INTEGER, MIN_COORD_INTEGER, MIN_COORD_INTEGER );
@@ -337,7 +340,10 @@ void MdlError( const char *fmt, ... )
 void MdlWarning( const char *fmt, ... )
 {
 	va_list args;
-	static char output[1024];
+
+	// animations may be processed on several threads, keep each warning whole
+	static CThreadMutex s_WarningMutex;
+	AUTO_LOCK( s_WarningMutex );
 
 	if (g_bNoWarnings || g_maxWarnings == 0)
 		return;
@@ -478,7 +484,7 @@ void MdlExceptionFilter( unsigned long code )
 =================
 */
 
-int k_memtotal;
+CInterlockedInt k_memtotal;
 void *kalloc( int num, int size )
 {
 	// printf( "calloc( %d, %d )\n", num, size );
@@ -9449,6 +9455,8 @@ void UsageAndExit()
 		"[-quiet] - operate silently\n"
 		"[-r] - tag reversed\n"
 		"[-t <texture>]\n"
+		"[-threads <count>] - process animations on <count> threads, 0 for one per core (experimental, diff the output against a serial compile)\n"
+		"[-timing] - report the time spent in each compile stage\n"
 		"[-x360] - generate xbox360 output\n"
 		"[-nox360] - disable xbox360 output(default)\n"
 		"[-nowarnings] - disable warnings\n"
@@ -9767,6 +9775,22 @@ bool CStudioMDLApp::ParseArguments()
 			continue;
 		}
 
+		if ( !Q_stricmp( pArgv, "-timing" ) )
+		{
+			g_bTimingReport = true;
+			continue;
+		}
+
+		if ( !Q_stricmp( pArgv, "-threads" ) )
+		{
+			g_nThreads = atoi( CommandLine()->GetParm( ++i ) );
+			if ( g_nThreads <= 0 )
+			{
+				g_nThreads = GetCPUInformation()->m_nLogicalProcessors;
+			}
+			continue;
+		}
+
 		if ( !Q_stricmp( pArgv, "-printgraph" ) )
 		{
 			g_bDumpGraph = true;
@@ -10078,35 +10102,60 @@ int CStudioMDLApp::Main()
 	g_ScriptLODs.AddToTail(); // add an empty one
 	g_ScriptLODs[0].switchValue = 0.0f;
 	
+	if ( g_nThreads > 1 )
+	{
+		ThreadPoolStartParams_t startParams;
+		startParams.nThreads = g_nThreads;
+		g_pThreadPool->Start( startParams, "StudioMDL" );
+	}
+
 	//
 	// parse it
 	//
 	ClearModel();
 
-//	V_strcpy_safe( g_pPlatformName, "" );
-	if ( pMDLMakeFile )
-	{
-		ParseMDLMakeFile( pMDLMakeFile );
-	}
-	else
 	{
-		ParseScript();
+		CPhaseTimer timer( "parse" );
+
+//		V_strcpy_safe( g_pPlatformName, "" );
+		if ( pMDLMakeFile )
+		{
+			ParseMDLMakeFile( pMDLMakeFile );
+		}
+		else
+		{
+			ParseScript();
+		}
 	}
 
 	if ( !g_bCreateMakefile )
 	{
 		SetSkinValues();
 
-		SimplifyModel();
+		{
+			CPhaseTimer timer( "simplify" );
+			SimplifyModel();
+		}
 
 		ConsistencyCheckSurfaceProp();
 		ConsistencyCheckContents();
 
-		CollisionModel_Build();
+		{
+			CPhaseTimer timer( "collision" );
+			CollisionModel_Build();
+		}
 
 		// ValidateSharedAnimationGroups();
 
-		WriteModelFiles();
+		{
+			CPhaseTimer timer( "write" );
+			WriteModelFiles();
+		}
+	}
+
+	if ( g_nThreads > 1 )
+	{
+		g_pThreadPool->Stop();
 	}
 
 	if ( pMDLMakeFile )
@@ -10125,6 +10174,11 @@ int CStudioMDLApp::Main()
 		Main_MakeVsi();
 	}
 
+	if ( g_bTimingReport )
+	{
+		PrintPhaseTimes( "Stage times", g_nThreads );
+	}
+
 	if (!g_quiet)
 	{
 		printf("\nCompleted \"%s\"\n", g_path);
@@ -23,6 +23,7 @@
 #include "studio.h"
 #include "datamodel/dmelementhandle.h"
 #include "checkuv.h"
+#include "phasetimer.h"
 
 struct LodScriptData_t;
 struct s_flexkey_t;
@@ -1574,6 +1575,8 @@ extern float g_flDefaultMotionRollback;
 extern int g_minSectionFrameLimit;
 extern int g_sectionFrames;
 extern bool g_bNoAnimblockStall;
+extern int g_nThreads;
+extern bool g_bTimingReport;
 
 extern Vector g_vecMinWorldspace;
 extern Vector g_vecMaxWorldspace;
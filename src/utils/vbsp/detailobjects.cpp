@@ -100,6 +100,40 @@ static CUtlVector<DetailObjectLump_t>		s_DetailObjectLump;
 static CUtlVector<DetailSpriteDictLump_t>	s_DetailSpriteDictLump;
 
 
+//-----------------------------------------------------------------------------
+// Details are placed on the faces on several threads, and added to the lump
+// afterwards in face order. Each face gets its own random numbers seeded with
+// its hammer face id, so the placement doesn't depend on the thread count.
+//-----------------------------------------------------------------------------
+struct DetailPlacement_t
+{
+	const DetailModel_t *m_pModel;
+	Vector	m_Origin;
+	QAngle	m_Angles;
+	int		m_nScaleDraw;		// which of the face's gaussian draws scales the sprite, or -1
+};
+
+struct DetailFace_t
+{
+	int				m_nFace;
+	DetailObject_t	*m_pDetail;
+	unsigned int	m_nRandHold;	// state of Rand()
+	int				m_nScaleDraws;
+	CUtlVector< DetailPlacement_t >	m_Placements;
+	CUtlVector< float >	m_ScaleGaussians;
+
+	// Same sequence as the MSVC CRT rand() after srand( hammer face id ),
+	// which is what the details used to be placed with
+	int Rand()
+	{
+		m_nRandHold = m_nRandHold * 214013 + 2531011;
+		return ( m_nRandHold >> 16 ) & VALVE_RAND_MAX;
+	}
+};
+
+static CUtlVector<DetailFace_t>	s_DetailFaces;
+
+
 //-----------------------------------------------------------------------------
 // Parses the key-value pairs in the detail.rad file
 //-----------------------------------------------------------------------------
@@ -319,7 +353,7 @@ void LoadEmitDetailObjectDictionary( const char* pGameDir )
 //-----------------------------------------------------------------------------
 // Selects a detail group
 //-----------------------------------------------------------------------------
-static int SelectGroup( const DetailObject_t& detail, float alpha )
+static int SelectGroup( DetailFace_t& face, const DetailObject_t& detail, float alpha )
 {
 	// Find the two groups whose alpha we're between...
 	int start, end;
@@ -345,7 +379,7 @@ static int SelectGroup( const DetailObject_t& detail, float alpha )
 	}
 
 	// Pick a number, any number...
-	float r = rand() / (float)VALVE_RAND_MAX;
+	float r = face.Rand() / (float)VALVE_RAND_MAX;
 
 	// When dist == 0, we *always* want start.
 	// When dist == 1, we *always* want end
@@ -357,10 +391,10 @@ static int SelectGroup( const DetailObject_t& detail, float alpha )
 //-----------------------------------------------------------------------------
 // Selects a detail object
 //-----------------------------------------------------------------------------
-static int SelectDetail( DetailObjectGroup_t const& group )
+static int SelectDetail( DetailFace_t& face, DetailObjectGroup_t const& group )
 {
 	// Pick a number, any number...
-	float r = rand() / (float)VALVE_RAND_MAX;
+	float r = face.Rand() / (float)VALVE_RAND_MAX;
 
 	// Look through the list of models + pick the one associated with this number
 	for ( int i = 0; i < group.m_Models.Count(); ++i )
@@ -545,7 +579,7 @@ static void AddDetailSpriteToLump( const Vector &vecOrigin, const QAngle &vecAng
 // (only when not in the debugger?)
 // Printing the values of normal at the bottom of the function fixes it as does
 // disabling global optimizations.
-static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vector& normal )
+static void PlaceDetail( DetailFace_t& face, DetailModel_t const& model, const Vector& pt, const Vector& normal )
 {
 	// But only place it on the surface if it meets the angle constraints...
 	float cosAngle = normal.z;
@@ -560,7 +594,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 		float probability = (cosAngle - model.m_MaxCosAngle) / 
 			(model.m_MinCosAngle - model.m_MaxCosAngle);
 
-		float t = rand() / (float)VALVE_RAND_MAX;
+		float t = face.Rand() / (float)VALVE_RAND_MAX;
 		if (t > probability)
 			return;
 	}
@@ -570,7 +604,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 	if (model.m_Flags & MODELFLAG_UPRIGHT)
 	{
 		// If it's upright, we just select a random yaw
-		angles.Init( 0, 360.0f * rand() / (float)VALVE_RAND_MAX, 0.0f );
+		angles.Init( 0, 360.0f * face.Rand() / (float)VALVE_RAND_MAX, 0.0f );
 	}
 	else
 	{
@@ -594,7 +628,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 		matrix.SetBasisVectors( xaxis, yaxis, zaxis );
 		matrix.SetTranslation( vec3_origin );
 
-		float rotAngle = 360.0f * rand() / (float)VALVE_RAND_MAX;
+		float rotAngle = 360.0f * face.Rand() / (float)VALVE_RAND_MAX;
 		VMatrix rot = SetupMatrixAxisRot( Vector( 0, 0, 1 ), rotAngle );
 		matrix = matrix * rot;
 
@@ -603,26 +637,16 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 
 	// FIXME: We may also want a purely random rotation too
 
-	// Insert an element into the object dictionary if it aint there...
-	switch ( model.m_Type )
-	{
-	case DETAIL_PROP_TYPE_MODEL:
-		AddDetailToLump( model.m_ModelName.String(), pt, angles, model.m_Orientation );
-		break;
-
-	// Sprites and procedural models made from sprites
-	case DETAIL_PROP_TYPE_SPRITE:
-	default:
-		{
-			float flScale = 1.0f;
-			if ( model.m_flRandomScaleStdDev != 0.0f ) 
-			{
-				flScale = fabs( RandomGaussianFloat( 1.0f, model.m_flRandomScaleStdDev ) );
-			}
+	DetailPlacement_t &placement = face.m_Placements[ face.m_Placements.AddToTail() ];
+	placement.m_pModel = &model;
+	placement.m_Origin = pt;
+	placement.m_Angles = angles;
+	placement.m_nScaleDraw = -1;
 
-			AddDetailSpriteToLump( pt, angles, model, flScale );
-		}
-		break;
+	// Sprites and procedural models made from sprites get a random scale
+	if ( model.m_Type != DETAIL_PROP_TYPE_MODEL && model.m_flRandomScaleStdDev != 0.0f )
+	{
+		placement.m_nScaleDraw = face.m_nScaleDraws++;
 	}
 }
 
@@ -630,7 +654,7 @@ static void PlaceDetail( DetailModel_t const& model, const Vector& pt, const Vec
 //-----------------------------------------------------------------------------
 // Places Detail Objects on a face
 //-----------------------------------------------------------------------------
-static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
+static void EmitDetailObjectsOnFace( DetailFace_t& face, dface_t* pFace, DetailObject_t& detail )
 {
 	if (pFace->numedges < 3)
 		return;
@@ -666,8 +690,8 @@ static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
 		for (int i = 0; i < numSamples; ++i )
 		{
 			// Create a random sample...
-			float u = rand() / (float)VALVE_RAND_MAX;
-			float v = rand() / (float)VALVE_RAND_MAX;
+			float u = face.Rand() / (float)VALVE_RAND_MAX;
+			float v = face.Rand() / (float)VALVE_RAND_MAX;
 			if (v > 1.0f - u)
 			{
 				u = 1.0f - u;
@@ -679,10 +703,10 @@ static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
 			float alpha = 1.0f;
 
 			// Select a group based on the alpha value
-			int group = SelectGroup( detail, alpha );
+			int group = SelectGroup( face, detail, alpha );
 
 			// Now that we've got a group, choose a detail
-			int model = SelectDetail( detail.m_Groups[group] );
+			int model = SelectDetail( face, detail.m_Groups[group] );
 			if (model < 0)
 				continue;
 
@@ -692,7 +716,7 @@ static void EmitDetailObjectsOnFace( dface_t* pFace, DetailObject_t& detail )
 			VectorMA( pt, v, e2, pt );
 			VectorDivide( areaVec, -normalLength, normal );
 
-			PlaceDetail( detail.m_Groups[group].m_Models[model], pt, normal );
+			PlaceDetail( face, detail.m_Groups[group].m_Models[model], pt, normal );
 		}
 	}
 }
@@ -734,7 +758,7 @@ static float ComputeDisplacementFaceArea( dface_t* pFace )
 //-----------------------------------------------------------------------------
 // Places Detail Objects on a face
 //-----------------------------------------------------------------------------
-static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace, 
+static void EmitDetailObjectsOnDisplacementFace( DetailFace_t& face, dface_t* pFace, 
 						DetailObject_t& detail, CCoreDispInfo& coreDispInfo )
 {
 	assert(pFace->numedges == 4);
@@ -752,8 +776,8 @@ static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace,
 	for (int i = 0; i < numSamples; ++i )
 	{
 		// Create a random sample...
-		float u = rand() / (float)VALVE_RAND_MAX;
-		float v = rand() / (float)VALVE_RAND_MAX;
+		float u = face.Rand() / (float)VALVE_RAND_MAX;
+		float v = face.Rand() / (float)VALVE_RAND_MAX;
 
 		// Compute alpha
 		float alpha;
@@ -762,15 +786,15 @@ static void EmitDetailObjectsOnDisplacementFace( dface_t* pFace,
 		alpha /= 255.0f;
 
 		// Select a group based on the alpha value
-		int group = SelectGroup( detail, alpha );
+		int group = SelectGroup( face, detail, alpha );
 
 		// Now that we've got a group, choose a detail
-		int model = SelectDetail( detail.m_Groups[group] );
+		int model = SelectDetail( face, detail.m_Groups[group] );
 		if (model < 0)
 			continue;
 
 		// Got a detail! Place it on the surface...
-		PlaceDetail( detail.m_Groups[group].m_Models[model], pt, normal );
+		PlaceDetail( face, detail.m_Groups[group].m_Models[model], pt, normal );
 	}
 }
 
@@ -832,16 +856,111 @@ static void SetLumpData( )
 //-----------------------------------------------------------------------------
 // Places Detail Objects in the level
 //-----------------------------------------------------------------------------
-void EmitDetailModels()
+static void PlaceDetailObjectsOnFace_Thread( int iThread, int nDetailFace )
 {
-	StartPacifier("Placing detail props : ");
+	DetailFace_t &face = s_DetailFaces[nDetailFace];
+	dface_t *pFace = &dfaces[face.m_nFace];
 
-	// Place stuff on each face
+	if (pFace->dispinfo < 0)
+	{
+		EmitDetailObjectsOnFace( face, pFace, *face.m_pDetail );
+	}
+	else
+	{
+		// Get a CCoreDispInfo. All we need is the triangles and lightmap texture coordinates.
+		mapdispinfo_t *pMapDisp = &mapdispinfo[pFace->dispinfo];
+		CCoreDispInfo coreDispInfo;
+		DispMapToCoreDispInfo( pMapDisp, &coreDispInfo, NULL, NULL );
+
+		EmitDetailObjectsOnDisplacementFace( face, pFace, *face.m_pDetail, coreDispInfo );
+	}
+
+	// The sprite scales come from the global gaussian stream, reseeded for every face
+	// along with rand(). Draw one more than the face used, since the stream can carry
+	// a value over from the face before (see AddDetailFaceToLump).
+	if ( face.m_nScaleDraws > 0 )
+	{
+		CUniformRandomStream uniformStream;
+		uniformStream.SetSeed( dfaceids[face.m_nFace].hammerfaceid );
+		CGaussianRandomStream gaussianStream( &uniformStream );
+
+		face.m_ScaleGaussians.EnsureCapacity( face.m_nScaleDraws + 1 );
+		for ( int i = 0; i <= face.m_nScaleDraws; ++i )
+		{
+			face.m_ScaleGaussians.AddToTail( gaussianStream.RandomFloat() );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds the details placed on a face to the lump. The gaussian stream keeps the
+// second value of every pair it makes for its next draw, even across faces, so
+// the scales are picked here in face order with that value passed along.
+//-----------------------------------------------------------------------------
+static void AddDetailFaceToLump( const DetailFace_t &face, bool &bHaveCarriedScale, float &flCarriedScale )
+{
+	for ( int i = 0; i < face.m_Placements.Count(); ++i )
+	{
+		const DetailPlacement_t &placement = face.m_Placements[i];
+		const DetailModel_t &model = *placement.m_pModel;
+
+		// Insert an element into the object dictionary if it aint there...
+		switch ( model.m_Type )
+		{
+		case DETAIL_PROP_TYPE_MODEL:
+			AddDetailToLump( model.m_ModelName.String(), placement.m_Origin, placement.m_Angles, model.m_Orientation );
+			break;
+
+		// Sprites and procedural models made from sprites
+		case DETAIL_PROP_TYPE_SPRITE:
+		default:
+			{
+				float flScale = 1.0f;
+				if ( placement.m_nScaleDraw >= 0 ) 
+				{
+					int nDraw = placement.m_nScaleDraw;
+					float flGaussian;
+					if ( bHaveCarriedScale )
+					{
+						flGaussian = ( nDraw == 0 ) ? flCarriedScale : face.m_ScaleGaussians[nDraw - 1];
+					}
+					else
+					{
+						flGaussian = face.m_ScaleGaussians[nDraw];
+					}
+					flScale = fabs( model.m_flRandomScaleStdDev * flGaussian + 1.0f );
+				}
+
+				AddDetailSpriteToLump( placement.m_Origin, placement.m_Angles, model, flScale );
+			}
+			break;
+		}
+	}
+
+	if ( face.m_nScaleDraws > 0 )
+	{
+		// A pair is left half used when an odd number of draws came from this face's seed
+		int nFreshDraws = bHaveCarriedScale ? face.m_nScaleDraws - 1 : face.m_nScaleDraws;
+		bHaveCarriedScale = ( nFreshDraws & 1 ) != 0;
+		if ( bHaveCarriedScale )
+		{
+			flCarriedScale = face.m_ScaleGaussians[nFreshDraws];
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Places Detail Objects in the level
+//-----------------------------------------------------------------------------
+void EmitDetailModels()
+{
+	// Find the faces with detail objects on them. The material lookups aren't
+	// thread safe, so this part stays serial.
 	dface_t* pFace = dfaces;
 	for (int j = 0; j < numfaces; ++j)
 	{
-		UpdatePacifier( (float)j / (float)numfaces );
-
 		// Get at the material associated with this face
 		texinfo_t* pTexInfo = &texinfo[pFace[j].texinfo];
 		dtexdata_t* pTexData = GetTexData( pTexInfo->texdata );
@@ -871,31 +990,30 @@ void EmitDetailModels()
 			continue;
 		}
 
-		// Emit objects on a particular face
-		DetailObject_t& detail = s_DetailObjectDict[objectType];
-
 		// Initialize the Random Number generators for detail prop placement based on the hammer Face num.
 		int	detailpropseed = dfaceids[j].hammerfaceid;
 #ifdef WARNSEEDNUMBER
 		Warning( "[%d]\n",detailpropseed );
 #endif
-		srand( detailpropseed );
-		RandomSeed( detailpropseed );
 
-		if (pFace[j].dispinfo < 0)
-		{
-			EmitDetailObjectsOnFace( &pFace[j], detail );
-		}
-		else
-		{
-			// Get a CCoreDispInfo. All we need is the triangles and lightmap texture coordinates.
-			mapdispinfo_t *pMapDisp = &mapdispinfo[pFace[j].dispinfo];
-			CCoreDispInfo coreDispInfo;
-			DispMapToCoreDispInfo( pMapDisp, &coreDispInfo, NULL, NULL );
+		// Emit objects on a particular face
+		DetailFace_t &face = s_DetailFaces[ s_DetailFaces.AddToTail() ];
+		face.m_nFace = j;
+		face.m_pDetail = &s_DetailObjectDict[objectType];
+		face.m_nRandHold = (unsigned int)detailpropseed;
+		face.m_nScaleDraws = 0;
+	}
 
-			EmitDetailObjectsOnDisplacementFace( &pFace[j], detail, coreDispInfo );
-		}
+	Msg( "Placing detail props : " );
+	RunJobsOnIndividual( s_DetailFaces.Count(), true, PlaceDetailObjectsOnFace_Thread );
+
+	bool bHaveCarriedScale = false;
+	float flCarriedScale = 0.0f;
+	for ( int i = 0; i < s_DetailFaces.Count(); ++i )
+	{
+		AddDetailFaceToLump( s_DetailFaces[i], bHaveCarriedScale, flCarriedScale );
 	}
+	s_DetailFaces.Purge();
 
 	// Emit specifically specified detail props
 	Vector origin;
@@ -944,8 +1062,6 @@ void EmitDetailModels()
 			continue;
 		}
 	}
-
-	EndPacifier( true );
 }
 
 
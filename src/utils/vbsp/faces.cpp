@@ -30,6 +30,7 @@
 #define	POINT_EPSILON		0.1
 #define	OFF_EPSILON			0.25
 
+// Faces are merged and subdivided on the job threads
 int	c_merge;
 int	c_subdivide;
 
@@ -797,10 +798,14 @@ face_t	*AllocFace (void)
 
 	f = (face_t*)malloc(sizeof(*f));
 	memset (f, 0, sizeof(*f));
+
+	// faces are allocated from several threads while the nodes are merged
+	ThreadLock();
 	f->id = s_FaceId;
 	++s_FaceId;
 
 	c_faces++;
+	ThreadUnlock();
 
 	return f;
 }
@@ -822,7 +827,10 @@ void FreeFace (face_t *f)
 	if (f->w)
 		FreeWinding (f->w);
 	free (f);
+
+	ThreadLock();
 	c_faces--;
+	ThreadUnlock();
 }
 
 
@@ -1107,7 +1115,7 @@ face_t *TryMerge (face_t *f1, face_t *f2, Vector& planenormal)
 	if (!nw)
 		return NULL;
 
-	c_merge++;
+	ThreadInterlockedIncrement( &c_merge );
 	newf = NewFaceFromFace (f1);
 	newf->w = nw;
 
@@ -1211,7 +1219,7 @@ void SubdivideFace (face_t **pFaceList, face_t *f)
 				break;
 			
 		// split it
-			c_subdivide++;
+			ThreadInterlockedIncrement( &c_subdivide );
 			
 			luxelsPerWorldUnit = VectorNormalize (temp);	
 
@@ -1293,6 +1301,10 @@ static bool AssignBottomWaterMaterialToFace( face_t *f )
 
 int	c_nodefaces;
 
+// non-leaf nodes with faces to merge and subdivide, once MakeFaces_r has
+// created every face
+static CUtlVector<node_t *> s_FaceNodes;
+
 static void SubdivideFaceBySubdivSize( face_t *f, float subdivsize );
 void SubdivideFaceBySubdivSize( face_t *f );
 
@@ -1423,11 +1435,8 @@ void MakeFaces_r (node_t *node)
 		MakeFaces_r (node->children[0]);
 		MakeFaces_r (node->children[1]);
 
-		// merge together all visible faces on the node
-		if (!nomerge)
-			MergeFaceList(&node->faces);
-		if (!nosubdiv)
-			SubdivideFaceList(&node->faces);
+		if (node->faces)
+			s_FaceNodes.AddToTail (node);
 
 		return;
 	}
@@ -1790,6 +1799,25 @@ void SplitSubdividedFaces( face_t *pLeafFaceList, node_t *headnode )
 
 #pragma optimize( "", on )
 
+/*
+============
+MergeNodeFaces_Thread
+
+Merges together all visible faces on the node. A node only
+holds faces from the portals on its own plane, so the nodes
+can be done in any order.
+============
+*/
+static void MergeNodeFaces_Thread (int iThread, int nodenum)
+{
+	node_t *node = s_FaceNodes[nodenum];
+
+	if (!nomerge)
+		MergeFaceList(&node->faces);
+	if (!nosubdiv)
+		SubdivideFaceList(&node->faces);
+}
+
 /*
 ============
 MakeFaces
@@ -1797,13 +1825,19 @@ MakeFaces
 */
 void MakeFaces (node_t *node)
 {
+	CPhaseTimer timer( "faces" );
+
 	qprintf ("--- MakeFaces ---\n");
 	c_merge = 0;
 	c_subdivide = 0;
 	c_nodefaces = 0;
 
+	// creating the faces stays in tree order, FaceFromPortal can add texinfos
 	MakeFaces_r (node);
 
+	RunJobsOnIndividual (s_FaceNodes.Count(), false, MergeNodeFaces_Thread);
+	s_FaceNodes.Purge();
+
 	qprintf ("%5i makefaces\n", c_nodefaces);
 	qprintf ("%5i merged\n", c_merge);
 	qprintf ("%5i subdivided\n", c_subdivide);
@@ -56,6 +56,8 @@ bool		g_NodrawTriggers = false;
 bool		g_DisableWaterLighting = false;
 bool		g_bAllowDetailCracks = false;
 bool		g_bNoVirtualMesh = false;
+bool		g_bTimingReport = false;
+int			g_nJobThreads = 1;
 
 float		g_defaultLuxelSize = DEFAULT_LUXEL_SIZE;
 float		g_luxelScale = 1.0f;
@@ -91,6 +93,19 @@ void AssignOccluderAreas( tree_t *pTree );
 static void Compute3DSkyboxAreas( node_t *headnode, CUtlVector<int>& areas );
 
 
+//-----------------------------------------------------------------------------
+// Runs a job on g_nJobThreads threads. The BSP itself is built on one thread
+// (numthreads), since splitting it across threads changes the plane numbering.
+//-----------------------------------------------------------------------------
+void RunJobsOnIndividual( int workcnt, qboolean showpacifier, ThreadWorkerFn fn )
+{
+	int nBSPThreads = numthreads;
+	numthreads = g_nJobThreads;
+	(RunThreadsOnIndividual)( workcnt, showpacifier, fn );
+	numthreads = nBSPThreads;
+}
+
+
 /*
 ============
 BlockTree
@@ -255,6 +270,8 @@ void ProcessWorldModel (void)
 
 	for (optimize = 0 ; optimize <= 1 ; optimize++)
 	{
+		CPhaseTimer timer( "bsp and portals" );
+
 		qprintf ("--------------------------------------------\n");
 
 		RunThreadsOnIndividual ((block_xh-block_xl+1)*(block_yh-block_yl+1),
@@ -337,9 +354,11 @@ void ProcessWorldModel (void)
 	face_t *pLeafFaceList = NULL;
 	if ( !nodetail )
 	{
+		CPhaseTimer timer( "detail brushes" );
 		pLeafFaceList = MergeDetailTree( tree, brush_start, brush_end );
 	}
 
+	CPhaseTimer writeTimer( "tjuncs and write" );
 	start = Plat_FloatTime();
 
 	Msg("FixTjuncs...\n");
@@ -825,11 +844,17 @@ void ProcessModels (void)
 	MarkNoDynamicShadowSides();
 
 	// emit the displacement surfaces
-	EmitInitialDispInfos();
+	{
+		CPhaseTimer timer( "displacements" );
+		EmitInitialDispInfos();
+	}
 
 	// Clip occluder brushes against each other, 
 	// Remove them from the list of models to process below
-	EmitOccluderBrushes( );
+	{
+		CPhaseTimer timer( "occluders" );
+		EmitOccluderBrushes( );
+	}
 
 	for ( entity_num=0; entity_num < num_entities; ++entity_num )
 	{
@@ -843,10 +868,12 @@ void ProcessModels (void)
 
 		if (entity_num == 0)
 		{
+			CPhaseTimer timer( "world model" );
 			ProcessWorldModel();
 		}
 		else
 		{
+			CPhaseTimer timer( "brush models" );
 			ProcessSubModel( );
 		}
 
@@ -915,6 +942,10 @@ int RunVBSP( int argc, char **argv )
 			numthreads = atoi (argv[i+1]);
 			i++;
 		}
+		else if (!Q_stricmp(argv[i], "-timing"))
+		{
+			g_bTimingReport = true;
+		}
 		else if (!Q_stricmp(argv[i],"-glview"))
 		{
 			glview = true;
@@ -1198,6 +1229,7 @@ int RunVBSP( int argc, char **argv )
 				"  -novconfig   : Don't bring up graphical UI on vproject errors.\n"
 				"  -threads     : Control the number of threads vbsp uses (defaults to the # of\n"
 				"                 processors on your machine).\n"
+				"  -timing      : Print how long each phase of the compile took.\n"
 				"  -verboseentities: If -v is on, this disables verbose output for submodels.\n"
 				"  -noweld      : Don't join face vertices together.\n"
 				"  -nocsg       : Don't chop out intersecting brush areas.\n"
@@ -1277,6 +1309,7 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
+	g_nJobThreads = numthreads;	// for RunJobsOnIndividual
 	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
@@ -1392,17 +1425,20 @@ int RunVBSP( int argc, char **argv )
 			AddBufferToPak( GetPakFile(), "stale.txt", "stale", strlen( "stale" ) + 1, false );
 		}
 
-		LoadMapFile (name);
-		WorldVertexTransitionFixup();
-		if( ( g_nDXLevel == 0 ) || ( g_nDXLevel >= 70 ) )
 		{
-			Cubemap_FixupBrushSidesMaterials();
-			Cubemap_AttachDefaultCubemapToSpecularSides();
-			Cubemap_AddUnreferencedCubemaps();
+			CPhaseTimer timer( "load map" );
+			LoadMapFile (name);
+			WorldVertexTransitionFixup();
+			if( ( g_nDXLevel == 0 ) || ( g_nDXLevel >= 70 ) )
+			{
+				Cubemap_FixupBrushSidesMaterials();
+				Cubemap_AttachDefaultCubemapToSpecularSides();
+				Cubemap_AddUnreferencedCubemaps();
+			}
+			SetModelNumbers ();
+			SetLightStyles ();
+			LoadEmitDetailObjectDictionary( gamedir );
 		}
-		SetModelNumbers ();
-		SetLightStyles ();
-		LoadEmitDetailObjectDictionary( gamedir );
 		ProcessModels ();
 
 		// Add embed dir if provided
@@ -1414,6 +1450,11 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	end = Plat_FloatTime();
+
+	if ( g_bTimingReport )
+	{
+		PrintPhaseTimes( "Phase times", g_nJobThreads );
+	}
 	
 	char str[512];
 	GetHourMinuteSecondsString( (int)( end - start ), str, sizeof( str ) );
@@ -15,6 +15,7 @@
 #include "scriplib.h"
 #include "polylib.h"
 #include "threads.h"
+#include "phasetimer.h"
 #include "bsplib.h"
 #include "qfiles.h"
 #include "utilmatlib.h"
@@ -365,12 +366,18 @@ extern	bool		g_NodrawTriggers;
 extern	bool		g_DisableWaterLighting;
 extern	bool		g_bAllowDetailCracks;
 extern	bool		g_bNoVirtualMesh;
+extern	bool		g_bTimingReport;
+extern	int			g_nJobThreads;
 extern	char		outbase[32];
 
 extern	char	source[1024];
 extern char		mapbase[ 64 ];
 extern CUtlVector<int> g_SkyAreas;
 
+// Like RunThreadsOnIndividual, but on g_nJobThreads threads. Only for work
+// that produces the same output whatever order the items run in.
+void	RunJobsOnIndividual( int workcnt, qboolean showpacifier, ThreadWorkerFn fn );
+
 bool 	LoadMapFile( const char *pszFileName );
 int		GetVertexnum( Vector& v );
 bool Is3DSkyboxArea( int area );
@@ -1250,24 +1250,39 @@ void EndBSPFile (void)
 	UpdateAllFaceLightmapExtents();
 
 	// Generate geometry and lightmap alpha for displacements.
-	EmitDispLMAlphaAndNeighbors();
+	{
+		CPhaseTimer timer( "displacements" );
+		EmitDispLMAlphaAndNeighbors();
+	}
 
 	// Emit overlay data.
-	Overlay_EmitOverlayFaces();
-	OverlayTransition_EmitOverlayFaces();
+	{
+		CPhaseTimer timer( "overlays" );
+		Overlay_EmitOverlayFaces();
+		OverlayTransition_EmitOverlayFaces();
+	}
 
 	// phys collision needs dispinfo to operate (needs to generate phys collision for displacement surfs)
-	EmitPhysCollision();
+	{
+		CPhaseTimer timer( "physics collision" );
+		EmitPhysCollision();
+	}
 
 	// We can't calculate this properly until vvis (since we need vis to do this), so we set
 	// to zero everywhere by default.
 	ClearDistToClosestWater();
 
 	// Emit static props found in the .vmf file
-	EmitStaticProps();
+	{
+		CPhaseTimer timer( "static props" );
+		EmitStaticProps();
+	}
 
 	// Place detail props found in .vmf and based on material properties
-	EmitDetailObjects();
+	{
+		CPhaseTimer timer( "detail props" );
+		EmitDetailObjects();
+	}
 
 	// Compute bounds after creating disp info because we need to reference it
 	ComputeBoundsNoSkybox();
@@ -1288,6 +1303,8 @@ void EndBSPFile (void)
 	V_strncpy( fileName, source, sizeof( fileName ) );
 	V_DefaultExtension( fileName, ".bsp", sizeof( fileName ) );
 	Msg ("Writing %s\n", fileName);
+
+	CPhaseTimer timer( "write bsp" );
 	WriteBSPFile (fileName);
 }
 
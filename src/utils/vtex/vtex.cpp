@@ -46,6 +46,7 @@
 #include "p4lib/ip4.h"
 
 #include "tier1/checksum_crc.h"
+#include "vstdlib/jobthread.h"
 
 #define FF_TRYAGAIN 1
 #define FF_DONTPROCESS 2
@@ -72,6 +73,7 @@ static bool g_bUsedAsLaunchableDLL = false;
 
 static bool g_bNoTga = false;
 static bool g_bNoPsd = false;
+static bool g_bImageLoaderCompress = false;
 
 static char g_ForcedOutputDir[MAX_PATH];
 
@@ -1889,7 +1891,7 @@ bool ProcessFiles( const char *pFullNameWithoutExtension,
 	}
 
 	// Convert to the final format
-	pVTFTexture->ConvertImageFormat( vtfImageFormat, info.m_bNormalToDuDv );
+	pVTFTexture->ConvertImageFormat( vtfImageFormat, info.m_bNormalToDuDv, g_bImageLoaderCompress );
 
 	// Stage 2 of matching cubemap borders.
 	pVTFTexture->MatchCubeMapBorders( 2, vtfImageFormat, info.m_bSkyBox );
@@ -2253,6 +2255,8 @@ void Usage( void )
 		"-quickconvert     : use with \"-nop4 -dontusegamedir -quickconvert\" to upgrade old .vmt files\n"
 		"-crcvalidate      : validate .vmt against the sources\n"
 		"-crcforce         : generate a new .vmt even if sources crc matches\n"
+		"-imageloader      : compress with the old ImageLoader compressors instead of the native encoder\n"
+		"-threads <n>      : number of worker threads for compression and mip generation (default: one per core)\n"
 		"\teg: -vmtparam $ignorez 1 -vmtparam $translucent 1\n"
 		"Note that you can use wildcards and that you can also chain them\n"
 		"e.g. materialsrc/monster1/*.tga materialsrc/monster2/*.tga\n" );
@@ -2718,6 +2722,16 @@ int CVTex::VTex( int argc, char **argv )
 			i++;
 			g_bNoTga = true;
 		}
+		else if ( stricmp( argv[i], "-imageloader" ) == 0 )
+		{
+			i++;
+			g_bImageLoaderCompress = true;
+		}
+		else if ( stricmp( argv[i], "-threads" ) == 0 )
+		{
+			// read through CommandLine() when the thread pool starts
+			i += 2;
+		}
 		else if ( stricmp( argv[i], "-nomkdir" ) == 0 ) 
 		{
 			i++;
@@ -2906,6 +2920,16 @@ int CVTex::VTex( int argc, char **argv )
 		}
 	}
 
+	// BCn compression and mip resampling split their work with ParallelProcess, which
+	// runs inline until the pool has threads. A host that loaded us may own the pool.
+	bool bStartedThreadPool = false;
+	if ( !g_pThreadPool->NumThreads() )
+	{
+		ThreadPoolStartParams_t startParams;
+		startParams.nThreads = CommandLine()->ParmValue( "-threads", -1 );
+		bStartedThreadPool = g_pThreadPool->Start( startParams, "VTex" );
+	}
+
 	// Parse args
 	for( ; i < argc; i++ )
 	{
@@ -2969,6 +2993,11 @@ int CVTex::VTex( int argc, char **argv )
 
 	}
 	
+	if ( bStartedThreadPool )
+	{
+		g_pThreadPool->Stop();
+	}
+
 	// Shutdown P4
 	if ( g_bUsedAsLaunchableDLL && p4 && !CommandLine()->FindParm( "-p4skip" ) )
 	{
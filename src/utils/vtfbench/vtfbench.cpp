@@ -0,0 +1,440 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures BC texture compression throughput and quality. Compares
+//			ImageLoader's compressors with the native encoder in the vtf
+//			library, both serially and through CVTFTexture::ConvertImageFormat
+//			on the thread pool. With -mipmaps, measures mip chain generation
+//			against the RESAMPLE_REFERENCE filter instead.
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mathlib/mathlib.h"
+#include "bitmap/imageformat.h"
+#include "tier0/dbg.h"
+#include "tier0/icommandline.h"
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+#include "tier2/tier2.h"
+#include "vstdlib/jobthread.h"
+#include "vtf/bcn_codec.h"
+#include "vtf/vtf.h"
+#include "filesystem.h"
+
+
+static const ImageFormat s_pBenchFormats[] =
+{
+	IMAGE_FORMAT_DXT1,
+	IMAGE_FORMAT_DXT5,
+	IMAGE_FORMAT_ATI1N,
+	IMAGE_FORMAT_ATI2N,
+};
+
+SpewRetval_t VTFBenchOutputFunc( SpewType_t spewType, char const *pMsg )
+{
+	printf( "%s", pMsg );
+	fflush( stdout );
+
+	if (spewType == SPEW_ERROR)
+		return SPEW_ABORT;
+	return (spewType == SPEW_ASSERT) ? SPEW_DEBUGGER : SPEW_CONTINUE;
+}
+
+static void Usage( void )
+{
+	Error( "Usage: vtfbench [-format dxt1|dxt5|ati1n|ati2n] [-mipmaps] [-threads <n>] [-iterations <n>] [-synthetic <w>x<h>] [file.vtf ...]\n" );
+	exit( -1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Source textures, always RGBA8888 with a full mip chain
+//-----------------------------------------------------------------------------
+static IVTFTexture *CreateSyntheticTexture( int nWidth, int nHeight )
+{
+	IVTFTexture *pTex = CreateVTFTexture();
+	if ( !pTex->Init( nWidth, nHeight, 1, IMAGE_FORMAT_RGBA8888, TEXTUREFLAGS_EIGHTBITALPHA, 1 ) )
+	{
+		DestroyVTFTexture( pTex );
+		return NULL;
+	}
+
+	// Smooth gradients with a little noise, hard edged blocks in blue and an
+	// alpha ramp; roughly what photographic and painted textures look like
+	unsigned char *pData = pTex->ImageData( 0, 0, 0 );
+	unsigned int nSeed = 1;
+	for ( int y = 0; y < nHeight; ++y )
+	{
+		for ( int x = 0; x < nWidth; ++x, pData += 4 )
+		{
+			float fx = (float)x / nWidth;
+			float fy = (float)y / nHeight;
+			nSeed = nSeed * 1103515245 + 12345;
+			int nNoise = (int)( ( nSeed >> 16 ) % 9 ) - 4;
+
+			pData[0] = (unsigned char)clamp( (int)( 127 + 120 * sinf( fx * 20 + fy * 7 ) ) + nNoise, 0, 255 );
+			pData[1] = (unsigned char)clamp( (int)( 127 + 100 * cosf( fy * 13 ) ) - nNoise, 0, 255 );
+			pData[2] = ( ( ( x / 37 ) ^ ( y / 23 ) ) & 1 ) ? 200 : 40;
+			pData[3] = (unsigned char)( 255 * fx );
+		}
+	}
+
+	pTex->GenerateMipmaps();
+	return pTex;
+}
+
+static IVTFTexture *LoadTexture( const char *pFileName )
+{
+	CUtlBuffer buf;
+	if ( !g_pFullFileSystem->ReadFile( pFileName, NULL, buf ) )
+	{
+		Warning( "Can't open %s\n", pFileName );
+		return NULL;
+	}
+
+	IVTFTexture *pTex = CreateVTFTexture();
+	if ( !pTex->Unserialize( buf ) )
+	{
+		Warning( "*** Error reading in .VTF file %s\n", pFileName );
+		DestroyVTFTexture( pTex );
+		return NULL;
+	}
+
+	pTex->ConvertImageFormat( IMAGE_FORMAT_RGBA8888, false );
+	return pTex;
+}
+
+static IVTFTexture *CloneTexture( IVTFTexture *pSrc )
+{
+	IVTFTexture *pTex = CreateVTFTexture();
+	pTex->Init( pSrc->Width(), pSrc->Height(), pSrc->Depth(), pSrc->Format(), pSrc->Flags(), pSrc->FrameCount(), pSrc->MipCount() );
+	memcpy( pTex->ImageData(), pSrc->ImageData(), pSrc->ComputeTotalSize() );
+	return pTex;
+}
+
+static int64 CountPixels( IVTFTexture *pTex )
+{
+	int64 nPixels = 0;
+	for ( int iMip = 0; iMip < pTex->MipCount(); ++iMip )
+	{
+		int nMipWidth, nMipHeight, nMipDepth;
+		pTex->ComputeMipLevelDimensions( iMip, &nMipWidth, &nMipHeight, &nMipDepth );
+		nPixels += (int64)nMipWidth * nMipHeight * nMipDepth;
+	}
+	return nPixels * pTex->FrameCount() * pTex->FaceCount();
+}
+
+
+//-----------------------------------------------------------------------------
+// Compresses every image of pSrc to fmt into pDst, laid out like the vtf
+// would lay it out. Returns false if the compressor doesn't support fmt.
+//-----------------------------------------------------------------------------
+static bool CompressSerial( IVTFTexture *pSrc, ImageFormat fmt, unsigned char *pDst, bool bNative )
+{
+	for ( int iFrame = 0; iFrame < pSrc->FrameCount(); ++iFrame )
+	{
+		for ( int iFace = 0; iFace < pSrc->FaceCount(); ++iFace )
+		{
+			for ( int iMip = 0; iMip < pSrc->MipCount(); ++iMip )
+			{
+				int nMipWidth, nMipHeight, nMipDepth;
+				pSrc->ComputeMipLevelDimensions( iMip, &nMipWidth, &nMipHeight, &nMipDepth );
+				int nSrcSliceSize = ImageLoader::GetMemRequired( nMipWidth, nMipHeight, 1, IMAGE_FORMAT_RGBA8888, false );
+				int nDstSliceSize = ImageLoader::GetMemRequired( nMipWidth, nMipHeight, 1, fmt, false );
+
+				const unsigned char *pSrcData = pSrc->ImageData( iFrame, iFace, iMip );
+				for ( int z = 0; z < nMipDepth; ++z, pSrcData += nSrcSliceSize, pDst += nDstSliceSize )
+				{
+					if ( bNative )
+					{
+						BCn_CompressImage( pSrcData, nMipWidth, nMipHeight, pDst, fmt );
+					}
+					else if ( !ImageLoader::ConvertImageFormat( pSrcData, IMAGE_FORMAT_RGBA8888, pDst, fmt, nMipWidth, nMipHeight ) )
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// PSNR of the top mip of the first image
+static double ComputeTopMipPSNR( IVTFTexture *pSrc, const unsigned char *pCompressed, ImageFormat fmt )
+{
+	int nPixels = pSrc->Width() * pSrc->Height();
+	unsigned char *pDecoded = new unsigned char[ nPixels * 4 ];
+	BCn_DecompressImage( pCompressed, pSrc->Width(), pSrc->Height(), pDecoded, fmt );
+	double flPSNR = BCn_ComputePSNR( pSrc->ImageData( 0, 0, 0 ), pDecoded, nPixels, BCn_GetChannelMask( fmt ) );
+	delete [] pDecoded;
+	return flPSNR;
+}
+
+static void ReportResult( const char *pName, int64 nPixels, int nIterations, double flSeconds, double flPSNR )
+{
+	double flMPixPerSec = ( flSeconds > 0.0 ) ? ( nPixels * nIterations / 1.0e6 ) / flSeconds : 0.0;
+	Msg( "  %-18s %9.1f MPix/s %8.2f ms %8.2f dB\n", pName, flMPixPerSec, 1000.0 * flSeconds / nIterations, flPSNR );
+}
+
+static void BenchTexture( const char *pName, IVTFTexture *pSrc, ImageFormat fmt, int nIterations )
+{
+	int64 nPixels = CountPixels( pSrc );
+	int nCompressedSize = ImageLoader::GetMemRequired( pSrc->Width(), pSrc->Height(), pSrc->Depth(), fmt, pSrc->MipCount() > 1 ) *
+		pSrc->FrameCount() * pSrc->FaceCount();
+
+	Msg( "%s: %dx%d, %d mips, %d frames, %d faces -> %s\n", pName, pSrc->Width(), pSrc->Height(), pSrc->MipCount(),
+		pSrc->FrameCount(), pSrc->FaceCount(), ImageLoader::GetName( fmt ) );
+
+	unsigned char *pReference = new unsigned char[ nCompressedSize ];
+	unsigned char *pNative = new unsigned char[ nCompressedSize ];
+
+	// ImageLoader, which on POSIX has no ATIxN compressor
+	double flStart = Plat_FloatTime();
+	bool bReference = true;
+	for ( int i = 0; i < nIterations && bReference; ++i )
+	{
+		bReference = CompressSerial( pSrc, fmt, pReference, false );
+	}
+	double flReferenceTime = Plat_FloatTime() - flStart;
+	if ( bReference )
+	{
+		ReportResult( "imageloader", nPixels, nIterations, flReferenceTime, ComputeTopMipPSNR( pSrc, pReference, fmt ) );
+
+		// Forcing the ImageLoader path through IVTFTexture has to reproduce it exactly
+		IVTFTexture *pTex = CloneTexture( pSrc );
+		pTex->ConvertImageFormat( fmt, false, true );
+		if ( pTex->ComputeTotalSize() != nCompressedSize || memcmp( pTex->ImageData(), pReference, nCompressedSize ) )
+		{
+			Warning( "  forced imageloader conversion differs from imageloader output!\n" );
+		}
+		DestroyVTFTexture( pTex );
+	}
+	else
+	{
+		Msg( "  %-18s unsupported\n", "imageloader" );
+	}
+
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		CompressSerial( pSrc, fmt, pNative, true );
+	}
+	double flNativeTime = Plat_FloatTime() - flStart;
+	ReportResult( "native serial", nPixels, nIterations, flNativeTime, ComputeTopMipPSNR( pSrc, pNative, fmt ) );
+
+	// The full IVTFTexture path, split across the thread pool
+	double flParallelTime = 0.0;
+	bool bMatches = true;
+	for ( int i = 0; i < nIterations; ++i )
+	{
+		IVTFTexture *pTex = CloneTexture( pSrc );
+		flStart = Plat_FloatTime();
+		pTex->ConvertImageFormat( fmt, false );
+		flParallelTime += Plat_FloatTime() - flStart;
+
+		bMatches = bMatches && ( pTex->ComputeTotalSize() == nCompressedSize ) && !memcmp( pTex->ImageData(), pNative, nCompressedSize );
+		DestroyVTFTexture( pTex );
+	}
+	ReportResult( "native parallel", nPixels, nIterations, flParallelTime, ComputeTopMipPSNR( pSrc, pNative, fmt ) );
+
+	if ( !bMatches )
+	{
+		Warning( "  native parallel output differs from native serial output!\n" );
+	}
+	if ( flParallelTime > 0.0 )
+	{
+		Msg( "  parallel speedup %.2fx over native serial", flNativeTime / flParallelTime );
+		if ( bReference )
+		{
+			Msg( ", %.2fx over imageloader", flReferenceTime / flParallelTime );
+		}
+		Msg( "\n" );
+	}
+
+	delete [] pReference;
+	delete [] pNative;
+}
+
+//-----------------------------------------------------------------------------
+// Resamples every mip level from the top one, the way
+// CVTFTexture::GenerateMipmaps does, with and without RESAMPLE_REFERENCE.
+// Returns false if the outputs differ by more than the documented tolerance.
+//-----------------------------------------------------------------------------
+static bool BenchMipmaps( const char *pName, IVTFTexture *pSrc, int nFlags, const char *pFilterName, int nIterations )
+{
+	int nMipCount = pSrc->MipCount();
+	int nChainSize = 0;
+	for ( int iMip = 1; iMip < nMipCount; ++iMip )
+	{
+		int nMipWidth, nMipHeight, nMipDepth;
+		pSrc->ComputeMipLevelDimensions( iMip, &nMipWidth, &nMipHeight, &nMipDepth );
+		nChainSize += nMipWidth * nMipHeight * 4;
+	}
+
+	unsigned char *pReference = new unsigned char[ nChainSize ];
+	unsigned char *pTiled = new unsigned char[ nChainSize ];
+	double pSeconds[2] = { 0.0, 0.0 };
+
+	for ( int nPass = 0; nPass < 2; ++nPass )
+	{
+		unsigned char *pChain = nPass ? pTiled : pReference;
+		double flStart = Plat_FloatTime();
+		for ( int i = 0; i < nIterations; ++i )
+		{
+			unsigned char *pDest = pChain;
+			for ( int iMip = 1; iMip < nMipCount; ++iMip )
+			{
+				ImageLoader::ResampleInfo_t info;
+				info.m_pSrc = pSrc->ImageData( 0, 0, 0 );
+				info.m_pDest = pDest;
+				info.m_nSrcWidth = pSrc->Width();
+				info.m_nSrcHeight = pSrc->Height();
+				pSrc->ComputeMipLevelDimensions( iMip, &info.m_nDestWidth, &info.m_nDestHeight, &info.m_nDestDepth );
+				info.m_flSrcGamma = 2.2f;
+				info.m_flDestGamma = 2.2f;
+				info.m_nFlags = nFlags | ( nPass ? 0 : ImageLoader::RESAMPLE_REFERENCE );
+				ImageLoader::ResampleRGBA8888( info );
+
+				pDest += info.m_nDestWidth * info.m_nDestHeight * 4;
+			}
+		}
+		pSeconds[nPass] = Plat_FloatTime() - flStart;
+	}
+
+	int nMaxDiff = 0, nDiffering = 0;
+	for ( int i = 0; i < nChainSize; ++i )
+	{
+		int nDiff = abs( (int)pReference[i] - (int)pTiled[i] );
+		nMaxDiff = MAX( nMaxDiff, nDiff );
+		nDiffering += ( nDiff != 0 );
+	}
+
+	Msg( "%s: %dx%d, %d mips, %s filter\n", pName, pSrc->Width(), pSrc->Height(), nMipCount, pFilterName );
+	Msg( "  %-18s %8.2f ms\n", "reference", 1000.0 * pSeconds[0] / nIterations );
+	Msg( "  %-18s %8.2f ms  %.2fx\n", "tiled", 1000.0 * pSeconds[1] / nIterations, ( pSeconds[1] > 0.0 ) ? pSeconds[0] / pSeconds[1] : 0.0 );
+	Msg( "  max difference %d (tolerance %d), %d of %d channels differ\n", nMaxDiff, RESAMPLE_REFERENCE_TOLERANCE, nDiffering, nChainSize );
+
+	delete [] pReference;
+	delete [] pTiled;
+
+	if ( nMaxDiff > RESAMPLE_REFERENCE_TOLERANCE )
+	{
+		Warning( "  tiled mipmaps exceed the tolerance!\n" );
+		return false;
+	}
+	return true;
+}
+
+static bool BenchTextureMipmaps( const char *pName, IVTFTexture *pSrc, int nIterations )
+{
+	bool bOk = BenchMipmaps( pName, pSrc, 0, "box", nIterations );
+	bOk = BenchMipmaps( pName, pSrc, ImageLoader::RESAMPLE_NICE_FILTER, "nice", nIterations ) && bOk;
+	bOk = BenchMipmaps( pName, pSrc, ImageLoader::RESAMPLE_NORMALMAP, "normal map", nIterations ) && bOk;
+	return bOk;
+}
+
+int main( int argc, char **argv )
+{
+	SpewOutputFunc( VTFBenchOutputFunc );
+	CommandLine()->CreateCmdLine( argc, argv );
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 1.0f, false, false, false, false );
+	InitDefaultFileSystem();
+
+	if ( CommandLine()->CheckParm( "-?" ) || CommandLine()->CheckParm( "-help" ) )
+	{
+		Usage();
+	}
+
+	int nIterations = MAX( 1, CommandLine()->ParmValue( "-iterations", 3 ) );
+	bool bMipmaps = CommandLine()->CheckParm( "-mipmaps" ) != NULL;
+	bool bOk = true;
+	const char *pFormat = CommandLine()->ParmValue( "-format" );
+	const char *pSynthetic = CommandLine()->ParmValue( "-synthetic" );
+
+	CUtlVector<ImageFormat> formats;
+	for ( int i = 0; i < ARRAYSIZE( s_pBenchFormats ); ++i )
+	{
+		if ( !pFormat || !Q_stricmp( pFormat, ImageLoader::GetName( s_pBenchFormats[i] ) ) )
+		{
+			formats.AddToTail( s_pBenchFormats[i] );
+		}
+	}
+	if ( !formats.Count() )
+	{
+		Usage();
+	}
+
+	ThreadPoolStartParams_t startParams;
+	startParams.nThreads = CommandLine()->ParmValue( "-threads", -1 );
+	g_pThreadPool->Start( startParams, "VtfBench" );
+	Msg( "%d worker threads\n", g_pThreadPool->NumThreads() );
+
+	// Anything on the command line that isn't an option or its value is a vtf
+	int nTextures = 0;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( argv[i][0] == '-' )
+		{
+			if ( !Q_stricmp( argv[i], "-format" ) || !Q_stricmp( argv[i], "-threads" ) ||
+				!Q_stricmp( argv[i], "-iterations" ) || !Q_stricmp( argv[i], "-synthetic" ) )
+			{
+				++i;
+			}
+			continue;
+		}
+
+		IVTFTexture *pTex = LoadTexture( argv[i] );
+		if ( !pTex )
+			continue;
+
+		if ( bMipmaps )
+		{
+			bOk = BenchTextureMipmaps( argv[i], pTex, nIterations ) && bOk;
+		}
+		else
+		{
+			for ( int j = 0; j < formats.Count(); ++j )
+			{
+				BenchTexture( argv[i], pTex, formats[j], nIterations );
+			}
+		}
+		DestroyVTFTexture( pTex );
+		++nTextures;
+	}
+
+	if ( !nTextures || pSynthetic )
+	{
+		int nWidth = bMipmaps ? 4096 : 2048;
+		int nHeight = nWidth;
+		if ( pSynthetic && sscanf( pSynthetic, "%dx%d", &nWidth, &nHeight ) != 2 )
+		{
+			Usage();
+		}
+
+		IVTFTexture *pTex = CreateSyntheticTexture( nWidth, nHeight );
+		if ( !pTex )
+		{
+			Error( "Can't create a %dx%d texture\n", nWidth, nHeight );
+		}
+
+		if ( bMipmaps )
+		{
+			bOk = BenchTextureMipmaps( "synthetic", pTex, nIterations ) && bOk;
+		}
+		else
+		{
+			for ( int j = 0; j < formats.Count(); ++j )
+			{
+				BenchTexture( "synthetic", pTex, formats[j], nIterations );
+			}
+		}
+		DestroyVTFTexture( pTex );
+	}
+
+	g_pThreadPool->Stop();
+	return bOk ? 0 : 1;
+}
@@ -7,9 +7,16 @@
 //=============================================================================//
 #include "vis.h"
 #include "vmpi.h"
+#include "threads.h"
+
+#if !defined( _X360 ) && !defined( _PS3 )
+#include <emmintrin.h>
+#define VIS_FLOW_SSE2 1
+#endif
 
 int g_TraceClusterStart = -1;
 int g_TraceClusterStop = -1;
+int c_chains;
 /*
 
   each portal will have a list of all possible to see from first portal
@@ -467,6 +474,72 @@ void WritePortalTrace( const char *source )
 	Warning("Wrote %s!!!\n", filename);
 }
 
+//-----------------------------------------------------------------------------
+// might = prevstack mightsee & test, over the words of the previous mightsee
+// that can be nonzero. Narrows the word range of the new mightsee to the words
+// that came out nonzero, so the deeper levels skip the empty parts of the bit
+// string. Returns true if the new mightsee has any bit that isn't in vis.
+//-----------------------------------------------------------------------------
+static bool FlowMightSee( const pstack_t *prevstack, const byte *test, const byte *vis, pstack_t *stack )
+{
+	const uint64 *prev = (const uint64 *)prevstack->mightsee;
+	const uint64 *test64 = (const uint64 *)test;
+	const uint64 *vis64 = (const uint64 *)vis;
+	uint64 *might = (uint64 *)stack->mightsee;
+	int end = prevstack->mightend;
+	int first = -1, last = -1;
+	uint64 more = 0;
+
+	int i = prevstack->mightstart;
+#ifdef VIS_FLOW_SSE2
+	__m128i zero = _mm_setzero_si128();
+	__m128i vmore = zero;
+	for ( ; i + 2 <= end; i += 2 )
+	{
+		__m128i m = _mm_and_si128( _mm_loadu_si128( (const __m128i *)( prev + i ) ), _mm_loadu_si128( (const __m128i *)( test64 + i ) ) );
+		_mm_storeu_si128( (__m128i *)( might + i ), m );
+		if ( _mm_movemask_epi8( _mm_cmpeq_epi32( m, zero ) ) == 0xFFFF )
+			continue;
+
+		if ( first < 0 )
+			first = i;
+		last = i + 2;
+		vmore = _mm_or_si128( vmore, _mm_andnot_si128( _mm_loadu_si128( (const __m128i *)( vis64 + i ) ), m ) );
+	}
+	more = ( _mm_movemask_epi8( _mm_cmpeq_epi32( vmore, zero ) ) != 0xFFFF );
+#endif
+	for ( ; i < end; i++ )
+	{
+		might[i] = prev[i] & test64[i];
+		if ( !might[i] )
+			continue;
+
+		if ( first < 0 )
+			first = i;
+		last = i + 1;
+		more |= might[i] & ~vis64[i];
+	}
+
+	if ( first < 0 )
+	{
+		stack->mightstart = stack->mightend = 0;
+	}
+	else
+	{
+		stack->mightstart = first;
+		stack->mightend = last;
+	}
+
+	return more != 0;
+}
+
+// Bits of mightsee outside its word range aren't written, so check the range first
+static inline bool MightSeePortal( const pstack_t *stack, int pnum )
+{
+	int word = pnum >> 6;
+	return word >= stack->mightstart && word < stack->mightend && CheckBit( stack->mightsee, pnum );
+}
+
 /*
 ==================
 RecursiveLeafFlow
@@ -481,8 +554,9 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	portal_t	*p;
 	plane_t		backplane;
 	leaf_t 		*leaf;
-	int			i, j;
-	long		*test, *might, *vis, more;
+	int			i;
+	byte		*test;
+	bool		more;
 	int			pnum;
 
 	// Early-out if we're a VMPI worker that's told to exit. If we don't do this here, then the
@@ -505,9 +579,6 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	stack.next = NULL;
 	stack.leaf = leaf;
 	stack.portal = NULL;
-
-	might = (long *)stack.mightsee;
-	vis = (long *)thread->base->portalvis;
 	
 	// check all portals for flowing into other leafs	
 	for (i=0 ; i<leaf->portals.Count() ; i++)
@@ -516,7 +587,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		p = leaf->portals[i];
 		pnum = p - portals;
 
-		if ( ! (prevstack->mightsee[pnum >> 3] & (1<<(pnum&7)) ) )
+		if ( !MightSeePortal( prevstack, pnum ) )
 		{
 			continue;	// can't possibly see it
 		}
@@ -524,19 +595,14 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		// if the portal can't see anything we haven't allready seen, skip it
 		if (p->status == stat_done)
 		{
-			test = (long *)p->portalvis;
+			test = p->portalvis;
 		}
 		else
 		{
-			test = (long *)p->portalflood;
+			test = p->portalflood;
 		}
 
-		more = 0;
-		for (j=0 ; j<portallongs ; j++)
-		{
-			might[j] = ((long *)prevstack->mightsee)[j] & test[j];
-			more |= (might[j] & ~vis[j]);
-		}
+		more = FlowMightSee( prevstack, test, thread->base->portalvis, &stack );
 		
 		if ( !more && CheckBit( thread->base->portalvis, pnum ) )
 		{	// can't see anything new
@@ -627,7 +693,7 @@ generates the portalvis bit vector
 void PortalFlow (int iThread, int portalnum)
 {
 	threaddata_t	data;
-	int				i;
+	int				i, words;
 	portal_t		*p;
 	int				c_might, c_can;
 
@@ -642,14 +708,28 @@ void PortalFlow (int iThread, int portalnum)
 	data.pstack_head.portal = p;
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
-	for (i=0 ; i<portallongs ; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+
+	// copy the words of portalflood from the first nonzero one to the last
+	const uint64 *flood = (const uint64 *)p->portalflood;
+	words = portalbytes / sizeof(uint64);
+	data.pstack_head.mightend = words;
+	while ( data.pstack_head.mightend > 0 && !flood[data.pstack_head.mightend - 1] )
+		data.pstack_head.mightend--;
+	data.pstack_head.mightstart = 0;
+	while ( data.pstack_head.mightstart < data.pstack_head.mightend && !flood[data.pstack_head.mightstart] )
+		data.pstack_head.mightstart++;
+	for (i=data.pstack_head.mightstart ; i<data.pstack_head.mightend ; i++)
+		((uint64 *)data.pstack_head.mightsee)[i] = flood[i];
 
 	RecursiveLeafFlow (p->leaf, &data, &data.pstack_head);
 
 
 	p->status = stat_done;
 
+	ThreadLock();
+	c_chains += data.c_chains;
+	ThreadUnlock();
+
 	c_can = CountBits (p->portalvis, g_numportals*2);
 
 	qprintf ("portal:%4i  mightsee:%4i  cansee:%4i (%i chains)\n", 
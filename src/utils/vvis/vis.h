@@ -67,6 +67,7 @@ struct leaf_t
 struct pstack_t
 {
 	byte		mightsee[MAX_PORTALS/8];		// bit string
+	int			mightstart, mightend;			// 64 bit words of mightsee that can be nonzero
 	pstack_t	*next;
 	leaf_t		*leaf;
 	portal_t	*portal;	// portal exiting
@@ -97,6 +98,8 @@ extern	int			c_portalskip, c_leafskip;
 extern	int			c_vistest, c_mighttest;
 extern	int			c_chains;
 
+extern	bool		g_bBenchmark;
+
 extern	byte	*vismap, *vismap_p, *vismap_end;	// past visfile
 
 extern	int			testlevel;
@@ -46,6 +46,7 @@ int			portalbytes, portallongs;
 
 bool		fastvis;
 bool		nosort;
+bool		g_bBenchmark;
 
 int			totalvis;
 
@@ -121,17 +122,21 @@ void prl(leaf_t *l)
 SortPortals
 
 Sorts the portals from the least complex, so the later ones can reuse
-the earlier information.
+the earlier information. Portals that might see as many go in memory
+order, which keeps the order the same with any qsort.
 =============
 */
 int PComp (const void *a, const void *b)
 {
-	if ( (*(portal_t **)a)->nummightsee == (*(portal_t **)b)->nummightsee)
-		return 0;
-	if ( (*(portal_t **)a)->nummightsee < (*(portal_t **)b)->nummightsee)
-		return -1;
+	portal_t *pa = *(portal_t **)a;
+	portal_t *pb = *(portal_t **)b;
 
-	return 1;
+	if (pa->nummightsee != pb->nummightsee)
+		return (pa->nummightsee < pb->nummightsee) ? -1 : 1;
+	if (pa != pb)
+		return (pa < pb) ? -1 : 1;
+
+	return 0;
 }
 
 void BuildTracePortals( int clusterStart )
@@ -302,6 +307,9 @@ void CalcPortalVis (void)
 	}
 
 
+	double start = Plat_FloatTime();
+	c_chains = 0;
+
     if (g_bUseMPI) 
 	{
  		RunMPIPortalFlow();
@@ -310,6 +318,49 @@ void CalcPortalVis (void)
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
 	}
+
+	if ( g_bBenchmark )
+	{
+		double flTime = Plat_FloatTime() - start;
+		Msg ("PortalFlow: %d portals in %.2f seconds, %.1f portals/sec, %d chains\n",
+			g_numportals*2, flTime, ( flTime > 0.0 ) ? g_numportals*2 / flTime : 0.0, c_chains);
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// For -benchmark, compares the PVS that was just built with the one the bsp
+// had when it was loaded.
+//-----------------------------------------------------------------------------
+static void ComparePVS( const byte *pOldVisData, int nOldVisDataSize )
+{
+	const dvis_t *pOldVis = (const dvis_t *)pOldVisData;
+	if ( !nOldVisDataSize || pOldVis->numclusters != portalclusters )
+	{
+		Msg ("The bsp had no vis data for %d clusters to compare with\n", portalclusters);
+		return;
+	}
+
+	byte oldPVS[MAX_MAP_LEAFS/8];
+	int nRowBytes = (portalclusters+7)>>3;
+	int nDiffering = 0;
+	for ( int i = 0; i < portalclusters; i++ )
+	{
+		DecompressVis( (byte *)pOldVisData + pOldVis->bitofs[i][DVIS_PVS], oldPVS );
+		if ( memcmp( oldPVS, uncompressedvis + i*leafbytes, nRowBytes ) )
+		{
+			nDiffering++;
+		}
+	}
+
+	if ( nDiffering )
+	{
+		Warning ("PVS differs from the bsp's in %d of %d clusters\n", nDiffering, portalclusters);
+	}
+	else
+	{
+		Msg ("PVS matches the bsp's\n");
+	}
 }
 
 
@@ -947,6 +998,11 @@ int ParseCommandLine( int argc, char **argv )
 			Msg ("nosort = true\n");
 			nosort = true;
 		}
+		else if (!Q_stricmp (argv[i],"-benchmark"))
+		{
+			Msg ("benchmark = true\n");
+			g_bBenchmark = true;
+		}
 		else if (!Q_stricmp (argv[i],"-tmpin"))
 			strcpy (inbase, "/tmp");
 		else if( !Q_stricmp( argv[i], "-low" ) )
@@ -1030,6 +1086,8 @@ void PrintUsage( int argc, char **argv )
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -nosort         : Don't sort portals (sorting is an optimization).\n"
+		"  -benchmark      : Time the full vis and check it against the vis already\n"
+		"                    in the bsp, without writing the bsp.\n"
 		"  -tmpin          : Make portals come from \\tmp\\<mapname>.\n"
 		"  -tmpout         : Make portals come from \\tmp\\<mapname>.\n"
 		"  -trace <start cluster> <end cluster> : Writes a linefile that traces the vis from one cluster to another for debugging map vis.\n"
@@ -1159,11 +1217,29 @@ int RunVVis( int argc, char **argv )
 	}
 	strcat (portalfile, ".prt");
 
+	// LoadPortals starts the new vis data over the old
+	CUtlVector<byte> oldVisData;
+	if ( g_bBenchmark )
+	{
+		oldVisData.CopyArray( dvisdata, visdatasize );
+	}
+
 	Msg ("reading %s\n", portalfile);
 	LoadPortals (portalfile);
 
+	if ( g_bBenchmark )
+	{
+		if ( fastvis )
+		{
+			Warning ("-benchmark times the full vis, ignoring -fast\n");
+			fastvis = false;
+		}
+
+		CalcVis ();
+		ComparePVS( oldVisData.Base(), oldVisData.Count() );
+	}
 	// don't write out results when simply doing a trace
-	if ( g_TraceClusterStart < 0 )
+	else if ( g_TraceClusterStart < 0 )
 	{
 		CalcVis ();
 		CalcPAS ();
@@ -17,6 +17,7 @@
 #include "tier1/fmtstr.h"
 #include "tier1/utlvector.h"
 #include "tier1/generichash.h"
+#include "tier1/convar.h"
 #include "tier0/vprof.h"
 
 #if defined( _X360 )
@@ -44,6 +45,11 @@ inline void ServiceJobAndRelease( CJob *pJob, int iThread = -1 )
 	pJob->Release();
 }
 
+//-----------------------------------------------------------------------------
+// Shared (and per-thread direct) job queue. The per-priority CTSQueues are
+// lock free; the item count is only a hint used to skip empty queues, so
+// pushes and pops never take a lock or touch a kernel event. Waking idle
+// workers is the pool's job (see CThreadPool::WakeIdleThread).
 //-----------------------------------------------------------------------------
 
 class ALIGN16 CJobQueue
@@ -104,57 +110,41 @@ public:
 		}
 
 		m_pQueues[pJob->GetPriority()]->PushItem( pJob );
-
-		m_mutex.Lock();
-		if ( ++m_nItems == 1 )
-		{
-			m_JobAvailableEvent.Set();
-		}
-		m_mutex.Unlock();
+		++m_nItems;
 
 		return nOverflow;
 	}
 
 	bool Pop( CJob **ppJob )
 	{
-		m_mutex.Lock();
-		if ( !m_nItems )
-		{
-			m_mutex.Unlock();
-			*ppJob = NULL;
-			return false;
-		}
-		if ( --m_nItems == 0 )
-		{
-			m_JobAvailableEvent.Reset();
-		}
-		m_mutex.Unlock();
-
 		for ( int i = JP_HIGH; i >= 0; --i )
 		{
-			if ( m_pQueues[i]->PopItem( ppJob ) )
+			if ( Pop( ppJob, (JobPriority_t)i ) )
 			{
 				return true;
 			}
 		}
 
-
-		AssertMsg( 0, "Expected at least one queue item" );
 		*ppJob = NULL;
 		return false;
 	}
 
-	CThreadEvent &GetEventHandle()
+	bool Pop( CJob **ppJob, JobPriority_t priority )
 	{
-		return m_JobAvailableEvent;
+		// The count is bumped after the item is pushed, so it can briefly read
+		// low (or go negative); that only costs a queue probe, never a lost job
+		if ( m_nItems != 0 && m_pQueues[priority]->PopItem( ppJob ) )
+		{
+			--m_nItems;
+			return true;
+		}
+		return false;
 	}
 
 	void Flush()
 	{
 		// Only safe to call when system is suspended
-		m_mutex.Lock();
 		m_nItems = 0;
-		m_JobAvailableEvent.Reset();
 		CJob *pJob;
 		for ( int i = JP_HIGH; i >= 0; --i )
 		{
@@ -164,18 +154,138 @@ public:
 				pJob->Release();
 			}
 		}
-		m_mutex.Unlock();
 	}
 
 private:
 	CTSQueue<CJob *>	*m_pQueues[JP_HIGH + 1];
-	int					m_nItems;
+	CInterlockedInt		m_nItems;
 	int					m_nMaxItems;
-	CThreadMutex		m_mutex;
-	CThreadManualEvent	m_JobAvailableEvent;
 
 } ALIGN16_POST;
 
+//-----------------------------------------------------------------------------
+// Fixed size work-stealing deque (Chase-Lev). Only the owning worker pushes
+// and pops at the bottom (LIFO, so nested jobs run while their data is still
+// warm); any other thread may steal from the top. A full deque refuses the
+// push and the caller falls back to the shared queue.
+//-----------------------------------------------------------------------------
+
+class CJobDeque
+{
+public:
+	enum
+	{
+		JOB_DEQUE_SIZE = 256,
+		JOB_DEQUE_MASK = JOB_DEQUE_SIZE - 1,
+	};
+
+	CJobDeque() :
+		m_iTop( 0 ),
+		m_iBottom( 0 )
+	{
+	}
+
+	int Count() const
+	{
+		int nItems = m_iBottom - m_iTop;
+		return ( nItems > 0 ) ? nItems : 0;
+	}
+
+	// Owner only
+	bool Push( CJob *pJob )
+	{
+		int iBottom = m_iBottom;
+		if ( iBottom - m_iTop >= JOB_DEQUE_SIZE )
+		{
+			return false;
+		}
+
+		m_pJobs[iBottom & JOB_DEQUE_MASK] = pJob;
+		ThreadMemoryBarrier(); // slot must be visible before the new bottom
+		m_iBottom = iBottom + 1;
+		return true;
+	}
+
+	// Owner only
+	bool Pop( CJob **ppJob )
+	{
+		int iBottom = m_iBottom - 1;
+		m_iBottom = iBottom;	// interlocked exchange, orders the store before the load of top below
+		int iTop = m_iTop;
+
+		if ( iTop > iBottom )
+		{
+			m_iBottom = iBottom + 1;
+			return false;
+		}
+
+		CJob *pJob = m_pJobs[iBottom & JOB_DEQUE_MASK];
+		if ( iTop == iBottom )
+		{
+			// Last item, race any thieves for it
+			bool bWon = m_iTop.AssignIf( iTop, iTop + 1 );
+			m_iBottom = iTop + 1;
+			if ( !bWon )
+			{
+				return false;
+			}
+		}
+
+		*ppJob = pJob;
+		return true;
+	}
+
+	// Any thread
+	bool Steal( CJob **ppJob )
+	{
+		int iTop = m_iTop;
+		ThreadMemoryBarrier();
+		int iBottom = m_iBottom;
+
+		if ( iTop >= iBottom )
+		{
+			return false;
+		}
+
+		CJob *pJob = m_pJobs[iTop & JOB_DEQUE_MASK];
+		if ( !m_iTop.AssignIf( iTop, iTop + 1 ) )
+		{
+			return false;
+		}
+
+		*ppJob = pJob;
+		return true;
+	}
+
+private:
+	CInterlockedInt		m_iTop;
+	CInterlockedInt		m_iBottom;
+	CJob * volatile		m_pJobs[JOB_DEQUE_SIZE];
+};
+
+//-----------------------------------------------------------------------------
+// Per-worker counters, written only by the owning thread and read (racily)
+// by threadpool_stats
+//-----------------------------------------------------------------------------
+
+struct JobThreadStats_t
+{
+	void Reset()
+	{
+		memset( this, 0, sizeof( *this ) );
+	}
+
+	int		m_nDirectJobs;
+	int		m_nLocalJobs;
+	int		m_nSharedJobs;
+	int		m_nStolenJobs;
+	int		m_nFailedSteals;
+	int		m_nSpinWakes;
+	int		m_nParks;
+	int		m_nMaxLocalDepth;
+	double	m_flIdleTime;
+};
+
 //-----------------------------------------------------------------------------
 //
 // CThreadPool
@@ -249,6 +359,16 @@ public:
 
 	void WaitForIdle( bool bAll = true );
 
+	//-----------------------------------------------------
+	// Work stealing support
+	//-----------------------------------------------------
+	bool StealJob( CJob **ppJob, JobPriority_t priority, int iThief = -1 );
+	bool HasPendingJobs();
+	void WakeIdleThread();
+
+	void PrintStats();
+	void ResetStats();
+
 private:
 	enum
 	{
@@ -267,11 +387,14 @@ private:
 	//-----------------------------------------------------
 	int Run();
 
+	bool ExecuteOrPutBack( CJob *pJob, JobFilter_t pfnFilter, CUtlVector<CJob *> &jobsToPutBack, int nJobsTotal );
+
 private:
 	friend class CJobThread;
 
 	CJobQueue				m_SharedQueue;
 	CInterlockedInt			m_nIdleThreads;
+	CInterlockedInt			m_nParkedThreads;
 	CUtlVector<CJobThread *> m_Threads;
 	CUtlVector<CThreadEvent *>		m_IdleEvents;
 
@@ -279,6 +402,15 @@ private:
 	int						m_nSuspend;
 	CInterlockedInt			m_nJobs;
 
+	// Pool wide counters for threadpool_stats; per-worker counters live on the CJobThread
+	CInterlockedInt			m_nWakes;
+	CInterlockedInt			m_nLocalOverflows;
+	CInterlockedInt			m_nYieldJobs;
+	CInterlockedInt			m_nYieldSteals;
+	CInterlockedInt			m_nMaxSharedDepth;
+
+	char					m_szName[32];
+
 	// Some jobs should only be executed on the threadpool thread(s). Ie: the rendering thread has the GL context
 	//	and the main thread coming in and "helping" with jobs breaks that pretty nicely. This flag states that
 	//	only the threadpool threads should execute these jobs.
@@ -328,14 +460,20 @@ public:
 
 //-----------------------------------------------------------------------------
 
+ConVar threadpool_spin( "threadpool_spin", "4000", 0, "Number of pause iterations an idle thread pool worker spins looking for work before it parks" );
+
+static CTHREADLOCALPTR( CJobThread ) g_pCurrentJobThread;
+
 class CJobThread : public CWorkerThread
 {
 public:
 	CJobThread( CThreadPool *pOwner, int iThread ) : 
 		m_SharedQueue( pOwner->m_SharedQueue ),
 		m_pOwner( pOwner ),
-		m_iThread( iThread )
+		m_iThread( iThread ),
+		m_nParked( 0 )
 	{
+		m_Stats.Reset();
 	}
 
 	CThreadEvent &GetIdleEvent()
@@ -348,70 +486,188 @@ public:
 		return m_DirectQueue;
 	}
 
+	CJobDeque &AccessLocalDeque( JobPriority_t priority )
+	{
+		return m_LocalDeques[priority];
+	}
+
+	JobThreadStats_t &AccessStats()
+	{
+		return m_Stats;
+	}
+
+	CThreadPool *GetOwner()
+	{
+		return m_pOwner;
+	}
+
+	bool IsParked()
+	{
+		return ( m_nParked != 0 );
+	}
+
+	//-----------------------------------------------------
+	// Push a job spawned by this worker onto its own deque
+	//-----------------------------------------------------
+	bool PushLocal( CJob *pJob )
+	{
+		CJobDeque &deque = m_LocalDeques[pJob->GetPriority()];
+		if ( !deque.Push( pJob ) )
+		{
+			return false;
+		}
+		m_Stats.m_nMaxLocalDepth = MAX( m_Stats.m_nMaxLocalDepth, deque.Count() );
+		return true;
+	}
+
+	//-----------------------------------------------------
+	// Wake the thread if it is parked. Returns false if it was already awake
+	//-----------------------------------------------------
+	bool Wake()
+	{
+		if ( m_nParked.AssignIf( 1, 0 ) )
+		{
+			m_pOwner->m_nParkedThreads--;
+			m_WakeEvent.Set();
+			return true;
+		}
+		return false;
+	}
+
+	bool HasLocalJobs()
+	{
+		for ( int i = JP_HIGH; i >= 0; --i )
+		{
+			if ( m_LocalDeques[i].Count() )
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//-----------------------------------------------------
+	// Only safe to call when the thread is not running jobs
+	//-----------------------------------------------------
+	int AbortLocalJobs()
+	{
+		CJob *pJob;
+		int nAborted = 0;
+		for ( int i = JP_HIGH; i >= 0; --i )
+		{
+			while ( m_LocalDeques[i].Steal( &pJob ) )
+			{
+				pJob->Abort();
+				pJob->Release();
+				nAborted++;
+			}
+		}
+		return nAborted;
+	}
+
 private:
-	unsigned Wait()
+	//-----------------------------------------------------
+	// Find the next job. Jobs aimed at this thread come first, then for each
+	// priority: our own deque, the shared queue, and finally other workers'
+	// deques.
+	//-----------------------------------------------------
+	bool GetJob( CJob **ppJob )
 	{
-		unsigned waitResult;
-		tmZone( TELEMETRY_LEVEL0, TMZF_IDLE, "%s", __FUNCTION__ );
-#ifdef WIN32
-		enum Event_t
+		if ( m_DirectQueue.Pop( ppJob ) )
+		{
+			m_Stats.m_nDirectJobs++;
+			return true;
+		}
+
+		for ( int i = JP_HIGH; i >= 0; --i )
 		{
-			CALL_FROM_MASTER,
-			SHARED_QUEUE,
-			DIRECT_QUEUE,
+			if ( m_LocalDeques[i].Pop( ppJob ) )
+			{
+				m_Stats.m_nLocalJobs++;
+				return true;
+			}
 
-			NUM_EVENTS
-		};
+			if ( m_SharedQueue.Pop( ppJob, (JobPriority_t)i ) )
+			{
+				m_Stats.m_nSharedJobs++;
+				return true;
+			}
 
-		HANDLE	 waitHandles[NUM_EVENTS];
-		
-		waitHandles[CALL_FROM_MASTER]	= GetCallHandle().GetHandle();
-		waitHandles[SHARED_QUEUE]		= m_SharedQueue.GetEventHandle().GetHandle();
-		waitHandles[DIRECT_QUEUE] 		= m_DirectQueue.GetEventHandle().GetHandle();
-		
-#ifdef _DEBUG
-		while ( ( waitResult = WaitForMultipleObjects( ARRAYSIZE(waitHandles), waitHandles, FALSE, 10 ) ) == WAIT_TIMEOUT )
+			if ( m_pOwner->StealJob( ppJob, (JobPriority_t)i, m_iThread ) )
+			{
+				m_Stats.m_nStolenJobs++;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool HasWork()
+	{
+		return ( m_DirectQueue.Count() || m_pOwner->HasPendingJobs() );
+	}
+
+	//-----------------------------------------------------
+	// Spin for a while looking for work, then park on the wake event until
+	// a producer (or a call from the master) wakes us
+	//-----------------------------------------------------
+	void Wait()
+	{
+		tmZone( TELEMETRY_LEVEL0, TMZF_IDLE, "%s", __FUNCTION__ );
+
+		double flStart = Plat_FloatTime();
+
+		int nSpin = threadpool_spin.GetInt();
+		for ( int i = 0; i < nSpin; i++ )
 		{
-			waitResult = waitResult; // break here
+			if ( HasWork() || ( ( i & 63 ) == 0 && PeekCall() ) )
+			{
+				m_Stats.m_nSpinWakes++;
+				m_Stats.m_flIdleTime += Plat_FloatTime() - flStart;
+				return;
+			}
+			ThreadPause();
 		}
+
+		// Publish that we are parked before the final check, so a producer
+		// either sees us parked or we see its job
+		m_nParked = 1;
+		m_pOwner->m_nParkedThreads++;
+
+		if ( !HasWork() && !PeekCall() )
+		{
+			m_Stats.m_nParks++;
+#ifdef WIN32
+			HANDLE waitHandles[2];
+			waitHandles[0] = GetCallHandle().GetHandle();
+			waitHandles[1] = m_WakeEvent.GetHandle();
+			WaitForMultipleObjects( ARRAYSIZE( waitHandles ), waitHandles, FALSE, INFINITE );
 #else
-		waitResult = WaitForMultipleObjects( ARRAYSIZE(waitHandles), waitHandles, FALSE, INFINITE );
+			// Calls from the master are followed by a Wake(), the timeout is
+			// only a backstop
+			m_WakeEvent.Wait( 100 );
 #endif
-#else // !win32
-		bool bSet = false;
-		int nWaitTime = 100;
+		}
 
-		while( !bSet )
+		if ( m_nParked.AssignIf( 1, 0 ) )
 		{
-			// Jobs are typically enqueued to the shared job queue so wait on it first.
-			bSet = m_SharedQueue.GetEventHandle().Wait( nWaitTime );
-			if( !bSet )
-				bSet = m_DirectQueue.GetEventHandle().Wait( 10 );
-			if ( !bSet )
-				bSet = GetCallHandle().Wait( 0 );
+			m_pOwner->m_nParkedThreads--;
 		}
 
-		if ( !bSet )
-			waitResult = WAIT_TIMEOUT;
-		else
-			waitResult = WAIT_OBJECT_0;
-#endif
-		return waitResult;
+		m_Stats.m_flIdleTime += Plat_FloatTime() - flStart;
 	}
 
 	int Run()
 	{
-
-
-		// Wait for either a call from the master thread, or an item in the queue...
-		unsigned waitResult;
 		bool	 bExit = false;
 
 		tmZone( TELEMETRY_LEVEL0, TMZF_NONE, "%s", __FUNCTION__ );
 
+		g_pCurrentJobThread = this;
+
 		m_pOwner->m_nIdleThreads++;
 		m_IdleEvent.Set();
-		while (!bExit && ( ( waitResult = Wait() ) != WAIT_FAILED ) )
+		while ( !bExit )
 		{
 			if ( PeekCall() )
 			{
@@ -454,48 +710,62 @@ private:
 				tmZone( TELEMETRY_LEVEL0, TMZF_NONE, "%s !PeekCall()", __FUNCTION__ );
 
 				CJob *pJob;
-				bool bTookJob = false;
+				if ( !GetJob( &pJob ) )
+				{
+					// Nothing to process, return to wait state
+					Wait();
+					continue;
+				}
+
+				m_IdleEvent.Reset();
+				m_pOwner->m_nIdleThreads--;
 				do
 				{
-					if ( !m_DirectQueue.Pop( &pJob) )
-					{
-						if ( !m_SharedQueue.Pop( &pJob ) )
-						{
-							// Nothing to process, return to wait state
-							break;
-						}
-					}
-					if ( !bTookJob )
-					{
-						m_IdleEvent.Reset();
-						m_pOwner->m_nIdleThreads--;
-						bTookJob = true;
-					}
 					ServiceJobAndRelease( pJob, m_iThread );
 					m_pOwner->m_nJobs--;
-				} while ( !PeekCall() );
+				} while ( !PeekCall() && GetJob( &pJob ) );
 
-				if ( bTookJob )
-				{
-					m_pOwner->m_nIdleThreads++;
-					m_IdleEvent.Set();
-				}
+				m_pOwner->m_nIdleThreads++;
+				m_IdleEvent.Set();
 			}
 		}
 		m_pOwner->m_nIdleThreads--;
 		m_IdleEvent.Reset();
+		g_pCurrentJobThread = NULL;
 		return 0;
 	}
 
 	CJobQueue			m_DirectQueue;
+	CJobDeque			m_LocalDeques[JP_HIGH + 1];
 	CJobQueue &			m_SharedQueue;
 	CThreadPool *		m_pOwner;
 	CThreadManualEvent	m_IdleEvent;
+	CThreadEvent		m_WakeEvent;
 	int					m_iThread;
+	CInterlockedInt		m_nParked;
+	JobThreadStats_t	m_Stats;
 };
 
 //-----------------------------------------------------------------------------
 
+JOB_INTERFACE bool ThreadInThreadPool( IThreadPool *pPool )
+{
+	CJobThread *pThread = g_pCurrentJobThread;
+	if ( !pThread )
+	{
+		return false;
+	}
+	return ( !pPool || pPool == static_cast<IThreadPool *>( pThread->GetOwner() ) );
+}
+
+//-----------------------------------------------------------------------------
+
+// Every started pool, for threadpool_stats
+static CThreadFastMutex g_ThreadPoolsMutex;
+static CUtlVector<CThreadPool *> g_ThreadPools;
+
+//-----------------------------------------------------------------------------
+
 CGlobalThreadPool g_ThreadPool;
 IThreadPool *g_pThreadPool = &g_ThreadPool;
 
@@ -507,9 +777,12 @@ IThreadPool *g_pThreadPool = &g_ThreadPool;
 
 CThreadPool::CThreadPool() :
 	m_nIdleThreads( 0 ),
+	m_nParkedThreads( 0 ),
 	m_nJobs( 0 ),
-	m_nSuspend( 0 )
+	m_nSuspend( 0 ),
+	m_nMaxSharedDepth( 0 )
 {
+	m_szName[0] = 0;
 }
 
 //---------------------------------------------------------
@@ -541,6 +814,7 @@ void CThreadPool::ExecuteHighPriorityFunctor( CFunctor *pFunctor )
 	for ( i = 0; i < m_Threads.Count(); i++ )
 	{
 		m_Threads[i]->CallWorker( TPM_RUNFUNCTOR, 0, false, pFunctor );
+		m_Threads[i]->Wake();
 	}
 
 	for ( i = 0; i < m_Threads.Count(); i++ )
@@ -564,6 +838,7 @@ int CThreadPool::SuspendExecution()
 		for ( i = 0; i < m_Threads.Count(); i++ )
 		{
 			m_Threads[i]->CallWorker( TPM_SUSPEND, 0 );
+			m_Threads[i]->Wake();
 		}
 
 		for ( i = 0; i < m_Threads.Count(); i++ )
@@ -624,6 +899,13 @@ int CThreadPool::YieldWait( CThreadEvent **pEvents, int nEvents, bool bWaitAll,
 		{
 			ServiceJobAndRelease( pJob );
 			m_nJobs--;
+			m_nYieldJobs++;
+		}
+		else if ( !m_bExecOnThreadPoolThreadsOnly && ( StealJob( &pJob, JP_HIGH ) || StealJob( &pJob, JP_NORMAL ) || StealJob( &pJob, JP_LOW ) ) )
+		{
+			ServiceJobAndRelease( pJob );
+			m_nJobs--;
+			m_nYieldSteals++;
 		}
 		else
 		{
@@ -735,25 +1017,135 @@ void CThreadPool::AddJob( CJob *pJob )
 void CThreadPool::InsertJobInQueue( CJob *pJob )
 {
 	CJobQueue *pQueue;
+	CJobThread *pDirectThread = NULL;
 
 	if ( !( pJob->GetFlags() & JF_SERIAL ) )
 	{
 		int iThread = pJob->GetServiceThread();
 		if ( iThread == -1 || !m_Threads.IsValidIndex( iThread ) )
 		{
+			// Jobs spawned by one of our own workers go on its deque, where
+			// it will pick them up next and idle workers can steal them
+			CJobThread *pCurrentThread = g_pCurrentJobThread;
+			if ( pCurrentThread && pCurrentThread->GetOwner() == this )
+			{
+				pJob->AddRef();
+				if ( pCurrentThread->PushLocal( pJob ) )
+				{
+					WakeIdleThread();
+					return;
+				}
+				pJob->Release();
+				m_nLocalOverflows++;
+			}
+
 			pQueue = &m_SharedQueue;
 		}
 		else
 		{
-			pQueue = &(m_Threads[iThread]->AccessDirectQueue());
+			pDirectThread = m_Threads[iThread];
+			pQueue = &(pDirectThread->AccessDirectQueue());
 		}
 	}
 	else
 	{
-		pQueue = &(m_Threads[0]->AccessDirectQueue());
+		pDirectThread = m_Threads[0];
+		pQueue = &(pDirectThread->AccessDirectQueue());
 	}
 
 	m_nJobs -= pQueue->Push( pJob );
+
+	if ( pDirectThread )
+	{
+		pDirectThread->Wake();
+	}
+	else
+	{
+		// Several threads can add jobs at once, so raise the high water mark with a compare-exchange
+		int nDepth = m_SharedQueue.Count();
+		int nMaxDepth = m_nMaxSharedDepth;
+		while ( nDepth > nMaxDepth && !m_nMaxSharedDepth.AssignIf( nMaxDepth, nDepth ) )
+		{
+			nMaxDepth = m_nMaxSharedDepth;
+		}
+		WakeIdleThread();
+	}
+}
+
+//---------------------------------------------------------
+// Wake one parked worker, if any. Workers that are still spinning will find
+// the job on their own
+//---------------------------------------------------------
+
+void CThreadPool::WakeIdleThread()
+{
+	if ( m_nParkedThreads <= 0 )
+	{
+		return;
+	}
+
+	for ( int i = 0; i < m_Threads.Count(); i++ )
+	{
+		if ( m_Threads[i]->Wake() )
+		{
+			m_nWakes++;
+			return;
+		}
+	}
+}
+
+//---------------------------------------------------------
+// Take the oldest job of the given priority from another worker's deque
+//---------------------------------------------------------
+
+bool CThreadPool::StealJob( CJob **ppJob, JobPriority_t priority, int iThief )
+{
+	int nThreads = m_Threads.Count();
+	int iFirst = ( iThief >= 0 ) ? iThief + 1 : 0;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		int iVictim = ( iFirst + i ) % nThreads;
+		if ( iVictim == iThief )
+		{
+			continue;
+		}
+
+		CJobDeque &deque = m_Threads[iVictim]->AccessLocalDeque( priority );
+		if ( !deque.Count() )
+		{
+			continue;
+		}
+
+		if ( deque.Steal( ppJob ) )
+		{
+			return true;
+		}
+
+		if ( iThief >= 0 )
+		{
+			m_Threads[iThief]->AccessStats().m_nFailedSteals++;
+		}
+	}
+	return false;
+}
+
+//---------------------------------------------------------
+
+bool CThreadPool::HasPendingJobs()
+{
+	if ( m_SharedQueue.Count() )
+	{
+		return true;
+	}
+
+	for ( int i = 0; i < m_Threads.Count(); i++ )
+	{
+		if ( m_Threads[i]->HasLocalJobs() )
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 //---------------------------------------------------------
@@ -802,6 +1194,28 @@ void CThreadPool::ChangePriority( CJob *pJob, JobPriority_t priority )
 // Execute to a specified priority
 //---------------------------------------------------------
 
+bool CThreadPool::ExecuteOrPutBack( CJob *pJob, JobFilter_t pfnFilter, CUtlVector<CJob *> &jobsToPutBack, int nJobsTotal )
+{
+	if ( pfnFilter && !(*pfnFilter)( pJob ) )
+	{
+		if ( pJob->CanExecute() )
+		{
+			jobsToPutBack.EnsureCapacity( nJobsTotal );
+			jobsToPutBack.AddToTail( pJob );
+		}
+		else
+		{
+			m_nJobs--;
+			pJob->Release(); // an already serviced job in queue, may as well ditch it (as in, main thread probably force executed)
+		}
+		return false;
+	}
+
+	ServiceJobAndRelease( pJob );
+	m_nJobs--;
+	return true;
+}
+
 int CThreadPool::ExecuteToPriority( JobPriority_t iToPriority, JobFilter_t pfnFilter )
 {
 	SuspendExecution();
@@ -819,49 +1233,31 @@ int CThreadPool::ExecuteToPriority( JobPriority_t iToPriority, JobFilter_t pfnFi
 			CJobQueue &queue = m_Threads[i]->AccessDirectQueue();
 			while ( queue.Count( (JobPriority_t)iCurPriority ) )
 			{
-				queue.Pop( &pJob );
-				if ( pfnFilter && !(*pfnFilter)( pJob ) )
+				queue.Pop( &pJob, (JobPriority_t)iCurPriority );
+				if ( ExecuteOrPutBack( pJob, pfnFilter, jobsToPutBack, nJobsTotal ) )
 				{
-					if ( pJob->CanExecute() )
-					{
-						jobsToPutBack.EnsureCapacity( nJobsTotal );
-						jobsToPutBack.AddToTail( pJob );
-					}
-					else
-					{
-						m_nJobs--;
-						pJob->Release(); // an already serviced job in queue, may as well ditch it (as in, main thread probably force executed)
-					}
-					continue;
+					nExecuted++;
 				}
-				ServiceJobAndRelease( pJob );
-				m_nJobs--;
-				nExecuted++;
 			}
 
+			// Workers are suspended, so their deques can be drained from the top
+			CJobDeque &deque = m_Threads[i]->AccessLocalDeque( (JobPriority_t)iCurPriority );
+			while ( deque.Steal( &pJob ) )
+			{
+				if ( ExecuteOrPutBack( pJob, pfnFilter, jobsToPutBack, nJobsTotal ) )
+				{
+					nExecuted++;
+				}
+			}
 		}
 
 		while ( m_SharedQueue.Count( (JobPriority_t)iCurPriority ) )
 		{
-			m_SharedQueue.Pop( &pJob );
-			if ( pfnFilter && !(*pfnFilter)( pJob ) )
+			m_SharedQueue.Pop( &pJob, (JobPriority_t)iCurPriority );
+			if ( ExecuteOrPutBack( pJob, pfnFilter, jobsToPutBack, nJobsTotal ) )
 			{
-				if ( pJob->CanExecute() )
-				{
-					jobsToPutBack.EnsureCapacity( nJobsTotal );
-					jobsToPutBack.AddToTail( pJob );
-				}
-				else
-				{
-					m_nJobs--;
-					pJob->Release(); // see above
-				}
-				continue;
+				nExecuted++;
 			}
-
-			ServiceJobAndRelease( pJob );
-			m_nJobs--;
-			nExecuted++;
 		}
 	}
 
@@ -903,6 +1299,7 @@ int CThreadPool::AbortAll()
 			iAborted++;
 		}
 
+		iAborted += m_Threads[i]->AbortLocalJobs();
 	}
 
 	m_nJobs = 0;
@@ -1000,12 +1397,14 @@ bool CThreadPool::Start( const ThreadPoolStartParams_t &startParams, const char
 	{
 		pszName = ( startParams.bIOThreads ) ? "IOJobX" : "CmpJobX";
 	}
+	V_strncpy( m_szName, pszName, sizeof( m_szName ) );
+
 	while ( nThreads-- )
 	{
-		int iThread = m_Threads.AddToTail();
-		m_IdleEvents.AddToTail();
-		m_Threads[iThread] = new CJobThread( this, iThread );
-		m_IdleEvents[iThread] = &m_Threads[iThread]->GetIdleEvent();
+		// Workers look at each other's deques as soon as they start, so the
+		// slot must never hold an unconstructed thread
+		int iThread = m_Threads.AddToTail( new CJobThread( this, m_Threads.Count() ) );
+		m_IdleEvents.AddToTail( &m_Threads[iThread]->GetIdleEvent() );
 		m_Threads[iThread]->SetName( CFmtStr( "%s%d", pszName, iThread ) );
 		m_Threads[iThread]->Start( nStackSize );
 		m_Threads[iThread]->GetIdleEvent().Wait();
@@ -1016,6 +1415,14 @@ bool CThreadPool::Start( const ThreadPoolStartParams_t &startParams, const char
 
 	Distribute( bDistribute, startParams.bUseAffinityTable ? (int *)startParams.iAffinityTable : NULL );
 
+	{
+		AUTO_LOCK( g_ThreadPoolsMutex );
+		if ( g_ThreadPools.Find( this ) == g_ThreadPools.InvalidIndex() )
+		{
+			g_ThreadPools.AddToTail( this );
+		}
+	}
+
 	return true;
 }
 
@@ -1112,23 +1519,37 @@ void CThreadPool::Distribute( bool bDistribute, int *pAffinityTable )
 
 bool CThreadPool::Stop( int timeout )
 {
+	{
+		AUTO_LOCK( g_ThreadPoolsMutex );
+		g_ThreadPools.FindAndRemove( this );
+	}
+
 	for ( int i = 0; i < m_Threads.Count(); i++ )
 	{
-		m_Threads[i]->CallWorker( TPM_EXIT );
+		m_Threads[i]->CallWorker( TPM_EXIT, 0 );
+		m_Threads[i]->Wake();
 	}
 
+	// Running workers may still steal from any deque, so nothing is freed
+	// until every one of them has exited
 	for ( int i = 0; i < m_Threads.Count(); ++i )
 	{
 		while( m_Threads[i]->IsAlive() )
 		{
 			ThreadSleep( 0 );
 		}
+	}
+
+	for ( int i = 0; i < m_Threads.Count(); ++i )
+	{
+		m_Threads[i]->AbortLocalJobs();
 		delete m_Threads[i];
 	}
 
 	m_nJobs = 0;
 	m_SharedQueue.Flush();
 	m_nIdleThreads = 0;
+	m_nParkedThreads = 0;
 	m_Threads.RemoveAll();
 	m_IdleEvents.RemoveAll();
 
@@ -1156,6 +1577,77 @@ CJob *CThreadPool::GetDummyJob()
 	return &dummyJob;
 }
 
+//---------------------------------------------------------
+// Statistics
+//---------------------------------------------------------
+
+void CThreadPool::PrintStats()
+{
+	int nSharedDepth = m_SharedQueue.Count();
+	Msg( "%s: %d threads, %d idle, %d parked, %d jobs pending, shared queue depth %d (max %d)\n",
+		m_szName, m_Threads.Count(), (int)m_nIdleThreads, (int)m_nParkedThreads, (int)m_nJobs, MAX( nSharedDepth, 0 ), (int)m_nMaxSharedDepth );
+	Msg( "  wakes %d, deque overflows %d, jobs run by waiting threads %d (%d stolen)\n",
+		(int)m_nWakes, (int)m_nLocalOverflows, (int)m_nYieldJobs, (int)m_nYieldSteals );
+	Msg( "  thread   direct    local   shared   stolen  failsteal  spinwake    parks  idle(s)  depth(max)\n" );
+
+	for ( int i = 0; i < m_Threads.Count(); i++ )
+	{
+		CJobThread *pThread = m_Threads[i];
+		const JobThreadStats_t &stats = pThread->AccessStats();
+		int nDepth = pThread->AccessDirectQueue().Count();
+		for ( int j = JP_HIGH; j >= 0; --j )
+		{
+			nDepth += pThread->AccessLocalDeque( (JobPriority_t)j ).Count();
+		}
+
+		Msg( "  %6d %8d %8d %8d %8d %10d %9d %8d %8.2f  %d(%d)\n",
+			i, stats.m_nDirectJobs, stats.m_nLocalJobs, stats.m_nSharedJobs, stats.m_nStolenJobs, stats.m_nFailedSteals,
+			stats.m_nSpinWakes, stats.m_nParks, stats.m_flIdleTime, MAX( nDepth, 0 ), stats.m_nMaxLocalDepth );
+	}
+}
+
+//---------------------------------------------------------
+
+void CThreadPool::ResetStats()
+{
+	m_nWakes = 0;
+	m_nLocalOverflows = 0;
+	m_nYieldJobs = 0;
+	m_nYieldSteals = 0;
+	m_nMaxSharedDepth = 0;
+
+	for ( int i = 0; i < m_Threads.Count(); i++ )
+	{
+		m_Threads[i]->AccessStats().Reset();
+	}
+}
+
+//---------------------------------------------------------
+
+CON_COMMAND( threadpool_stats, "Print thread pool job, steal, idle time and queue depth counters. 'threadpool_stats reset' clears them." )
+{
+	bool bReset = ( args.ArgC() > 1 && !V_stricmp( args[1], "reset" ) );
+
+	AUTO_LOCK( g_ThreadPoolsMutex );
+	if ( !g_ThreadPools.Count() )
+	{
+		Msg( "No thread pools running\n" );
+		return;
+	}
+
+	for ( int i = 0; i < g_ThreadPools.Count(); i++ )
+	{
+		if ( bReset )
+		{
+			g_ThreadPools[i]->ResetStats();
+		}
+		else
+		{
+			g_ThreadPools[i]->PrintStats();
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 
 
@@ -1374,6 +1866,89 @@ void TestForcedExecute()
 	Msg( "TestForcedExecute DONE\n" );
 }
 
+CInterlockedInt g_nStealLeaves;
+CInterlockedInt g_nStealItems;
+
+void ProcessStealItem( int &item )
+{
+	item++;
+	g_nStealItems++;
+}
+
+class CStealTestJob : public CJob
+{
+public:
+	CStealTestJob( int nDepth ) : m_nDepth( nDepth ) {}
+
+	virtual JobStatus_t DoExecute()
+	{
+		if ( m_nDepth == 0 )
+		{
+			// Nested parallel work on a worker must run inline, not deadlock
+			int items[16] = { 0 };
+			ParallelProcess( "StealTest", g_pTestThreadPool, items, ARRAYSIZE( items ), &ProcessStealItem );
+			g_nStealLeaves++;
+			return JOB_OK;
+		}
+
+		// Children land on this worker's deque; idle workers have to steal them
+		CJob *pChildren[4];
+		for ( int i = 0; i < ARRAYSIZE( pChildren ); i++ )
+		{
+			pChildren[i] = new CStealTestJob( m_nDepth - 1 );
+			pChildren[i]->SetFlags( JF_QUEUE );
+			g_pTestThreadPool->AddJob( pChildren[i] );
+		}
+		// Help out on the test pool (WaitForFinish would yield to the global one).
+		// One job at a time, POSIX ThreadWaitForEvents only waits on the first event
+		for ( int i = 0; i < ARRAYSIZE( pChildren ); i++ )
+		{
+			g_pTestThreadPool->YieldWait( &pChildren[i], 1 );
+			pChildren[i]->Release();
+		}
+		return JOB_OK;
+	}
+
+	int m_nDepth;
+};
+
+void TestWorkStealing()
+{
+	Msg( "TestWorkStealing\n" );
+	for ( int i = 2; i <= 4; i++ )
+	{
+		g_nStealLeaves = 0;
+		g_nStealItems = 0;
+
+		ThreadPoolStartParams_t params;
+		params.nThreads = i;
+		g_pTestThreadPool->Start( params, "Tst" );
+
+		CFastTimer timer;
+		timer.Start();
+
+		CJob *pRoot = new CStealTestJob( 3 );
+		pRoot->SetFlags( JF_QUEUE );
+		g_pTestThreadPool->AddJob( pRoot );
+		g_pTestThreadPool->YieldWait( &pRoot, 1 );
+		pRoot->Release();
+
+		timer.End();
+
+		// 4^3 leaves of 16 items each
+		if ( g_nStealLeaves != 64 || g_nStealItems != 64 * 16 )
+		{
+			Msg( "TestWorkStealing failed! %d leaves, %d items\n", (int)g_nStealLeaves, (int)g_nStealItems );
+			DebuggerBreakIfDebugging();
+		}
+
+		Msg( "ThreadPoolTest:         %d threads -- %fms\n", i, timer.GetDuration().GetMillisecondsF() );
+		g_pTestThreadPool->PrintStats();
+		g_pTestThreadPool->Stop();
+	}
+	Msg( "TestWorkStealing DONE\n" );
+}
+
 } // namespace ThreadPoolTest
 
 void RunThreadPoolTests()
@@ -1456,4 +2031,5 @@ void RunThreadPoolTests()
 #endif
 
 	ThreadPoolTest::TestForcedExecute();
+	ThreadPoolTest::TestWorkStealing();
 }
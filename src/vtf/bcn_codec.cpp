@@ -0,0 +1,852 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: BC1/BC3/BC4/BC5 block compression, see bcn_codec.h.
+//
+// Color blocks start from the texels' bounding box, inset slightly, with the
+// diagonal picked from the signs of the red/green and blue/green covariance.
+// Each texel then takes its nearest palette entry and the endpoints are refit
+// to those indices by least squares. Single channel blocks use the block's
+// min and max with the closed form index selection described at
+// http://fgiesen.wordpress.com/2009/12/15/dxt5-alpha-block-index-determination/
+//
+// The per texel work runs four texels per SSE2 instruction. Every SSE2 kernel
+// has a scalar twin that produces identical results for other platforms.
+//
+//=============================================================================//
+
+#include "vtf/bcn_codec.h"
+#include "tier0/dbg.h"
+#include "tier0/platform.h"
+#include "mathlib/mathlib.h"
+#include <math.h>
+#include <string.h>
+
+#if !defined( _X360 ) && !defined( _PS3 )
+#include <emmintrin.h>
+#define BCN_SSE2 1
+#endif
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// RGB565 endpoints
+//-----------------------------------------------------------------------------
+static inline int Expand5( int v )
+{
+	return ( v << 3 ) | ( v >> 2 );
+}
+
+static inline int Expand6( int v )
+{
+	return ( v << 2 ) | ( v >> 4 );
+}
+
+static inline uint16 PackRGB565( const int *pRGB )
+{
+	int r = ( pRGB[0] * 31 + 127 ) / 255;
+	int g = ( pRGB[1] * 63 + 127 ) / 255;
+	int b = ( pRGB[2] * 31 + 127 ) / 255;
+	return (uint16)( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+static inline void UnpackRGB565( uint16 nColor, int *pRGB )
+{
+	pRGB[0] = Expand5( ( nColor >> 11 ) & 31 );
+	pRGB[1] = Expand6( ( nColor >> 5 ) & 63 );
+	pRGB[2] = Expand5( nColor & 31 );
+}
+
+// The four color palette, in index order
+static void EvalColorPalette( uint16 nColor0, uint16 nColor1, int pPalette[4][3] )
+{
+	UnpackRGB565( nColor0, pPalette[0] );
+	UnpackRGB565( nColor1, pPalette[1] );
+	for ( int i = 0; i < 3; ++i )
+	{
+		pPalette[2][i] = ( 2 * pPalette[0][i] + pPalette[1][i] ) / 3;
+		pPalette[3][i] = ( pPalette[0][i] + 2 * pPalette[1][i] ) / 3;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Best endpoint pair for a block of one color, per channel value: the pair
+// whose 2/3 interpolant (index 2) comes closest, preferring close endpoints
+// so decoders that round the interpolant differently still agree.
+//-----------------------------------------------------------------------------
+class CSolidColorTable
+{
+public:
+	CSolidColorTable()
+	{
+		Build( m_Match5, 32, Expand5 );
+		Build( m_Match6, 64, Expand6 );
+	}
+
+	uint8 m_Match5[256][2];
+	uint8 m_Match6[256][2];
+
+private:
+	static void Build( uint8 pMatch[256][2], int nSize, int (*pfnExpand)( int ) )
+	{
+		for ( int v = 0; v < 256; ++v )
+		{
+			int nBestErr = INT_MAX;
+			for ( int a = 0; a < nSize; ++a )
+			{
+				int ea = pfnExpand( a );
+				for ( int b = 0; b < nSize; ++b )
+				{
+					int eb = pfnExpand( b );
+					int nErr = abs( ( 2 * ea + eb ) / 3 - v ) * 1024 + abs( ea - eb );
+					if ( nErr < nBestErr )
+					{
+						nBestErr = nErr;
+						pMatch[v][0] = (uint8)a;
+						pMatch[v][1] = (uint8)b;
+					}
+				}
+			}
+		}
+	}
+};
+
+static CSolidColorTable s_SolidColorTable;
+
+
+//-----------------------------------------------------------------------------
+// Kernels. Blocks are 16 RGBA8888 texels in row order.
+//-----------------------------------------------------------------------------
+#ifdef BCN_SSE2
+
+static inline __m128i LoadTexelRow( const uint32 *pTexels, int nRow )
+{
+	return _mm_load_si128( (const __m128i *)( pTexels + nRow * 4 ) );
+}
+
+// Sums adjacent pairs of 32 bit lanes: ( a0+a1, a2+a3, b0+b1, b2+b3 )
+static inline __m128i AddPairs( __m128i a, __m128i b )
+{
+	__m128 fa = _mm_castsi128_ps( a );
+	__m128 fb = _mm_castsi128_ps( b );
+	__m128i even = _mm_castps_si128( _mm_shuffle_ps( fa, fb, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+	__m128i odd = _mm_castps_si128( _mm_shuffle_ps( fa, fb, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+	return _mm_add_epi32( even, odd );
+}
+
+static inline __m128i Select( __m128i mask, __m128i a, __m128i b )
+{
+	return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+}
+
+static inline int HorizontalSum( __m128i v )
+{
+	v = _mm_add_epi32( v, _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	v = _mm_add_epi32( v, _mm_shuffle_epi32( v, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	return _mm_cvtsi128_si32( v );
+}
+
+// Spreads the low 16 bits of x to the even bits of the result
+static inline uint32 SpreadBits( uint32 x )
+{
+	x = ( x | ( x << 8 ) ) & 0x00FF00FF;
+	x = ( x | ( x << 4 ) ) & 0x0F0F0F0F;
+	x = ( x | ( x << 2 ) ) & 0x33333333;
+	x = ( x | ( x << 1 ) ) & 0x55555555;
+	return x;
+}
+
+static void ComputeBounds( const uint32 *pTexels, int *pMin, int *pMax )
+{
+	__m128i r0 = LoadTexelRow( pTexels, 0 );
+	__m128i r1 = LoadTexelRow( pTexels, 1 );
+	__m128i r2 = LoadTexelRow( pTexels, 2 );
+	__m128i r3 = LoadTexelRow( pTexels, 3 );
+
+	__m128i mn = _mm_min_epu8( _mm_min_epu8( r0, r1 ), _mm_min_epu8( r2, r3 ) );
+	__m128i mx = _mm_max_epu8( _mm_max_epu8( r0, r1 ), _mm_max_epu8( r2, r3 ) );
+	mn = _mm_min_epu8( mn, _mm_shuffle_epi32( mn, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	mx = _mm_max_epu8( mx, _mm_shuffle_epi32( mx, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	mn = _mm_min_epu8( mn, _mm_shuffle_epi32( mn, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	mx = _mm_max_epu8( mx, _mm_shuffle_epi32( mx, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+
+	uint32 nMin = (uint32)_mm_cvtsi128_si32( mn );
+	uint32 nMax = (uint32)_mm_cvtsi128_si32( mx );
+	for ( int i = 0; i < 3; ++i )
+	{
+		pMin[i] = ( nMin >> ( i * 8 ) ) & 0xFF;
+		pMax[i] = ( nMax >> ( i * 8 ) ) & 0xFF;
+	}
+}
+
+// Red/green and blue/green covariance about pCenter, scaled by 16
+static void ComputeCovariance( const uint32 *pTexels, const int *pCenter, int *pCovRG, int *pCovBG )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i center = _mm_setr_epi16( pCenter[0], pCenter[1], pCenter[2], 0, pCenter[0], pCenter[1], pCenter[2], 0 );
+	const __m128i maskRB = _mm_setr_epi16( -1, 0, -1, 0, -1, 0, -1, 0 );
+
+	__m128i cov = zero;
+	for ( int r = 0; r < 4; ++r )
+	{
+		__m128i texels = LoadTexelRow( pTexels, r );
+		__m128i d[2] = { _mm_sub_epi16( _mm_unpacklo_epi8( texels, zero ), center ), _mm_sub_epi16( _mm_unpackhi_epi8( texels, zero ), center ) };
+		for ( int h = 0; h < 2; ++h )
+		{
+			__m128i dg = _mm_shufflehi_epi16( _mm_shufflelo_epi16( d[h], _MM_SHUFFLE( 1, 1, 1, 1 ) ), _MM_SHUFFLE( 1, 1, 1, 1 ) );
+			// ( dr * dg, db * dg ) for each of the two texels
+			cov = _mm_add_epi32( cov, _mm_madd_epi16( _mm_and_si128( d[h], maskRB ), dg ) );
+		}
+	}
+
+	cov = _mm_add_epi32( cov, _mm_shuffle_epi32( cov, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	*pCovRG = _mm_cvtsi128_si32( cov );
+	*pCovBG = _mm_cvtsi128_si32( _mm_shuffle_epi32( cov, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+}
+
+// Picks each texel's nearest palette entry, returns the summed squared error
+static int SelectColorIndices( const uint32 *pTexels, const int pPalette[4][3], uint32 *pIndices )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbMask = _mm_set1_epi32( 0x00FFFFFF );
+
+	__m128i palette[4];
+	for ( int k = 0; k < 4; ++k )
+	{
+		palette[k] = _mm_setr_epi16( pPalette[k][0], pPalette[k][1], pPalette[k][2], 0, pPalette[k][0], pPalette[k][1], pPalette[k][2], 0 );
+	}
+
+	__m128i err = zero;
+	__m128i indices[4];
+	for ( int r = 0; r < 4; ++r )
+	{
+		__m128i texels = _mm_and_si128( LoadTexelRow( pTexels, r ), rgbMask );
+		__m128i lo = _mm_unpacklo_epi8( texels, zero );
+		__m128i hi = _mm_unpackhi_epi8( texels, zero );
+
+		__m128i best = zero, bestIndex = zero;
+		for ( int k = 0; k < 4; ++k )
+		{
+			__m128i dlo = _mm_sub_epi16( lo, palette[k] );
+			__m128i dhi = _mm_sub_epi16( hi, palette[k] );
+			__m128i dist = AddPairs( _mm_madd_epi16( dlo, dlo ), _mm_madd_epi16( dhi, dhi ) );
+			if ( k == 0 )
+			{
+				best = dist;
+				continue;
+			}
+
+			__m128i closer = _mm_cmplt_epi32( dist, best );
+			best = Select( closer, dist, best );
+			bestIndex = Select( closer, _mm_set1_epi32( k ), bestIndex );
+		}
+
+		err = _mm_add_epi32( err, best );
+		indices[r] = bestIndex;
+	}
+
+	// One byte per texel, then gather each index bit plane with movemask
+	__m128i bytes = _mm_packus_epi16( _mm_packs_epi32( indices[0], indices[1] ), _mm_packs_epi32( indices[2], indices[3] ) );
+	uint32 nBit0 = (uint32)_mm_movemask_epi8( _mm_slli_epi16( bytes, 7 ) );
+	uint32 nBit1 = (uint32)_mm_movemask_epi8( _mm_slli_epi16( bytes, 6 ) );
+	*pIndices = SpreadBits( nBit0 ) | ( SpreadBits( nBit1 ) << 1 );
+
+	return HorizontalSum( err );
+}
+
+// Gathers one channel of the block into 16 bytes
+static inline __m128i GatherChannel( const uint32 *pTexels, int nChannel )
+{
+	const __m128i byteMask = _mm_set1_epi32( 0xFF );
+	__m128i shift = _mm_cvtsi32_si128( nChannel * 8 );
+	__m128i c[4];
+	for ( int r = 0; r < 4; ++r )
+	{
+		c[r] = _mm_and_si128( _mm_srl_epi32( LoadTexelRow( pTexels, r ), shift ), byteMask );
+	}
+	return _mm_packus_epi16( _mm_packs_epi32( c[0], c[1] ), _mm_packs_epi32( c[2], c[3] ) );
+}
+
+static void EncodeChannelBlock( const uint32 *pTexels, int nChannel, uint8 *pDst )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i values = GatherChannel( pTexels, nChannel );
+
+	__m128i mn = _mm_min_epu8( values, _mm_srli_si128( values, 8 ) );
+	__m128i mx = _mm_max_epu8( values, _mm_srli_si128( values, 8 ) );
+	mn = _mm_min_epu8( mn, _mm_srli_si128( mn, 4 ) );
+	mx = _mm_max_epu8( mx, _mm_srli_si128( mx, 4 ) );
+	mn = _mm_min_epu8( mn, _mm_srli_si128( mn, 2 ) );
+	mx = _mm_max_epu8( mx, _mm_srli_si128( mx, 2 ) );
+	mn = _mm_min_epu8( mn, _mm_srli_si128( mn, 1 ) );
+	mx = _mm_max_epu8( mx, _mm_srli_si128( mx, 1 ) );
+	int nMin = _mm_cvtsi128_si32( mn ) & 0xFF;
+	int nMax = _mm_cvtsi128_si32( mx ) & 0xFF;
+
+	int nDist = nMax - nMin;
+	int nBias = ( nDist < 8 ) ? ( nDist - 1 ) : ( nDist / 2 + 2 );
+	nBias -= nMin * 7;
+
+	// Scale each value to 0 (min) .. 7 (max), then turn that into an index,
+	// where 0 and 1 are the endpoints and 2..7 the interpolants from max down
+	uint8 pIndices[16];
+	__m128i v[2] = { _mm_unpacklo_epi8( values, zero ), _mm_unpackhi_epi8( values, zero ) };
+	for ( int h = 0; h < 2; ++h )
+	{
+		__m128i a = _mm_add_epi16( _mm_mullo_epi16( v[h], _mm_set1_epi16( 7 ) ), _mm_set1_epi16( nBias ) );
+
+		__m128i t = _mm_cmpgt_epi16( a, _mm_set1_epi16( nDist * 4 - 1 ) );
+		__m128i ind = _mm_and_si128( t, _mm_set1_epi16( 4 ) );
+		a = _mm_sub_epi16( a, _mm_and_si128( t, _mm_set1_epi16( nDist * 4 ) ) );
+
+		t = _mm_cmpgt_epi16( a, _mm_set1_epi16( nDist * 2 - 1 ) );
+		ind = _mm_add_epi16( ind, _mm_and_si128( t, _mm_set1_epi16( 2 ) ) );
+		a = _mm_sub_epi16( a, _mm_and_si128( t, _mm_set1_epi16( nDist * 2 ) ) );
+
+		ind = _mm_sub_epi16( ind, _mm_cmpgt_epi16( a, _mm_set1_epi16( nDist - 1 ) ) );
+
+		ind = _mm_and_si128( _mm_sub_epi16( zero, ind ), _mm_set1_epi16( 7 ) );
+		ind = _mm_xor_si128( ind, _mm_and_si128( _mm_cmpgt_epi16( _mm_set1_epi16( 2 ), ind ), _mm_set1_epi16( 1 ) ) );
+		v[h] = ind;
+	}
+	_mm_storeu_si128( (__m128i *)pIndices, _mm_packus_epi16( v[0], v[1] ) );
+
+	pDst[0] = (uint8)nMax;
+	pDst[1] = (uint8)nMin;
+	uint64 nBits = 0;
+	for ( int i = 0; i < 16; ++i )
+	{
+		nBits |= (uint64)pIndices[i] << ( i * 3 );
+	}
+	for ( int i = 0; i < 6; ++i )
+	{
+		pDst[2 + i] = (uint8)( nBits >> ( i * 8 ) );
+	}
+}
+
+#else // !BCN_SSE2
+
+static void ComputeBounds( const uint32 *pTexels, int *pMin, int *pMax )
+{
+	for ( int i = 0; i < 3; ++i )
+	{
+		pMin[i] = 255;
+		pMax[i] = 0;
+	}
+
+	for ( int t = 0; t < 16; ++t )
+	{
+		for ( int i = 0; i < 3; ++i )
+		{
+			int c = ( pTexels[t] >> ( i * 8 ) ) & 0xFF;
+			pMin[i] = MIN( pMin[i], c );
+			pMax[i] = MAX( pMax[i], c );
+		}
+	}
+}
+
+static void ComputeCovariance( const uint32 *pTexels, const int *pCenter, int *pCovRG, int *pCovBG )
+{
+	int nCovRG = 0, nCovBG = 0;
+	for ( int t = 0; t < 16; ++t )
+	{
+		int dr = (int)( pTexels[t] & 0xFF ) - pCenter[0];
+		int dg = (int)( ( pTexels[t] >> 8 ) & 0xFF ) - pCenter[1];
+		int db = (int)( ( pTexels[t] >> 16 ) & 0xFF ) - pCenter[2];
+		nCovRG += dr * dg;
+		nCovBG += db * dg;
+	}
+	*pCovRG = nCovRG;
+	*pCovBG = nCovBG;
+}
+
+static int SelectColorIndices( const uint32 *pTexels, const int pPalette[4][3], uint32 *pIndices )
+{
+	int nErr = 0;
+	uint32 nIndices = 0;
+	for ( int t = 0; t < 16; ++t )
+	{
+		int r = pTexels[t] & 0xFF;
+		int g = ( pTexels[t] >> 8 ) & 0xFF;
+		int b = ( pTexels[t] >> 16 ) & 0xFF;
+
+		int nBest = INT_MAX, nBestIndex = 0;
+		for ( int k = 0; k < 4; ++k )
+		{
+			int dr = r - pPalette[k][0], dg = g - pPalette[k][1], db = b - pPalette[k][2];
+			int nDist = dr * dr + dg * dg + db * db;
+			if ( nDist < nBest )
+			{
+				nBest = nDist;
+				nBestIndex = k;
+			}
+		}
+
+		nErr += nBest;
+		nIndices |= nBestIndex << ( t * 2 );
+	}
+
+	*pIndices = nIndices;
+	return nErr;
+}
+
+static void EncodeChannelBlock( const uint32 *pTexels, int nChannel, uint8 *pDst )
+{
+	int pValues[16];
+	int nMin = 255, nMax = 0;
+	for ( int t = 0; t < 16; ++t )
+	{
+		pValues[t] = ( pTexels[t] >> ( nChannel * 8 ) ) & 0xFF;
+		nMin = MIN( nMin, pValues[t] );
+		nMax = MAX( nMax, pValues[t] );
+	}
+
+	int nDist = nMax - nMin;
+	int nBias = ( nDist < 8 ) ? ( nDist - 1 ) : ( nDist / 2 + 2 );
+	nBias -= nMin * 7;
+
+	pDst[0] = (uint8)nMax;
+	pDst[1] = (uint8)nMin;
+	uint64 nBits = 0;
+	for ( int t = 0; t < 16; ++t )
+	{
+		int a = pValues[t] * 7 + nBias;
+		int ind = 0;
+		if ( a >= nDist * 4 ) { ind += 4; a -= nDist * 4; }
+		if ( a >= nDist * 2 ) { ind += 2; a -= nDist * 2; }
+		if ( a >= nDist ) { ind += 1; }
+
+		ind = -ind & 7;
+		ind ^= ( 2 > ind );
+		nBits |= (uint64)ind << ( t * 3 );
+	}
+	for ( int i = 0; i < 6; ++i )
+	{
+		pDst[2 + i] = (uint8)( nBits >> ( i * 8 ) );
+	}
+}
+
+#endif // BCN_SSE2
+
+
+//-----------------------------------------------------------------------------
+// Refits the endpoints to the given indices by least squares. Returns false
+// if the indices don't constrain both endpoints.
+//-----------------------------------------------------------------------------
+static bool RefitColorEndpoints( const uint32 *pTexels, uint32 nIndices, uint16 *pColor0, uint16 *pColor1 )
+{
+	// Weight of color 0 in each palette entry, in thirds
+	static const int s_pWeight0[4] = { 3, 0, 2, 1 };
+
+	int nA = 0, nB = 0, nC = 0;
+	int pX0[3] = { 0, 0, 0 }, pX1[3] = { 0, 0, 0 };
+	for ( int t = 0; t < 16; ++t )
+	{
+		int w0 = s_pWeight0[( nIndices >> ( t * 2 ) ) & 3];
+		int w1 = 3 - w0;
+		nA += w0 * w0;
+		nB += w0 * w1;
+		nC += w1 * w1;
+		for ( int i = 0; i < 3; ++i )
+		{
+			int c = ( pTexels[t] >> ( i * 8 ) ) & 0xFF;
+			pX0[i] += w0 * c;
+			pX1[i] += w1 * c;
+		}
+	}
+
+	int nDet = nA * nC - nB * nB;
+	if ( nDet == 0 )
+		return false;
+
+	float flScale = 3.0f / nDet;
+	int pRGB0[3], pRGB1[3];
+	for ( int i = 0; i < 3; ++i )
+	{
+		pRGB0[i] = clamp( (int)( ( nC * pX0[i] - nB * pX1[i] ) * flScale + 0.5f ), 0, 255 );
+		pRGB1[i] = clamp( (int)( ( nA * pX1[i] - nB * pX0[i] ) * flScale + 0.5f ), 0, 255 );
+	}
+
+	*pColor0 = PackRGB565( pRGB0 );
+	*pColor1 = PackRGB565( pRGB1 );
+	return true;
+}
+
+static inline void WriteColorBlock( uint8 *pDst, uint16 nColor0, uint16 nColor1, uint32 nIndices )
+{
+	// Four color mode needs color0 > color1. Swapping the endpoints swaps
+	// index 0 with 1 and 2 with 3; equal endpoints only have index 0 left.
+	if ( nColor0 < nColor1 )
+	{
+		V_swap( nColor0, nColor1 );
+		nIndices ^= 0x55555555;
+	}
+	else if ( nColor0 == nColor1 )
+	{
+		nIndices = 0;
+	}
+
+	pDst[0] = (uint8)nColor0;
+	pDst[1] = (uint8)( nColor0 >> 8 );
+	pDst[2] = (uint8)nColor1;
+	pDst[3] = (uint8)( nColor1 >> 8 );
+	pDst[4] = (uint8)nIndices;
+	pDst[5] = (uint8)( nIndices >> 8 );
+	pDst[6] = (uint8)( nIndices >> 16 );
+	pDst[7] = (uint8)( nIndices >> 24 );
+}
+
+static void EncodeColorBlock( const uint32 *pTexels, uint8 *pDst, int nRefinePasses )
+{
+	int pMin[3], pMax[3];
+	ComputeBounds( pTexels, pMin, pMax );
+
+	if ( pMin[0] == pMax[0] && pMin[1] == pMax[1] && pMin[2] == pMax[2] )
+	{
+		uint16 nColor0 = (uint16)( ( s_SolidColorTable.m_Match5[pMin[0]][0] << 11 ) | ( s_SolidColorTable.m_Match6[pMin[1]][0] << 5 ) | s_SolidColorTable.m_Match5[pMin[2]][0] );
+		uint16 nColor1 = (uint16)( ( s_SolidColorTable.m_Match5[pMin[0]][1] << 11 ) | ( s_SolidColorTable.m_Match6[pMin[1]][1] << 5 ) | s_SolidColorTable.m_Match5[pMin[2]][1] );
+		WriteColorBlock( pDst, nColor0, nColor1, 0xAAAAAAAA );
+		return;
+	}
+
+	int pCenter[3];
+	for ( int i = 0; i < 3; ++i )
+	{
+		pCenter[i] = ( pMin[i] + pMax[i] + 1 ) >> 1;
+
+		// Pull the box in by 1/16th of its size; the extremes are rarely
+		// worth spending an endpoint on
+		int nInset = ( pMax[i] - pMin[i] ) >> 4;
+		pMin[i] += nInset;
+		pMax[i] -= nInset;
+	}
+
+	// The box's main diagonal runs from min to max; flip red or blue when
+	// they trend against green
+	int nCovRG, nCovBG;
+	ComputeCovariance( pTexels, pCenter, &nCovRG, &nCovBG );
+	if ( nCovRG < 0 )
+	{
+		V_swap( pMin[0], pMax[0] );
+	}
+	if ( nCovBG < 0 )
+	{
+		V_swap( pMin[2], pMax[2] );
+	}
+
+	uint16 nColor0 = PackRGB565( pMax );
+	uint16 nColor1 = PackRGB565( pMin );
+
+	int pPalette[4][3];
+	EvalColorPalette( nColor0, nColor1, pPalette );
+	uint32 nIndices;
+	int nErr = SelectColorIndices( pTexels, pPalette, &nIndices );
+
+	for ( int nPass = 0; nPass < nRefinePasses && nErr > 0; ++nPass )
+	{
+		uint16 nRefit0, nRefit1;
+		if ( !RefitColorEndpoints( pTexels, nIndices, &nRefit0, &nRefit1 ) )
+			break;
+
+		if ( nRefit0 == nColor0 && nRefit1 == nColor1 )
+			break;
+
+		EvalColorPalette( nRefit0, nRefit1, pPalette );
+		uint32 nRefitIndices;
+		int nRefitErr = SelectColorIndices( pTexels, pPalette, &nRefitIndices );
+		if ( nRefitErr >= nErr )
+			break;
+
+		nColor0 = nRefit0;
+		nColor1 = nRefit1;
+		nIndices = nRefitIndices;
+		nErr = nRefitErr;
+	}
+
+	WriteColorBlock( pDst, nColor0, nColor1, nIndices );
+}
+
+
+//-----------------------------------------------------------------------------
+// Decoding
+//-----------------------------------------------------------------------------
+static void DecodeColorBlock( const uint8 *pSrc, uint32 *pTexels, bool bForceFourColor )
+{
+	uint16 nColor0 = pSrc[0] | ( pSrc[1] << 8 );
+	uint16 nColor1 = pSrc[2] | ( pSrc[3] << 8 );
+
+	int pRGB[4][3];
+	UnpackRGB565( nColor0, pRGB[0] );
+	UnpackRGB565( nColor1, pRGB[1] );
+
+	uint32 pPalette[4];
+	bool bFourColor = bForceFourColor || ( nColor0 > nColor1 );
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( bFourColor )
+		{
+			pRGB[2][i] = ( 2 * pRGB[0][i] + pRGB[1][i] ) / 3;
+			pRGB[3][i] = ( pRGB[0][i] + 2 * pRGB[1][i] ) / 3;
+		}
+		else
+		{
+			pRGB[2][i] = ( pRGB[0][i] + pRGB[1][i] ) / 2;
+			pRGB[3][i] = 0;
+		}
+	}
+	for ( int k = 0; k < 4; ++k )
+	{
+		pPalette[k] = pRGB[k][0] | ( pRGB[k][1] << 8 ) | ( pRGB[k][2] << 16 ) | 0xFF000000;
+	}
+	if ( !bFourColor )
+	{
+		// transparent black
+		pPalette[3] = 0;
+	}
+
+	uint32 nIndices = pSrc[4] | ( pSrc[5] << 8 ) | ( pSrc[6] << 16 ) | ( (uint32)pSrc[7] << 24 );
+	for ( int t = 0; t < 16; ++t, nIndices >>= 2 )
+	{
+		pTexels[t] = pPalette[nIndices & 3];
+	}
+}
+
+static void DecodeChannelBlock( const uint8 *pSrc, uint32 *pTexels, int nChannel )
+{
+	int pPalette[8];
+	pPalette[0] = pSrc[0];
+	pPalette[1] = pSrc[1];
+	if ( pPalette[0] > pPalette[1] )
+	{
+		for ( int i = 1; i < 7; ++i )
+		{
+			pPalette[i + 1] = ( ( 7 - i ) * pPalette[0] + i * pPalette[1] ) / 7;
+		}
+	}
+	else
+	{
+		for ( int i = 1; i < 5; ++i )
+		{
+			pPalette[i + 1] = ( ( 5 - i ) * pPalette[0] + i * pPalette[1] ) / 5;
+		}
+		pPalette[6] = 0;
+		pPalette[7] = 255;
+	}
+
+	uint64 nBits = 0;
+	for ( int i = 0; i < 6; ++i )
+	{
+		nBits |= (uint64)pSrc[2 + i] << ( i * 8 );
+	}
+
+	int nShift = nChannel * 8;
+	uint32 nKeep = ~( 0xFFu << nShift );
+	for ( int t = 0; t < 16; ++t, nBits >>= 3 )
+	{
+		pTexels[t] = ( pTexels[t] & nKeep ) | ( pPalette[nBits & 7] << nShift );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Images
+//-----------------------------------------------------------------------------
+static int GetBlockSize( ImageFormat fmt )
+{
+	switch ( fmt )
+	{
+	case IMAGE_FORMAT_DXT1:
+	case IMAGE_FORMAT_DXT1_RUNTIME:
+	case IMAGE_FORMAT_ATI1N:
+		return 8;
+	default:
+		return 16;
+	}
+}
+
+bool BCn_IsSupportedFormat( ImageFormat fmt )
+{
+	switch ( fmt )
+	{
+	case IMAGE_FORMAT_DXT1:
+	case IMAGE_FORMAT_DXT1_RUNTIME:
+	case IMAGE_FORMAT_DXT5:
+	case IMAGE_FORMAT_DXT5_RUNTIME:
+	case IMAGE_FORMAT_ATI1N:
+	case IMAGE_FORMAT_ATI2N:
+		return true;
+	default:
+		return false;
+	}
+}
+
+int BCn_GetChannelMask( ImageFormat fmt )
+{
+	switch ( fmt )
+	{
+	case IMAGE_FORMAT_DXT1:
+	case IMAGE_FORMAT_DXT1_RUNTIME:
+		return BCN_CHANNEL_RGB;
+	case IMAGE_FORMAT_DXT5:
+	case IMAGE_FORMAT_DXT5_RUNTIME:
+		return BCN_CHANNEL_RGBA;
+	case IMAGE_FORMAT_ATI1N:
+		return BCN_CHANNEL_R;
+	case IMAGE_FORMAT_ATI2N:
+		return BCN_CHANNEL_R | BCN_CHANNEL_G;
+	default:
+		return 0;
+	}
+}
+
+static void LoadBlock( const uint8 *pRGBA8888, int nWidth, int nHeight, int x, int y, uint32 *pTexels )
+{
+	for ( int j = 0; j < 4; ++j )
+	{
+		const uint32 *pRow = (const uint32 *)( pRGBA8888 + MIN( y + j, nHeight - 1 ) * nWidth * 4 );
+		if ( x + 4 <= nWidth )
+		{
+			memcpy( pTexels + j * 4, pRow + x, 4 * sizeof( uint32 ) );
+		}
+		else
+		{
+			for ( int i = 0; i < 4; ++i )
+			{
+				pTexels[j * 4 + i] = pRow[MIN( x + i, nWidth - 1 )];
+			}
+		}
+	}
+}
+
+void BCn_CompressImage( const uint8 *pRGBA8888, int nWidth, int nHeight, uint8 *pDst, ImageFormat fmt, int nRefinePasses )
+{
+	Assert( BCn_IsSupportedFormat( fmt ) );
+
+	int nBlockSize = GetBlockSize( fmt );
+	int nBlocksWide = ( nWidth + 3 ) >> 2;
+	int nBlocksHigh = ( nHeight + 3 ) >> 2;
+
+	ALIGN16 uint32 pTexels[16] ALIGN16_POST;
+	for ( int by = 0; by < nBlocksHigh; ++by )
+	{
+		for ( int bx = 0; bx < nBlocksWide; ++bx, pDst += nBlockSize )
+		{
+			LoadBlock( pRGBA8888, nWidth, nHeight, bx * 4, by * 4, pTexels );
+
+			switch ( fmt )
+			{
+			case IMAGE_FORMAT_DXT1:
+			case IMAGE_FORMAT_DXT1_RUNTIME:
+				EncodeColorBlock( pTexels, pDst, nRefinePasses );
+				break;
+
+			case IMAGE_FORMAT_DXT5:
+			case IMAGE_FORMAT_DXT5_RUNTIME:
+				EncodeChannelBlock( pTexels, 3, pDst );
+				EncodeColorBlock( pTexels, pDst + 8, nRefinePasses );
+				break;
+
+			case IMAGE_FORMAT_ATI1N:
+				EncodeChannelBlock( pTexels, 0, pDst );
+				break;
+
+			case IMAGE_FORMAT_ATI2N:
+				EncodeChannelBlock( pTexels, 0, pDst );
+				EncodeChannelBlock( pTexels, 1, pDst + 8 );
+				break;
+
+			default:
+				return;
+			}
+		}
+	}
+}
+
+void BCn_DecompressImage( const uint8 *pSrc, int nWidth, int nHeight, uint8 *pRGBA8888, ImageFormat fmt )
+{
+	Assert( BCn_IsSupportedFormat( fmt ) );
+
+	int nBlockSize = GetBlockSize( fmt );
+	int nBlocksWide = ( nWidth + 3 ) >> 2;
+	int nBlocksHigh = ( nHeight + 3 ) >> 2;
+
+	uint32 pTexels[16];
+	for ( int by = 0; by < nBlocksHigh; ++by )
+	{
+		for ( int bx = 0; bx < nBlocksWide; ++bx, pSrc += nBlockSize )
+		{
+			switch ( fmt )
+			{
+			case IMAGE_FORMAT_DXT1:
+			case IMAGE_FORMAT_DXT1_RUNTIME:
+				DecodeColorBlock( pSrc, pTexels, false );
+				break;
+
+			case IMAGE_FORMAT_DXT5:
+			case IMAGE_FORMAT_DXT5_RUNTIME:
+				DecodeColorBlock( pSrc + 8, pTexels, true );
+				DecodeChannelBlock( pSrc, pTexels, 3 );
+				break;
+
+			case IMAGE_FORMAT_ATI1N:
+				for ( int t = 0; t < 16; ++t )
+				{
+					pTexels[t] = 0xFF000000;
+				}
+				DecodeChannelBlock( pSrc, pTexels, 0 );
+				break;
+
+			case IMAGE_FORMAT_ATI2N:
+				for ( int t = 0; t < 16; ++t )
+				{
+					pTexels[t] = 0xFF000000;
+				}
+				DecodeChannelBlock( pSrc, pTexels, 0 );
+				DecodeChannelBlock( pSrc + 8, pTexels, 1 );
+				break;
+
+			default:
+				return;
+			}
+
+			int nCopyWidth = MIN( 4, nWidth - bx * 4 );
+			int nCopyHeight = MIN( 4, nHeight - by * 4 );
+			for ( int j = 0; j < nCopyHeight; ++j )
+			{
+				uint8 *pDstRow = pRGBA8888 + ( ( by * 4 + j ) * nWidth + bx * 4 ) * 4;
+				memcpy( pDstRow, pTexels + j * 4, nCopyWidth * sizeof( uint32 ) );
+			}
+		}
+	}
+}
+
+double BCn_ComputePSNR( const uint8 *pRGBA8888A, const uint8 *pRGBA8888B, int nPixels, int nChannelMask )
+{
+	double flSumSq = 0.0;
+	int nChannels = 0;
+	for ( int c = 0; c < 4; ++c )
+	{
+		if ( !( nChannelMask & ( 1 << c ) ) )
+			continue;
+
+		++nChannels;
+		int64 nChannelSumSq = 0;
+		for ( int i = 0; i < nPixels; ++i )
+		{
+			int d = (int)pRGBA8888A[i * 4 + c] - (int)pRGBA8888B[i * 4 + c];
+			nChannelSumSq += d * d;
+		}
+		flSumSq += (double)nChannelSumSq;
+	}
+
+	if ( !nChannels || !nPixels )
+		return 0.0;
+
+	double flMSE = flSumSq / ( (double)nPixels * nChannels );
+	if ( flMSE <= 0.0 )
+		return 999.0;
+
+	return 10.0 * log10( 255.0 * 255.0 / flMSE );
+}
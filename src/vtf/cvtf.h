@@ -213,7 +213,7 @@ public:
 	virtual unsigned char *LowResImageData();
 
 	// Converts the texture's image format. Use IMAGE_FORMAT_DEFAULT
-	virtual void ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV );
+	virtual void ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV, bool bImageLoader );
 
 	// Generate spheremap based on the current cube faces (only works for cubemaps)
 	// The look dir indicates the direction of the center of the sphere
@@ -16,6 +16,8 @@
 #include "s3tc_decode.h"
 #include "utlvector.h"
 #include "vprof_telemetry.h"
+#include "vtf/bcn_codec.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1856,11 +1858,68 @@ void CVTFTexture::ComputeMipLevelSubRect( Rect_t *pSrcRect, int nMipLevel, Rect_
 }
 
 
+//-----------------------------------------------------------------------------
+// Compression to BC formats goes through the native encoder in bands of block
+// rows, so that a single large top mip still spreads across the thread pool
+//-----------------------------------------------------------------------------
+#define BCN_CONVERT_BAND_HEIGHT		64
+
+struct BCnConvertBand_t
+{
+	const unsigned char *m_pSrc;
+	unsigned char *m_pDst;
+	ImageFormat m_SrcFormat;
+	ImageFormat m_DstFormat;
+	int m_nWidth;
+	int m_nHeight;
+};
+
+static bool CanConvertWithBCnEncoder( ImageFormat srcFormat, ImageFormat dstFormat )
+{
+	// The bitmap DXT decoders aren't thread safe, so compressed sources keep
+	// going through ImageLoader
+	return BCn_IsSupportedFormat( dstFormat ) && !ImageLoader::IsCompressed( srcFormat ) &&
+		ImageLoader::ImageFormatInfo( srcFormat ).m_NumBytes <= 4;
+}
+
+static void ConvertBCnBand( BCnConvertBand_t &band )
+{
+	if ( band.m_SrcFormat == IMAGE_FORMAT_RGBA8888 )
+	{
+		BCn_CompressImage( band.m_pSrc, band.m_nWidth, band.m_nHeight, band.m_pDst, band.m_DstFormat );
+		return;
+	}
+
+	int nRGBASize = ImageLoader::GetMemRequired( band.m_nWidth, band.m_nHeight, 1, IMAGE_FORMAT_RGBA8888, false );
+	unsigned char *pRGBA = new unsigned char[ nRGBASize ];
+	if ( ImageLoader::ConvertImageFormat( band.m_pSrc, band.m_SrcFormat, pRGBA, IMAGE_FORMAT_RGBA8888, band.m_nWidth, band.m_nHeight ) )
+	{
+		BCn_CompressImage( pRGBA, band.m_nWidth, band.m_nHeight, band.m_pDst, band.m_DstFormat );
+	}
+	delete [] pRGBA;
+}
+
+static void AddBCnConvertBands( CUtlVector<BCnConvertBand_t> &bands, const unsigned char *pSrc, ImageFormat srcFormat,
+	unsigned char *pDst, ImageFormat dstFormat, int nWidth, int nHeight )
+{
+	for ( int y = 0; y < nHeight; y += BCN_CONVERT_BAND_HEIGHT )
+	{
+		BCnConvertBand_t &band = bands[ bands.AddToTail() ];
+		band.m_pSrc = pSrc + ImageLoader::GetMemRequired( nWidth, y, 1, srcFormat, false );
+		band.m_pDst = pDst + ImageLoader::GetMemRequired( nWidth, y, 1, dstFormat, false );
+		band.m_SrcFormat = srcFormat;
+		band.m_DstFormat = dstFormat;
+		band.m_nWidth = nWidth;
+		band.m_nHeight = MIN( BCN_CONVERT_BAND_HEIGHT, nHeight - y );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Converts the texture's image format. Use IMAGE_FORMAT_DEFAULT
 // if you want to be able to use various tool functions below
 //-----------------------------------------------------------------------------
-void CVTFTexture::ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV )
+void CVTFTexture::ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV, bool bImageLoader )
 {
 	if ( !m_pImageData )
 	{
@@ -1899,6 +1958,9 @@ void CVTFTexture::ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV )
 	if ( !pConvertedImage )
 		return;
 
+	bool bUseBCnEncoder = !bNormalToDUDV && !bImageLoader && CanConvertWithBCnEncoder( m_Format, fmt );
+	CUtlVector<BCnConvertBand_t> bcnBands;
+
 	for (int iMip = 0; iMip < m_nMipCount; ++iMip)
 	{
 		int nMipWidth, nMipHeight, nMipDepth;
@@ -1940,6 +2002,10 @@ void CVTFTexture::ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV )
 							return;
 						}
 					}
+					else if ( bUseBCnEncoder )
+					{
+						AddBCnConvertBands( bcnBands, pSrcData, m_Format, pDstData, fmt, nMipWidth, nMipHeight );
+					}
 					else
 					{
 						ImageLoader::ConvertImageFormat( pSrcData, m_Format, 
@@ -1950,6 +2016,11 @@ void CVTFTexture::ConvertImageFormat( ImageFormat fmt, bool bNormalToDUDV )
 		}
 	}
 
+	if ( bcnBands.Count() )
+	{
+		ParallelProcess( "CVTFTexture::ConvertImageFormat", bcnBands.Base(), bcnBands.Count(), &ConvertBCnBand );
+	}
+
 	if ( !AllocateImageData(iConvertedSize) )
 		return;
 